@@ -329,6 +329,16 @@ if (Pixie16SaveDSPParametersToFile("C:\\XIA\\Pixie16\\Configuration\\test.json")
 }
 //! [Pixie16SaveDSPParametersToFile]
 
+//! [Pixie16SaveExternalFIFODataToFile]
+unsigned int nFIFOWords;
+unsigned short ModNum = 0;
+unsigned short EndOfRunRead = 0;
+if (Pixie16SaveExternalFIFODataToFile("listmodedata_mod0.bin", &nFIFOWords, ModNum,
+                                      EndOfRunRead) < 0) {
+    // Error handling
+}
+//! [Pixie16SaveExternalFIFODataToFile]
+
 //! [Pixie16SaveHistogramToFile]
 unsigned short ModNum = 0;
 if (Pixie16SaveHistogramToFile("C:\\XIA\\Pixie16\\MCA\\histogramdata.bin", ModNum) < 0) {
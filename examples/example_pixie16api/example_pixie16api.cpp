@@ -91,6 +91,7 @@ struct mod_cfg : module_config {
     firmware_spec fw;
     std::string dsp_par;
     fifo_worker_config worker_config;
+    fifo_worker_options worker_options;
     bool has_worker_cfg;
     bool has_firmware_spec;
 };
@@ -210,6 +211,18 @@ void read_config(const std::string& config_file_name, configuration& cfg) {
             mcfg.worker_config.hold_usecs = module["worker"]["hold_usecs"];
             mcfg.worker_config.idle_wait_usecs = module["worker"]["idle_wait_usecs"];
             mcfg.worker_config.run_wait_usecs = module["worker"]["run_wait_usecs"];
+            mcfg.worker_options.struct_size = sizeof(mcfg.worker_options);
+            mcfg.worker_options.interrupt_mode = module["worker"].value("interrupt_mode", 0);
+            mcfg.worker_options.crc_mode = module["worker"].value("crc_mode", 0);
+            mcfg.worker_options.adaptive_mode = module["worker"].value("adaptive_mode", 0);
+            std::string cpus = module["worker"].value("cpus", std::string());
+            std::strncpy(mcfg.worker_options.cpu_list, cpus.c_str(),
+                         PIXIE16_API_WORKER_CPU_LIST_MAX - 1);
+            mcfg.worker_options.cpu_list[PIXIE16_API_WORKER_CPU_LIST_MAX - 1] = '\0';
+            mcfg.worker_options.sched_policy = module["worker"].value("sched_policy", 0);
+            mcfg.worker_options.sched_priority = module["worker"].value("sched_priority", 0);
+            mcfg.worker_options.numa_local = module["worker"].value("numa_local", 0);
+            mcfg.worker_options.max_buffers = module["worker"].value("max_buffers", 0);
             mcfg.has_worker_cfg = true;
         } else {
             mcfg.has_worker_cfg = false;
@@ -878,6 +891,12 @@ void output_module_worker_info(const size_t mod_num) {
                                  "PixieGetWorkerConfiguration", false))
         throw std::runtime_error("Could not get worker information for Module " +
                                  std::to_string(mod_num));
+    fifo_worker_options worker_options;
+    worker_options.struct_size = sizeof(worker_options);
+    if (!verify_api_return_value(PixieGetWorkerOptions(mod_num, &worker_options),
+                                 "PixieGetWorkerOptions", false))
+        throw std::runtime_error("Could not get worker options for Module " +
+                                 std::to_string(mod_num));
     std::cout << LOG("INFO") << "Begin List-Mode FIFO worker information for Module " << mod_num
               << std::endl;
     std::cout << LOG("INFO") << "Bandwidth (MB/sec): " << worker_config.bandwidth_mb_per_sec
@@ -888,6 +907,14 @@ void output_module_worker_info(const size_t mod_num) {
     std::cout << LOG("INFO") << "Hold (usec): " << worker_config.hold_usecs << std::endl;
     std::cout << LOG("INFO") << "Idle wait (usec): " << worker_config.idle_wait_usecs << std::endl;
     std::cout << LOG("INFO") << "Run wait (usec): " << worker_config.run_wait_usecs << std::endl;
+    std::cout << LOG("INFO") << "Max buffers : " << worker_options.max_buffers << std::endl;
+    std::cout << LOG("INFO") << "Interrupt mode: " << worker_options.interrupt_mode << std::endl;
+    std::cout << LOG("INFO") << "CRC mode: " << worker_options.crc_mode << std::endl;
+    std::cout << LOG("INFO") << "Adaptive mode: " << worker_options.adaptive_mode << std::endl;
+    std::cout << LOG("INFO") << "CPUs: " << worker_options.cpu_list << std::endl;
+    std::cout << LOG("INFO") << "Scheduling policy: " << worker_options.sched_policy
+              << " priority: " << worker_options.sched_priority << std::endl;
+    std::cout << LOG("INFO") << "NUMA local: " << worker_options.numa_local << std::endl;
     std::cout << LOG("INFO") << "End List-Mode FIFO worker information for Module " << mod_num
               << std::endl;
 }
@@ -963,6 +990,10 @@ bool set_workers(configuration& cfg) {
                         PixieSetWorkerConfiguration(mod.number, &mod.worker_config),
                         "PixieSetWorkerConfiguration", false))
                     return false;
+                if (!verify_api_return_value(
+                        PixieSetWorkerOptions(mod.number, &mod.worker_options),
+                        "PixieSetWorkerOptions", false))
+                    return false;
             }
             output_module_info(mod);
             output_module_worker_info(mod.number);
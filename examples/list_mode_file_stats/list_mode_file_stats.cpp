@@ -20,13 +20,16 @@
  * @brief Ingests a list-mode data file and validates its contents. Part of P16-502.
  */
 
+#include <algorithm>
 #include <chrono>
 #include <cmath>
 #include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <map>
+#include <thread>
 #include <vector>
 
 #include <args/args.hxx>
@@ -100,6 +103,85 @@ void to_json(nlohmann::json& j, const channel_info& ch) {
 using channel_id = size_t;
 using channel_stats = std::map<channel_id, channel_info>;
 
+/*
+ * The filter time range of the events to include.
+ */
+struct time_range {
+    double start;
+    double end;
+    time_range() : start(0), end(std::numeric_limits<double>::max()) {}
+    bool contains(double time) const {
+        return time >= start && time <= end;
+    }
+};
+
+void update_stats(channel_stats& stats, const xia::pixie::data::list_mode::event_batch& batch,
+                  const time_range& range) {
+    for (size_t e = 0; e < batch.size(); ++e) {
+        if (!range.contains(batch.filter_time[e])) {
+            continue;
+        }
+        const size_t channel = batch.channel[e];
+        const double energy = batch.energy[e];
+        const double time = batch.time[e];
+        auto stat_rec = stats.find(channel);
+        if (stat_rec == stats.end()) {
+            stats[channel] = {channel,
+                              1,
+                              0,
+                              energy,
+                              energy,
+                              energy,
+                              static_cast<double>(batch.event_length[e]),
+                              static_cast<double>(batch.header_length[e]),
+                              time,
+                              time,
+                              static_cast<double>(batch.trace_length[e])};
+        } else {
+            auto ch = &stat_rec->second;
+            ch->count++;
+            ch->energy_ave += energy;
+            ch->trace_length_ave += batch.trace_length[e];
+            ch->header_length_ave += batch.header_length[e];
+            ch->event_length_ave += batch.event_length[e];
+
+            if (energy > ch->energy_max) {
+                ch->energy_max = energy;
+            }
+            if (energy < ch->energy_min) {
+                ch->energy_min = energy;
+            }
+            if (time > ch->time_max) {
+                ch->time_max = time;
+            }
+            if (time < ch->time_min) {
+                ch->time_min = time;
+            }
+        }
+    }
+}
+
+void merge_stats(channel_stats& stats, const channel_stats& other) {
+    for (const auto& stat : other) {
+        auto stat_rec = stats.find(stat.first);
+        if (stat_rec == stats.end()) {
+            stats[stat.first] = stat.second;
+        } else {
+            auto ch = &stat_rec->second;
+            const auto& och = stat.second;
+            ch->count += och.count;
+            ch->energy_ave += och.energy_ave;
+            ch->trace_length_ave += och.trace_length_ave;
+            ch->header_length_ave += och.header_length_ave;
+            ch->event_length_ave += och.event_length_ave;
+            ch->energy_max = std::max(ch->energy_max, och.energy_max);
+            ch->energy_min = std::min(ch->energy_min, och.energy_min);
+            ch->time_max = std::max(ch->time_max, och.time_max);
+            ch->time_min = std::min(ch->time_min, och.time_min);
+        }
+    }
+}
+
 void verify_json_slot(const nlohmann::json& node) {
     if (!node.contains("slot")) {
         throw std::invalid_argument("Missing slot definition in configuration element.");
@@ -154,6 +236,18 @@ int main(int argc, char** argv) {
     args::ValueFlag<std::string> input_flag(arguments, "input_file",
                                             "The input file we'll attempt to decode.",
                                             {'i', "input-file"}, args::Options::Required);
+    args::ValueFlag<size_t> threads_flag(
+        arguments, "threads", "The number of decode threads. Defaults to the number of cores.",
+        {'t', "threads"}, 0);
+    args::Flag index_flag(arguments, "index",
+                          "Build the file's time index and save it next to the file.",
+                          {"index"});
+    args::ValueFlag<double> start_flag(
+        arguments, "start", "Only read the events at or after this filter time in seconds.",
+        {"start"});
+    args::ValueFlag<double> end_flag(
+        arguments, "end", "Only read the events at or before this filter time in seconds.",
+        {"end"});
 
     try {
         parser.ParseCLI(argc, argv);
@@ -167,6 +261,11 @@ int main(int argc, char** argv) {
         return EXIT_FAILURE;
     }
 
+    size_t threads = threads_flag.Get();
+    if (threads == 0) {
+        threads = std::max(std::thread::hardware_concurrency(), 1U);
+    }
+
     configs cfgs;
     try {
         read_config(conf_flag.Get(), cfgs);
@@ -182,107 +281,84 @@ int main(int argc, char** argv) {
     start = std::chrono::system_clock::now();
     std::cout << LOG("INFO") << "Starting to parse " << input_flag.Get() << std::endl;
 
-    std::ifstream input(input_flag.Get(), std::ios::in | std::ios::binary | std::ios::ate);
-    xia::pixie::data::list_mode::buffer remainder;
-    auto record_total = 0;
+    time_range range;
+    if (start_flag) {
+        range.start = start_flag.Get();
+    }
+    if (end_flag) {
+        range.end = end_flag.Get();
+    }
+
+    size_t leftover_words = 0;
+    size_t record_total = 0;
     channel_stats stats;
     try {
-        if (input.fail()) {
-            throw std::ios_base::failure("open: " + input_flag.Get() + ": " + std::strerror(errno));
-        }
-
         static const auto bytes_per_word = 4;
+        xia::pixie::data::list_mode::file_reader reader(input_flag.Get(), cfgs[0].revision,
+                                                        cfgs[0].frequency);
+
+        std::cout << LOG("INFO") << "File Size In Bytes: " << reader.size() * bytes_per_word
+                  << " | File Size In Words: " << reader.size() << " | Threads: " << threads
+                  << " | Memory Mapped: " << std::boolalpha << reader.mapped() << std::endl;
+
         /*
-         * This is the approximate maximum size of a Rev H record (header + trace).
+         * The stats only need the header values, the traces and sums are
+         * skipped.
          */
-        static const auto chunk_size_words = 16398;
-        auto size_bytes = input.tellg();
-        auto size_words = size_bytes / bytes_per_word;
-        auto num_chunks = size_words / chunk_size_words;
-        auto data_vec_size = chunk_size_words;
-        auto max_retries = 10;
-        auto retries = max_retries;
-
-        if (size_words < chunk_size_words) {
-            data_vec_size = size_words;
+        reader.set_fields(xia::pixie::data::list_mode::scan_times |
+                          xia::pixie::data::list_mode::scan_energy |
+                          xia::pixie::data::list_mode::scan_ids);
+
+        if (index_flag || start_flag || end_flag) {
+            namespace list_mode = xia::pixie::data::list_mode;
+            auto index_start = std::chrono::system_clock::now();
+            const auto sidecar = list_mode::time_index::sidecar(input_flag.Get());
+            list_mode::time_index index;
+            if (index_flag || !index.load(sidecar, reader)) {
+                reader.build_index(index);
+                std::cout << LOG("INFO") << "Built the time index of "
+                          << index.checkpoints().size() << " checkpoints in "
+                          << calculate_duration_in_seconds(index_start,
+                                                           std::chrono::system_clock::now())
+                          << " s." << std::endl;
+                if (index_flag) {
+                    index.save(sidecar);
+                    std::cout << LOG("INFO") << "Saved the time index to " << sidecar
+                              << std::endl;
+                }
+            }
+            reader.seek(index, range.start, range.end);
+            std::cout << LOG("INFO") << "Reading words " << reader.position() << " to "
+                      << index.end(range.end) << std::endl;
         }
 
-        std::cout << LOG("INFO") << "File Size In Bytes: " << size_bytes
-                  << " | File Size In Words: " << size_words << std::endl;
-
-        input.seekg(0);
         std::cout << LOG("INFO") << "Starting to decode data." << std::endl;
-        for (int chunk_num = 0; chunk_num <= num_chunks; chunk_num++) {
-            if (retries == 0) {
-                std::cout << LOG("ERROR") << "Failed to resync data stream." << std::endl;
-                break;
-            }
-
-            xia::pixie::data::list_mode::buffer data(data_vec_size, 0);
-            input.read(reinterpret_cast<char*>(&data[0]), chunk_size_words * bytes_per_word);
-            if (!remainder.empty()) {
-                data.insert(data.begin(), remainder.begin(), remainder.end());
-                remainder.clear();
-                remainder.shrink_to_fit();
-            }
-            try {
-                xia::pixie::data::list_mode::records records;
-                xia::pixie::data::list_mode::decode_data_block(
-                    data, cfgs[0].revision, cfgs[0].frequency, records, remainder);
-                record_total += records.size();
-                for (const auto& record : records) {
-                    auto stat_rec = stats.find(record.channel_number);
-                    if (stat_rec == stats.end()) {
-                        stats[record.channel_number] = {record.channel_number,
-                                                        1,
-                                                        0,
-                                                        record.energy,
-                                                        record.energy,
-                                                        record.energy,
-                                                        static_cast<double>(record.event_length),
-                                                        static_cast<double>(record.header_length),
-                                                        record.time.count(),
-                                                        record.time.count(),
-                                                        static_cast<double>(record.trace_length)};
-                    } else {
-                        auto ch = &stat_rec->second;
-                        ch->count++;
-                        ch->energy_ave += record.energy;
-                        ch->trace_length_ave += record.trace_length;
-                        ch->header_length_ave += record.header_length;
-                        ch->event_length_ave += record.event_length;
-
-                        if (record.energy > ch->energy_max) {
-                            ch->energy_max = record.energy;
-                        }
-                        if (record.energy < ch->energy_min) {
-                            ch->energy_min = record.energy;
-                        }
-                        if (record.time.count() > ch->time_max) {
-                            ch->time_max = record.time.count();
-                        }
-                        if (record.time.count() < ch->time_min) {
-                            ch->time_min = record.time.count();
-                        }
-                    }
-                }
-                retries = max_retries;
-            } catch (xia::pixie::data::list_mode::error& error) {
-                std::cout << LOG("WARN") << "Decoding failed on chunk " << chunk_num - 1
-                          << " starting at byte " << (chunk_num-1) * chunk_size_words * bytes_per_word
-                          << " with the following error. Attempting to resync data stream." << std::endl;
-                std::cout << LOG("ERROR") << error.what() << std::endl;
-                retries--;
+        std::vector<channel_stats> worker_stats(threads);
+        std::vector<size_t> worker_records(threads, 0);
+        try {
+            while (reader.next(threads, [&worker_stats, &worker_records, &range](
+                                            size_t worker,
+                                            xia::pixie::data::list_mode::event_batch& batch) {
+                worker_records[worker] += batch.size();
+                update_stats(worker_stats[worker], batch, range);
+            })) {
             }
+        } catch (xia::pixie::data::list_mode::error& error) {
+            std::cout << LOG("WARN") << "Decoding failed after byte "
+                      << reader.position() * bytes_per_word << " with the following error."
+                      << std::endl;
+            std::cout << LOG("ERROR") << error.what() << std::endl;
+        }
+        leftover_words = reader.leftovers();
+        for (size_t t = 0; t < threads; ++t) {
+            record_total += worker_records[t];
+            merge_stats(stats, worker_stats[t]);
         }
         std::cout << LOG("INFO") << "Finished decoding data in "
                   << calculate_duration_in_seconds(start, std::chrono::system_clock::now()) << " s."
                   << std::endl;
-        input.close();
     } catch (std::bad_alloc& bad_alloc) {
         std::cout << LOG("ERROR") << bad_alloc.what() << std::endl;
-    } catch (std::ios_base::failure& failure) {
-        std::cout << LOG("ERROR") << failure.what() << std::endl;
     } catch (xia::pixie::error::error& sdkerr) {
         std::cout << LOG("ERROR") << sdkerr.what() << std::endl;
     }
@@ -300,8 +376,8 @@ int main(int argc, char** argv) {
         std::cout << LOG("INFO") << j.dump() << std::endl;
     }
 
-    if (!remainder.empty()) {
-        std::cout << LOG("WARN") << "Leftover Words: " << remainder.size() << std::endl;
+    if (leftover_words != 0) {
+        std::cout << LOG("WARN") << "Leftover Words: " << leftover_words << std::endl;
     }
 
     std::cout << LOG("INFO") << "Finished execution in "
@@ -0,0 +1,111 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2022 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file alloc.hpp
+ * @brief Defines the accounting of heap allocations on watched threads.
+ */
+
+#ifndef PIXIE_ALLOC_H
+#define PIXIE_ALLOC_H
+
+#include <atomic>
+#include <cstddef>
+
+namespace xia {
+namespace pixie {
+/**
+ * @brief Heap allocation accounting.
+ *
+ * A thread is watched by a counter and the heap allocations the thread
+ * makes while watched are counted, for example the FIFO worker and the
+ * readout threads during a steady-state run. A thread that is not
+ * watched is not counted.
+ *
+ * The global allocation functions are replaced when the SDK is built
+ * with `USE_ALLOC_HOOKS` so every allocation is seen. Without the hooks
+ * only the allocations the SDK's buffers make when they fall back to the
+ * heap are counted.
+ */
+namespace alloc {
+/**
+ * @brief A count of allocations and bytes.
+ */
+class counter {
+public:
+    counter();
+    counter(const counter& c);
+    counter& operator=(const counter& c);
+
+    void note(const size_t bytes);
+    void reset();
+
+    size_t allocations() const {
+        return allocations_.load(std::memory_order_relaxed);
+    }
+
+    size_t bytes() const {
+        return bytes_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic_size_t allocations_;
+    std::atomic_size_t bytes_;
+};
+
+/**
+ * @brief Watch the calling thread for the scope. A null counter does not
+ * watch the thread. The thread's previous counter is restored when the
+ * watch is destroyed.
+ */
+class watch {
+public:
+    explicit watch(counter* counter_);
+    ~watch();
+
+    watch(const watch&) = delete;
+    watch& operator=(const watch&) = delete;
+
+private:
+    counter* previous;
+};
+
+/**
+ * @brief The counter watching the calling thread or null.
+ */
+counter* watching();
+
+/**
+ * @brief Note an allocation made by the calling thread.
+ */
+void note(const size_t bytes);
+
+/**
+ * @brief Note an allocation an SDK allocator made from the heap when it
+ * has no preallocated memory. It is not noted if the hooks see it.
+ */
+void note_fallback(const size_t bytes);
+
+/**
+ * @brief True if the SDK is built with the allocation hooks.
+ */
+bool hooked();
+}  // namespace alloc
+}  // namespace pixie
+}  // namespace xia
+
+#endif  // PIXIE_ALLOC_H
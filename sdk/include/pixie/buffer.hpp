@@ -24,12 +24,16 @@
 #define PIXIE_BUFFER_H
 
 #include <atomic>
+#include <cstddef>
 #include <cstdint>
 #include <deque>
-#include <forward_list>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <mutex>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include <pixie/error.hpp>
@@ -64,10 +68,268 @@ typedef pixie::hw::word buffer_value;
  * @brief Defines a type for pointers to buffer_values
  */
 typedef pixie::hw::word_ptr buffer_value_ptr;
+/**
+ * @brief A contiguous block of memory buffers are carved from.
+ *
+ * The arena is a single mapping split into fixed size slots. Huge pages
+ * are used if the system has them reserved, otherwise transparent huge
+ * pages are advised for the mapping and the kernel backs it with huge
+ * pages when it can. A large pool in a single arena has far fewer TLB
+ * misses than the same number of separately allocated buffers.
+ */
+class arena {
+public:
+    enum struct pages { none, normal, transparent, huge };
+
+    arena();
+    ~arena();
+
+    /*
+     * Map the arena's slots. The slot size is rounded up to a page. If
+     * `lock_pages` is true the arena's memory is page locked. Returns
+     * false if the arena cannot be mapped.
+     */
+    bool create(const size_t slots, const size_t slot_bytes, const bool lock_pages);
+    void destroy();
+
+    bool valid() const {
+        return base != nullptr;
+    }
+
+    /*
+     * Allocate a free slot of at least the bytes. Returns null if there
+     * is no free slot or the bytes are larger than a slot.
+     */
+    void* allocate(const size_t bytes);
+
+    /*
+     * Free a slot. Returns false if the memory is not in the arena.
+     */
+    bool deallocate(void* ptr);
+
+    bool contains(const void* ptr) const {
+        auto p = static_cast<const char*>(ptr);
+        return base != nullptr && p >= base && p < base + bytes;
+    }
+
+    pages page_type() const {
+        return pages_;
+    }
+
+    bool locked() const {
+        return locked_;
+    }
+
+    size_t slots() const {
+        return slots_;
+    }
+
+private:
+    char* base;
+    size_t bytes;
+    size_t slot_bytes;
+    size_t slots_;
+    pages pages_;
+    bool locked_;
+    std::vector<char*> free;
+    lock_type lock;
+};
+
+/**
+ * @brief Allocates a vector's storage from an arena if it has one and
+ * has a free slot, otherwise from the heap. A copy of a vector is always
+ * allocated from the heap.
+ */
+template<typename T>
+struct arena_allocator {
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+    typedef std::false_type propagate_on_container_copy_assignment;
+
+    arena* arena_;
+
+    arena_allocator() noexcept : arena_(nullptr) {}
+    explicit arena_allocator(arena* arena__) noexcept : arena_(arena__) {}
+    template<typename U>
+    arena_allocator(const arena_allocator<U>& other) noexcept : arena_(other.arena_) {}
+
+    T* allocate(const size_t n) {
+        if (arena_ != nullptr) {
+            auto ptr = arena_->allocate(n * sizeof(T));
+            if (ptr != nullptr) {
+                return static_cast<T*>(ptr);
+            }
+        }
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* ptr, const size_t n) noexcept {
+        if (arena_ == nullptr || !arena_->deallocate(ptr)) {
+            std::allocator<T>().deallocate(ptr, n);
+        }
+    }
+
+    arena_allocator select_on_container_copy_construction() const {
+        return arena_allocator();
+    }
+};
+
+template<typename T, typename U>
+bool operator==(const arena_allocator<T>& a, const arena_allocator<U>& b) {
+    return a.arena_ == b.arena_;
+}
+
+template<typename T, typename U>
+bool operator!=(const arena_allocator<T>& a, const arena_allocator<U>& b) {
+    return a.arena_ != b.arena_;
+}
+
+/**
+ * @brief Fixed size blocks for the control blocks of the handles a pool
+ * gives out so a request does not allocate from the heap.
+ *
+ * Blocks are added as the pool's buffers are added and are kept until the
+ * pool is destroyed because a handle's control block is freed after the
+ * buffer is returned to the pool. A control block larger than a block or
+ * a request when no block is free is allocated from the heap.
+ */
+class handle_blocks {
+public:
+    static constexpr size_t block_bytes = 64;
+
+    handle_blocks();
+
+    /*
+     * Hold at least the number of blocks.
+     */
+    void reserve(const size_t count);
+
+    void* allocate(const size_t bytes);
+    void deallocate(void* ptr, const size_t bytes) noexcept;
+
+    size_t size() const {
+        return size_;
+    }
+
+    /*
+     * The number of heap allocations made.
+     */
+    size_t heap() const {
+        return heap_.load();
+    }
+
+private:
+    struct alignas(alignof(std::max_align_t)) block {
+        char bytes[block_bytes];
+    };
+    typedef std::unique_ptr<block[]> chunk;
+
+    bool contains(const void* ptr) const;
+
+    std::vector<std::pair<chunk, size_t>> chunks;
+    std::vector<block*> free;
+    size_t size_;
+    std::atomic_size_t heap_;
+    lock_type lock;
+};
+
+template<typename T>
+struct handle_allocator {
+    typedef T value_type;
+
+    handle_blocks* blocks;
+
+    explicit handle_allocator(handle_blocks* blocks_) noexcept : blocks(blocks_) {}
+    template<typename U>
+    handle_allocator(const handle_allocator<U>& other) noexcept : blocks(other.blocks) {}
+
+    T* allocate(const size_t n) {
+        return static_cast<T*>(blocks->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* ptr, const size_t n) noexcept {
+        blocks->deallocate(ptr, n * sizeof(T));
+    }
+};
+
+template<typename T, typename U>
+bool operator==(const handle_allocator<T>& a, const handle_allocator<U>& b) {
+    return a.blocks == b.blocks;
+}
+
+template<typename T, typename U>
+bool operator!=(const handle_allocator<T>& a, const handle_allocator<U>& b) {
+    return a.blocks != b.blocks;
+}
+
+/**
+ * @brief Keeps the memory a queue's container frees so the container's
+ * next allocation of the same size reuses it. A queue that has held its
+ * most buffers does not allocate again. The cache holds up to a limit of
+ * bytes and is only used with the queue's lock held.
+ */
+class node_cache {
+public:
+    static constexpr size_t default_limit_bytes = 64 * 1024;
+
+    node_cache();
+    ~node_cache();
+
+    node_cache(const node_cache&) = delete;
+    node_cache& operator=(const node_cache&) = delete;
+
+    void* allocate(const size_t bytes);
+    void deallocate(void* ptr, const size_t bytes) noexcept;
+
+    /*
+     * Raise the limit of the bytes held.
+     */
+    void limit(const size_t bytes);
+
+    size_t held() const {
+        return held_;
+    }
+
+private:
+    std::vector<std::pair<size_t, void*>> free;
+    size_t held_;
+    size_t limit_;
+};
+
+template<typename T>
+struct cache_allocator {
+    typedef T value_type;
+
+    node_cache* cache;
+
+    explicit cache_allocator(node_cache* cache_) noexcept : cache(cache_) {}
+    template<typename U>
+    cache_allocator(const cache_allocator<U>& other) noexcept : cache(other.cache) {}
+
+    T* allocate(const size_t n) {
+        return static_cast<T*>(cache->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* ptr, const size_t n) noexcept {
+        cache->deallocate(ptr, n * sizeof(T));
+    }
+};
+
+template<typename T, typename U>
+bool operator==(const cache_allocator<T>& a, const cache_allocator<U>& b) {
+    return a.cache == b.cache;
+}
+
+template<typename T, typename U>
+bool operator!=(const cache_allocator<T>& a, const cache_allocator<U>& b) {
+    return a.cache != b.cache;
+}
+
 /**
  * @brief Defines a type for a vector of buffer words.
 */
-typedef pixie::hw::words buffer;
+typedef std::vector<buffer_value, arena_allocator<buffer_value>> buffer;
 /**
  * @brief Defines a pointer to a vector of buffer words.
 */
@@ -79,16 +341,87 @@ typedef std::shared_ptr<buffer> handle;
 
 /**
  * @brief The buffer pool to manage the buffer workers.
+ *
+ * A pool can be elastic. An elastic pool grows when it runs low up to a
+ * maximum number of buffers and shrinks back to the number created when
+ * the grown buffers are not in use. The growth and shrinking are made by
+ * the thread requesting buffers.
+ *
+ * The pool reports watermark events as buffers are used. The high
+ * watermark is reported when the buffers in use reach the high mark and
+ * the low watermark when the buffers in use fall back to the low mark.
+ * The handler is called by the thread requesting or releasing the buffer
+ * without the pool lock held.
  */
 struct pool {
+    enum struct watermark { low, high };
+    typedef std::function<void(watermark level, size_t in_use)> watermark_handler;
+
     pool();
     ~pool();
 
-    void create(const size_t number, const size_t size);
+    /*
+     * Create the pool's buffers. If `lock_pages` is true the buffer memory
+     * is page locked so DMA transfers do not fault pages in. The buffers
+     * are never reallocated so the memory stays locked until the pool is
+     * destroyed. If the memory cannot be locked, for example the process
+     * limit is reached, the remaining buffers are not locked.
+     *
+     * If `huge_pages` is true the buffers are carved from a single arena
+     * backed by huge pages where available. Buffers added by growing the
+     * pool are allocated from the heap. If the arena cannot be mapped the
+     * buffers are allocated from the heap.
+     */
+    void create(const size_t number, const size_t size, const bool lock_pages = false,
+                const bool huge_pages = false);
     void destroy();
 
     handle request();
 
+    /*
+     * Let the pool grow by `grow_by` buffers at a time to `max_number`
+     * buffers. A `max_number` of 0 is a fixed size pool. The setting is
+     * kept when the pool is destroyed.
+     */
+    void set_elastic(const size_t max_number, const size_t grow_by = 1);
+
+    /*
+     * Grow the pool if it is elastic and below its maximum. Returns true if
+     * buffers were added.
+     */
+    bool grow();
+
+    /*
+     * Free the unused buffers added by growing the pool. Returns the number
+     * of buffers freed.
+     */
+    size_t shrink();
+
+    /*
+     * Set the watermarks in buffers in use. A high mark of 0 disables the
+     * watermarks. The setting is kept when the pool is destroyed.
+     */
+    void set_watermarks(const size_t high, const size_t low, watermark_handler handler = nullptr);
+
+    /*
+     * The high watermark has been reached and the low watermark has not
+     * been reached since.
+     */
+    bool high_water() const {
+        return high_water_.load();
+    }
+
+    /*
+     * The number of times the high watermark has been reached.
+     */
+    size_t high_water_events() const {
+        return high_water_events_.load();
+    }
+
+    bool grown() const {
+        return number.load() > base_number;
+    }
+
     bool valid() const {
         return number != 0;
     }
@@ -105,18 +438,65 @@ struct pool {
         return count_.load();
     }
 
-    size_t number;
+    std::atomic_size_t number;
     size_t size;
 
+    /*
+     * Number of buffers with page locked memory.
+     */
+    size_t locked;
+
+    /*
+     * The pages of the pool's arena, none if the pool has no arena.
+     */
+    arena::pages arena_pages() const {
+        return arena_.page_type();
+    }
+
+    /*
+     * Number of buffers created and the elastic limits.
+     */
+    size_t base_number;
+    size_t max_number;
+    size_t grow_by;
+
     void output(std::ostream& out);
 
 private:
     struct releaser;
     void release(buffer_ptr buf);
 
+    void add_buffers(const size_t count);
+    /*
+     * Check the watermarks with the lock held. Returns true if the
+     * handler is to be called with the level.
+     */
+    bool check_watermarks(watermark& level, size_t& in_use);
+    void notify(bool report, watermark level, size_t in_use);
+
     std::atomic_size_t count_;
 
-    std::forward_list<buffer_ptr> buffers;
+    bool lock_pages;
+
+    size_t high_mark;
+    size_t low_mark;
+    watermark_handler handler;
+    std::atomic_bool high_water_;
+    std::atomic_size_t high_water_events_;
+
+    /*
+     * The free buffers, the most recently released is at the back.
+     */
+    std::vector<buffer_ptr> buffers;
+
+    /*
+     * The buffers with page locked memory. The free buffers are a stack
+     * so the locked buffers are not in any order.
+     */
+    std::unordered_set<buffer_ptr> page_locked;
+
+    arena arena_;
+    handle_blocks blocks;
 
     lock_type lock;
 };
@@ -132,11 +512,32 @@ struct queue {
     void push(handle buf);
     handle pop();
 
+    /*
+     * Pop up to `max_buffers` buffers from the queue into the caller's
+     * handles without copying the data. A `max_buffers` of 0 pops all the
+     * buffers. Each buffer is returned to its pool when the last handle is
+     * released. The number of words popped is returned.
+     */
+    size_t pop(handles& to, const size_t max_buffers = 0);
+
+    /*
+     * Return popped buffers to the front of the queue in their order. A
+     * consumer that cannot use the buffers it popped puts them back so
+     * the data is not lost.
+     */
+    void requeue(handles& from);
+
     size_t copy(buffer& to);
     size_t copy(buffer_value_ptr to, const size_t to_move);
 
     void compact();
 
+    /*
+     * Preallocate the queue's container to hold the number of buffers so
+     * pushing up to that number does not allocate.
+     */
+    void reserve(const size_t count);
+
     bool empty();
 
     size_t size();
@@ -149,17 +550,200 @@ struct queue {
 private:
     size_t copy_unprotected(buffer_value_ptr to, size_t to_move);
 
+    /*
+     * Remove the words copied out of the front buffer.
+     */
+    void trim_head();
+
     void check(const char* label);
 
-    handles buffers;
+    typedef std::deque<handle, cache_allocator<handle>> store;
+
+    node_cache cache;
+    store buffers;
     lock_type lock;
     size_t size_;
+    /*
+     * The words at the start of the front buffer that have been copied
+     * out. A partial copy moves the offset rather than the data.
+     */
+    size_t head_offset;
+};
+
+/**
+ * @brief Bounded single producer, single consumer ring of buffer handles.
+ *
+ * The ring is the hand off between a producer thread, for example the
+ * FIFO worker, and a single consumer. Push and pop are wait-free and the
+ * number of queued buffers and words are held in atomics so the level can
+ * be checked without a lock. Only one thread can push and only one thread
+ * can pop, flush or drain at a time.
+ */
+struct ring {
+    typedef std::vector<handle> handles;
+
+    ring();
+    ~ring();
+
+    void create(const size_t capacity);
+    void destroy();
+
+    bool valid() const {
+        return !slots.empty();
+    }
+
+    /*
+     * Producer. Returns false if the ring is full.
+     */
+    bool push(handle buf);
+
+    /*
+     * Consumer. Returns an empty handle if the ring is empty.
+     */
+    handle pop();
+    size_t drain(queue& to);
+    void flush();
+
+    bool empty() const {
+        return count() == 0;
+    }
+
+    bool full() const {
+        return count() == slots.size();
+    }
+
+    size_t size() const {
+        return size_.load(std::memory_order_acquire);
+    }
+
+    /*
+     * Load the tail first. The head only moves forward so the count cannot
+     * wrap if the consumer pops between the loads.
+     */
+    size_t count() const {
+        const size_t tail_ = tail.load(std::memory_order_acquire);
+        return head.load(std::memory_order_acquire) - tail_;
+    }
+
+    size_t capacity() const {
+        return slots.size();
+    }
+
+    void output(std::ostream& out);
+
+private:
+    handles slots;
+    std::atomic_size_t head;
+    std::atomic_size_t tail;
+    std::atomic_size_t size_;
+};
+
+/**
+ * @brief Delivers a stream of buffers to more than one consumer without
+ * copying the data.
+ *
+ * The fan-out pulls the buffers from a source, for example a module's
+ * data queue, and holds the handles. Each consumer has a cursor and reads
+ * the buffers from it. A read gives the consumer handles to the buffers
+ * so a buffer returns to its pool when the last consumer has read and
+ * released it. Any consumer's read pulls the source.
+ *
+ * A consumer that falls behind does not stop the others. If more than
+ * `max_held` buffers are held the oldest are removed and the consumers
+ * that have not read them count them as dropped.
+ */
+struct fanout {
+    typedef std::function<size_t(queue::handles& buffers)> source;
+
+    /**
+     * @brief A consumer of the fan-out. The consumer is removed when it
+     * is destroyed. Release the consumers before the fan-out.
+     */
+    struct consumer {
+        ~consumer();
+
+        consumer(const consumer&) = delete;
+        consumer& operator=(const consumer&) = delete;
+
+        /*
+         * Read up to `max_buffers` buffers appending them to `buffers`, 0
+         * reads all the buffers available. Returns the number of words
+         * read.
+         */
+        size_t read(queue::handles& buffers, const size_t max_buffers = 0);
+
+        /*
+         * The buffers held for the consumer and the buffers it has
+         * dropped.
+         */
+        size_t available() const;
+        size_t dropped() const;
+
+        const size_t id;
+
+    private:
+        friend struct fanout;
+        consumer(fanout& fan, size_t id);
+        fanout& fan;
+    };
+    typedef std::shared_ptr<consumer> consumer_ptr;
+
+    /*
+     * A `max_held` of 0 holds all the buffers the slowest consumer has
+     * not read. Set a limit below the number of buffers in the source's
+     * pool so a stalled consumer cannot starve the source.
+     */
+    fanout(const source& src, const size_t max_held = 0);
+    ~fanout();
+
+    fanout(const fanout&) = delete;
+    fanout& operator=(const fanout&) = delete;
+
+    /*
+     * Add a consumer. It reads the buffers pulled after it is added.
+     */
+    consumer_ptr subscribe();
+
+    /*
+     * Pull the source's buffers. Returns the number of words pulled.
+     */
+    size_t pull();
+
+    size_t held() const;
+    size_t consumers() const;
+
+    const size_t max_held;
+
+private:
+    struct cursor {
+        size_t id;
+        uint64_t next;
+        size_t dropped;
+    };
+
+    cursor& find(size_t id);
+    void unsubscribe(size_t id);
+    size_t read(size_t id, queue::handles& buffers, const size_t max_buffers);
+    size_t pull_unprotected();
+    void trim();
+
+    source src;
+    /*
+     * The held buffers, the front buffer's sequence number is `base`.
+     */
+    std::deque<handle> buffers;
+    uint64_t base;
+    std::vector<cursor> cursors;
+    size_t next_id;
+    mutable lock_type lock;
 };
 
 }  // namespace buffer
 }  // namespace xia
 
+std::ostream& operator<<(std::ostream& out, xia::buffer::arena::pages pages);
 std::ostream& operator<<(std::ostream& out, xia::buffer::pool& pool);
 std::ostream& operator<<(std::ostream& out, xia::buffer::queue& queue);
+std::ostream& operator<<(std::ostream& out, xia::buffer::ring& ring);
 
 #endif  // PIXIE_BUFFER_H
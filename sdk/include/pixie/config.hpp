@@ -41,19 +41,88 @@ typedef pixie::error::error error;
 
 /**
  * @brief Import a JSON configuration into a crate's internal variables.
+ *
+ * The file is read with a single read and parsed with a SAX parser so the
+ * JSON document is not held in memory. The parsed configuration is kept
+ * in the parse cache and reused if the file's size and modification time
+ * have not changed.
+ *
  * @param[in] filename The name of the file with the relative or absolute path.
  * @param[in] crate The crate object that we're going to load this configuration into.
  * @param[in] loaded List of modules that will receive the configuration.
+ * @param[in] changes_only Only write the values that differ from the
+ *                         modules' copies so only they are dirty.
  */
-void import_json(const std::string& filename, crate::crate& crate, module::number_slots& loaded);
+void import_json(const std::string& filename, crate::crate& crate, module::number_slots& loaded,
+                 bool changes_only = false);
 
 /**
  * @brief Export the active module configurations to a JSON file.
+ *
+ * The modules' variables are read from the DSPs in parallel and each
+ * module's configuration is formatted on its crate worker. The JSON is
+ * streamed to the file and is not held as a document.
+ *
  * @param[in] filename The name of the JSON output file used for the export.
  * @param[in] crate The crate object holding the modules to be exported.
  */
 void export_json(const std::string& filename, crate::crate& crate);
 
+/**
+ * @brief Check if a file is a binary configuration snapshot.
+ * @param[in] filename The name of the file with the relative or absolute path.
+ * @return True if the file starts with the snapshot's magic.
+ */
+bool is_snapshot(const std::string& filename);
+
+/**
+ * @brief Import a binary configuration snapshot into a crate's internal
+ * variables. The snapshot is loaded with a single read and validated with
+ * its CRC32. The variables are imported the same way as a JSON
+ * configuration.
+ * @param[in] filename The name of the file with the relative or absolute path.
+ * @param[in] crate The crate object that we're going to load this configuration into.
+ * @param[in] loaded List of modules that will receive the configuration.
+ * @param[in] changes_only Only write the values that differ from the
+ *                         modules' copies so only they are dirty.
+ */
+void import_snapshot(const std::string& filename, crate::crate& crate,
+                     module::number_slots& loaded, bool changes_only = false);
+
+/**
+ * @brief Export the active module configurations to a binary snapshot.
+ * A snapshot holds the variables but not the metadata of a JSON export.
+ * @param[in] filename The name of the snapshot file used for the export.
+ * @param[in] crate The crate object holding the modules to be exported.
+ */
+void export_snapshot(const std::string& filename, crate::crate& crate);
+
+/**
+ * @brief Export the active module configurations to a JSON file and a
+ * binary snapshot. The modules' variables are read once for both files.
+ * @param[in] json_file The name of the JSON output file, empty for none.
+ * @param[in] snapshot_file The name of the snapshot file, empty for none.
+ * @param[in] crate The crate object holding the modules to be exported.
+ */
+void export_config(const std::string& json_file, const std::string& snapshot_file,
+                   crate::crate& crate);
+
+/**
+ * @brief Enable or disable the process wide JSON configuration parse
+ * cache. The cache is enabled by default. Disabling the cache clears it.
+ */
+void parse_cache_enable(bool enable);
+
+/**
+ * @brief Drop the cached configurations.
+ */
+void parse_cache_clear();
+
+/**
+ * @brief The number of files in the parse cache.
+ */
+size_t parse_cache_files();
+
 }  // namespace config
 }  // namespace pixie
 }  // namespace xia
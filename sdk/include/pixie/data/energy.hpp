@@ -0,0 +1,161 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file energy.hpp
+ * @brief Defines the recomputation of list-mode energies from the energy sums.
+ */
+
+#ifndef PIXIESDK_LIST_MODE_ENERGY_HPP
+#define PIXIESDK_LIST_MODE_ENERGY_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include <pixie/data/list_mode.hpp>
+
+namespace xia {
+namespace pixie {
+namespace data {
+/**
+ * @brief Recomputes the energies of decoded events from their energy sums.
+ *
+ * An event with the energy sums has the leading, gap and trailing sums of
+ * the module's trapezoidal energy filter and the filter baseline. The
+ * energy is the sums weighted by coefficients of the filter's rise time,
+ * flat top and the preamplifier's decay time less the baseline. The
+ * energies can be recomputed with another decay time than the one the
+ * module used.
+ *
+ * The batch kernel gathers the sums and the coefficients of each event's
+ * channel into columns then computes the energies with a single loop over
+ * the columns the compiler vectorizes. The results keep the columns so
+ * the kernel does not allocate once warm.
+ */
+namespace energy {
+/**
+ * @brief A channel's energy filter.
+ */
+struct PIXIE_EXPORT filter {
+    /*
+     * The energy filter's rise time and flat top and the preamplifier's
+     * decay time, units usecs.
+     */
+    double rise_time_usecs;
+    double flat_top_usecs;
+    double tau_usecs;
+    /*
+     * The period of an energy filter sample, the filter clock period
+     * times 2 to the power of the channel's slow filter range, units
+     * usecs.
+     */
+    double sample_usecs;
+    /*
+     * The coefficients' scale for the ADC bits: 16 for 12 bits, 4 for 14
+     * bits and 1 for 16 bits.
+     */
+    double scale;
+
+    filter();
+
+    /*
+     * The rise time and flat top in filter samples.
+     */
+    size_t rise_samples() const;
+    size_t flat_top_samples() const;
+
+    /**
+     * @brief Check the filter.
+     * @throws xia::pixie::error::error if the filter is not valid.
+     */
+    void validate() const;
+};
+
+/**
+ * @brief The channels' filters indexed by channel number.
+ */
+using filters = std::vector<filter>;
+
+/**
+ * @brief The weights of the leading, gap and trailing sums.
+ */
+struct PIXIE_EXPORT coefficients {
+    double leading;
+    double gap;
+    double trailing;
+
+    coefficients();
+    /**
+     * @throws xia::pixie::error::error if the filter is not valid.
+     */
+    explicit coefficients(const filter& filt);
+};
+
+/**
+ * @brief The energy of an event's leading, gap and trailing sums and
+ * filter baseline.
+ */
+inline double compute(const coefficients& coeffs, const uint32_t* sums, double baseline) {
+    return coeffs.leading * sums[0] + coeffs.gap * sums[1] + coeffs.trailing * sums[2] -
+        baseline;
+}
+
+/**
+ * @brief The energies of `count` events of one channel. The sums are
+ * three words an event.
+ */
+PIXIE_EXPORT void PIXIE_API compute(const coefficients& coeffs, const uint32_t* sums,
+                                    const double* baselines, size_t count, double* energies);
+
+/**
+ * @brief The energies recomputed for a batch of events. The energy is NaN
+ * if the event has no energy sums or there is no filter for its channel.
+ */
+struct PIXIE_EXPORT results {
+    std::vector<double> energy;
+
+    /*
+     * The columns of the gathered sums and coefficients kept for the next
+     * batch.
+     */
+    std::vector<double> leading;
+    std::vector<double> gap;
+    std::vector<double> trailing;
+    std::vector<double> c_leading;
+    std::vector<double> c_gap;
+    std::vector<double> c_trailing;
+
+    size_t size() const {
+        return energy.size();
+    }
+    void clear();
+};
+
+/**
+ * @brief Recompute the energies of a batch of events. The batch must hold
+ * the energy sums and the ids.
+ * @throws xia::pixie::error::error if the batch does not hold the fields or
+ *  a filter is not valid.
+ */
+PIXIE_EXPORT void PIXIE_API recompute(const list_mode::event_batch& batch,
+                                      const filters& channel_filters, results& out);
+}  // namespace energy
+}  // namespace data
+}  // namespace pixie
+}  // namespace xia
+
+#endif  // PIXIESDK_LIST_MODE_ENERGY_HPP
@@ -0,0 +1,321 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file histogrammer.hpp
+ * @brief Defines an online histogrammer filled from decoded list-mode events.
+ */
+
+#ifndef PIXIESDK_LIST_MODE_HISTOGRAMMER_HPP
+#define PIXIESDK_LIST_MODE_HISTOGRAMMER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <pixie/data/list_mode.hpp>
+
+namespace xia {
+namespace pixie {
+namespace data {
+namespace list_mode {
+
+/**
+ * @brief Fills user defined 1D and 2D histograms from decoded list-mode
+ * events while a run is acquiring.
+ *
+ * The histograms are defined before filling starts. The events are filled
+ * into shards, one per thread filling. A shard is only written by one
+ * thread at a time so filling does not lock or contend with other
+ * threads. Use the worker number of a parallel decode or the module
+ * number of a FIFO reader as the shard.
+ *
+ * Snapshots merge the shards on read. A snapshot can be taken from any
+ * thread while the shards are being filled and the filling does not stop.
+ * The counts of events being filled during a snapshot may or may not be
+ * included.
+ */
+class PIXIE_EXPORT histogrammer {
+public:
+    using id_type = event_batch::id_type;
+
+    /**
+     * @brief Matches any crate, slot or channel.
+     */
+    static constexpr id_type any = static_cast<id_type>(-1);
+
+    /**
+     * @brief The number of QDC sums in an event.
+     */
+    static constexpr size_t qdc_sums = 8;
+
+    /**
+     * @brief A histogram axis of equal width bins from low to high. A value
+     * is in a bin if it is at or above the bin's low edge and below the
+     * next bin's low edge.
+     */
+    struct PIXIE_EXPORT axis {
+        double low;
+        double high;
+        size_t bins;
+
+        axis();
+        axis(double low, double high, size_t bins);
+
+        /**
+         * @brief The value's bin or `bins` if the value is outside the axis.
+         */
+        size_t bin(double value) const {
+            if (!(value >= low && value < high)) {
+                return bins;
+            }
+            return std::min(static_cast<size_t>((value - low) * scale), bins - 1);
+        }
+
+        /**
+         * @brief The low edge of a bin.
+         */
+        double bin_low(size_t bin) const;
+
+    private:
+        friend class histogrammer;
+        double scale;
+    };
+
+    /**
+     * @brief Selects the events of a channel. Set a field to `any` to match
+     * all of them.
+     */
+    struct PIXIE_EXPORT channel_id {
+        id_type crate;
+        id_type slot;
+        id_type channel;
+
+        channel_id();
+        channel_id(id_type crate, id_type slot, id_type channel);
+
+        bool matches(const event_batch& batch, size_t event) const {
+            return (crate == any || crate == batch.crate[event]) &&
+                (slot == any || slot == batch.slot[event]) &&
+                (channel == any || channel == batch.channel[event]);
+        }
+        bool wildcard() const {
+            return crate == any || slot == any || channel == any;
+        }
+    };
+
+    /**
+     * @brief A user value of an event. Return false to not fill the event.
+     */
+    using value_1d = std::function<bool(const event_batch& batch, size_t event, double& x)>;
+    using value_2d =
+        std::function<bool(const event_batch& batch, size_t event, double& x, double& y)>;
+
+    /**
+     * @brief A merged copy of a histogram's counts.
+     */
+    struct PIXIE_EXPORT snapshot {
+        std::string name;
+        axis x;
+        axis y;
+        /*
+         * The counts with the x bins of each y bin in turn. A 1D histogram
+         * has a single y bin.
+         */
+        std::vector<uint64_t> counts;
+        /*
+         * The values filled outside the axes.
+         */
+        uint64_t outside;
+
+        snapshot();
+
+        bool two_d() const {
+            return y.bins > 1;
+        }
+        uint64_t at(size_t xbin, size_t ybin = 0) const {
+            return counts[ybin * x.bins + xbin];
+        }
+        /**
+         * @brief The total of the counts including the values outside the axes.
+         */
+        uint64_t entries() const;
+    };
+
+    using snapshots = std::vector<snapshot>;
+
+    /**
+     * @brief Create a histogrammer.
+     * @param shards The number of shards, the number of threads that can
+     *  fill at the same time.
+     * @throws xia::pixie::error::error if there are no shards.
+     */
+    explicit histogrammer(size_t shards);
+    ~histogrammer();
+
+    histogrammer(const histogrammer&) = delete;
+    histogrammer& operator=(const histogrammer&) = delete;
+
+    /**
+     * @brief Add a histogram of a channel's energy.
+     * @return The histogram's index.
+     * @throws xia::pixie::error::error if the name is in use, an axis is not
+     *  valid or filling has started.
+     */
+    size_t add_energy(const std::string& name, const channel_id& chan, const axis& x);
+
+    /**
+     * @brief Add a histogram of the time differences between two channels.
+     * The difference is the stop time less the start time of the closest
+     * earlier event of the other channel in a shard's stream, so a
+     * stop before the start is negative. The times are in seconds. Pairs
+     * are only found within a shard, both channels need to be in the same
+     * module or a merged stream.
+     */
+    size_t add_time_difference(const std::string& name, const channel_id& start,
+                               const channel_id& stop, const axis& x);
+
+    /**
+     * @brief Add a 2D histogram of a channel's energy against its pulse
+     * shape, the ratio of the QDC sum `tail` to the QDC sum `total`. Events
+     * without QDC sums are not filled.
+     */
+    size_t add_energy_psd(const std::string& name, const channel_id& chan, const axis& energy,
+                          const axis& psd, size_t tail, size_t total);
+
+    /**
+     * @brief Add a histogram of a user value of each event.
+     */
+    size_t add(const std::string& name, const axis& x, value_1d value);
+    size_t add(const std::string& name, const axis& x, const axis& y, value_2d value);
+
+    /**
+     * @brief Fill a shard with the events in a batch.
+     * @throws xia::pixie::error::error if the shard is not valid.
+     */
+    void fill(size_t shard, const event_batch& batch);
+
+    /**
+     * @brief Decode a module's data block and fill the shard with the
+     * events. This is the FIFO path, call it with each buffer a module's
+     * list-mode read returns. The decoding and leftovers are the same as
+     * `decode_data_block`.
+     */
+    void decode(size_t shard, uint32_t* data, size_t len, size_t revision, size_t frequency,
+                buffer& leftovers);
+
+    /**
+     * @brief A batch handler that fills the worker's shard. There must be a
+     * shard for each worker.
+     */
+    batch_handler handler();
+
+    /**
+     * @brief Find a histogram by name.
+     * @throws xia::pixie::error::error if not found.
+     */
+    size_t find(const std::string& name) const;
+
+    /**
+     * @brief Take a snapshot of a histogram or all histograms.
+     */
+    void get(size_t hist, snapshot& snap) const;
+    void get(snapshots& snaps) const;
+
+    /**
+     * @brief Clear the counts. Counts being filled when clearing may be kept.
+     */
+    void clear();
+
+    /**
+     * @brief The number of histograms.
+     */
+    size_t size() const {
+        return definitions.size();
+    }
+    /**
+     * @brief The number of shards.
+     */
+    size_t shards() const {
+        return shards_.size();
+    }
+
+private:
+    enum struct kind { energy, time_difference, energy_psd, user_1d, user_2d };
+
+    struct definition {
+        std::string name;
+        kind type;
+        channel_id chan;
+        channel_id stop;
+        axis x;
+        axis y;
+        size_t tail;
+        size_t total;
+        value_1d value_x;
+        value_2d value_xy;
+        definition();
+    };
+
+    /*
+     * A shard's counts are only written by the thread filling it. A count
+     * is a relaxed atomic that is loaded and stored so an increment is a
+     * plain add and a snapshot can read the count at any time.
+     */
+    using counter = std::atomic<uint64_t>;
+    using counters = std::vector<counter>;
+
+    struct shard {
+        /*
+         * Each histogram's bins and the outside count last.
+         */
+        std::vector<std::unique_ptr<counters>> hists;
+        /*
+         * The last start and stop times of the time difference histograms.
+         */
+        std::vector<double> last_start;
+        std::vector<double> last_stop;
+        event_batch batch;
+    };
+
+    static void count(counter& c) {
+        c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    size_t add(definition& def);
+    void fill(shard& sh, size_t hist, const event_batch& batch, size_t event);
+
+    std::vector<definition> definitions;
+    /*
+     * The histograms of fully specified channels and those with wildcards
+     * or user values that see all events.
+     */
+    std::unordered_map<uint64_t, std::vector<size_t>> by_channel;
+    std::vector<size_t> all_events;
+    std::vector<std::unique_ptr<shard>> shards_;
+    std::atomic_bool filling;
+};
+}  // namespace list_mode
+}  // namespace data
+}  // namespace pixie
+}  // namespace xia
+
+#endif  // PIXIESDK_LIST_MODE_HISTOGRAMMER_HPP
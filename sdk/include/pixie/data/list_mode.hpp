@@ -23,7 +23,12 @@
 #ifndef PIXIESDK_LIST_MODE_HPP
 #define PIXIESDK_LIST_MODE_HPP
 
+#include <array>
 #include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iterator>
+#include <limits>
 #include <string>
 #include <vector>
 
@@ -118,6 +123,20 @@ struct record {
      * @brief Defines a time type that all the times in the object use.
      */
     using time_type = std::chrono::duration<double>;
+    /**
+     * @brief Defines the integer fixed point time type. The unit is 1/1024
+     * of a nanosecond so the times of all the supported frequencies have
+     * the same unit and 48-bit time stamps do not overflow.
+     */
+    using fixed_time_type = int64_t;
+    static constexpr fixed_time_type fixed_time_per_ns = 1024;
+
+    /**
+     * @brief Convert between a time and a fixed point time. A time is
+     * rounded to the nearest fixed point unit.
+     */
+    static fixed_time_type to_fixed_time(const time_type t);
+    static time_type from_fixed_time(const fixed_time_type t);
 
     record();
     ~record() = default;
@@ -196,7 +215,8 @@ struct record {
     size_t channel_number;
     /**
      * @brief The crate id for the crate that produced the event.
-     * @note The SDK does not support multi-crate systems so this will always be 0.
+     * @note This is the module's CrateID. The cluster controller sets it to
+     *  the id of the crate's node.
      */
     size_t crate_id;
     /**
@@ -302,6 +322,40 @@ struct record {
      */
     bool trace_out_of_range;
 
+    /**
+     * @brief The raw 48-bit time stamp of the on-board filter.
+     * @note Units of filter clock cycles
+     *
+     * A record that is not decoded from list-mode data, for example a JSON
+     * or binary record, does not have the time stamp and it is 0.
+     */
+    uint64_t timestamp;
+    /**
+     * @brief The CFD fractional time as a fixed point value.
+     * @note Units of 1/1024 ns
+     */
+    fixed_time_type cfd_fixed_time;
+    /**
+     * @brief The arrival time of the event as a fixed point value, the filter
+     * time stamp plus the CFD fractional time.
+     * @note Units of 1/1024 ns
+     *
+     * Integer compares order events exactly where the double time loses the
+     * CFD's sub-nanosecond resolution at large time stamps.
+     */
+    fixed_time_type fixed_time;
+
+    /**
+     * @brief Set the time and the fixed point time of a record that is not
+     * decoded from list-mode data. The time is the filter time.
+     */
+    void set_time(const time_type t);
+    /**
+     * @brief Offset the times of the record, for example by the crate's
+     * time offset.
+     */
+    void shift_time(const time_type offset);
+
     /**
      * @brief Provides streamed output for the class
      * @param out the stream that we'll use for the output
@@ -328,11 +382,571 @@ std::string record_to_json(const record& rec);
  */
 void json_to_record(const std::string& json_string, record& rec);
 
+/**
+ * @brief A type definition for the binary encoding of records.
+ */
+using binary = std::vector<uint8_t>;
+
+/**
+ * @brief The version of the binary record encoding.
+ */
+static constexpr uint16_t binary_record_version = 1;
+
+/**
+ * @brief The size of the binary record header in bytes.
+ */
+static constexpr size_t binary_record_header_size = 80;
+
+/**
+ * @brief The size in bytes of a record's binary encoding.
+ */
+size_t binary_record_size(const record& rec);
+/**
+ * @brief Appends the binary encoding of a record.
+ *
+ * The encoding is little endian. A fixed size header holds the size of the
+ * encoding, the version, the flags, the identifiers, the lengths and the
+ * times and energies as doubles. The header is followed by the energy sums
+ * and QDCs as 32-bit values and the trace as 16-bit samples, padded to a
+ * multiple of 4 bytes.
+ *
+ * @param[in] rec The record to encode.
+ * @param[in, out] out The binary data the encoding is appended to.
+ * @throws xia::pixie::error::error if a value does not fit the encoding.
+ */
+void record_to_binary(const record& rec, binary& out);
+/**
+ * @brief Appends the binary encoding of a number of records.
+ */
+void records_to_binary(const records& recs, binary& out);
+/**
+ * @brief Converts the binary encoding of a record into a record.
+ * @param[in] data The binary data.
+ * @param[in] len The length of the binary data.
+ * @param[in, out] rec The record object to store the converted information.
+ * @return The number of bytes of the encoding. 0 if the binary data does not
+ *  hold the complete encoding.
+ * @throws xia::pixie::error::error if the encoding is invalid.
+ */
+size_t binary_to_record(const uint8_t* data, size_t len, record& rec);
+/**
+ * @brief Converts the complete binary record encodings in the data into
+ *  records. The records are appended.
+ * @return The number of bytes converted. Any remaining bytes are a partial
+ *  encoding.
+ * @throws xia::pixie::error::error if an encoding is invalid.
+ */
+size_t binary_to_records(const uint8_t* data, size_t len, records& recs);
+
 /**
  * @brief A type definition to define an object that holds the binary data.
  */
 using buffer = std::vector<uint32_t>;
 
+/**
+ * @brief A reusable set of records.
+ *
+ * Clearing the arena keeps its records and the capacity of their vectors.
+ * Decoding into an arena reuses the records so once the arena has grown to
+ * the size of the data blocks decoding does not allocate.
+ */
+class PIXIE_EXPORT record_arena {
+public:
+    using iterator = records::iterator;
+    using const_iterator = records::const_iterator;
+
+    record_arena();
+
+    /**
+     * @brief The next record. The arena grows if all records are in use.
+     * The record holds the values of its last use.
+     */
+    record& next();
+
+    /**
+     * @brief Release the records for reuse.
+     */
+    void clear() {
+        count = 0;
+    }
+    /**
+     * @brief Create a number of records each with a trace capacity.
+     */
+    void reserve(const size_t records_, const size_t trace_samples = 0);
+
+    size_t size() const {
+        return count;
+    }
+    bool empty() const {
+        return count == 0;
+    }
+    /**
+     * @brief The number of records the arena holds.
+     */
+    size_t capacity() const {
+        return slots.size();
+    }
+
+    record& operator[](const size_t index) {
+        return slots[index];
+    }
+    const record& operator[](const size_t index) const {
+        return slots[index];
+    }
+
+    iterator begin() {
+        return slots.begin();
+    }
+    iterator end() {
+        return slots.begin() + count;
+    }
+    const_iterator begin() const {
+        return slots.begin();
+    }
+    const_iterator end() const {
+        return slots.begin() + count;
+    }
+
+private:
+    records slots;
+    size_t count;
+};
+
+/**
+ * @brief Unpacks a trace's packed 16-bit sample pairs.
+ *
+ * Each 32-bit data word holds two samples with the first sample in the
+ * low half of the word.
+ *
+ * @param words The trace's data words.
+ * @param length The number of data words.
+ * @param samples The samples. This must have space for 2 * length samples.
+ */
+PIXIE_EXPORT void PIXIE_API unpack_trace(const uint32_t* words, const size_t length,
+                                         uint16_t* samples);
+
+/**
+ * @brief The fields decoded into an event batch.
+ *
+ * A scan of the data decodes only the fields it needs. The words of the
+ * fields not decoded, for example the traces, are skipped by the event
+ * length and not read. The header, event and trace lengths are always
+ * decoded.
+ */
+enum scan_fields : uint32_t {
+    /**
+     * @brief The time, filter time and CFD fractional time, and the raw
+     * time stamp and fixed point time.
+     */
+    scan_times = 1 << 0,
+    scan_energy = 1 << 1,
+    /**
+     * @brief The crate, slot, channel and CFD trigger source.
+     */
+    scan_ids = 1 << 2,
+    scan_flags = 1 << 3,
+    scan_external_time = 1 << 4,
+    /**
+     * @brief The energy sums and the filter baseline.
+     */
+    scan_energy_sums = 1 << 5,
+    scan_qdc = 1 << 6,
+    scan_traces = 1 << 7,
+    /**
+     * @brief The fields held in the first four header words.
+     */
+    scan_header = scan_times | scan_energy | scan_ids | scan_flags,
+    scan_all = 0xFF
+};
+
+/**
+ * @brief A batch of decoded events stored as a structure of arrays.
+ *
+ * Each decoded value is held in a contiguous column indexed by the event's
+ * position in the batch. Variable length data, the energy sums, QDCs and
+ * traces, are held in shared arenas with a per-event offset. Analysis that
+ * only needs a few values, for example the time and energy, can scan those
+ * columns without touching the rest of the event's data.
+ *
+ * Clearing a batch keeps the memory of the columns and arenas so a batch can
+ * be reused for each data block without allocating.
+ *
+ * A batch holds the fields in its scan fields. The columns of the fields
+ * not held are empty.
+ */
+struct PIXIE_EXPORT event_batch {
+    /**
+     * @brief The type used for the crate, slot and channel columns.
+     */
+    using id_type = uint16_t;
+    /**
+     * @brief The type of a trace sample.
+     */
+    using trace_value = uint16_t;
+    /**
+     * @brief The offset recorded when an event has no energy sums or QDCs.
+     */
+    static constexpr size_t no_data = static_cast<size_t>(-1);
+
+    /**
+     * @brief Bits in the flags column.
+     */
+    enum flag_bits : uint8_t {
+        finish_code = 1 << 0,
+        trace_out_of_range = 1 << 1,
+        cfd_forced_trigger = 1 << 2
+    };
+
+    /**
+     * @brief A view of an event's trace in the trace arena.
+     */
+    struct trace_view {
+        const trace_value* data;
+        size_t length;
+    };
+
+    explicit event_batch(uint32_t fields_ = scan_all);
+
+    /**
+     * @brief The number of events in the batch. A scan without the times
+     * counts the lengths, they are always decoded.
+     */
+    size_t size() const {
+        return holds(scan_times) ? time.size() : event_length.size();
+    }
+    /**
+     * @brief True if there are no events in the batch.
+     */
+    bool empty() const {
+        return size() == 0;
+    }
+
+    /**
+     * @brief Returns true if the batch holds all the fields.
+     */
+    bool holds(uint32_t fields_) const {
+        return (fields & fields_) == fields_;
+    }
+
+    /**
+     * @brief Remove all events. The memory is kept for reuse.
+     */
+    void clear();
+    /**
+     * @brief Reserve memory for a number of events and trace samples.
+     */
+    void reserve(const size_t events, const size_t trace_samples = 0);
+
+    /**
+     * @brief Returns a view of an event's trace. The length is 0 if the
+     * event has no trace.
+     */
+    trace_view trace(const size_t event) const;
+
+    /**
+     * @brief Copy an event in the batch to a record. The values of the
+     * fields the batch does not hold are 0.
+     * @throws xia::pixie::error::error if the event is out of range.
+     */
+    void get(const size_t event, record& rec) const;
+
+    /**
+     * @brief The scan fields decoded into the batch. Set the fields when
+     * the batch is empty.
+     */
+    uint32_t fields;
+
+    /*
+     * Times in seconds.
+     */
+    std::vector<double> time;
+    std::vector<double> filter_time;
+    std::vector<double> cfd_fractional_time;
+    std::vector<double> external_time;
+    /*
+     * The raw time stamps and fixed point times, see the record.
+     */
+    std::vector<uint64_t> timestamp;
+    std::vector<record::fixed_time_type> fixed_time;
+
+    std::vector<double> energy;
+    std::vector<double> filter_baseline;
+
+    std::vector<id_type> crate;
+    std::vector<id_type> slot;
+    std::vector<id_type> channel;
+    std::vector<uint8_t> cfd_trigger_source;
+    std::vector<uint8_t> flags;
+    std::vector<uint16_t> header_length;
+    std::vector<uint32_t> event_length;
+
+    /*
+     * Per-event offsets into the arenas.
+     */
+    std::vector<size_t> energy_sums_offset;
+    std::vector<size_t> qdc_offset;
+    std::vector<size_t> trace_offset;
+    std::vector<uint32_t> trace_length;
+
+    /*
+     * Arenas
+     */
+    std::vector<uint32_t> energy_sums;
+    std::vector<uint32_t> qdc;
+    std::vector<trace_value> traces;
+};
+
+/**
+ * @brief A compact event.
+ *
+ * A compact event holds a record's header values in 48 bytes. The times are
+ * the fixed point times. The external time, energy sums and QDC sums are
+ * optional blocks of words and the trace is a range of samples, both held
+ * in the arenas of a compact event set.
+ */
+struct compact_event {
+    /**
+     * @brief The flags.
+     */
+    static constexpr uint8_t cfd_forced_trigger = 1 << 0;
+    static constexpr uint8_t finish_code = 1 << 1;
+    static constexpr uint8_t trace_out_of_range = 1 << 2;
+    static constexpr uint8_t has_external_time = 1 << 3;
+    static constexpr uint8_t has_energy_sums = 1 << 4;
+    static constexpr uint8_t has_qdc = 1 << 5;
+
+    record::fixed_time_type fixed_time;
+    uint64_t timestamp;
+    int32_t cfd_fixed_time;
+    float energy;
+    uint32_t event_length;
+    /*
+     * The offset of the event's blocks in the block arena. The blocks that
+     * are present are in the order external time, energy sums, QDC sums.
+     */
+    uint32_t blocks;
+    uint32_t trace_offset;
+    uint32_t trace_length;
+    uint8_t crate_id;
+    uint8_t slot_id;
+    uint8_t channel_number;
+    uint8_t cfd_trigger_source;
+    uint8_t header_length;
+    uint8_t flags;
+};
+
+/**
+ * @brief A set of compact events with the arenas of their blocks and
+ * traces.
+ *
+ * The optional blocks held are selected by scan fields, an event's blocks
+ * not selected are dropped when it is added. Clearing the set keeps its
+ * memory.
+ */
+class PIXIE_EXPORT compact_events {
+public:
+    using trace_value = event_batch::trace_value;
+
+    /**
+     * @brief The optional blocks that can be held.
+     */
+    static constexpr uint32_t blocks_all =
+        scan_external_time | scan_energy_sums | scan_qdc | scan_traces;
+
+    /**
+     * @brief Create a set.
+     * @param blocks_ The scan fields of the optional blocks to hold.
+     */
+    explicit compact_events(uint32_t blocks_ = blocks_all);
+
+    /**
+     * @brief Add a record.
+     * @throws xia::pixie::error::error if a value does not fit the compact
+     *  event or the arenas are full.
+     */
+    void add(const record& rec);
+    /**
+     * @brief Get an event as a record. The double times are the fixed point
+     * times converted.
+     */
+    void get(const size_t event, record& rec) const;
+
+    void clear();
+    void reserve(const size_t events_, const size_t trace_samples = 0);
+
+    size_t size() const {
+        return events.size();
+    }
+    bool empty() const {
+        return events.empty();
+    }
+    /**
+     * @brief The bytes of the events and arenas in use.
+     */
+    size_t bytes() const;
+
+    const compact_event& operator[](const size_t event) const {
+        return events[event];
+    }
+
+    /**
+     * @brief The trace samples of an event.
+     */
+    event_batch::trace_view trace(const size_t event) const;
+
+    const uint32_t blocks;
+
+    std::vector<compact_event> events;
+    std::vector<uint32_t> block_words;
+    std::vector<trace_value> traces;
+};
+
+/**
+ * @brief A per-channel calibration applied while list-mode data is decoded.
+ *
+ * A channel's energy calibration is a polynomial of the raw energy that is
+ * compiled into a lookup table of the 16-bit energy range so calibrating an
+ * event is a table load. A channel's time offset, for example a cable
+ * delay, is added to the event's time and filter time. The channels not
+ * set are decoded without a change.
+ *
+ * Set the channels then compile the table once. A compiled table is not
+ * changed by decoding and can be shared by decoding threads.
+ */
+class PIXIE_EXPORT calibration {
+public:
+    using time_type = record::time_type;
+    using coefficients = std::vector<double>;
+
+    /**
+     * @brief The size of the energy lookup table, the 16-bit energy range.
+     */
+    static constexpr size_t energy_range = 65536;
+    /**
+     * @brief The crate, slot and channel limits. These are the 4-bit fields
+     * of the event header.
+     */
+    static constexpr size_t max_ids = 16;
+
+    /**
+     * @brief A compiled channel.
+     */
+    struct channel_table {
+        std::vector<double> energy;
+        time_type time_offset;
+        record::fixed_time_type fixed_time_offset;
+    };
+
+    calibration();
+
+    /**
+     * @brief Set a channel's calibration. The table is no longer compiled.
+     * @param crate The crate id.
+     * @param slot The slot id.
+     * @param channel The channel number.
+     * @param energy The polynomial coefficients of the energy starting with
+     *  the constant term. If empty the energy is not calibrated.
+     * @param time_offset The time added to the event times.
+     * @throws xia::pixie::error::error if an id is out of range.
+     */
+    void set(size_t crate, size_t slot, size_t channel, const coefficients& energy,
+             time_type time_offset = time_type(0));
+
+    /**
+     * @brief Compile the lookup tables of the channels set.
+     */
+    void compile();
+    bool compiled() const {
+        return compiled_;
+    }
+
+    /**
+     * @brief Remove all channels.
+     */
+    void clear();
+
+    /**
+     * @brief Find a channel's compiled table.
+     * @return The table or nullptr if the channel is not calibrated or the
+     *  table is not compiled.
+     */
+    const channel_table* find(size_t crate, size_t slot, size_t channel) const {
+        if (!compiled_ || crate >= max_ids || slot >= max_ids || channel >= max_ids) {
+            return nullptr;
+        }
+        const int32_t entry = index[(crate * max_ids + slot) * max_ids + channel];
+        return entry < 0 ? nullptr : &tables[size_t(entry)];
+    }
+
+private:
+    struct setting {
+        size_t crate;
+        size_t slot;
+        size_t channel;
+        coefficients energy;
+        time_type time_offset;
+    };
+
+    std::vector<setting> settings;
+    std::vector<channel_table> tables;
+    std::vector<int32_t> index;
+    bool compiled_;
+};
+
+/**
+ * @brief Recovery from corrupt words when decoding.
+ *
+ * A decoder given a recovery does not throw when it finds a bad event.
+ * It skips forward a word at a time to the next plausible header and
+ * continues decoding from it. A plausible header has a known header
+ * length, an event length that matches the header and trace lengths, no
+ * CFD time if the CFD trigger was forced, a slot in range and the
+ * expected slot and crate if set. A header found after skipping words
+ * has to be followed by a plausible header if the block holds the next
+ * header.
+ *
+ * The counts are for all the blocks decoded with the recovery, a block's
+ * leftovers have to be prepended to the next block. Reset the recovery
+ * to decode unrelated data.
+ */
+struct PIXIE_EXPORT recovery {
+    /**
+     * @brief Any slot or crate.
+     */
+    static constexpr size_t any = static_cast<size_t>(-1);
+
+    /**
+     * @brief The expected slot and crate of the module's events.
+     */
+    size_t slot;
+    size_t crate;
+
+    /**
+     * @brief The number of corrupt runs of words found.
+     */
+    size_t errors;
+    /**
+     * @brief The number of times decoding continued after skipping words.
+     */
+    size_t resyncs;
+    /**
+     * @brief The number of words skipped.
+     */
+    size_t skipped_words;
+    /**
+     * @brief Words are being skipped, the end of the last block was in a
+     * corrupt run.
+     */
+    bool resyncing;
+
+    recovery(size_t slot = any, size_t crate = any);
+
+    /**
+     * @brief Reset the counts.
+     */
+    void reset();
+};
+
 /**
  * @brief Decodes a Pixie-16 list-mode data block.
  *
@@ -343,7 +957,7 @@ using buffer = std::vector<uint32_t>;
  * early and fast because the data blocks do not contain marker information.
  * If we encounter corrupted data, or values don't match with what we expect,
  * then we have no way to recover, and we'll have to consider the whole buffer
- * corrupted.
+ * corrupted. Give a recovery to skip the corrupt words instead.
  *
  * @param data A pointer to the array containing the data read out of the module.
  *  The data block does not have to be an integer number of records.
@@ -364,9 +978,16 @@ using buffer = std::vector<uint32_t>;
  *  data buffer, then we fill the leftovers buffer with the remaining data. This
  *  typically happens when you've passed in a partial record, or a data block
  *  that contains a partial record at the end.
+ * @param calib The calibration applied to the decoded events. A compiled
+ *  table or nullptr for no calibration.
+ * @param recover The recovery used for corrupt data or nullptr to throw
+ *  on the first bad event.
+ * @throws xia::pixie::error::error if the calibration is not compiled.
  */
 PIXIE_EXPORT void PIXIE_API decode_data_block(uint32_t* data, size_t len, size_t revision,
-                                              size_t frequency, records& recs, buffer& leftovers);
+                                              size_t frequency, records& recs, buffer& leftovers,
+                                              const calibration* calib = nullptr,
+                                              recovery* recover = nullptr);
 
 /**
  * @brief Decodes a Pixie-16 list-mode data block.
@@ -398,12 +1019,896 @@ PIXIE_EXPORT void PIXIE_API decode_data_block(uint32_t* data, size_t len, size_t
  */
 PIXIE_EXPORT void PIXIE_API decode_data_block(buffer data, size_t revision, size_t frequency,
                                               records& recs, buffer& leftovers);
+
+/**
+ * @brief Decodes a Pixie-16 list-mode data block into a record arena.
+ *
+ * The decoding and errors are the same as the records version. The arena is
+ * cleared and its records are reused.
+ *
+ * @param data A pointer to the array containing the data read out of the module.
+ * @param len The length of the data array.
+ * @param revision The firmware revision used to collect the data.
+ * @param frequency The module's ADC sampling frequency that collected the data.
+ * @param arena The arena that holds the decoded records.
+ * @param leftovers A vector to hold any remaining words that could not be decoded.
+ * @param calib The calibration applied to the decoded events.
+ * @param recover The recovery used for corrupt data or nullptr.
+ */
+PIXIE_EXPORT void PIXIE_API decode_data_block(uint32_t* data, size_t len, size_t revision,
+                                              size_t frequency, record_arena& arena,
+                                              buffer& leftovers,
+                                              const calibration* calib = nullptr,
+                                              recovery* recover = nullptr);
+
+/**
+ * @brief Decodes a Pixie-16 list-mode data block into an event batch.
+ *
+ * The decoding and errors are the same as the records version. The decoded
+ * events are appended to the batch, clear the batch to reuse it.
+ *
+ * @param data A pointer to the array containing the data read out of the module.
+ * @param len The length of the data array.
+ * @param revision The firmware revision used to collect the data.
+ * @param frequency The module's ADC sampling frequency that collected the data.
+ * @param batch The event batch the decoded events are appended to.
+ * @param leftovers A vector to hold any remaining words that could not be decoded.
+ * @param calib The calibration applied to the decoded events.
+ * @param recover The recovery used for corrupt data or nullptr.
+ */
+PIXIE_EXPORT void PIXIE_API decode_data_block(uint32_t* data, size_t len, size_t revision,
+                                              size_t frequency, event_batch& batch,
+                                              buffer& leftovers,
+                                              const calibration* calib = nullptr,
+                                              recovery* recover = nullptr);
+
+/**
+ * @brief Decodes a Pixie-16 list-mode data block into a compact event set.
+ *
+ * The decoding and errors are the same as the records version. The decoded
+ * events are appended to the set.
+ *
+ * @param data A pointer to the array containing the data read out of the module.
+ * @param len The length of the data array.
+ * @param revision The firmware revision used to collect the data.
+ * @param frequency The module's ADC sampling frequency that collected the data.
+ * @param events The compact event set the decoded events are appended to.
+ * @param leftovers A vector to hold any remaining words that could not be decoded.
+ * @param calib The calibration applied to the decoded events.
+ * @param recover The recovery used for corrupt data or nullptr.
+ */
+PIXIE_EXPORT void PIXIE_API decode_data_block(uint32_t* data, size_t len, size_t revision,
+                                              size_t frequency, compact_events& events,
+                                              buffer& leftovers,
+                                              const calibration* calib = nullptr,
+                                              recovery* recover = nullptr);
+
+/**
+ * @brief Scans a Pixie-16 list-mode data block decoding only the fields
+ * requested into an event batch.
+ *
+ * The decoding and errors are the same as the records version. The batch is
+ * cleared and holds the fields requested.
+ *
+ * @param data A pointer to the array containing the data read out of the module.
+ * @param len The length of the data array.
+ * @param revision The firmware revision used to collect the data.
+ * @param frequency The module's ADC sampling frequency that collected the data.
+ * @param fields The scan fields to decode.
+ * @param batch The event batch holding the scanned events.
+ * @param leftovers A vector to hold any remaining words that could not be decoded.
+ * @param calib The calibration applied to the decoded events.
+ * @param recover The recovery used for corrupt data or nullptr.
+ */
+PIXIE_EXPORT void PIXIE_API scan_data_block(uint32_t* data, size_t len, size_t revision,
+                                            size_t frequency, uint32_t fields,
+                                            event_batch& batch, buffer& leftovers,
+                                            const calibration* calib = nullptr,
+                                            recovery* recover = nullptr);
+
+/**
+ * @brief Handles the events a parallel decode worker decoded from a chunk.
+ *
+ * The worker is the number of the worker thread calling the handler. The
+ * handler is called from all workers concurrently. A worker only calls
+ * the handler for one chunk at a time so per-worker state, for example
+ * statistics, can be updated without locking and merged after the decode.
+ */
+using batch_handler = std::function<void(size_t worker, event_batch& batch)>;
+
+/**
+ * @brief Finds the boundaries of chunks of complete events in a data block.
+ *
+ * The data has no markers so the event length of each event is walked from
+ * the start of the data. A boundary is placed at the first event boundary
+ * at or after each chunk size of words.
+ *
+ * @param data A pointer to the array containing the data read out of the module.
+ * @param len The length of the data array.
+ * @param revision The firmware revision used to collect the data.
+ * @param frequency The module's ADC sampling frequency that collected the data.
+ * @param chunk_words The minimum size of a chunk in words.
+ * @param boundaries The offsets of the chunks. The first is 0 and the last
+ *  is the end of the last complete event.
+ * @return The number of words of complete events.
+ */
+PIXIE_EXPORT size_t PIXIE_API find_event_boundaries(const uint32_t* data, size_t len,
+                                                    size_t revision, size_t frequency,
+                                                    size_t chunk_words,
+                                                    std::vector<size_t>& boundaries);
+
+/**
+ * @brief A decoder of the data of a firmware revision and ADC frequency.
+ *
+ * The layout of the revision and frequency is selected once when the
+ * decoder is made and a decode calls the layout's decoder through the
+ * decoder's table rather than selecting the layout for each data block.
+ * The decoding and errors are the same as decode_data_block.
+ */
+class PIXIE_EXPORT decoder {
+public:
+    /**
+     * @throws xia::pixie::error::error if the revision or frequency is not
+     *  supported.
+     */
+    decoder(size_t revision, size_t frequency);
+
+    /*
+     * The records and arena are cleared, the batch and compact events are
+     * appended to.
+     */
+    void decode(uint32_t* data, size_t len, records& recs, buffer& leftovers,
+                const calibration* calib = nullptr, recovery* recover = nullptr) const;
+    void decode(uint32_t* data, size_t len, record_arena& arena, buffer& leftovers,
+                const calibration* calib = nullptr, recovery* recover = nullptr) const;
+    void decode(uint32_t* data, size_t len, event_batch& batch, buffer& leftovers,
+                const calibration* calib = nullptr, recovery* recover = nullptr) const;
+    void decode(uint32_t* data, size_t len, compact_events& events, buffer& leftovers,
+                const calibration* calib = nullptr, recovery* recover = nullptr) const;
+
+    const size_t revision;
+    const size_t frequency;
+
+private:
+    template<typename Target>
+    using path = void (*)(uint32_t* data, size_t len, size_t revision, Target& target,
+                          buffer& leftovers, const calibration* calib, recovery* recover);
+
+    path<records> records_path;
+    path<record_arena> arena_path;
+    path<event_batch> batch_path;
+    path<compact_events> compact_path;
+};
+
+/**
+ * @brief Decodes a Pixie-16 list-mode data block with a number of threads.
+ *
+ * The data block is split into chunks of complete events and worker threads
+ * decode the chunks into event batches calling the handler with each. The
+ * order the chunks are handled in is not defined. If decoding fails the
+ * error closest to the start of the data is thrown once the workers have
+ * stopped.
+ *
+ * @param data A pointer to the array containing the data read out of the module.
+ * @param len The length of the data array.
+ * @param revision The firmware revision used to collect the data.
+ * @param frequency The module's ADC sampling frequency that collected the data.
+ * @param threads The number of worker threads. If 0 the hardware concurrency
+ *  is used.
+ * @param handler The handler called with each chunk's event batch.
+ * @param leftovers A vector to hold any remaining words of a partial event
+ *  at the end of the data.
+ * @param fields The scan fields decoded into the batches.
+ * @param calib The calibration applied to the decoded events, shared by the
+ *  workers.
+ */
+PIXIE_EXPORT void PIXIE_API decode_data_block_parallel(uint32_t* data, size_t len,
+                                                       size_t revision, size_t frequency,
+                                                       size_t threads,
+                                                       const batch_handler& handler,
+                                                       buffer& leftovers,
+                                                       uint32_t fields = scan_all,
+                                                       const calibration* calib = nullptr);
+
+/**
+ * @brief The reduction of list-mode data before it is queued for a user.
+ *
+ * An event is kept if its channel is in the channel mask, its energy is in
+ * the energy window and its finish code passes the finish code policy. The
+ * trace of a kept event is kept or stripped by its channel's trace policy.
+ */
+struct PIXIE_EXPORT reduction {
+    /**
+     * @brief The events kept by their finish code, the pile-up flag.
+     */
+    enum struct finish_codes { keep, drop, only };
+    /**
+     * @brief The traces of a channel's kept events.
+     */
+    enum struct traces {
+        /**
+         * @brief Keep the traces.
+         */
+        keep,
+        /**
+         * @brief Strip the traces.
+         */
+        strip,
+        /**
+         * @brief Only keep the traces of piled up events.
+         */
+        pileup,
+        /**
+         * @brief Keep the trace's region of interest and decimate the
+         * rest of the trace, see @ref trace_roi.
+         */
+        roi
+    };
+
+    /**
+     * @brief A trace's region of interest.
+     *
+     * The samples in the region are kept at full resolution. The samples
+     * before and after the region are reduced to the mean of each
+     * `decimation` samples. A decimation of 0 strips the samples outside
+     * the region. A reduced trace is padded to an even number of samples.
+     *
+     * The region is set in samples from the start of the trace. The
+     * trigger is the channel's trace delay into the trace so a region
+     * around the trigger starts the samples wanted before the trigger
+     * less than the trace delay.
+     */
+    struct PIXIE_EXPORT trace_roi {
+        size_t start;
+        size_t length;
+        size_t decimation;
+
+        trace_roi();
+
+        /**
+         * @brief Returns the number of samples a trace is reduced to.
+         */
+        size_t reduced_length(size_t trace_length) const;
+
+        /**
+         * @brief Reduce a trace's packed sample words. The output can be
+         * the input or start before it. Returns the number of samples.
+         */
+        size_t reduce(const uint32_t* in, size_t trace_length, uint32_t* out) const;
+
+        /**
+         * @brief Expand a reduced trace to the trace length. A decimated
+         * sample is repeated for the samples it is the mean of and a
+         * stripped sample is 0.
+         * @throws xia::pixie::error::error if the reduced trace is too
+         *  short for the trace length.
+         */
+        void expand(const record::trace_type& reduced, size_t trace_length,
+                    record::trace_type& trace) const;
+    };
+
+    /**
+     * @brief The channels kept, a bit per channel number.
+     */
+    uint64_t channel_mask;
+    /**
+     * @brief The energy window. An event's energy is kept if it is in the
+     * window including the limits.
+     */
+    uint32_t energy_min;
+    uint32_t energy_max;
+    finish_codes finish_code;
+    /**
+     * @brief The trace policy of each channel. Channels without a policy
+     * keep their traces.
+     */
+    std::vector<traces> trace_policy;
+    /**
+     * @brief The region of interest of each channel with the `roi` trace
+     * policy.
+     */
+    std::vector<trace_roi> trace_rois;
+
+    reduction();
+
+    /**
+     * @brief Returns true if the reduction does not change any events.
+     */
+    bool pass_through() const;
+};
+
+/**
+ * @brief Reduces blocks of list-mode data in place in a single pass.
+ *
+ * The blocks are consecutive blocks of a module's data, for example the
+ * FIFO's DMA reads. An event can span blocks. The filter holds the state
+ * of an event that spans the end of a block so the next block is reduced
+ * from where the event continues. A header split by the end of a block is
+ * held and prepended to the next block.
+ *
+ * The event header layout is the layout of the firmware revision and
+ * frequency. A stripped or reduced trace's event length and trace length
+ * are updated in its header. A kept event with a region of interest that
+ * spans the end of a block is held and prepended to the next block so
+ * its trace is reduced whole.
+ */
+class PIXIE_EXPORT event_filter {
+public:
+    /**
+     * @brief The counts of the data reduced.
+     */
+    struct stats {
+        size_t events_in;
+        size_t events_out;
+        size_t traces_stripped;
+        size_t traces_reduced;
+        size_t words_in;
+        size_t words_out;
+
+        stats();
+    };
+
+    event_filter();
+
+    /**
+     * @brief Configure the filter and reset its state.
+     * @throws xia::pixie::error::error if the revision or frequency is not
+     *  supported or a channel with the `roi` trace policy has no region.
+     */
+    void configure(const reduction& policy, size_t revision, size_t frequency);
+
+    /**
+     * @brief Clear the state held between blocks. The next block starts
+     * with an event.
+     */
+    void reset();
+
+    /**
+     * @brief Returns true if the filter has been configured and reduces
+     * data.
+     */
+    bool enabled() const;
+
+    const reduction& policy() const {
+        return policy_;
+    }
+
+    const stats& counts() const {
+        return counts_;
+    }
+
+    /**
+     * @brief Reduce a block in place. The held words of a split header are
+     * prepended and the block is resized to the reduced data.
+     * @throws xia::pixie::error::error if an event's lengths are not valid.
+     */
+    template<typename Alloc>
+    void reduce(std::vector<uint32_t, Alloc>& block) {
+        if (!held.empty()) {
+            block.insert(block.begin(), held.begin(), held.end());
+            held.clear();
+        }
+        block.resize(reduce(block.data(), block.size()));
+    }
+
+private:
+    size_t reduce(uint32_t* data, size_t len);
+
+    template<typename Layout>
+    size_t reduce_events(uint32_t* data, size_t len);
+
+    reduction policy_;
+    size_t revision;
+    size_t frequency;
+    bool configured;
+    stats counts_;
+
+    /*
+     * The words of the event spanning the end of the last block still to
+     * be passed or skipped and the words of a split header or a split
+     * event with a region of interest.
+     */
+    size_t pass;
+    size_t skip;
+    buffer held;
+};
+
+/**
+ * @brief Validates the structure of blocks of list-mode data in a single
+ * pass.
+ *
+ * The blocks are consecutive blocks of a module's data, for example the
+ * FIFO's DMA reads, and an event can span blocks. Each event's header is
+ * checked for a valid header length, an event length that matches the
+ * header and trace lengths, the module's slot and the crate if it is set.
+ * A header that fails a check is a fault and the data is scanned for the
+ * next header that passes the checks, a resynchronization. Runs of zero
+ * words are found by a vector scan of the block.
+ *
+ * The faults are held up to a limit reserved when the validator is
+ * configured so validating a block does not allocate.
+ */
+class PIXIE_EXPORT event_validator {
+public:
+    static constexpr size_t any_crate = size_t(-1);
+    static constexpr size_t default_zero_run_words = 32;
+    static constexpr size_t default_max_faults = 64;
+
+    enum struct fault_kind {
+        header_length,
+        event_length,
+        slot,
+        crate,
+        /**
+         * @brief A run of zero words of at least the zero run length.
+         */
+        zero_run,
+        /**
+         * @brief Not a fault, the header found by a resynchronization. The
+         * word is the number of words skipped.
+         */
+        resync
+    };
+
+    /**
+     * @brief A fault. The offset is in words from the start of the data
+     * since the validator was reset. The word is the header's first word.
+     */
+    struct fault {
+        fault_kind kind;
+        size_t offset;
+        uint32_t word;
+    };
+    using faults = std::vector<fault>;
+
+    /**
+     * @brief The counts of the data validated.
+     */
+    struct stats {
+        size_t blocks;
+        size_t words;
+        size_t events;
+        size_t faults;
+        size_t resyncs;
+        size_t skipped_words;
+        size_t zero_runs;
+
+        stats();
+    };
+
+    event_validator();
+
+    /**
+     * @brief Configure the validator and reset its state. A zero run length
+     * of 0 does not scan for zero runs.
+     * @throws xia::pixie::error::error if the revision or frequency is not
+     *  supported.
+     */
+    void configure(size_t revision, size_t frequency, size_t slot, size_t crate = any_crate,
+                   size_t zero_run_words = default_zero_run_words,
+                   size_t max_faults = default_max_faults);
+
+    /**
+     * @brief Clear the state held between blocks, the faults and the
+     * counts. The next block starts with an event.
+     */
+    void reset();
+
+    bool enabled() const {
+        return configured;
+    }
+
+    /**
+     * @brief Validate a block. Returns the number of faults found in the
+     * block.
+     * @throws xia::pixie::error::error if the validator is not configured.
+     */
+    size_t validate(const uint32_t* data, size_t len);
+
+    template<typename Alloc>
+    size_t validate(const std::vector<uint32_t, Alloc>& block) {
+        return validate(block.data(), block.size());
+    }
+
+    const stats& counts() const {
+        return counts_;
+    }
+
+    /**
+     * @brief The faults and resynchronizations found. A block's header
+     * faults and resynchronizations are followed by its zero runs. Once
+     * the limit is reached the faults are only counted.
+     */
+    const faults& found() const {
+        return faults_;
+    }
+
+    void clear_faults();
+
+private:
+    template<typename Layout>
+    void check_events(const uint32_t* data, size_t len);
+
+    /*
+     * Returns the event length of a valid header, otherwise 0. The fault
+     * is noted if the offset is not null.
+     */
+    template<typename Layout>
+    size_t check_header(const uint32_t* header, const size_t* offset);
+
+    void scan_zero_runs(const uint32_t* data, size_t len);
+    void note(fault_kind kind, size_t at, uint32_t word);
+    void fail(size_t at);
+    void resynced(size_t at);
+
+    size_t revision;
+    size_t frequency;
+    size_t slot;
+    size_t crate;
+    size_t zero_run_words;
+    size_t max_faults;
+    bool configured;
+    stats counts_;
+    faults faults_;
+
+    /*
+     * The words validated before the block, the words of the event
+     * spanning the end of the last block still to come and the length of
+     * the zero run at the end of the last block.
+     */
+    size_t offset;
+    size_t skip;
+    size_t zero_run;
+    /*
+     * Resynchronizing since the fault at the offset.
+     */
+    bool resyncing;
+    size_t fault_at;
+    /*
+     * The words of a header or header being tried split by the end of the
+     * last block.
+     */
+    std::array<uint32_t, 4> held;
+    size_t held_count;
+};
+
+class file_reader;
+
+/**
+ * @brief A checkpoint in a list-mode data file. A checkpoint is placed
+ * every stride of events and covers the events up to the next checkpoint.
+ */
+struct PIXIE_EXPORT time_checkpoint {
+    /**
+     * @brief The offset in words of the first event.
+     */
+    size_t offset;
+    /**
+     * @brief The number of events covered.
+     */
+    size_t events;
+    /**
+     * @brief The filter times in seconds of the first event and the range
+     * of the events covered. The events of a module are not strictly time
+     * ordered.
+     */
+    double first_time;
+    double min_time;
+    double max_time;
+    /**
+     * @brief The crate and slot of the first event, the module.
+     */
+    event_batch::id_type crate;
+    event_batch::id_type slot;
+
+    time_checkpoint();
+};
+
+/**
+ * @brief A sparse time index of a list-mode data file.
+ *
+ * The index is built with one scan of the file that walks the event
+ * lengths and is saved in a sidecar file next to the data file. The
+ * index finds the range of the file holding the events of a time range
+ * so the reader can seek to it.
+ */
+class PIXIE_EXPORT time_index {
+public:
+    /**
+     * @brief The default number of events between checkpoints.
+     */
+    static constexpr size_t default_stride = 10000;
+
+    time_index();
+
+    /**
+     * @brief The sidecar file name of a data file.
+     */
+    static std::string sidecar(const std::string& path);
+
+    /**
+     * @brief Save the index to a file.
+     * @throws xia::pixie::error::error if the file cannot be written.
+     */
+    void save(const std::string& path) const;
+    /**
+     * @brief Load the index from a file.
+     * @return False if the file does not exist or the index is for a
+     *  different revision, frequency or size of data file.
+     * @throws xia::pixie::error::error if the file is not valid.
+     */
+    bool load(const std::string& path, const file_reader& reader);
+
+    /**
+     * @brief Add a checkpoint. The checkpoints are added in file order.
+     */
+    void add(const time_checkpoint& checkpoint);
+    void clear();
+
+    /**
+     * @brief The offset in words to read from to get the events at or
+     * after a time. No event before the offset is at or after the time.
+     */
+    size_t start(double time) const;
+    /**
+     * @brief The offset in words to read up to to get the events at or
+     * before a time. No event after the offset is at or before the time.
+     */
+    size_t end(double time) const;
+
+    const std::vector<time_checkpoint>& checkpoints() const {
+        return checkpoints_;
+    }
+
+    size_t stride;
+    size_t revision;
+    size_t frequency;
+    /**
+     * @brief The size of the indexed file in words.
+     */
+    size_t file_words;
+
+private:
+    std::vector<time_checkpoint> checkpoints_;
+    /*
+     * The latest time up to and including a checkpoint and the earliest
+     * time from a checkpoint on.
+     */
+    std::vector<double> latest;
+    std::vector<double> earliest;
+};
+
+/**
+ * @brief Reads and decodes a list-mode data file.
+ *
+ * The file is memory mapped. If the file cannot be mapped it is streamed
+ * with large reads into a single window buffer. The file is decoded a
+ * window at a time and a partial event at the end of a window is carried
+ * into the next window without copying when mapped. The memory used does
+ * not depend on the size of the file.
+ *
+ * A file only holds data from one module so the revision and frequency
+ * are set when the reader is constructed.
+ */
+class PIXIE_EXPORT file_reader {
+public:
+    /**
+     * @brief An input iterator over the event batches of a file.
+     *
+     * Each step decodes the next window of the file into the reader's
+     * batch. There is only one pass over the file.
+     */
+    class iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = event_batch;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const event_batch*;
+        using reference = const event_batch&;
+
+        iterator() : reader(nullptr) {}
+        explicit iterator(file_reader& reader_);
+
+        reference operator*() const {
+            return reader->batch;
+        }
+        pointer operator->() const {
+            return &reader->batch;
+        }
+        iterator& operator++();
+        bool operator==(const iterator& rhs) const {
+            return reader == rhs.reader;
+        }
+        bool operator!=(const iterator& rhs) const {
+            return reader != rhs.reader;
+        }
+
+    private:
+        file_reader* reader;
+    };
+
+    /**
+     * @brief The default window size in words.
+     */
+    static constexpr size_t default_window_words = 16 * 1024 * 1024;
+    /**
+     * @brief The minimum window size in words. A window has to hold the
+     * largest event.
+     */
+    static constexpr size_t min_window_words = 64 * 1024;
+
+    /**
+     * @brief Open the file.
+     * @param path The path of the file.
+     * @param revision The firmware revision used to collect the data.
+     * @param frequency The module's ADC sampling frequency that collected the data.
+     * @param window_words The number of words decoded at a time.
+     * @param use_mmap Memory map the file if possible else stream the file.
+     * @throws xia::pixie::error::error if the file cannot be opened.
+     */
+    file_reader(const std::string& path, size_t revision, size_t frequency,
+                size_t window_words = default_window_words, bool use_mmap = true);
+    ~file_reader();
+
+    file_reader(const file_reader&) = delete;
+    file_reader& operator=(const file_reader&) = delete;
+
+    /**
+     * @brief Decode the next window of events.
+     * @return False if there are no more events in the file.
+     */
+    bool next(event_batch& batch);
+    bool next(records& recs);
+    /**
+     * @brief Decode the next window of events in parallel. See
+     * decode_data_block_parallel.
+     * @return False if there are no more events in the file.
+     */
+    bool next(size_t threads, const batch_handler& handler);
+
+    /**
+     * @brief The scan fields decoded by the parallel decode and the
+     * iterator's batches. All fields are decoded by default.
+     */
+    void set_fields(uint32_t fields);
+    uint32_t fields() const {
+        return batch.fields;
+    }
+
+    /**
+     * @brief The calibration applied to the decoded events. The reader does
+     * not own the calibration, it has to stay valid while the reader uses
+     * it. nullptr is no calibration.
+     */
+    void set_calibration(const calibration* calib_) {
+        calib = calib_;
+    }
+
+    /**
+     * @brief The recovery used when the file has corrupt words. The reader
+     * does not own the recovery and nullptr throws on the first bad event.
+     * The parallel decode does not recover.
+     */
+    void set_recovery(recovery* recover_) {
+        recover = recover_;
+    }
+
+    /**
+     * @brief Iterate over the remaining batches in the file.
+     */
+    iterator begin();
+    iterator end();
+
+    /**
+     * @brief Start reading from the start of the file again.
+     */
+    void rewind();
+
+    /**
+     * @brief Read the file from an offset in words up to an end offset. The
+     * start must be at an event.
+     * @throws xia::pixie::error::error if the range is not in the file.
+     */
+    void seek(size_t start, size_t end = static_cast<size_t>(-1));
+    /**
+     * @brief Read the range of the file holding the events at or after the
+     * start time and at or before the end time. Events outside the times
+     * can be in the range.
+     * @throws xia::pixie::error::error if the index is not for the file.
+     */
+    void seek(const time_index& index, double start,
+              double end = std::numeric_limits<double>::max());
+
+    /**
+     * @brief Scan the file and build a time index of it. The reader is
+     * rewound.
+     */
+    void build_index(time_index& index, size_t stride = time_index::default_stride);
+
+    /**
+     * @brief The size of the file in words.
+     */
+    size_t size() const {
+        return size_words;
+    }
+    /**
+     * @brief The number of words decoded.
+     */
+    size_t position() const {
+        return offset;
+    }
+    /**
+     * @brief The number of words after the last complete event. This is
+     * only valid once the end of the file has been reached.
+     */
+    size_t leftovers() const {
+        return trailing_words;
+    }
+    /**
+     * @brief True if the file is memory mapped.
+     */
+    bool mapped() const {
+        return map != nullptr;
+    }
+
+    const std::string path;
+    const size_t revision;
+    const size_t frequency;
+    const size_t window_words;
+
+private:
+    /*
+     * Get the next window of data, false if the end of the file is reached.
+     */
+    bool window(uint32_t*& data, size_t& len);
+    /*
+     * Consume a window leaving the leftover words for the next window.
+     */
+    void consume(size_t len, size_t leftover);
+    void close();
+
+    size_t size_words;
+    size_t offset;
+    size_t trailing_words;
+    bool at_end;
+    /*
+     * The end of the range being read.
+     */
+    size_t end_words;
+
+    uint32_t* map;
+    size_t map_bytes;
+    size_t map_released;
+#if defined(_WIN64) || defined(_WIN32)
+    void* file_handle;
+    void* mapping_handle;
+#else
+    int fd;
+#endif
+
+    /*
+     * Streaming
+     */
+    std::FILE* stream;
+    buffer window_data;
+    size_t window_start;
+    size_t window_end;
+
+    buffer leftover_data;
+    event_batch batch;
+    const calibration* calib;
+    recovery* recover;
+
+    decoder layout_decoder;
+};
 }  // namespace list_mode
 }  // namespace data
 }  // namespace pixie
 }  // namespace xia
 
 std::ostream& operator<<(std::ostream& out, xia::pixie::data::list_mode::record& event);
+std::ostream& operator<<(std::ostream& out,
+                         const xia::pixie::data::list_mode::event_validator::fault_kind kind);
 
 
 #endif  //PIXIESDK_LIST_MODE_HPP
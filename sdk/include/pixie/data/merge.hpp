@@ -0,0 +1,249 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file merge.hpp
+ * @brief Defines a time ordered merge of the list-mode streams of a crate's modules.
+ */
+
+#ifndef PIXIESDK_LIST_MODE_MERGE_HPP
+#define PIXIESDK_LIST_MODE_MERGE_HPP
+
+#include <deque>
+#include <vector>
+
+#include <pixie/data/list_mode.hpp>
+
+namespace xia {
+namespace pixie {
+namespace data {
+namespace list_mode {
+
+/**
+ * @brief Restores the time order of a module's decoded events within a
+ * bounded window.
+ *
+ * A module that does not sort its events, ModCSRB bit 12 is clear, sends
+ * its channels' events partially out of time order. The reorder holds the
+ * events in a min-heap keyed on the fixed point time and releases an event
+ * once an event later than the event's time by more than the window has
+ * been pushed. The released events are in time order if no event is more
+ * than the window out of order. An event earlier than an event already
+ * released is late. A late event is counted and released with the next
+ * events or dropped.
+ *
+ * The reorder is not thread safe.
+ */
+class PIXIE_EXPORT reorder {
+public:
+    using time_type = record::time_type;
+
+    /**
+     * @brief Create a reorder.
+     * @param window The maximum time an event can be out of order.
+     * @param max_held The maximum number of events held. When more are
+     *  held the earliest events are released before the window has passed.
+     *  0 is no limit.
+     * @param drop_late Drop the late events rather than release them.
+     * @throws xia::pixie::error::error if the window is negative.
+     */
+    explicit reorder(time_type window, size_t max_held = 0, bool drop_late = false);
+
+    /**
+     * @brief Push decoded events. The events are moved into the reorder and
+     * the vector is cleared.
+     */
+    void push(records& events);
+
+    /**
+     * @brief Append the events the window has passed to the output in time
+     * order.
+     * @return The number of events released.
+     */
+    size_t pop(records& out);
+
+    /**
+     * @brief Append all the held events to the output in time order, for
+     * example at the end of a run.
+     * @return The number of events released.
+     */
+    size_t flush(records& out);
+
+    /**
+     * @brief The number of events held.
+     */
+    size_t held() const {
+        return heap.size();
+    }
+    /**
+     * @brief The number of late events and the number of them dropped.
+     */
+    size_t late() const {
+        return late_;
+    }
+    size_t dropped() const {
+        return dropped_;
+    }
+
+    const time_type window;
+    const size_t max_held;
+    const bool drop_late;
+
+private:
+    using fixed_time_type = record::fixed_time_type;
+
+    /*
+     * A held event's key. The events are held in slots and the heap only
+     * moves the keys. The sequence keeps the push order of equal times.
+     */
+    struct key {
+        fixed_time_type time;
+        size_t sequence;
+        size_t slot;
+    };
+
+    void release(records& out);
+    size_t release_until(records& out, fixed_time_type until);
+
+    const fixed_time_type fixed_window;
+    std::vector<key> heap;
+    records slots;
+    std::vector<size_t> free_slots;
+    fixed_time_type latest;
+    fixed_time_type released;
+    size_t sequence;
+    size_t late_;
+    size_t dropped_;
+};
+
+/**
+ * @brief Merges the decoded list-mode streams of a number of modules into
+ * a single time ordered stream of coincidence groups.
+ *
+ * Each module's stream is pushed into the merger as it is decoded. A
+ * module's events only need to be in time order within the lookahead,
+ * for example when the module does not sort its events. The merger holds
+ * a stream's events until every stream has progressed the lookahead past
+ * them and then merges the streams with a heap of the stream heads.
+ *
+ * The merged events are grouped. A group starts with the first event not
+ * in a group and contains the events within the coincidence window of the
+ * first event.
+ *
+ * The merger is not thread safe.
+ */
+class PIXIE_EXPORT merger {
+public:
+    using time_type = record::time_type;
+
+    /**
+     * @brief Create a merger.
+     * @param streams The number of streams, typically the number of online
+     *  modules in the crate.
+     * @param window The coincidence window.
+     * @param lookahead The time a stream's events can be out of order.
+     * @param max_pending The maximum number of events held. When more are
+     *  held the oldest events are merged without waiting for the lookahead
+     *  of all streams. 0 is no limit.
+     */
+    merger(size_t streams, time_type window, time_type lookahead = time_type(0),
+           size_t max_pending = 0);
+
+    /**
+     * @brief Push a stream's decoded events. The events are moved into the
+     * merger and the vector is cleared.
+     * @throws xia::pixie::error::error if the stream is not valid or has
+     *  finished.
+     */
+    void push(size_t stream, records& events);
+
+    /**
+     * @brief Tell the merger a stream has no events before a time. This lets
+     * a quiet stream not hold the merge.
+     */
+    void advance(size_t stream, time_type time);
+
+    /**
+     * @brief Finish a stream. There are no more events for the stream.
+     */
+    void finish(size_t stream);
+    /**
+     * @brief Finish all streams.
+     */
+    void finish();
+
+    /**
+     * @brief Pop the next complete coincidence group.
+     * @param group The events of the group in time order.
+     * @return False if there is no complete group.
+     */
+    bool next(records& group);
+
+    /**
+     * @brief The number of events held.
+     */
+    size_t pending() const {
+        return pending_ + merged.size();
+    }
+    /**
+     * @brief The number of streams.
+     */
+    size_t streams() const {
+        return inputs.size();
+    }
+
+    const time_type window;
+    const time_type lookahead;
+    const size_t max_pending;
+
+private:
+    using fixed_time_type = record::fixed_time_type;
+
+    struct input {
+        std::deque<record> events;
+        fixed_time_type watermark;
+        bool started;
+        bool finished;
+        input();
+    };
+
+    input& get_input(size_t stream);
+    /*
+     * The time up to which all streams are complete.
+     */
+    fixed_time_type safe_time() const;
+    /*
+     * Move the merged events that can no longer change to the output.
+     */
+    void merge();
+
+    /*
+     * The merge compares the records' fixed point times.
+     */
+    const fixed_time_type fixed_window;
+    const fixed_time_type fixed_lookahead;
+    std::vector<input> inputs;
+    std::vector<size_t> heap;
+    std::deque<record> merged;
+    size_t pending_;
+};
+}  // namespace list_mode
+}  // namespace data
+}  // namespace pixie
+}  // namespace xia
+
+#endif  //PIXIESDK_LIST_MODE_MERGE_HPP
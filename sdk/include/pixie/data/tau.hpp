@@ -0,0 +1,211 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file tau.hpp
+ * @brief Defines the host side estimation of the preamplifier decay time from traces.
+ */
+
+#ifndef PIXIESDK_LIST_MODE_TAU_HPP
+#define PIXIESDK_LIST_MODE_TAU_HPP
+
+#include <vector>
+
+#include <pixie/data/list_mode.hpp>
+
+namespace xia {
+namespace pixie {
+namespace data {
+/**
+ * @brief Estimates a channel's preamplifier decay time from its traces.
+ *
+ * The pulses in a trace are found with a rising edge trigger. The decay
+ * of each pulse after its peak is fitted with a log-linear least squares
+ * fit weighted by the square of the signal so the noisy end of the tail
+ * counts less. A pulse is rejected if its baseline is not flat, the tail
+ * is too short or the fit is out of range. The channel's decay time is
+ * the median of its pulses' fits so a few piled up or noisy pulses do not
+ * move it.
+ *
+ * The traces can be ADC traces, which can hold many pulses, or list-mode
+ * traces. Many traces can be added to a channel's fitter and the channels
+ * are fitted in parallel.
+ */
+namespace tau {
+/**
+ * @brief A raw trace sample.
+ */
+using value = list_mode::event_batch::trace_value;
+/**
+ * @brief A raw trace.
+ */
+using trace = std::vector<value>;
+using traces = std::vector<trace>;
+/**
+ * @brief A baseline subtracted sample.
+ */
+using sample = float;
+using samples = std::vector<sample>;
+
+/**
+ * @brief The weighted log-linear fit of an exponential decay. The samples
+ * are baseline subtracted and a sample of 0 or less has no weight.
+ *
+ * @param trace The baseline subtracted samples.
+ * @param length The number of samples.
+ * @param work A work array of at least 2 times `length` samples.
+ * @return The decay time in samples or NaN if the samples do not decay.
+ */
+PIXIE_EXPORT double PIXIE_API log_linear(const sample* trace, size_t length, sample* work);
+
+/**
+ * @brief The pulse finding and fit of a channel.
+ */
+struct PIXIE_EXPORT config {
+    /*
+     * The period of a trace sample, units usecs. An ADC trace's period is
+     * the channel's XDT.
+     */
+    double sample_usecs;
+    /*
+     * A pulse triggers when the rise over `rise_samples` is more than the
+     * threshold, units ADC counts.
+     */
+    size_t rise_samples;
+    double threshold;
+    /*
+     * The samples before the trigger the pulse's baseline is the mean of.
+     * The baseline is not flat if the samples' range is more than the
+     * threshold.
+     */
+    size_t baseline_samples;
+    /*
+     * The samples after the trigger the peak is searched for and the
+     * samples after the peak that are not fitted.
+     */
+    size_t peak_samples;
+    size_t skip_samples;
+    /*
+     * The fit stops when the signal falls below the fraction of the
+     * pulse's amplitude, another pulse triggers or the maximum is
+     * reached.
+     */
+    double tail_fraction;
+    size_t min_fit_samples;
+    size_t max_fit_samples;
+    /*
+     * The range of decay times accepted, units usecs.
+     */
+    double min_tau_usecs;
+    double max_tau_usecs;
+
+    config();
+
+    /**
+     * @brief Check the configuration.
+     * @throws xia::pixie::error::error if the configuration is not valid.
+     */
+    void validate() const;
+};
+
+/**
+ * @brief A channel's decay time estimate. The decay time is NaN if no
+ * pulse was fitted.
+ */
+struct PIXIE_EXPORT estimate {
+    double tau_usecs;
+    /*
+     * The median absolute deviation of the pulses' decay times, units
+     * usecs.
+     */
+    double spread_usecs;
+    size_t pulses;
+    size_t rejected;
+
+    estimate();
+
+    bool valid() const;
+};
+
+using estimates = std::vector<estimate>;
+
+/**
+ * @brief Fits the pulses of a channel's traces. A fitter keeps its work
+ * buffer so adding a trace does not allocate once warm.
+ */
+struct PIXIE_EXPORT fitter {
+    /**
+     * @throws xia::pixie::error::error if the configuration is not valid.
+     */
+    explicit fitter(const config& cfg);
+
+    /*
+     * Find and fit the pulses in a trace.
+     */
+    void add(const value* trace, size_t length);
+    void add(const trace& samples_) {
+        add(samples_.data(), samples_.size());
+    }
+
+    estimate result() const;
+    void clear();
+
+    config cfg;
+
+    /*
+     * The decay times of the pulses fitted, units usecs.
+     */
+    std::vector<double> taus;
+    size_t rejected;
+
+    samples work;
+};
+
+using fitters = std::vector<fitter>;
+
+/**
+ * @brief Add a trace to each fitter in parallel. The trace at an index is
+ * added to the fitter at the same index.
+ * @param fits The fitters.
+ * @param channel_traces The traces, one for each fitter.
+ * @param threads The number of threads. If 0 the hardware concurrency is
+ *  used.
+ * @throws xia::pixie::error::error if the number of traces is not the
+ *  number of fitters.
+ */
+PIXIE_EXPORT void PIXIE_API add(fitters& fits, const traces& channel_traces,
+                                size_t threads = 0);
+
+/**
+ * @brief Add the traces of a batch of events to the fitter of the event's
+ * channel in parallel. The batch must hold the ids and traces. An event
+ * with a channel that has no fitter is ignored.
+ * @throws xia::pixie::error::error if the batch does not hold the fields.
+ */
+PIXIE_EXPORT void PIXIE_API add(fitters& fits, const list_mode::event_batch& batch,
+                                size_t threads = 0);
+
+/**
+ * @brief The estimates of the fitters.
+ */
+PIXIE_EXPORT void PIXIE_API results(const fitters& fits, estimates& out);
+}  // namespace tau
+}  // namespace data
+}  // namespace pixie
+}  // namespace xia
+
+#endif  // PIXIESDK_LIST_MODE_TAU_HPP
@@ -0,0 +1,274 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file trace.hpp
+ * @brief Defines processing kernels for decoded list-mode traces.
+ */
+
+#ifndef PIXIESDK_LIST_MODE_TRACE_HPP
+#define PIXIESDK_LIST_MODE_TRACE_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <pixie/data/list_mode.hpp>
+
+namespace xia {
+namespace pixie {
+namespace data {
+/**
+ * @brief Processing of decoded list-mode traces.
+ *
+ * The kernels work on contiguous sample arrays with simple loops the
+ * compiler can vectorize. The sums are split over independent partial
+ * sums so they vectorize without relaxed floating point math. The batch
+ * processing keeps its buffers so it does not allocate once warm.
+ */
+namespace trace {
+/**
+ * @brief A raw trace sample.
+ */
+using value = list_mode::event_batch::trace_value;
+/**
+ * @brief A processed trace sample.
+ */
+using sample = float;
+using samples = std::vector<sample>;
+
+/**
+ * @brief The mean of `count` raw samples from `start`. The window is
+ * limited to the trace. Returns NaN if the window is empty.
+ */
+PIXIE_EXPORT double PIXIE_API mean(const value* trace, size_t length, size_t start,
+                                   size_t count);
+
+/**
+ * @brief Convert raw samples less the baseline to processed samples.
+ */
+PIXIE_EXPORT void PIXIE_API subtract(const value* trace, size_t length, sample baseline,
+                                     sample* out);
+/**
+ * @brief Subtract a baseline from processed samples in place.
+ */
+PIXIE_EXPORT void PIXIE_API subtract(sample* trace, size_t length, sample baseline);
+
+/**
+ * @brief A trailing moving average of a window of samples. The first
+ * samples average the samples available. The output cannot be the trace.
+ */
+PIXIE_EXPORT void PIXIE_API moving_average(const sample* trace, size_t length, size_t window,
+                                           sample* out);
+
+/**
+ * @brief A digital constant fraction discriminator of a baseline
+ * subtracted positive pulse.
+ *
+ * The CFD signal is the delayed trace less the fraction of the trace. It
+ * arms when the signal falls below minus the threshold and triggers when
+ * it next crosses zero. The crossing is interpolated between the samples.
+ *
+ * @param trace The baseline subtracted trace.
+ * @param length The number of samples.
+ * @param delay The delay in samples. Must be more than 0.
+ * @param fraction The fraction of the trace.
+ * @param threshold The arming threshold.
+ * @param work A work array of at least `length` samples for the CFD signal.
+ * @return The time of the crossing in samples from the start of the trace
+ *  or NaN if there is no crossing.
+ */
+PIXIE_EXPORT double PIXIE_API cfd(const sample* trace, size_t length, size_t delay,
+                                  sample fraction, sample threshold, sample* work);
+
+/**
+ * @brief The sum of the samples from `start` up to `end`. The range is
+ * limited to the trace.
+ */
+PIXIE_EXPORT double PIXIE_API integral(const sample* trace, size_t length, size_t start,
+                                       size_t end);
+
+/**
+ * @brief The ratio of the tail integral from `tail` to `end` to the total
+ * integral from `start` to `end`. Returns NaN if the total is 0 or less.
+ */
+PIXIE_EXPORT double PIXIE_API tail_total(const sample* trace, size_t length, size_t start,
+                                         size_t tail, size_t end);
+
+/**
+ * @brief The trace processing of a batch of events.
+ */
+struct PIXIE_EXPORT config {
+    /*
+     * The pre-trigger window the baseline is the mean of.
+     */
+    size_t baseline_start;
+    size_t baseline_samples;
+    /*
+     * The moving average window the CFD input is smoothed with. 0 or 1
+     * does not smooth. The CFD time is corrected for the average's delay.
+     */
+    size_t smoothing;
+    /*
+     * The CFD's delay in samples, fraction and arming threshold.
+     */
+    size_t cfd_delay;
+    double cfd_fraction;
+    double cfd_threshold;
+    /*
+     * The integration windows are relative to the sample of the CFD
+     * crossing. The total is from `total_start` to `end` and the tail is
+     * from `tail_start` to `end`.
+     */
+    int total_start;
+    int tail_start;
+    int end;
+
+    config();
+
+    /**
+     * @brief Check the configuration.
+     * @throws xia::pixie::error::error if the configuration is not valid.
+     */
+    void validate() const;
+};
+
+/**
+ * @brief The results of processing a batch of events' traces. A value is
+ * NaN if the event has no trace or the value could not be found.
+ */
+struct PIXIE_EXPORT results {
+    /*
+     * The baseline subtracted traces at the batch's trace offsets.
+     */
+    samples traces;
+    std::vector<double> baseline;
+    /*
+     * The CFD time in samples from the start of the trace.
+     */
+    std::vector<double> cfd;
+    std::vector<double> total;
+    std::vector<double> psd;
+
+    /*
+     * Work buffers kept for the next batch.
+     */
+    samples work;
+    samples smoothed;
+
+    size_t size() const {
+        return baseline.size();
+    }
+    void clear();
+};
+
+/**
+ * @brief Process the traces of a batch of events. The batch's traces are
+ * converted into the results' trace arena and the baseline, CFD and
+ * integrals are computed in place.
+ * @throws xia::pixie::error::error if the configuration is not valid.
+ */
+PIXIE_EXPORT void PIXIE_API process(const list_mode::event_batch& batch, const config& cfg,
+                                    results& out);
+
+/**
+ * @brief The backends the batches can be processed on.
+ */
+enum struct backend {
+    /*
+     * The kernels run on a host thread.
+     */
+    host,
+    /*
+     * The kernels run on an OpenCL device, a GPU if there is one. The
+     * backend is only available if the SDK is built with USE_OPENCL.
+     */
+    opencl
+};
+
+/**
+ * @brief Returns true if the backend is built and has a device.
+ */
+PIXIE_EXPORT bool PIXIE_API available(backend which);
+
+/**
+ * @brief Processes batches of events' traces asynchronously on a backend.
+ *
+ * A batch is processed while the caller reads and decodes the next so the
+ * processing overlaps the readout. The results are collected in the
+ * order the batches are submitted and are the columns of @ref process
+ * aligned to the batch's events.
+ *
+ * The host backend processes the batch in place so a batch must not
+ * change until its results are collected. The OpenCL backend copies the
+ * batch's trace arena into pinned host memory when it is submitted and
+ * queues the copy to the device, the kernels, with a work item for each
+ * event, and the copy of the results without waiting.
+ */
+class PIXIE_EXPORT offload {
+public:
+    /**
+     * @param cfg_ The trace processing.
+     * @param which The backend.
+     * @param depth The number of batches that can be in flight.
+     * @throws xia::pixie::error::error if the configuration is not valid
+     *  or the backend is not available.
+     */
+    offload(const config& cfg_, backend which = backend::host, size_t depth = 2);
+    ~offload();
+
+    offload(const offload&) = delete;
+    offload& operator=(const offload&) = delete;
+
+    /**
+     * @brief Submit a batch. Returns false if `depth` batches are in
+     * flight, collect a batch and submit again.
+     */
+    bool submit(const list_mode::event_batch& batch);
+
+    /**
+     * @brief Wait for and collect the results of the oldest batch. Returns
+     * false if no batch is in flight. The results' memory is kept for a
+     * later batch.
+     * @throws xia::pixie::error::error if the batch failed.
+     */
+    bool collect(results& out);
+
+    size_t in_flight() const;
+
+    /**
+     * @brief The name of the backend's device.
+     */
+    std::string device() const;
+
+    const config cfg;
+    const backend which;
+
+    /*
+     * The backend's engine.
+     */
+    struct engine;
+
+private:
+    std::unique_ptr<engine> engine_;
+};
+}  // namespace trace
+}  // namespace data
+}  // namespace pixie
+}  // namespace xia
+
+#endif  // PIXIESDK_LIST_MODE_TRACE_HPP
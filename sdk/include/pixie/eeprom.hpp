@@ -25,6 +25,7 @@
 
 #include <array>
 #include <cstdint>
+#include <string>
 #include <vector>
 
 #include <pixie/error.hpp>
@@ -278,6 +279,46 @@ inline T eeprom::get8(const size_t offset) const {
     return static_cast<T>(data[offset + 0]);
 }
 
+/**
+ * @brief Open the process wide host cache of EEPROM contents. The cache is
+ * persisted to the file at the path and the entries in the file are
+ * loaded. A missing file is an empty cache.
+ *
+ * A module's EEPROM is cached if it has a valid CRC. The cache is keyed by
+ * the CRC and the serial number. A module reads the EEPROM's @ref header
+ * and uses the cached contents if the header matches an entry. If not the
+ * full EEPROM block is read and added to the cache. This avoids the slow
+ * I2C read of the full block each time a process opens a module.
+ */
+void cache_open(const std::string& path);
+
+/**
+ * @brief Close the cache. The cache is disabled.
+ */
+void cache_close();
+
+/**
+ * @brief Is the cache open?
+ */
+bool cache_enabled();
+
+/**
+ * @brief Find the contents with a header. The header is the first @ref
+ * header::size bytes of an EEPROM. Returns true and the contents if found.
+ */
+bool cache_find(const contents& hdr, contents& data);
+
+/**
+ * @brief Add the contents of an EEPROM to the cache if it has a valid CRC
+ * and write the cache's file.
+ */
+void cache_add(const contents& data);
+
+/**
+ * @brief The number of entries in the cache.
+ */
+size_t cache_entries();
+
 }  // namespace eeprom
 }  // namespace pixie
 }  // namespace xia
@@ -147,6 +147,10 @@ enum struct code {
      * @brief 217
      */
     module_test_invalid,
+    /**
+     * @brief 218
+     */
+    module_task_cancelled,
     /*
      * Channel
      */
@@ -306,6 +310,10 @@ enum struct code {
      * @brief 704
      */
     file_create_failure,
+    /**
+     * @brief 705
+     */
+    file_write_failure,
     /*
      * System
      */
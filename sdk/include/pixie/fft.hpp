@@ -0,0 +1,199 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file fft.hpp
+ * @brief Defines the fast Fourier transforms of traces.
+ */
+
+#ifndef PIXIE_FFT_H
+#define PIXIE_FFT_H
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace xia {
+namespace pixie {
+/**
+ * @brief Fast Fourier transforms of power of 2 lengths.
+ *
+ * A plan holds the bit reversal swaps and the twiddle factors of a
+ * length so repeated transforms of the length do not compute them. The
+ * transform is an iterative radix-4 with a radix-2 stage for odd powers
+ * of 2. A plan is not changed by a transform and can be shared by
+ * threads.
+ */
+namespace fft {
+/**
+ * @brief A complex value.
+ */
+typedef std::complex<double> value;
+typedef std::vector<value> values;
+
+/**
+ * @brief Returns true if the length is a power of 2.
+ */
+bool power_of_2(const size_t length);
+
+/**
+ * @brief A complex transform of a length.
+ */
+class plan {
+public:
+    /**
+     * @brief Create a plan.
+     * @param length The number of complex values, a power of 2.
+     * @throws xia::pixie::error::error if the length is not a power of 2.
+     */
+    explicit plan(const size_t length);
+
+    size_t length() const {
+        return length_;
+    }
+
+    /**
+     * @brief The forward transform in place.
+     * @param data The length's complex values.
+     */
+    void forward(value* data) const;
+    void forward(values& data) const;
+
+    /**
+     * @brief The inverse transform in place. The result is not scaled,
+     * divide by the length to invert a forward transform.
+     * @param data The length's complex values.
+     */
+    void inverse(value* data) const;
+    void inverse(values& data) const;
+
+private:
+    struct stage {
+        size_t span;
+        size_t twiddles;
+    };
+
+    void transform(value* data, const bool inverse) const;
+
+    size_t length_;
+    bool radix_2;
+    std::vector<std::pair<uint32_t, uint32_t>> swaps;
+    std::vector<stage> stages;
+    /*
+     * Each radix-4 stage of quarter span `L` holds `L` triples, the
+     * twiddles `w^k`, `w^2k` and `w^3k` of the stage's span.
+     */
+    values twiddles;
+};
+
+/**
+ * @brief A transform of real values, for example an ADC trace. The
+ * transform is a complex transform of half the length.
+ */
+class real_plan {
+public:
+    /**
+     * @brief Create a plan.
+     * @param length The number of real values, a power of 2 and 2 or more.
+     * @throws xia::pixie::error::error if the length is not valid.
+     */
+    explicit real_plan(const size_t length);
+
+    size_t length() const {
+        return length_;
+    }
+
+    /**
+     * @brief The number of bins of a transform, half the length plus 1.
+     */
+    size_t bins() const {
+        return length_ / 2 + 1;
+    }
+
+    /**
+     * @brief Check the length of an input.
+     * @throws xia::pixie::error::error if the length is not the plan's length.
+     */
+    void check(const size_t input_length) const;
+
+    /**
+     * @brief The forward transform of the length's real values.
+     * @param input The real values.
+     * @param output The bins, DC to the Nyquist frequency.
+     */
+    template<typename T>
+    void forward(const T* input, value* output) const {
+        for (size_t i = 0; i < half.length(); ++i) {
+            output[i] = value(double(input[2 * i]), double(input[2 * i + 1]));
+        }
+        unpack(output);
+    }
+
+    template<typename T>
+    void forward(const std::vector<T>& input, values& output) const;
+
+    /**
+     * @brief The power spectrum, the squared magnitude of each bin scaled
+     * by the length. The scratch holds the transform.
+     */
+    template<typename T>
+    void power_spectrum(const T* input, double* spectrum, values& scratch) const {
+        scratch.resize(bins());
+        forward(input, scratch.data());
+        for (size_t k = 0; k < bins(); ++k) {
+            spectrum[k] = std::norm(scratch[k]) / double(length_);
+        }
+    }
+
+private:
+    void unpack(value* output) const;
+
+    size_t length_;
+    plan half;
+    values twiddles;
+};
+
+template<typename T>
+void real_plan::forward(const std::vector<T>& input, values& output) const {
+    check(input.size());
+    output.resize(bins());
+    forward(input.data(), output.data());
+}
+
+/**
+ * @brief The power spectra of a batch of traces, for example the ADC
+ * traces of a module's channels. The traces are the plan's length. The
+ * plan's twiddles and a single scratch are shared by the batch.
+ */
+template<typename T>
+void power_spectra(const real_plan& plan, const std::vector<std::vector<T>>& traces,
+                   std::vector<std::vector<double>>& spectra) {
+    values scratch(plan.bins());
+    spectra.resize(traces.size());
+    for (size_t t = 0; t < traces.size(); ++t) {
+        plan.check(traces[t].size());
+        spectra[t].resize(plan.bins());
+        plan.power_spectrum(traces[t].data(), spectra[t].data(), scratch);
+    }
+}
+}  // namespace fft
+}  // namespace pixie
+}  // namespace xia
+
+#endif  // PIXIE_FFT_H
@@ -44,6 +44,12 @@ namespace firmware {
  */
 typedef std::vector<uint8_t> image;
 
+/**
+ * @brief A reference to an immutable image. Images are shared through the
+ * firmware image cache.
+ */
+typedef std::shared_ptr<const image> image_ptr;
+
 /**
  * @brief Image data type.
  *
@@ -155,11 +161,18 @@ struct firmware {
     slots slot;
 
     /**
-     * @brief The image data is a char buffer.
+     * @brief The image data is a char buffer. It is null if the image is not
+     * loaded. The image is shared with other firmware loaded from the same
+     * file or with the same contents.
      *
      * See @ref words for the number of words of data in the image.
      */
-    image data;
+    image_ptr data;
+
+    /**
+     * @brief The CRC32 of the image. Valid when the image is loaded.
+     */
+    uint32_t crc;
 
     /**
      * @brief The firmware's version, module revision (it can be loaded on) and
@@ -184,10 +197,17 @@ struct firmware {
     firmware(firmware&& from);
 
     /**
-     * @brief Load the firmware from its file.
+     * @brief Load the firmware from its file. The image is taken from the
+     * firmware image cache if the file has not changed since it was cached.
      */
     void load();
 
+    /**
+     * @brief The loaded image.
+     * @throws xia::pixie::error::error if the image is not loaded.
+     */
+    image_ptr get_image();
+
     /**
      * @brief Clear the firmware image from this object.
      */
@@ -295,6 +315,28 @@ void load(module& fw);
  */
 void clear(module& fw);
 
+/**
+ * @brief Enable or disable the process wide firmware image cache. The
+ * cache is enabled by default. Disabling the cache clears it.
+ *
+ * The cache holds the images loaded by the process keyed by their file and
+ * validated by the file's size and modification time. An image is shared
+ * with any other file with the same size and CRC32. A cached image is kept
+ * when the firmware is cleared so the next load does not read the file.
+ */
+void image_cache_enable(bool enable);
+
+/**
+ * @brief Drop the cached images. Images loaded into firmware are not
+ * released until the firmware is cleared.
+ */
+void image_cache_clear();
+
+/**
+ * @brief The number of files in the image cache.
+ */
+size_t image_cache_files();
+
 /**
  * @brief Parse a firmware string.
  *
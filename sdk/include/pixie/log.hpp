@@ -52,7 +52,11 @@ static outputters_ptr outputs_ptr = make_outputters();
  * simpler.
  *
  * The macro xia_log provides conditional use of log instances. This improves
- * runtime performance.
+ * runtime performance. The macro xia_logc logs to a category. A category's
+ * level can be set separately from the logging level.
+ *
+ * A log instance uses a stream from a per-thread pool so logging does not
+ * construct a stream for each entry.
  */
 class log {
     friend logging::outputter;
@@ -66,7 +70,15 @@ public:
      */
     enum level { off = 0, error, warning, info, debug, max_level };
 
-    log(level level__) : level_(level__) {}
+    /**
+     * The categories of the SDK's subsystems. The `general` category uses
+     * the logging level. The other categories use the logging level unless
+     * their level has been set.
+     */
+    enum category { general = 0, fifo, dma, bus, param, max_category };
+
+    log(level level__, category category__ = general);
+    log(const log&) = delete;
     ~log();
 
     template<typename T>
@@ -79,22 +91,47 @@ public:
         return level_.load();
     }
 
+    log::category get_category() const {
+        return category_;
+    }
+
 private:
     std::atomic<level> level_;
-    std::ostringstream output;
+    const category category_;
+    std::ostringstream& output;
 };
 
 namespace logging {
 /*
   * Start and stop a log output stream.
+  *
+  * A queue size of 0 writes the entries on the caller's thread. A non-zero
+  * queue size makes the output asynchronous. The entries are queued and a
+  * worker thread formats and writes them. If the queue is full an entry is
+  * dropped and counted. Stopping an output writes the queued entries.
   */
-void start(const std::string name, const std::string file, bool append = true);
+void start(const std::string name, const std::string file, bool append = true,
+           size_t queue_size = 0);
 void stop(const std::string name);
 
+/*
+ * The number of entries an asynchronous output has dropped.
+ */
+size_t dropped(const std::string name);
+
 /*
  * Output control.
  */
 void set_level(log::level level);
+
+/*
+ * Category output control. Set a category's level, clear it so the
+ * category uses the logging level, or set the levels from a comma
+ * separated list of "category=level" pairs, for example "bus=debug,fifo=off".
+ */
+void set_level(log::category category, log::level level);
+void clear_level(log::category category);
+void set_levels(const std::string& levels);
 void set_level_stamp(const std::string name, bool level);
 void set_datetime_stamp(const std::string name, bool datetime);
 void set_line_numbers(const std::string name, bool line_numbers);
@@ -103,6 +140,7 @@ void set_line_numbers(const std::string name, bool line_numbers);
  * Check the currently active logging level
  */
 bool level_logging(log::level level);
+bool level_logging(log::level level, log::category category);
 
 /**
  * @brief Outputs a memory segment as hex values.
@@ -125,5 +163,7 @@ void memdump(log::level level, const std::string label, const void* addr, size_t
  */
 #define xia_log(_level) \
           if (xia::logging::level_logging(_level)) xia::log(_level)
+#define xia_logc(_category, _level) \
+          if (xia::logging::level_logging(_level, _category)) xia::log(_level, _category)
 
 #endif  // PIXIE_LOG_H
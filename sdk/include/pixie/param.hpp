@@ -1258,6 +1258,66 @@ typedef std::vector<module_var_desc> module_var_descs;
 typedef variable_desc<channel_var> channel_var_desc;
 typedef std::vector<channel_var_desc> channel_var_descs;
 
+/**
+ * @brief A read only set of descriptors shared by modules.
+ *
+ * A set created from descriptors is a copy. A set loaded from the DSP
+ * variables of a firmware is shared by the modules using the firmware.
+ */
+template<typename D>
+class shared_descs {
+public:
+    typedef std::vector<D> descs;
+    typedef std::shared_ptr<const descs> descs_ptr;
+    typedef typename descs::value_type value_type;
+    typedef typename descs::const_iterator const_iterator;
+
+    shared_descs() : descs_(std::make_shared<descs>()) {}
+    shared_descs(const descs& from) : descs_(std::make_shared<descs>(from)) {}
+    shared_descs(descs_ptr from) : descs_(from ? from : std::make_shared<descs>()) {}
+
+    operator const descs&() const {
+        return *descs_;
+    }
+
+    const D& operator[](const size_t index) const {
+        return (*descs_)[index];
+    }
+
+    size_t size() const {
+        return descs_->size();
+    }
+
+    bool empty() const {
+        return descs_->empty();
+    }
+
+    const_iterator begin() const {
+        return descs_->begin();
+    }
+
+    const_iterator end() const {
+        return descs_->end();
+    }
+
+    void clear() {
+        descs_ = std::make_shared<descs>();
+    }
+
+    /*
+     * True if the sets are the same shared set.
+     */
+    bool shares(const shared_descs& other) const {
+        return descs_ == other.descs_;
+    }
+
+private:
+    descs_ptr descs_;
+};
+
+typedef shared_descs<module_var_desc> shared_module_var_descs;
+typedef shared_descs<channel_var_desc> shared_channel_var_descs;
+
 /**
  * @brief A variable is an object that combines descriptors with values.
  */
@@ -1268,8 +1328,9 @@ struct variable {
      */
     struct data {
         bool dirty; /*!< Written to hardware? */
+        bool cached; /*!< Value matches the hardware? */
         value_type value;
-        data() : dirty(false), value(0) {}
+        data() : dirty(false), cached(false), value(0) {}
     };
     const Vdesc& var; /*!< The variable descriptor */
     std::vector<data> value; /*!< The value(s) */
@@ -1324,7 +1385,8 @@ const unsigned int qdc_mask = 1 << 12;
 const unsigned int all_mask = (1 << 12) - 1;
 
 /*
- * Look up maps. A fast way to map a name to a parameter or variable.
+ * Look up maps. A fast way to map a name to a parameter or variable. The
+ * look up calls use a hashed index of these maps.
  */
 typedef std::map<std::string, system_param> system_param_map;
 typedef std::map<std::string, module_param> module_param_map;
@@ -1354,6 +1416,12 @@ struct address_map {
 
     range full;
 
+    /*
+     * The DSP words the variables occupy. The end is one past the last
+     * word of the last variable.
+     */
+    range extent;
+
     range module;
     range module_in;
     range module_out;
@@ -1385,6 +1453,117 @@ private:
     hw::address max(const desc_addresses& addresses);
 };
 
+/**
+ * @brief The variable descriptors and address map of a firmware's DSP
+ * variables.
+ *
+ * The tables are cached by the firmware so the modules loading the same
+ * firmware share a single read only table.
+ */
+struct var_table {
+    module_var_descs module_descs;
+    channel_var_descs channel_descs;
+    address_map addresses;
+};
+typedef std::shared_ptr<const var_table> var_table_ref;
+
+/**
+ * @brief Load the variable table of a DSP `var` firmware for a number of
+ * channels. A table of the firmware already loaded is returned.
+ */
+var_table_ref load_table(firmware::firmware_ref& firmware, const size_t max_channels);
+
+/**
+ * @brief A flat image of a module's DSP variable memory.
+ *
+ * The image holds a word for each DSP address of an address map's extent
+ * and a dirty bit for each word. Contiguous dirty words are a single
+ * transfer to the DSP and images of the same address map are compared
+ * and copied as blocks of memory.
+ */
+class image {
+public:
+    /*
+     * A run of words at a DSP address, the offset is the run's first word
+     * in the image.
+     */
+    struct run {
+        hw::address address;
+        size_t offset;
+        size_t length;
+    };
+    typedef std::vector<run> runs;
+    typedef std::vector<hw::address> addresses;
+
+    image();
+
+    void create(const address_map& map);
+    void clear();
+
+    bool valid() const {
+        return !words.empty();
+    }
+
+    hw::address base() const {
+        return base_;
+    }
+
+    size_t size() const {
+        return words.size();
+    }
+
+    bool contains(const hw::address address) const {
+        return address >= base_ && address - base_ < words.size();
+    }
+
+    /*
+     * The words, the word at index `i` is at DSP address `base() + i`.
+     */
+    hw::word_ptr data() {
+        return words.data();
+    }
+
+    const hw::word* data() const {
+        return words.data();
+    }
+
+    /*
+     * Get a word. Set a word marks it dirty, store a word read from or
+     * written to the DSP clears the dirty bit.
+     */
+    hw::word get(const hw::address address) const;
+    void set(const hw::address address, const hw::word value);
+    void store(const hw::address address, const hw::word value);
+
+    bool dirty(const hw::address address) const;
+    size_t dirty_words() const;
+    void clean();
+
+    /*
+     * The runs of contiguous dirty words in address order.
+     */
+    void dirty_runs(runs& dirty) const;
+
+    /*
+     * Compare or copy from an image of the same address map. A copy marks
+     * the words that change dirty and returns the number of them.
+     */
+    bool same(const image& other) const;
+    void diff(const image& other, addresses& differ) const;
+    size_t copy(const image& from);
+
+private:
+    typedef uint64_t bits;
+    static const size_t bits_per_word = 64;
+
+    size_t index(const hw::address address) const;
+    void check(const image& other) const;
+
+    hw::address base_;
+    hw::words words;
+    std::vector<bits> dirty_bits;
+};
+
 /**
  * @brief Get a descriptor from the descriptors by its variable name.
  */
@@ -1402,9 +1581,9 @@ const channel_var_descs& get_channel_var_descriptors();
 /*
  * Get the maps
  */
-const system_param_map get_system_param_map();
-const module_param_map get_module_param_map();
-const channel_param_map get_channel_param_map();
+const system_param_map& get_system_param_map();
+const module_param_map& get_module_param_map();
+const channel_param_map& get_channel_param_map();
 
 /*
  * Check is the parameter or variable is valid?
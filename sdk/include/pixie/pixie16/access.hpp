@@ -0,0 +1,102 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file access.hpp
+ * @brief Defines the revision specialized hardware access paths of a module.
+ */
+
+#ifndef PIXIE_HW_ACCESS_H
+#define PIXIE_HW_ACCESS_H
+
+#include <cstddef>
+
+#include <pixie/pixie16/hw.hpp>
+
+namespace xia {
+namespace pixie {
+namespace module {
+class module;
+}
+namespace hw {
+/**
+ * @brief Revision specialized hardware access paths.
+ *
+ * The data paths of a module, the FIFO read, the MCA read and the DSP DMA
+ * setup, are templates of a revision's traits. A module selects the table
+ * of its revision's paths once when it is opened and the paths are called
+ * through the table so a path does not check the revision each call. Each
+ * revision's paths can be called directly, for example to benchmark them.
+ */
+namespace access {
+/*
+ * Rev B to G modules.
+ */
+struct rev_b_g {
+    static constexpr int first = rev_B;
+    /*
+     * The MCA address write is not followed by a dummy read.
+     */
+    static constexpr bool mca_dummy_read = false;
+};
+
+/*
+ * Rev H and later modules. The FPGA glitches at the end of the MCA address
+ * write unless a dummy read follows it.
+ */
+struct rev_h {
+    static constexpr int first = rev_H;
+    static constexpr bool mca_dummy_read = true;
+};
+
+/*
+ * The paths. The bus is held when the DSP DMA setup is called, the reads
+ * take the bus.
+ */
+template<typename Rev>
+void fifo_read(module::module& module, word_ptr buffer, size_t length);
+template<typename Rev>
+void mca_read(module::module& module, address addr, word_ptr values, size_t size);
+template<typename Rev>
+void dsp_dma_setup(module::module& module, address addr, size_t length);
+
+/**
+ * @brief A revision's table of paths.
+ */
+struct table {
+    const char* name;
+    void (*fifo_read)(module::module& module, word_ptr buffer, size_t length);
+    void (*mca_read)(module::module& module, address addr, word_ptr values, size_t size);
+    void (*dsp_dma_setup)(module::module& module, address addr, size_t length);
+};
+
+/**
+ * @brief The table of a revision. A revision before rev H uses the rev B
+ * to G table.
+ */
+const table& select(int revision);
+
+/**
+ * @brief The table of a module's revision.
+ */
+const table& make(const module::module& module);
+}  // namespace access
+}  // namespace hw
+}  // namespace pixie
+}  // namespace xia
+
+#endif  // PIXIE_HW_ACCESS_H
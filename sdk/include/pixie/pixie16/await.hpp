@@ -0,0 +1,251 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2022 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file await.hpp
+ * @brief Defines awaitable list-mode readout and control operations.
+ */
+
+#ifndef PIXIE_AWAIT_H
+#define PIXIE_AWAIT_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <pixie/buffer.hpp>
+#include <pixie/error.hpp>
+
+#include <pixie/pixie16/crate.hpp>
+#include <pixie/pixie16/module.hpp>
+
+#if __cplusplus >= 202002L && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+#define PIXIE_AWAIT_COROUTINES 1
+#endif
+#endif
+
+namespace xia {
+namespace pixie {
+/**
+ * @brief Awaitable list-mode readout, run completion and crate module
+ * operations.
+ *
+ * A reactor waits for many modules' list-mode data, runs and operations
+ * from one thread and posts the completions to an executor. An event
+ * builder with many streams can use a few reactor and executor threads
+ * rather than a thread for each module.
+ *
+ * The completions are handlers so the SDK builds as C++14. A C++20 build
+ * of a user's code has awaitable wrappers of the waits that resume the
+ * coroutine on the executor, for example:
+ *
+ *     auto result = co_await await::next_buffers(reactor, module);
+ */
+namespace await {
+/**
+ * @brief The interface of a scheduler the completions are posted to. Wrap
+ * an asio io_context or a user's scheduler.
+ */
+class executor {
+public:
+    using task = std::function<void()>;
+
+    virtual ~executor() = default;
+    virtual void post(task work) = 0;
+};
+
+/**
+ * @brief Run the completions on the reactor's thread.
+ */
+class inline_executor : public executor {
+public:
+    void post(task work) override {
+        work();
+    }
+};
+
+/**
+ * @brief Wait for modules' list-mode data, runs and crate operations and
+ * post the completions to an executor.
+ *
+ * A wait completes once. The reactor checks its waits every poll period
+ * and sleeps when there are no waits. Stopping the reactor completes the
+ * pending waits with `module_task_cancelled`.
+ */
+class reactor {
+public:
+    using buffers_handler = std::function<void(error::code, buffer::queue::handles&)>;
+    using done_handler = std::function<void(error::code)>;
+
+    static constexpr size_t default_poll_usecs = 1000;
+
+    explicit reactor(executor& exec, size_t poll_usecs = default_poll_usecs);
+    ~reactor();
+
+    reactor(const reactor&) = delete;
+    reactor& operator=(const reactor&) = delete;
+
+    void start();
+    void stop();
+    bool running() const;
+
+    /**
+     * @brief Wait for a module's list-mode data. The buffers are popped
+     * from the module's FIFO data queue.
+     * @param mod The module.
+     * @param handler Called with the result and the buffers.
+     * @param max_buffers The maximum number of buffers, 0 is all queued.
+     * @param timeout_usecs The handler is called with no buffers when the
+     *  timeout expires, 0 waits for ever.
+     */
+    void next_buffers(module::module& mod, buffers_handler handler, size_t max_buffers = 0,
+                      size_t timeout_usecs = 0);
+
+    /**
+     * @brief Wait for a module's run to end.
+     */
+    void run_done(module::module& mod, done_handler handler);
+
+    /**
+     * @brief Wait for a crate operation. The handler is called with the
+     * operation's first error or `success`.
+     */
+    void operation_done(crate::operation&& op, done_handler handler);
+
+    /**
+     * @brief The number of pending waits.
+     */
+    size_t pending() const;
+
+private:
+    struct wait;
+    using wait_ptr = std::unique_ptr<wait>;
+    using waits = std::vector<wait_ptr>;
+
+    void add(wait_ptr w);
+    void run();
+    bool check(wait& w);
+    void complete(wait& w, error::code code);
+
+    executor& exec;
+    const std::chrono::microseconds poll;
+
+    mutable std::mutex lock;
+    std::condition_variable wake;
+    waits waiting;
+    size_t checking;
+    bool running_;
+    std::thread thread;
+};
+
+#ifdef PIXIE_AWAIT_COROUTINES
+/**
+ * @brief The result of an awaited list-mode read.
+ */
+struct buffers_result {
+    error::code code;
+    buffer::queue::handles buffers;
+};
+
+/**
+ * @brief Await a module's list-mode data.
+ */
+class buffers_awaitable {
+public:
+    buffers_awaitable(reactor& r, module::module& m, size_t max_buffers, size_t timeout_usecs)
+        : reactor_(r), module_(m), max_buffers_(max_buffers), timeout_usecs_(timeout_usecs) {}
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+    void await_suspend(std::coroutine_handle<> handle) {
+        reactor_.next_buffers(
+            module_,
+            [this, handle](error::code code, buffer::queue::handles& buffers) {
+                result_.code = code;
+                result_.buffers = std::move(buffers);
+                handle.resume();
+            },
+            max_buffers_, timeout_usecs_);
+    }
+    buffers_result await_resume() {
+        return std::move(result_);
+    }
+
+private:
+    reactor& reactor_;
+    module::module& module_;
+    size_t max_buffers_;
+    size_t timeout_usecs_;
+    buffers_result result_;
+};
+
+/**
+ * @brief Await a run's end or a crate operation. The result is the error
+ * code.
+ */
+class done_awaitable {
+public:
+    using starter = std::function<void(reactor::done_handler)>;
+
+    explicit done_awaitable(starter start) : start_(std::move(start)) {}
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+    void await_suspend(std::coroutine_handle<> handle) {
+        start_([this, handle](error::code code) {
+            code_ = code;
+            handle.resume();
+        });
+    }
+    error::code await_resume() const noexcept {
+        return code_;
+    }
+
+private:
+    starter start_;
+    error::code code_ = error::code::success;
+};
+
+inline buffers_awaitable next_buffers(reactor& r, module::module& m, size_t max_buffers = 0,
+                                      size_t timeout_usecs = 0) {
+    return buffers_awaitable(r, m, max_buffers, timeout_usecs);
+}
+
+inline done_awaitable run_done(reactor& r, module::module& m) {
+    return done_awaitable([&r, &m](reactor::done_handler h) { r.run_done(m, std::move(h)); });
+}
+
+inline done_awaitable operation_done(reactor& r, crate::operation&& op) {
+    auto shared = std::make_shared<crate::operation>(std::move(op));
+    return done_awaitable([&r, shared](reactor::done_handler h) {
+        r.operation_done(std::move(*shared), std::move(h));
+    });
+}
+#endif
+}  // namespace await
+}  // namespace pixie
+}  // namespace xia
+
+#endif  // PIXIE_AWAIT_H
@@ -63,6 +63,15 @@ struct channel {
     bool operator!=(const int bl) const;
 
     bin_buckets bins;
+
+private:
+    /*
+     * Interleaved histograms of the samples in a trace. The baseline is in a
+     * few bins and the lanes avoid incrementing the same bin one sample
+     * after another. Only the range of samples seen is merged into the bins.
+     */
+    static const size_t lanes = 4;
+    bin_buckets lane_bins;
 };
 
 using channels = std::vector<channel>;
@@ -0,0 +1,134 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2022 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file capture.hpp
+ * @brief Defines the capture and replay files of a module's DMA stream.
+ */
+
+#ifndef PIXIE_CAPTURE_H
+#define PIXIE_CAPTURE_H
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+#include <pixie/pixie16/hw.hpp>
+
+namespace xia {
+namespace pixie {
+/**
+ * @brief Captures the DMA transfers of a module's FIFO worker to a file
+ * and reads them back for a replay.
+ *
+ * A capture file is a header then a chunk for each DMA transfer. A chunk
+ * is the microseconds from the start of the capture to the start of the
+ * transfer, the number of words and the words as read. The values are in
+ * the host's byte order.
+ */
+namespace capture {
+static constexpr uint32_t magic = 0x43444d58; /* "XMDC" */
+static constexpr uint32_t version = 1;
+
+/**
+ * @brief The module that captured the stream.
+ */
+struct header {
+    uint32_t slot;
+    uint32_t revision;
+    uint32_t adc_msps;
+
+    header();
+};
+
+/**
+ * @brief A DMA transfer.
+ */
+struct chunk {
+    uint64_t usecs;
+    hw::words words;
+
+    chunk();
+};
+
+/**
+ * @brief Writes a capture file.
+ */
+class writer {
+public:
+    typedef std::chrono::steady_clock clock;
+
+    writer();
+
+    /**
+     * @brief Create the file and start the capture's clock.
+     * @throws xia::pixie::error::error if the file cannot be created.
+     */
+    void open(const std::string& path, const header& hdr);
+    void close();
+    bool is_open() const;
+
+    /**
+     * @brief Write a DMA transfer that started at a time.
+     * @throws xia::pixie::error::error if the write fails.
+     */
+    void write(clock::time_point at, const hw::word* words, const size_t size);
+
+    std::string path;
+    size_t chunks;
+    size_t words;
+
+private:
+    std::ofstream out;
+    clock::time_point started;
+};
+
+/**
+ * @brief Reads a capture file.
+ */
+class reader {
+public:
+    reader();
+
+    /**
+     * @brief Open the file and read its header.
+     * @throws xia::pixie::error::error if the file cannot be opened or is
+     *  not a capture file.
+     */
+    void open(const std::string& path);
+    void close();
+    bool is_open() const;
+
+    /**
+     * @brief Read the next chunk.
+     * @return False at the end of the file.
+     * @throws xia::pixie::error::error if the chunk is truncated.
+     */
+    bool next(chunk& chk);
+
+    std::string path;
+    header hdr;
+
+private:
+    std::ifstream in;
+};
+}  // namespace capture
+}  // namespace pixie
+}  // namespace xia
+
+#endif  // PIXIE_CAPTURE_H
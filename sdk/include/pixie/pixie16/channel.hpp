@@ -28,6 +28,7 @@
 
 #include <pixie/error.hpp>
 #include <pixie/param.hpp>
+#include <pixie/stats.hpp>
 
 #include <pixie/pixie16/fixture.hpp>
 
@@ -95,9 +96,23 @@ struct baseline {
      */
     baseline(module::module& module, range& channels);
 
+    /**
+     * @brief Find the baseline cut of the channels in the range. The
+     * baselines are captured once for all channels with the channels'
+     * baseline cut and weight cleared. The variables are written in a
+     * single sync before and after the capture.
+     */
     void find_cut(size_t num = max_num);
     void compute_cut(size_t num);
 
+    /**
+     * @brief Compute a channel's cut from its baseline values. The cut is 8
+     * times the standard deviation of the difference of successive
+     * baselines. The deviation is estimated from the median of the absolute
+     * differences so the baseline values with a pulse do not move the cut.
+     */
+    static param::value_type compute_cut(const values& vals, size_t num);
+
     /**
      * @brief Get the channel values for the range.
      *
@@ -120,7 +135,22 @@ struct baseline {
      */
     void get(channels_values& chan_values, bool run = true);
 
+    /**
+     * @brief Update the channels' noise figures with the baselines. The
+     * noise figures track the channels at the same index in the channel
+     * range. The baselines are not kept.
+     */
+    void get(stats::baseline_noises& noises, bool run = true);
+
     double time(hw::word time_word0, hw::word time_word1);
+
+private:
+    /*
+     * Visit the channel range's baselines. The arguments are the index in
+     * the range, the baseline number, the timestamp and the baseline.
+     */
+    typedef std::function<void(size_t, size_t, double, double)> visitor;
+    void visit(const visitor& visit_, bool run);
 };
 
 /**
@@ -172,6 +202,10 @@ struct channel {
      * @param[in] size The length of the data buffer for holding the trace.
      */
     void read_adc(hw::adc_word* buffer, size_t size);
+    /**
+     * @brief The address of the channel's ADC trace in the DSP's IO buffer.
+     */
+    hw::address adc_trace_address() const;
 
     /**
      * @brief Reads a histogram from the channel.
@@ -184,6 +218,10 @@ struct channel {
      * @param[in,out] values A word vector whose length determines the number of histogram words.
      */
     void read_histogram(hw::words& values);
+    /**
+     * @brief The address of the channel's histogram in the MCA memory.
+     */
+    hw::address histogram_address() const;
 
     /**
      * @brief Updated fifo settings based on the trace delay.
@@ -0,0 +1,269 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file cluster.hpp
+ * @brief Defines the run control and readout of a system of crates on a number of hosts.
+ */
+
+#ifndef PIXIE_CLUSTER_H
+#define PIXIE_CLUSTER_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pixie/data/list_mode.hpp>
+#include <pixie/data/merge.hpp>
+
+#include <pixie/pixie16/crate.hpp>
+#include <pixie/pixie16/server.hpp>
+
+namespace xia {
+namespace pixie {
+/**
+ * @brief A system of crates with a host for each crate. A node on each
+ * crate's host serves the crate's run control and list-mode data. A
+ * controller connects to the nodes, runs the crates together and merges
+ * their data in time order.
+ *
+ * The crates share the clock and the run synchronisation of the
+ * multi-crate clock distribution. The director crate's run leader starts
+ * and stops the runs of all crates so the controller prepares all crates,
+ * enables the other crates and then the director. A run is ended on the
+ * director first.
+ *
+ * The nodes and the controller are not supported on Windows.
+ */
+namespace cluster {
+/**
+ * @brief A node's configuration.
+ */
+struct node_config {
+    /*
+     * The crate's id. It is written to the modules' CrateID and the
+     * controller sets it in the crate's records.
+     */
+    size_t crate_id;
+    /*
+     * The director crate starts and stops the runs of the crates.
+     */
+    bool director;
+    /*
+     * The firmware revision of the modules' list-mode data. The controller
+     * decodes the data with it. A revision of 0 reports the module's
+     * revision.
+     */
+    int fw_revision;
+    /*
+     * The run control port and address. A port of 0 picks a free port and
+     * an empty address binds all addresses.
+     */
+    int control_port;
+    std::string address;
+    /*
+     * The list-mode data server. A port of -1 picks a free port.
+     */
+    server::config data;
+
+    node_config();
+};
+
+/**
+ * @brief Serves a crate's run control and data to a controller. The node
+ * takes one controller connection at a time.
+ *
+ * The run control is a line of text for each request and each reply. A
+ * reply starts with `ok` or `error` and the error's text. The requests
+ * are:
+ *
+ *  `status` replies with the crate id, director, data port and the online
+ *  modules as `number:slot:fw-revision:adc-bits:adc-msps:frames`
+ *
+ *  `prepare <mode>` prepares the crate's modules for a list-mode run, a
+ *  mode of 1 is a new run and 0 resumes the run
+ *
+ *  `enable` enables the prepared run and replies with the start skew
+ *
+ *  `end` ends the run, sends the data left and replies with the number of
+ *  frames of each module's data
+ */
+class node {
+public:
+    node(crate::crate& crate, const node_config& cfg);
+    ~node();
+
+    node(const node&) = delete;
+    node& operator=(const node&) = delete;
+
+    void start();
+    void stop();
+    bool running() const {
+        return running_.load();
+    }
+
+    int control_port() const {
+        return port_;
+    }
+    int data_port() const;
+
+    const node_config cfg;
+
+private:
+    void worker();
+    std::string request(const std::string& line);
+
+    crate::crate& crate_;
+    std::unique_ptr<server::server> data;
+    crate::crate::run_start run_start;
+
+    int listen_fd;
+    int port_;
+
+    std::thread thread;
+    std::atomic_bool running_;
+};
+
+/**
+ * @brief The address of a crate's node.
+ */
+struct crate_address {
+    std::string host;
+    int control_port;
+    /*
+     * Added to the times of the crate's events to align them with the
+     * other crates, for example the delay of the clock distribution.
+     */
+    data::list_mode::record::time_type time_offset;
+
+    crate_address();
+    crate_address(const std::string& host_, int control_port_,
+                  data::list_mode::record::time_type time_offset_ =
+                      data::list_mode::record::time_type(0));
+};
+
+typedef std::vector<crate_address> crate_addresses;
+
+/**
+ * @brief Controls the runs of the crates and receives and decodes their
+ * data. The events of every module of every crate are a stream of a
+ * merger. A crate's modules are the streams from the crate's first stream
+ * in the order the node reports them.
+ */
+class controller {
+public:
+    struct module_info {
+        int number;
+        int slot;
+        int revision;
+        int adc_bits;
+        int adc_msps;
+        module_info();
+    };
+
+    struct crate_info {
+        size_t crate_id;
+        bool director;
+        int data_port;
+        size_t first_stream;
+        std::vector<module_info> modules;
+        crate_info();
+    };
+
+    explicit controller(const crate_addresses& crates);
+    ~controller();
+
+    controller(const controller&) = delete;
+    controller& operator=(const controller&) = delete;
+
+    /*
+     * Connect to the nodes and their data. Connect before a run starts so
+     * all of the run's data is received.
+     */
+    void connect();
+    void disconnect();
+
+    /*
+     * Start a list-mode run on all crates. If a crate fails to prepare the
+     * prepared crates are ended. Returns the largest crate start skew in
+     * usecs.
+     */
+    size_t start_run(hw::run::run_mode mode);
+
+    /*
+     * End the run on all crates, the director first.
+     */
+    void end_run();
+
+    /*
+     * Push the events received into the merger. After a run has ended and
+     * all of the run's data has been received the streams are finished.
+     * Returns the number of events pushed.
+     */
+    size_t read(data::list_mode::merger& merger);
+
+    /*
+     * Reorder each module's events within the window before they are
+     * pushed into the merger, for modules that do not sort their events.
+     * The merger then receives time ordered streams. Set the reorder
+     * before the first read. A window of 0 does not reorder.
+     */
+    void set_reorder(data::list_mode::record::time_type window, size_t max_held = 0);
+
+    /*
+     * The number of events the reorders received later than their window.
+     */
+    size_t late_events() const;
+
+    /*
+     * True when the run has ended and all the data has been read.
+     */
+    bool complete() const;
+
+    /*
+     * The number of merger streams, the total number of modules.
+     */
+    size_t streams() const;
+
+    const std::vector<crate_info>& crates() const {
+        return infos;
+    }
+
+    const crate_addresses addresses;
+
+private:
+    struct link;
+    typedef std::unique_ptr<link> link_ptr;
+
+    std::string request(link& lk, const std::string& line);
+
+    std::vector<link_ptr> links;
+    std::vector<crate_info> infos;
+    bool ended;
+    bool finished;
+
+    data::list_mode::record::time_type reorder_window;
+    size_t reorder_max_held;
+    std::vector<std::unique_ptr<data::list_mode::reorder>> reorders;
+};
+}  // namespace cluster
+}  // namespace pixie
+}  // namespace xia
+
+#endif  // PIXIE_CLUSTER_H
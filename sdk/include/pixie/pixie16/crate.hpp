@@ -24,10 +24,17 @@
 #define PIXIE_CRATE_H
 
 #include <atomic>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
 
 #include <pixie/error.hpp>
 #include <pixie/fw.hpp>
 #include <pixie/os_compat.hpp>
+#include <pixie/util.hpp>
 
 #include <pixie/pixie16/backplane.hpp>
 #include <pixie/pixie16/fpga.hpp>
@@ -44,6 +51,68 @@ namespace crate {
  */
 typedef pixie::error::error error;
 
+/**
+ * @brief An operation on modules run on the crate's workers. The caller
+ * can wait for, poll or cancel the operation and get its result.
+ *
+ * Cancelling an operation stops the modules that have not started the
+ * operation from running it and their result is a cancelled error. A
+ * module running the operation finishes it. An operation is moved and
+ * not copied.
+ */
+class operation {
+public:
+    operation();
+    operation(operation&&) = default;
+    operation& operator=(operation&&) = default;
+
+    operation(const operation&) = delete;
+    operation& operator=(const operation&) = delete;
+
+    /**
+     * @brief True if the operation has modules and the result has not
+     * been got.
+     */
+    bool valid() const;
+
+    /**
+     * @brief True if all modules have finished the operation. Does not
+     * block.
+     */
+    bool ready() const;
+
+    /**
+     * @brief Wait for all modules to finish the operation.
+     */
+    void wait() const;
+
+    /**
+     * @brief Wait for a period for all modules to finish the operation.
+     * @return True if the operation has finished.
+     */
+    bool wait_for(size_t msecs) const;
+
+    /**
+     * @brief Wait for the operation and get its result. The result can
+     * only be got once.
+     * @throws xia::pixie::error::error with the first module's error.
+     */
+    void get();
+
+    /**
+     * @brief Cancel the modules that have not started the operation.
+     */
+    void cancel();
+    bool cancelled() const;
+
+private:
+    friend struct crate;
+
+    std::string label;
+    std::vector<std::future<void>> futures;
+    std::shared_ptr<std::atomic_bool> cancel_;
+};
+
 /**
  * @brief A crate is a series of slots that contain modules.
  */
@@ -97,10 +166,91 @@ public:
         bool boot_fippi; /** Clear and load the FIPPI FPGA */
         bool boot_dsp; /** Reset and load the DSP */
         range modules; /** Range of modules to boot, empty is all */
+        /**
+         * The file of the fingerprints of the firmware loaded into the
+         * modules. If set a module's devices are only booted if they are
+         * not loaded or hold other firmware and the device selections are
+         * ignored. Force boots all devices and records the fingerprints.
+         * The file is updated after the boot. Empty (the default) disables
+         * the fingerprints.
+         */
+        std::string fingerprints;
 
         boot_params();
     };
 
+    /**
+     * The timing of a crate's run start. The times are from the first
+     * module's run enable, units usecs.
+     */
+    struct run_start {
+        /**
+         * The time each module's run was enabled. The index is the
+         * module's number.
+         */
+        std::vector<size_t> enable_usecs;
+        /**
+         * The time from the first to the last module enabled.
+         */
+        size_t skew_usecs;
+        /**
+         * The time to prepare all the modules.
+         */
+        size_t prepare_usecs;
+
+        run_start();
+    };
+
+    /**
+     * A timed list-mode run. Set the run time and if the preset is used
+     * then run it with run_listmode_for(). The results are indexed by the
+     * module's number.
+     */
+    struct timed_run {
+        /**
+         * The run time, units secs.
+         */
+        double seconds;
+        /**
+         * Write the run time to the modules' host run time preset so
+         * firmware that supports the preset ends the run.
+         */
+        bool preset;
+        /**
+         * The time past the run time to wait for the firmware to end the
+         * run before the host ends it, units msecs.
+         */
+        size_t preset_grace_msecs;
+        /**
+         * The timing of the start.
+         */
+        run_start start;
+        /**
+         * The run time of each module's run time counter, units secs. The
+         * time is 0 if the module does not count the run time.
+         */
+        std::vector<double> run_secs;
+        /**
+         * The host's time from a module's enable to the stop, units secs.
+         */
+        std::vector<double> host_secs;
+        /**
+         * The time each module took to end its run and read the remaining
+         * data, units usecs.
+         */
+        std::vector<size_t> end_usecs;
+        /**
+         * The firmware ended the run at the preset.
+         */
+        bool preset_ended;
+        /**
+         * The stop was timed from the run leader's run time counter.
+         */
+        bool counter_timed;
+
+        timed_run();
+    };
+
     /**
      * Number of modules present in the crate.
      */
@@ -135,6 +285,12 @@ public:
      */
     firmware::crate firmware;
 
+    /**
+     * Pin the crate's workers to the CPUs local to the PCI device of the
+     * module they serve. Set before the workers are started.
+     */
+    bool pin_workers;
+
     crate();
     virtual ~crate();
 
@@ -144,6 +300,14 @@ public:
      */
     void ready();
 
+    /**
+     * Returns true if the crate has been initialised and is ready. Does
+     * not throw.
+     */
+    bool is_ready() const {
+        return ready_.load();
+    }
+
     /**
      * @brief Check if the crate is busy?
      * @return True if the crate is busy with another operation.
@@ -197,7 +361,8 @@ public:
     }
 
     /**
-     * @brief Initialise the crate and get it ready.
+     * @brief Initialise the crate and get it ready. The modules' devices are
+     * opened in parallel and the modules are ordered by slot.
      * @param reg_trace When true enables enhanced diagnostic information to be output.
      */
     void initialize(bool reg_trace = false);
@@ -228,7 +393,8 @@ public:
     void set_offline(module::module_ptr module);
 
     /**
-     * @brief Checks if all the modules are online.
+     * @brief Checks if all the modules are online. The modules are probed in
+     * parallel.
      *
      * @return True if all modules are online else false if a module is not online
      */
@@ -260,10 +426,19 @@ public:
 
     /**
      * @brief Import a configuration. Returning a list of loaded modules.
+     * The file can be JSON or a binary snapshot.
+     *
+     * If `changes_only` is true only the values that differ from the
+     * modules' copies are written and the modules run only the hardware
+     * actions the changes need. There is no need to call @ref
+     * initialize_afe after a changes only import.
+     *
      * @param[in] json_file The path to the JSON configuration file to load.
      * @param[out] loaded The list of modules that received configurations.
+     * @param[in] changes_only Only sync the changed values and hardware.
      */
-    void import_config(const std::string json_file, module::number_slots& loaded);
+    void import_config(const std::string json_file, module::number_slots& loaded,
+                       bool changes_only = false);
 
     /**
      * @brief Initializes the module's analog front end after importing a configuration.
@@ -273,11 +448,299 @@ public:
      */
     void initialize_afe();
 
+    /**
+     * @brief Set the DACs of the online modules.
+     * @see xia::pixie::module::set_dacs
+     */
+    void set_dacs();
+
+    /**
+     * @brief Adjust the offsets of the online modules.
+     * @see xia::pixie::module::adjust_offsets
+     */
+    void adjust_offsets();
+
+    /**
+     * @brief Batches of parameter writes by module number.
+     */
+    typedef std::map<size_t, module::param_writes> module_param_writes;
+
+    /**
+     * @brief Write batches of parameters to modules. The modules' batches are
+     * written in parallel.
+     *
+     * A module parameter that is broadcast by a single write is only written
+     * to the modules it is listed for.
+     *
+     * @see xia::pixie::module::write_batch
+     */
+    void write_batch(const module_param_writes& writes);
+
+    /**
+     * @brief Stage batches of parameter writes for the next run while the
+     * current run takes data. The modules' batches are staged in parallel.
+     * @see xia::pixie::module::stage_writes
+     */
+    void stage_writes(const module_param_writes& writes);
+
+    /**
+     * @brief Commit the modules' staged writes in parallel once the run
+     * has ended.
+     * @see xia::pixie::module::commit_staged
+     */
+    void commit_staged();
+
+    /**
+     * @brief A task run on a module by the crate's task executor.
+     */
+    typedef std::function<void(module::module& module)> module_task;
+    typedef std::vector<size_t> module_numbers;
+
+    /**
+     * @brief The crate's workers. There is a worker for each module. A
+     * module's tasks are run on the worker with the module's number. The
+     * workers are started on first use and restarted if the number of
+     * modules changes.
+     */
+    util::thread_pool& workers();
+
+    /**
+     * @brief Run a task on each online module in parallel.
+     *
+     * The task is run on the module's worker. The call returns when all
+     * tasks have finished. The crate lock needs to be held.
+     *
+     * @param label The label of the task in error messages.
+     * @param task The task to run.
+     * @throws xia::pixie::error::error with the first module's error.
+     */
+    void run_modules(const std::string& label, const module_task& task);
+
+    /**
+     * @brief Run a task on the listed modules in parallel.
+     * @param label The label of the task in error messages.
+     * @param mod_nums The numbers of modules to run the task on.
+     * @param task The task to run.
+     */
+    void run_modules(const std::string& label, const module_numbers& mod_nums,
+                     const module_task& task);
+
+    /**
+     * @brief Queue a task on the listed modules and return without
+     * waiting. Many modules can be calibrated concurrently from a single
+     * control thread.
+     *
+     * The task is copied and can outlive the caller's scope. The task is
+     * run on the module's worker after the module's queued tasks.
+     *
+     * @param label The label of the task in error messages.
+     * @param mod_nums The numbers of modules to run the task on, empty is
+     *  all online modules.
+     * @param task The task to run.
+     * @return The operation of the modules.
+     */
+    operation run_modules_async(const std::string& label, const module_numbers& mod_nums,
+                                module_task task);
+
+    /**
+     * @brief Asynchronous module operations. The modules are the module
+     * numbers, empty is all online modules.
+     *
+     * @see xia::pixie::module::module
+     */
+    operation boot_async(const module_numbers& mod_nums, bool boot_comms = true,
+                         bool boot_fippi = true, bool boot_dsp = true);
+    operation set_dacs_async(const module_numbers& mod_nums = {});
+    operation adjust_offsets_async(const module_numbers& mod_nums = {});
+    operation acquire_baselines_async(const module_numbers& mod_nums = {});
+    operation tau_finder_async(const module_numbers& mod_nums = {});
+    operation get_traces_async(const module_numbers& mod_nums = {});
+
+    /**
+     * @brief Module histograms. There is an entry for each module read.
+     */
+    typedef std::vector<hw::words> module_histograms;
+
+    /**
+     * @brief Read the histograms of all channels of the modules in parallel.
+     * @param mod_nums The numbers of the modules to read.
+     * @param histograms The histograms read. The entries are in the order
+     *  of the module numbers.
+     * @param length The histogram length of each channel, 0 is the maximum.
+     * @see xia::pixie::module::read_histograms
+     */
+    void read_histograms(const module_numbers& mod_nums, module_histograms& histograms,
+                         size_t length = 0);
+
+    /**
+     * @brief The format of a histogram file.
+     *
+     * A `binary` file is the legacy format. It is each channel's histogram
+     * as 32 bit words with the channels in order and the modules in the
+     * order of the module numbers.
+     *
+     * A `described` file has a header of 32 bit words, the magic number
+     * `histogram_file_magic`, the version and the number of modules. Each
+     * module has a header of its number, slot, serial number, revision,
+     * ADC MSPS, ADC bits, number of channels and histogram length
+     * followed by its histograms in the binary format.
+     */
+    enum struct histogram_format { binary, described };
+    static const hw::word histogram_file_magic;
+    static const hw::word histogram_file_version;
+
+    /**
+     * @brief Save the histograms of all channels of the modules to a file.
+     *
+     * The histograms are read with the bulk read of the modules in
+     * parallel then written to the file with a single write. An existing
+     * file is overwritten.
+     *
+     * @param file_name The file's name.
+     * @param mod_nums The numbers of the modules to save. Empty is all the
+     *  online modules.
+     * @param format The file's format.
+     * @param length The histogram length of each channel, 0 is the maximum.
+     * @see read_histograms
+     */
+    void save_histograms(const std::string& file_name, const module_numbers& mod_nums,
+                         histogram_format format = histogram_format::binary,
+                         size_t length = 0);
+
+    /**
+     * @brief A task that analyzes the ADC traces of all of a module's
+     * channels.
+     */
+    typedef std::function<void(module::module& module, hw::adc_traces& traces)> adc_traces_task;
+
+    /**
+     * @brief Acquire and read the ADC traces of all the channels of the
+     * modules and analyze them.
+     *
+     * Each module acquires, reads and analyzes its traces on its worker so
+     * the acquisition of one module overlaps the readout and analysis of
+     * the others. The analysis task is called on the module workers and
+     * needs to be thread safe across modules.
+     *
+     * @param mod_nums The numbers of the modules to read.
+     * @param analyze The task called with a module's traces.
+     * @param run If true, then the control task to collect the traces is run.
+     * @see xia::pixie::module::read_adcs
+     */
+    void read_adcs(const module_numbers& mod_nums, const adc_traces_task& analyze,
+                   bool run = true);
+
+    /**
+     * @brief Module tau estimates. There is an entry for each module fitted.
+     */
+    typedef std::vector<data::tau::estimates> module_taus;
+
+    /**
+     * @brief Estimate the preamplifier decay time of all channels of the
+     * modules from their ADC traces in parallel.
+     * @param mod_nums The numbers of the modules to fit.
+     * @param cfg The pulse finding and fit.
+     * @param taus The estimates. The entries are in the order of the module
+     *  numbers.
+     * @param captures The number of ADC trace captures fitted.
+     * @param write If true, then the valid estimates are written to the
+     *  channels' tau.
+     * @see xia::pixie::module::fit_tau
+     */
+    void fit_taus(const module_numbers& mod_nums, const data::tau::config& cfg,
+                  module_taus& taus, size_t captures = 1, bool write = false);
+
+    /**
+     * @brief Read the statistics of the modules in parallel at close to the
+     * same instant.
+     *
+     * Each module's worker waits at a gate until all the workers are ready
+     * then reads the module's statistics in a single batch of DSP reads.
+     * The snapshot's skew is the range of the read times. Reuse a snapshot
+     * so its entries are not allocated on each read. Push the snapshots
+     * into a `stats::snapshots` ring to compute interval rates.
+     *
+     * @param mod_nums The numbers of the modules to read. Empty is all the
+     *  online modules.
+     * @param snap The snapshot. The entries are in the order of the module
+     *  numbers.
+     * @see xia::pixie::module::read_stats
+     */
+    void read_stats(const module_numbers& mod_nums, stats::snapshot& snap);
+
+    /**
+     * @brief Subscribe to the list-mode data of the online modules. Each
+     * module has a subscription and the handler is called with the module
+     * the data is from.
+     * @param subscription The subscription each module is given.
+     * @see xia::pixie::module::subscribe_list_mode
+     */
+    void subscribe_list_mode(const module::list_mode_subscription& subscription);
+
+    /**
+     * @brief Remove the modules' list-mode subscriptions.
+     */
+    void unsubscribe_list_mode();
+
+    /**
+     * @brief Start a list-mode run on all online modules.
+     *
+     * The modules are prepared in parallel then the runs are enabled one
+     * after the other with the run leader last so the start skew does not
+     * grow with the time to prepare a module. If a module fails to
+     * prepare the prepared modules are ended.
+     *
+     * @param mode A new run or resume the run.
+     * @param start The timing of the start.
+     */
+    void start_listmode(hw::run::run_mode mode, run_start& start);
+    void start_listmode(hw::run::run_mode mode);
+
+    /**
+     * @brief The two steps of a list-mode run start. Use these to prepare
+     * the crates of a multi-crate system before any crate is enabled.
+     */
+    void prepare_listmode(hw::run::run_mode mode, run_start& start);
+    void enable_run(run_start& start);
+
+    /**
+     * @brief End the run on all online modules. The run leader is stopped
+     * first then all the modules are ended and their data is read in
+     * parallel.
+     */
+    void end_run();
+
+    /**
+     * @brief Run list-mode on all online modules for a fixed time.
+     *
+     * The run is started with start_listmode(). The stop is timed from the
+     * run leader's run time counter so the run length does not depend on
+     * the host's sleep. If the run time preset is used the firmware that
+     * supports it ends the run and the host ends it if the firmware has not
+     * by the grace time. The modules are ended and their data is read in
+     * parallel. Read the list-mode data while the run is active and read
+     * the remaining data once this returns.
+     *
+     * @param mode A new run or resume the run.
+     * @param run The run time and the results.
+     */
+    void run_listmode_for(hw::run::run_mode mode, timed_run& run);
+
     /**
      * @brief Export the active module configurations to a file.
      * @param json_file Path to the file that will hold the configurations.
+     * @param snapshot Export a binary snapshot rather than JSON.
+     */
+    void export_config(const std::string json_file, bool snapshot = false);
+
+    /**
+     * @brief Export the active module configurations to a JSON file and a
+     * binary snapshot alongside it. The modules are read once.
+     * @param json_file Path to the JSON file.
+     * @param snapshot_file Path to the snapshot file.
      */
-    void export_config(const std::string json_file);
+    void export_config_and_snapshot(const std::string json_file,
+                                    const std::string snapshot_file);
 
     /**
      * @brief Move offline modules from the online list to offline.
@@ -297,7 +760,21 @@ public:
 protected:
     virtual void add_module();
 
+    /*
+     * The number of devices to open. The bus is rescanned on each
+     * initialization so devices added or powered up since the last
+     * scan are found. The scan's keys let the modules open their
+     * devices without searching for them.
+     */
+    virtual size_t scan_devices();
+
 private:
+    /*
+     * Stop the run leader then end the online modules' runs and read their
+     * data in parallel. The time each module's end took is returned.
+     */
+    void end_modules(std::vector<size_t>& end_usecs);
+
     /*
      * Check the module slots.
      */
@@ -308,6 +785,12 @@ private:
      */
     void check_revision();
 
+    /*
+     * The worker pool.
+     */
+    util::thread_pool workers_;
+    std::mutex workers_lock_;
+
     /*
      * Crate lock
      */
@@ -374,6 +857,53 @@ module_handle::module_handle(crate& crate_, T number, checks check)
         break;
     }
 }
+
+/**
+ * @brief A module handle for the polling and readout paths that does not
+ * throw.
+ *
+ * The crate has this user registered while the object exists. Check the
+ * result before using the module, it is `success` if the crate is ready
+ * and the module is online. The module is not locked, use the module's
+ * non-throwing calls that lock the module.
+ */
+struct module_poll_handle {
+    template<typename T> module_poll_handle(crate& crate_, T number) noexcept;
+    ~module_poll_handle() = default;
+
+    explicit operator bool() const {
+        return result == pixie::error::code::success;
+    }
+
+    module::module& operator*() {
+        return *handle;
+    }
+    module::module* operator->() {
+        return handle;
+    }
+
+    pixie::error::code result;
+
+private:
+    module::module* handle;
+    crate::user user;
+};
+
+template<typename T>
+module_poll_handle::module_poll_handle(crate& crate_, T number) noexcept
+    : result(pixie::error::code::success), handle(nullptr), user(crate_) {
+    size_t number_ = static_cast<size_t>(number);
+    if (!crate_.is_ready()) {
+        result = pixie::error::code::crate_not_ready;
+    } else if (number_ >= crate_.num_modules) {
+        result = pixie::error::code::module_number_invalid;
+    } else {
+        handle = crate_.modules[number_].get();
+        if (!handle->online()) {
+            result = pixie::error::code::module_offline;
+        }
+    }
+}
 }  // namespace crate
 }  // namespace pixie
 }  // namespace xia
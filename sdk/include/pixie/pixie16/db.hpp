@@ -113,6 +113,9 @@ struct afe_dbs : public module {
 
     void analyze_channel_baselines(
         baseline::channels& baselines, const int traces = 1);
+    void analyze_channel_baselines(
+        baseline::channels& baselines, const pixie::channel::range& channels,
+        const int traces = 1);
 };
 
 /**
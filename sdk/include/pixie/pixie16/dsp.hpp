@@ -51,6 +51,11 @@ struct dsp {
      */
     typedef uint16_t load_value_type;
 
+    /**
+     * The default number of instructions loaded with the host bus held.
+     */
+    static const size_t default_load_chunk = 1024;
+
     module::module& module;
 
     /**
@@ -63,6 +68,13 @@ struct dsp {
      */
     bool trace;
 
+    /**
+     * The number of instructions of a section loaded with the host bus
+     * request held. A value of 0 requests and releases the host bus for
+     * each instruction. A failed load is retried with a chunk of 0.
+     */
+    size_t load_chunk;
+
     dsp(module::module& module, bool trace = false);
     dsp& operator=(dsp&& d);
 
@@ -89,7 +101,13 @@ private:
     /*
      * Image section loader.
      */
-    void section_load(firmware::reader& reader, const size_t wordsize);
+    void section_load(firmware::reader& reader, const size_t wordsize, const size_t chunk);
+
+    /*
+     * Load instructions. The host bus is requested for each chunk of
+     * instructions.
+     */
+    void instructions_load(firmware::reader& reader, size_t count, const size_t chunk);
 
     /*
      * Low level access.
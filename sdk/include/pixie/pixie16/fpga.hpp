@@ -109,7 +109,23 @@ struct control {
      */
     uint32_t bus_read(int regnum);
 
+    /**
+     * The period between polls of the status register when waiting for a
+     * clear or done.
+     */
+    static const size_t poll_usecs = 100;
+    /**
+     * The time to wait for a clear or done.
+     */
+    static const size_t timeout_usecs = 25 * 1000;
+
 private:
+    /*
+     * Poll the status register until the bits in the mask are set or the
+     * timeout expires. The first poll is after a poll period.
+     */
+    bool poll(const uint32_t mask, const size_t timeout);
+
     std::string make_what(const char* msg);
 };
 }  // namespace fpga
@@ -0,0 +1,233 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2022 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file histogram.hpp
+ * @brief Defines snapshots of a module's histograms taken during a run.
+ */
+
+#ifndef PIXIE_HISTOGRAM_H
+#define PIXIE_HISTOGRAM_H
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <pixie/sync.hpp>
+#include <pixie/util.hpp>
+
+#include <pixie/pixie16/module.hpp>
+
+namespace xia {
+namespace pixie {
+/**
+ * @brief Snapshots of a module's histograms and the changes between them.
+ */
+namespace histogram {
+/**
+ * @brief A bin and the change of its count.
+ */
+typedef std::pair<hw::word, hw::word> bin_count;
+typedef std::vector<bin_count> bin_counts;
+
+/**
+ * @brief How a channel's changes are reported.
+ */
+enum struct format {
+    /** The change of every bin. */
+    dense,
+    /** The bins that changed and the change of their count. */
+    sparse
+};
+
+/**
+ * @brief The changes of a channel's histogram between two snapshots.
+ */
+struct delta {
+    size_t channel;
+    /*
+     * A bin's count is less than in the previous snapshot, the histogram
+     * has been cleared. The changes are the counts of the snapshot.
+     */
+    bool reset;
+    /*
+     * The number of counts added to the histogram.
+     */
+    size_t counts;
+    hw::words dense;
+    bin_counts sparse;
+
+    delta();
+};
+
+typedef std::vector<delta> deltas;
+
+/**
+ * @brief Compute a channel's changes between the previous and current
+ * snapshots.
+ * @param previous The previous snapshot of the channel's bins.
+ * @param current The current snapshot of the channel's bins.
+ * @param fmt The format of the changes.
+ * @param change The changes. The channel number is not changed.
+ */
+void make_delta(hw::word_ptr previous, hw::word_ptr current, size_t length, format fmt,
+                delta& change);
+
+/**
+ * @brief An update of the snapshots.
+ */
+struct update {
+    /*
+     * The number of the snapshot, the first snapshot is 1.
+     */
+    size_t sequence;
+    /*
+     * The seconds between this snapshot and the previous snapshot.
+     */
+    double period;
+    /*
+     * The length of each channel's histogram.
+     */
+    size_t length;
+    /*
+     * The full snapshot of the channels' histograms. The histogram of a
+     * channel starts at `length` times its index in the channel range.
+     */
+    const hw::words* snapshot;
+    deltas changes;
+
+    update();
+};
+
+/**
+ * @brief Periodically snapshots a module's histograms during a run. The
+ * snapshot is read once and each subscriber is given the changes against
+ * the previous snapshot in the subscriber's format.
+ *
+ * The subscribers are called from the snapshot thread and the update is
+ * only valid for the call. A subscriber cannot subscribe or unsubscribe in
+ * the call.
+ */
+class snapshots {
+public:
+    /**
+     * @brief Read the snapshot of the channels' histograms.
+     */
+    typedef std::function<void(hw::words& values)> reader;
+    typedef std::function<void(const update& changes)> subscriber;
+    typedef size_t subscriber_id;
+
+    /**
+     * @brief Snapshot the module's channels. A length of 0 is the maximum
+     * histogram length of the first channel.
+     */
+    snapshots(module::module& module, const channel::range& channels, size_t length = 0);
+    /**
+     * @brief Snapshot the channels using a reader.
+     */
+    snapshots(const channel::range& channels, size_t length, reader read);
+    ~snapshots();
+
+    /**
+     * @brief Add a subscriber.
+     * @param fmt The format of the subscriber's changes.
+     * @return The subscriber's id.
+     */
+    subscriber_id subscribe(subscriber sub, format fmt = format::sparse);
+    void unsubscribe(subscriber_id id);
+
+    /**
+     * @brief Start and stop the snapshot thread. A snapshot is taken every
+     * period.
+     */
+    void start(size_t period_msecs);
+    void stop();
+    bool running() const {
+        return running_.load();
+    }
+
+    /**
+     * @brief Take a snapshot and update the subscribers. The thread calls
+     * this each period. It can be called when the thread is not running.
+     */
+    void poll();
+
+    /**
+     * @brief Forget the previous snapshot. The next snapshot reports the
+     * changes against empty histograms.
+     */
+    void reset();
+
+    /**
+     * @brief Copy the last snapshot.
+     */
+    void snapshot(hw::words& values);
+
+    /**
+     * @brief The number of snapshots taken.
+     */
+    size_t sequence() const {
+        return sequence_.load();
+    }
+    /**
+     * @brief The number of snapshot reads that failed in the thread.
+     */
+    size_t errors() const {
+        return errors_.load();
+    }
+
+    const channel::range channels;
+    const size_t length;
+
+private:
+    struct sub_entry {
+        subscriber sub;
+        format fmt;
+    };
+    typedef std::map<subscriber_id, sub_entry> subscribers;
+
+    void worker();
+
+    reader read;
+
+    /*
+     * Holds the snapshots and subscribers.
+     */
+    sync::variable::lock_type lock;
+    subscribers subs;
+    subscriber_id next_id;
+    hw::words previous;
+    hw::words current;
+    util::timepoint since;
+
+    std::thread thread;
+    sync::variable::lock_type period_lock;
+    sync::variable period_wake;
+    size_t period_msecs;
+
+    std::atomic_bool running_;
+    std::atomic_size_t sequence_;
+    std::atomic_size_t errors_;
+};
+}  // namespace histogram
+}  // namespace pixie
+}  // namespace xia
+
+#endif  // PIXIE_HISTOGRAM_H
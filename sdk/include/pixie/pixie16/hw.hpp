@@ -24,6 +24,7 @@
 #define PIXIE_HW_H
 
 #include <array>
+#include <chrono>
 #include <stdexcept>
 #include <vector>
 
@@ -276,11 +277,26 @@ inline void convert(I vin, O& vout) {
 
 /**
  * @brief Wait in microseconds.
- * @todo We need to check how well this works.
+ *
+ * The wait is timed with the steady clock. Long waits sleep for the part
+ * of the period the scheduler can meet and spin on the clock for the rest
+ * so the wait is not short and does not oversleep by the scheduler's
+ * slice. The sleep overshoot is measured on the first wait.
+ *
  * @param microseconds The number of microseconds we should wait.
  */
 void wait(size_t microseconds);
 
+/**
+ * @brief Wait until a time point of the steady clock.
+ */
+void wait_until(const std::chrono::steady_clock::time_point deadline);
+
+/**
+ * @brief The measured overshoot of a sleep in microseconds.
+ */
+size_t wait_sleep_overshoot();
+
 /**
  * Bus interface calls.
  */
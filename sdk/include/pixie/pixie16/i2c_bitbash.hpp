@@ -64,8 +64,10 @@ struct bitbash {
 
     /**
      * A count of dummy accesses to backoff the timing to meet the required
-     * I2C slave clock speed. This backoff doubles on write ACK errors until
-     * the multiplier limit is reached.
+     * I2C slave clock speed. The count is calibrated from the module's
+     * measured register read period so each SCL level is held for half
+     * the bus clock period. The backoff is multiplied on write ACK errors
+     * until the multiplier limit is reached.
      */
     size_t access_backoff;
     size_t access_multiplier;
@@ -101,15 +103,24 @@ struct bitbash {
     void send_nack();
 
     /*
-     * Low level I2C access.
+     * Low level I2C access. A bus write waits the backoff, a bus set does
+     * not wait.
      */
     void bus_write(uint8_t data);
+    void bus_set(uint8_t data);
     uint8_t bus_read();
 
     /*
-     * the bus wait is based on the access backoff counter
+     * Write a sequence of bus states with a backoff after each state.
      */
-    void bus_wait();
+    void bus_sequence(const uint8_t* states, size_t count);
+
+    /*
+     * The bus wait is based on the access backoff counter. The accesses
+     * are the register accesses made in the period that count towards
+     * the backoff.
+     */
+    void bus_wait(size_t accesses = 0);
 };
 }  // namespace i2c
 }  // namespace hw
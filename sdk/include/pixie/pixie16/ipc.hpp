@@ -0,0 +1,285 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file ipc.hpp
+ * @brief Defines a crate server that serves a resident crate to local processes.
+ */
+
+#ifndef PIXIE_IPC_H
+#define PIXIE_IPC_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pixie/shm.hpp>
+#include <pixie/sync.hpp>
+
+#include <pixie/pixie16/crate.hpp>
+#include <pixie/pixie16/recorder.hpp>
+
+namespace xia {
+namespace pixie {
+/**
+ * @brief Serves a crate to client processes on the same host.
+ *
+ * A server process initializes and boots the crate once and keeps it
+ * resident. Clients connect to the server's local socket to control the
+ * modules and receive the list-mode data from the server's shared memory
+ * ring. A client restarting does not initialize the crate again and more
+ * than one client can use the crate.
+ */
+namespace ipc {
+/**
+ * @brief The requests a client makes.
+ */
+enum struct command : uint32_t {
+    hello,
+    read_param,
+    write_param,
+    start_listmode,
+    start_histograms,
+    end_run,
+    run_active,
+    read_histogram
+};
+
+/**
+ * @brief A request's message. A channel of -1 is a module parameter and a
+ * module of -1 is all the modules for the run commands. The fields are in
+ * the host's byte order.
+ */
+struct request {
+    uint32_t magic;
+    command cmd;
+    int32_t module;
+    int32_t channel;
+    double value;
+    uint32_t mode;
+    uint32_t reserved;
+    char name[64];
+};
+
+static_assert(sizeof(request) == 96, "request size");
+
+/**
+ * @brief A response's message. It is followed by `bytes` of payload. The
+ * result is the error code of a request that failed and the payload is
+ * the error's text.
+ */
+struct response {
+    uint32_t magic;
+    int32_t result;
+    double value;
+    uint64_t bytes;
+};
+
+static_assert(sizeof(response) == 24, "response size");
+
+static constexpr uint32_t request_magic = 0x51435058; /* "XPCQ" */
+static constexpr uint32_t response_magic = 0x52435058; /* "XPCR" */
+
+/**
+ * @brief A module's details returned by the hello request.
+ */
+struct module_info {
+    int32_t number;
+    int32_t slot;
+    int32_t serial_num;
+    int32_t revision;
+    int32_t adc_bits;
+    int32_t adc_msps;
+    int32_t num_channels;
+    int32_t online;
+};
+
+/**
+ * @brief The server's configuration.
+ */
+struct config {
+    /*
+     * The path of the local socket clients connect to. A stale socket
+     * file is removed.
+     */
+    std::string socket;
+    /*
+     * The shared memory ring the modules' list-mode data is published
+     * to. The block's source is the module's number.
+     */
+    std::string ring_name;
+    buffer::shm::config ring;
+    size_t max_clients;
+    /*
+     * The period the modules are polled for data when no clients are
+     * making requests.
+     */
+    size_t poll_msecs;
+
+    config();
+};
+
+/**
+ * @brief Serves a crate's modules to clients. The server thread answers
+ * the clients' requests and publishes the modules' queued list-mode data
+ * to the ring. A request is answered before the next one is read so the
+ * modules are only accessed from the server thread.
+ *
+ * Create the server after the crate is initialized and booted. The server
+ * is not supported on Windows.
+ */
+class server {
+public:
+    server(crate::crate& crate, const config& cfg);
+    ~server();
+
+    server(const server&) = delete;
+    server& operator=(const server&) = delete;
+
+    void start();
+    void stop();
+    bool running() const {
+        return running_.load();
+    }
+
+    /*
+     * Accept new clients, answer the requests and publish the data. The
+     * thread calls this. It can be called when the thread is not running.
+     * Returns the number of requests answered.
+     */
+    size_t poll(size_t wait_msecs = 0);
+
+    /*
+     * The number of clients, the requests answered, the requests that
+     * failed and the words published.
+     */
+    size_t clients() const {
+        return clients_.load();
+    }
+    size_t requests() const {
+        return requests_.load();
+    }
+    size_t errors() const {
+        return errors_.load();
+    }
+    size_t published() const {
+        return published_.load();
+    }
+
+    const config cfg;
+
+private:
+    /*
+     * A connection. A request is read without blocking and the part of a
+     * request received is held until the rest arrives.
+     */
+    struct client {
+        int fd;
+        request req;
+        size_t received;
+        client();
+    };
+
+    void listen();
+    void accept();
+    bool answer(client& cl, bool& answered);
+    double handle(const request& req, std::vector<uint8_t>& payload);
+    size_t publish();
+    void worker();
+
+    crate::crate& crate_;
+    module::modules modules;
+    recorder::sources srcs;
+    std::vector<buffer::queue::handles> pending;
+    std::unique_ptr<buffer::shm::publisher> ring;
+
+    int listen_fd;
+    std::vector<client> connections;
+
+    /*
+     * Held by a poll.
+     */
+    sync::variable::lock_type lock;
+
+    std::thread thread;
+    std::atomic_bool running_;
+    std::atomic_size_t clients_;
+    std::atomic_size_t requests_;
+    std::atomic_size_t errors_;
+    std::atomic_size_t published_;
+};
+
+/**
+ * @brief A client of a crate server. The requests are answered in the
+ * order made and an error in the server is thrown in the client. Use the
+ * ring's name to subscribe to the data. Only one thread can use a client.
+ */
+class client {
+public:
+    explicit client(const std::string& socket);
+    ~client();
+
+    client(const client&) = delete;
+    client& operator=(const client&) = delete;
+
+    /*
+     * Read and write a module's or a channel's parameter. A channel of -1
+     * is a module parameter.
+     */
+    double read(int module, const std::string& par, int channel = -1);
+    void write(int module, const std::string& par, double value, int channel = -1);
+
+    /*
+     * Run control. A module of -1 is all the modules. A list-mode run of
+     * all the modules is started and ended by the crate.
+     */
+    void start_listmode(int module = -1, hw::run::run_mode mode = hw::run::run_mode::new_run);
+    void start_histograms(int module = -1, hw::run::run_mode mode = hw::run::run_mode::new_run);
+    void end_run(int module = -1);
+    bool run_active(int module);
+
+    /*
+     * Read a channel's histogram. The size of the values is the length
+     * read, 0 reads the whole histogram.
+     */
+    void read_histogram(int module, int channel, hw::words& values);
+
+    /*
+     * Subscribe to the server's list-mode data ring.
+     */
+    std::unique_ptr<buffer::shm::subscriber> subscribe() const;
+
+    /*
+     * The server's ring and modules from the hello request.
+     */
+    std::string ring_name;
+    std::vector<module_info> modules;
+
+private:
+    double call(request& req, std::vector<uint8_t>& payload);
+    bool read(void* data, size_t size);
+
+    int fd;
+};
+}  // namespace ipc
+}  // namespace pixie
+}  // namespace xia
+
+#endif  // PIXIE_IPC_H
@@ -0,0 +1,265 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2022 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file lmc.hpp
+ * @brief Defines a compressed and indexed list-mode container file.
+ */
+
+#ifndef PIXIE_LMC_H
+#define PIXIE_LMC_H
+
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <pixie/pixie16/hw.hpp>
+
+namespace xia {
+namespace pixie {
+/**
+ * @brief The list-mode container (LMC) format.
+ *
+ * A container holds the list-mode data of one or more modules in blocks.
+ * A block holds complete events from one module. The event headers are
+ * delta encoded against the previous event and the traces are delta
+ * encoded and bit packed in groups of samples. Decoding a block returns
+ * the module's data words exactly as read from the module.
+ *
+ * The file starts with a header of the magic, the version, the size of a
+ * JSON metadata text and a reserved word followed by the text. The blocks
+ * follow. Each block has a header with the module, the number of events,
+ * the number of data words, the payload size, a mask of the channels, a
+ * CRC32 of the payload and the time range of the events. The file ends
+ * with an index of the blocks and a trailer of the index's offset, the
+ * number of entries and the index magic. A file without an index, for
+ * example a file being written, is indexed by scanning the blocks.
+ *
+ * The words are in the host's byte order.
+ */
+namespace lmc {
+static constexpr uint32_t file_magic = 0x434d4c58; /* "XLMC" */
+static constexpr uint32_t block_magic = 0x4b4d4c58; /* "XLMK" */
+static constexpr uint32_t index_magic = 0x494d4c58; /* "XLMI" */
+static constexpr uint32_t version = 1;
+
+/**
+ * @brief The default number of data words in a block.
+ */
+static constexpr size_t default_block_words = 256 * 1024;
+
+/**
+ * @brief A module whose data is in a container.
+ */
+struct module_info {
+    int number;
+    /*
+     * The firmware revision selects the event length field and the ADC
+     * rate the timestamp's clock period.
+     */
+    int revision;
+    int adc_msps;
+
+    module_info();
+    module_info(int number, int revision, int adc_msps);
+
+    /*
+     * The timestamp clock period in seconds.
+     */
+    double tick_period() const;
+};
+
+typedef std::vector<module_info> module_infos;
+
+/**
+ * @brief A block's index entry.
+ */
+struct block {
+    enum flag_bits : uint32_t {
+        /*
+         * The payload is the data words, the data could not be framed
+         * into events or is a partial event.
+         */
+        raw = 1 << 0,
+        /*
+         * The event length field is 13 bits.
+         */
+        narrow_length = 1 << 1
+    };
+
+    uint64_t offset;
+    uint32_t module;
+    uint32_t flags;
+    uint32_t events;
+    uint32_t words;
+    uint32_t bytes;
+    uint32_t channels;
+    uint32_t crc;
+    /*
+     * The earliest and latest event timestamps in clock ticks. Raw blocks
+     * have no times.
+     */
+    uint64_t first_time;
+    uint64_t last_time;
+
+    block();
+};
+
+typedef std::vector<block> blocks;
+
+/**
+ * @brief Writes a container. The data of each module is added as it is
+ * read and a block is written when a module has a block of words. The
+ * partial event at the end of the data is held until the rest of the event
+ * is added.
+ *
+ * The writer is not thread safe.
+ */
+class writer {
+public:
+    /*
+     * Writes the container's bytes. The writer tracks the offsets.
+     */
+    typedef std::function<void(const void* data, size_t size)> output;
+
+    writer(const output& out, const module_infos& modules, const std::string& header,
+           size_t block_words = default_block_words);
+
+    /*
+     * Add a module's data words.
+     */
+    void add(int module, const hw::word* data, size_t words);
+
+    /*
+     * Write the complete events held in blocks.
+     */
+    void flush();
+
+    /*
+     * Write the data held and the index. A partial event is written as a
+     * raw block.
+     */
+    void finish();
+
+    /*
+     * The bytes written and the data words added.
+     */
+    size_t bytes() const {
+        return bytes_;
+    }
+    size_t words() const {
+        return words_;
+    }
+
+    const blocks& index() const {
+        return index_;
+    }
+
+    const size_t block_words;
+
+private:
+    struct stream {
+        module_info info;
+        hw::words pending;
+    };
+
+    stream& get_stream(int module);
+    void emit(stream& s, bool partial_blocks);
+    void write_block(stream& s, const hw::word* data, size_t words, size_t events, bool raw);
+    void write(const void* data, size_t size);
+
+    output out;
+    std::vector<stream> streams;
+    blocks index_;
+    std::vector<uint8_t> payload;
+    size_t bytes_;
+    size_t words_;
+    bool finished;
+};
+
+/**
+ * @brief Reads a container. The index is loaded when the container is
+ * opened and a block can be read without reading the blocks before it.
+ */
+class reader {
+public:
+    explicit reader(const std::string& path);
+
+    /*
+     * The JSON metadata text.
+     */
+    const std::string& header() const {
+        return header_;
+    }
+    /*
+     * The modules in the metadata.
+     */
+    const module_infos& modules() const {
+        return modules_;
+    }
+    const blocks& index() const {
+        return index_;
+    }
+    /*
+     * True if the container has an index, false if it was scanned.
+     */
+    bool indexed() const {
+        return indexed_;
+    }
+
+    /*
+     * Find the first block that can hold an event at or after the time in
+     * clock ticks or seconds. A module of -1 searches all modules. Returns
+     * the number of blocks if there is no block.
+     */
+    size_t find_ticks(uint64_t ticks, int module = -1) const;
+    size_t find(double secs, int module = -1) const;
+
+    /*
+     * Read a block's data words.
+     */
+    void read(size_t block, hw::words& words);
+
+    const std::string path;
+
+private:
+    struct module_blocks {
+        int module;
+        std::vector<size_t> blocks;
+        /*
+         * The latest time of the module's blocks up to each block.
+         */
+        std::vector<uint64_t> latest;
+    };
+
+    void scan(uint64_t start, uint64_t size);
+
+    std::ifstream in;
+    std::string header_;
+    module_infos modules_;
+    blocks index_;
+    std::vector<module_blocks> by_module;
+    std::vector<uint8_t> payload;
+    bool indexed_;
+};
+}  // namespace lmc
+}  // namespace pixie
+}  // namespace xia
+
+#endif  // PIXIE_LMC_H
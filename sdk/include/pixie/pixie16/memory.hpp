@@ -24,6 +24,7 @@
 #define PIXIE_HW_MEMORY_H
 
 #include <cstdint>
+#include <vector>
 
 #include <pixie/error.hpp>
 #include <pixie/fw.hpp>
@@ -56,6 +57,16 @@ static const address MCA_MEM_DATA = 0x00400000; /* R W */
  */
 static const address HISTOGRAM_MEMORY = 0x00000000;
 
+/*
+ * Host bus reads longer than this number of words use DMA.
+ */
+static const size_t dma_read_threshold = 48;
+
+/*
+ * MCA writes longer than this number of words use DMA.
+ */
+static const size_t dma_write_threshold = 48;
+
 /**
  * @brief Defines a memory bus for low level communication with the hardware.
  */
@@ -86,6 +97,16 @@ protected:
  * @brief Defines the communications channel for the host bus on a module.
  */
 struct host_bus : public bus {
+    /*
+     * A block of memory to transfer in a batch.
+     */
+    struct block {
+        address addr;
+        word_ptr buffer;
+        size_t length;
+    };
+    typedef std::vector<block> blocks;
+
     host_bus(module::module& module, const hw::hbr::host_bus_access access_);
 
     /*
@@ -104,6 +125,13 @@ struct host_bus : public bus {
     void read(const address addr, B& values, const size_t length = 0);
     void read(const address addr, word_ptr buffer, const size_t length);
 
+    /*
+     * Batched memory block read. The bus and the host bus request are held
+     * for the batch and blocks longer than the DMA threshold are read
+     * using DMA.
+     */
+    void read(const blocks& reads);
+
     /*
      * Memory write.
      */
@@ -117,11 +145,18 @@ struct host_bus : public bus {
     void write(const address addr, const words& values);
     void write(const size_t channel, const address addr, const words& values);
 
+    /*
+     * Batched memory block write. The bus and the host bus request are held
+     * for the batch.
+     */
+    void write(const blocks& writes);
+
 private:
     /*
-     * DMA set up
+     * DMA set up. The bus and the host bus request are held on exit.
      */
-    void dma_read(const address addr, word_ptr buffer, const size_t length);
+    void dma_read(const address addr, word_ptr buffer, const size_t length,
+                  hbr::host_bus_request& hbr);
 };
 
 template<class B>
@@ -158,6 +193,7 @@ struct mca : public bus {
     void read(const address addr, words& values);
     void read(const address addr, word_ptr values, size_t size);
     void write(const address addr, const words& values);
+    void write(const address addr, const word* values, size_t size);
 };
 
 /**
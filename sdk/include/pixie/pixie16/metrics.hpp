@@ -0,0 +1,157 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file metrics.hpp
+ * @brief Defines an exporter of a crate's statistics in the OpenMetrics text format.
+ */
+
+#ifndef PIXIE_METRICS_H
+#define PIXIE_METRICS_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pixie/pixie16/crate.hpp>
+
+namespace xia {
+namespace pixie {
+/**
+ * @brief Exports the crate's module states, FIFO statistics and channel
+ * statistics for Prometheus or another OpenMetrics scraper.
+ */
+namespace metrics {
+/**
+ * @brief The exporter's configuration.
+ */
+struct config {
+    /*
+     * The HTTP port scrapes are served on. A port of 0 picks a free port
+     * and a port of -1 does not serve, use the text dump. The address is
+     * the local address to bind to, empty binds all addresses.
+     */
+    int port;
+    std::string address;
+    /*
+     * The period the modules' statistics are read from the DSP. A period
+     * of 0 does not read them.
+     */
+    size_t stats_period_msecs;
+
+    config();
+};
+
+/**
+ * @brief A channel's statistics from the last read.
+ */
+struct channel_values {
+    std::atomic<double> input_counts;
+    std::atomic<double> input_count_rate;
+    std::atomic<double> output_counts;
+    std::atomic<double> output_count_rate;
+    std::atomic<double> live_time;
+
+    channel_values();
+};
+
+/**
+ * @brief A module's statistics from the last read.
+ */
+struct module_values {
+    std::atomic<uint64_t> processed_events;
+    std::atomic<double> real_time;
+    std::atomic_size_t reads;
+    std::atomic_size_t errors;
+    std::unique_ptr<channel_values[]> channels;
+    size_t num_channels;
+
+    explicit module_values(size_t num_channels);
+};
+
+/**
+ * @brief Exports the metrics of a crate's modules.
+ *
+ * The module states and FIFO statistics are the atomics the FIFO worker
+ * updates so they are read without the module locks. The channel
+ * statistics are read from each module's DSP in a batch by the exporter's
+ * thread each stats period and held in atomics for the scrapes. A scrape
+ * does not access the modules' hardware.
+ *
+ * Create the exporter after the crate is initialized and its slots are
+ * assigned. The endpoint is not supported on Windows.
+ */
+class exporter {
+public:
+    exporter(crate::crate& crate, const config& cfg);
+    ~exporter();
+
+    exporter(const exporter&) = delete;
+    exporter& operator=(const exporter&) = delete;
+
+    void start();
+    void stop();
+    bool running() const {
+        return running_.load();
+    }
+
+    /*
+     * Read the statistics of the online modules. Returns the number of
+     * modules read.
+     */
+    size_t poll_stats();
+
+    /*
+     * Answer the pending scrapes. The thread calls this. Returns the
+     * number of scrapes answered.
+     */
+    size_t serve();
+
+    /*
+     * The metrics in the OpenMetrics text format.
+     */
+    std::string text() const;
+
+    /*
+     * The bound port.
+     */
+    int port() const {
+        return port_;
+    }
+
+    const config cfg;
+
+private:
+    void listen();
+    void worker();
+
+    module::modules modules;
+    std::vector<std::unique_ptr<module_values>> values;
+
+    int listen_fd;
+    int port_;
+
+    std::thread thread;
+    std::atomic_bool running_;
+};
+}  // namespace metrics
+}  // namespace pixie
+}  // namespace xia
+
+#endif  // PIXIE_METRICS_H
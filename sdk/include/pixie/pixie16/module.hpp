@@ -23,15 +23,21 @@
 #ifndef PIXIE_MODULE_H
 #define PIXIE_MODULE_H
 
+#include <array>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <new>
 #include <thread>
 #include <vector>
 
+#include <pixie/alloc.hpp>
 #include <pixie/buffer.hpp>
 #include <pixie/eeprom.hpp>
 #include <pixie/error.hpp>
@@ -40,8 +46,14 @@
 #include <pixie/param.hpp>
 #include <pixie/stats.hpp>
 #include <pixie/sync.hpp>
+#include <pixie/util.hpp>
 
+#include <pixie/data/list_mode.hpp>
+#include <pixie/data/tau.hpp>
+
+#include <pixie/pixie16/access.hpp>
 #include <pixie/pixie16/backplane.hpp>
+#include <pixie/pixie16/capture.hpp>
 #include <pixie/pixie16/channel.hpp>
 #include <pixie/pixie16/hw.hpp>
 #include <pixie/pixie16/run.hpp>
@@ -76,6 +88,216 @@ struct pci_bus_handle;
  */
 typedef std::unique_ptr<pci_bus_handle> bus_handle;
 
+/**
+ * @brief A parameter write in a batch of writes. A module parameter write
+ * has no channel.
+ */
+struct param_write {
+    bool module_par;
+    param::module_param mod_par;
+    param::channel_param chan_par;
+    size_t channel;
+    double value;
+
+    param_write(param::module_param par, param::value_type value);
+    param_write(param::channel_param par, size_t channel, double value);
+};
+
+/**
+ * @brief A batch of parameter writes.
+ */
+typedef std::vector<param_write> param_writes;
+
+/**
+ * @brief The fingerprint of the firmware in a module's devices. A device's
+ * fingerprint is the CRC32 of the image it holds and 0 is not known.
+ */
+struct fingerprint {
+    uint32_t comms;
+    uint32_t fippi;
+    uint32_t dsp;
+
+    fingerprint();
+};
+
+/**
+ * @brief Estimates the rate data arrives in the FIFO from successive level
+ * samples. The estimate sets the FIFO worker's poll period and DMA
+ * trigger level so the FIFO stays below a target level with the fewest
+ * wakeups.
+ */
+struct fifo_rate {
+    /*
+     * The weight of a sample in the smoothed rate.
+     */
+    static constexpr double smoothing = 0.25;
+
+    double rate; /* Words per usec */
+    bool valid;
+
+    fifo_rate();
+
+    void reset();
+
+    /*
+     * Add a sample. The level is the FIFO level polled, remaining is the
+     * level left after the previous poll's reads and usecs is the time
+     * since the previous poll.
+     */
+    void sample(size_t level, size_t remaining, size_t usecs);
+
+    /*
+     * The period until the FIFO reaches the target level from the level.
+     * The period is the maximum wait if there is no estimate.
+     */
+    size_t wait_usecs(size_t level, size_t target, size_t min_wait, size_t max_wait) const;
+
+    /*
+     * The data expected to arrive in the wait period.
+     */
+    size_t trigger_level(size_t wait, size_t min_level, size_t max_level) const;
+};
+
+/**
+ * @brief The FIFO pool's buffer size and number an auto-tune chose. The
+ * values can be pinned in a configuration with set_fifo_buffer_words and
+ * set_fifo_buffers.
+ */
+struct fifo_tuning {
+    size_t buffer_words;
+    size_t buffers;
+    /*
+     * The DMA transfers sampled, the largest transfer and event and the
+     * deepest the queue was in buffers.
+     */
+    size_t dmas;
+    size_t max_dma_words;
+    size_t max_event_words;
+    size_t max_queue_depth;
+    /*
+     * A transfer filled a buffer so the transfers were capped by the
+     * buffer size.
+     */
+    bool capped;
+    /*
+     * The tuned pool does not fit in the memory budget.
+     */
+    bool over_budget;
+    bool valid;
+
+    fifo_tuning();
+};
+
+/**
+ * @brief Tunes the size and number of the FIFO pool's buffers from the DMA
+ * transfers and the event lengths seen at the start of a run.
+ *
+ * A buffer holds a DMA transfer so a buffer is sized to the largest
+ * transfer, or twice the size if transfers filled a buffer, and never less
+ * than the largest event. The queue is compacted when fewer than a few
+ * buffers are free so the pool has twice the deepest queue seen plus the
+ * headroom. If the pool is more than the memory budget the number of
+ * buffers and then the buffer size are reduced.
+ */
+struct fifo_tuner {
+    static constexpr size_t headroom_buffers = 6;
+    static constexpr size_t min_buffer_words = hw::max_dma_block_size;
+    static constexpr size_t max_buffer_words = hw::fifo_size_words;
+
+    size_t dmas;
+    size_t max_dma_words;
+    size_t max_event_words;
+    size_t max_queue_depth;
+    /*
+     * The largest buffer a transfer filled.
+     */
+    size_t capacity;
+    bool capped;
+    /*
+     * The words of the last event that are in the next transfer.
+     */
+    size_t carry;
+
+    fifo_tuner();
+
+    void reset();
+
+    /*
+     * Sample a DMA transfer. The capacity is the size of the buffer read
+     * into and the depth is the number of the pool's buffers in use.
+     */
+    void sample(const hw::word* data, size_t words, size_t buffer_capacity, size_t depth);
+
+    /*
+     * The tuning. A budget of 0 is no limit.
+     */
+    fifo_tuning tune(size_t budget_bytes, size_t min_buffers, size_t max_buffers) const;
+};
+
+/**
+ * @brief The placement of a module's FIFO worker thread and its buffers.
+ */
+struct worker_placement {
+    /*
+     * The CPUs the worker runs on. An empty set is not pinned.
+     */
+    util::cpus cpus;
+    /*
+     * Pin the worker to the CPUs local to the module's PCI device if no
+     * CPUs are set.
+     */
+    bool pci_local;
+    /*
+     * The worker's scheduling policy and priority. The real-time policies
+     * need privileges and the priority is from 1 to 99.
+     */
+    util::sched_policy policy;
+    int priority;
+    /*
+     * Allocate the buffer pool from a thread on the worker's CPUs so the
+     * memory is local to the worker's NUMA node.
+     */
+    bool numa_local;
+
+    worker_placement();
+};
+
+class module;
+
+/**
+ * @brief A subscription to a module's list-mode data. The FIFO worker
+ * signals the subscription when the data it has queued and is not read
+ * reaches the threshold.
+ */
+struct list_mode_subscription {
+    /*
+     * The handler is called with the buffers read from the module's FIFO
+     * data queue. It is called from the module's dispatcher thread and
+     * can keep the buffers. A subscription without a handler is only
+     * signalled and the user reads the data.
+     */
+    typedef std::function<void(module& module_, buffer::queue::handles& buffers)> handler;
+    handler callback;
+    /*
+     * The queued data that signals the subscription, units hw::words. A
+     * threshold of 0 signals any data.
+     */
+    size_t threshold_words;
+    /*
+     * The handler is called with the data queued below the threshold when
+     * the timeout expires. A timeout of 0 only calls the handler when the
+     * threshold is reached.
+     */
+    size_t timeout_usecs;
+    /*
+     * The maximum number of buffers handed to the handler in a call, 0 is
+     * all queued buffers.
+     */
+    size_t max_buffers;
+
+    list_mode_subscription();
+};
+
 /**
  * @brief Defines a Pixie-16 Module
  *
@@ -95,11 +317,78 @@ class module {
     typedef std::recursive_mutex lock_type;
     typedef std::lock_guard<lock_type> lock_guard;
 
+public:
+    /**
+     * @brief Bus lock priorities. FIFO servicing has priority over the
+     * other users of the bus.
+     */
+    enum struct bus_priority {
+        normal,
+        fifo
+    };
+
+    /**
+     * @brief Bus lock hold statistics.
+     */
+    struct bus_stats {
+        size_t holds; /* Number of times the lock was held */
+        size_t fifo_holds; /* Number of FIFO priority holds */
+        size_t max_hold_usecs; /* Longest hold */
+        size_t max_fifo_hold_usecs; /* Longest FIFO priority hold */
+        size_t total_hold_usecs; /* Total time held */
+        size_t fifo_waits; /* FIFO priority locks that waited for another holder */
+        size_t waits; /* Locks that waited for another holder */
+        size_t max_wait_usecs; /* Longest wait */
+        size_t total_wait_usecs; /* Total time waited */
+
+        bus_stats();
+    };
+
+    /**
+     * @brief Module lock wait statistics of the module guards. A lock
+     * waits when another thread holds the module. Only the locks taken
+     * with a module guard, the API's module handles, are counted. The
+     * module's internal uses of the lock are not.
+     */
+    struct lock_stats {
+        size_t locks; /* Number of times the lock was taken */
+        size_t waits; /* Locks that waited for another holder */
+        size_t max_wait_usecs; /* Longest wait */
+        size_t total_wait_usecs; /* Total time waited */
+
+        lock_stats();
+    };
+
+private:
     /*
-     * Bus lock
+     * Bus lock. A waiting FIFO priority lock is granted before the normal
+     * priority waiters so user reads cannot hold off the FIFO service
+     * between its bus accesses. The lock meets the Lockable requirements
+     * and locks with normal priority.
      */
-    typedef std::mutex bus_lock_type;
-    typedef std::lock_guard<bus_lock_type> bus_lock_guard;
+    class bus_lock_type {
+    public:
+        bus_lock_type();
+
+        void lock(bus_priority priority = bus_priority::normal);
+        bool try_lock();
+        void unlock();
+        bool held();
+
+        bus_stats stats() const;
+        void stats_reset();
+
+    private:
+        typedef std::chrono::steady_clock clock;
+
+        mutable std::mutex mutex;
+        std::condition_variable released;
+        bool locked;
+        size_t fifo_waiters;
+        bus_priority holder;
+        clock::time_point acquired;
+        bus_stats stats_;
+    };
 
     /*
      * A datasotre for persistent module wide data. This is for
@@ -123,6 +412,7 @@ public:
      * @brief Provides a guard to prevent concurrent module access.
      */
     class guard {
+        module& module_;
         lock_type& lock_;
         lock_guard guard_;
 
@@ -138,11 +428,11 @@ public:
      */
     class bus_guard {
         bus_lock_type& lock_;
-        bus_lock_guard guard_;
+        bus_priority priority;
 
     public:
-        bus_guard(module& mod);
-        ~bus_guard() = default;
+        bus_guard(module& mod, bus_priority priority = bus_priority::normal);
+        ~bus_guard();
         void lock();
         void unlock();
     };
@@ -161,22 +451,80 @@ public:
         void disable();
     };
 
+    /*
+     * A fixed bin histogram of a FIFO worker measurement. Bin 0 counts the
+     * value 0 and bin n counts the values from 2^(n-1) to 2^n - 1. The last
+     * bin also counts all larger values. The counts are relaxed atomics so
+     * the worker can record without a lock.
+     */
+    struct fifo_histogram {
+        static constexpr size_t bins = 32;
+
+        std::array<std::atomic_size_t, bins> counts;
+
+        fifo_histogram();
+        fifo_histogram(const fifo_histogram& h);
+
+        fifo_histogram& operator=(const fifo_histogram& h);
+
+        void record(size_t value);
+        void clear();
+
+        /*
+         * The bin of a value and the smallest value of a bin.
+         */
+        static size_t bin(size_t value);
+        static size_t bin_lower(size_t bin);
+
+        size_t total() const;
+
+        std::string output() const;
+    };
+
     /*
      * Stats for the module or a run.
+     *
+     * The counters are in blocks by the thread that writes them. The FIFO
+     * worker writes the first block and the readout, which holds the FIFO
+     * read lock, writes `out`. The blocks are padded apart by a cache line
+     * so a reader counting data out does not invalidate the worker's line
+     * on each read. A copy of the stats aggregates the blocks.
      */
     struct fifo_stats {
         static constexpr size_t bw_update_period = 100000; /* only update after usecs */
 
+        util::cache_line_pad in_pad;
         std::atomic_size_t in; /* Data into the fifo queue, units hw::words */
-        std::atomic_size_t out; /* Data read from the fifo queue, units hw::words */
         std::atomic_size_t dma_in; /* DMA data in, units hw::words */
         std::atomic_size_t overflows; /* Fifo queue overflows, units events */
         std::atomic_size_t dropped; /* Fifo queue data dropped, units events */
+        std::atomic_size_t filtered; /* Data removed by the event filter, units hw::words */
         std::atomic_size_t hw_overflows; /* Fifo HW overflows, units events */
+        std::atomic_size_t faults; /* Data faults found by the validator, units faults */
         std::atomic<double> bandwidth; /* Current bandwidth in MB/s*/
         std::atomic<double> max_bandwidth; /* Maximum bandwidth in MB/s */
         std::atomic<double> min_bandwidth; /* Minimum bandwidth in MB/s */
 
+        util::cache_line_pad out_pad;
+        std::atomic_size_t out; /* Data read from the fifo queue, units hw::words */
+
+        /*
+         * Run-time telemetry of the FIFO worker.
+         */
+        util::cache_line_pad telemetry_pad;
+        fifo_histogram level_words; /* FIFO level when read, units hw::words */
+        fifo_histogram dma_usecs; /* DMA transfer duration, units usecs */
+        fifo_histogram dma_words; /* DMA transfer length, units hw::words */
+        fifo_histogram latency_usecs; /* Data seen in the FIFO to queued, units usecs */
+        fifo_histogram queue_depth; /* Fifo queue depth after a queue, units buffers */
+        fifo_histogram poll_usecs; /* Time between FIFO level polls, units usecs */
+        fifo_histogram compact_usecs; /* Fifo queue compaction duration, units usecs */
+
+        /*
+         * Heap allocations of the worker and readouts in a steady-state run.
+         */
+        pixie::alloc::counter allocations;
+
         fifo_stats();
         fifo_stats(const fifo_stats& s);
 
@@ -215,20 +563,42 @@ public:
      */
     enum struct test { off = 0, lm_fifo };
 
+    /**
+     * @brief The MCA memory clear of a new run.
+     *
+     * `run_start` clears the memory when a new run starts. `run_end`
+     * clears the memory in the background when a run ends so the next run
+     * starts without a clear, the ended run's histograms cannot be read.
+     * `skip_list_mode` does not clear the memory for a new list-mode run.
+     * A new run does not clear memory that has been cleared in the
+     * background.
+     */
+    enum struct mca_clear { run_start, run_end, skip_list_mode };
+
+    /**
+     * @brief The state of the MCA memory.
+     */
+    enum struct mca_state { dirty, clearing, clear };
+
     /*
      * Defaults
      */
     static const size_t default_fifo_buffers;
+    static const size_t default_fifo_buffer_words;
+    static const size_t default_fifo_tune_msecs;
     static const size_t default_fifo_run_wait_usec;
     static const size_t default_fifo_idle_wait_usec;
     static const size_t default_fifo_hold_usec;
     static const size_t default_fifo_dma_trigger_level;
+    static const size_t fifo_adaptive_target_level;
 
     /*
      * Ranges
      */
     static const size_t min_fifo_buffers;
     static const size_t max_fifo_buffers;
+    static const size_t min_fifo_buffer_words;
+    static const size_t max_fifo_buffer_words;
     static const size_t min_fifo_run_wait_usec;
     static const size_t max_fifo_run_wait_usec;
     static const size_t min_fifo_idle_wait_usec;
@@ -296,16 +666,22 @@ public:
      */
     hw::run::module_config run_config;
 
+    /**
+     * The revision's hardware access paths, selected when the module is
+     * opened.
+     */
+    const hw::access::table* hw_access;
+
     /*
      * Module parameters
      */
-    param::module_var_descs module_var_descriptors;
+    param::shared_module_var_descs module_var_descriptors;
     param::module_variables module_vars;
 
     /*
      * Channel parameters, a set per channel.
      */
-    param::channel_var_descs channel_var_descriptors;
+    param::shared_channel_var_descs channel_var_descriptors;
     channel::channels channels;
 
     /**
@@ -313,14 +689,22 @@ public:
      */
     param::address_map param_addresses;
 
+    /**
+     * Image of the DSP variable memory. The image mirrors the variables and
+     * is only valid when the variables' addresses are loaded.
+     */
+    param::image var_image;
+
     /**
      * Firmware
      */
     firmware::module firmware;
 
     /*
-     * Run and control task states.
+     * Run and control task states. The user polls these while the workers
+     * write their counters so they are padded off the counters' lines.
      */
+    util::cache_line_pad run_state_pad;
     std::atomic<hw::run::run_task> run_task;
     std::atomic<hw::run::control_task> control_task;
 
@@ -332,6 +716,24 @@ public:
      */
     size_t fifo_buffers;
 
+    /**
+     * Maximum number of buffers in the FIFO pool. If more than @ref
+     * fifo_buffers the pool grows when it runs low during a run and
+     * shrinks back when the module is idle. A value of 0 is a fixed size
+     * pool.
+     *
+     * Do not set this value directly, use @ref set_fifo_buffers_max.
+     */
+    size_t fifo_buffers_max;
+
+    /**
+     * Size of a FIFO pool buffer in words. A DMA transfer is no longer
+     * than a buffer. The setting is applied when the pool is next created.
+     *
+     * Do not set this value directly, use @ref set_fifo_buffer_words.
+     */
+    size_t fifo_buffer_words;
+
     /**
      * FIFO run wait poll period. This setting needs to be less than the
      * period of time it takes to full the FIFO device at the maxiumum data
@@ -378,12 +780,151 @@ public:
      */
     std::atomic_size_t fifo_bandwidth;
 
+    /**
+     * FIFO interrupt mode. The FIFO worker blocks waiting for a PLX local
+     * interrupt notification rather than polling the FIFO level every run
+     * wait period. If no interrupt is seen the worker polls at the idle
+     * wait period. If the interrupt cannot be armed the worker polls.
+     *
+     * Do not set this value directly, use @ref set_fifo_interrupt.
+     */
+    std::atomic_bool fifo_interrupt;
+
+    /**
+     * FIFO data CRC. The FIFO worker computes a CRC32 of the data it queues
+     * for the user. The CRC covers the data queued since the start of the
+     * list-mode run so a user can verify the data read end to end. The CRC
+     * is computed independently of the logging level.
+     *
+     * Do not set this value directly, use @ref set_fifo_crc.
+     */
+    std::atomic_bool fifo_crc;
+
+    /**
+     * FIFO adaptive mode. During a list-mode run the FIFO worker estimates
+     * the rate data arrives from the FIFO level and sets the poll period
+     * and DMA trigger level to keep the FIFO level below @ref
+     * fifo_adaptive_target_level with the fewest wakeups. The poll period
+     * is bounded by the minimum run wait and the idle wait. The mode is
+     * not used when the FIFO interrupt is armed.
+     *
+     * Do not set this value directly, use @ref set_fifo_adaptive.
+     */
+    std::atomic_bool fifo_adaptive;
+
+    /**
+     * FIFO pool huge pages. The pool's buffers are carved from one arena
+     * backed by huge pages where the system has them, otherwise from
+     * normal pages. The setting is applied when the pool is next created.
+     *
+     * Do not set this value directly, use @ref set_fifo_huge_pages.
+     */
+    std::atomic_bool fifo_huge_pages;
+
+    /**
+     * FIFO steady state. The pool is grown to its maximum and the FIFO
+     * queue is preallocated for the pool's buffers when a list-mode run
+     * starts so the worker and readouts do not allocate during the run.
+     * The heap allocations the worker and readout threads make during the
+     * run are counted in the run stats.
+     *
+     * Do not set this value directly, use @ref set_fifo_steady_state.
+     */
+    std::atomic_bool fifo_steady_state;
+
+    /**
+     * FIFO auto-tune. The FIFO worker samples the DMA transfers and event
+     * lengths for the tune period at the start of a list-mode run and
+     * tunes the pool's buffer size and number within the memory budget,
+     * units bytes, 0 is no limit. The tuning is logged, can be read with
+     * @ref get_fifo_tuning and is applied to the pool when the next
+     * list-mode run is prepared.
+     *
+     * Do not set these values directly, use @ref set_fifo_auto_tune.
+     */
+    std::atomic_bool fifo_auto_tune;
+    std::atomic_size_t fifo_tune_budget;
+    std::atomic_size_t fifo_tune_msecs;
+
+    /**
+     * FIFO direct reads. The worker does not run and a list-mode read
+     * checks the FIFO level and reads the FIFO into a pool buffer on the
+     * reader's thread. There is no handshake with the worker so a read
+     * has the lowest latency. Data is only read from the FIFO when the
+     * user reads so the user has to read often enough to keep the FIFO
+     * from filling. The mode cannot be set while a task is running.
+     *
+     * Do not set this value directly, use @ref set_fifo_direct.
+     */
+    std::atomic_bool fifo_direct;
+
+    /**
+     * FIFO worker placement. The CPUs and scheduling are applied when the
+     * worker starts or the placement is set. The NUMA local pool is
+     * applied when the pool is next created.
+     *
+     * Do not set this value directly, use @ref set_fifo_placement.
+     */
+    worker_placement fifo_placement;
+
+    /**
+     * FIFO event filter. The FIFO worker reduces the data it reads with
+     * the filter before the data is queued. The filter's lock is held by
+     * the worker while a buffer is reduced.
+     *
+     * Do not set this value directly, use @ref set_fifo_filter.
+     */
+    data::list_mode::event_filter fifo_filter;
+    buffer::lock_type fifo_filter_lock;
+    std::atomic_bool fifo_filtering;
+
+    /**
+     * FIFO data validator. The FIFO worker checks the structure of the
+     * data it reads before the filter and logs the faults it finds with
+     * the module's context. The validator's lock is held by the worker
+     * while a buffer is checked.
+     *
+     * Do not set this value directly, use @ref set_fifo_validation.
+     */
+    data::list_mode::event_validator fifo_validator;
+    buffer::lock_type fifo_validator_lock;
+    std::atomic_bool fifo_validating;
+
+    /**
+     * FIFO capture. The FIFO worker writes each DMA transfer to the capture
+     * file as it is read, before the filter. The capture's lock is held by
+     * the worker while a transfer is written.
+     *
+     * Do not set these values directly, use @ref start_fifo_capture.
+     */
+    capture::writer fifo_capture;
+    buffer::lock_type fifo_capture_lock;
+    std::atomic_bool fifo_capturing;
+
     /*
      * Run stats, only updated when a run is active
      */
     util::timepoint run_interval; /* Period of the run */
     fifo_stats run_stats;
 
+    /*
+     * Control task and run end completion latencies.
+     */
+    hw::run::latencies task_latencies;
+
+    /*
+     * MCA memory clear policy.
+     *
+     * Do not set this value directly, use @ref set_mca_clear.
+     */
+    std::atomic<mca_clear> mca_clear_policy;
+
+    /*
+     * The MCA memory was clear when the last new run started. A list-mode
+     * run that skips the clear starts with the previous run's histograms.
+     */
+    std::atomic_bool run_mca_cleared;
+
     /**
      * Crate revision
      */
@@ -459,6 +1000,18 @@ public:
      */
     virtual void boot(bool boot_comms = true, bool boot_fippi = true, bool boot_dsp = true);
 
+    /**
+     * Boot the devices that are not loaded or that hold firmware other than
+     * the module's. The loaded fingerprint is the firmware the devices hold
+     * and it is updated after the boot. Returns true if a device is booted.
+     */
+    bool boot_changed(fingerprint& loaded);
+
+    /**
+     * The fingerprint of the module's firmware. The images are loaded.
+     */
+    fingerprint firmware_fingerprint();
+
     /**
      * Initialise the module ready for use.
      */
@@ -497,6 +1050,51 @@ public:
     void write(const std::string& var, size_t channel, double value);
     void write(param::channel_param par, size_t channel, double value);
 
+    /**
+     * Write a batch of parameters under a single lock. The FIPPI programming
+     * and DAC setting the writes need are run once when the batch has been
+     * written. If a write fails the control tasks needed by the writes
+     * applied are still run. Returns true if a module parameter written
+     * needs to be broadcast to the other modules.
+     */
+    bool write_batch(const param_writes& writes);
+
+    /**
+     * Stage the writes of the next run's parameters while the current run
+     * takes data. The staged variables are held in the module's copy and
+     * the variable image and are not written to the DSP. The FIPPI
+     * programming and DAC setting the writes need are deferred to the
+     * commit. Staged values are read back from the module's copy. Writes
+     * can be staged more than once before a commit. Returns true if a
+     * module parameter written needs to be broadcast to the other modules.
+     *
+     * A parameter that writes hardware other than the DSP variables, for
+     * example the backplane, writes the hardware when staged.
+     */
+    bool stage_writes(const param_writes& writes);
+    bool staged() const {
+        return staging.load();
+    }
+
+    /**
+     * Commit the staged writes once the run has ended. The dirty variables
+     * are written to the DSP in a single transfer of the variable image's
+     * dirty runs then the FIPPI is programmed and the DACs set once if the
+     * staged writes need them.
+     */
+    void commit_staged();
+
+    /**
+     * Discard the staged writes. The variables are read back from the DSP.
+     */
+    void discard_staged();
+
+    /**
+     * Defer a control task if a batch of writes is being written. Returns
+     * true if the task has been deferred.
+     */
+    bool defer_control(hw::run::control_task task);
+
     /*
      * Read a variable.
      *
@@ -527,24 +1125,73 @@ public:
     void write_var(param::channel_var, param::value_type value, size_t channel, size_t offset = 0,
                    bool io = true);
 
+    /*
+     * Update a variable's copy if the value differs. The copy is marked
+     * dirty and synced to the DSP with @ref sync_vars. A value equal to a
+     * copy that matches the DSP or is dirty is not written. Returns true
+     * if the copy was written.
+     */
+    bool update_var(param::module_var var, param::value_type value, size_t offset = 0);
+    bool update_var(param::channel_var var, param::value_type value, size_t channel,
+                    size_t offset = 0);
+
     /**
      * Synchronize dirty variables with the hardware and then sync the
      * hardware state.
      */
     void sync_vars(const sync_var_mode sync_mode = sync_to_dsp);
 
+    /**
+     * Invalidate the cached variable values. A read of a cached read-write
+     * variable is served from memory until the DSP changes the variable's
+     * value. Read-only variables are always read from the hardware.
+     */
+    void invalidate_vars();
+
     /**
      * Sync the hardware after the variables have been sync'ed with @ref sync_var and
      * the mode sync mode is @ref sync_to_dsp.
      */
     void sync_hw(const bool program_fippi = true, const bool program_dacs = true);
 
+    /**
+     * Sync the dirty variables to the DSP and run only the hardware actions
+     * the changes need. The DACs are set if an offset DAC changed. The
+     * FIPPI is programmed and the hardware synced if any other variable
+     * changed that is not only used by the DSP. Nothing is done if no
+     * variable is dirty.
+     */
+    void sync_changed_vars();
+
+    /*
+     * Export the variables as an image of the DSP variable memory. Import
+     * copies the writable variables that differ in the image marking them
+     * dirty, sync the variables to write them to the DSP. Returns the
+     * number of words that differ. The image must be of the module's
+     * address map.
+     */
+    void export_vars(param::image& image);
+    size_t import_vars(const param::image& image);
+
     /*
      * Run control and status
      */
     void run_end();
     bool run_active();
 
+    /*
+     * Request the run to stop without waiting for it to end or reading the
+     * remaining data. Call run_end() to complete the end. A crate stops
+     * its run leader so the modules in sync wait mode stop together then
+     * ends the modules in parallel.
+     */
+    void run_stop();
+
+    /*
+     * The run's real time from the module's run time counter, units secs.
+     */
+    double run_real_time();
+
     /*
      * Control tasks
      */
@@ -560,6 +1207,26 @@ public:
     void start_histograms(hw::run::run_mode mode);
     void start_listmode(hw::run::run_mode mode);
 
+    /*
+     * Start a list-mode run in two steps. Prepare the module for the run
+     * then enable it. The slow part of a start is the preparation so the
+     * modules of a crate are prepared together and enabled one after the
+     * other.
+     */
+    void prepare_listmode(hw::run::run_mode mode);
+    void enable_run();
+
+    /*
+     * MCA memory clear. Start a background clear once the histograms have
+     * been read. A wait for the clear returns true if the memory is clear.
+     * A new run prepares the memory and waits for a background clear.
+     */
+    void set_mca_clear(mca_clear policy);
+    void start_mca_clear();
+    bool wait_mca_clear();
+    mca_state mca_memory() const;
+    void prepare_mca(hw::run::run_task run_tsk);
+
     /**
      * @brief Reads an ADC trace from the specified channel.
      * @param[in] channel The channel that we'd like to read the ADC trace from.
@@ -579,6 +1246,37 @@ public:
      *                  already been run.
      */
     void read_adc(size_t channel, hw::adc_trace& buffer, bool run = true);
+    /**
+     * @brief Reads the ADC traces of a range of channels.
+     * @param[in] channels The channels to read.
+     * @param[out] traces The traces, one for each channel in the range. An
+     *                  empty trace is sized to the channel's maximum trace
+     *                  length. The traces of consecutive channels are read
+     *                  from the DSP in a single batch.
+     * @param[in] run If true, then we execute the control task to collect the
+     *                  ADC traces. If false, then we assume the control task has
+     *                  already been run.
+     */
+    void read_adcs(const channel::range& channels, hw::adc_traces& traces, bool run = true);
+
+    /**
+     * @brief Estimates the preamplifier decay time of a range of channels
+     *        from their ADC traces on the host. This does not use the
+     *        DSP's tau finder.
+     * @param[in] channels The channels to fit.
+     * @param[in] cfg The pulse finding and fit. If the sample period is 0
+     *                  the channel's XDT is used.
+     * @param[out] taus The estimates, one for each channel in the range.
+     * @param[in] captures The number of ADC trace captures fitted.
+     * @param[in] write If true, then the valid estimates are written to
+     *                  the channels' tau.
+     * @param[in] threads The number of threads the channels are fitted
+     *                  with. If 0 the hardware concurrency is used.
+     * @see xia::pixie::data::tau
+     */
+    void fit_tau(const channel::range& channels, const data::tau::config& cfg,
+                 data::tau::estimates& taus, size_t captures = 1, bool write = false,
+                 size_t threads = 0);
 
     /*
      * Find the baseline cut for the range of channels. Return the
@@ -588,6 +1286,13 @@ public:
     void bl_get(channel::range& channels_, channel::baseline::channels_values& values,
                 bool run = true);
 
+    /*
+     * Update the noise figures of the range of channels with a capture of
+     * the baselines. Only the figures are returned and the figures can be
+     * updated with further captures.
+     */
+    void bl_noise(channel::range& channels_, stats::baseline_noises& noises, bool run = true);
+
     /*
      * Read a channel's histogram.
      */
@@ -595,16 +1300,107 @@ public:
     void read_histogram(size_t channel, hw::word_ptr values, const size_t size);
 
     /*
-     * Read the module's list mode
+     * Read the histograms of a range of channels. The histogram of the
+     * channel at index `i` in the range starts at `values[i * length]`. A
+     * length of 0 is the first channel's maximum histogram length. The
+     * full histograms of consecutive channels are read with a single DMA.
+     */
+    void read_histograms(const channel::range& channels, hw::words& values, size_t length = 0);
+
+    /*
+     * Read the module's list mode. The reads do not take the module lock
+     * and do not wait for control calls such as parameter writes or
+     * statistics reads.
      */
     size_t read_list_mode_level();
     size_t read_list_mode(hw::words& words);
     size_t read_list_mode(hw::word_ptr values, const size_t size);
 
+    /*
+     * Read the module's list mode as buffers taken directly from the FIFO
+     * data queue. No data is copied. Up to `max_buffers` buffers are
+     * appended to `buffers`, 0 reads all queued buffers. The buffers are
+     * returned to the module's FIFO pool when the handles are released and
+     * must be released before the module is closed. Returns the number of
+     * words read.
+     */
+    size_t read_list_mode(buffer::queue::handles& buffers, const size_t max_buffers = 0);
+
+    /*
+     * Return buffers read as handles to the front of the FIFO data queue
+     * in their order, for example when a consumer fails to write them.
+     * The handles are cleared.
+     */
+    void requeue_list_mode(buffer::queue::handles& buffers);
+
+    /*
+     * Append the module's queued list mode to a file if more than
+     * `min_words` are queued. The buffers are written from the FIFO pool
+     * without a copy. The file is created if it does not exist and is not
+     * opened if there is nothing to save. The buffers not written when a
+     * write fails are returned to the front of the queue. Returns the
+     * number of words written.
+     */
+    size_t save_list_mode(const std::string& file_name, const size_t min_words = 0);
+
+    /*
+     * Tee the module's list mode to more than one in-process consumer. The
+     * fan-out reads the buffers from the FIFO data queue and each consumer
+     * reads all of them without copying. Create one fan-out for a module
+     * and read the data only through its consumers. A consumer that falls
+     * behind by more than `max_held` buffers drops the oldest, 0 uses half
+     * the FIFO pool. Release the fan-out before the module is closed.
+     */
+    std::shared_ptr<buffer::fanout> tee_list_mode(const size_t max_held = 0);
+
+    /*
+     * Read the module's list mode level and data without exceptions for
+     * polling loops. A module that is not online or has no data is a
+     * routine result and is returned as a code. A hardware error is also
+     * returned as the error's code. Returns `success` or the code and the
+     * level or the number of words read.
+     */
+    error::code read_list_mode_level(size_t& level, const std::nothrow_t&) noexcept;
+    error::code read_list_mode(hw::word_ptr values, const size_t size, size_t& words,
+                               const std::nothrow_t&) noexcept;
+    error::code read_list_mode(buffer::queue::handles& buffers, const size_t max_buffers,
+                               size_t& words, const std::nothrow_t&) noexcept;
+
+    /*
+     * Subscribe to the module's list-mode data. A subscription replaces
+     * the existing one. A subscription with a handler starts a dispatcher
+     * thread that reads the data and calls the handler. The subscription
+     * is signalled until the data is read. Subscribe and unsubscribe from
+     * one thread and not from the handler.
+     */
+    void subscribe_list_mode(const list_mode_subscription& subscription);
+    void unsubscribe_list_mode();
+    bool list_mode_subscribed() const {
+        return fifo_subscribed.load();
+    }
+
+    /*
+     * Wait for the subscription to be signalled. Returns false if the wait
+     * timed out or there is no subscription. A timeout of 0 waits for
+     * ever.
+     */
+    bool wait_list_mode(size_t timeout_usecs = 0);
+
+    /*
+     * An event descriptor readable when the subscription is signalled.
+     * Add it to an epoll set or an event loop and read the descriptor to
+     * reset it. The descriptor is valid while subscribed and is -1 if
+     * the platform does not support it.
+     */
+    int list_mode_event_fd() const {
+        return fifo_event_fd.load();
+    }
+
     /**
      * Read the stats
      */
     void read_stats(stats::stats& stats);
+    error::code read_stats(stats::stats& stats, const std::nothrow_t&) noexcept;
 
     /**
      * Read auto tau values
@@ -615,11 +1411,88 @@ public:
      * FIFO worker controls. These range values.
      */
     void set_fifo_buffers(const size_t buffers);
+    void set_fifo_buffers_max(const size_t buffers);
+    void set_fifo_buffer_words(const size_t words);
+    void set_fifo_auto_tune(const bool auto_tune, const size_t budget_bytes = 0,
+                            const size_t tune_msecs = default_fifo_tune_msecs);
     void set_fifo_run_wait(const size_t run_wait);
     void set_fifo_idle_wait(const size_t idle_wait);
     void set_fifo_hold(const size_t hold);
     void set_fifo_dma_trigger_level(const size_t dma_trigger_level);
     void set_fifo_bandwidth(const size_t bandwidth);
+    void set_fifo_interrupt(const bool interrupt);
+    void set_fifo_crc(const bool crc);
+    void set_fifo_adaptive(const bool adaptive);
+    void set_fifo_huge_pages(const bool huge_pages);
+    void set_fifo_steady_state(const bool steady_state);
+    void set_fifo_direct(const bool direct);
+    void set_fifo_placement(const worker_placement& placement);
+
+    /**
+     * The FIFO auto-tune's tuning of the last list-mode run. It is not
+     * valid until a run has been tuned.
+     */
+    fifo_tuning get_fifo_tuning() const;
+
+    /**
+     * Resize the FIFO pool to the auto-tune's tuning. The module must not
+     * be running. Returns false if there is no valid tuning.
+     */
+    bool apply_fifo_tuning();
+
+    /**
+     * FIFO event filter. The events are reduced in the layout of the
+     * firmware revision and the module's ADC frequency. A reduction that
+     * passes all events through disables the filter. The filter cannot be
+     * set while a run is active.
+     */
+    void set_fifo_filter(const data::list_mode::reduction& policy, const size_t fw_revision);
+
+    /**
+     * FIFO data validation. The headers are checked in the layout of the
+     * firmware revision and the module's ADC frequency for the module's
+     * slot. The validator's state is reset when a run starts. Validation
+     * cannot be set while a run is active.
+     */
+    void set_fifo_validation(const bool validate, const size_t fw_revision,
+                             const size_t zero_run_words =
+                                 data::list_mode::event_validator::default_zero_run_words);
+
+    /**
+     * FIFO capture. Capture the DMA transfers of the FIFO worker with their
+     * sizes and start times to a file. A simulated module can replay the
+     * file. A write error stops the capture. Starting a capture replaces
+     * the current capture.
+     */
+    void start_fifo_capture(const std::string& path);
+    void stop_fifo_capture();
+
+    /**
+     * FIFO pool watermarks in buffers in use. The handler is called when
+     * the buffers in use reach the high mark and when they fall back to
+     * the low mark. It is called from the FIFO worker or the thread
+     * releasing the data and must not block. A high mark of 0 disables the
+     * watermarks.
+     */
+    void set_fifo_watermarks(const size_t high, const size_t low,
+                             buffer::pool::watermark_handler handler = nullptr);
+    bool fifo_high_water() const {
+        return fifo_pool.high_water();
+    }
+
+    /**
+     * The CPU time the FIFO worker thread has used in microseconds. It is
+     * 0 if the worker is not running or the time cannot be read.
+     */
+    size_t fifo_worker_cpu_usecs() {
+        return util::thread_cpu_usecs(fifo_thread);
+    }
+
+    /**
+     * The CRC32 of the FIFO data queued since the start of the list-mode
+     * run. It is only computed if @ref fifo_crc is set.
+     */
+    util::crc32::value_type fifo_data_crc() const;
 
     /**
      * Select the module's port
@@ -638,6 +1511,18 @@ public:
      */
     void report(std::ostream& out) const;
 
+    /*
+     * Bus lock hold statistics.
+     */
+    bus_stats bus_hold_stats() const;
+    void bus_hold_stats_reset();
+
+    /*
+     * Module lock wait statistics of the module guards.
+     */
+    lock_stats lock_wait_stats() const;
+    void lock_wait_stats_reset();
+
     /**
      * Read a word.
      */
@@ -654,6 +1539,12 @@ public:
     virtual void dma_read(const hw::address source, hw::words& values);
     virtual void dma_read(const hw::address source, hw::word_ptr values, const size_t size);
 
+    /*
+     * DMA block write. The local address is held constant for the
+     * transfer. There is nothing to write if there is no hardware.
+     */
+    virtual void dma_write(const hw::address dest, const hw::word* values, const size_t size);
+
     /*
      * Revision tag operators to make comparisons of a version simpler to
      * code.
@@ -678,6 +1569,12 @@ public:
     int pci_bus();
     int pci_slot();
 
+    /*
+     * The CPUs local to the module's PCI device. The set is empty if it is
+     * not known.
+     */
+    void pci_local_cpus(util::cpus& cpus);
+
     /*
      * Test modes
      *
@@ -720,6 +1617,14 @@ protected:
      */
     virtual void set_bus_device_number(size_t device_number);
 
+    /*
+     * Register access when there is no hardware. A simulated module can
+     * model registers by overriding these. By default reads return 0 and
+     * writes are ignored.
+     */
+    virtual hw::word no_hw_read_word(int reg);
+    virtual void no_hw_write_word(int reg, const hw::word value);
+
     /*
      * Load the variable address map.
      */
@@ -737,6 +1642,21 @@ protected:
     virtual void erase_channels();
     virtual void init_channels();
 
+    /*
+     * Create the variable image from the variables and the runs of the
+     * writable variables' words to read from the DSP. Stage the dirty
+     * variables into the image.
+     */
+    void create_var_image();
+    void stage_var_image();
+
+    /*
+     * Set a dirty word or store a DSP word of a variable in the image.
+     */
+    void image_var(const hw::address address, const hw::word word, const bool dirty);
+    void image_var(channel::channel& channel, const hw::address address, const hw::word word,
+                   const bool dirty);
+
     /*
      * Module parameter handlers.
      */
@@ -761,6 +1681,13 @@ protected:
     void start_fifo_services();
     void stop_fifo_services();
 
+    /*
+     * Create the FIFO pool and ring and recreate them with the current
+     * settings. The recreate stops and restarts the worker.
+     */
+    void create_fifo_pool();
+    void recreate_fifo_pool();
+
     /*
      * FIFO worker
      */
@@ -768,6 +1695,26 @@ protected:
     void stop_fifo_worker();
     void fifo_worker();
 
+    /*
+     * The CPUs of the worker's placement and apply the placement to the
+     * running worker.
+     */
+    void fifo_placement_cpus(util::cpus& cpus);
+    void apply_fifo_placement();
+
+    /*
+     * FIFO interrupt notifier. The notifier thread waits on the PLX
+     * notification and wakes the FIFO worker.
+     */
+    void start_fifo_interrupt();
+    void stop_fifo_interrupt();
+    void fifo_interrupt_notifier();
+
+    /*
+     * Run the control tasks deferred by a batch of writes.
+     */
+    void run_batch_controls();
+
     /*
      * Calculate the bus speed
      */
@@ -790,23 +1737,110 @@ protected:
      */
     void sync_worker_run(bool forced = false);
 
+    /*
+     * The list mode level and reads of an online module. They throw only
+     * for hardware errors.
+     */
+    size_t fifo_level();
+    size_t fifo_copy(hw::word_ptr values, const size_t size);
+    size_t fifo_pop(buffer::queue::handles& buffers, const size_t max_buffers);
+    void fifo_requeue(buffer::queue::handles& buffers);
+    /*
+     * The counter of a steady-state list-mode run or null.
+     */
+    pixie::alloc::counter* run_allocations();
+
+    /*
+     * Queue a buffer read from the FIFO and the direct read of the FIFO.
+     */
+    typedef std::chrono::steady_clock fifo_clock;
+    void fifo_queue(buffer::handle& buf, bool queue_buf, fifo_clock::time_point seen,
+                    fifo_clock::time_point start);
+    void fifo_direct_read();
+
+    /*
+     * The FIFO auto-tune. The worker samples each DMA transfer during the
+     * tune period and finishes the tuning at the end of the period or run.
+     */
+    void fifo_tune_sample(const buffer::handle& buf, fifo_clock::time_point now);
+    void fifo_tune_finish();
+
     void trace_reg(char type, const char* ptr, void* vmaddr, int reg, hw::word value);
 
     std::thread fifo_thread;
 
+    /*
+     * The worker and run state flags are polled by the worker and the user
+     * so each group is padded off the lines of the data the worker writes.
+     */
+    util::cache_line_pad worker_state_pad;
     std::atomic_bool fifo_worker_running;
     std::atomic_bool fifo_worker_finished;
     sync::variable::lock_type fifo_worker_working;
     sync::variable fifo_worker_req;
     sync::variable fifo_worker_resp;
+    std::atomic_bool fifo_worker_requested;
+
+    std::thread fifo_irq_thread;
+    std::atomic_bool fifo_irq_running;
+    std::atomic_bool fifo_irq_pending;
+
+    /*
+     * Running CRC of the queued FIFO data. The worker updates it for each
+     * buffer.
+     */
+    util::cache_line_pad crc_pad;
+    std::atomic<util::crc32::value_type> fifo_crc_value;
 
+    /*
+     * FIFO auto-tune state. The tuner and its period are only used by the
+     * worker, the tuning is held by the lock. A prepared list-mode run sets
+     * the pending flag and the worker starts tuning at the first transfer.
+     */
+    fifo_tuner fifo_tune;
+    bool fifo_tuning_run;
+    fifo_clock::time_point fifo_tune_end;
+    fifo_tuning fifo_tuned;
+    mutable buffer::lock_type fifo_tuned_lock;
+    std::atomic_bool fifo_tune_pending;
+
+    /*
+     * List-mode data subscription. The worker signals the subscription
+     * once when the queued data reaches the threshold and a read of the
+     * data clears it.
+     */
+    void notify_list_mode();
+    void list_mode_dispatcher();
+    util::cache_line_pad subscription_pad;
+    list_mode_subscription fifo_subscription;
+    std::atomic_bool fifo_subscribed;
+    std::atomic_size_t fifo_notify_threshold;
+    std::atomic_bool fifo_notify_pending;
+    sync::variable::lock_type fifo_notify_lock;
+    sync::variable fifo_notify;
+    std::atomic_bool fifo_notify_running;
+    std::thread fifo_notify_thread;
+    std::atomic_int fifo_event_fd;
+
+    /*
+     * The FIFO worker pushes buffers into the ring and the user calls drain
+     * the ring into the data queue under the FIFO read lock. The ring is the
+     * only path between the worker and the user calls. The read lock is not
+     * the module lock so readout does not wait for control calls.
+     */
     buffer::pool fifo_pool;
+    buffer::ring fifo_ring;
     buffer::queue fifo_data;
+    buffer::lock_type fifo_read_lock;
 
     /*
-     * Module lock
+     * Module lock and its wait statistics. The guards take the lock with
+     * lock_acquire().
      */
     lock_type lock_;
+    mutable std::mutex lock_stats_lock;
+    lock_stats lock_stats_;
+    lock_type& lock_acquire();
 
     /*
      * Bus lock
@@ -821,6 +1855,7 @@ protected:
     /*
      * Present in the rack.
      */
+    util::cache_line_pad state_pad;
     std::atomic_bool present_;
 
     /*
@@ -838,6 +1873,21 @@ protected:
      */
     std::atomic_bool pause_fifo_worker;
 
+    /*
+     * A run task is prepared and not enabled. The task is not active.
+     */
+    std::atomic_bool run_prepared;
+
+    /*
+     * Background MCA memory clear.
+     */
+    util::cache_line_pad mca_pad;
+    std::thread mca_clear_thread;
+    std::atomic<mca_state> mca_memory_;
+    std::atomic_bool mca_clear_abort;
+    void mca_clear_worker();
+    bool clear_mca_memory();
+
     /*
      * System, FIPPI and DSP online.
      */
@@ -855,11 +1905,32 @@ protected:
      */
     bool vars_loaded;
 
+    /*
+     * The runs of the variable image read from the DSP.
+     */
+    param::image::runs var_image_reads;
+
     /*
      * Control CS shadow, it is a write-only register
      */
     hw::word cfg_ctrlcs;
 
+    /*
+     * Parameter write batch. The deferred control tasks are run when the
+     * outer batch has been written. Only valid with the module lock held.
+     */
+    size_t batch_depth;
+    bool batch_program_fippi;
+    bool batch_set_dacs;
+
+    /*
+     * Staged parameter writes. The control tasks are deferred until the
+     * commit.
+     */
+    std::atomic_bool staging;
+    bool staged_program_fippi;
+    bool staged_set_dacs;
+
     /*
      * PCI bus. The type is opaque.
      */
@@ -884,7 +1955,7 @@ inline hw::word module::read_word(int reg) {
     if (have_hardware) {
         value = hw::read_word(vmaddr, reg);
     } else {
-        value = 0;
+        value = no_hw_read_word(reg);
     }
     if (reg_trace) {
         trace_reg('r', " => ", vmaddr, reg, value);
@@ -898,6 +1969,8 @@ inline void module::write_word(int reg, const hw::word value) {
     }
     if (have_hardware) {
         hw::write_word(vmaddr, reg, value);
+    } else {
+        no_hw_write_word(reg, value);
     }
 }
 
@@ -922,6 +1995,21 @@ typedef std::shared_ptr<module> module_ptr;
  */
 typedef std::vector<module_ptr> modules;
 
+/**
+ * Scan the bus for the module devices and cache the devices' keys in
+ * device number order. A cached key holds the device's PCI domain, bus and
+ * slot so a module opens its device without searching for it. A crate
+ * rescans on each initialization, a scan without a rescan returns the
+ * cached scan if there is one. Returns the number of devices found. An
+ * empty scan is not cached.
+ */
+size_t device_scan(bool rescan = false);
+
+/**
+ * Clear the cached device scan. The next open searches for its device.
+ */
+void device_scan_reset();
+
 /**
  * Assign the number to the slots in the rack.
  */
@@ -0,0 +1,226 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2022 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file pipeline.hpp
+ * @brief Defines a pipeline that decodes modules' list-mode data.
+ */
+
+#ifndef PIXIE_PIPELINE_H
+#define PIXIE_PIPELINE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <pixie/sync.hpp>
+#include <pixie/util.hpp>
+
+#include <pixie/data/list_mode.hpp>
+
+#include <pixie/pixie16/recorder.hpp>
+
+namespace xia {
+namespace pixie {
+/**
+ * @brief Decodes the list-mode data of modules on a pool of workers.
+ *
+ * The readout thread takes the buffers queued by the FIFO workers,
+ * stitches each module's partial event at the end of a read to its next
+ * read and splits the complete events into chunks. The decode workers
+ * decode the chunks into event batches and the consumer is called with a
+ * module's batches in the order of the module's data. The readout, the
+ * decode and the consumer overlap.
+ */
+namespace pipeline {
+/**
+ * @brief The pipeline's configuration.
+ */
+struct config {
+    /*
+     * The number of decode workers, 0 is the hardware concurrency.
+     */
+    size_t workers;
+    /*
+     * The minimum size of a chunk of complete events a worker decodes.
+     */
+    size_t chunk_words;
+    /*
+     * The maximum number of chunks queued or decoded and not consumed.
+     * The readout waits when the limit is reached so a slow consumer
+     * holds the data in the modules' queues.
+     */
+    size_t max_chunks;
+    /*
+     * The scan fields decoded into the batches.
+     */
+    uint32_t fields;
+    /*
+     * The calibration applied to the decoded events. It is shared by the
+     * workers and must outlive the pipeline.
+     */
+    const data::list_mode::calibration* calib;
+    /*
+     * The period the modules are polled for data.
+     */
+    size_t poll_msecs;
+
+    config();
+};
+
+/**
+ * @brief A decoded chunk of a module's data.
+ */
+struct batch {
+    /*
+     * The source's module number and the chunk's sequence in the module's
+     * data.
+     */
+    int number;
+    size_t sequence;
+    data::list_mode::event_batch events;
+
+    batch();
+};
+
+/**
+ * @brief The consumer of the batches. A module's batches are consumed in
+ * order one at a time. The batches of different modules can be consumed
+ * concurrently from different workers.
+ */
+typedef std::function<void(batch& batch_)> consumer;
+
+/**
+ * @brief Decodes the sources' list-mode data. Start the pipeline before
+ * the run starts and stop it after the run has ended. Stopping decodes
+ * and consumes the remaining data.
+ */
+class pipeline {
+public:
+    pipeline(const recorder::sources& sources, const config& cfg, consumer consume);
+    ~pipeline();
+
+    void start();
+    void stop();
+    bool running() const {
+        return running_.load();
+    }
+
+    /*
+     * Read the sources' queued data and queue the chunks. The thread calls
+     * this each period. It can be called when the thread is not running.
+     * Returns the number of words read.
+     */
+    size_t poll();
+
+    /*
+     * Wait until the queued chunks have been decoded and consumed.
+     */
+    void flush();
+
+    /*
+     * The words read, the complete event words decoded, the batches and
+     * events consumed and the errors.
+     */
+    size_t words() const {
+        return words_.load();
+    }
+    size_t decoded_words() const {
+        return decoded_words_.load();
+    }
+    size_t batches() const {
+        return batches_.load();
+    }
+    size_t events() const {
+        return events_.load();
+    }
+    size_t errors() const {
+        return errors_.load();
+    }
+
+    /*
+     * The words of partial events waiting for the rest of their event.
+     */
+    size_t leftovers() const;
+
+    const config cfg;
+
+private:
+    typedef std::unique_ptr<batch> batch_ptr;
+
+    /*
+     * A source's stitching and ordering state. A decoded batch that is
+     * not the next in sequence is held until the batches before it have
+     * been consumed.
+     */
+    struct stream {
+        recorder::source src;
+        data::list_mode::buffer leftovers;
+        size_t next_sequence;
+        std::mutex lock;
+        size_t next_consume;
+        std::map<size_t, batch_ptr> done;
+        stream(const recorder::source& src_);
+    };
+    typedef std::unique_ptr<stream> stream_ptr;
+
+    void queue(stream& strm, data::list_mode::buffer& chunk);
+    void decode(stream& strm, size_t sequence, data::list_mode::buffer& chunk);
+    void consume(stream& strm, size_t sequence, batch_ptr decoded);
+    batch_ptr get_batch();
+    void put_batch(batch_ptr b);
+    void worker();
+
+    std::vector<stream_ptr> streams;
+    consumer consume_;
+    util::thread_pool workers;
+    size_t next_worker;
+
+    /*
+     * Held by a poll.
+     */
+    std::mutex poll_lock;
+
+    /*
+     * The chunks in flight and the batches for reuse.
+     */
+    std::mutex chunks_lock;
+    std::condition_variable chunks_wake;
+    size_t chunks;
+    std::vector<batch_ptr> free_batches;
+
+    std::thread thread;
+    sync::variable::lock_type period_lock;
+    sync::variable period_wake;
+
+    std::atomic_bool running_;
+    std::atomic_size_t words_;
+    std::atomic_size_t decoded_words_;
+    std::atomic_size_t batches_;
+    std::atomic_size_t events_;
+    std::atomic_size_t errors_;
+};
+}  // namespace pipeline
+}  // namespace pixie
+}  // namespace xia
+
+#endif  // PIXIE_PIPELINE_H
@@ -0,0 +1,253 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2022 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file recorder.hpp
+ * @brief Defines a recorder that writes modules' list-mode data to disk.
+ */
+
+#ifndef PIXIE_RECORDER_H
+#define PIXIE_RECORDER_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pixie/buffer.hpp>
+#include <pixie/sync.hpp>
+#include <pixie/util.hpp>
+
+#include <pixie/pixie16/lmc.hpp>
+#include <pixie/pixie16/module.hpp>
+
+namespace xia {
+namespace pixie {
+/**
+ * @brief Records the list-mode data of modules to files.
+ */
+namespace recorder {
+/**
+ * @brief The size of a file's header. The header is a nul padded JSON
+ * object with the run's metadata. The data follows the header.
+ */
+static constexpr size_t header_size = 4096;
+
+/**
+ * @brief A merged file's block header. Each block of a module's data is
+ * preceded by the magic word, the module number, the number of data words
+ * and a reserved word.
+ */
+static constexpr hw::word block_magic = 0x424d4c58; /* "XLMB" */
+static constexpr size_t block_header_words = 4;
+
+/**
+ * @brief The recorder's configuration.
+ */
+struct config {
+    /*
+     * The base path of the files. A module's files are named
+     * `<path>-<module>-<sequence>.lmd` and merged files are named
+     * `<path>-<sequence>.lmd`. The sequence starts at 0 and is incremented
+     * when a file rotates.
+     */
+    std::string path;
+    /*
+     * Write all modules to one merged file of blocks.
+     */
+    bool merged;
+    /*
+     * Rotate a file when its size or age reaches the limit. A limit of 0
+     * does not rotate. A module's file rotates at a buffer boundary so a
+     * list-mode record can span files.
+     */
+    size_t rotate_bytes;
+    size_t rotate_secs;
+    /*
+     * Write with direct I/O bypassing the page cache. The data is staged
+     * in aligned blocks. If the file system does not support direct I/O
+     * the file is written through the page cache.
+     */
+    bool direct;
+    /*
+     * Write compressed list-mode container files, see `lmc`. The files
+     * are named `.lmc` and a merged file holds each module's blocks. The
+     * block size is the number of a module's data words in a block.
+     */
+    bool compressed;
+    size_t block_words;
+    /*
+     * The period the modules are polled for data.
+     */
+    size_t poll_msecs;
+    /*
+     * User metadata added to each header as a string.
+     */
+    std::string metadata;
+
+    config();
+};
+
+/**
+ * @brief A source of list-mode data, typically a module.
+ */
+struct source {
+    /*
+     * Read the queued buffers. Returns the number of words read.
+     */
+    typedef std::function<size_t(buffer::queue::handles& buffers)> reader;
+    /*
+     * Return buffers read and not written to the front of the source.
+     * A source without one cannot take buffers back.
+     */
+    typedef std::function<void(buffer::queue::handles& buffers)> requeuer;
+
+    int number;
+    int slot;
+    int serial_num;
+    int revision;
+    int adc_bits;
+    int adc_msps;
+    /*
+     * The reduction of the source's data. The trace regions of interest
+     * are written to the header so a reduced trace can be expanded.
+     */
+    data::list_mode::reduction reduction;
+    reader read;
+    requeuer requeue;
+
+    source();
+};
+
+typedef std::vector<source> sources;
+
+/**
+ * @brief A module's list-mode data source.
+ */
+source module_source(module::module& module);
+
+/**
+ * @brief A module's list-mode data source read from a consumer of the
+ * module's fan-out. The source holds the consumer so the recorder, a
+ * server and other sources of the module each read all the data. The
+ * consumer cannot take buffers back.
+ * @see xia::pixie::module::module::tee_list_mode
+ */
+source module_source(module::module& module, buffer::fanout& tee);
+
+/**
+ * @brief Records the sources' list-mode data. The recorder thread takes
+ * the buffers queued by the FIFO workers and writes them to the files.
+ * There is no user copy of the data unless the data is staged for direct
+ * I/O.
+ *
+ * Start the recorder before the run starts and stop it after the run has
+ * ended. Stopping writes the data queued when it is stopped and closes the
+ * files.
+ *
+ * If a write fails the buffers not written are returned to their source
+ * and the file is closed. The next poll writes them to a new file. If the
+ * source cannot take the buffers back the recorder stops.
+ */
+class recorder {
+public:
+    recorder(const sources& sources, const config& cfg);
+    ~recorder();
+
+    void start();
+    void stop();
+    bool running() const {
+        return running_.load();
+    }
+
+    /*
+     * Write the sources' queued data. The thread calls this each period.
+     * It can be called when the thread is not running. Returns the number
+     * of words written. Throws if a write fails.
+     */
+    size_t poll();
+
+    /*
+     * The bytes of data written excluding the headers, the number of files
+     * opened and the number of errors in the thread.
+     */
+    size_t bytes() const {
+        return bytes_.load();
+    }
+    size_t files() const {
+        return files_.load();
+    }
+    size_t errors() const {
+        return errors_.load();
+    }
+
+    /*
+     * The names of the files opened.
+     */
+    util::strings names();
+
+    const config cfg;
+
+private:
+    class file;
+    typedef std::unique_ptr<file> file_ptr;
+
+    typedef std::unique_ptr<lmc::writer> container_ptr;
+
+    struct output {
+        int number;
+        size_t sequence;
+        size_t header_bytes;
+        file_ptr out;
+        container_ptr container;
+        output();
+        output(output&&);
+        ~output();
+    };
+
+    void open(output& out);
+    void close(output& out);
+    void rotate(output& out);
+    void abandon(output& out);
+    std::string header(const output& out);
+    void worker();
+
+    sources srcs;
+    std::vector<output> outputs;
+
+    /*
+     * Held by a poll.
+     */
+    sync::variable::lock_type lock;
+    util::strings names_;
+
+    std::thread thread;
+    sync::variable::lock_type period_lock;
+    sync::variable period_wake;
+
+    std::atomic_bool running_;
+    std::atomic_size_t bytes_;
+    std::atomic_size_t files_;
+    std::atomic_size_t errors_;
+};
+}  // namespace recorder
+}  // namespace pixie
+}  // namespace xia
+
+#endif  // PIXIE_RECORDER_H
@@ -0,0 +1,170 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file reglist.hpp
+ * @brief Defines register command lists for fixed sequences of bus accesses.
+ */
+
+#ifndef PIXIE_HW_REGLIST_H
+#define PIXIE_HW_REGLIST_H
+
+#include <atomic>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#include <pixie/error.hpp>
+
+#include <pixie/pixie16/hw.hpp>
+
+namespace xia {
+namespace pixie {
+namespace module {
+class module;
+}
+namespace hw {
+/**
+ * @brief Register command lists.
+ *
+ * Many hardware sequences are a fixed chain of register reads and writes,
+ * for example the setup of a DSP DMA transfer. A list is built once and
+ * validated when it is built. Running a list makes the accesses under a
+ * single bus guard, traces the list as one entry rather than a trace for
+ * each access and times each run. A value that changes for each run, such
+ * as an address or a length, is a parameter of the run.
+ */
+namespace reglist {
+/**
+ * @brief The operations of a command.
+ */
+enum struct op {
+    write,       /* Write the value */
+    write_param, /* Write the run's parameter */
+    read,        /* Read into the run's results */
+    set_bits,    /* Read, set the mask's bits and write */
+    clear_bits,  /* Read, clear the mask's bits and write */
+    expect       /* Read and throw if the masked value is not the value */
+};
+
+/**
+ * @brief A register command.
+ */
+struct command {
+    op operation;
+    int reg;
+    word value;
+    word mask;
+    size_t param;
+    error::code code;
+    const char* what;
+
+    command();
+};
+
+typedef std::vector<command> commands;
+
+/*
+ * Command builders.
+ */
+command write(int reg, word value);
+command write_param(int reg, size_t param);
+command read(int reg);
+command set_bits(int reg, word mask);
+command clear_bits(int reg, word mask);
+command expect(int reg, word mask, word value, error::code code, const char* what);
+
+/**
+ * @brief The run times of a list.
+ */
+struct timing {
+    size_t runs;
+    size_t total_nsecs;
+    size_t max_nsecs;
+
+    timing();
+
+    double mean_nsecs() const;
+};
+
+/**
+ * @brief A register command list. A list can be run by many threads on
+ * many modules.
+ */
+class list {
+public:
+    /**
+     * @throws xia::pixie::error::error if a command is not valid.
+     */
+    list(const std::string& name, std::initializer_list<command> cmds);
+    list(const std::string& name, const commands& cmds);
+
+    list(const list&) = delete;
+    list& operator=(const list&) = delete;
+
+    /**
+     * @brief Run the list holding the module's bus.
+     *
+     * @param module The module to access.
+     * @param params The parameters of the `write_param` commands.
+     * @param results The values read by the `read` commands in the order
+     *  of the commands. Can be null if the list has no reads.
+     * @throws xia::pixie::error::error if there are not enough parameters,
+     *  there are reads and no results or an `expect` command fails.
+     */
+    void run(module::module& module, std::initializer_list<word> params = {},
+             word* results = nullptr);
+
+    /*
+     * Run the list when the caller holds the module's bus.
+     */
+    void run_held(module::module& module, std::initializer_list<word> params = {},
+                  word* results = nullptr);
+
+    size_t size() const {
+        return cmds.size();
+    }
+    size_t params() const {
+        return num_params;
+    }
+    size_t reads() const {
+        return num_reads;
+    }
+
+    timing times() const;
+    void times_reset();
+
+    const std::string name;
+
+private:
+    void validate();
+    void trace(module::module& module, const words& values) const;
+
+    const commands cmds;
+    size_t num_params;
+    size_t num_reads;
+
+    std::atomic_size_t runs;
+    std::atomic_size_t total_nsecs;
+    std::atomic_size_t max_nsecs;
+};
+}  // namespace reglist
+}  // namespace hw
+}  // namespace pixie
+}  // namespace xia
+
+#endif  // PIXIE_HW_REGLIST_H
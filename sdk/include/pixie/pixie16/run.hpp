@@ -23,7 +23,9 @@
 #ifndef PIXIE_HW_RUN_H
 #define PIXIE_HW_RUN_H
 
+#include <array>
 #include <cstdint>
+#include <mutex>
 
 #include <pixie/pixie16/hw.hpp>
 
@@ -209,6 +211,11 @@ enum struct control_task {
     nop = 100
 };
 
+/**
+ * @brief The number of control task numbers. The last task is `reset_adc`.
+ */
+static const size_t control_tasks = size_t(control_task::reset_adc) + 1;
+
 /**
  * @brief Module run and control task configuration
  *
@@ -244,13 +251,83 @@ struct module_config {
  */
 module_config make(module::module& module);
 
+/**
+ * @brief A task's completion latency.
+ *
+ * A task's completion is detected by polling the CSR. The poll spins for a
+ * short task, waits until most of the task's expected duration has passed
+ * then polls with an exponential back-off so a task is not rounded up to
+ * the poll period. The expected duration starts from a table of typical
+ * durations and follows the measured durations.
+ */
+struct task_latency {
+    size_t count; /* Tasks completed */
+    size_t last_usecs; /* Duration of the last task */
+    size_t min_usecs; /* Shortest task */
+    size_t max_usecs; /* Longest task */
+    size_t total_usecs; /* Total duration of the tasks */
+    size_t last_polls; /* CSR polls of the last task */
+    size_t expected_usecs; /* Expected duration of the next task */
+
+    task_latency(size_t expected_usecs = 0);
+
+    void record(size_t usecs, size_t polls);
+};
+
+/**
+ * @brief The completion latency of a module's control tasks and run ends.
+ */
+class latencies {
+public:
+    latencies();
+    latencies(const latencies& l);
+    latencies& operator=(const latencies& l);
+
+    /*
+     * A control task's latency. The `nop` task is the run end.
+     */
+    task_latency get(control_task task) const;
+    void record(control_task task, size_t usecs, size_t polls);
+    size_t expected_usecs(control_task task) const;
+    void clear();
+
+private:
+    /*
+     * A slot for each control task number and a slot for the run end.
+     */
+    static const size_t run_end_slot = control_tasks;
+    static const size_t slots = control_tasks + 1;
+    typedef std::array<task_latency, slots> task_latencies;
+
+    static size_t index(control_task task);
+
+    mutable std::mutex lock;
+    task_latencies tasks;
+};
+
+/**
+ * @brief The control task label.
+ */
+const char* control_task_label(control_task task);
+
 /*
- * Run and control task management.
+ * Run and control task management. A start prepares the task then enables
+ * it. A task can be prepared and enabled later so the modules of a crate are
+ * enabled together.
  */
 void start(module::module& module, run_mode mode, run_task run_tsk, control_task control_tsk);
+void prepare(module::module& module, run_mode mode, run_task run_tsk, control_task control_tsk);
+void enable(module::module& module);
 void end(module::module& module);
 bool active(module::module& module);
 
+/*
+ * Request the active run to stop without waiting for it to end. The run
+ * leader's stop ends the runs of the modules in sync wait mode. Call end()
+ * to wait for the run to end.
+ */
+void stop(module::module& module);
+
 /**
  * @brief Execute a control task in a specific module
  * @param module The module to work with
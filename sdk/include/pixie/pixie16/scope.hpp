@@ -0,0 +1,193 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file scope.hpp
+ * @brief Defines a continuous oscilloscope that streams a module's ADC traces.
+ */
+
+#ifndef PIXIE_SCOPE_H
+#define PIXIE_SCOPE_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <pixie/sync.hpp>
+
+#include <pixie/pixie16/channel.hpp>
+#include <pixie/pixie16/hw.hpp>
+#include <pixie/pixie16/module.hpp>
+
+namespace xia {
+namespace pixie {
+/**
+ * @brief Streams a module's ADC traces in the background.
+ *
+ * A scope's thread repeatedly acquires the ADC traces of its channels and
+ * keeps a ring of the latest traces of each channel. Readers, for example
+ * a GUI, take the newest trace of a channel without a lock and without
+ * waiting for the control task. The module lock is only held for each
+ * acquisition so control calls are made between acquisitions. Run a scope
+ * for each module of a crate to view all the channels.
+ */
+namespace scope {
+/**
+ * @brief The clock of the traces' times.
+ */
+typedef std::chrono::steady_clock clock;
+
+/**
+ * @brief The scope's configuration.
+ */
+struct config {
+    /*
+     * The channels streamed. Empty is all the module's channels.
+     */
+    channel::range channels;
+    /*
+     * The number of traces kept for each channel.
+     */
+    size_t depth;
+    /*
+     * The trace length in samples. 0 is the channel's maximum.
+     */
+    size_t length;
+    /*
+     * The minimum period between acquisitions. 0 acquires as fast as the
+     * module allows.
+     */
+    size_t period_msecs;
+
+    config();
+};
+
+/**
+ * @brief A channel's trace. The sequence is the number of the acquisition,
+ * the first is 1.
+ */
+struct frame {
+    size_t sequence;
+    clock::time_point time;
+    hw::adc_trace samples;
+
+    frame();
+};
+
+typedef std::vector<frame> frames;
+
+/**
+ * @brief A module's oscilloscope. The acquisitions are paused while the
+ * module runs a list-mode or histogram run.
+ */
+class scope {
+public:
+    scope(module::module& module, const config& cfg);
+    ~scope();
+
+    scope(const scope&) = delete;
+    scope& operator=(const scope&) = delete;
+
+    void start();
+    void stop();
+    bool running() const {
+        return running_.load();
+    }
+
+    /*
+     * Acquire and publish the traces once. The thread calls this. It can
+     * be called when the thread is not running. Returns false if the
+     * module is running and the acquisition is skipped.
+     */
+    bool acquire();
+
+    /*
+     * Copy a channel's newest trace. Returns false if there is no trace.
+     * Readers do not block the thread and the thread does not wait for
+     * readers.
+     */
+    bool latest(size_t channel, frame& out) const;
+
+    /*
+     * Copy a channel's traces newest first. A trace overwritten while it
+     * is copied is left out. Returns the number of traces.
+     */
+    size_t history(size_t channel, frames& out) const;
+
+    /*
+     * The number of acquisitions and the number that failed.
+     */
+    size_t sequence() const {
+        return sequence_.load();
+    }
+    size_t errors() const {
+        return errors_.load();
+    }
+
+    const config cfg;
+
+private:
+    /*
+     * A ring slot. The sequence is 0 while the slot is written so a reader
+     * can detect a trace that changed while it was copied.
+     */
+    struct slot {
+        std::atomic_size_t sequence;
+        clock::time_point time;
+        hw::adc_trace samples;
+        slot();
+    };
+
+    struct channel_ring {
+        size_t number;
+        std::atomic_size_t latest;
+        std::unique_ptr<slot[]> slots;
+        channel_ring();
+    };
+    typedef std::unique_ptr<channel_ring> channel_ring_ptr;
+
+    const channel_ring& ring(size_t channel) const;
+    bool copy(const channel_ring& chan, size_t seq, frame& out) const;
+    void publish(channel_ring& chan, size_t seq, clock::time_point time,
+                 const hw::adc_trace& trace);
+    void worker();
+
+    module::module& module_;
+    channel::range channels;
+    std::vector<channel_ring_ptr> rings;
+    hw::adc_traces traces;
+
+    /*
+     * Held by an acquisition.
+     */
+    sync::variable::lock_type lock;
+
+    std::thread thread;
+    sync::variable::lock_type period_lock;
+    sync::variable period_wake;
+
+    std::atomic_bool running_;
+    std::atomic_size_t sequence_;
+    std::atomic_size_t errors_;
+};
+}  // namespace scope
+}  // namespace pixie
+}  // namespace xia
+
+#endif  // PIXIE_SCOPE_H
@@ -0,0 +1,263 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file server.hpp
+ * @brief Defines a network server that streams modules' list-mode data.
+ */
+
+#ifndef PIXIE_SERVER_H
+#define PIXIE_SERVER_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pixie/buffer.hpp>
+#include <pixie/sync.hpp>
+
+#include <pixie/pixie16/recorder.hpp>
+
+namespace xia {
+namespace pixie {
+/**
+ * @brief Streams the list-mode data of modules to TCP clients and a UDP
+ * multicast group.
+ */
+namespace server {
+/**
+ * @brief A frame's header. Each buffer read from a module is sent as a
+ * frame of the header and the data words. A TCP frame holds a complete
+ * buffer, a UDP datagram holds a fragment of a buffer at the word offset.
+ * The CRC32 is of the buffer's data and is 0 if the server does not
+ * compute it. The fields are in the host's byte order.
+ */
+struct frame_header {
+    uint32_t magic;
+    uint16_t module;
+    uint16_t slot;
+    /*
+     * The module's buffer sequence number, it starts at 0 for each module.
+     */
+    uint64_t sequence;
+    uint32_t words;
+    uint32_t offset;
+    uint32_t count;
+    uint32_t crc;
+};
+
+static_assert(sizeof(frame_header) == 32, "frame header size");
+
+static constexpr uint32_t frame_magic = 0x534d4c58; /* "XLMS" */
+
+/**
+ * @brief The server's configuration.
+ */
+struct config {
+    /*
+     * The TCP port clients connect to. A port of 0 picks a free port and
+     * a port of -1 does not accept clients. The address is the local
+     * address to bind to, empty binds all addresses.
+     */
+    int port;
+    std::string address;
+    size_t max_clients;
+    /*
+     * A client that cannot take the data within the timeout is
+     * disconnected so it does not stop the other clients.
+     */
+    size_t send_timeout_msecs;
+    /*
+     * Send with MSG_ZEROCOPY where the kernel supports it. The buffers are
+     * held until the kernel has sent them so the module's FIFO pool needs
+     * buffers to cover the data in flight.
+     */
+    bool zerocopy;
+    /*
+     * The multicast group and port the data is sent to. An empty group
+     * does not send to a group. The interface is the local address of the
+     * interface to send on, empty uses the default interface. The datagram
+     * size includes the frame header.
+     */
+    std::string group;
+    int group_port;
+    int group_ttl;
+    std::string group_interface;
+    size_t datagram_bytes;
+    /*
+     * The maximum number of frames sent with one call.
+     */
+    size_t batch_frames;
+    /*
+     * Compute the CRC32 of each buffer.
+     */
+    bool crc;
+    /*
+     * The period the modules are polled for data.
+     */
+    size_t poll_msecs;
+
+    config();
+};
+
+/**
+ * @brief Serves the sources' list-mode data. The server thread takes the
+ * buffers queued by the FIFO workers and sends them to each client in
+ * large batches with a single `sendmsg` call and to the multicast group
+ * with `sendmmsg`. The clients only receive. A client sees the data read
+ * after it connected.
+ *
+ * The server is not supported on Windows.
+ */
+class server {
+public:
+    server(const recorder::sources& sources, const config& cfg);
+    ~server();
+
+    void start();
+    void stop();
+    bool running() const {
+        return running_.load();
+    }
+
+    /*
+     * Accept new clients and send the sources' queued data. The thread
+     * calls this each period. It can be called when the thread is not
+     * running. Returns the number of words read.
+     */
+    size_t poll();
+
+    /*
+     * The bound TCP port.
+     */
+    int port() const {
+        return port_;
+    }
+
+    /*
+     * The number of clients, the clients disconnected on an error, the
+     * bytes sent to the clients and the group and the errors.
+     */
+    size_t clients() const {
+        return clients_.load();
+    }
+    size_t dropped() const {
+        return dropped_.load();
+    }
+    size_t bytes() const {
+        return bytes_.load();
+    }
+    size_t errors() const {
+        return errors_.load();
+    }
+
+    /*
+     * The number of buffers read from a source. It is the sequence number
+     * of the source's next frame.
+     */
+    uint64_t frames(size_t source);
+
+    const config cfg;
+
+private:
+    struct batch;
+    typedef std::shared_ptr<batch> batch_ptr;
+
+    struct client {
+        int fd;
+        std::string peer;
+        bool zerocopy;
+        /*
+         * The zero copy sends not completed and their batches.
+         */
+        uint32_t next_send;
+        std::deque<std::pair<uint32_t, batch_ptr>> in_flight;
+        client();
+    };
+
+    void listen();
+    void accept();
+    bool send(client& cl, const batch_ptr& frames);
+    void complete(client& cl, bool wait);
+    void disconnect(client& cl);
+    void multicast(const batch& frames);
+    void worker();
+
+    recorder::sources srcs;
+    std::vector<uint64_t> sequences;
+
+    int listen_fd;
+    int port_;
+    std::vector<client> connections;
+    int group_fd;
+    std::vector<uint8_t> group_addr;
+
+    /*
+     * Held by a poll.
+     */
+    sync::variable::lock_type lock;
+
+    std::thread thread;
+    sync::variable::lock_type period_lock;
+    sync::variable period_wake;
+
+    std::atomic_bool running_;
+    std::atomic_size_t clients_;
+    std::atomic_size_t dropped_;
+    std::atomic_size_t bytes_;
+    std::atomic_size_t errors_;
+};
+
+/**
+ * @brief A TCP client of a server. Use this to receive the data in an event
+ * builder or a monitor.
+ */
+class client {
+public:
+    client(const std::string& host, int port);
+    ~client();
+
+    client(const client&) = delete;
+    client& operator=(const client&) = delete;
+
+    /*
+     * Receive the next frame. Returns false if the server closed the
+     * connection.
+     * @throws xia::pixie::error::error if the frame is not valid.
+     */
+    bool receive(frame_header& header, hw::words& words);
+
+    /*
+     * Shut the connection down. A receive blocked in another thread
+     * returns false.
+     */
+    void shutdown();
+
+private:
+    bool read(void* data, size_t size);
+
+    int fd;
+};
+}  // namespace server
+}  // namespace pixie
+}  // namespace xia
+
+#endif  // PIXIE_SERVER_H
@@ -23,10 +23,16 @@
 #ifndef PIXIE_SDK_SYSTEM_SIMULATION_HPP
 #define PIXIE_SDK_SYSTEM_SIMULATION_HPP
 
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <mutex>
+#include <random>
+#include <vector>
 
 #include <pixie/error.hpp>
 
+#include <pixie/pixie16/capture.hpp>
 #include <pixie/pixie16/crate.hpp>
 #include <pixie/pixie16/module.hpp>
 
@@ -38,6 +44,181 @@ namespace pixie {
 namespace sim {
 typedef xia::pixie::error::error error;
 
+/**
+ * @brief The events a channel generates.
+ */
+struct channel_events {
+    /*
+     * The event rate in counts per second. A rate of 0 disables the
+     * channel.
+     */
+    double rate;
+    /*
+     * The mean energy and its standard deviation.
+     */
+    double energy;
+    double energy_sigma;
+    /*
+     * The trace length in samples. The length is rounded down to an even
+     * number of samples.
+     */
+    size_t trace_length;
+
+    channel_events();
+};
+
+/**
+ * @brief The configuration of a simulated module's list-mode data.
+ */
+struct generator_config {
+    /*
+     * The header length in words. Must be a list-mode header variant.
+     */
+    size_t header_length;
+    /*
+     * The channels' events. A single entry is used for all channels. No
+     * entries disables the generator.
+     */
+    std::vector<channel_events> channels;
+    /*
+     * An event on a channel that follows the channel's previous event
+     * within the pile-up period is flagged as piled up. A period of 0
+     * disables pile-up.
+     */
+    size_t pileup_ns;
+    /*
+     * The seed of the random number generator.
+     */
+    unsigned int seed;
+
+    generator_config();
+
+    bool enabled() const {
+        return !channels.empty();
+    }
+};
+
+/**
+ * @brief Generates a module's list-mode data into a simulated external
+ * FIFO. Events are generated in time order from the start of the run at
+ * the configured rates as the FIFO level is read. An event that does not
+ * fit in the FIFO is lost.
+ *
+ * The records have the header layout of firmware revision 34688. Modules
+ * with more than 16 channels use the layout of revision 46540.
+ */
+class generator {
+public:
+    generator();
+
+    void configure(const generator_config& config, int slot, size_t num_channels,
+                   int adc_msps);
+    bool enabled();
+
+    /*
+     * Start and stop the run. The data in the FIFO can be read after the
+     * run has stopped.
+     */
+    void start();
+    void stop();
+    bool running();
+
+    /*
+     * The FIFO level in words. Generates the events due.
+     */
+    size_t level();
+    /*
+     * Read words from the FIFO. Reading more than the level fills the rest
+     * with 0.
+     */
+    void read(hw::word_ptr values, const size_t size);
+
+    /*
+     * The number of events generated, lost to a full FIFO and piled up.
+     */
+    std::atomic_size_t events;
+    std::atomic_size_t lost;
+    std::atomic_size_t pileups;
+
+private:
+    typedef std::chrono::steady_clock clock;
+
+    struct channel_state {
+        channel_events events;
+        uint64_t next;
+        uint64_t last;
+        bool first;
+        hw::words trace;
+    };
+
+    void generate();
+    void encode(size_t channel, uint64_t time, bool pileup);
+    void push(const hw::word* values, const size_t size);
+    uint64_t interval(double rate);
+
+    std::mutex lock;
+    generator_config config;
+    std::vector<channel_state> channels;
+    int slot;
+    bool wide_layout;
+    double tick_ns;
+    bool running_;
+    clock::time_point started;
+    std::mt19937 random;
+    hw::words record;
+    hw::words fifo;
+    size_t head;
+    size_t count;
+};
+
+/**
+ * @brief Replays a capture of a module's DMA transfers into a simulated
+ * external FIFO. The FIFO level is the rest of the next chunk so the FIFO
+ * worker reads the chunks as they were captured.
+ *
+ * A timed replay makes each chunk available at its captured time from the
+ * start of the run, otherwise the chunks are available as fast as they
+ * are read. The run is no longer active once the last chunk is read.
+ */
+class replay {
+public:
+    replay();
+
+    /*
+     * Load the capture. The chunks are held in memory so reading the file
+     * does not change the timing.
+     */
+    void load(const std::string& path, bool timed);
+    void unload();
+    bool enabled();
+
+    void start();
+    void stop();
+    bool running();
+
+    size_t level();
+    void read(hw::word_ptr values, const size_t size);
+
+    /*
+     * The chunks and words replayed.
+     */
+    std::atomic_size_t chunks;
+    std::atomic_size_t words;
+
+    capture::header hdr;
+
+private:
+    typedef std::chrono::steady_clock clock;
+
+    std::mutex lock;
+    std::vector<capture::chunk> data;
+    bool timed;
+    bool running_;
+    clock::time_point started;
+    size_t next;
+    size_t offset;
+};
+
 /**
  * @brief A Simulated a module derived from the module class.
  */
@@ -57,11 +238,36 @@ public:
     void initialize() override;
     void init_values() override;
 
+    using xia::pixie::module::module::dma_read;
+    void dma_read(const hw::address source, hw::word_ptr values, const size_t size) override;
+
+    /*
+     * Generate list-mode data. The data is generated into the FIFO during
+     * a list-mode run and read by the FIFO worker. The FIFO services are
+     * started if the module is online.
+     */
+    void set_generator(const generator_config& config);
+
+    /*
+     * Replay a capture of a module's DMA transfers in place of the
+     * generator during a list-mode run. The FIFO services are started if
+     * the module is online.
+     */
+    void set_replay(const std::string& path, bool timed = true);
+    void clear_replay();
+
     void load_var_defaults(const std::string& file);
     void load_var_defaults(std::istream& input);
 
     std::unique_ptr<uint8_t[]> pci_memory;
     std::string var_defaults;
+    generator_config gen_config;
+    generator gen;
+    replay replayer;
+
+protected:
+    hw::word no_hw_read_word(int reg) override;
+    void no_hw_write_word(int reg, const hw::word value) override;
 };
 
 /**
@@ -72,6 +278,7 @@ public:
     typedef xia::pixie::crate::error error;
 
     void add_module() override;
+    size_t scan_devices() override;
 };
 
 /**
@@ -88,6 +295,7 @@ struct module_def {
     int adc_msps;
     int adc_clk_div;
     std::string var_defaults;
+    generator_config gen_config;
 
     module_def();
 };
@@ -0,0 +1,155 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2022 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file profile.hpp
+ * @brief Defines a profiler of named code sites.
+ */
+
+#ifndef PIXIE_PROFILE_H
+#define PIXIE_PROFILE_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <pixie/util.hpp>
+
+namespace xia {
+namespace pixie {
+/**
+ * @brief A profiler of named sites, for example a DMA read or a crate's
+ * boot.
+ *
+ * A site's timings are aggregated into the count, the total, the minimum,
+ * the maximum and a histogram of power of 2 bins in nanoseconds. Each
+ * thread has its own aggregates so recording a timing does not lock or
+ * share a cache line. A dump sums the threads' aggregates.
+ *
+ * The profiler is disabled by default and a disabled timer only loads a
+ * flag. Sites with the same name share their aggregates.
+ */
+namespace profile {
+/**
+ * @brief The maximum number of names. Sites after the limit are not
+ * profiled.
+ */
+static constexpr size_t max_sites = 128;
+/**
+ * @brief The histogram bins. Bin `b` holds the timings of `2^(b-1)` to
+ * `2^b - 1` nanoseconds and the last bin holds the longer timings.
+ */
+static constexpr size_t bins = 40;
+
+using clock = std::chrono::steady_clock;
+
+/**
+ * @brief The aggregate of a site.
+ */
+struct stats {
+    std::string name;
+    uint64_t count;
+    uint64_t total_nsecs;
+    uint64_t min_nsecs;
+    uint64_t max_nsecs;
+    std::array<uint64_t, bins> histogram;
+
+    stats();
+
+    double mean_usecs() const;
+    /**
+     * @brief The upper bound of the histogram bin with a percentile, for
+     * example 0.99. The bound is limited to the maximum.
+     */
+    uint64_t percentile_nsecs(const double percentile) const;
+};
+
+using stats_list = std::vector<stats>;
+
+/**
+ * @brief A named site. A site is typically a function local static.
+ */
+class site {
+public:
+    explicit site(const char* name);
+
+    void record(const uint64_t nsecs);
+    /**
+     * @brief Record a timepoint's period.
+     */
+    void record(util::timepoint& tp);
+
+private:
+    size_t index;
+};
+
+/**
+ * @brief Time a scope. The timing is recorded when the timer is stopped or
+ * destroyed. A timer created while the profiler is disabled does nothing.
+ */
+class timer {
+public:
+    explicit timer(site& site__);
+    ~timer();
+
+    void stop();
+
+private:
+    site* site_;
+    clock::time_point start;
+};
+
+/**
+ * @brief Enable or disable the profiler.
+ */
+void enable(const bool on = true);
+bool enabled();
+
+/**
+ * @brief Clear the aggregates of all sites and threads.
+ */
+void reset();
+
+/**
+ * @brief The aggregates of the sites that have a timing in the order the
+ * sites were first used.
+ */
+void dump(stats_list& sites);
+
+/**
+ * @brief Output a table of the sites' aggregates.
+ */
+void output(std::ostream& out);
+}  // namespace profile
+}  // namespace pixie
+}  // namespace xia
+
+#define PIXIE_PROFILE_CONCAT_(a, b) a##b
+#define PIXIE_PROFILE_CONCAT(a, b) PIXIE_PROFILE_CONCAT_(a, b)
+
+/**
+ * @brief Time the rest of the scope as a named site.
+ */
+#define PIXIE_PROFILE_SCOPE(name)                                                         \
+    static xia::pixie::profile::site PIXIE_PROFILE_CONCAT(profile_site_, __LINE__)(name); \
+    xia::pixie::profile::timer PIXIE_PROFILE_CONCAT(profile_timer_, __LINE__)(            \
+        PIXIE_PROFILE_CONCAT(profile_site_, __LINE__))
+
+#endif  // PIXIE_PROFILE_H
@@ -0,0 +1,199 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file shm.hpp
+ * @brief Defines a shared memory ring to publish data buffers to other processes
+ */
+
+#ifndef PIXIE_SHM_H
+#define PIXIE_SHM_H
+
+#include <cstdint>
+#include <string>
+
+#include <pixie/buffer.hpp>
+
+namespace xia {
+namespace buffer {
+/**
+ * @brief Publishes data buffers to consumer processes with a ring of fixed
+ * size blocks in POSIX shared memory.
+ *
+ * There is one publisher and up to a configured number of subscribers.
+ * Each block has a sequence number and each subscriber has a cursor in
+ * the shared memory. A subscriber reads a block in place without copying
+ * it and releases it when done.
+ *
+ * A lossy ring never stops the publisher. A subscriber that falls behind
+ * by more than the ring skips the blocks overwritten and counts them as
+ * dropped. A block overwritten while a subscriber is reading it is
+ * detected when it is released. A lossless ring does not overwrite a
+ * block until all the subscribers have released it and publishing fails
+ * when there is no space. The blocks of subscriber processes that have
+ * exited are reclaimed.
+ *
+ * The shared memory is not supported on Windows.
+ */
+namespace shm {
+enum struct policy : uint32_t { lossy, lossless };
+
+/**
+ * @brief A ring's configuration.
+ */
+struct config {
+    /*
+     * The number of blocks and the data words a block holds. A buffer
+     * larger than a block is published in more than one block.
+     */
+    size_t blocks;
+    size_t block_words;
+    /*
+     * The maximum number of subscribers.
+     */
+    size_t subscribers;
+    policy mode;
+
+    config();
+};
+
+/**
+ * @brief A published block being read by a subscriber. The data is in the
+ * shared memory and is valid until the block is released.
+ */
+struct block_view {
+    enum flag_bits : uint32_t {
+        /*
+         * The next block holds more of the buffer.
+         */
+        continued = 1 << 0
+    };
+
+    uint64_t sequence;
+    uint32_t source;
+    uint32_t flags;
+    const buffer_value* data;
+    size_t words;
+
+    block_view();
+};
+
+struct segment;
+
+/**
+ * @brief Creates a ring and publishes buffers to it. Only one thread can
+ * publish. The ring is removed when the publisher is destroyed and the
+ * subscribers attached see it closed.
+ */
+class publisher {
+public:
+    publisher(const std::string& name, const config& cfg = config());
+    ~publisher();
+
+    publisher(const publisher&) = delete;
+    publisher& operator=(const publisher&) = delete;
+
+    /*
+     * Publish a source's data. Returns false if the ring is lossless and
+     * there is no space for all the data, nothing is published.
+     */
+    bool publish(uint32_t source, const buffer_value* data, size_t words);
+
+    /*
+     * Publish the buffers in order removing each one published. This is
+     * the output of a module's data queue. The buffers not published are
+     * left to be published later. Returns the number of words published.
+     */
+    size_t publish(uint32_t source, queue::handles& buffers);
+
+    /*
+     * The blocks that can be published without overwriting a block a
+     * subscriber has not released. A lossy ring always has space.
+     */
+    size_t space();
+
+    /*
+     * Reclaim the subscribers whose processes have exited. Returns the
+     * number reclaimed.
+     */
+    size_t reap();
+
+    /*
+     * The next block's sequence number, the number of subscribers and
+     * the times a lossless ring was full.
+     */
+    uint64_t sequence() const;
+    size_t subscribers() const;
+    size_t full() const {
+        return full_;
+    }
+
+    const std::string name;
+    const config cfg;
+
+private:
+    segment* seg;
+    size_t bytes;
+    size_t full_;
+};
+
+/**
+ * @brief Reads the blocks published to a ring. A subscriber starts with the
+ * next block published. Only one thread can use a subscriber.
+ */
+class subscriber {
+public:
+    explicit subscriber(const std::string& name);
+    ~subscriber();
+
+    subscriber(const subscriber&) = delete;
+    subscriber& operator=(const subscriber&) = delete;
+
+    /*
+     * Read the next block waiting up to `wait_usecs` for one to be
+     * published. Returns false if there is no block. The block must be
+     * released before the next read.
+     */
+    bool read(block_view& view, size_t wait_usecs = 0);
+
+    /*
+     * Release the block read. Returns false if the block was overwritten
+     * while it was being read and the data is not valid.
+     */
+    bool release(const block_view& view);
+
+    /*
+     * The blocks published and not read, the blocks dropped and if the
+     * publisher has closed the ring.
+     */
+    size_t available() const;
+    uint64_t dropped() const;
+    bool closed() const;
+
+    const std::string name;
+    config cfg;
+
+private:
+    segment* seg;
+    size_t bytes;
+    size_t slot;
+};
+}  // namespace shm
+}  // namespace buffer
+}  // namespace xia
+
+#endif  // PIXIE_SHM_H
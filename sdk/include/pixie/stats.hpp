@@ -17,12 +17,16 @@
  */
 
 /** @file stats.hpp
- * @brief Defines functions and data structures related to hardware statistics.
+ * @brief Defines functions and data structures related to hardware statistics
+ * and streaming statistics accumulators.
  */
 
 #ifndef PIXIE_STATS_H
 #define PIXIE_STATS_H
 
+#include <array>
+#include <chrono>
+#include <cstddef>
 #include <vector>
 
 #include <pixie/param.hpp>
@@ -99,6 +103,246 @@ struct stats {
 };
 
 void read(pixie::module::module& module_, stats& stats_);
+
+/**
+ * @brief A channel's statistics over the interval between two reads.
+ *
+ * The counters are the differences of the two reads so the rates are of
+ * the interval and not of the whole run. If the later read's run time is
+ * less than the earlier read's a new run started and the interval is from
+ * the start of the new run.
+ */
+struct channel_interval {
+    double input_counts;
+    double output_counts;
+    /*
+     * The channel's live time and the module's real time in the interval,
+     * units secs.
+     */
+    double live_time;
+    double real_time;
+
+    channel_interval();
+    channel_interval(const channel& from, const channel& to);
+
+    double input_count_rate() const;
+    double output_count_rate() const;
+
+    /*
+     * The fraction of the interval the channel was live.
+     */
+    double live_fraction() const;
+};
+
+typedef std::vector<channel_interval> channel_intervals;
+
+/**
+ * @brief A module's statistics over the interval between two reads.
+ */
+struct interval {
+    uint64_t processed_events;
+    double real_time;
+    channel_intervals chans;
+
+    interval();
+    interval(const stats& from, const stats& to);
+};
+
+typedef std::vector<interval> intervals;
+
+/**
+ * @brief The statistics of a number of modules read at close to the same
+ * instant.
+ *
+ * The time is the mean of the host times each module's read completed and
+ * the skew is the range of those times. The entries are in the order of
+ * the module numbers.
+ */
+struct snapshot {
+    typedef std::chrono::steady_clock clock;
+
+    size_t sequence;
+    clock::time_point time;
+    std::chrono::microseconds skew;
+    std::vector<size_t> numbers;
+    std::vector<stats> modules;
+
+    snapshot();
+
+    /*
+     * The host time between this snapshot and an earlier one, units secs.
+     */
+    double elapsed(const snapshot& earlier) const;
+};
+
+/**
+ * @brief A ring of the most recent snapshots. A snapshot pushed into a full
+ * ring replaces the oldest. The slots are reused so pushing a snapshot does
+ * not allocate once the ring is full. A ring is not thread safe.
+ */
+class snapshots {
+public:
+    explicit snapshots(size_t depth = 16);
+
+    /*
+     * Copy a snapshot into the ring. The snapshot's sequence is set to the
+     * number of snapshots pushed, the first is 1.
+     */
+    void push(snapshot& snap);
+
+    size_t size() const {
+        return count;
+    }
+    size_t depth() const {
+        return slots.size();
+    }
+    bool empty() const {
+        return count == 0;
+    }
+    void clear();
+
+    /*
+     * A snapshot by its age, 0 is the newest.
+     * @throws xia::pixie::error::error if there is no snapshot of that age.
+     */
+    const snapshot& at(size_t age = 0) const;
+
+    /*
+     * The interval statistics of each module between the snapshot of an
+     * age and the newest. The entries are in the order of the newest
+     * snapshot's module numbers.
+     * @throws xia::pixie::error::error if there is no snapshot of that age
+     *  or the snapshots are not of the same modules.
+     */
+    void rates(intervals& out, size_t age = 1) const;
+
+private:
+    std::vector<snapshot> slots;
+    size_t next;
+    size_t count;
+    size_t pushed;
+};
+
+/**
+ * @brief Streaming mean, variance and range of values using Welford's
+ * method. The values are not kept.
+ */
+struct moments {
+    size_t count;
+    double mean;
+    double min;
+    double max;
+
+    moments();
+
+    void clear();
+    void update(double value);
+
+    /*
+     * Merge the moments of other values, for example of another thread.
+     */
+    void merge(const moments& other);
+
+    /*
+     * The sample variance and standard deviation. Zero if there are less
+     * than 2 values.
+     */
+    double variance() const;
+    double stddev() const;
+
+private:
+    double m2;
+};
+
+/**
+ * @brief A streaming quantile estimate using the P-squared algorithm of
+ * Jain and Chlamtac. Five markers are kept whatever the number of values. The
+ * estimate is exact until there are 5 values.
+ */
+struct quantile {
+    double p;
+
+    explicit quantile(double p = 0.5);
+
+    void clear();
+    void update(double value);
+
+    size_t count() const {
+        return count_;
+    }
+
+    double value() const;
+
+private:
+    double parabolic(size_t i, double d) const;
+    double linear(size_t i, int d) const;
+
+    size_t count_;
+    std::array<double, 5> heights;
+    std::array<double, 5> positions;
+    std::array<double, 5> desired;
+    std::array<double, 5> increments;
+};
+
+/**
+ * @brief A histogram of fixed width bins over [low, high). Values outside
+ * the range are counted as underflows and overflows.
+ */
+struct histogram {
+    typedef std::vector<size_t> bins;
+
+    const double low;
+    const double high;
+    const double width;
+
+    bins counts;
+    size_t underflow;
+    size_t overflow;
+    size_t total;
+
+    histogram(double low, double high, size_t num_bins);
+
+    void clear();
+    void update(double value, size_t count = 1);
+
+    /*
+     * The low edge of a bin.
+     */
+    double bin_low(size_t bin) const;
+
+    /*
+     * The quantile of the binned values interpolated in the bin it falls
+     * in. The underflows and overflows are at the low and high edges.
+     */
+    double quantile(double p) const;
+};
+
+/**
+ * @brief Noise figures of a channel's baselines accumulated as the
+ * baselines are captured. The noise is estimated from the differences of
+ * successive baselines so a slow drift of the baseline is not noise.
+ */
+struct baseline_noise {
+    moments values;
+    moments diffs;
+    quantile median;
+
+    baseline_noise();
+
+    void clear();
+    void update(double baseline);
+
+    /*
+     * The standard deviation of a baseline from the variance of the
+     * differences of successive baselines.
+     */
+    double noise() const;
+
+private:
+    double last;
+};
+
+typedef std::vector<baseline_noise> baseline_noises;
 }  // namespace stats
 }  // namespace pixie
 }  // namespace xia
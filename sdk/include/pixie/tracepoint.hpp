@@ -0,0 +1,79 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file tracepoint.hpp
+ * @brief Defines the static tracepoints in the SDK's hot paths.
+ *
+ * The tracepoints are USDT probes of the `pixie` provider and can be used
+ * with bpftrace, perf or SystemTap, for example:
+ *
+ *    bpftrace -e 'usdt:./pixie16_omnitool:pixie:dma_read_exit { @[arg0] = hist(arg2); }'
+ *
+ * Build with `-DUSE_TRACEPOINTS=ON` to add them. The build needs
+ * `sys/sdt.h`. When not enabled a tracepoint is empty and its arguments
+ * are not evaluated.
+ *
+ * The tracepoints and their arguments are:
+ *
+ *  dma_read_entry(module, address, words)
+ *  dma_read_exit(module, words, usecs)
+ *  fifo_level(module, words)
+ *  queue_push(words, queued-words)
+ *  queue_copy(words, queued-words)
+ *  pool_request(pool, free-buffers)
+ *  pool_release(pool, free-buffers)
+ *  crate_boot_start(modules)
+ *  crate_boot_modules(modules)
+ *  crate_boot_end(modules)
+ *  run_start(module, mode, run-task, control-task)
+ *  run_end_entry(module)
+ *  run_end_exit(module, usecs)
+ *
+ * A run end's tracepoints are only hit when a run is active.
+ */
+
+#ifndef PIXIE_TRACEPOINT_H
+#define PIXIE_TRACEPOINT_H
+
+#if defined(PIXIE_TRACEPOINTS)
+#include <sys/sdt.h>
+
+#define PIXIE_TRACEPOINT(name) DTRACE_PROBE(pixie, name)
+#define PIXIE_TRACEPOINT1(name, a1) DTRACE_PROBE1(pixie, name, a1)
+#define PIXIE_TRACEPOINT2(name, a1, a2) DTRACE_PROBE2(pixie, name, a1, a2)
+#define PIXIE_TRACEPOINT3(name, a1, a2, a3) DTRACE_PROBE3(pixie, name, a1, a2, a3)
+#define PIXIE_TRACEPOINT4(name, a1, a2, a3, a4) DTRACE_PROBE4(pixie, name, a1, a2, a3, a4)
+#else
+#define PIXIE_TRACEPOINT(name) \
+    do {                       \
+    } while (0)
+#define PIXIE_TRACEPOINT1(name, a1) \
+    do {                            \
+    } while (0)
+#define PIXIE_TRACEPOINT2(name, a1, a2) \
+    do {                                \
+    } while (0)
+#define PIXIE_TRACEPOINT3(name, a1, a2, a3) \
+    do {                                    \
+    } while (0)
+#define PIXIE_TRACEPOINT4(name, a1, a2, a3, a4) \
+    do {                                        \
+    } while (0)
+#endif
+
+#endif  // PIXIE_TRACEPOINT_H
@@ -27,9 +27,16 @@
 #include <chrono>
 #include <climits>
 #include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
 #include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace xia {
@@ -42,6 +49,20 @@ namespace util {
  */
 using strings = std::vector<std::string>;
 
+/**
+ * @brief The size of a cache line.
+ */
+static constexpr size_t cache_line = 64;
+
+/**
+ * @brief Padding between members written by different threads. A line of
+ * padding keeps the members off a shared line whatever the alignment of
+ * the object. Heap allocations are not aligned to a line in C++14.
+ */
+struct cache_line_pad {
+    char bytes[cache_line];
+};
+
 /**
  * @brief Split a string into a vector of strings.
  * @param[out] split_string The split string
@@ -99,6 +120,12 @@ void trim(std::string& s);
  */
 void dequote(std::string& s);
 
+/**
+ * @brief True if the host stores the low half of a word first. A word
+ * holding a pair of packed 16-bit samples is then the samples in order.
+ */
+bool host_little_endian();
+
 /**
  * @brief Humanize a number into standard size names. Ex. gigabyte (GB).
  * @tparam T A type that can be streamed into a ostringstream
@@ -187,6 +214,12 @@ private:
 
 /**
  * @brief Defines a type for the IEEE 754 floating point standard.
+ *
+ * A double is converted by truncating it to the single format's 24 bits
+ * of precision. The conversion of values from 2^-9 up to 2^23 and of the
+ * single format's normal numbers is a copy of the bits. The values outside
+ * this range are converted by the original bitwise method so the results
+ * do not change.
  */
 struct ieee_float {
     using value_type = unsigned int;
@@ -206,9 +239,22 @@ struct ieee_float {
     operator double() const;
     operator value_type() const;
 
+    /*
+     * Convert arrays. The result of each element is the same as the
+     * element's conversion.
+     */
+    static void to_doubles(const value_type* values, double* doubles, const size_t count);
+    static void to_values(const double* doubles, value_type* values, const size_t count);
+
 private:
-    value_type in(const double dec_num) const;
-    double out() const;
+    static value_type in(const double dec_num);
+    static double out(const value_type value_);
+
+    /*
+     * The original bitwise conversions.
+     */
+    static value_type in_bitwise(const double dec_num);
+    static double out_bitwise(const value_type value_);
 
     value_type value;
 };
@@ -231,9 +277,9 @@ struct crc32 {
         update(static_cast<const unsigned char*>(&val), sizeof(T));
     }
 
-    template<typename T>
-    void update(const std::vector<T>& vals, const size_t start = 0) {
-        const size_t so = ((vals.size() - start) * sizeof(typename std::vector<T>::value_type));
+    template<typename T, typename A>
+    void update(const std::vector<T, A>& vals, const size_t start = 0) {
+        const size_t so = ((vals.size() - start) * sizeof(T));
         update(reinterpret_cast<const unsigned char*>(&vals[start]), int(so));
     }
 
@@ -331,6 +377,116 @@ struct linear_fit {
     }
 };
 
+/**
+ * @brief A set of CPU numbers.
+ */
+using cpus = std::vector<int>;
+
+/**
+ * @brief Parse a Linux CPU list, for example "0-3,8-11", into a set of CPUs.
+ * @param[out] set The CPUs in the list.
+ * @param[in] list The CPU list.
+ */
+void parse_cpu_list(cpus& set, const std::string& list);
+
+/**
+ * @brief Format a set of CPUs as a Linux CPU list.
+ */
+std::string cpu_list(const cpus& set);
+
+/**
+ * @brief Thread scheduling policies.
+ */
+enum struct sched_policy { other, fifo, round_robin };
+
+/**
+ * @brief Pin a thread to a set of CPUs. Pinning is a performance hint and
+ * is only supported on Linux.
+ * @return False if the thread could not be pinned.
+ */
+bool set_thread_affinity(std::thread& thread, const cpus& set);
+/**
+ * @brief Pin the calling thread to a set of CPUs.
+ */
+bool set_thread_affinity(const cpus& set);
+
+/**
+ * @brief Set a thread's scheduling policy and priority. The real-time
+ * policies need privileges and are only supported on Linux.
+ * @return False if the scheduling could not be set.
+ */
+bool set_thread_scheduling(std::thread& thread, sched_policy policy, int priority);
+
+/**
+ * @brief The CPU time a thread has used in microseconds. Only supported on
+ * Linux.
+ * @return The CPU time or 0 if it cannot be read.
+ */
+size_t thread_cpu_usecs(std::thread& thread);
+
+/**
+ * @brief A pool of long lived worker threads.
+ *
+ * Each worker has its own queue of tasks so a task can be run on a specific
+ * worker. A worker can be pinned to a set of CPUs. Pinning is only
+ * supported on Linux and is ignored on other hosts.
+ *
+ * A task must not wait for another task queued on the same worker.
+ */
+class thread_pool {
+public:
+    using task = std::function<void()>;
+    using affinities = std::vector<cpus>;
+
+    thread_pool();
+    ~thread_pool();
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    /**
+     * @brief Start the workers. A running pool is stopped first.
+     * @param workers The number of workers.
+     * @param affinity The CPUs of each worker. A worker without an entry or
+     *  with an empty entry is not pinned.
+     */
+    void start(size_t workers, const affinities& affinity = affinities());
+
+    /**
+     * @brief Stop the workers once they have run their queued tasks.
+     */
+    void stop();
+
+    /**
+     * @brief Queue a task on a worker.
+     * @param worker The worker. The worker is the remainder of the number of
+     *  workers.
+     * @param work The task to run.
+     * @return A future that is ready when the task has run. The future holds
+     *  any exception the task throws.
+     */
+    std::future<void> submit(size_t worker, task work);
+
+    size_t size() const {
+        return workers.size();
+    }
+    bool running() const {
+        return !workers.empty();
+    }
+
+private:
+    struct worker {
+        std::thread thread;
+        std::mutex lock;
+        std::condition_variable wake;
+        std::deque<std::packaged_task<void()>> tasks;
+        bool finish;
+        worker();
+        void run();
+    };
+
+    std::vector<std::unique_ptr<worker>> workers;
+};
 
 }  // namespace util
 }  // namespace xia
@@ -56,6 +56,12 @@ extern "C" {
  * @warning This variable will be deprecated July 31, 2023 with the Legacy API.
  */
 #define EXTERNAL_FIFO_LENGTH 131072
+/**
+ * @brief Defines the number of words queued before ::Pixie16SaveExternalFIFODataToFile saves
+ *   the list-mode data during a run.
+ * @warning This variable will be deprecated July 31, 2023 with the Legacy API.
+ */
+#define EXTFIFO_READ_THRESH 1024
 /**
  * @brief Defines the code used to define a list mode run.
  * @warning This variable will be deprecated July 31, 2023 with the Legacy API.
@@ -105,6 +111,12 @@ extern "C" {
  */
 #define SYS_MAX_NUM_MODULES 32
 
+/**
+ * @ingroup PIXIE16_API
+ * @brief The maximum length of the FIFO worker's CPU list including the terminating nul.
+ */
+#define PIXIE16_API_WORKER_CPU_LIST_MAX (128)
+
 /**
  * @ingroup PIXIE16_API
  * @brief Defines a data structure used to configure the List-mode data FIFO worker
@@ -199,6 +211,111 @@ struct fifo_worker_config {
     size_t run_wait_usecs;
 };
 
+/**
+ * @ingroup PIXIE16_API
+ * @brief Defines a data structure used to set the List-mode data FIFO worker's options
+ *
+ * The options are in addition to the ::fifo_worker_config. Set ::struct_size to
+ * `sizeof(struct fifo_worker_options)`. Only the fields within the size are read or written,
+ * so a caller built with an earlier version of this structure keeps working when fields are
+ * added to the end.
+ */
+struct fifo_worker_options {
+    /**
+     * @brief The size of the structure in bytes set by the caller.
+     */
+    size_t struct_size;
+    /**
+     * @brief Wake the worker on the module's PCI local interrupt rather than polling.
+     *
+     * When non-zero the worker blocks waiting for the PLX local interrupt notification and
+     * reads the FIFO when notified. If no interrupt is seen the worker polls at the
+     * fifo_worker_config::idle_wait_usecs period. If the interrupt cannot be armed the worker
+     * polls using fifo_worker_config::run_wait_usecs.
+     *
+     * | Units | Min | Max | Default |
+     * |---|---|---|---|
+     * | None | 0 | 1 | 0 |
+     */
+    unsigned int interrupt_mode;
+    /**
+     * @brief Compute a CRC32 of the list-mode data read from the module's FIFO.
+     *
+     * When non-zero the worker computes a running CRC32 of the data it queues for reading
+     * during a list-mode run. The CRC is reset when the run starts. Use ::PixieGetFifoDataCrc
+     * to read the CRC and verify the data your application has read. The CRC is computed
+     * independently of the logging level.
+     *
+     * | Units | Min | Max | Default |
+     * |---|---|---|---|
+     * | None | 0 | 1 | 0 |
+     */
+    unsigned int crc_mode;
+    /**
+     * @brief Set the worker's poll period and DMA trigger level from the observed data rate.
+     *
+     * When non-zero the worker estimates the rate data arrives in the module's FIFO during a
+     * list-mode run and polls so the FIFO stays below a quarter full with the fewest wakeups.
+     * The poll period is bounded by the minimum fifo_worker_config::run_wait_usecs and
+     * fifo_worker_config::idle_wait_usecs. The mode is not used when ::interrupt_mode is armed.
+     *
+     * | Units | Min | Max | Default |
+     * |---|---|---|---|
+     * | None | 0 | 1 | 0 |
+     */
+    unsigned int adaptive_mode;
+    /**
+     * @brief The CPUs the worker thread runs on as a Linux CPU list, for example "0-3,8".
+     *
+     * An empty list does not pin the worker. The list "pci" pins the worker to the CPUs
+     * local to the module's PCI device. Pinning is only supported on Linux.
+     */
+    char cpu_list[PIXIE16_API_WORKER_CPU_LIST_MAX];
+    /**
+     * @brief The worker thread's scheduling policy, 0 is the default policy, 1 is SCHED_FIFO
+     * and 2 is SCHED_RR.
+     *
+     * The real-time policies need privileges. If the policy cannot be set the worker runs with
+     * the default policy and a warning is logged.
+     *
+     * | Units | Min | Max | Default |
+     * |---|---|---|---|
+     * | None | 0 | 2 | 0 |
+     */
+    unsigned int sched_policy;
+    /**
+     * @brief The worker thread's real-time priority. It is ignored for the default policy.
+     *
+     * | Units | Min | Max | Default |
+     * |---|---|---|---|
+     * | None | 1 | 99 | 0 |
+     */
+    int sched_priority;
+    /**
+     * @brief Allocate the worker's buffers on the NUMA node of the worker's CPUs.
+     *
+     * When non-zero and the worker is pinned the buffers are allocated by a thread on the
+     * worker's CPUs when the module boots.
+     *
+     * | Units | Min | Max | Default |
+     * |---|---|---|---|
+     * | None | 0 | 1 | 0 |
+     */
+    unsigned int numa_local;
+    /**
+     * @brief Defines the maximum number of buffers a worker can grow its pool to.
+     *
+     * If more than fifo_worker_config::buffers the worker adds buffers when the pool runs low
+     * during a run rather than dropping data and frees the added buffers when the module is
+     * idle. A value of 0 is a fixed size pool.
+     *
+     * | Units | Min | Max | Default |
+     * |---|---|---|---|
+     * | None | 0 | 10000000 | 0 |
+     */
+    size_t max_buffers;
+};
+
 /**
  * @ingroup PIXIE16_API
  * @brief Defines a data structure used to provide users information about the module.
@@ -231,6 +348,45 @@ struct module_fifo_stats {
     size_t hw_overflows; /** Estimate of HW FIFO overflows */
 };
 
+/**
+ * @ingroup PIXIE16_API
+ * @brief Defines a data structure used to provide users the module and bus lock
+ * statistics for a module. The times are in usecs. The module lock statistics
+ * count the API calls that lock the module, the SDK's internal uses of the
+ * module lock are not counted.
+ */
+struct module_lock_stats {
+    size_t locks; /** Module lock acquisitions */
+    size_t lock_waits; /** Module locks that waited for another thread */
+    size_t lock_max_wait_usecs; /** Longest module lock wait */
+    size_t lock_total_wait_usecs; /** Total module lock wait */
+    size_t bus_holds; /** Bus lock holds */
+    size_t bus_waits; /** Bus locks that waited for another holder */
+    size_t bus_max_wait_usecs; /** Longest bus lock wait */
+    size_t bus_total_wait_usecs; /** Total bus lock wait */
+    size_t bus_max_hold_usecs; /** Longest bus lock hold */
+    size_t bus_total_hold_usecs; /** Total bus lock hold */
+    size_t bus_fifo_waits; /** FIFO priority bus locks that waited */
+};
+
+/**
+ * @ingroup PIXIE16_API
+ * @brief Defines a data structure used to provide users the FIFO worker's run-time
+ * telemetry for a module. Each histogram has ::PIXIE16_API_FIFO_HISTOGRAM_BINS
+ * bins. Bin 0 counts the value 0 and bin n counts the values from 2^(n-1) to
+ * 2^n - 1. The last bin also counts all larger values.
+ */
+#define PIXIE16_API_FIFO_HISTOGRAM_BINS (32)
+struct module_fifo_histograms {
+    size_t level_words[PIXIE16_API_FIFO_HISTOGRAM_BINS]; /** FIFO level in words when read */
+    size_t dma_usecs[PIXIE16_API_FIFO_HISTOGRAM_BINS]; /** DMA transfer duration in usecs */
+    size_t dma_words[PIXIE16_API_FIFO_HISTOGRAM_BINS]; /** DMA transfer length in words */
+    size_t latency_usecs[PIXIE16_API_FIFO_HISTOGRAM_BINS]; /** Data seen to queued in usecs */
+    size_t queue_depth[PIXIE16_API_FIFO_HISTOGRAM_BINS]; /** Queue depth in buffers */
+    size_t poll_usecs[PIXIE16_API_FIFO_HISTOGRAM_BINS]; /** FIFO level poll period in usecs */
+    size_t compact_usecs[PIXIE16_API_FIFO_HISTOGRAM_BINS]; /** Queue compaction time in usecs */
+};
+
 /**
  * @defgroup PIXIE_SDK PixieSDK
  * Documentation group for the PixieSDK functions/classes/macros.
@@ -842,6 +998,26 @@ PIXIE_EXPORT int PIXIE_API Pixie16CopyDSPParameters(unsigned short BitMask,
                                                     unsigned short SourceChannel,
                                                     unsigned short* DestinationMask);
 
+/**
+ * @ingroup PIXIE16_API
+ * @brief Computes the complex FFT of a trace in place.
+ *
+ * A compatible replacement of the legacy API's function. The transform
+ * uses the exponent sign of the legacy function and is not scaled. The
+ * transform's plan is kept so repeated calls with the same length do not
+ * compute the twiddle factors.
+ *
+ * @see xia::pixie::fft::plan
+ *
+ * @param[in,out] data A pointer to an array of `2 * length` doubles, the
+ *    interleaved real and imaginary parts. The array is overwritten with the
+ *    transform.
+ * @param[in] length The number of complex values, which **must** be a power of 2. Ex. 8192
+ * @returns Zero if successful.
+ * @return The value of the xia::pixie::error::code if there was an error.
+ */
+PIXIE_EXPORT int PIXIE_API Pixie16complexFFT(double* data, unsigned int length);
+
 /**
  * @ingroup PIXIE16_API
  * @brief Stop the run in a Pixie module.
@@ -965,6 +1141,82 @@ PIXIE_EXPORT int PIXIE_API Pixie16ReadDataFromExternalFIFO(unsigned int* ExtFIFO
                                                            unsigned int nFIFOWords,
                                                            unsigned short ModNum);
 
+/**
+ * @ingroup PIXIE_API
+ * @brief Read a buffer of list mode data from the module's FIFO data queue without copying.
+ *
+ * The oldest buffer of list mode data read from the external FIFO by the FIFO worker is
+ * handed to the caller. The data stays in the SDK's buffer pool and is not copied. The
+ * buffer must be returned with ::PixieReleaseListModeBuffer once the caller has finished
+ * with the data. Buffers not released are not available to the FIFO worker and data may be
+ * dropped. All buffers must be released before the system is exited.
+ *
+ * If no data is available `Data` is set to NULL, `NumWords` is 0 and `Buffer` is NULL.
+ *
+ * @see Pixie16ReadDataFromExternalFIFO
+ * @see PixieReleaseListModeBuffer
+ *
+ * @param[out] Data Set to point to the buffer's 32-bit words.
+ * @param[out] NumWords The number of 32-bit words in the buffer.
+ * @param[out] Buffer An opaque handle for the buffer to pass to ::PixieReleaseListModeBuffer.
+ * @param[in] ModNum The module number that we'll read from. Numbering starts at 0.
+ * @returns The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieReadListModeBuffer(unsigned int** Data, unsigned int* NumWords,
+                                                   void** Buffer, unsigned short ModNum);
+
+/**
+ * @ingroup PIXIE_API
+ * @brief Release a list mode buffer returned by ::PixieReadListModeBuffer.
+ *
+ * The buffer is returned to the module's buffer pool. The data pointer returned with the
+ * buffer is invalid once released. A NULL `Buffer` is ignored.
+ *
+ * @param[in] Buffer The opaque buffer handle returned by ::PixieReadListModeBuffer.
+ * @returns The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieReleaseListModeBuffer(void* Buffer);
+
+/**
+ * @ingroup PIXIE_API
+ * @brief Read the number of 32-bit words each module's external FIFO has in one call.
+ *
+ * This is ::Pixie16CheckExternalFIFOStatus for modules 0 to `NumModules - 1` with a single
+ * check of the crate. Use it to poll a crate of modules at a high rate.
+ *
+ * @see Pixie16CheckExternalFIFOStatus
+ * @see PixieReadCrateFIFO
+ *
+ * @param[out] nFIFOWords An array of `NumModules` words set to the number of 32-bit words each
+ *     module has.
+ * @param[in] NumModules The number of modules to check starting at module 0.
+ * @returns The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieCheckCrateFIFOStatus(unsigned int* nFIFOWords,
+                                                     unsigned short NumModules);
+
+/**
+ * @ingroup PIXIE_API
+ * @brief Read the list mode data of all modules into per-module buffers in one call.
+ *
+ * The data of modules 0 to `NumModules - 1` is copied into the caller's buffers with a single
+ * check of the crate. Each module's buffer `Data[m]` has space for `MaxWords[m]` words and
+ * `NumWords[m]` is set to the number of words copied. Unlike
+ * ::Pixie16ReadDataFromExternalFIFO the buffers are not padded, the words not copied remain
+ * queued for the next read. A module with a NULL buffer or no space is not read.
+ *
+ * @see Pixie16ReadDataFromExternalFIFO
+ * @see PixieCheckCrateFIFOStatus
+ *
+ * @param[in] Data An array of `NumModules` pointers to the modules' buffers.
+ * @param[in] MaxWords An array of `NumModules` sizes of the buffers in 32-bit words.
+ * @param[out] NumWords An array of `NumModules` words set to the number of words copied.
+ * @param[in] NumModules The number of modules to read starting at module 0.
+ * @returns The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieReadCrateFIFO(unsigned int** Data, const unsigned int* MaxWords,
+                                              unsigned int* NumWords, unsigned short NumModules);
+
 /**
  * @ingroup PIXIE16_API
  * @brief Load DSP parameters from a settings file
@@ -1256,23 +1508,57 @@ PIXIE_EXPORT int PIXIE_API Pixie16ReadStatisticsFromModule(unsigned int* Statist
  */
 PIXIE_EXPORT int PIXIE_API Pixie16SaveDSPParametersToFile(const char* FileName);
 
+/**
+ * @ingroup PIXIE16_API
+ * @brief Save the list-mode data of a module to a file.
+ *
+ * @warning This function will be deprecated July 31, 2023 with the Legacy API.
+ *
+ * Use this function to append the list-mode data of a Pixie-16 module to a binary file of
+ * 32-bit words. It is a drop in for the legacy function. The data is not read from the
+ * external FIFO on the caller's thread. The FIFO worker has already read the data into the
+ * module's buffer pool and the queued buffers are written to the file without a copy. During
+ * a run the data is only saved once more than #EXTFIFO_READ_THRESH words are queued. Set
+ * `EndOfRunRead` to 1 after the run has ended to save the remaining words. **Existing files
+ * are appended to.**
+ *
+ * ### Example
+ * \snippet snippets/api_function_examples.c Pixie16SaveExternalFIFODataToFile
+ *
+ * @see Pixie16CheckExternalFIFOStatus
+ * @see PixieReadListModeBuffer
+ *
+ * @param[in] FileName The name of the list-mode data file.
+ * @param[out] nFIFOWords The number of 32-bit words saved.
+ * @param[in] ModNum The module number we'll save the data of. Counting from 0.
+ * @param[in] EndOfRunRead 1 saves any queued words, 0 only saves once the threshold is
+ *     exceeded.
+ * @returns The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API Pixie16SaveExternalFIFODataToFile(const char* FileName,
+                                                             unsigned int* nFIFOWords,
+                                                             unsigned short ModNum,
+                                                             unsigned short EndOfRunRead);
+
 /**
  * @ingroup PIXIE16_API
  * @brief Retrieve histogram data from a Pixie module and then save the data to a file.
  *
- * @warning This function is not currently implemented.
  * @warning This function will be deprecated July 31, 2023 with the Legacy API.
  *
  * Use this function to read histogram data from a Pixie-16 module and save the histogram data to
- * a file with file name specified by the user. First, this function saves the histogram data to a
- * binary file, and it then saves the histogram data to an ASCII file with run statistics data
- * appended to the end of the ASCII file. **Existing files will be overwritten.**
+ * a binary file with file name specified by the user. The file holds each channel's full
+ * histogram as 32-bit words in channel order. If ModNum is the number of modules in the crate
+ * the histograms of all online modules are read in parallel and saved in module order in the one
+ * file. The ASCII file with run statistics of the legacy implementation is not written.
+ * **Existing files will be overwritten.**
  *
  * ### Example
  * \snippet snippets/api_function_examples.c Pixie16SaveHistogramToFile
  *
  * @param[in] FileName The file name for the file containing the histogram data
- * @param[in] ModNum The module number we'll read histogram data from. Counting from 0.
+ * @param[in] ModNum The module number we'll read histogram data from. Counting from 0. Use the
+ *     number of modules in the crate to save all the online modules.
  * @returns The value of the xia::pixie::error::code indicating the result of the operation
  */
 PIXIE_EXPORT int PIXIE_API Pixie16SaveHistogramToFile(const char* FileName, unsigned short ModNum);
@@ -1530,6 +1816,49 @@ enum PIXIE_BOOT_MODE {
 PIXIE_EXPORT int PIXIE_API PixieBootCrate(const char* settings_file,
                                           const enum PIXIE_BOOT_MODE boot_mode);
 
+/**
+ * @ingroup PIXIE_API
+ * @brief Gets the handle of a channel parameter
+ *
+ * Resolve a channel parameter name once and use the handle with
+ * ::PixieReadSglChanParHandle and ::PixieWriteSglChanParHandle to avoid
+ * looking up the name on each call. A handle is valid for the life of the
+ * process.
+ *
+ * @param[in] ChanParName The name of the channel parameter. See ::Pixie16ReadSglChanPar.
+ * @param[out] Handle A pointer to the variable to hold the parameter's handle
+ * @returns The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieGetChanParHandle(const char* ChanParName, unsigned int* Handle);
+
+/**
+ * @ingroup PIXIE_API
+ * @brief Gets the CRC32 of the list-mode data queued by the module's FIFO worker
+ *
+ * The CRC covers the data queued since the start of the list-mode run. It is only computed
+ * if the worker configuration's `crc_mode` is set.
+ *
+ * @param mod_num The module number to get the CRC from.
+ * @param crc A pointer to the variable to hold the CRC
+ * @return The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieGetFifoDataCrc(unsigned short mod_num, unsigned int* crc);
+
+/**
+ * @ingroup PIXIE_API
+ * @brief Gets the handle of a module parameter
+ *
+ * Resolve a module parameter name once and use the handle with
+ * ::PixieReadSglModParHandle and ::PixieWriteSglModParHandle to avoid
+ * looking up the name on each call. A handle is valid for the life of the
+ * process.
+ *
+ * @param[in] ModParName The name of the module parameter. See ::Pixie16ReadSglModPar.
+ * @param[out] Handle A pointer to the variable to hold the parameter's handle
+ * @returns The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieGetModParHandle(const char* ModParName, unsigned int* Handle);
+
 /**
  * @ingroup PIXIE_API
  * @brief Gets a worker configuration from the specified module
@@ -1540,6 +1869,17 @@ PIXIE_EXPORT int PIXIE_API PixieBootCrate(const char* settings_file,
 PIXIE_EXPORT int PIXIE_API PixieGetWorkerConfiguration(unsigned short mod_num,
                                                        struct fifo_worker_config* worker_config);
 
+/**
+ * @ingroup PIXIE_API
+ * @brief Gets the worker options from the specified module
+ * @param mod_num The module number to get the options from.
+ * @param worker_options A pointer to the options object to fill with the information. The
+ *        ::fifo_worker_options::struct_size must be set.
+ * @return The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieGetWorkerOptions(unsigned short mod_num,
+                                                 struct fifo_worker_options* worker_options);
+
 /**
  * @ingroup PIXIE_API
  * @brief Register a module's firmware set
@@ -1564,6 +1904,30 @@ PIXIE_EXPORT int PIXIE_API PixieRegisterFirmware(const unsigned int version, con
                                                  const char* device, const char* path,
                                                  unsigned short ModNum);
 
+/**
+ * @ingroup PIXIE_API
+ * @brief Reads a channel parameter using its handle
+ * @param[in] Handle The handle from ::PixieGetChanParHandle
+ * @param[out] ChanParData Contains the value of the requested parameter
+ * @param[in] ModNum The module number we'll read from. Counting starts at 0.
+ * @param[in] ChanNum The channel number we'll read from. Counting starts at 0.
+ * @returns The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieReadSglChanParHandle(unsigned int Handle, double* ChanParData,
+                                                     unsigned short ModNum,
+                                                     unsigned short ChanNum);
+
+/**
+ * @ingroup PIXIE_API
+ * @brief Reads a module parameter using its handle
+ * @param[in] Handle The handle from ::PixieGetModParHandle
+ * @param[out] ModParData Contains the value of the requested parameter
+ * @param[in] ModNum The module number we'll read from. Counting starts at 0.
+ * @returns The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieReadSglModParHandle(unsigned int Handle, unsigned int* ModParData,
+                                                    unsigned short ModNum);
+
 /**
  * @ingroup PIXIE_API
  * @brief Sets a worker configuration in the specified module
@@ -1574,6 +1938,20 @@ PIXIE_EXPORT int PIXIE_API PixieRegisterFirmware(const unsigned int version, con
 PIXIE_EXPORT int PIXIE_API PixieSetWorkerConfiguration(unsigned short mod_num,
                                                        struct fifo_worker_config* worker_config);
 
+/**
+ * @ingroup PIXIE_API
+ * @brief Sets the worker options in the specified module
+ *
+ * The fields outside the ::fifo_worker_options::struct_size are not read and the module
+ * keeps their current values.
+ *
+ * @param mod_num The module number to set the options.
+ * @param worker_options A pointer to the options object with the necessary information
+ * @return The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieSetWorkerOptions(unsigned short mod_num,
+                                                 struct fifo_worker_options* worker_options);
+
 /**
  * @ingroup PIXIE_API
  * @brief Read the run's statistics for the module. if a run as finished the statistics
@@ -1585,6 +1963,58 @@ PIXIE_EXPORT int PIXIE_API PixieSetWorkerConfiguration(unsigned short mod_num,
 PIXIE_EXPORT int PIXIE_API PixieReadRunFifoStats(unsigned short mod_num,
                                                  struct module_fifo_stats* fifo_stats);
 
+/**
+ * @ingroup PIXIE_API
+ * @brief Read the run's FIFO worker telemetry histograms for the module. If a run
+ * has finished the histograms are for the last run.
+ * @param mod_num The module number to read the histograms from.
+ * @param fifo_histograms A pointer to the histograms the module data is copied too.
+ * @return The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieReadRunFifoHistograms(
+    unsigned short mod_num, struct module_fifo_histograms* fifo_histograms);
+
+/**
+ * @ingroup PIXIE_API
+ * @brief Read the module and bus lock statistics for the module. The module lock
+ * is not taken so the call can be made while other threads use the module.
+ * @param mod_num The module number to read the statistics from.
+ * @param lock_stats A pointer to the statistics the module data is copied too.
+ * @param reset Reset the statistics after they are read if not 0.
+ * @return The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieReadLockStats(unsigned short mod_num,
+                                              struct module_lock_stats* lock_stats,
+                                              unsigned short reset);
+
+/**
+ * @ingroup PIXIE_API
+ * @brief Writes a channel parameter using its handle
+ * @param[in] Handle The handle from ::PixieGetChanParHandle
+ * @param[in] ChanParData The value that we'll write to the provided channel
+ * @param[in] ModNum The module number we'll write to. Counting starts at 0.
+ * @param[in] ChanNum The channel number we'll write to. Counting starts at 0.
+ * @returns The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieWriteSglChanParHandle(unsigned int Handle, double ChanParData,
+                                                      unsigned short ModNum,
+                                                      unsigned short ChanNum);
+
+/**
+ * @ingroup PIXIE_API
+ * @brief Writes a module parameter using its handle
+ *
+ * The module number can be the number of modules in the crate to write the
+ * parameter to all modules. See ::Pixie16WriteSglModPar.
+ *
+ * @param[in] Handle The handle from ::PixieGetModParHandle
+ * @param[in] ModParData The value that we'll write to the module
+ * @param[in] ModNum The module number we'll write to. Counting starts at 0.
+ * @returns The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieWriteSglModParHandle(unsigned int Handle, unsigned int ModParData,
+                                                     unsigned short ModNum);
+
 #ifdef __cplusplus
 }
 #endif
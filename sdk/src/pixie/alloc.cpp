@@ -0,0 +1,163 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2022 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file alloc.cpp
+ * @brief Implements the accounting of heap allocations on watched threads.
+ */
+
+#include <cstdlib>
+#include <new>
+
+#include <pixie/alloc.hpp>
+
+namespace xia {
+namespace pixie {
+namespace alloc {
+/*
+ * A plain pointer so the hooks can read it while a thread's storage is
+ * being destroyed.
+ */
+static thread_local counter* thread_counter = nullptr;
+
+counter::counter() : allocations_(0), bytes_(0) {}
+
+counter::counter(const counter& c) : allocations_(c.allocations()), bytes_(c.bytes()) {}
+
+counter& counter::operator=(const counter& c) {
+    allocations_ = c.allocations();
+    bytes_ = c.bytes();
+    return *this;
+}
+
+void counter::note(const size_t bytes) {
+    allocations_.fetch_add(1, std::memory_order_relaxed);
+    bytes_.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void counter::reset() {
+    allocations_ = 0;
+    bytes_ = 0;
+}
+
+watch::watch(counter* counter_) : previous(thread_counter) {
+    thread_counter = counter_;
+}
+
+watch::~watch() {
+    thread_counter = previous;
+}
+
+counter* watching() {
+    return thread_counter;
+}
+
+void note(const size_t bytes) {
+    auto c = thread_counter;
+    if (c != nullptr) {
+        c->note(bytes);
+    }
+}
+
+void note_fallback(const size_t bytes) {
+    if (!hooked()) {
+        note(bytes);
+    }
+}
+
+bool hooked() {
+#if defined(PIXIE_ALLOC_HOOKS)
+    return true;
+#else
+    return false;
+#endif
+}
+}  // namespace alloc
+}  // namespace pixie
+}  // namespace xia
+
+#if defined(PIXIE_ALLOC_HOOKS)
+/*
+ * The replaced global allocation functions. The memory is from the C
+ * heap and the allocation is noted before it is returned.
+ */
+static void* hooked_new(std::size_t bytes) {
+    if (bytes == 0) {
+        bytes = 1;
+    }
+    while (true) {
+        void* ptr = std::malloc(bytes);
+        if (ptr != nullptr) {
+            xia::pixie::alloc::note(bytes);
+            return ptr;
+        }
+        auto handler = std::get_new_handler();
+        if (handler == nullptr) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+void* operator new(std::size_t bytes) {
+    return hooked_new(bytes);
+}
+
+void* operator new[](std::size_t bytes) {
+    return hooked_new(bytes);
+}
+
+void* operator new(std::size_t bytes, const std::nothrow_t&) noexcept {
+    try {
+        return hooked_new(bytes);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void* operator new[](std::size_t bytes, const std::nothrow_t&) noexcept {
+    try {
+        return hooked_new(bytes);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+    std::free(ptr);
+}
+#endif
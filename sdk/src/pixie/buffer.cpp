@@ -20,18 +20,278 @@
  * @brief Implements functions and data structures for creating threaded data buffers
  */
 
+#include <algorithm>
 #include <cstring>
 #include <iomanip>
 #include <iostream>
 
+#include <pixie/alloc.hpp>
 #include <pixie/buffer.hpp>
 #include <pixie/error.hpp>
 #include <pixie/log.hpp>
+#include <pixie/os_compat.hpp>
+#include <pixie/tracepoint.hpp>
+
+#if defined(_WIN64) || defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
 
 namespace xia {
 namespace buffer {
 static constexpr bool queue_trace = false;
 
+static bool lock_buffer(buffer& buf) {
+    const size_t bytes = buf.capacity() * sizeof(buffer_value);
+#if defined(_WIN64) || defined(_WIN32)
+    return ::VirtualLock(buf.data(), bytes) != 0;
+#else
+    return ::mlock(buf.data(), bytes) == 0;
+#endif
+}
+
+static void unlock_buffer(buffer& buf) {
+    const size_t bytes = buf.capacity() * sizeof(buffer_value);
+#if defined(_WIN64) || defined(_WIN32)
+    ::VirtualUnlock(buf.data(), bytes);
+#else
+    ::munlock(buf.data(), bytes);
+#endif
+}
+
+static const size_t page_bytes = 4096;
+static const size_t huge_page_bytes = 2 * 1024 * 1024;
+
+static size_t round_up(const size_t value, const size_t to) {
+    return ((value + to - 1) / to) * to;
+}
+
+static const char* pages_label(const arena::pages pages) {
+    switch (pages) {
+    case arena::pages::normal:
+        return "normal";
+    case arena::pages::transparent:
+        return "transparent";
+    case arena::pages::huge:
+        return "huge";
+    default:
+        break;
+    }
+    return "none";
+}
+
+arena::arena()
+    : base(nullptr), bytes(0), slot_bytes(0), slots_(0), pages_(pages::none), locked_(false) {}
+
+arena::~arena() {
+    destroy();
+}
+
+bool arena::create(const size_t slots__, const size_t slot_bytes_, const bool lock_pages) {
+    lock_guard guard(lock);
+    if (base != nullptr) {
+        throw error(error::code::buffer_pool_not_empty, "arena is already created");
+    }
+    if (slots__ == 0 || slot_bytes_ == 0) {
+        return false;
+    }
+    slot_bytes = round_up(slot_bytes_, page_bytes);
+    bytes = round_up(slots__ * slot_bytes, huge_page_bytes);
+    void* mem = nullptr;
+#if defined(_WIN64) || defined(_WIN32)
+    mem = ::VirtualAlloc(nullptr, bytes, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (mem != nullptr) {
+        pages_ = pages::normal;
+    }
+#else
+#if defined(MAP_HUGETLB)
+    mem = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                 -1, 0);
+    if (mem == MAP_FAILED) {
+        mem = nullptr;
+    } else {
+        pages_ = pages::huge;
+    }
+#endif
+    if (mem == nullptr) {
+        mem = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) {
+            mem = nullptr;
+        } else {
+            pages_ = pages::normal;
+#if defined(MADV_HUGEPAGE)
+            if (::madvise(mem, bytes, MADV_HUGEPAGE) == 0) {
+                pages_ = pages::transparent;
+            }
+#endif
+        }
+    }
+#endif
+    if (mem == nullptr) {
+        xia_log(log::warning) << "arena: map failed: bytes=" << bytes;
+        bytes = 0;
+        slot_bytes = 0;
+        pages_ = pages::none;
+        return false;
+    }
+    base = static_cast<char*>(mem);
+    slots_ = bytes / slot_bytes;
+    free.reserve(slots_);
+    for (size_t s = slots_; s > 0; --s) {
+        free.push_back(base + (s - 1) * slot_bytes);
+    }
+    if (lock_pages) {
+#if defined(_WIN64) || defined(_WIN32)
+        locked_ = ::VirtualLock(base, bytes) != 0;
+#else
+        locked_ = ::mlock(base, bytes) == 0;
+#endif
+        if (!locked_) {
+            xia_log(log::info) << "arena: page lock failed: bytes=" << bytes;
+        }
+    }
+    xia_log(log::info) << "arena: create: slots=" << slots_ << " slot-bytes=" << slot_bytes
+                       << " pages=" << pages_label(pages_) << std::boolalpha
+                       << " locked=" << locked_;
+    return true;
+}
+
+void arena::destroy() {
+    lock_guard guard(lock);
+    if (base != nullptr) {
+#if defined(_WIN64) || defined(_WIN32)
+        if (locked_) {
+            ::VirtualUnlock(base, bytes);
+        }
+        ::VirtualFree(base, 0, MEM_RELEASE);
+#else
+        ::munmap(base, bytes);
+#endif
+        base = nullptr;
+        bytes = 0;
+        slot_bytes = 0;
+        slots_ = 0;
+        pages_ = pages::none;
+        locked_ = false;
+        free.clear();
+    }
+}
+
+void* arena::allocate(const size_t bytes_) {
+    lock_guard guard(lock);
+    if (bytes_ > slot_bytes || free.empty()) {
+        return nullptr;
+    }
+    auto slot = free.back();
+    free.pop_back();
+    return slot;
+}
+
+bool arena::deallocate(void* ptr) {
+    if (!contains(ptr)) {
+        return false;
+    }
+    lock_guard guard(lock);
+    free.push_back(static_cast<char*>(ptr));
+    return true;
+}
+
+handle_blocks::handle_blocks() : size_(0), heap_(0) {}
+
+void handle_blocks::reserve(const size_t count) {
+    lock_guard guard(lock);
+    if (count > size_) {
+        const size_t adding = count - size_;
+        chunks.emplace_back(chunk(new block[adding]), adding);
+        auto& added = chunks.back().first;
+        free.reserve(count);
+        for (size_t b = adding; b > 0; --b) {
+            free.push_back(&added[b - 1]);
+        }
+        size_ = count;
+    }
+}
+
+void* handle_blocks::allocate(const size_t bytes) {
+    if (bytes <= block_bytes) {
+        lock_guard guard(lock);
+        if (!free.empty()) {
+            auto blk = free.back();
+            free.pop_back();
+            return blk;
+        }
+    }
+    ++heap_;
+    pixie::alloc::note_fallback(bytes);
+    return ::operator new(bytes);
+}
+
+void handle_blocks::deallocate(void* ptr, const size_t bytes) noexcept {
+    if (bytes <= block_bytes) {
+        lock_guard guard(lock);
+        if (contains(ptr)) {
+            free.push_back(static_cast<block*>(ptr));
+            return;
+        }
+    }
+    ::operator delete(ptr);
+}
+
+bool handle_blocks::contains(const void* ptr) const {
+    auto blk = static_cast<const block*>(ptr);
+    for (auto& c : chunks) {
+        if (blk >= c.first.get() && blk < c.first.get() + c.second) {
+            return true;
+        }
+    }
+    return false;
+}
+
+node_cache::node_cache() : held_(0), limit_(0) {
+    limit(default_limit_bytes);
+}
+
+node_cache::~node_cache() {
+    for (auto& f : free) {
+        ::operator delete(f.second);
+    }
+}
+
+void* node_cache::allocate(const size_t bytes) {
+    for (auto f = free.rbegin(); f != free.rend(); ++f) {
+        if (f->first == bytes) {
+            void* ptr = f->second;
+            *f = free.back();
+            free.pop_back();
+            held_ -= bytes;
+            return ptr;
+        }
+    }
+    pixie::alloc::note_fallback(bytes);
+    return ::operator new(bytes);
+}
+
+void node_cache::deallocate(void* ptr, const size_t bytes) noexcept {
+    if (held_ + bytes <= limit_ && free.size() < free.capacity()) {
+        free.emplace_back(bytes, ptr);
+        held_ += bytes;
+    } else {
+        ::operator delete(ptr);
+    }
+}
+
+void node_cache::limit(const size_t bytes) {
+    if (bytes > limit_) {
+        limit_ = bytes;
+        /*
+         * A container's smallest allocation is a few pointers so the
+         * entries are bounded by the limit.
+         */
+        free.reserve(limit_ / (4 * sizeof(void*)));
+    }
+}
+
 struct pool::releaser {
     pool& pool_;
     releaser(pool& pool_);
@@ -44,7 +304,9 @@ void pool::releaser::operator()(buffer* buf) const {
     pool_.release(buf);
 }
 
-pool::pool() : number(0), size(0), count_(0) {}
+pool::pool()
+    : number(0), size(0), locked(0), base_number(0), max_number(0), grow_by(1), count_(0),
+      lock_pages(false), high_mark(0), low_mark(0), high_water_(false), high_water_events_(0) {}
 
 pool::~pool() {
     try {
@@ -54,20 +316,24 @@ pool::~pool() {
     }
 }
 
-void pool::create(const size_t number_, const size_t size_) {
-    xia_log(log::info) << "pool create: num=" << number_ << " size=" << size_;
+void pool::create(const size_t number_, const size_t size_, const bool lock_pages_,
+                  const bool huge_pages) {
+    xia_log(log::info) << "pool create: num=" << number_ << " size=" << size_
+                       << std::boolalpha << " lock-pages=" << lock_pages_
+                       << " huge-pages=" << huge_pages;
     lock_guard guard(lock);
     if (valid()) {
         throw error(error::code::buffer_pool_not_empty, "pool is already created");
     }
-    number = number_;
     size = size_;
-    for (size_t n = 0; n < number; ++n) {
-        buffer_ptr buf = new buffer;
-        buf->reserve(size);
-        buffers.push_front(buf);
+    locked = 0;
+    lock_pages = lock_pages_;
+    base_number = number_;
+    high_water_ = false;
+    if (huge_pages) {
+        arena_.create(number_, size_ * sizeof(buffer_value), lock_pages_);
     }
-    count_ = number;
+    add_buffers(number_);
 }
 
 void pool::destroy() {
@@ -78,45 +344,209 @@ void pool::destroy() {
             throw error(error::code::buffer_pool_busy, "pool destroy made while busy");
         }
         while (!buffers.empty()) {
-            buffer_ptr buf = buffers.front();
+            buffer_ptr buf = buffers.back();
+            if (page_locked.count(buf) != 0 && !arena_.contains(buf->data())) {
+                unlock_buffer(*buf);
+            }
             delete buf;
-            buffers.pop_front();
+            buffers.pop_back();
         }
+        arena_.destroy();
+        page_locked.clear();
         number = 0;
         size = 0;
+        locked = 0;
+        base_number = 0;
         count_ = 0;
+        high_water_ = false;
     }
 }
 
 handle pool::request() {
+    watermark level = watermark::low;
+    size_t in_use = 0;
+    bool report;
+    handle buf;
+    {
+        lock_guard guard(lock);
+        if (empty() && valid() && number < max_number) {
+            add_buffers(std::min(grow_by, max_number - number));
+        }
+        if (empty()) {
+            throw error(error::code::buffer_pool_empty, "no buffers available");
+        }
+        count_--;
+        buffer_ptr bp = buffers.back();
+        buffers.pop_back();
+        buf = handle(bp, releaser(*this), handle_allocator<buffer>(&blocks));
+        report = check_watermarks(level, in_use);
+    }
+    PIXIE_TRACEPOINT2(pool_request, this, count_.load());
+    notify(report, level, in_use);
+    return buf;
+}
+
+void pool::set_elastic(const size_t max_number_, const size_t grow_by_) {
     lock_guard guard(lock);
-    if (empty()) {
-        throw error(error::code::buffer_pool_empty, "no buffers available");
+    max_number = max_number_;
+    grow_by = grow_by_ == 0 ? 1 : grow_by_;
+}
+
+bool pool::grow() {
+    lock_guard guard(lock);
+    if (!valid() || number >= max_number) {
+        return false;
     }
-    count_--;
-    buffer_ptr buf = buffers.front();
-    buffers.pop_front();
-    return handle(buf, releaser(*this));
+    size_t adding = max_number - number;
+    if (adding > grow_by) {
+        adding = grow_by;
+    }
+    xia_log(log::info) << "pool grow: num=" << number << " adding=" << adding
+                       << " max=" << max_number;
+    add_buffers(adding);
+    return true;
+}
+
+size_t pool::shrink() {
+    lock_guard guard(lock);
+    size_t freed = 0;
+    while (number > base_number && count_.load() > 0) {
+        buffer_ptr buf = buffers.back();
+        buffers.pop_back();
+        if (page_locked.erase(buf) != 0) {
+            if (!arena_.contains(buf->data())) {
+                unlock_buffer(*buf);
+            }
+            --locked;
+        }
+        delete buf;
+        --number;
+        --count_;
+        ++freed;
+    }
+    if (freed > 0) {
+        xia_log(log::info) << "pool shrink: num=" << number << " freed=" << freed;
+    }
+    return freed;
+}
+
+void pool::set_watermarks(const size_t high, const size_t low, watermark_handler handler_) {
+    if (high != 0 && low >= high) {
+        throw error(error::code::invalid_value, "pool low watermark not below high watermark");
+    }
+    lock_guard guard(lock);
+    high_mark = high;
+    low_mark = low;
+    handler = handler_;
+    high_water_ = false;
 }
 
 void pool::release(buffer_ptr buf) {
     buf->clear();
-    lock_guard guard(lock);
-    buffers.push_front(buf);
-    count_++;
+    watermark level = watermark::low;
+    size_t in_use = 0;
+    bool report;
+    {
+        lock_guard guard(lock);
+        buffers.push_back(buf);
+        count_++;
+        report = check_watermarks(level, in_use);
+    }
+    PIXIE_TRACEPOINT2(pool_release, this, count_.load());
+    notify(report, level, in_use);
+}
+
+void pool::add_buffers(const size_t count) {
+    bool locking = lock_pages && locked == number;
+    buffers.reserve(number + count);
+    blocks.reserve(number + count);
+    if (locking) {
+        page_locked.reserve(number + count);
+    }
+    for (size_t n = 0; n < count; ++n) {
+        buffer_ptr buf = new buffer(arena_allocator<buffer_value>(&arena_));
+        buf->reserve(size);
+        if (arena_.contains(buf->data()) && arena_.locked()) {
+            if (locking) {
+                page_locked.insert(buf);
+                ++locked;
+            }
+        } else if (locking) {
+            if (lock_buffer(*buf)) {
+                page_locked.insert(buf);
+                ++locked;
+            } else {
+                locking = false;
+                xia_log(log::info) << "pool: page lock failed: locked=" << locked;
+            }
+        }
+        buffers.push_back(buf);
+        ++number;
+        ++count_;
+    }
+}
+
+bool pool::check_watermarks(watermark& level, size_t& in_use) {
+    if (high_mark == 0) {
+        return false;
+    }
+    in_use = number - count_.load();
+    if (!high_water_.load() && in_use >= high_mark) {
+        high_water_ = true;
+        ++high_water_events_;
+        level = watermark::high;
+        return true;
+    }
+    if (high_water_.load() && in_use <= low_mark) {
+        high_water_ = false;
+        level = watermark::low;
+        return true;
+    }
+    return false;
+}
+
+void pool::notify(bool report, watermark level, size_t in_use) {
+    if (report) {
+        xia_log(log::debug) << "pool watermark: "
+                            << (level == watermark::high ? "high" : "low")
+                            << " in-use=" << in_use;
+        watermark_handler call;
+        {
+            lock_guard guard(lock);
+            call = handler;
+        }
+        if (call) {
+            call(level, in_use);
+        }
+    }
 }
 
 void pool::output(std::ostream& out) {
-    out << "count=" << count_.load() << " num=" << number << " size=" << size;
+    out << "count=" << count_.load() << " num=" << number << " size=" << size
+        << " locked=" << locked;
+    if (arena_.valid()) {
+        out << " arena=" << pages_label(arena_.page_type());
+    }
+    if (max_number > base_number) {
+        out << " base=" << base_number << " max=" << max_number;
+    }
+    if (blocks.heap() != 0) {
+        out << " handle-heap=" << blocks.heap();
+    }
+    if (high_mark != 0) {
+        out << " high-water=" << std::boolalpha << high_water_.load() << std::noboolalpha
+            << " high-water-events=" << high_water_events_.load();
+    }
 }
 
-queue::queue() : size_(0) {}
+queue::queue() : buffers(cache_allocator<handle>(&cache)), size_(0), head_offset(0) {}
 
 void queue::push(handle buf) {
     if (buf->size() > 0) {
         lock_guard guard(lock);
         buffers.push_back(buf);
         size_ += buf->size();
+        PIXIE_TRACEPOINT2(queue_push, buf->size(), size_);
         if (queue_trace) {
             xia_log(log::debug) << "queue::push: buffers=" << buffers.size()
                                 << " buf=" << buf->size()
@@ -128,6 +558,7 @@ void queue::push(handle buf) {
 
 handle queue::pop() {
     lock_guard guard(lock);
+    trim_head();
     handle buf = buffers.front();
     buffers.pop_front();
     size_ -= buf->size();
@@ -140,6 +571,46 @@ handle queue::pop() {
     return buf;
 }
 
+size_t queue::pop(handles& to, const size_t max_buffers) {
+    lock_guard guard(lock);
+    trim_head();
+    size_t popped = 0;
+    size_t count = 0;
+    while (!buffers.empty() && (max_buffers == 0 || count < max_buffers)) {
+        handle buf = buffers.front();
+        buffers.pop_front();
+        size_ -= buf->size();
+        popped += buf->size();
+        to.push_back(buf);
+        ++count;
+    }
+    if (queue_trace) {
+        xia_log(log::debug) << "queue::pop: buffers=" << buffers.size()
+                            << " popped=" << count << '/' << popped
+                            << " size=" << size_;
+        check("pop handles");
+    }
+    return popped;
+}
+
+void queue::requeue(handles& from) {
+    lock_guard guard(lock);
+    trim_head();
+    size_t requeued = 0;
+    for (auto bi = from.rbegin(); bi != from.rend(); ++bi) {
+        buffers.push_front(*bi);
+        requeued += (*bi)->size();
+    }
+    size_ += requeued;
+    from.clear();
+    if (queue_trace) {
+        xia_log(log::debug) << "queue::requeue: buffers=" << buffers.size()
+                            << " requeued=" << requeued
+                            << " size=" << size_;
+        check("requeue");
+    }
+}
+
 size_t queue::copy(buffer& to) {
     lock_guard guard(lock);
     /*
@@ -172,36 +643,35 @@ size_t queue::copy_unprotected(buffer_value_ptr to, size_t to_move) {
     auto from_bi = buffers.begin();
     while (to_move > 0 && from_bi != buffers.end()) {
         auto from = *from_bi;
-        ++from_bi;
-        if (to_move >= from->size()) {
+        auto available = from->size() - head_offset;
+        if (to_move >= available) {
             if (queue_trace) {
                 xia_log(log::debug) << "queue::copy: from-all: to_move=" << to_move
-                                    << " from=" << from->size()
+                                    << " from=" << available
                                     << " size_=" << size_;
             }
-            std::memcpy(to, from->data(), from->size() * sizeof(*to));
-            to += from->size();
-            to_move -= from->size();
-            size_ -= from->size();
+            std::memcpy(to, from->data() + head_offset, available * sizeof(*to));
+            to += available;
+            to_move -= available;
+            size_ -= available;
+            head_offset = 0;
+            ++from_bi;
         } else {
-            auto remaining = from->size() - to_move;
             if (queue_trace) {
                 xia_log(log::debug) << "queue::copy: from-some: to_move=" << to_move
-                                    << " from=" << from->size()
-                                    << " remaining=" << remaining
+                                    << " from=" << available
+                                    << " remaining=" << available - to_move
                                     << " size_=" << size_;
             }
-            std::memcpy(to, from->data(), to_move * sizeof(*to));
-            std::memmove(
-                from->data(), from->data() + to_move, remaining * sizeof(*to));
-            from->resize(remaining);
+            std::memcpy(to, from->data() + head_offset, to_move * sizeof(*to));
+            head_offset += to_move;
             to += to_move;
             size_ -= to_move;
             to_move = 0;
-            --from_bi;
         }
     }
     copied -= to_move;
+    PIXIE_TRACEPOINT2(queue_copy, copied, size_);
     if (from_bi != buffers.begin()) {
         buffers.erase(buffers.begin(), from_bi);
     }
@@ -218,67 +688,60 @@ void queue::compact() {
     lock_guard guard(lock);
     if (queue_trace) {
         check("compact start");
+        xia_log(log::debug) << "compact: buffers=" << buffers.size();
     }
     /*
-     * Erasing elements from the queue's container invalidates the
-     * iterators. After moving one or more buffers into another buffer and
-     * removing them we start again, so we have valid iterators.
+     * A single pass packs the data into the front of the queue. The
+     * buffer being filled is at `to_bi` and the next buffer with data is
+     * at `from_bi`. A buffer that is emptied is released and a buffer
+     * that is partly moved becomes the buffer being filled so each
+     * buffer's data is moved at most twice. The packed buffers are
+     * compressed to the front of the container and the tail is erased
+     * once.
      */
-    bool rerun = true;
-    while (rerun) {
-        rerun = false;
-        if (queue_trace) {
-            xia_log(log::debug) << "compact: buffers=" << buffers.size();
-        }
+    trim_head();
+    if (buffers.size() > 1) {
         auto to_bi = buffers.begin();
-        while (to_bi != buffers.end()) {
+        for (auto from_bi = to_bi + 1; from_bi != buffers.end(); ++from_bi) {
             auto& to = *to_bi;
-            auto to_move = to->capacity() - to->size();
-            auto from_bi = to_bi + 1;
-            if (to_move > 0 && from_bi != buffers.end()) {
-                auto erase_from = buffers.end();
-                auto erase_to = buffers.end();
-                while (to_move > 0 && from_bi != buffers.end()) {
-                    auto from = *from_bi;
-                    if (queue_trace) {
-                        xia_log(log::debug) << "compact: move=" << to_move
-                                            << " to=" << to->data() << '/' << to->size()
-                                            << " from=" << from->data() << '/' << from->size();
-                    }
-                    if (to_move >= from->size()) {
-                        to->insert(to->end(), from->begin(), from->end());
-                        to_move -= from->size();
-                        if (erase_from == buffers.end()) {
-                            erase_from = from_bi;
-                        }
-                        from_bi++;
-                        erase_to = from_bi;
-                        from->clear();
-                    } else {
-                        to->insert(to->end(), from->begin(), from->begin() + to_move);
-                        from->erase(from->begin(), from->begin() + to_move);
-                        to_move = 0;
-                    }
-                    if (queue_trace) {
-                        xia_log(log::debug) << "compact: moved:    "
-                                            << " to=" << to->data() << '/' << to->size()
-                                            << " from=" << from->data() << '/' << from->size();
-                    }
+            auto from = *from_bi;
+            auto to_move = std::min(to->capacity() - to->size(), from->size());
+            if (queue_trace) {
+                xia_log(log::debug) << "compact: move=" << to_move
+                                    << " to=" << to->data() << '/' << to->size()
+                                    << " from=" << from->data() << '/' << from->size();
+            }
+            if (to_move > 0) {
+                to->insert(to->end(), from->begin(), from->begin() + to_move);
+            }
+            if (to_move == from->size()) {
+                from->clear();
+                from_bi->reset();
+            } else {
+                if (to_move > 0) {
+                    from->erase(from->begin(), from->begin() + to_move);
                 }
-                if (erase_from != buffers.end()) {
-                    buffers.erase(erase_from, erase_to);
-                    rerun = true;
-                    break;
+                ++to_bi;
+                if (to_bi != from_bi) {
+                    *to_bi = std::move(*from_bi);
                 }
             }
-            to_bi++;
         }
+        buffers.erase(to_bi + 1, buffers.end());
     }
     if (queue_trace) {
-        check("compact start");
+        check("compact end");
     }
 }
 
+void queue::reserve(const size_t count) {
+    lock_guard guard(lock);
+    cache.limit(2 * count * sizeof(handle) + node_cache::default_limit_bytes);
+    const size_t held = buffers.size();
+    buffers.resize(held + count);
+    buffers.resize(held);
+}
+
 bool queue::empty() {
     lock_guard guard(lock);
     return buffers.empty();
@@ -287,7 +750,7 @@ bool queue::empty() {
 size_t queue::size() {
     lock_guard guard(lock);
     return size_;
-    }
+}
 
 size_t queue::count() {
     lock_guard guard(lock);
@@ -298,32 +761,254 @@ void queue::flush() {
     lock_guard guard(lock);
     buffers.clear();
     size_ = 0;
+    head_offset = 0;
 }
 
 void queue::output(std::ostream& out) {
     out << "count=" << count() << " size=" << size();
 }
 
+void queue::trim_head() {
+    if (head_offset != 0) {
+        auto& front = buffers.front();
+        front->erase(front->begin(), front->begin() + head_offset);
+        head_offset = 0;
+    }
+}
+
 void queue::check(const char* label) {
     size_t csize = 0;
+    size_t offset = head_offset;
     size_t zero_pairs = 0;
     buffer_value prev = 1;
     for (auto& buf : buffers) {
-        csize += buf->size();
+        csize += buf->size() - offset;
         auto* ptr = buf->data();
-        for (size_t i = 0; i < buf->size(); ++i) {
+        for (size_t i = offset; i < buf->size(); ++i) {
             if (ptr[i] == 0 && prev == 0) {
                 ++zero_pairs;
             }
             prev = ptr[i];
         }
+        offset = 0;
     }
     xia_log(log::debug) << "queue::check: " << label << ": found=" << csize << " has=" << size_
                         << " buffers=" << buffers.size() << " zero-pairs=" << zero_pairs;
 }
+
+ring::ring() : head(0), tail(0), size_(0) {}
+
+ring::~ring() {
+    destroy();
+}
+
+void ring::create(const size_t capacity_) {
+    xia_log(log::info) << "ring create: capacity=" << capacity_;
+    if (valid()) {
+        throw error(error::code::buffer_pool_not_empty, "ring is already created");
+    }
+    if (capacity_ == 0) {
+        throw error(error::code::invalid_value, "ring capacity is 0");
+    }
+    slots.resize(capacity_);
+    head = 0;
+    tail = 0;
+    size_ = 0;
+}
+
+void ring::destroy() {
+    if (valid()) {
+        xia_log(log::info) << "ring destroy";
+        flush();
+        slots.clear();
+        slots.shrink_to_fit();
+    }
+}
+
+bool ring::push(handle buf) {
+    if (buf->size() == 0) {
+        return true;
+    }
+    const size_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) >= slots.size()) {
+        return false;
+    }
+    auto buf_size = buf->size();
+    slots[h % slots.size()] = std::move(buf);
+    size_.fetch_add(buf_size, std::memory_order_release);
+    head.store(h + 1, std::memory_order_release);
+    return true;
+}
+
+handle ring::pop() {
+    const size_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) {
+        return handle();
+    }
+    handle buf = std::move(slots[t % slots.size()]);
+    slots[t % slots.size()].reset();
+    size_.fetch_sub(buf->size(), std::memory_order_release);
+    tail.store(t + 1, std::memory_order_release);
+    return buf;
+}
+
+size_t ring::drain(queue& to) {
+    size_t drained = 0;
+    while (true) {
+        handle buf = pop();
+        if (!buf) {
+            break;
+        }
+        drained += buf->size();
+        to.push(buf);
+    }
+    return drained;
+}
+
+void ring::flush() {
+    while (pop()) {
+    }
+}
+
+void ring::output(std::ostream& out) {
+    out << "count=" << count() << " size=" << size() << " capacity=" << capacity();
+}
+
+fanout::consumer::consumer(fanout& fan_, size_t id_) : id(id_), fan(fan_) {}
+
+fanout::consumer::~consumer() {
+    fan.unsubscribe(id);
+}
+
+size_t fanout::consumer::read(queue::handles& buffers, const size_t max_buffers) {
+    return fan.read(id, buffers, max_buffers);
+}
+
+size_t fanout::consumer::available() const {
+    lock_guard guard(fan.lock);
+    auto& cur = fan.find(id);
+    const uint64_t end = fan.base + fan.buffers.size();
+    return cur.next < fan.base ? fan.buffers.size() : size_t(end - cur.next);
+}
+
+size_t fanout::consumer::dropped() const {
+    lock_guard guard(fan.lock);
+    auto& cur = fan.find(id);
+    return cur.dropped + (cur.next < fan.base ? size_t(fan.base - cur.next) : 0);
+}
+
+fanout::fanout(const source& src_, const size_t max_held_)
+    : max_held(max_held_), src(src_), base(0), next_id(0) {
+    if (!src) {
+        throw error(error::code::invalid_value, "fanout: no source");
+    }
+}
+
+fanout::~fanout() {
+    lock_guard guard(lock);
+    if (!cursors.empty()) {
+        xia_log(log::warning) << "fanout: destroyed with consumers: " << cursors.size();
+    }
+    buffers.clear();
+}
+
+fanout::consumer_ptr fanout::subscribe() {
+    lock_guard guard(lock);
+    cursors.push_back({next_id, base + buffers.size(), 0});
+    return consumer_ptr(new consumer(*this, next_id++));
+}
+
+size_t fanout::pull() {
+    lock_guard guard(lock);
+    const size_t words = pull_unprotected();
+    trim();
+    return words;
+}
+
+size_t fanout::held() const {
+    lock_guard guard(lock);
+    return buffers.size();
+}
+
+size_t fanout::consumers() const {
+    lock_guard guard(lock);
+    return cursors.size();
+}
+
+fanout::cursor& fanout::find(size_t id) {
+    auto ci = std::find_if(cursors.begin(), cursors.end(),
+                           [id](const cursor& cur) { return cur.id == id; });
+    if (ci == cursors.end()) {
+        throw error(error::code::invalid_value, "fanout: consumer not found");
+    }
+    return *ci;
+}
+
+void fanout::unsubscribe(size_t id) {
+    lock_guard guard(lock);
+    cursors.erase(std::remove_if(cursors.begin(), cursors.end(),
+                                 [id](const cursor& cur) { return cur.id == id; }),
+                  cursors.end());
+    trim();
+}
+
+size_t fanout::read(size_t id, queue::handles& to, const size_t max_buffers) {
+    lock_guard guard(lock);
+    pull_unprotected();
+    auto& cur = find(id);
+    if (cur.next < base) {
+        cur.dropped += size_t(base - cur.next);
+        cur.next = base;
+    }
+    size_t words = 0;
+    size_t count = size_t(base + buffers.size() - cur.next);
+    if (max_buffers != 0) {
+        count = std::min(count, max_buffers);
+    }
+    for (size_t b = size_t(cur.next - base); count > 0; ++b, --count) {
+        words += buffers[b]->size();
+        to.push_back(buffers[b]);
+        ++cur.next;
+    }
+    trim();
+    return words;
+}
+
+size_t fanout::pull_unprotected() {
+    queue::handles pulled;
+    const size_t words = src(pulled);
+    for (auto& buf : pulled) {
+        buffers.push_back(std::move(buf));
+    }
+    return words;
+}
+
+/*
+ * Release the buffers all the consumers have read then the oldest
+ * buffers above the limit.
+ */
+void fanout::trim() {
+    uint64_t oldest = base + buffers.size();
+    for (auto& cur : cursors) {
+        oldest = std::min(oldest, cur.next);
+    }
+    while (base < oldest) {
+        buffers.pop_front();
+        ++base;
+    }
+    while (max_held != 0 && buffers.size() > max_held) {
+        buffers.pop_front();
+        ++base;
+    }
+}
 }  // namespace buffer
 }  // namespace xia
 
+std::ostream& operator<<(std::ostream& out, xia::buffer::arena::pages pages) {
+    out << xia::buffer::pages_label(pages);
+    return out;
+}
+
 std::ostream& operator<<(std::ostream& out, xia::buffer::pool& pool) {
     pool.output(out);
     return out;
@@ -333,3 +1018,8 @@ std::ostream& operator<<(std::ostream& out, xia::buffer::queue& queue) {
     queue.output(out);
     return out;
 }
+
+std::ostream& operator<<(std::ostream& out, xia::buffer::ring& ring) {
+    ring.output(out);
+    return out;
+}
@@ -20,10 +20,26 @@
  * @brief Implements data structures and functions for working with SDK configuration files.
  */
 #include <algorithm>
+#include <cstring>
 #include <exception>
 #include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#if defined(_WIN64) || defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 #include <pixie/config.hpp>
+#include <pixie/util.hpp>
 
 #include <nolhmann/json.hpp>
 
@@ -32,10 +48,6 @@ namespace pixie {
 namespace config {
 using json = nlohmann::json;
 
-static void throw_json_error(json::exception& e, const std::string& what) {
-    throw error(error::code::config_json_error, what + ": " + e.what());
-}
-
 //@todo Need to make this more dynamic to take into account changes to the DSP vars.
 /*
  * Default values maybe applied to all modules. Do not set values
@@ -118,225 +130,645 @@ static const json default_config = {
         {"U00", {0, 0, 0, 0, 0, 0, 0}},
         {"UserIn", {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}}}}}}};
 
-void import_json(const std::string& filename, crate::crate& crate, module::number_slots& loaded) {
-    std::ifstream input_json(filename);
-    if (!input_json) {
-        throw error(pixie::error::code::file_open_failure,
-                    "opening json config: " + filename + ": " + std::strerror(errno));
+/*
+ * A module's configuration. The values are held until the module's object
+ * has been parsed as the keys of an exported configuration are sorted
+ * and the metadata follows the channels.
+ */
+struct var_config {
+    std::string name;
+    std::vector<param::value_type> values;
+};
+
+typedef std::vector<var_config> var_configs;
+
+struct module_config {
+    bool has_metadata;
+    bool has_module;
+    bool has_channel;
+    bool has_module_input;
+    bool has_channel_input;
+    bool has_slot;
+    std::string revision;
+    int slot;
+    var_configs module_vars;
+    var_configs channel_vars;
+
+    module_config();
+};
+
+typedef std::vector<module_config> module_configs;
+typedef std::shared_ptr<const module_configs> module_configs_ptr;
+
+module_config::module_config()
+    : has_metadata(false), has_module(false), has_channel(false), has_module_input(false),
+      has_channel_input(false), has_slot(false), slot(-1) {}
+
+/*
+ * A SAX parser of a JSON configuration. The depth of the containers
+ * locates a value:
+ *
+ *   1: the array of modules
+ *   2: a module's object of sections
+ *   3: the metadata or the module or channel section
+ *   4: the section's input variables
+ *   5: a variable's array of values
+ *
+ * Values not used by the import are skipped.
+ */
+class parser : public json::json_sax_t {
+public:
+    explicit parser(module_configs& configs);
+
+    bool null() override;
+    bool boolean(bool val) override;
+    bool number_integer(number_integer_t val) override;
+    bool number_unsigned(number_unsigned_t val) override;
+    bool number_float(number_float_t val, const string_t& s) override;
+    bool string(string_t& val) override;
+    bool binary(binary_t& val) override;
+    bool start_object(std::size_t elements) override;
+    bool key(string_t& val) override;
+    bool end_object() override;
+    bool start_array(std::size_t elements) override;
+    bool end_array() override;
+    bool parse_error(std::size_t position, const std::string& last_token,
+                     const json::exception& ex) override;
+
+private:
+    enum struct section { none, metadata, module, channel };
+
+    bool skip_start();
+    bool skip_end();
+    bool skip_scalar();
+    void value(param::value_type val);
+    void invalid();
+
+    module_configs& configs;
+    size_t depth;
+    size_t skip;
+    bool skip_next;
+    section sect;
+    std::string key_;
+    var_config* var;
+};
+
+parser::parser(module_configs& configs_)
+    : configs(configs_), depth(0), skip(0), skip_next(false), sect(section::none),
+      var(nullptr) {}
+
+bool parser::null() {
+    if (!skip_scalar()) {
+        invalid();
+    }
+    return true;
+}
+
+bool parser::boolean(bool) {
+    if (!skip_scalar()) {
+        invalid();
     }
+    return true;
+}
 
-    json config;
+bool parser::number_integer(number_integer_t val) {
+    if (!skip_scalar()) {
+        value(param::value_type(val));
+    }
+    return true;
+}
 
-    try {
-        config = json::parse(input_json);
-    } catch (json::exception& e) {
-        throw_json_error(e, "parse config");
+bool parser::number_unsigned(number_unsigned_t val) {
+    if (!skip_scalar()) {
+        value(param::value_type(val));
     }
+    return true;
+}
 
-    if (config.size() > crate.num_modules) {
-        xia_log(log::warning) << "too many module configs (" << config.size() << "), crate only has "
-                              << crate.num_modules << " modules ";
+bool parser::number_float(number_float_t val, const string_t&) {
+    if (!skip_scalar()) {
+        value(param::value_type(val));
     }
+    return true;
+}
 
-    if (config.size() < crate.num_modules) {
-        xia_log(log::warning) << "too few module configs (" << config.size() << "), crate has "
-                              << crate.num_modules
-                              << " modules. Using default config for missing modules";
-        while (config.size() < crate.num_modules) {
-            config.push_back(default_config);
+bool parser::string(string_t& val) {
+    if (!skip_scalar()) {
+        if (depth == 3 && sect == section::metadata && key_ == "hardware_revision") {
+            configs.back().revision = val;
+        } else {
+            invalid();
         }
     }
+    return true;
+}
 
-    size_t mod = 0;
-    auto ci = config.begin();
+bool parser::binary(binary_t&) {
+    if (!skip_scalar()) {
+        invalid();
+    }
+    return true;
+}
 
-    while (mod < crate.num_modules) {
-        auto& module = crate[mod];
+bool parser::start_object(std::size_t) {
+    if (skip_start()) {
+        return true;
+    }
+    switch (depth) {
+    case 1:
+        configs.emplace_back();
+        break;
+    case 2:
+        break;
+    case 3:
+        if (sect == section::metadata) {
+            invalid();
+        }
+        break;
+    default:
+        invalid();
+    }
+    ++depth;
+    return true;
+}
 
-        if (!module.online()) {
-            xia_log(log::warning) << "module " << mod << " not online, skipping";
+bool parser::key(string_t& val) {
+    if (skip > 0) {
+        return true;
+    }
+    auto& config = configs.back();
+    switch (depth) {
+    case 2:
+        key_ = val;
+        if (val == "metadata") {
+            sect = section::metadata;
+            config.has_metadata = true;
+        } else if (val == "module") {
+            sect = section::module;
+            config.has_module = true;
+        } else if (val == "channel") {
+            sect = section::channel;
+            config.has_channel = true;
         } else {
-            auto& settings = *ci;
-
-            if (!settings.contains("metadata")) {
-                throw error(error::code::config_json_error, "'metadata' not found");
+            skip_next = true;
+        }
+        break;
+    case 3:
+        key_ = val;
+        if (sect == section::metadata) {
+            if (val != "hardware_revision" && val != "slot") {
+                skip_next = true;
             }
-
-            if (!settings.contains("module")) {
-                throw error(error::code::config_json_error, "'module' not found");
+        } else if (val == "input") {
+            if (sect == section::module) {
+                config.has_module_input = true;
+            } else {
+                config.has_channel_input = true;
             }
+        } else {
+            skip_next = true;
+        }
+        break;
+    case 4: {
+        auto& vars = sect == section::module ? config.module_vars : config.channel_vars;
+        vars.emplace_back();
+        vars.back().name = val;
+        var = &vars.back();
+        key_ = val;
+        break;
+    }
+    default:
+        break;
+    }
+    return true;
+}
 
-            if (!settings.contains("channel")) {
-                throw error(error::code::config_json_error, "'channel' not found");
-            }
+bool parser::end_object() {
+    if (skip_end()) {
+        return true;
+    }
+    --depth;
+    if (depth == 2) {
+        sect = section::none;
+    }
+    var = nullptr;
+    return true;
+}
 
-            auto metadata = settings["metadata"];
-            auto moddata = settings["module"];
-            auto chandata = settings["channel"];
+bool parser::start_array(std::size_t) {
+    if (skip_start()) {
+        return true;
+    }
+    if ((depth != 0 && depth != 4) || (depth == 4 && var == nullptr)) {
+        invalid();
+    }
+    ++depth;
+    return true;
+}
 
-            if (!moddata.contains("input")) {
-                throw error(error::code::config_json_error, "module 'input' not found");
-            }
+bool parser::end_array() {
+    if (skip_end()) {
+        return true;
+    }
+    --depth;
+    if (depth == 4) {
+        var = nullptr;
+    }
+    return true;
+}
 
-            if (!chandata.contains("input")) {
-                throw error(error::code::config_json_error, "channel 'input' not found");
-            }
+bool parser::parse_error(std::size_t, const std::string&, const json::exception& ex) {
+    throw error(error::code::config_json_error, std::string("parse config: ") + ex.what());
+}
 
-            try {
-                auto rev = metadata["hardware_revision"].get<std::string>();
-                if (rev[0] != module.revision_label()) {
-                    xia_log(log::warning) << "config module " << mod << " (rev " << rev
-                                          << ") loading on to " << module.revision_label();
-                }
-            } catch (json::exception& e) {
-                throw_json_error(e, "config rev");
-            }
+bool parser::skip_start() {
+    if (skip > 0) {
+        ++skip;
+        return true;
+    }
+    if (skip_next) {
+        skip_next = false;
+        skip = 1;
+        return true;
+    }
+    return false;
+}
 
-            try {
-                auto slot = metadata["slot"];
-                if (slot != module.slot) {
-                    xia_log(log::warning) << "config module " << mod << " (slot " << slot
-                                          << ") has moved to slot " << module.slot;
-                }
-            } catch (json::exception& e) {
-                throw_json_error(e, "config slot-id");
+bool parser::skip_end() {
+    if (skip > 0) {
+        --skip;
+        return true;
+    }
+    return false;
+}
+
+bool parser::skip_scalar() {
+    if (skip > 0) {
+        return true;
+    }
+    if (skip_next) {
+        skip_next = false;
+        return true;
+    }
+    return false;
+}
+
+void parser::value(param::value_type val) {
+    if (depth == 3 && sect == section::metadata && key_ == "slot") {
+        configs.back().slot = int(val);
+        configs.back().has_slot = true;
+    } else if ((depth == 4 || depth == 5) && var != nullptr) {
+        var->values.push_back(val);
+        if (depth == 4) {
+            var = nullptr;
+        }
+    } else {
+        invalid();
+    }
+}
+
+void parser::invalid() {
+    if (depth == 0) {
+        throw error(error::code::config_json_error, "parse config: not an array of modules");
+    }
+    if (depth == 1) {
+        throw error(error::code::config_json_error, "parse config: module not an object");
+    }
+    if (depth == 3 && sect == section::metadata) {
+        throw error(error::code::config_json_error, "config " + key_ + ": invalid value");
+    }
+    throw error(error::code::config_json_error, "parse config: invalid value: " + key_);
+}
+
+static void parse(const char* data, size_t size, module_configs& configs) {
+    parser handler(configs);
+    json::sax_parse(data, data + size, &handler);
+}
+
+/*
+ * A file's identity. The modification time includes the nanoseconds so a
+ * file rewritten with the same size in the same second is seen as changed.
+ */
+struct file_id {
+    size_t size;
+    time_t modified;
+    long modified_nsecs;
+    dev_t device;
+    ino_t inode;
+
+    file_id(const struct stat& sb);
+
+    bool operator==(const file_id& other) const {
+        return size == other.size && modified == other.modified &&
+            modified_nsecs == other.modified_nsecs && device == other.device &&
+            inode == other.inode;
+    }
+    bool operator!=(const file_id& other) const {
+        return !(*this == other);
+    }
+};
+
+file_id::file_id(const struct stat& sb)
+    : size(size_t(sb.st_size)), modified(sb.st_mtime),
+#if defined(_WIN64) || defined(_WIN32)
+      modified_nsecs(0),
+#elif defined(__APPLE__)
+      modified_nsecs(long(sb.st_mtimespec.tv_nsec)),
+#else
+      modified_nsecs(long(sb.st_mtim.tv_nsec)),
+#endif
+      device(sb.st_dev), inode(sb.st_ino) {
+}
+
+/*
+ * Process wide parse cache. A cached configuration is used if the file's
+ * identity has not changed.
+ */
+struct parse_cache {
+    struct entry {
+        file_id id;
+        module_configs_ptr configs;
+    };
+
+    typedef std::map<std::string, entry> entries;
+
+    std::mutex lock;
+    entries files;
+    bool enabled;
+
+    parse_cache() : enabled(true) {}
+
+    module_configs_ptr find(const std::string& filename, const struct stat& sb);
+    void add(const std::string& filename, const struct stat& sb, module_configs_ptr configs);
+};
+
+static parse_cache cache;
+
+module_configs_ptr parse_cache::find(const std::string& filename, const struct stat& sb) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto fi = files.find(filename);
+    if (fi == files.end()) {
+        return {};
+    }
+    auto& e = fi->second;
+    if (e.id != file_id(sb)) {
+        files.erase(fi);
+        return {};
+    }
+    return e.configs;
+}
+
+void parse_cache::add(const std::string& filename, const struct stat& sb,
+                      module_configs_ptr configs) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (enabled) {
+        files.erase(filename);
+        files.emplace(filename, entry{file_id(sb), configs});
+    }
+}
+
+/*
+ * Read a file with a single read.
+ */
+static void read_file(const std::string& filename, std::vector<char>& data, struct stat& sb) {
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw error(pixie::error::code::file_open_failure,
+                    "opening json config: " + filename + ": " + std::strerror(errno));
+    }
+    try {
+        if (::fstat(fd, &sb) < 0) {
+            throw error(error::code::file_read_failure,
+                        "config stat: " + filename + ": " + std::strerror(errno));
+        }
+        const size_t size = size_t(sb.st_size);
+        data.resize(size);
+        size_t offset = 0;
+        while (offset < size) {
+            auto nr = ::read(fd, data.data() + offset, static_cast<unsigned int>(size - offset));
+            if (nr < 0) {
+                throw error(error::code::file_read_failure,
+                            "config read: " + filename + ": " + std::strerror(errno));
             }
+            if (nr == 0) {
+                throw error(error::code::file_read_failure,
+                            "config read: " + filename + ": short read");
+            }
+            offset += size_t(nr);
+        }
+        ::close(fd);
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+}
 
-            /*
-             * Write the config to the module variables
-             */
-            for (auto& el : moddata["input"].items()) {
-                /*
-                 * Load variables first and if not a variable check if it is a
-                 * parameter and if not a parameter log a warning. This puts
-                 * variables before parameters and ignores parameters if
-                 * present.
-                 */
-                if (param::is_module_var(el.key())) {
-                    auto var = param::lookup_module_var(el.key());
-                    auto& desc = module.module_var_descriptors[int(var)];
-                    if (desc.writeable()) {
-                        if (desc.size != el.value().size()) {
-                            xia_log(log::warning) << module::module_label(module)
-                                                  << "size does not match: " << el.key();
-                        } else {
-                            xia_log(log::debug)
-                                << module::module_label(module) << "module var set: " << el.key();
-                            if (desc.size > 1) {
-                                for (size_t v = 0; v < desc.size; ++v) {
-                                    try {
-                                        module.write_var(var, el.value()[v], v, false);
-                                    } catch (json::exception& e) {
-                                        auto s = el.key() + ": " + std::string(el.value());
-                                        throw_json_error(e, s);
-                                    }
-                                }
-                            } else {
-                                try {
-                                    if (desc.par == xia::pixie::param::module_var::SlotID) {
-                                        module.write_var(var, module.slot, 0, false);
-                                    } else if (desc.par == xia::pixie::param::module_var::ModNum) {
-                                        module.write_var(var, module.number, 0, false);
-                                    } else {
-                                        module.write_var(var, el.value(), 0, false);
-                                    }
-                                } catch (json::exception& e) {
-                                    auto s = el.key() + ": " + std::string(el.value());
-                                    throw_json_error(e, s);
-                                }
-                            }
+static const module_config& default_module_config() {
+    static const module_configs defaults = [] {
+        module_configs configs;
+        auto text = json::array({default_config}).dump();
+        parse(text.data(), text.size(), configs);
+        return configs;
+    }();
+    return defaults[0];
+}
+
+/*
+ * Write a variable's value or only update it if changed. Returns 1 if
+ * the value was written.
+ */
+static size_t write_var(module::module& module, param::module_var var, param::value_type value,
+                        size_t offset, bool changes_only) {
+    if (changes_only) {
+        return module.update_var(var, value, offset) ? 1 : 0;
+    }
+    module.write_var(var, value, offset, false);
+    return 1;
+}
+
+static size_t write_var(module::module& module, param::channel_var var, param::value_type value,
+                        size_t channel, size_t offset, bool changes_only) {
+    if (changes_only) {
+        return module.update_var(var, value, channel, offset) ? 1 : 0;
+    }
+    module.write_var(var, value, channel, offset, false);
+    return 1;
+}
+
+static size_t import_module_vars(const module_config& config, module::module& module, size_t mod,
+                                 bool changes_only) {
+    size_t written = 0;
+    /*
+     * Load variables first and if not a variable check if it is a
+     * parameter and if not a parameter log a warning. This puts
+     * variables before parameters and ignores parameters if present.
+     */
+    for (auto& el : config.module_vars) {
+        if (param::is_module_var(el.name)) {
+            auto var = param::lookup_module_var(el.name);
+            auto& desc = module.module_var_descriptors[int(var)];
+            if (desc.writeable()) {
+                if (desc.size != el.values.size()) {
+                    xia_log(log::warning)
+                        << module::module_label(module) << "size does not match: " << el.name;
+                } else {
+                    xia_log(log::debug)
+                        << module::module_label(module) << "module var set: " << el.name;
+                    for (size_t v = 0; v < desc.size; ++v) {
+                        auto value = el.values[v];
+                        if (desc.size == 1 && desc.par == param::module_var::SlotID) {
+                            value = param::value_type(module.slot);
+                        } else if (desc.size == 1 && desc.par == param::module_var::ModNum) {
+                            value = param::value_type(module.number);
                         }
+                        written += write_var(module, var, value, v, changes_only);
                     }
-                } else if (!param::is_module_param(el.key())) {
-                    /*
-                     * If not a parameter (ignore those) log a message
-                     */
-                    xia_log(log::warning) << "config module " << mod << " (slot " << module.slot
-                                          << "): invalid variable: " << el.key();
                 }
             }
-
+        } else if (!param::is_module_param(el.name)) {
             /*
-             * Write the config to the channel variables
+             * If not a parameter (ignore those) log a message
              */
-            for (auto& el : chandata["input"].items()) {
-                /*
-                 * Load variables first and if not a variable check if it is a
-                 * parameter and if not a parameter log a warning. This puts
-                 * variables before parameters and ignores parameters if
-                 * present.
-                 */
-                if (param::is_channel_var(el.key())) {
-                    auto var = param::lookup_channel_var(el.key());
-                    auto& desc = module.channel_var_descriptors[int(var)];
-                    if (desc.writeable()) {
-                        if ((el.value().size() % desc.size) != 0) {
-                            xia_log(log::warning) << module::module_label(module)
-                                                  << "size does not match config: " << el.key();
-                        } else {
-                            xia_log(log::debug)
-                                << module::module_label(module) << "channel var set: " << el.key()
-                                << ": " << el.value();
-                            size_t vchannels = el.value().size() / desc.size;
-
-                            if (vchannels < module.num_channels) {
-                                if (metadata["hardware_revision"].get<std::string>() != "DEFAULT") {
-                                    xia_log(log::warning) << module::module_label(module) << el.key()
-                                                          << " config has too few elements. "
-                                                          << "vchannels= " << vchannels
-                                                          << " num_channels=" << module.num_channels;
-                                }
-
-                                xia_log(log::debug) << module::module_label(module) << "extending "
-                                                    << el.key() << " to " << module.num_channels
-                                                    << " elements using value at index 0.";
-                                for (size_t idx = vchannels; idx < module.num_channels; idx++) {
-                                    el.value().push_back(el.value()[0]);
-                                }
-
-                                vchannels = el.value().size() / desc.size;
-                            }
-
-                            for (size_t channel = 0;
-                                 channel < module.num_channels && channel < vchannels &&
-                                 channel * desc.size < el.value().size();
-                                 ++channel) {
-                                size_t vbase = channel * desc.size;
-                                for (size_t v = 0; v < desc.size; ++v) {
-                                    try {
-                                        module.write_var(var, el.value()[vbase + v], channel, v,
-                                                         false);
-                                    } catch (json::exception& e) {
-                                        auto s =
-                                            el.key() + ": " + std::string(el.value()[vbase + v]);
-                                        throw_json_error(e, s);
-                                    }
-                                }
-                            }
+            xia_log(log::warning) << "config module " << mod << " (slot " << module.slot
+                                  << "): invalid variable: " << el.name;
+        }
+    }
+    return written;
+}
+
+static size_t import_channel_vars(const module_config& config, module::module& module, size_t mod,
+                                  bool changes_only) {
+    size_t written = 0;
+    for (auto& el : config.channel_vars) {
+        if (param::is_channel_var(el.name)) {
+            auto var = param::lookup_channel_var(el.name);
+            auto& desc = module.channel_var_descriptors[int(var)];
+            if (desc.writeable()) {
+                if (el.values.empty() || (el.values.size() % desc.size) != 0) {
+                    xia_log(log::warning) << module::module_label(module)
+                                          << "size does not match config: " << el.name;
+                } else {
+                    xia_log(log::debug)
+                        << module::module_label(module) << "channel var set: " << el.name;
+                    const size_t vchannels = el.values.size() / desc.size;
+                    if (vchannels < module.num_channels) {
+                        if (config.revision != "DEFAULT") {
+                            xia_log(log::warning)
+                                << module::module_label(module) << el.name
+                                << " config has too few elements. "
+                                << "vchannels= " << vchannels
+                                << " num_channels=" << module.num_channels;
+                        }
+                        xia_log(log::debug)
+                            << module::module_label(module) << "extending " << el.name << " to "
+                            << module.num_channels << " elements using value at index 0.";
+                    }
+                    for (size_t channel = 0; channel < module.num_channels; ++channel) {
+                        /*
+                         * Channels missing from the config use the first
+                         * value.
+                         */
+                        for (size_t v = 0; v < desc.size; ++v) {
+                            auto value =
+                                channel < vchannels ? el.values[channel * desc.size + v] :
+                                el.values[0];
+                            written += write_var(module, var, value, channel, v, changes_only);
                         }
                     }
-                } else if (!param::is_channel_param(el.key())) {
-                    /*
-                     * If not a parameter (ignore those) log a message
-                     */
-                    xia_log(log::warning) << "config module " << mod << " (slot " << module.slot
-                                          << "): invalid variable: " << el.key();
                 }
             }
+        } else if (!param::is_channel_param(el.name)) {
+            /*
+             * If not a parameter (ignore those) log a message
+             */
+            xia_log(log::warning) << "config module " << mod << " (slot " << module.slot
+                                  << "): invalid variable: " << el.name;
+        }
+    }
+    return written;
+}
+
+static void import_module(const module_config& config, module::module& module, size_t mod,
+                          bool changes_only) {
+    if (!config.has_metadata) {
+        throw error(error::code::config_json_error, "'metadata' not found");
+    }
+    if (!config.has_module) {
+        throw error(error::code::config_json_error, "'module' not found");
+    }
+    if (!config.has_channel) {
+        throw error(error::code::config_json_error, "'channel' not found");
+    }
+    if (!config.has_module_input) {
+        throw error(error::code::config_json_error, "module 'input' not found");
+    }
+    if (!config.has_channel_input) {
+        throw error(error::code::config_json_error, "channel 'input' not found");
+    }
+    if (config.revision.empty()) {
+        throw error(error::code::config_json_error, "config rev: not found");
+    }
+    if (config.revision[0] != module.revision_label()) {
+        xia_log(log::warning) << "config module " << mod << " (rev " << config.revision
+                              << ") loading on to " << module.revision_label();
+    }
+    if (config.has_slot && config.slot != module.slot) {
+        xia_log(log::warning) << "config module " << mod << " (slot " << config.slot
+                              << ") has moved to slot " << module.slot;
+    }
+    size_t written = import_module_vars(config, module, mod, changes_only);
+    written += import_channel_vars(config, module, mod, changes_only);
+    xia_log(log::debug) << module::module_label(module) << "config: values written=" << written
+                        << " changes-only=" << std::boolalpha << changes_only;
+}
+
+static void import_modules(const module_configs& configs, crate::crate& crate,
+                           module::number_slots& loaded, bool changes_only) {
+    if (configs.size() > crate.num_modules) {
+        xia_log(log::warning) << "too many module configs (" << configs.size()
+                              << "), crate only has " << crate.num_modules << " modules ";
+    }
+
+    if (configs.size() < crate.num_modules) {
+        xia_log(log::warning) << "too few module configs (" << configs.size() << "), crate has "
+                              << crate.num_modules
+                              << " modules. Using default config for missing modules";
+    }
 
+    for (size_t mod = 0; mod < crate.num_modules; ++mod) {
+        auto& module = crate[mod];
+        if (!module.online()) {
+            xia_log(log::warning) << "module " << mod << " not online, skipping";
+        } else {
+            auto& config = mod < configs.size() ? configs[mod] : default_module_config();
+            import_module(config, module, mod, changes_only);
             /*
              * Record the module had been loaded.
              */
             loaded.push_back(module::number_slot(module.number, module.slot));
         }
+    }
+}
 
-        ++ci;
-        if (ci == config.end()) {
-            break;
-        }
-
-        ++mod;
+void import_json(const std::string& filename, crate::crate& crate, module::number_slots& loaded,
+                 bool changes_only) {
+    struct stat sb;
+    module_configs_ptr configs;
+    if (::stat(filename.c_str(), &sb) == 0) {
+        configs = cache.find(filename, sb);
+    }
+    const bool cached = !!configs;
+    if (!cached) {
+        std::vector<char> data;
+        read_file(filename, data, sb);
+        auto parsed = std::make_shared<module_configs>();
+        parse(data.data(), data.size(), *parsed);
+        configs = parsed;
+        cache.add(filename, sb, configs);
     }
+    xia_log(log::debug) << "config: import: " << filename << " modules=" << configs->size()
+                        << " cached=" << std::boolalpha << cached;
+    import_modules(*configs, crate, loaded, changes_only);
 }
 
 static json json_firmware(const firmware::firmware_ref fw) {
@@ -350,86 +782,464 @@ static json json_firmware(const firmware::firmware_ref fw) {
     return jfw;
 }
 
-void export_json(const std::string& filename, crate::crate& crate) {
-    json config;
+/*
+ * A snapshot is a header followed by the modules' variables as 32bit
+ * words in host order. Names are a length followed by the characters
+ * padded to a word. The CRC covers the words after the header.
+ *
+ *   header: magic, version, modules, words, crc
+ *   module: revision label, number, slot, channels,
+ *           module vars: count, { name, size, values[size] }
+ *           channel vars: count, { name, size, values[size * channels] }
+ */
+static constexpr uint32_t snapshot_magic = 0x534e4358; /* "XCNS" */
+static constexpr uint32_t snapshot_version = 1;
+static constexpr size_t snapshot_header_words = 5;
 
-    for (auto m : crate.modules) {
-        module::module& mod = *m;
+namespace {
+struct snapshot_writer {
+    std::vector<uint32_t> words;
 
-        /*
-         * Refresh the vairables from the DSP before exporting
-         */
-        mod.sync_vars(module::module::sync_from_dsp);
+    void put(uint32_t word) {
+        words.push_back(word);
+    }
+    void put(const std::string& s) {
+        put(uint32_t(s.size()));
+        const size_t base = words.size();
+        words.resize(base + (s.size() + sizeof(uint32_t) - 1) / sizeof(uint32_t), 0);
+        std::memcpy(&words[base], s.data(), s.size());
+    }
+};
 
-        json metadata;
-        char rv[2] = {mod.revision_label(), '\0'};
-        metadata["number"] = mod.number;
-        metadata["slot"] = mod.slot;
-        metadata["serial-num"] = mod.serial_num;
-        metadata["hardware_revision"] = rv;
-        metadata["num-channels"] = mod.num_channels;
-        metadata["sys"] = json_firmware(mod.get("sys"));
-        metadata["fippi"] = json_firmware(mod.get("fippi"));
-        metadata["dsp"] = json_firmware(mod.get("dsp"));
-        metadata["var"] = json_firmware(mod.get("var"));
-        metadata["fifo"]["buffers"] = mod.fifo_buffers;
-        metadata["fifo"]["run-wait"] = mod.fifo_run_wait_usecs.load();
-        metadata["fifo"]["idle-wait"] = mod.fifo_idle_wait_usecs.load();
-        metadata["fifo"]["hold"] = mod.fifo_hold_usecs.load();
-        metadata["config"] = json::array();
-        for (auto& chan : mod.channels) {
-            json cfg;
-            cfg["adc_bits"] = chan.fixture->config.adc_bits;
-            cfg["adc_msps"] = chan.fixture->config.adc_msps;
-            cfg["adc_clk_div"] = chan.fixture->config.adc_clk_div;
-            cfg["fpga_clk_mhz"] = chan.fixture->config.fpga_clk_mhz;
-            metadata["config"].push_back(cfg);
+struct snapshot_reader {
+    const uint32_t* words;
+    size_t remaining;
+
+    uint32_t get() {
+        if (remaining == 0) {
+            throw error(error::code::config_json_error, "config snapshot: truncated");
         }
+        --remaining;
+        return *words++;
+    }
+    std::string get_string() {
+        const size_t length = get();
+        const size_t count = (length + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+        if (count > remaining) {
+            throw error(error::code::config_json_error, "config snapshot: truncated");
+        }
+        std::string s(reinterpret_cast<const char*>(words), length);
+        words += count;
+        remaining -= count;
+        return s;
+    }
+    /*
+     * Get a count of items that each take at least a number of words. A
+     * count larger than the remaining words can hold is invalid.
+     */
+    size_t get_count(size_t item_words) {
+        const size_t count = get();
+        if (count > remaining / item_words) {
+            throw error(error::code::config_json_error, "config snapshot: invalid count");
+        }
+        return count;
+    }
+    void get_values(std::vector<param::value_type>& values) {
+        const size_t count = get();
+        if (count > remaining) {
+            throw error(error::code::config_json_error, "config snapshot: truncated");
+        }
+        values.assign(words, words + count);
+        words += count;
+        remaining -= count;
+    }
+};
+}  // namespace
 
-        json module;
-        for (auto& var : mod.module_vars) {
-            auto& desc = var.var;
-            if (desc.mode != param::ro) {
-                if (desc.size == 1) {
-                    module[desc.name] = var.value[0].value;
-                } else {
-                    json value;
-                    for (auto v : var.value) {
-                        value.push_back(v.value);
-                    }
-                    module[desc.name] = value;
-                }
+bool is_snapshot(const std::string& filename) {
+    std::ifstream input(filename, std::ios::in | std::ios::binary);
+    uint32_t magic = 0;
+    input.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    return input && magic == snapshot_magic;
+}
+
+void import_snapshot(const std::string& filename, crate::crate& crate,
+                     module::number_slots& loaded, bool changes_only) {
+    std::vector<char> data;
+    struct stat sb;
+    read_file(filename, data, sb);
+    if (data.size() < snapshot_header_words * sizeof(uint32_t) ||
+        (data.size() % sizeof(uint32_t)) != 0) {
+        throw error(error::code::file_size_invalid, "config snapshot: invalid size: " + filename);
+    }
+    std::vector<uint32_t> words(data.size() / sizeof(uint32_t));
+    std::memcpy(words.data(), data.data(), data.size());
+    if (words[0] != snapshot_magic) {
+        throw error(error::code::config_json_error, "config snapshot: invalid magic: " + filename);
+    }
+    if (words[1] != snapshot_version) {
+        throw error(error::code::config_json_error,
+                    "config snapshot: unsupported version: " + std::to_string(words[1]));
+    }
+    if (words[3] != words.size() - snapshot_header_words) {
+        throw error(error::code::file_size_invalid, "config snapshot: invalid length: " + filename);
+    }
+    util::crc32 crc;
+    crc.update(words, snapshot_header_words);
+    if (crc.value != words[4]) {
+        throw error(error::code::config_json_error, "config snapshot: CRC mismatch: " + filename);
+    }
+    snapshot_reader reader = {words.data() + snapshot_header_words,
+                              words.size() - snapshot_header_words};
+    /*
+     * The module count is in the header which the CRC does not cover. A
+     * module has at least 6 words and a variable at least 2.
+     */
+    const size_t module_words = 6;
+    const size_t var_words = 2;
+    if (words[2] > reader.remaining / module_words) {
+        throw error(error::code::config_json_error,
+                    "config snapshot: invalid module count: " + filename);
+    }
+    module_configs configs(words[2]);
+    for (auto& config : configs) {
+        config.has_metadata = true;
+        config.has_module = true;
+        config.has_channel = true;
+        config.has_module_input = true;
+        config.has_channel_input = true;
+        config.revision = std::string(1, char(reader.get()));
+        reader.get(); /* number */
+        config.slot = int(reader.get());
+        config.has_slot = true;
+        reader.get(); /* channels */
+        for (auto vars : {&config.module_vars, &config.channel_vars}) {
+            vars->resize(reader.get_count(var_words));
+            for (auto& var : *vars) {
+                var.name = reader.get_string();
+                reader.get_values(var.values);
             }
         }
+    }
+    xia_log(log::debug) << "config: import snapshot: " << filename
+                        << " modules=" << configs.size();
+    import_modules(configs, crate, loaded, changes_only);
+}
 
-        json channel;
-        for (auto& desc : mod.channel_var_descriptors) {
-            if (desc.mode != param::ro) {
-                json values;
-                for (auto& chan : mod.channels) {
-                    for (auto& v : chan.vars[int(desc.par)].value) {
-                        values.push_back(v.value);
-                    }
-                }
-                channel[desc.name] = values;
+namespace {
+/*
+ * A streaming JSON writer. The output is the same as a DOM's dump with an
+ * indent of 4 so exports compare with earlier exports.
+ */
+struct json_writer {
+    std::ostream& out;
+    size_t depth;
+    std::vector<bool> empty;
+
+    json_writer(std::ostream& out_, size_t depth_ = 0) : out(out_), depth(depth_) {}
+
+    void newline() {
+        out << '\n' << std::string(depth * 4, ' ');
+    }
+    void open(char bracket) {
+        out << bracket;
+        ++depth;
+        empty.push_back(true);
+    }
+    void close(char bracket) {
+        --depth;
+        if (!empty.back()) {
+            newline();
+        }
+        empty.pop_back();
+        out << bracket;
+    }
+    void item() {
+        if (!empty.back()) {
+            out << ',';
+        }
+        empty.back() = false;
+        newline();
+    }
+    void key(const std::string& name) {
+        item();
+        out << json(name).dump() << ": ";
+    }
+    void value(param::value_type v) {
+        out << v;
+    }
+    void value(const json& j) {
+        if (j.is_object()) {
+            open('{');
+            for (auto& e : j.items()) {
+                key(e.key());
+                value(e.value());
+            }
+            close('}');
+        } else if (j.is_array()) {
+            open('[');
+            for (auto& e : j) {
+                item();
+                value(e);
             }
+            close(']');
+        } else {
+            out << j.dump();
         }
+    }
+};
+
+/*
+ * A module's export. The JSON text is the module's object in the array of
+ * modules.
+ */
+struct module_export {
+    std::string json_text;
+    snapshot_writer snapshot;
+};
+typedef std::vector<module_export> module_exports;
+}  // namespace
 
-        json mod_config;
-        mod_config["metadata"] = metadata;
-        mod_config["module"] = {{"input", module}};
-        mod_config["channel"] = {{"input", channel}};
+static void export_module_json(module::module& mod, std::string& text) {
+    json metadata;
+    char rv[2] = {mod.revision_label(), '\0'};
+    metadata["number"] = mod.number;
+    metadata["slot"] = mod.slot;
+    metadata["serial-num"] = mod.serial_num;
+    metadata["hardware_revision"] = rv;
+    metadata["num-channels"] = mod.num_channels;
+    metadata["sys"] = json_firmware(mod.get("sys"));
+    metadata["fippi"] = json_firmware(mod.get("fippi"));
+    metadata["dsp"] = json_firmware(mod.get("dsp"));
+    metadata["var"] = json_firmware(mod.get("var"));
+    metadata["fifo"]["buffers"] = mod.fifo_buffers;
+    metadata["fifo"]["buffer-words"] = mod.fifo_buffer_words;
+    metadata["fifo"]["run-wait"] = mod.fifo_run_wait_usecs.load();
+    metadata["fifo"]["idle-wait"] = mod.fifo_idle_wait_usecs.load();
+    metadata["fifo"]["hold"] = mod.fifo_hold_usecs.load();
+    metadata["config"] = json::array();
+    for (auto& chan : mod.channels) {
+        json cfg;
+        cfg["adc_bits"] = chan.fixture->config.adc_bits;
+        cfg["adc_msps"] = chan.fixture->config.adc_msps;
+        cfg["adc_clk_div"] = chan.fixture->config.adc_clk_div;
+        cfg["fpga_clk_mhz"] = chan.fixture->config.fpga_clk_mhz;
+        metadata["config"].push_back(cfg);
+    }
+
+    /*
+     * The variables are written in name order, the order of a DOM's keys.
+     */
+    std::vector<size_t> module_vars;
+    for (size_t v = 0; v < mod.module_vars.size(); ++v) {
+        if (mod.module_vars[v].var.mode != param::ro) {
+            module_vars.push_back(v);
+        }
+    }
+    std::sort(module_vars.begin(), module_vars.end(), [&mod](size_t a, size_t b) {
+        return mod.module_vars[a].var.name < mod.module_vars[b].var.name;
+    });
+    std::vector<size_t> channel_vars;
+    for (size_t v = 0; v < mod.channel_var_descriptors.size(); ++v) {
+        if (mod.channel_var_descriptors[v].mode != param::ro) {
+            channel_vars.push_back(v);
+        }
+    }
+    std::sort(channel_vars.begin(), channel_vars.end(), [&mod](size_t a, size_t b) {
+        return mod.channel_var_descriptors[a].name < mod.channel_var_descriptors[b].name;
+    });
+
+    std::ostringstream out;
+    json_writer writer(out, 1);
+    writer.open('{');
+    writer.key("channel");
+    writer.open('{');
+    writer.key("input");
+    writer.open('{');
+    for (auto v : channel_vars) {
+        auto& desc = mod.channel_var_descriptors[v];
+        writer.key(desc.name);
+        writer.open('[');
+        for (auto& chan : mod.channels) {
+            for (auto& value : chan.vars[int(desc.par)].value) {
+                writer.item();
+                writer.value(value.value);
+            }
+        }
+        writer.close(']');
+    }
+    writer.close('}');
+    writer.close('}');
+    writer.key("metadata");
+    writer.value(metadata);
+    writer.key("module");
+    writer.open('{');
+    writer.key("input");
+    writer.open('{');
+    for (auto v : module_vars) {
+        auto& var = mod.module_vars[v];
+        writer.key(var.var.name);
+        if (var.var.size == 1) {
+            writer.value(var.value[0].value);
+        } else {
+            writer.open('[');
+            for (auto& value : var.value) {
+                writer.item();
+                writer.value(value.value);
+            }
+            writer.close(']');
+        }
+    }
+    writer.close('}');
+    writer.close('}');
+    writer.close('}');
+    text = out.str();
+}
+
+static void export_module_snapshot(module::module& mod, snapshot_writer& writer) {
+    writer.put(uint32_t(mod.revision_label()));
+    writer.put(uint32_t(mod.number));
+    writer.put(uint32_t(mod.slot));
+    writer.put(uint32_t(mod.num_channels));
+    uint32_t count = 0;
+    for (auto& var : mod.module_vars) {
+        count += var.var.mode != param::ro ? 1 : 0;
+    }
+    writer.put(count);
+    for (auto& var : mod.module_vars) {
+        if (var.var.mode != param::ro) {
+            writer.put(var.var.name);
+            writer.put(uint32_t(var.value.size()));
+            for (auto& v : var.value) {
+                writer.put(v.value);
+            }
+        }
+    }
+    count = 0;
+    for (auto& desc : mod.channel_var_descriptors) {
+        count += desc.mode != param::ro ? 1 : 0;
+    }
+    writer.put(count);
+    for (auto& desc : mod.channel_var_descriptors) {
+        if (desc.mode != param::ro) {
+            writer.put(desc.name);
+            writer.put(uint32_t(desc.size * mod.channels.size()));
+            for (auto& chan : mod.channels) {
+                for (auto& v : chan.vars[int(desc.par)].value) {
+                    writer.put(v.value);
+                }
+            }
+        }
+    }
+}
 
-        config.push_back(mod_config);
+/*
+ * Refresh the modules' variables from the DSPs and format the exports on
+ * the crate's workers so the modules are read in parallel. A module's
+ * variables are read with block reads of the variable image.
+ */
+static void export_modules(crate::crate& crate, bool as_json, bool as_snapshot,
+                           module_exports& exports) {
+    exports.clear();
+    exports.resize(crate.modules.size());
+    crate::crate::module_numbers mod_nums;
+    for (size_t m = 0; m < crate.modules.size(); ++m) {
+        mod_nums.push_back(m);
     }
+    crate.run_modules("export config", mod_nums,
+                      [&crate, &exports, as_json, as_snapshot](module::module& mod) {
+        auto mi = std::find_if(crate.modules.begin(), crate.modules.end(),
+                               [&mod](const module::module_ptr& m) { return m.get() == &mod; });
+        auto& exp = exports[size_t(std::distance(crate.modules.begin(), mi))];
+        mod.sync_vars(module::module::sync_from_dsp);
+        if (as_json) {
+            export_module_json(mod, exp.json_text);
+        }
+        if (as_snapshot) {
+            export_module_snapshot(mod, exp.snapshot);
+        }
+    });
+}
 
-    std::ofstream output_json(filename);
-    if (!output_json) {
+static void write_json(const std::string& filename, const module_exports& exports) {
+    std::ofstream output(filename);
+    if (!output) {
         throw error(pixie::error::code::file_open_failure,
                     "opening json config: " + filename + ": " + std::strerror(errno));
     }
+    json_writer writer(output);
+    writer.open('[');
+    for (auto& exp : exports) {
+        writer.item();
+        output << exp.json_text;
+    }
+    writer.close(']');
+    output << std::endl;
+    if (!output) {
+        throw error(pixie::error::code::file_write_failure, "writing json config: " + filename);
+    }
+}
+
+static void write_snapshot(const std::string& filename, const module_exports& exports) {
+    std::vector<uint32_t> words(snapshot_header_words, 0);
+    for (auto& exp : exports) {
+        words.insert(words.end(), exp.snapshot.words.begin(), exp.snapshot.words.end());
+    }
+    util::crc32 crc;
+    crc.update(words, snapshot_header_words);
+    words[0] = snapshot_magic;
+    words[1] = snapshot_version;
+    words[2] = uint32_t(exports.size());
+    words[3] = uint32_t(words.size() - snapshot_header_words);
+    words[4] = crc.value;
+    std::ofstream output(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!output) {
+        throw error(pixie::error::code::file_open_failure,
+                    "opening config snapshot: " + filename + ": " + std::strerror(errno));
+    }
+    output.write(reinterpret_cast<const char*>(words.data()), words.size() * sizeof(uint32_t));
+    if (!output) {
+        throw error(pixie::error::code::file_write_failure,
+                    "writing config snapshot: " + filename);
+    }
+}
+
+void export_json(const std::string& filename, crate::crate& crate) {
+    export_config(filename, "", crate);
+}
+
+void export_snapshot(const std::string& filename, crate::crate& crate) {
+    export_config("", filename, crate);
+}
+
+void export_config(const std::string& json_file, const std::string& snapshot_file,
+                   crate::crate& crate) {
+    module_exports exports;
+    export_modules(crate, !json_file.empty(), !snapshot_file.empty(), exports);
+    if (!json_file.empty()) {
+        write_json(json_file, exports);
+    }
+    if (!snapshot_file.empty()) {
+        write_snapshot(snapshot_file, exports);
+    }
+}
+
+void parse_cache_enable(bool enable) {
+    std::lock_guard<std::mutex> guard(cache.lock);
+    cache.enabled = enable;
+    if (!enable) {
+        cache.files.clear();
+    }
+}
+
+void parse_cache_clear() {
+    std::lock_guard<std::mutex> guard(cache.lock);
+    cache.files.clear();
+}
 
-    output_json << std::setw(4) << config << std::endl;
+size_t parse_cache_files() {
+    std::lock_guard<std::mutex> guard(cache.lock);
+    return cache.files.size();
 }
 
 }  // namespace config
@@ -0,0 +1,166 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file energy.cpp
+ * @brief Implements the recomputation of list-mode energies from the energy sums.
+ */
+
+#include <cmath>
+#include <limits>
+
+#include <pixie/error.hpp>
+
+#include <pixie/data/energy.hpp>
+
+namespace xia {
+namespace pixie {
+namespace data {
+namespace energy {
+using error = pixie::error::error;
+
+static const double nan = std::numeric_limits<double>::quiet_NaN();
+
+/*
+ * The sum words of an event, the baseline word is decoded separately.
+ */
+static constexpr size_t sum_words = 3;
+
+filter::filter()
+    : rise_time_usecs(0), flat_top_usecs(0), tau_usecs(0), sample_usecs(0), scale(1) {}
+
+size_t filter::rise_samples() const {
+    return size_t(std::lround(rise_time_usecs / sample_usecs));
+}
+
+size_t filter::flat_top_samples() const {
+    return size_t(std::lround(flat_top_usecs / sample_usecs));
+}
+
+void filter::validate() const {
+    if (!(sample_usecs > 0)) {
+        throw error(error::code::invalid_value, "energy: invalid sample period");
+    }
+    if (!(tau_usecs > 0)) {
+        throw error(error::code::invalid_value, "energy: invalid tau");
+    }
+    if (!(rise_time_usecs > 0) || rise_samples() == 0) {
+        throw error(error::code::invalid_value, "energy: invalid rise time");
+    }
+    if (!(flat_top_usecs >= 0)) {
+        throw error(error::code::invalid_value, "energy: invalid flat top");
+    }
+    if (!(scale > 0)) {
+        throw error(error::code::invalid_value, "energy: invalid scale");
+    }
+}
+
+coefficients::coefficients() : leading(nan), gap(nan), trailing(nan) {}
+
+/*
+ * The coefficients of Pixie16ComputeSlowFiltersOffline. The decay of the
+ * preamplifier's signal over a sample is b1.
+ */
+coefficients::coefficients(const filter& filt) {
+    filt.validate();
+    const double b1 = std::exp(-filt.sample_usecs / filt.tau_usecs);
+    const double b1_rise = std::pow(b1, double(filt.rise_samples()));
+    leading = -(1.0 - b1) * b1_rise * filt.scale / (1.0 - b1_rise);
+    gap = (1.0 - b1) * filt.scale;
+    trailing = (1.0 - b1) * filt.scale / (1.0 - b1_rise);
+}
+
+void compute(const coefficients& coeffs, const uint32_t* sums, const double* baselines,
+             size_t count, double* energies) {
+    for (size_t e = 0; e < count; ++e) {
+        energies[e] = compute(coeffs, sums + e * sum_words, baselines[e]);
+    }
+}
+
+void results::clear() {
+    energy.clear();
+    leading.clear();
+    gap.clear();
+    trailing.clear();
+    c_leading.clear();
+    c_gap.clear();
+    c_trailing.clear();
+}
+
+void recompute(const list_mode::event_batch& batch, const filters& channel_filters,
+               results& out) {
+    if (!batch.holds(list_mode::scan_energy_sums | list_mode::scan_ids)) {
+        throw error(error::code::invalid_value, "energy: batch has no energy sums or ids");
+    }
+    std::vector<coefficients> channel_coeffs;
+    channel_coeffs.reserve(channel_filters.size());
+    for (auto& filt : channel_filters) {
+        channel_coeffs.emplace_back(filt);
+    }
+    const size_t events = batch.size();
+    out.energy.resize(events);
+    out.leading.resize(events);
+    out.gap.resize(events);
+    out.trailing.resize(events);
+    out.c_leading.resize(events);
+    out.c_gap.resize(events);
+    out.c_trailing.resize(events);
+    /*
+     * Gather the columns. An event without sums or a filter has NaN
+     * coefficients so its energy is NaN without a branch in the kernel.
+     */
+    const coefficients none;
+    for (size_t e = 0; e < events; ++e) {
+        const size_t offset = batch.energy_sums_offset[e];
+        const size_t channel = batch.channel[e];
+        const coefficients& coeffs =
+            offset == list_mode::event_batch::no_data || channel >= channel_coeffs.size() ?
+            none : channel_coeffs[channel];
+        out.c_leading[e] = coeffs.leading;
+        out.c_gap[e] = coeffs.gap;
+        out.c_trailing[e] = coeffs.trailing;
+        if (offset != list_mode::event_batch::no_data) {
+            const uint32_t* sums = batch.energy_sums.data() + offset;
+            out.leading[e] = sums[0];
+            out.gap[e] = sums[1];
+            out.trailing[e] = sums[2];
+        } else {
+            out.leading[e] = 0;
+            out.gap[e] = 0;
+            out.trailing[e] = 0;
+        }
+    }
+    /*
+     * The kernel.
+     */
+    const double* leading = out.leading.data();
+    const double* gap = out.gap.data();
+    const double* trailing = out.trailing.data();
+    const double* c_leading = out.c_leading.data();
+    const double* c_gap = out.c_gap.data();
+    const double* c_trailing = out.c_trailing.data();
+    const double* baseline = batch.filter_baseline.data();
+    double* energy = out.energy.data();
+    for (size_t e = 0; e < events; ++e) {
+        energy[e] = c_leading[e] * leading[e] + c_gap[e] * gap[e] + c_trailing[e] * trailing[e] -
+            baseline[e];
+    }
+}
+}  // namespace energy
+}  // namespace data
+}  // namespace pixie
+}  // namespace xia
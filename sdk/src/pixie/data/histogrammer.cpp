@@ -0,0 +1,382 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file histogrammer.cpp
+ * @brief Implements an online histogrammer filled from decoded list-mode events.
+ */
+
+#include <cmath>
+#include <limits>
+
+#include <pixie/error.hpp>
+
+#include <pixie/data/histogrammer.hpp>
+
+namespace xia {
+namespace pixie {
+namespace data {
+namespace list_mode {
+
+constexpr histogrammer::id_type histogrammer::any;
+constexpr size_t histogrammer::qdc_sums;
+
+static const double no_time = std::numeric_limits<double>::quiet_NaN();
+
+static uint64_t channel_key(const histogrammer::channel_id& chan) {
+    return (uint64_t(chan.crate) << 32) | (uint64_t(chan.slot) << 16) | chan.channel;
+}
+
+static uint64_t channel_key(const event_batch& batch, size_t event) {
+    return (uint64_t(batch.crate[event]) << 32) | (uint64_t(batch.slot[event]) << 16) |
+        batch.channel[event];
+}
+
+histogrammer::axis::axis() : low(0), high(1), bins(1), scale(1) {}
+
+histogrammer::axis::axis(double low_, double high_, size_t bins_)
+    : low(low_), high(high_), bins(bins_), scale(0) {
+    if (bins == 0 || !(high > low)) {
+        throw error(error::code::invalid_value, "histogrammer: invalid axis");
+    }
+    scale = double(bins) / (high - low);
+}
+
+double histogrammer::axis::bin_low(size_t bin) const {
+    return low + double(bin) / scale;
+}
+
+histogrammer::channel_id::channel_id() : crate(any), slot(any), channel(any) {}
+
+histogrammer::channel_id::channel_id(id_type crate_, id_type slot_, id_type channel_)
+    : crate(crate_), slot(slot_), channel(channel_) {}
+
+histogrammer::snapshot::snapshot() : outside(0) {}
+
+uint64_t histogrammer::snapshot::entries() const {
+    uint64_t total = outside;
+    for (auto c : counts) {
+        total += c;
+    }
+    return total;
+}
+
+histogrammer::definition::definition() : type(kind::energy), tail(0), total(0) {}
+
+histogrammer::histogrammer(size_t shards) : filling(false) {
+    if (shards == 0) {
+        throw error(error::code::invalid_value, "histogrammer: no shards");
+    }
+    for (size_t s = 0; s < shards; ++s) {
+        shards_.emplace_back(new shard);
+    }
+}
+
+histogrammer::~histogrammer() {}
+
+size_t histogrammer::add_energy(const std::string& name, const channel_id& chan, const axis& x) {
+    definition def;
+    def.name = name;
+    def.type = kind::energy;
+    def.chan = chan;
+    def.x = x;
+    return add(def);
+}
+
+size_t histogrammer::add_time_difference(const std::string& name, const channel_id& start,
+                                         const channel_id& stop, const axis& x) {
+    definition def;
+    def.name = name;
+    def.type = kind::time_difference;
+    def.chan = start;
+    def.stop = stop;
+    def.x = x;
+    return add(def);
+}
+
+size_t histogrammer::add_energy_psd(const std::string& name, const channel_id& chan,
+                                    const axis& energy, const axis& psd, size_t tail,
+                                    size_t total) {
+    if (tail >= qdc_sums || total >= qdc_sums) {
+        throw error(error::code::invalid_value, "histogrammer: invalid QDC sum: " + name);
+    }
+    definition def;
+    def.name = name;
+    def.type = kind::energy_psd;
+    def.chan = chan;
+    def.x = energy;
+    def.y = psd;
+    def.tail = tail;
+    def.total = total;
+    return add(def);
+}
+
+size_t histogrammer::add(const std::string& name, const axis& x, value_1d value) {
+    if (!value) {
+        throw error(error::code::invalid_value, "histogrammer: no value: " + name);
+    }
+    definition def;
+    def.name = name;
+    def.type = kind::user_1d;
+    def.x = x;
+    def.value_x = value;
+    return add(def);
+}
+
+size_t histogrammer::add(const std::string& name, const axis& x, const axis& y,
+                         value_2d value) {
+    if (!value) {
+        throw error(error::code::invalid_value, "histogrammer: no value: " + name);
+    }
+    definition def;
+    def.name = name;
+    def.type = kind::user_2d;
+    def.x = x;
+    def.y = y;
+    def.value_xy = value;
+    return add(def);
+}
+
+size_t histogrammer::add(definition& def) {
+    if (filling.load()) {
+        throw error(error::code::invalid_value, "histogrammer: filling has started: " + def.name);
+    }
+    if (def.name.empty()) {
+        throw error(error::code::invalid_value, "histogrammer: no name");
+    }
+    for (auto& d : definitions) {
+        if (d.name == def.name) {
+            throw error(error::code::invalid_value, "histogrammer: name in use: " + def.name);
+        }
+    }
+    const size_t hist = definitions.size();
+    const size_t bins = def.x.bins * def.y.bins + 1;
+    for (auto& sh : shards_) {
+        sh->hists.emplace_back(new counters(bins));
+        sh->last_start.push_back(no_time);
+        sh->last_stop.push_back(no_time);
+    }
+    switch (def.type) {
+        case kind::user_1d:
+        case kind::user_2d:
+            all_events.push_back(hist);
+            break;
+        case kind::time_difference:
+            if (def.chan.wildcard() || def.stop.wildcard()) {
+                all_events.push_back(hist);
+            } else {
+                by_channel[channel_key(def.chan)].push_back(hist);
+                if (channel_key(def.stop) != channel_key(def.chan)) {
+                    by_channel[channel_key(def.stop)].push_back(hist);
+                }
+            }
+            break;
+        default:
+            if (def.chan.wildcard()) {
+                all_events.push_back(hist);
+            } else {
+                by_channel[channel_key(def.chan)].push_back(hist);
+            }
+            break;
+    }
+    definitions.push_back(std::move(def));
+    return hist;
+}
+
+void histogrammer::fill(size_t shard_, const event_batch& batch) {
+    if (shard_ >= shards_.size()) {
+        throw error(error::code::invalid_value,
+                    "histogrammer: invalid shard: " + std::to_string(shard_));
+    }
+    if (!filling.load(std::memory_order_relaxed)) {
+        filling = true;
+    }
+    auto& sh = *shards_[shard_];
+    const size_t events = batch.size();
+    /*
+     * Runs of events from the same channel are common in a module's
+     * stream, look the channel up once for a run.
+     */
+    const std::vector<size_t>* hists = nullptr;
+    uint64_t last_key = 0;
+    bool looked_up = false;
+    for (size_t event = 0; event < events; ++event) {
+        if (!by_channel.empty()) {
+            const auto key = channel_key(batch, event);
+            if (!looked_up || key != last_key) {
+                auto found = by_channel.find(key);
+                hists = found == by_channel.end() ? nullptr : &found->second;
+                last_key = key;
+                looked_up = true;
+            }
+            if (hists != nullptr) {
+                for (auto hist : *hists) {
+                    fill(sh, hist, batch, event);
+                }
+            }
+        }
+        for (auto hist : all_events) {
+            fill(sh, hist, batch, event);
+        }
+    }
+}
+
+void histogrammer::fill(shard& sh, size_t hist, const event_batch& batch, size_t event) {
+    auto& def = definitions[hist];
+    auto& counts = *sh.hists[hist];
+    const size_t outside = counts.size() - 1;
+    size_t bin = outside;
+    switch (def.type) {
+        case kind::energy:
+            if (!def.chan.matches(batch, event)) {
+                return;
+            }
+            bin = def.x.bin(batch.energy[event]);
+            break;
+        case kind::time_difference: {
+            /*
+             * An event can be both the start and the stop when the
+             * channels overlap.
+             */
+            const double time = batch.time[event];
+            const bool start = def.chan.matches(batch, event);
+            const bool stop = def.stop.matches(batch, event);
+            if (stop) {
+                if (!std::isnan(sh.last_start[hist])) {
+                    count(counts[def.x.bin(time - sh.last_start[hist])]);
+                }
+                sh.last_stop[hist] = time;
+            }
+            if (start) {
+                if (!stop && !std::isnan(sh.last_stop[hist])) {
+                    count(counts[def.x.bin(sh.last_stop[hist] - time)]);
+                }
+                sh.last_start[hist] = time;
+            }
+            return;
+        }
+        case kind::energy_psd: {
+            if (!def.chan.matches(batch, event)) {
+                return;
+            }
+            const size_t offset = batch.qdc_offset[event];
+            if (offset == event_batch::no_data) {
+                return;
+            }
+            const double total = batch.qdc[offset + def.total];
+            if (total == 0) {
+                return;
+            }
+            const double psd = batch.qdc[offset + def.tail] / total;
+            const size_t x = def.x.bin(batch.energy[event]);
+            const size_t y = def.y.bin(psd);
+            if (x != def.x.bins && y != def.y.bins) {
+                bin = y * def.x.bins + x;
+            }
+            break;
+        }
+        case kind::user_1d: {
+            double x;
+            if (!def.value_x(batch, event, x)) {
+                return;
+            }
+            bin = def.x.bin(x);
+            break;
+        }
+        case kind::user_2d: {
+            double x;
+            double y;
+            if (!def.value_xy(batch, event, x, y)) {
+                return;
+            }
+            const size_t xb = def.x.bin(x);
+            const size_t yb = def.y.bin(y);
+            if (xb != def.x.bins && yb != def.y.bins) {
+                bin = yb * def.x.bins + xb;
+            }
+            break;
+        }
+    }
+    count(counts[bin]);
+}
+
+void histogrammer::decode(size_t shard_, uint32_t* data, size_t len, size_t revision,
+                          size_t frequency, buffer& leftovers) {
+    if (shard_ >= shards_.size()) {
+        throw error(error::code::invalid_value,
+                    "histogrammer: invalid shard: " + std::to_string(shard_));
+    }
+    auto& batch = shards_[shard_]->batch;
+    batch.clear();
+    decode_data_block(data, len, revision, frequency, batch, leftovers);
+    fill(shard_, batch);
+}
+
+batch_handler histogrammer::handler() {
+    return [this](size_t worker, event_batch& batch) { fill(worker, batch); };
+}
+
+size_t histogrammer::find(const std::string& name) const {
+    for (size_t hist = 0; hist < definitions.size(); ++hist) {
+        if (definitions[hist].name == name) {
+            return hist;
+        }
+    }
+    throw error(error::code::invalid_value, "histogrammer: not found: " + name);
+}
+
+void histogrammer::get(size_t hist, snapshot& snap) const {
+    if (hist >= definitions.size()) {
+        throw error(error::code::invalid_value,
+                    "histogrammer: invalid histogram: " + std::to_string(hist));
+    }
+    auto& def = definitions[hist];
+    snap.name = def.name;
+    snap.x = def.x;
+    snap.y = def.y;
+    const size_t bins = def.x.bins * def.y.bins;
+    snap.counts.assign(bins, 0);
+    snap.outside = 0;
+    for (auto& sh : shards_) {
+        auto& counts = *sh->hists[hist];
+        for (size_t bin = 0; bin < bins; ++bin) {
+            snap.counts[bin] += counts[bin].load(std::memory_order_relaxed);
+        }
+        snap.outside += counts[bins].load(std::memory_order_relaxed);
+    }
+}
+
+void histogrammer::get(snapshots& snaps) const {
+    snaps.resize(definitions.size());
+    for (size_t hist = 0; hist < definitions.size(); ++hist) {
+        get(hist, snaps[hist]);
+    }
+}
+
+void histogrammer::clear() {
+    for (auto& sh : shards_) {
+        for (auto& counts : sh->hists) {
+            for (auto& c : *counts) {
+                c.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+}  // namespace list_mode
+}  // namespace data
+}  // namespace pixie
+}  // namespace xia
@@ -20,6 +20,24 @@
  * @brief Defines classes and functions useful for list-mode data processing.
  */
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PIXIE_LIST_MODE_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PIXIE_LIST_MODE_NEON 1
+#endif
+
 #include <pixie/error.hpp>
 #include <pixie/util.hpp>
 
@@ -27,6 +45,15 @@
 
 #include <nolhmann/json.hpp>
 
+#if defined(_WIN64) || defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace xia {
 namespace pixie {
 namespace data {
@@ -39,30 +66,10 @@ static constexpr size_t num_esum_words = 4;
 static constexpr size_t num_ext_ts_words = 2;
 static constexpr size_t min_slot_id = 2;
 static constexpr size_t max_slot_id = 14;
+static constexpr size_t parallel_chunk_words = 4 * 1024 * 1024;
 
 using json = nlohmann::json;
 
-/**
- * @brief Describes the elements that need to be decoded out of a list-mode event
- */
-enum struct element {
-    cfd_forced_trigger_bit,
-    cfd_fractional_time,
-    cfd_trigger_source_bit,
-    channel_number,
-    crate_id,
-    energy,
-    event_length,
-    event_time_high,
-    event_time_low,
-    finish_code,
-    header_length,
-    slot_id,
-    trace_length,
-    trace_out_of_range_flag,
-    END
-};
-
 void json_to_record(const std::string& json_string, record& rec) {
     /*
      * We define a dummy double here because the JSON deseralizer can't get to
@@ -99,6 +106,9 @@ void json_to_record(const std::string& json_string, record& rec) {
 
         val.at("time").get_to(dummy);
         rec.time = record::time_type(dummy);
+        rec.timestamp = 0;
+        rec.cfd_fixed_time = record::to_fixed_time(rec.cfd_fractional_time);
+        rec.fixed_time = record::to_fixed_time(rec.time);
 
         val.at("trace_out_of_range").get_to(rec.trace_out_of_range);
         val.at("trace").get_to(rec.trace);
@@ -131,11 +141,274 @@ std::string record_to_json(const record& evt) {
     return val.dump();
 }
 
+/*
+ * Little endian binary encoding.
+ */
+static void put_u8(uint8_t*& out, const uint8_t value) {
+    *out++ = value;
+}
+
+static void put_u16(uint8_t*& out, const uint16_t value) {
+    *out++ = static_cast<uint8_t>(value);
+    *out++ = static_cast<uint8_t>(value >> 8);
+}
+
+static void put_u32(uint8_t*& out, const uint32_t value) {
+    for (int b = 0; b < 32; b += 8) {
+        *out++ = static_cast<uint8_t>(value >> b);
+    }
+}
+
+static void put_f64(uint8_t*& out, const double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    for (int b = 0; b < 64; b += 8) {
+        *out++ = static_cast<uint8_t>(bits >> b);
+    }
+}
+
+static uint8_t get_u8(const uint8_t*& in) {
+    return *in++;
+}
+
+static uint16_t get_u16(const uint8_t*& in) {
+    uint16_t value = uint16_t(in[0]) | uint16_t(uint16_t(in[1]) << 8);
+    in += 2;
+    return value;
+}
+
+static uint32_t get_u32(const uint8_t*& in) {
+    uint32_t value = 0;
+    for (int b = 0; b < 4; ++b) {
+        value |= uint32_t(in[b]) << (b * 8);
+    }
+    in += 4;
+    return value;
+}
+
+static double get_f64(const uint8_t*& in) {
+    uint64_t bits = 0;
+    for (int b = 0; b < 8; ++b) {
+        bits |= uint64_t(in[b]) << (b * 8);
+    }
+    in += 8;
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+enum binary_flags : uint8_t {
+    binary_cfd_forced_trigger = 1 << 0,
+    binary_finish_code = 1 << 1,
+    binary_trace_out_of_range = 1 << 2
+};
+
+template<typename T>
+static void check_binary_value(const T value, const size_t max, const char* what) {
+    if (static_cast<size_t>(value) > max) {
+        throw error(error::code::invalid_value,
+                    std::string("binary record: value out of range: ") + what + ": " +
+                        std::to_string(value));
+    }
+}
+
+size_t binary_record_size(const record& rec) {
+    const size_t size = binary_record_header_size +
+                        (rec.energy_sums.size() + rec.qdc.size()) * sizeof(uint32_t) +
+                        rec.trace.size() * sizeof(uint16_t);
+    return (size + 3) & ~size_t(3);
+}
+
+void record_to_binary(const record& rec, binary& out) {
+    check_binary_value(rec.cfd_trigger_source, 0xFF, "cfd_trigger_source");
+    check_binary_value(rec.crate_id, 0xFFFF, "crate_id");
+    check_binary_value(rec.slot_id, 0xFFFF, "slot_id");
+    check_binary_value(rec.channel_number, 0xFFFF, "channel_number");
+    check_binary_value(rec.header_length, 0xFFFF, "header_length");
+    check_binary_value(rec.event_length, 0xFFFFFFFF, "event_length");
+    check_binary_value(rec.trace_length, 0xFFFFFFFF, "trace_length");
+    check_binary_value(rec.energy_sums.size(), 0xFFFF, "energy_sums");
+    check_binary_value(rec.qdc.size(), 0xFFFF, "qdc");
+    check_binary_value(rec.trace.size(), 0xFFFFFFFF, "trace");
+    for (auto value : rec.energy_sums) {
+        check_binary_value(value, 0xFFFFFFFF, "energy_sums");
+    }
+    for (auto value : rec.qdc) {
+        check_binary_value(value, 0xFFFFFFFF, "qdc");
+    }
+    for (auto sample : rec.trace) {
+        check_binary_value(sample, 0xFFFF, "trace");
+    }
+
+    const size_t size = binary_record_size(rec);
+    check_binary_value(size, 0xFFFFFFFF, "size");
+
+    const size_t offset = out.size();
+    out.resize(offset + size, 0);
+    auto* p = out.data() + offset;
+
+    uint8_t flags = 0;
+    if (rec.cfd_forced_trigger) {
+        flags |= binary_cfd_forced_trigger;
+    }
+    if (rec.finish_code) {
+        flags |= binary_finish_code;
+    }
+    if (rec.trace_out_of_range) {
+        flags |= binary_trace_out_of_range;
+    }
+
+    put_u32(p, static_cast<uint32_t>(size));
+    put_u16(p, binary_record_version);
+    put_u8(p, flags);
+    put_u8(p, static_cast<uint8_t>(rec.cfd_trigger_source));
+    put_u16(p, static_cast<uint16_t>(rec.crate_id));
+    put_u16(p, static_cast<uint16_t>(rec.slot_id));
+    put_u16(p, static_cast<uint16_t>(rec.channel_number));
+    put_u16(p, static_cast<uint16_t>(rec.header_length));
+    put_u32(p, static_cast<uint32_t>(rec.event_length));
+    put_u32(p, static_cast<uint32_t>(rec.trace_length));
+    put_f64(p, rec.time.count());
+    put_f64(p, rec.cfd_fractional_time.count());
+    put_f64(p, rec.filter_time.count());
+    put_f64(p, rec.external_time.count());
+    put_f64(p, rec.energy);
+    put_f64(p, rec.filter_baseline);
+    put_u16(p, static_cast<uint16_t>(rec.energy_sums.size()));
+    put_u16(p, static_cast<uint16_t>(rec.qdc.size()));
+    put_u32(p, static_cast<uint32_t>(rec.trace.size()));
+    for (auto value : rec.energy_sums) {
+        put_u32(p, static_cast<uint32_t>(value));
+    }
+    for (auto value : rec.qdc) {
+        put_u32(p, static_cast<uint32_t>(value));
+    }
+    for (auto sample : rec.trace) {
+        put_u16(p, static_cast<uint16_t>(sample));
+    }
+}
+
+void records_to_binary(const records& recs, binary& out) {
+    size_t size = 0;
+    for (const auto& rec : recs) {
+        size += binary_record_size(rec);
+    }
+    out.reserve(out.size() + size);
+    for (const auto& rec : recs) {
+        record_to_binary(rec, out);
+    }
+}
+
+size_t binary_to_record(const uint8_t* data, size_t len, record& rec) {
+    if (data == nullptr) {
+        throw error(error::code::invalid_buffer, "binary record: invalid data");
+    }
+    if (len < binary_record_header_size) {
+        return 0;
+    }
+    const auto* p = data;
+    const size_t size = get_u32(p);
+    const auto version = get_u16(p);
+    if (version == 0 || version > binary_record_version) {
+        throw error(error::code::invalid_value,
+                    "binary record: unsupported version: " + std::to_string(version));
+    }
+    if (size < binary_record_header_size) {
+        throw error(error::code::invalid_value,
+                    "binary record: invalid size: " + std::to_string(size));
+    }
+    if (len < size) {
+        return 0;
+    }
+    const auto flags = get_u8(p);
+    rec.cfd_forced_trigger = (flags & binary_cfd_forced_trigger) != 0;
+    rec.finish_code = (flags & binary_finish_code) != 0;
+    rec.trace_out_of_range = (flags & binary_trace_out_of_range) != 0;
+    rec.cfd_trigger_source = get_u8(p);
+    rec.crate_id = get_u16(p);
+    rec.slot_id = get_u16(p);
+    rec.channel_number = get_u16(p);
+    rec.header_length = get_u16(p);
+    rec.event_length = get_u32(p);
+    rec.trace_length = get_u32(p);
+    rec.time = record::time_type(get_f64(p));
+    rec.cfd_fractional_time = record::time_type(get_f64(p));
+    rec.filter_time = record::time_type(get_f64(p));
+    rec.external_time = record::time_type(get_f64(p));
+    rec.timestamp = 0;
+    rec.cfd_fixed_time = record::to_fixed_time(rec.cfd_fractional_time);
+    rec.fixed_time = record::to_fixed_time(rec.time);
+    rec.energy = get_f64(p);
+    rec.filter_baseline = get_f64(p);
+    const size_t num_esums = get_u16(p);
+    const size_t num_qdcs = get_u16(p);
+    const size_t num_samples = get_u32(p);
+    const size_t data_size = binary_record_header_size +
+                             (num_esums + num_qdcs) * sizeof(uint32_t) +
+                             num_samples * sizeof(uint16_t);
+    if (data_size > size) {
+        throw error(error::code::invalid_value,
+                    "binary record: size does not match the contents: " + std::to_string(size));
+    }
+    rec.energy_sums.resize(num_esums);
+    for (auto& value : rec.energy_sums) {
+        value = get_u32(p);
+    }
+    rec.qdc.resize(num_qdcs);
+    for (auto& value : rec.qdc) {
+        value = get_u32(p);
+    }
+    rec.trace.resize(num_samples);
+    for (auto& sample : rec.trace) {
+        sample = get_u16(p);
+    }
+    return size;
+}
+
+size_t binary_to_records(const uint8_t* data, size_t len, records& recs) {
+    size_t pos = 0;
+    while (pos < len) {
+        record rec;
+        const size_t size = binary_to_record(data + pos, len - pos, rec);
+        if (size == 0) {
+            break;
+        }
+        recs.push_back(std::move(rec));
+        pos += size;
+    }
+    return pos;
+}
+
 record::record()
     : cfd_forced_trigger(false), cfd_fractional_time(0), cfd_trigger_source(0), channel_number(0),
       crate_id(0), energy(0), event_length(0), external_time(0), filter_baseline(0), filter_time(0),
       finish_code(false), header_length(0), slot_id(0), time(0), trace_length(0),
-      trace_out_of_range(false) {}
+      trace_out_of_range(false), timestamp(0), cfd_fixed_time(0), fixed_time(0) {}
+
+constexpr record::fixed_time_type record::fixed_time_per_ns;
+
+record::fixed_time_type record::to_fixed_time(const time_type t) {
+    return static_cast<fixed_time_type>(
+        std::llround(t.count() * 1e9 * double(fixed_time_per_ns)));
+}
+
+record::time_type record::from_fixed_time(const fixed_time_type t) {
+    return time_type(double(t) / (1e9 * double(fixed_time_per_ns)));
+}
+
+void record::set_time(const time_type t) {
+    time = t;
+    filter_time = t;
+    cfd_fractional_time = time_type(0);
+    fixed_time = to_fixed_time(t);
+    cfd_fixed_time = 0;
+}
+
+void record::shift_time(const time_type offset) {
+    time += offset;
+    filter_time += offset;
+    fixed_time += to_fixed_time(offset);
+}
 
 bool record::operator==(const record& rhs) const {
     return crate_id == rhs.crate_id && slot_id == rhs.slot_id &&
@@ -166,219 +439,260 @@ void record::output(std::ostream& out) const {
 }
 
 
-/**
- * @brief A structure defining the information regarding a data mask.
+/*
+ * A value held in an event's header words.
  */
-struct element_desc {
-    /**
-     * @brief The element type that we're describing.
-     */
-    const element type;
-    /**
-     * @brief Defines the value of the descriptor
-     */
-    const size_t value;
-    /**
-     * @brief The bit that the value occupies within the data structure
-     */
-    const size_t start_bit;
-    /**
-     * @brief The header word that this element appears on.
-     */
-    const size_t header_index;
-
-    element_desc(const element type_, const size_t value_, const size_t bit_,
-                 const size_t header_index_)
-        : type(type_), value(value_), start_bit(bit_), header_index(header_index_) {}
+template<uint32_t Mask, unsigned StartBit, unsigned HeaderIndex>
+struct field {
+    static uint32_t get(const uint32_t* data) {
+        return (data[HeaderIndex] & Mask) >> StartBit;
+    }
+    static void set(uint32_t* data, uint32_t value) {
+        data[HeaderIndex] = (data[HeaderIndex] & ~Mask) | ((value << StartBit) & Mask);
+    }
 };
 
-using descriptor_list = std::vector<element_desc>;
+/*
+ * A value the firmware does not provide. It always decodes as 0.
+ */
+struct absent_field {
+    static uint32_t get(const uint32_t*) {
+        return 0;
+    }
+};
 
 /*
- * NOTE: We put the header length, event length, and trace length first to ensure that we decode
- * those data first and **in that order**. This allows us to check that we have uncorrupted
- * data before we try to decode the rest of the structure. Everything else falls in alphabetical
- * order to find them easier.
+ * The header layouts of the supported firmware revisions and frequencies. A
+ * layout is selected once for a data block and the decoder is specialized
+ * for it so the masks, shifts and CFD scaling are compiled in.
  */
-static const descriptor_list descriptors_17562_100 = {
-    {element::header_length, 0x0001F000, 12, 0},
-    {element::event_length, 0x3FFE0000, 17, 0},
-    {element::trace_length, 0xFFFF0000, 16, 3},
-    {element::cfd_fractional_time, 0xFFFF0000, 16, 2},
-    {element::channel_number, 0x0000000F, 0, 0},
-    {element::crate_id, 0x00000F00, 8, 0},
-    {element::energy, 0x0000FFFF, 0, 3},
-    {element::event_time_high, 0x0000FFFF, 0, 2},
-    {element::event_time_low, 0xFFFFFFFF, 0, 1},
-    {element::finish_code, 0x80000000, 31, 0},
-    {element::slot_id, 0x000000F0, 4, 0},
-    {element::trace_out_of_range_flag, 0x40000000, 30, 0}};
-
-static const descriptor_list descriptors_29432_100 = {
-    {element::header_length, 0x0001F000, 12, 0},
-    {element::event_length, 0x7FFE0000, 17, 0},
-    {element::trace_length, 0xFFFF0000, 16, 3},
-    {element::cfd_fractional_time, 0xFFFF0000, 16, 2},
-    {element::channel_number, 0x0000000F, 0, 0},
-    {element::crate_id, 0x00000F00, 8, 0},
-    {element::energy, 0x00007FFF, 0, 3},
-    {element::event_time_high, 0x0000FFFF, 0, 2},
-    {element::event_time_low, 0xFFFFFFFF, 0, 1},
-    {element::finish_code, 0x80000000, 31, 0},
-    {element::slot_id, 0x000000F0, 4, 0},
-    {element::trace_out_of_range_flag, 0x00008000, 15, 3}};
-
-static const descriptor_list descriptors_30474_100 = {
-    {element::header_length, 0x0001F000, 12, 0},
-    {element::event_length, 0x7FFE0000, 17, 0},
-    {element::trace_length, 0xFFFF0000, 16, 3},
-    {element::cfd_forced_trigger_bit, 0x80000000, 31, 2},
-    {element::cfd_fractional_time, 0x7FFF0000, 16, 2},
-    {element::channel_number, 0x0000000F, 0, 0},
-    {element::crate_id, 0x00000F00, 8, 0},
-    {element::energy, 0x00007FFF, 0, 3},
-    {element::event_time_high, 0x0000FFFF, 0, 2},
-    {element::event_time_low, 0xFFFFFFFF, 0, 1},
-    {element::finish_code, 0x80000000, 31, 0},
-    {element::slot_id, 0x000000F0, 4, 0},
-    {element::trace_out_of_range_flag, 0x00008000, 15, 3}};
-
-static const descriptor_list descriptors_34688_100 = {
-    {element::header_length, 0x0001F000, 12, 0},
-    {element::event_length, 0x7FFE0000, 17, 0},
-    {element::trace_length, 0x7FFF0000, 16, 3},
-    {element::cfd_forced_trigger_bit, 0x80000000, 31, 2},
-    {element::cfd_fractional_time, 0x7FFF0000, 16, 2},
-    {element::channel_number, 0x0000000F, 0, 0},
-    {element::crate_id, 0x00000F00, 8, 0},
-    {element::energy, 0x0000FFFF, 0, 3},
-    {element::event_time_high, 0x0000FFFF, 0, 2},
-    {element::event_time_low, 0xFFFFFFFF, 0, 1},
-    {element::finish_code, 0x80000000, 31, 0},
-    {element::slot_id, 0x000000F0, 4, 0},
-    {element::trace_out_of_range_flag, 0x80000000, 31, 3}};
-
-static const descriptor_list descriptors_20466_250 = {
-    {element::header_length, 0x0001F000, 12, 0},
-    {element::event_length, 0x3FFE0000, 17, 0},
-    {element::trace_length, 0xFFFF0000, 16, 3},
-    {element::cfd_fractional_time, 0xFFFF0000, 16, 2},
-    {element::channel_number, 0x0000000F, 0, 0},
-    {element::crate_id, 0x00000F00, 8, 0},
-    {element::energy, 0x0000FFFF, 0, 3},
-    {element::event_time_high, 0x0000FFFF, 0, 2},
-    {element::event_time_low, 0xFFFFFFFF, 0, 1},
-    {element::finish_code, 0x80000000, 31, 0},
-    {element::slot_id, 0x000000F0, 4, 0},
-    {element::trace_out_of_range_flag, 0x40000000, 30, 0}};
-
-static const descriptor_list descriptors_27361_250 = {
-    {element::header_length, 0x0001F000, 12, 0},
-    {element::event_length, 0x3FFE0000, 17, 0},
-    {element::trace_length, 0xFFFF0000, 16, 3},
-    {element::cfd_fractional_time, 0x7FFF0000, 16, 2},
-    {element::cfd_trigger_source_bit, 0x80000000, 31, 2},
-    {element::channel_number, 0x0000000F, 0, 0},
-    {element::crate_id, 0x00000F00, 8, 0},
-    {element::energy, 0x0000FFFF, 0, 3},
-    {element::event_time_high, 0x0000FFFF, 0, 2},
-    {element::event_time_low, 0xFFFFFFFF, 0, 1},
-    {element::finish_code, 0x80000000, 31, 0},
-    {element::slot_id, 0x000000F0, 4, 0},
-    {element::trace_out_of_range_flag, 0x40000000, 30, 0}};
-
-static const descriptor_list descriptors_29432_250 = {
-    {element::header_length, 0x0001F000, 12, 0},
-    {element::event_length, 0x7FFE0000, 17, 0},
-    {element::trace_length, 0xFFFF0000, 16, 3},
-    {element::cfd_fractional_time, 0x7FFF0000, 16, 2},
-    {element::cfd_trigger_source_bit, 0x80000000, 31, 2},
-    {element::channel_number, 0x0000000F, 0, 0},
-    {element::crate_id, 0x00000F00, 8, 0},
-    {element::energy, 0x00007FFF, 0, 3},
-    {element::event_time_high, 0x0000FFFF, 0, 2},
-    {element::event_time_low, 0xFFFFFFFF, 0, 1},
-    {element::finish_code, 0x80000000, 31, 0},
-    {element::slot_id, 0x000000F0, 4, 0},
-    {element::trace_out_of_range_flag, 0x00008000, 15, 3}};
-
-static const descriptor_list descriptors_30474_250 = {
-    {element::header_length, 0x0001F000, 12, 0},
-    {element::event_length, 0x7FFE0000, 17, 0},
-    {element::trace_length, 0xFFFF0000, 16, 3},
-    {element::cfd_forced_trigger_bit, 0x80000000, 31, 2},
-    {element::cfd_fractional_time, 0x3FFF0000, 16, 2},
-    {element::cfd_trigger_source_bit, 0x40000000, 30, 2},
-    {element::channel_number, 0x0000000F, 0, 0},
-    {element::crate_id, 0x00000F00, 8, 0},
-    {element::energy, 0x00007FFF, 0, 3},
-    {element::event_time_high, 0x0000FFFF, 0, 2},
-    {element::event_time_low, 0xFFFFFFFF, 0, 1},
-    {element::finish_code, 0x80000000, 31, 0},
-    {element::slot_id, 0x000000F0, 4, 0},
-    {element::trace_out_of_range_flag, 0x00008000, 15, 3}};
-
-static const descriptor_list descriptors_34688_250 = {
-    {element::header_length, 0x0001F000, 12, 0},
-    {element::event_length, 0x7FFE0000, 17, 0},
-    {element::trace_length, 0x7FFF0000, 16, 3},
-    {element::cfd_forced_trigger_bit, 0x80000000, 31, 2},
-    {element::cfd_fractional_time, 0x3FFF0000, 16, 2},
-    {element::cfd_trigger_source_bit, 0x40000000, 30, 2},
-    {element::channel_number, 0x0000000F, 0, 0},
-    {element::crate_id, 0x00000F00, 8, 0},
-    {element::energy, 0x0000FFFF, 0, 3},
-    {element::event_time_high, 0x0000FFFF, 0, 2},
-    {element::event_time_low, 0xFFFFFFFF, 0, 1},
-    {element::finish_code, 0x80000000, 31, 0},
-    {element::slot_id, 0x000000F0, 4, 0},
-    {element::trace_out_of_range_flag, 0x80000000, 31, 3}};
-
-static const descriptor_list descriptors_46540_250 = {
-    {element::header_length, 0x0001F000, 12, 0},
-    {element::event_length, 0x7FFE0000, 17, 0},
-    {element::trace_length, 0x7FFF0000, 16, 3},
-    {element::cfd_forced_trigger_bit, 0x80000000, 31, 2},
-    {element::cfd_fractional_time, 0x3FFF0000, 16, 2},
-    {element::cfd_trigger_source_bit, 0x40000000, 30, 2},
-    {element::channel_number, 0x0000003F, 0, 0},
-    {element::crate_id, 0x00000C00, 10, 0},
-    {element::energy, 0x0000FFFF, 0, 3},
-    {element::event_time_high, 0x0000FFFF, 0, 2},
-    {element::event_time_low, 0xFFFFFFFF, 0, 1},
-    {element::finish_code, 0x80000000, 31, 0},
-    {element::slot_id, 0x000003C0, 6, 0},
-    {element::trace_out_of_range_flag, 0x80000000, 31, 3}};
-
-static const descriptor_list descriptors_29432_500 = {
-    {element::header_length, 0x0001F000, 12, 0},
-    {element::event_length, 0x7FFE0000, 17, 0},
-    {element::trace_length, 0xFFFF0000, 16, 3},
-    {element::cfd_fractional_time, 0x1FFF0000, 16, 2},
-    {element::cfd_trigger_source_bit, 0xE0000000, 29, 2},
-    {element::channel_number, 0x0000000F, 0, 0},
-    {element::crate_id, 0x00000F00, 8, 0},
-    {element::energy, 0x00007FFF, 0, 3},
-    {element::event_time_high, 0x0000FFFF, 0, 2},
-    {element::event_time_low, 0xFFFFFFFF, 0, 1},
-    {element::finish_code, 0x80000000, 31, 0},
-    {element::slot_id, 0x000000F0, 4, 0},
-    {element::trace_out_of_range_flag, 0x00008000, 15, 3}};
-
-static const descriptor_list descriptors_34688_500 = {
-    {element::header_length, 0x0001F000, 12, 0},
-    {element::event_length, 0x7FFE0000, 17, 0},
-    {element::trace_length, 0x7FFF0000, 16, 3},
-    {element::cfd_fractional_time, 0x1FFF0000, 16, 2},
-    {element::cfd_trigger_source_bit, 0xE0000000, 29, 2},
-    {element::channel_number, 0x0000000F, 0, 0},
-    {element::crate_id, 0x00000F00, 8, 0},
-    {element::energy, 0x0000FFFF, 0, 3},
-    {element::event_time_high, 0x0000FFFF, 0, 2},
-    {element::event_time_low, 0xFFFFFFFF, 0, 1},
-    {element::finish_code, 0x80000000, 31, 0},
-    {element::slot_id, 0x000000F0, 4, 0},
-    {element::trace_out_of_range_flag, 0x80000000, 31, 3}};
+struct layout_17562_100 {
+    static constexpr size_t frequency = 100;
+    static constexpr double cfd_multiplier = 65536;
+    using header_length = field<0x0001F000, 12, 0>;
+    using event_length = field<0x3FFE0000, 17, 0>;
+    using trace_length = field<0xFFFF0000, 16, 3>;
+    using cfd_forced_trigger_bit = absent_field;
+    using cfd_fractional_time = field<0xFFFF0000, 16, 2>;
+    using cfd_trigger_source_bit = absent_field;
+    using channel_number = field<0x0000000F, 0, 0>;
+    using crate_id = field<0x00000F00, 8, 0>;
+    using energy = field<0x0000FFFF, 0, 3>;
+    using event_time_high = field<0x0000FFFF, 0, 2>;
+    using event_time_low = field<0xFFFFFFFF, 0, 1>;
+    using finish_code = field<0x80000000, 31, 0>;
+    using slot_id = field<0x000000F0, 4, 0>;
+    using trace_out_of_range_flag = field<0x40000000, 30, 0>;
+};
+
+struct layout_29432_100 {
+    static constexpr size_t frequency = 100;
+    static constexpr double cfd_multiplier = 65536;
+    using header_length = field<0x0001F000, 12, 0>;
+    using event_length = field<0x7FFE0000, 17, 0>;
+    using trace_length = field<0xFFFF0000, 16, 3>;
+    using cfd_forced_trigger_bit = absent_field;
+    using cfd_fractional_time = field<0xFFFF0000, 16, 2>;
+    using cfd_trigger_source_bit = absent_field;
+    using channel_number = field<0x0000000F, 0, 0>;
+    using crate_id = field<0x00000F00, 8, 0>;
+    using energy = field<0x00007FFF, 0, 3>;
+    using event_time_high = field<0x0000FFFF, 0, 2>;
+    using event_time_low = field<0xFFFFFFFF, 0, 1>;
+    using finish_code = field<0x80000000, 31, 0>;
+    using slot_id = field<0x000000F0, 4, 0>;
+    using trace_out_of_range_flag = field<0x00008000, 15, 3>;
+};
+
+struct layout_30474_100 {
+    static constexpr size_t frequency = 100;
+    static constexpr double cfd_multiplier = 32768;
+    using header_length = field<0x0001F000, 12, 0>;
+    using event_length = field<0x7FFE0000, 17, 0>;
+    using trace_length = field<0xFFFF0000, 16, 3>;
+    using cfd_forced_trigger_bit = field<0x80000000, 31, 2>;
+    using cfd_fractional_time = field<0x7FFF0000, 16, 2>;
+    using cfd_trigger_source_bit = absent_field;
+    using channel_number = field<0x0000000F, 0, 0>;
+    using crate_id = field<0x00000F00, 8, 0>;
+    using energy = field<0x00007FFF, 0, 3>;
+    using event_time_high = field<0x0000FFFF, 0, 2>;
+    using event_time_low = field<0xFFFFFFFF, 0, 1>;
+    using finish_code = field<0x80000000, 31, 0>;
+    using slot_id = field<0x000000F0, 4, 0>;
+    using trace_out_of_range_flag = field<0x00008000, 15, 3>;
+};
+
+struct layout_34688_100 {
+    static constexpr size_t frequency = 100;
+    static constexpr double cfd_multiplier = 32768;
+    using header_length = field<0x0001F000, 12, 0>;
+    using event_length = field<0x7FFE0000, 17, 0>;
+    using trace_length = field<0x7FFF0000, 16, 3>;
+    using cfd_forced_trigger_bit = field<0x80000000, 31, 2>;
+    using cfd_fractional_time = field<0x7FFF0000, 16, 2>;
+    using cfd_trigger_source_bit = absent_field;
+    using channel_number = field<0x0000000F, 0, 0>;
+    using crate_id = field<0x00000F00, 8, 0>;
+    using energy = field<0x0000FFFF, 0, 3>;
+    using event_time_high = field<0x0000FFFF, 0, 2>;
+    using event_time_low = field<0xFFFFFFFF, 0, 1>;
+    using finish_code = field<0x80000000, 31, 0>;
+    using slot_id = field<0x000000F0, 4, 0>;
+    using trace_out_of_range_flag = field<0x80000000, 31, 3>;
+};
+
+struct layout_20466_250 {
+    static constexpr size_t frequency = 250;
+    static constexpr double cfd_multiplier = 65536;
+    using header_length = field<0x0001F000, 12, 0>;
+    using event_length = field<0x3FFE0000, 17, 0>;
+    using trace_length = field<0xFFFF0000, 16, 3>;
+    using cfd_forced_trigger_bit = absent_field;
+    using cfd_fractional_time = field<0xFFFF0000, 16, 2>;
+    using cfd_trigger_source_bit = absent_field;
+    using channel_number = field<0x0000000F, 0, 0>;
+    using crate_id = field<0x00000F00, 8, 0>;
+    using energy = field<0x0000FFFF, 0, 3>;
+    using event_time_high = field<0x0000FFFF, 0, 2>;
+    using event_time_low = field<0xFFFFFFFF, 0, 1>;
+    using finish_code = field<0x80000000, 31, 0>;
+    using slot_id = field<0x000000F0, 4, 0>;
+    using trace_out_of_range_flag = field<0x40000000, 30, 0>;
+};
+
+struct layout_27361_250 {
+    static constexpr size_t frequency = 250;
+    static constexpr double cfd_multiplier = 32768;
+    using header_length = field<0x0001F000, 12, 0>;
+    using event_length = field<0x3FFE0000, 17, 0>;
+    using trace_length = field<0xFFFF0000, 16, 3>;
+    using cfd_forced_trigger_bit = absent_field;
+    using cfd_fractional_time = field<0x7FFF0000, 16, 2>;
+    using cfd_trigger_source_bit = field<0x80000000, 31, 2>;
+    using channel_number = field<0x0000000F, 0, 0>;
+    using crate_id = field<0x00000F00, 8, 0>;
+    using energy = field<0x0000FFFF, 0, 3>;
+    using event_time_high = field<0x0000FFFF, 0, 2>;
+    using event_time_low = field<0xFFFFFFFF, 0, 1>;
+    using finish_code = field<0x80000000, 31, 0>;
+    using slot_id = field<0x000000F0, 4, 0>;
+    using trace_out_of_range_flag = field<0x40000000, 30, 0>;
+};
+
+struct layout_29432_250 {
+    static constexpr size_t frequency = 250;
+    static constexpr double cfd_multiplier = 32768;
+    using header_length = field<0x0001F000, 12, 0>;
+    using event_length = field<0x7FFE0000, 17, 0>;
+    using trace_length = field<0xFFFF0000, 16, 3>;
+    using cfd_forced_trigger_bit = absent_field;
+    using cfd_fractional_time = field<0x7FFF0000, 16, 2>;
+    using cfd_trigger_source_bit = field<0x80000000, 31, 2>;
+    using channel_number = field<0x0000000F, 0, 0>;
+    using crate_id = field<0x00000F00, 8, 0>;
+    using energy = field<0x00007FFF, 0, 3>;
+    using event_time_high = field<0x0000FFFF, 0, 2>;
+    using event_time_low = field<0xFFFFFFFF, 0, 1>;
+    using finish_code = field<0x80000000, 31, 0>;
+    using slot_id = field<0x000000F0, 4, 0>;
+    using trace_out_of_range_flag = field<0x00008000, 15, 3>;
+};
+
+struct layout_30474_250 {
+    static constexpr size_t frequency = 250;
+    static constexpr double cfd_multiplier = 16384;
+    using header_length = field<0x0001F000, 12, 0>;
+    using event_length = field<0x7FFE0000, 17, 0>;
+    using trace_length = field<0xFFFF0000, 16, 3>;
+    using cfd_forced_trigger_bit = field<0x80000000, 31, 2>;
+    using cfd_fractional_time = field<0x3FFF0000, 16, 2>;
+    using cfd_trigger_source_bit = field<0x40000000, 30, 2>;
+    using channel_number = field<0x0000000F, 0, 0>;
+    using crate_id = field<0x00000F00, 8, 0>;
+    using energy = field<0x00007FFF, 0, 3>;
+    using event_time_high = field<0x0000FFFF, 0, 2>;
+    using event_time_low = field<0xFFFFFFFF, 0, 1>;
+    using finish_code = field<0x80000000, 31, 0>;
+    using slot_id = field<0x000000F0, 4, 0>;
+    using trace_out_of_range_flag = field<0x00008000, 15, 3>;
+};
+
+struct layout_34688_250 {
+    static constexpr size_t frequency = 250;
+    static constexpr double cfd_multiplier = 16384;
+    using header_length = field<0x0001F000, 12, 0>;
+    using event_length = field<0x7FFE0000, 17, 0>;
+    using trace_length = field<0x7FFF0000, 16, 3>;
+    using cfd_forced_trigger_bit = field<0x80000000, 31, 2>;
+    using cfd_fractional_time = field<0x3FFF0000, 16, 2>;
+    using cfd_trigger_source_bit = field<0x40000000, 30, 2>;
+    using channel_number = field<0x0000000F, 0, 0>;
+    using crate_id = field<0x00000F00, 8, 0>;
+    using energy = field<0x0000FFFF, 0, 3>;
+    using event_time_high = field<0x0000FFFF, 0, 2>;
+    using event_time_low = field<0xFFFFFFFF, 0, 1>;
+    using finish_code = field<0x80000000, 31, 0>;
+    using slot_id = field<0x000000F0, 4, 0>;
+    using trace_out_of_range_flag = field<0x80000000, 31, 3>;
+};
+
+struct layout_46540_250 {
+    static constexpr size_t frequency = 250;
+    static constexpr double cfd_multiplier = 16384;
+    using header_length = field<0x0001F000, 12, 0>;
+    using event_length = field<0x7FFE0000, 17, 0>;
+    using trace_length = field<0x7FFF0000, 16, 3>;
+    using cfd_forced_trigger_bit = field<0x80000000, 31, 2>;
+    using cfd_fractional_time = field<0x3FFF0000, 16, 2>;
+    using cfd_trigger_source_bit = field<0x40000000, 30, 2>;
+    using channel_number = field<0x0000003F, 0, 0>;
+    using crate_id = field<0x00000C00, 10, 0>;
+    using energy = field<0x0000FFFF, 0, 3>;
+    using event_time_high = field<0x0000FFFF, 0, 2>;
+    using event_time_low = field<0xFFFFFFFF, 0, 1>;
+    using finish_code = field<0x80000000, 31, 0>;
+    using slot_id = field<0x000003C0, 6, 0>;
+    using trace_out_of_range_flag = field<0x80000000, 31, 3>;
+};
+
+struct layout_29432_500 {
+    static constexpr size_t frequency = 500;
+    static constexpr double cfd_multiplier = 8192;
+    using header_length = field<0x0001F000, 12, 0>;
+    using event_length = field<0x7FFE0000, 17, 0>;
+    using trace_length = field<0xFFFF0000, 16, 3>;
+    using cfd_forced_trigger_bit = absent_field;
+    using cfd_fractional_time = field<0x1FFF0000, 16, 2>;
+    using cfd_trigger_source_bit = field<0xE0000000, 29, 2>;
+    using channel_number = field<0x0000000F, 0, 0>;
+    using crate_id = field<0x00000F00, 8, 0>;
+    using energy = field<0x00007FFF, 0, 3>;
+    using event_time_high = field<0x0000FFFF, 0, 2>;
+    using event_time_low = field<0xFFFFFFFF, 0, 1>;
+    using finish_code = field<0x80000000, 31, 0>;
+    using slot_id = field<0x000000F0, 4, 0>;
+    using trace_out_of_range_flag = field<0x00008000, 15, 3>;
+};
+
+struct layout_34688_500 {
+    static constexpr size_t frequency = 500;
+    static constexpr double cfd_multiplier = 8192;
+    using header_length = field<0x0001F000, 12, 0>;
+    using event_length = field<0x7FFE0000, 17, 0>;
+    using trace_length = field<0x7FFF0000, 16, 3>;
+    using cfd_forced_trigger_bit = absent_field;
+    using cfd_fractional_time = field<0x1FFF0000, 16, 2>;
+    using cfd_trigger_source_bit = field<0xE0000000, 29, 2>;
+    using channel_number = field<0x0000000F, 0, 0>;
+    using crate_id = field<0x00000F00, 8, 0>;
+    using energy = field<0x0000FFFF, 0, 3>;
+    using event_time_high = field<0x0000FFFF, 0, 2>;
+    using event_time_low = field<0xFFFFFFFF, 0, 1>;
+    using finish_code = field<0x80000000, 31, 0>;
+    using slot_id = field<0x000000F0, 4, 0>;
+    using trace_out_of_range_flag = field<0x80000000, 31, 3>;
+};
 
 static uint64_t make_u64(const uint32_t high, const uint32_t low) {
     return (uint64_t(high) << 32) | uint64_t(low);
@@ -388,95 +702,63 @@ static double make_u64_double(const uint32_t high, const uint32_t low) {
     return double(make_u64(high, low));
 }
 
-static void make_time(record& rec, const size_t freq, const uint32_t filter_low,
-                      const uint32_t filter_high, const double cfd_time) {
+/**
+ * @brief The times of an event in seconds and as fixed point values.
+ */
+struct event_times {
+    double cfd_fractional_time;
+    double filter_time;
+    double time;
+    uint64_t timestamp;
+    record::fixed_time_type cfd_fixed_time;
+    record::fixed_time_type fixed_time;
+};
+
+/*
+ * The CFD fraction is a raw count of the CFD multiplier. The fixed point
+ * times are computed with integer arithmetic from the raw values, the CFD
+ * fraction is rounded to the nearest unit.
+ */
+static void make_time(event_times& times, const size_t freq, const uint32_t filter_low,
+                      const uint32_t filter_high, const uint32_t cfd_raw,
+                      const double cfd_multiplier, const size_t cfd_trigger_source) {
+    using fixed = record::fixed_time_type;
+    const double cfd_time = static_cast<double>(cfd_raw) / cfd_multiplier;
+    const auto multiplier = static_cast<fixed>(cfd_multiplier);
+    auto cfd_fixed = [cfd_raw, multiplier](fixed span) {
+        return (fixed(cfd_raw) * span + multiplier / 2) / multiplier;
+    };
+    const auto src = static_cast<fixed>(cfd_trigger_source);
     double filter_conv;
+    fixed filter_fixed;
     switch (freq) {
         case 250:
             filter_conv = 8e-9;
-            rec.cfd_fractional_time =
-                record::time_type((cfd_time - static_cast<double>(rec.cfd_trigger_source)) * 4e-9);
+            filter_fixed = 8 * record::fixed_time_per_ns;
+            times.cfd_fractional_time =
+                (cfd_time - static_cast<double>(cfd_trigger_source)) * 4e-9;
+            times.cfd_fixed_time = cfd_fixed(4 * record::fixed_time_per_ns) -
+                src * 4 * record::fixed_time_per_ns;
             break;
         case 500:
             filter_conv = 10e-9;
-            rec.cfd_fractional_time = record::time_type(
-                (cfd_time + static_cast<double>(rec.cfd_trigger_source) - 1) * 2e-9);
+            filter_fixed = 10 * record::fixed_time_per_ns;
+            times.cfd_fractional_time =
+                (cfd_time + static_cast<double>(cfd_trigger_source) - 1) * 2e-9;
+            times.cfd_fixed_time = cfd_fixed(2 * record::fixed_time_per_ns) +
+                (src - 1) * 2 * record::fixed_time_per_ns;
             break;
         default:
             filter_conv = 10e-9;
-            rec.cfd_fractional_time = record::time_type(cfd_time * 10e-9);
+            filter_fixed = 10 * record::fixed_time_per_ns;
+            times.cfd_fractional_time = cfd_time * 10e-9;
+            times.cfd_fixed_time = cfd_fixed(10 * record::fixed_time_per_ns);
             break;
     }
-    rec.filter_time = record::time_type(make_u64_double(filter_high, filter_low) * filter_conv);
-    rec.time = rec.cfd_fractional_time + rec.filter_time;
-}
-
-static const descriptor_list& find_element_set(size_t rev, size_t freq) {
-    switch (freq) {
-        case 100:
-            if (rev >= 17562 && rev < 29432) {
-                return descriptors_17562_100;
-            } else if (rev >= 29432 && rev < 30474) {
-                return descriptors_29432_100;
-            } else if (rev >= 30474 && rev < 34688) {
-                return descriptors_30474_100;
-            } else {
-                return descriptors_34688_100;
-            }
-        case 250:
-            if (rev < 20466) {
-                throw error(error::code::invalid_revision,
-                            "minimum supported firmware rev is 20466");
-            } else if (rev >= 20466 && rev < 27361) {
-                return descriptors_20466_250;
-            } else if (rev >= 27361 && rev < 29432) {
-                return descriptors_27361_250;
-            } else if (rev >= 29432 && rev < 30474) {
-                return descriptors_29432_250;
-            } else if (rev >= 30474 && rev < 34688) {
-                return descriptors_30474_250;
-            } else if (rev >= 34688 && rev < 46540) {
-                return descriptors_34688_250;
-            } else {
-                return descriptors_46540_250;
-            }
-        case 500:
-            if (rev < 29432) {
-                throw error(error::code::invalid_revision,
-                            "minimum supported firmware rev is 29432");
-            } else if (rev >= 29432 && rev < 34688) {
-                return descriptors_29432_500;
-            } else {
-                return descriptors_34688_500;
-            }
-        default:
-            throw error(error::code::invalid_frequency,
-                        "invalid frequency: " + std::to_string(freq));
-    }
-}
-
-static double cfd_multiplier(const size_t rev, const size_t freq) {
-    switch (freq) {
-        case 100:
-            if (rev >= 17562 && rev < 30474) {
-                return 65536;
-            } else {
-                return 32768;
-            }
-        case 250:
-            if (rev >= 20466 && rev < 27361) {
-                return 65536;
-            } else if (rev >= 27361 && rev < 30474) {
-                return 32768;
-            } else {
-                return 16384;
-            }
-        case 500:
-            return 8192;
-        default:
-            throw error(error::code::invalid_frequency,
-                        "invalid frequency: " + std::to_string(freq));
-    }
+    times.timestamp = make_u64(filter_high, filter_low);
+    times.filter_time = double(times.timestamp) * filter_conv;
+    times.time = times.cfd_fractional_time + times.filter_time;
+    times.fixed_time = fixed(times.timestamp) * filter_fixed + times.cfd_fixed_time;
 }
 
 struct header_config {
@@ -490,7 +772,7 @@ struct header_config {
         valid = false;
     }
 
-    void generate(size_t len, size_t rev, record& rec) {
+    void generate(size_t len, size_t rev) {
         if (rev < 30980) {
             switch (len) {
                 case header_length::header_ets:
@@ -542,7 +824,6 @@ struct header_config {
                             "unknown header length: " + std::to_string(len));
         }
         valid = true;
-        rec.header_length = len;
     }
 
     size_t ets_offset;
@@ -554,6 +835,51 @@ struct header_config {
     bool valid;
 };
 
+/**
+ * @brief The header values of an event decoded from the data.
+ *
+ * The decode loop fills this for each event and the output, records or an
+ * event batch, takes what it needs from it and the event's data words.
+ */
+struct event_header {
+    bool cfd_forced_trigger;
+    size_t cfd_trigger_source;
+    size_t channel_number;
+    size_t crate_id;
+    double energy;
+    size_t event_length;
+    bool finish_code;
+    size_t header_length;
+    size_t slot_id;
+    size_t trace_length;
+    bool trace_out_of_range;
+    event_times times;
+    header_config config;
+
+    event_header()
+        : cfd_forced_trigger(false), cfd_trigger_source(0), channel_number(0), crate_id(0),
+          energy(0), event_length(0), finish_code(false), header_length(0), slot_id(0),
+          trace_length(0), trace_out_of_range(false), times() {}
+
+    double external_time(const uint32_t* data) const {
+        return make_u64_double(data[config.ets_offset + 1], data[config.ets_offset]);
+    }
+
+    double filter_baseline(const uint32_t* data) const {
+        return util::ieee_float(data[config.esums_offset + num_esum_words - 1]);
+    }
+};
+
+static void apply_calibration(const calibration::channel_table& table, const uint32_t energy,
+                              event_times& times, double& calibrated) {
+    if (!table.energy.empty()) {
+        calibrated = table.energy[energy];
+    }
+    times.filter_time += table.time_offset.count();
+    times.time += table.time_offset.count();
+    times.fixed_time += table.fixed_time_offset;
+}
+
 void fill_remainder(uint32_t* data, uint32_t* data_end, buffer& leftovers) {
     while (data < data_end) {
         leftovers.push_back(*data);
@@ -561,25 +887,61 @@ void fill_remainder(uint32_t* data, uint32_t* data_end, buffer& leftovers) {
     }
 }
 
-void decode_data_block(uint32_t* data, size_t len, size_t revision, size_t frequency, records& recs,
-                       buffer& leftovers) {
-    if (data == nullptr) {
-        throw error(error::code::invalid_buffer, "buffer pointed to an invalid location");
+/*
+ * A header a recovering decoder continues from. The checks only use the
+ * first words so a word can be tried before its event is in the block.
+ */
+template<typename Layout>
+static bool plausible_header(const uint32_t* header, size_t revision, const recovery& recover) {
+    const size_t header_length = Layout::header_length::get(header);
+    if (header_length < min_words || header_length > header_esum_qdc_ets ||
+        (header_length & 1) != 0) {
+        return false;
     }
-    if (len == 0) {
-        throw error(error::code::invalid_buffer_length, "minimum data buffer size is 1");
+    if (revision < 30980 &&
+        (header_length == header_ets || header_length == header_esum_ets ||
+         header_length == header_qdc_ets || header_length == header_esum_qdc_ets)) {
+        return false;
     }
-    if (revision < min_rev) {
-        throw error(error::code::invalid_revision,
-                    "minimum supported firmware rev is " + std::to_string(min_rev));
+    if (Layout::event_length::get(header) !=
+        header_length + Layout::trace_length::get(header) / 2) {
+        return false;
+    }
+    if (Layout::cfd_forced_trigger_bit::get(header) != 0 &&
+        Layout::cfd_fractional_time::get(header) != 0) {
+        return false;
     }
+    const size_t slot = Layout::slot_id::get(header);
+    if (slot < min_slot_id || slot > max_slot_id ||
+        (recover.slot != recovery::any && slot != recover.slot)) {
+        return false;
+    }
+    return recover.crate == recovery::any || Layout::crate_id::get(header) == recover.crate;
+}
 
-    recs.clear();
-    leftovers.clear();
+/*
+ * Decode the events in a data block calling the output with each event's
+ * header values and data words. The layout is a compile time parameter so
+ * each supported firmware has its own decoder.
+ *
+ * With a recovery each header is checked before it is decoded so a bad
+ * event is skipped and not thrown. A word found after skipping is only
+ * accepted if the header after its event is plausible or is not in the
+ * block.
+ */
+template<typename Layout, typename Output>
+static void decode_events(uint32_t* data, size_t len, size_t revision, Output& output,
+                          buffer& leftovers, const calibration* calib, recovery* recover) {
     auto* data_start = data;
     auto* data_end = data_start + len;
     auto remaining_len = len;
-    auto& core_elements = find_element_set(revision, frequency);
+
+    /*
+     * The header configuration only changes when the header length changes
+     * and that is fixed for a channel during a run.
+     */
+    header_config config;
+    size_t config_header_length = 0;
 
     /*
      * We check to see if the data buffer meets the minimum size requirement for a complete record.
@@ -597,165 +959,2114 @@ void decode_data_block(uint32_t* data, size_t len, size_t revision, size_t frequ
             break;
         }
 
-        record evt;
-        uint32_t event_time_low = 0;
-        uint32_t event_time_high = 0;
-        double cfd_fractional_time = 0;
-        header_config header_config;
-
-        /*
-         * This for loops over the element tables above, which define the order in which we expect
-         * to parse the elements. This order is reflected in the switch case ordering to make it
-         * consistent with the definitions in the element descriptors. The order allows us to
-         * ensure that we fail on the first error we encounter. Subsequent steps (and case checks)
-         * depend upon having valid data. The order of header length, event length, then trace
-         * length must be maintained.
-         */
-        for (const auto& ele : core_elements) {
-            if (!have_record) {
+        if (recover != nullptr) {
+            if (remaining_len < min_words) {
+                fill_remainder(data, data_end, leftovers);
                 break;
             }
-            auto val = (data[ele.header_index] & ele.value) >> ele.start_bit;
-            switch (ele.type) {
-                case element::header_length:
-                    header_config.generate(val, revision, evt);
-                    break;
-                case element::event_length:
-                    if (val == 0) {
-                        fill_remainder(data, data_end, leftovers);
-                        throw error(error::code::invalid_event_length, "bad event length: 0");
-                    }
-                    if (remaining_len < val) {
-                        have_record = false;
-                    }
-                    evt.event_length = val;
-                    break;
-                case element::trace_length:
-                    /*
-                     * The trace length is stored as the number of samples, so we need to
-                     * divide by two to when comparing with the event length, which is
-                     * provided as the number of 32-bit words.
-                     */
-                    if (evt.event_length != evt.header_length + val / 2) {
-                        fill_remainder(data, data_end, leftovers);
-                        std::stringstream msg;
-                        msg << "event does not match header and trace: "
-                            << "crate=" << evt.crate_id << ", slot=" << evt.slot_id
-                            << ", chan=" << evt.channel_number
-                            << ", event_length=" << evt.event_length
-                            << ", header_length=" << evt.header_length
-                            << ", trace_length=" << evt.trace_length;
-                        throw error(error::code::invalid_event_length, msg.str());
-                    }
-                    evt.trace_length = val;
-                    break;
-                case element::cfd_forced_trigger_bit:
-                    evt.cfd_forced_trigger = val != 0;
-                    break;
-                case element::cfd_fractional_time:
-                    /*
-                     * We could treat this as not an error and just force the CFD time to be zero instead.
-                     * The downside to that would be it masks issues in the firmware. We've chosen to make it a
-                     * hard kill at this time.
-                     */
-                    if (evt.cfd_forced_trigger && val != 0) {
-                        fill_remainder(data, data_end, leftovers);
-                        throw error(error::code::invalid_cfd_time,
-                                    "data corruption: cfd was forced but still recorded a time");
-                    }
-                    cfd_fractional_time =
-                        static_cast<double>(val) / cfd_multiplier(revision, frequency);
-                    break;
-                case element::cfd_trigger_source_bit:
-                    evt.cfd_trigger_source = val;
-                    break;
-                case element::channel_number:
-                    evt.channel_number = val;
-                    break;
-                case element::crate_id:
-                    evt.crate_id = val;
-                    break;
-                case element::energy:
-                    evt.energy = static_cast<double>(val);
-                    break;
-                case element::event_time_high:
-                    event_time_high = static_cast<uint32_t>(val);
-                    break;
-                case element::event_time_low:
-                    event_time_low = static_cast<uint32_t>(val);
-                    break;
-                case element::finish_code:
-                    evt.finish_code = val != 0;
-                    break;
-                case element::slot_id:
-                    if (val < min_slot_id || val > max_slot_id) {
-                        fill_remainder(data, data_end, leftovers);
-                        throw error(error::code::invalid_slot_id,
-                                    "bad slot id: " + std::to_string(val));
-                    }
-                    evt.slot_id = val;
-                    break;
-                case element::trace_out_of_range_flag:
-                    evt.trace_out_of_range = val != 0;
-                    break;
-                default:
-                    fill_remainder(data, data_end, leftovers);
-                    throw error(error::code::invalid_element, "Unknown data element encountered");
+            bool plausible = plausible_header<Layout>(data, revision, *recover);
+            if (plausible && recover->resyncing) {
+                const size_t event_length = Layout::event_length::get(data);
+                plausible = remaining_len < event_length + min_words ||
+                            plausible_header<Layout>(data + event_length, revision, *recover);
+            }
+            if (!plausible) {
+                if (!recover->resyncing) {
+                    recover->resyncing = true;
+                    recover->errors++;
+                }
+                recover->skipped_words++;
+                data++;
+                remaining_len--;
+                continue;
+            }
+            if (recover->resyncing) {
+                recover->resyncing = false;
+                recover->resyncs++;
             }
         }
 
-        if (!have_record) {
-            continue;
+        event_header evt;
+
+        /*
+         * The header length, event length, then trace length are decoded
+         * first and in that order. This allows us to check that we have
+         * uncorrupted data before we decode the rest of the event and we
+         * fail on the first error we encounter.
+         */
+        evt.header_length = Layout::header_length::get(data);
+        if (!config.valid || evt.header_length != config_header_length) {
+            config = header_config();
+            config.generate(evt.header_length, revision);
+            config_header_length = evt.header_length;
         }
+        evt.config = config;
 
-        make_time(evt, frequency, event_time_low, event_time_high, cfd_fractional_time);
+        evt.event_length = Layout::event_length::get(data);
+        if (evt.event_length == 0) {
+            fill_remainder(data, data_end, leftovers);
+            throw error(error::code::invalid_event_length, "bad event length: 0");
+        }
+        if (remaining_len < evt.event_length) {
+            have_record = false;
+            continue;
+        }
 
-        if (header_config.ets) {
-            evt.external_time = record::time_type(make_u64_double(
-                data[header_config.ets_offset + 1], data[header_config.ets_offset]));
+        /*
+         * The trace length is stored as the number of samples, so we need to
+         * divide by two to when comparing with the event length, which is
+         * provided as the number of 32-bit words.
+         */
+        const size_t trace_length = Layout::trace_length::get(data);
+        if (evt.event_length != evt.header_length + trace_length / 2) {
+            fill_remainder(data, data_end, leftovers);
+            std::stringstream msg;
+            msg << "event does not match header and trace: "
+                << "crate=" << evt.crate_id << ", slot=" << evt.slot_id
+                << ", chan=" << evt.channel_number << ", event_length=" << evt.event_length
+                << ", header_length=" << evt.header_length
+                << ", trace_length=" << evt.trace_length;
+            throw error(error::code::invalid_event_length, msg.str());
         }
+        evt.trace_length = trace_length;
 
-        if (header_config.esums) {
-            for (unsigned int i = 0; i < num_esum_words; i++) {
-                if (i != num_esum_words - 1) {
-                    evt.energy_sums.push_back(data[header_config.esums_offset + i]);
-                } else {
-                    evt.filter_baseline =
-                        util::ieee_float(data[header_config.esums_offset + num_esum_words - 1]);
-                }
-            }
+        evt.cfd_forced_trigger = Layout::cfd_forced_trigger_bit::get(data) != 0;
+
+        /*
+         * We could treat this as not an error and just force the CFD time to be zero instead.
+         * The downside to that would be it masks issues in the firmware. We've chosen to make it a
+         * hard kill at this time.
+         */
+        const uint32_t cfd_time = Layout::cfd_fractional_time::get(data);
+        if (evt.cfd_forced_trigger && cfd_time != 0) {
+            fill_remainder(data, data_end, leftovers);
+            throw error(error::code::invalid_cfd_time,
+                        "data corruption: cfd was forced but still recorded a time");
         }
 
-        if (header_config.qdc) {
-            for (unsigned int i = 0; i < num_qdc_words; i++) {
-                evt.qdc.push_back(data[header_config.qdc_offset + i]);
-            }
+        evt.cfd_trigger_source = Layout::cfd_trigger_source_bit::get(data);
+        evt.channel_number = Layout::channel_number::get(data);
+        evt.crate_id = Layout::crate_id::get(data);
+        const uint32_t energy = Layout::energy::get(data);
+        evt.energy = static_cast<double>(energy);
+        evt.finish_code = Layout::finish_code::get(data) != 0;
+
+        evt.slot_id = Layout::slot_id::get(data);
+        if (evt.slot_id < min_slot_id || evt.slot_id > max_slot_id) {
+            fill_remainder(data, data_end, leftovers);
+            throw error(error::code::invalid_slot_id,
+                        "bad slot id: " + std::to_string(evt.slot_id));
         }
 
-        if (evt.trace_length > 0) {
-            for (size_t w = evt.header_length; w < evt.event_length; ++w) {
-                evt.trace.push_back(data[w] & 0xFFFF);
-                evt.trace.push_back((data[w] >> 16) & 0xFFFF);
+        evt.trace_out_of_range = Layout::trace_out_of_range_flag::get(data) != 0;
+
+        make_time(evt.times, Layout::frequency, Layout::event_time_low::get(data),
+                  Layout::event_time_high::get(data), cfd_time, Layout::cfd_multiplier,
+                  evt.cfd_trigger_source);
+
+        if (calib != nullptr) {
+            auto table = calib->find(evt.crate_id, evt.slot_id, evt.channel_number);
+            if (table != nullptr) {
+                apply_calibration(*table, energy, evt.times, evt.energy);
             }
         }
 
+        output(evt, data);
+
         data += evt.event_length;
         remaining_len -= evt.event_length;
-        recs.push_back(evt);
     }
 }
 
-void decode_data_block(buffer data, size_t revision, size_t frequency, records& recs,
-                       buffer& leftovers) {
-    decode_data_block(data.data(), data.size(), revision, frequency, recs, leftovers);
+/*
+ * Check the arguments common to all the decoders.
+ */
+static void check_data_block(const uint32_t* data, size_t len, size_t revision) {
+    if (data == nullptr) {
+        throw error(error::code::invalid_buffer, "buffer pointed to an invalid location");
+    }
+    if (len == 0) {
+        throw error(error::code::invalid_buffer_length, "minimum data buffer size is 1");
+    }
+    if (revision < min_rev) {
+        throw error(error::code::invalid_revision,
+                    "minimum supported firmware rev is " + std::to_string(min_rev));
+    }
 }
 
-}  // namespace list_mode
-}  // namespace data
-}  // namespace pixie
-}  // namespace xia
-
-std::ostream& operator<<(std::ostream& out, xia::pixie::data::list_mode::record& event) {
-    event.output(out);
+/*
+ * Call the handler with the layout for the revision and frequency.
+ */
+template<typename Handler>
+static void with_layout(size_t revision, size_t frequency, Handler handler) {
+    switch (frequency) {
+        case 100:
+            if (revision < 29432) {
+                handler(layout_17562_100());
+            } else if (revision < 30474) {
+                handler(layout_29432_100());
+            } else if (revision < 34688) {
+                handler(layout_30474_100());
+            } else {
+                handler(layout_34688_100());
+            }
+            break;
+        case 250:
+            if (revision < 20466) {
+                throw error(error::code::invalid_revision,
+                            "minimum supported firmware rev is 20466");
+            } else if (revision < 27361) {
+                handler(layout_20466_250());
+            } else if (revision < 29432) {
+                handler(layout_27361_250());
+            } else if (revision < 30474) {
+                handler(layout_29432_250());
+            } else if (revision < 34688) {
+                handler(layout_30474_250());
+            } else if (revision < 46540) {
+                handler(layout_34688_250());
+            } else {
+                handler(layout_46540_250());
+            }
+            break;
+        case 500:
+            if (revision < 29432) {
+                throw error(error::code::invalid_revision,
+                            "minimum supported firmware rev is 29432");
+            } else if (revision < 34688) {
+                handler(layout_29432_500());
+            } else {
+                handler(layout_34688_500());
+            }
+            break;
+        default:
+            throw error(error::code::invalid_frequency,
+                        "invalid frequency: " + std::to_string(frequency));
+    }
+}
+
+/*
+ * Check the arguments and calibration of a decode and clear the leftovers.
+ */
+static void decode_prepare(uint32_t* data, size_t len, size_t revision, buffer& leftovers,
+                           const calibration* calib) {
+    check_data_block(data, len, revision);
+    if (calib != nullptr && !calib->compiled()) {
+        throw error(error::code::invalid_value, "calibration is not compiled");
+    }
+    leftovers.clear();
+}
+
+/*
+ * Decode the data block with the decoder for the revision and frequency.
+ */
+template<typename Output>
+static void decode(uint32_t* data, size_t len, size_t revision, size_t frequency,
+                   Output& output, buffer& leftovers, const calibration* calib,
+                   recovery* recover) {
+    decode_prepare(data, len, revision, leftovers, calib);
+    with_layout(revision, frequency, [&](auto layout) {
+        decode_events<decltype(layout)>(data, len, revision, output, leftovers, calib, recover);
+    });
+}
+
+void unpack_trace(const uint32_t* words, const size_t length, uint16_t* samples) {
+    if (util::host_little_endian()) {
+        std::memcpy(samples, words, length * sizeof(uint32_t));
+        return;
+    }
+    for (size_t w = 0; w < length; ++w) {
+        *samples++ = static_cast<uint16_t>(words[w] & 0xFFFF);
+        *samples++ = static_cast<uint16_t>((words[w] >> 16) & 0xFFFF);
+    }
+}
+
+/*
+ * Unpack the trace words into the record's trace type widening each
+ * sample. SSE2 and NEON widen 8 samples per step.
+ */
+static void unpack_trace_wide(const uint32_t* words, const size_t length,
+                              record::trace_type::value_type* samples) {
+    size_t w = 0;
+    if (sizeof(record::trace_type::value_type) == sizeof(uint64_t)) {
+#if defined(PIXIE_LIST_MODE_SSE2)
+        const __m128i zero = _mm_setzero_si128();
+        for (; w + 4 <= length; w += 4) {
+            const __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(words + w));
+            const __m128i lo = _mm_unpacklo_epi16(packed, zero);
+            const __m128i hi = _mm_unpackhi_epi16(packed, zero);
+            auto* out = reinterpret_cast<__m128i*>(samples + w * 2);
+            _mm_storeu_si128(out + 0, _mm_unpacklo_epi32(lo, zero));
+            _mm_storeu_si128(out + 1, _mm_unpackhi_epi32(lo, zero));
+            _mm_storeu_si128(out + 2, _mm_unpacklo_epi32(hi, zero));
+            _mm_storeu_si128(out + 3, _mm_unpackhi_epi32(hi, zero));
+        }
+#elif defined(PIXIE_LIST_MODE_NEON)
+        for (; w + 4 <= length; w += 4) {
+            const uint16x8_t packed = vreinterpretq_u16_u32(vld1q_u32(words + w));
+            const uint32x4_t lo = vmovl_u16(vget_low_u16(packed));
+            const uint32x4_t hi = vmovl_u16(vget_high_u16(packed));
+            auto* out = reinterpret_cast<uint64_t*>(samples + w * 2);
+            vst1q_u64(out + 0, vmovl_u32(vget_low_u32(lo)));
+            vst1q_u64(out + 2, vmovl_u32(vget_high_u32(lo)));
+            vst1q_u64(out + 4, vmovl_u32(vget_low_u32(hi)));
+            vst1q_u64(out + 6, vmovl_u32(vget_high_u32(hi)));
+        }
+#endif
+    }
+    for (; w < length; ++w) {
+        samples[w * 2] = words[w] & 0xFFFF;
+        samples[w * 2 + 1] = (words[w] >> 16) & 0xFFFF;
+    }
+}
+
+/*
+ * Fill a record with a decoded event. Every value is set so a record can
+ * be reused keeping the capacity of its vectors.
+ */
+static void fill_record(const event_header& evt, const uint32_t* data, record& rec) {
+    rec.cfd_forced_trigger = evt.cfd_forced_trigger;
+    rec.cfd_trigger_source = evt.cfd_trigger_source;
+    rec.channel_number = evt.channel_number;
+    rec.crate_id = evt.crate_id;
+    rec.energy = evt.energy;
+    rec.event_length = evt.event_length;
+    rec.finish_code = evt.finish_code;
+    rec.header_length = evt.header_length;
+    rec.slot_id = evt.slot_id;
+    rec.trace_length = evt.trace_length;
+    rec.trace_out_of_range = evt.trace_out_of_range;
+    rec.cfd_fractional_time = record::time_type(evt.times.cfd_fractional_time);
+    rec.filter_time = record::time_type(evt.times.filter_time);
+    rec.time = rec.cfd_fractional_time + rec.filter_time;
+    rec.timestamp = evt.times.timestamp;
+    rec.cfd_fixed_time = evt.times.cfd_fixed_time;
+    rec.fixed_time = evt.times.fixed_time;
+
+    if (evt.config.ets) {
+        rec.external_time = record::time_type(evt.external_time(data));
+    } else {
+        rec.external_time = record::time_type(0);
+    }
+
+    if (evt.config.esums) {
+        rec.energy_sums.assign(data + evt.config.esums_offset,
+                               data + evt.config.esums_offset + num_esum_words - 1);
+        rec.filter_baseline = evt.filter_baseline(data);
+    } else {
+        rec.energy_sums.clear();
+        rec.filter_baseline = 0;
+    }
+
+    if (evt.config.qdc) {
+        rec.qdc.assign(data + evt.config.qdc_offset, data + evt.config.qdc_offset + num_qdc_words);
+    } else {
+        rec.qdc.clear();
+    }
+
+    if (evt.trace_length > 0) {
+        const size_t words = evt.event_length - evt.header_length;
+        rec.trace.resize(words * 2);
+        unpack_trace_wide(data + evt.header_length, words, rec.trace.data());
+    } else {
+        rec.trace.clear();
+    }
+}
+
+/*
+ * Output decoded events to records.
+ */
+struct record_output {
+    records& recs;
+
+    record_output(records& recs_) : recs(recs_) {}
+
+    void operator()(const event_header& evt, const uint32_t* data) {
+        recs.emplace_back();
+        fill_record(evt, data, recs.back());
+    }
+};
+
+/*
+ * Output decoded events to an arena's records.
+ */
+struct arena_output {
+    record_arena& arena;
+
+    arena_output(record_arena& arena_) : arena(arena_) {}
+
+    void operator()(const event_header& evt, const uint32_t* data) {
+        fill_record(evt, data, arena.next());
+    }
+};
+
+/*
+ * Output decoded events to a compact event set. The scratch record keeps
+ * its capacity between events.
+ */
+struct compact_output {
+    compact_events& events;
+    record scratch;
+
+    compact_output(compact_events& events_) : events(events_) {}
+
+    void operator()(const event_header& evt, const uint32_t* data) {
+        fill_record(evt, data, scratch);
+        events.add(scratch);
+    }
+};
+
+record_arena::record_arena() : count(0) {}
+
+record& record_arena::next() {
+    if (count == slots.size()) {
+        slots.emplace_back();
+    }
+    return slots[count++];
+}
+
+void record_arena::reserve(const size_t records_, const size_t trace_samples) {
+    if (slots.size() < records_) {
+        slots.resize(records_);
+    }
+    if (trace_samples > 0) {
+        for (auto& rec : slots) {
+            rec.trace.reserve(trace_samples);
+        }
+    }
+}
+
+/*
+ * Output decoded events to an event batch.
+ */
+struct batch_output {
+    event_batch& batch;
+
+    batch_output(event_batch& batch_) : batch(batch_) {}
+
+    void operator()(const event_header& evt, const uint32_t* data) {
+        const uint32_t fields = batch.fields;
+
+        if ((fields & scan_flags) != 0) {
+            uint8_t flags = 0;
+            if (evt.finish_code) {
+                flags |= event_batch::finish_code;
+            }
+            if (evt.trace_out_of_range) {
+                flags |= event_batch::trace_out_of_range;
+            }
+            if (evt.cfd_forced_trigger) {
+                flags |= event_batch::cfd_forced_trigger;
+            }
+            batch.flags.push_back(flags);
+        }
+
+        if ((fields & scan_times) != 0) {
+            batch.time.push_back(evt.times.time);
+            batch.filter_time.push_back(evt.times.filter_time);
+            batch.cfd_fractional_time.push_back(evt.times.cfd_fractional_time);
+            batch.timestamp.push_back(evt.times.timestamp);
+            batch.fixed_time.push_back(evt.times.fixed_time);
+        }
+        if ((fields & scan_external_time) != 0) {
+            batch.external_time.push_back(evt.config.ets ? evt.external_time(data) : 0);
+        }
+        if ((fields & scan_energy) != 0) {
+            batch.energy.push_back(evt.energy);
+        }
+        if ((fields & scan_ids) != 0) {
+            batch.crate.push_back(static_cast<event_batch::id_type>(evt.crate_id));
+            batch.slot.push_back(static_cast<event_batch::id_type>(evt.slot_id));
+            batch.channel.push_back(static_cast<event_batch::id_type>(evt.channel_number));
+            batch.cfd_trigger_source.push_back(static_cast<uint8_t>(evt.cfd_trigger_source));
+        }
+        batch.header_length.push_back(static_cast<uint16_t>(evt.header_length));
+        batch.event_length.push_back(static_cast<uint32_t>(evt.event_length));
+
+        if ((fields & scan_energy_sums) != 0) {
+            batch.filter_baseline.push_back(evt.config.esums ? evt.filter_baseline(data) : 0);
+            if (evt.config.esums) {
+                batch.energy_sums_offset.push_back(batch.energy_sums.size());
+                batch.energy_sums.insert(batch.energy_sums.end(), data + evt.config.esums_offset,
+                                         data + evt.config.esums_offset + num_esum_words - 1);
+            } else {
+                batch.energy_sums_offset.push_back(event_batch::no_data);
+            }
+        }
+
+        if ((fields & scan_qdc) != 0) {
+            if (evt.config.qdc) {
+                batch.qdc_offset.push_back(batch.qdc.size());
+                batch.qdc.insert(batch.qdc.end(), data + evt.config.qdc_offset,
+                                 data + evt.config.qdc_offset + num_qdc_words);
+            } else {
+                batch.qdc_offset.push_back(event_batch::no_data);
+            }
+        }
+
+        const size_t samples =
+            evt.trace_length > 0 ? (evt.event_length - evt.header_length) * 2 : 0;
+        batch.trace_length.push_back(static_cast<uint32_t>(samples));
+        if ((fields & scan_traces) == 0) {
+            return;
+        }
+        batch.trace_offset.push_back(batch.traces.size());
+        if (samples > 0) {
+            const size_t offset = batch.traces.size();
+            batch.traces.resize(offset + samples);
+            unpack_trace(data + evt.header_length, evt.event_length - evt.header_length,
+                         batch.traces.data() + offset);
+        }
+    }
+};
+
+constexpr size_t event_batch::no_data;
+
+event_batch::event_batch(uint32_t fields_) : fields(fields_) {}
+
+void event_batch::clear() {
+    time.clear();
+    filter_time.clear();
+    cfd_fractional_time.clear();
+    external_time.clear();
+    timestamp.clear();
+    fixed_time.clear();
+    energy.clear();
+    filter_baseline.clear();
+    crate.clear();
+    slot.clear();
+    channel.clear();
+    cfd_trigger_source.clear();
+    flags.clear();
+    header_length.clear();
+    event_length.clear();
+    energy_sums_offset.clear();
+    qdc_offset.clear();
+    trace_offset.clear();
+    trace_length.clear();
+    energy_sums.clear();
+    qdc.clear();
+    traces.clear();
+}
+
+void event_batch::reserve(const size_t events, const size_t trace_samples) {
+    time.reserve(events);
+    filter_time.reserve(events);
+    cfd_fractional_time.reserve(events);
+    external_time.reserve(events);
+    timestamp.reserve(events);
+    fixed_time.reserve(events);
+    energy.reserve(events);
+    filter_baseline.reserve(events);
+    crate.reserve(events);
+    slot.reserve(events);
+    channel.reserve(events);
+    cfd_trigger_source.reserve(events);
+    flags.reserve(events);
+    header_length.reserve(events);
+    event_length.reserve(events);
+    energy_sums_offset.reserve(events);
+    qdc_offset.reserve(events);
+    trace_offset.reserve(events);
+    trace_length.reserve(events);
+    traces.reserve(trace_samples);
+}
+
+event_batch::trace_view event_batch::trace(const size_t event) const {
+    if (!holds(scan_traces)) {
+        trace_view view = {nullptr, 0};
+        return view;
+    }
+    trace_view view = {traces.data() + trace_offset[event], trace_length[event]};
+    return view;
+}
+
+void event_batch::get(const size_t event, record& rec) const {
+    if (event >= size()) {
+        throw error(error::code::invalid_value, "event batch index out of range");
+    }
+    rec = record();
+    if (holds(scan_flags)) {
+        rec.cfd_forced_trigger = (flags[event] & cfd_forced_trigger) != 0;
+        rec.finish_code = (flags[event] & finish_code) != 0;
+        rec.trace_out_of_range = (flags[event] & trace_out_of_range) != 0;
+    }
+    if (holds(scan_times)) {
+        rec.cfd_fractional_time = record::time_type(cfd_fractional_time[event]);
+        rec.filter_time = record::time_type(filter_time[event]);
+        rec.time = rec.cfd_fractional_time + rec.filter_time;
+        rec.cfd_fixed_time = record::to_fixed_time(rec.cfd_fractional_time);
+        if (event < fixed_time.size()) {
+            rec.timestamp = timestamp[event];
+            rec.fixed_time = fixed_time[event];
+        } else {
+            rec.fixed_time = record::to_fixed_time(rec.time);
+        }
+    }
+    if (holds(scan_ids)) {
+        rec.cfd_trigger_source = cfd_trigger_source[event];
+        rec.channel_number = channel[event];
+        rec.crate_id = crate[event];
+        rec.slot_id = slot[event];
+    }
+    if (holds(scan_energy)) {
+        rec.energy = energy[event];
+    }
+    if (holds(scan_energy_sums)) {
+        if (energy_sums_offset[event] != no_data) {
+            auto first = energy_sums.begin() + energy_sums_offset[event];
+            rec.energy_sums.assign(first, first + num_esum_words - 1);
+        }
+        rec.filter_baseline = filter_baseline[event];
+    }
+    if (holds(scan_external_time)) {
+        rec.external_time = record::time_type(external_time[event]);
+    }
+    rec.event_length = event_length[event];
+    rec.header_length = header_length[event];
+    if (holds(scan_qdc) && qdc_offset[event] != no_data) {
+        auto first = qdc.begin() + qdc_offset[event];
+        rec.qdc.assign(first, first + num_qdc_words);
+    }
+    auto trc = trace(event);
+    rec.trace.assign(trc.data, trc.data + trc.length);
+    rec.trace_length = trace_length[event];
+}
+
+static_assert(sizeof(compact_event) == 48, "compact event is not 48 bytes");
+
+constexpr uint8_t compact_event::cfd_forced_trigger;
+constexpr uint8_t compact_event::finish_code;
+constexpr uint8_t compact_event::trace_out_of_range;
+constexpr uint8_t compact_event::has_external_time;
+constexpr uint8_t compact_event::has_energy_sums;
+constexpr uint8_t compact_event::has_qdc;
+constexpr uint32_t compact_events::blocks_all;
+
+template<typename T, typename V>
+static T compact_value(const V value, const char* what) {
+    if (value > V(std::numeric_limits<T>::max())) {
+        throw error(error::code::invalid_value,
+                    std::string("compact event: value does not fit: ") + what);
+    }
+    return static_cast<T>(value);
+}
+
+static int32_t compact_cfd_time(const record::fixed_time_type value) {
+    if (value < std::numeric_limits<int32_t>::min() ||
+        value > std::numeric_limits<int32_t>::max()) {
+        throw error(error::code::invalid_value,
+                    "compact event: value does not fit: cfd fixed time");
+    }
+    return static_cast<int32_t>(value);
+}
+
+static void compact_arena_check(const size_t size, const size_t adding, const char* what) {
+    if (adding > std::numeric_limits<uint32_t>::max() - size) {
+        throw error(error::code::invalid_value, std::string("compact events: arena full: ") + what);
+    }
+}
+
+compact_events::compact_events(uint32_t blocks_) : blocks(blocks_ & blocks_all) {}
+
+void compact_events::add(const record& rec) {
+    compact_event ev;
+    ev.fixed_time = rec.fixed_time;
+    ev.timestamp = rec.timestamp;
+    ev.cfd_fixed_time = compact_cfd_time(rec.cfd_fixed_time);
+    ev.energy = static_cast<float>(rec.energy);
+    ev.event_length = compact_value<uint32_t>(rec.event_length, "event length");
+    ev.crate_id = compact_value<uint8_t>(rec.crate_id, "crate id");
+    ev.slot_id = compact_value<uint8_t>(rec.slot_id, "slot id");
+    ev.channel_number = compact_value<uint8_t>(rec.channel_number, "channel number");
+    ev.cfd_trigger_source = compact_value<uint8_t>(rec.cfd_trigger_source, "cfd trigger source");
+    ev.header_length = compact_value<uint8_t>(rec.header_length, "header length");
+    ev.flags = 0;
+    if (rec.cfd_forced_trigger) {
+        ev.flags |= compact_event::cfd_forced_trigger;
+    }
+    if (rec.finish_code) {
+        ev.flags |= compact_event::finish_code;
+    }
+    if (rec.trace_out_of_range) {
+        ev.flags |= compact_event::trace_out_of_range;
+    }
+
+    const bool ets = (blocks & scan_external_time) != 0 && rec.external_time.count() != 0;
+    const bool esums = (blocks & scan_energy_sums) != 0 && !rec.energy_sums.empty();
+    const bool qdc = (blocks & scan_qdc) != 0 && !rec.qdc.empty();
+    if (esums && rec.energy_sums.size() != num_esum_words - 1) {
+        throw error(error::code::invalid_value, "compact event: invalid energy sums");
+    }
+    if (qdc && rec.qdc.size() != num_qdc_words) {
+        throw error(error::code::invalid_value, "compact event: invalid QDC sums");
+    }
+    for (auto sum : rec.energy_sums) {
+        compact_value<uint32_t>(sum, "energy sum");
+    }
+    for (auto sum : rec.qdc) {
+        compact_value<uint32_t>(sum, "qdc sum");
+    }
+    const size_t words = (ets ? num_ext_ts_words : 0) + (esums ? num_esum_words : 0) +
+                         (qdc ? num_qdc_words : 0);
+    compact_arena_check(block_words.size(), words, "blocks");
+    ev.blocks = static_cast<uint32_t>(block_words.size());
+    if (ets) {
+        ev.flags |= compact_event::has_external_time;
+        const auto ts = static_cast<uint64_t>(rec.external_time.count());
+        block_words.push_back(static_cast<uint32_t>(ts));
+        block_words.push_back(static_cast<uint32_t>(ts >> 32));
+    }
+    if (esums) {
+        ev.flags |= compact_event::has_energy_sums;
+        block_words.insert(block_words.end(), rec.energy_sums.begin(), rec.energy_sums.end());
+        block_words.push_back(util::ieee_float(rec.filter_baseline));
+    }
+    if (qdc) {
+        ev.flags |= compact_event::has_qdc;
+        block_words.insert(block_words.end(), rec.qdc.begin(), rec.qdc.end());
+    }
+
+    /*
+     * A held trace's length is its samples in the arena.
+     */
+    ev.trace_offset = static_cast<uint32_t>(traces.size());
+    if ((blocks & scan_traces) != 0) {
+        compact_arena_check(traces.size(), rec.trace.size(), "traces");
+        ev.trace_length = static_cast<uint32_t>(rec.trace.size());
+        if (!rec.trace.empty()) {
+            compact_value<trace_value>(*std::max_element(rec.trace.begin(), rec.trace.end()),
+                                       "trace sample");
+            traces.insert(traces.end(), rec.trace.begin(), rec.trace.end());
+        }
+    } else {
+        ev.trace_length = compact_value<uint32_t>(rec.trace_length, "trace length");
+    }
+    events.push_back(ev);
+}
+
+void compact_events::get(const size_t event, record& rec) const {
+    if (event >= events.size()) {
+        throw error(error::code::invalid_value, "compact events index out of range");
+    }
+    const auto& ev = events[event];
+    rec = record();
+    rec.cfd_forced_trigger = (ev.flags & compact_event::cfd_forced_trigger) != 0;
+    rec.finish_code = (ev.flags & compact_event::finish_code) != 0;
+    rec.trace_out_of_range = (ev.flags & compact_event::trace_out_of_range) != 0;
+    rec.fixed_time = ev.fixed_time;
+    rec.cfd_fixed_time = ev.cfd_fixed_time;
+    rec.timestamp = ev.timestamp;
+    rec.time = record::from_fixed_time(ev.fixed_time);
+    rec.cfd_fractional_time = record::from_fixed_time(ev.cfd_fixed_time);
+    rec.filter_time = record::from_fixed_time(ev.fixed_time - ev.cfd_fixed_time);
+    rec.energy = ev.energy;
+    rec.event_length = ev.event_length;
+    rec.crate_id = ev.crate_id;
+    rec.slot_id = ev.slot_id;
+    rec.channel_number = ev.channel_number;
+    rec.cfd_trigger_source = ev.cfd_trigger_source;
+    rec.header_length = ev.header_length;
+    rec.trace_length = ev.trace_length;
+
+    const uint32_t* block = block_words.data() + ev.blocks;
+    if ((ev.flags & compact_event::has_external_time) != 0) {
+        rec.external_time = record::time_type(make_u64_double(block[1], block[0]));
+        block += num_ext_ts_words;
+    }
+    if ((ev.flags & compact_event::has_energy_sums) != 0) {
+        rec.energy_sums.assign(block, block + num_esum_words - 1);
+        rec.filter_baseline = util::ieee_float(block[num_esum_words - 1]);
+        block += num_esum_words;
+    }
+    if ((ev.flags & compact_event::has_qdc) != 0) {
+        rec.qdc.assign(block, block + num_qdc_words);
+    }
+    auto trc = trace(event);
+    rec.trace.assign(trc.data, trc.data + trc.length);
+}
+
+event_batch::trace_view compact_events::trace(const size_t event) const {
+    if ((blocks & scan_traces) == 0) {
+        event_batch::trace_view view = {nullptr, 0};
+        return view;
+    }
+    const auto& ev = events[event];
+    event_batch::trace_view view = {traces.data() + ev.trace_offset, ev.trace_length};
+    return view;
+}
+
+void compact_events::clear() {
+    events.clear();
+    block_words.clear();
+    traces.clear();
+}
+
+void compact_events::reserve(const size_t events_, const size_t trace_samples) {
+    events.reserve(events_);
+    if ((blocks & scan_traces) != 0) {
+        traces.reserve(events_ * trace_samples);
+    }
+}
+
+size_t compact_events::bytes() const {
+    return events.size() * sizeof(compact_event) + block_words.size() * sizeof(uint32_t) +
+           traces.size() * sizeof(trace_value);
+}
+
+constexpr size_t calibration::energy_range;
+constexpr size_t calibration::max_ids;
+
+calibration::calibration() : compiled_(false) {}
+
+void calibration::set(size_t crate, size_t slot, size_t channel, const coefficients& energy,
+                      time_type time_offset) {
+    if (crate >= max_ids || slot >= max_ids || channel >= max_ids) {
+        std::stringstream msg;
+        msg << "calibration: invalid channel: crate=" << crate << " slot=" << slot
+            << " channel=" << channel;
+        throw error(error::code::invalid_value, msg.str());
+    }
+    compiled_ = false;
+    for (auto& setting : settings) {
+        if (setting.crate == crate && setting.slot == slot && setting.channel == channel) {
+            setting.energy = energy;
+            setting.time_offset = time_offset;
+            return;
+        }
+    }
+    settings.push_back({crate, slot, channel, energy, time_offset});
+}
+
+void calibration::compile() {
+    tables.clear();
+    tables.reserve(settings.size());
+    index.assign(max_ids * max_ids * max_ids, -1);
+    for (auto& setting : settings) {
+        channel_table table;
+        if (!setting.energy.empty()) {
+            table.energy.resize(energy_range);
+            for (size_t e = 0; e < energy_range; ++e) {
+                /*
+                 * Horner's method from the highest power.
+                 */
+                double value = 0;
+                for (auto c = setting.energy.rbegin(); c != setting.energy.rend(); ++c) {
+                    value = value * double(e) + *c;
+                }
+                table.energy[e] = value;
+            }
+        }
+        table.time_offset = setting.time_offset;
+        table.fixed_time_offset = record::to_fixed_time(setting.time_offset);
+        index[(setting.crate * max_ids + setting.slot) * max_ids + setting.channel] =
+            int32_t(tables.size());
+        tables.push_back(std::move(table));
+    }
+    compiled_ = true;
+}
+
+void calibration::clear() {
+    settings.clear();
+    tables.clear();
+    index.clear();
+    compiled_ = false;
+}
+
+constexpr size_t recovery::any;
+
+recovery::recovery(size_t slot_, size_t crate_) : slot(slot_), crate(crate_) {
+    reset();
+}
+
+void recovery::reset() {
+    errors = 0;
+    resyncs = 0;
+    skipped_words = 0;
+    resyncing = false;
+}
+
+void decode_data_block(uint32_t* data, size_t len, size_t revision, size_t frequency, records& recs,
+                       buffer& leftovers, const calibration* calib, recovery* recover) {
+    recs.clear();
+    record_output output(recs);
+    decode(data, len, revision, frequency, output, leftovers, calib, recover);
+}
+
+void decode_data_block(buffer data, size_t revision, size_t frequency, records& recs,
+                       buffer& leftovers) {
+    decode_data_block(data.data(), data.size(), revision, frequency, recs, leftovers);
+}
+
+void decode_data_block(uint32_t* data, size_t len, size_t revision, size_t frequency,
+                       record_arena& arena, buffer& leftovers, const calibration* calib,
+                       recovery* recover) {
+    arena.clear();
+    arena_output output(arena);
+    decode(data, len, revision, frequency, output, leftovers, calib, recover);
+}
+
+void decode_data_block(uint32_t* data, size_t len, size_t revision, size_t frequency,
+                       event_batch& batch, buffer& leftovers, const calibration* calib,
+                       recovery* recover) {
+    batch_output output(batch);
+    decode(data, len, revision, frequency, output, leftovers, calib, recover);
+}
+
+void decode_data_block(uint32_t* data, size_t len, size_t revision, size_t frequency,
+                       compact_events& events, buffer& leftovers, const calibration* calib,
+                       recovery* recover) {
+    compact_output output(events);
+    decode(data, len, revision, frequency, output, leftovers, calib, recover);
+}
+
+/*
+ * A layout's decoder of a target. The decoder's table holds these.
+ */
+template<typename Layout, typename Output, typename Target>
+static void decode_layout(uint32_t* data, size_t len, size_t revision, Target& target,
+                          buffer& leftovers, const calibration* calib, recovery* recover) {
+    Output output(target);
+    decode_events<Layout>(data, len, revision, output, leftovers, calib, recover);
+}
+
+decoder::decoder(size_t revision_, size_t frequency_)
+    : revision(revision_), frequency(frequency_), records_path(nullptr), arena_path(nullptr),
+      batch_path(nullptr), compact_path(nullptr) {
+    if (revision < min_rev) {
+        throw error(error::code::invalid_revision,
+                    "minimum supported firmware rev is " + std::to_string(min_rev));
+    }
+    with_layout(revision, frequency, [this](auto layout) {
+        using Layout = decltype(layout);
+        records_path = decode_layout<Layout, record_output, records>;
+        arena_path = decode_layout<Layout, arena_output, record_arena>;
+        batch_path = decode_layout<Layout, batch_output, event_batch>;
+        compact_path = decode_layout<Layout, compact_output, compact_events>;
+    });
+}
+
+void decoder::decode(uint32_t* data, size_t len, records& recs, buffer& leftovers,
+                     const calibration* calib, recovery* recover) const {
+    recs.clear();
+    decode_prepare(data, len, revision, leftovers, calib);
+    records_path(data, len, revision, recs, leftovers, calib, recover);
+}
+
+void decoder::decode(uint32_t* data, size_t len, record_arena& arena, buffer& leftovers,
+                     const calibration* calib, recovery* recover) const {
+    arena.clear();
+    decode_prepare(data, len, revision, leftovers, calib);
+    arena_path(data, len, revision, arena, leftovers, calib, recover);
+}
+
+void decoder::decode(uint32_t* data, size_t len, event_batch& batch, buffer& leftovers,
+                     const calibration* calib, recovery* recover) const {
+    decode_prepare(data, len, revision, leftovers, calib);
+    batch_path(data, len, revision, batch, leftovers, calib, recover);
+}
+
+void decoder::decode(uint32_t* data, size_t len, compact_events& events, buffer& leftovers,
+                     const calibration* calib, recovery* recover) const {
+    decode_prepare(data, len, revision, leftovers, calib);
+    compact_path(data, len, revision, events, leftovers, calib, recover);
+}
+
+void scan_data_block(uint32_t* data, size_t len, size_t revision, size_t frequency,
+                     uint32_t fields, event_batch& batch, buffer& leftovers,
+                     const calibration* calib, recovery* recover) {
+    batch.clear();
+    batch.fields = fields;
+    decode_data_block(data, len, revision, frequency, batch, leftovers, calib, recover);
+}
+
+template<typename Layout>
+static size_t walk_events(const uint32_t* data, size_t len, size_t chunk_words,
+                          std::vector<size_t>& boundaries) {
+    size_t pos = 0;
+    size_t next_boundary = chunk_words;
+    boundaries.push_back(0);
+    while (len - pos >= min_words) {
+        const size_t event_length = Layout::event_length::get(data + pos);
+        if (event_length == 0) {
+            throw error(error::code::invalid_event_length, "bad event length: 0");
+        }
+        if (len - pos < event_length) {
+            break;
+        }
+        pos += event_length;
+        if (pos >= next_boundary) {
+            boundaries.push_back(pos);
+            next_boundary = pos + chunk_words;
+        }
+    }
+    if (boundaries.back() != pos) {
+        boundaries.push_back(pos);
+    }
+    return pos;
+}
+
+size_t find_event_boundaries(const uint32_t* data, size_t len, size_t revision, size_t frequency,
+                             size_t chunk_words, std::vector<size_t>& boundaries) {
+    check_data_block(data, len, revision);
+    if (chunk_words == 0) {
+        throw error(error::code::invalid_value, "chunk size cannot be 0");
+    }
+    boundaries.clear();
+    size_t complete = 0;
+    with_layout(revision, frequency, [&](auto layout) {
+        complete = walk_events<decltype(layout)>(data, len, chunk_words, boundaries);
+    });
+    return complete;
+}
+
+void decode_data_block_parallel(uint32_t* data, size_t len, size_t revision, size_t frequency,
+                                size_t threads, const batch_handler& handler, buffer& leftovers,
+                                uint32_t fields, const calibration* calib) {
+    if (threads == 0) {
+        threads = std::max(std::thread::hardware_concurrency(), 1U);
+    }
+
+    /*
+     * A worker's batch holds a chunk's decoded events so the chunks are
+     * bounded in size to bound the memory used.
+     */
+    const size_t chunk_words =
+        std::min(parallel_chunk_words, std::max((len + threads - 1) / threads, min_words));
+
+    std::vector<size_t> boundaries;
+    const size_t complete =
+        find_event_boundaries(data, len, revision, frequency, chunk_words, boundaries);
+    leftovers.assign(data + complete, data + len);
+
+    const size_t chunks = boundaries.size() - 1;
+    threads = std::min(threads, chunks);
+
+    std::atomic_size_t next_chunk(0);
+    std::atomic_bool failed(false);
+    std::vector<std::exception_ptr> errors(chunks);
+
+    auto worker = [&](size_t number) {
+        event_batch batch(fields);
+        buffer chunk_leftovers;
+        while (!failed.load()) {
+            const size_t chunk = next_chunk++;
+            if (chunk >= chunks) {
+                break;
+            }
+            try {
+                batch.clear();
+                decode_data_block(data + boundaries[chunk],
+                                  boundaries[chunk + 1] - boundaries[chunk], revision, frequency,
+                                  batch, chunk_leftovers, calib);
+                handler(number, batch);
+            } catch (...) {
+                errors[chunk] = std::current_exception();
+                failed = true;
+            }
+        }
+    };
+
+    if (threads <= 1) {
+        worker(0);
+    } else {
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < threads; ++t) {
+            workers.emplace_back(worker, t);
+        }
+        for (auto& w : workers) {
+            w.join();
+        }
+    }
+
+    /*
+     * Report the error closest to the start of the data, this is the error a
+     * serial decode reports.
+     */
+    for (auto& e : errors) {
+        if (e) {
+            std::rethrow_exception(e);
+        }
+    }
+}
+
+reduction::reduction()
+    : channel_mask(std::numeric_limits<uint64_t>::max()), energy_min(0),
+      energy_max(std::numeric_limits<uint32_t>::max()), finish_code(finish_codes::keep) {}
+
+/*
+ * A packed trace word holds two samples with the first sample in the low
+ * half.
+ */
+static size_t trace_sample(const uint32_t* words, size_t sample) {
+    return (words[sample / 2] >> ((sample & 1) * 16)) & 0xFFFF;
+}
+
+static void set_trace_sample(uint32_t* words, size_t sample, size_t value) {
+    const unsigned shift = unsigned(sample & 1) * 16;
+    words[sample / 2] =
+        (words[sample / 2] & ~(uint32_t(0xFFFF) << shift)) | (uint32_t(value & 0xFFFF) << shift);
+}
+
+reduction::trace_roi::trace_roi() : start(0), length(0), decimation(0) {}
+
+size_t reduction::trace_roi::reduced_length(size_t trace_length) const {
+    const size_t roi_start = std::min(start, trace_length);
+    const size_t roi_end = std::min(start + length, trace_length);
+    size_t samples = roi_end - roi_start;
+    if (decimation != 0) {
+        samples += (roi_start + decimation - 1) / decimation;
+        samples += (trace_length - roi_end + decimation - 1) / decimation;
+    }
+    return (samples + 1) & ~size_t(1);
+}
+
+/*
+ * A reduced sample is never written past the input sample being read so
+ * the trace can be reduced in place. Only the half of a word holding the
+ * sample is written.
+ */
+size_t reduction::trace_roi::reduce(const uint32_t* in, size_t trace_length,
+                                    uint32_t* out) const {
+    const size_t roi_start = std::min(start, trace_length);
+    const size_t roi_end = std::min(start + length, trace_length);
+    size_t samples = 0;
+    auto decimate = [&](size_t from, size_t to) {
+        if (decimation == 0) {
+            return;
+        }
+        for (size_t s = from; s < to; s += decimation) {
+            const size_t end = std::min(s + decimation, to);
+            size_t sum = 0;
+            for (size_t d = s; d < end; ++d) {
+                sum += trace_sample(in, d);
+            }
+            set_trace_sample(out, samples++, sum / (end - s));
+        }
+    };
+    decimate(0, roi_start);
+    for (size_t s = roi_start; s < roi_end; ++s) {
+        set_trace_sample(out, samples++, trace_sample(in, s));
+    }
+    decimate(roi_end, trace_length);
+    if ((samples & 1) != 0) {
+        set_trace_sample(out, samples++, 0);
+    }
+    return samples;
+}
+
+void reduction::trace_roi::expand(const record::trace_type& reduced, size_t trace_length,
+                                  record::trace_type& trace) const {
+    if (reduced.size() < reduced_length(trace_length)) {
+        throw error(error::code::invalid_value,
+                    "trace roi: reduced trace too short: samples=" +
+                        std::to_string(reduced.size()) +
+                        " trace-length=" + std::to_string(trace_length));
+    }
+    const size_t roi_start = std::min(start, trace_length);
+    const size_t roi_end = std::min(start + length, trace_length);
+    trace.resize(trace_length);
+    size_t r = 0;
+    auto fill = [&](size_t from, size_t to) {
+        if (decimation == 0) {
+            std::fill(trace.begin() + from, trace.begin() + to, 0);
+            return;
+        }
+        for (size_t s = from; s < to; s += decimation) {
+            const size_t end = std::min(s + decimation, to);
+            std::fill(trace.begin() + s, trace.begin() + end, reduced[r++]);
+        }
+    };
+    fill(0, roi_start);
+    std::copy(reduced.begin() + r, reduced.begin() + r + (roi_end - roi_start),
+              trace.begin() + roi_start);
+    r += roi_end - roi_start;
+    fill(roi_end, trace_length);
+}
+
+bool reduction::pass_through() const {
+    if (channel_mask != std::numeric_limits<uint64_t>::max() || energy_min != 0 ||
+        energy_max != std::numeric_limits<uint32_t>::max() ||
+        finish_code != finish_codes::keep) {
+        return false;
+    }
+    return std::all_of(trace_policy.begin(), trace_policy.end(),
+                       [](traces t) { return t == traces::keep; });
+}
+
+event_filter::stats::stats()
+    : events_in(0), events_out(0), traces_stripped(0), traces_reduced(0), words_in(0),
+      words_out(0) {}
+
+event_filter::event_filter() : revision(0), frequency(0), configured(false), pass(0), skip(0) {}
+
+void event_filter::configure(const reduction& policy, size_t revision_, size_t frequency_) {
+    if (revision_ < min_rev) {
+        throw error(error::code::invalid_revision,
+                    "minimum supported firmware rev is " + std::to_string(min_rev));
+    }
+    with_layout(revision_, frequency_, [](auto) {});
+    if (policy.energy_min > policy.energy_max) {
+        throw error(error::code::invalid_value, "event filter: energy window is empty");
+    }
+    for (size_t channel = 0; channel < policy.trace_policy.size(); ++channel) {
+        if (policy.trace_policy[channel] == reduction::traces::roi &&
+            (channel >= policy.trace_rois.size() || policy.trace_rois[channel].length == 0)) {
+            throw error(error::code::invalid_value,
+                        "event filter: no trace region of interest: channel=" +
+                            std::to_string(channel));
+        }
+    }
+    policy_ = policy;
+    revision = revision_;
+    frequency = frequency_;
+    configured = true;
+    counts_ = stats();
+    reset();
+}
+
+void event_filter::reset() {
+    pass = 0;
+    skip = 0;
+    held.clear();
+}
+
+bool event_filter::enabled() const {
+    return configured && !policy_.pass_through();
+}
+
+size_t event_filter::reduce(uint32_t* data, size_t len) {
+    if (!configured) {
+        throw error(error::code::invalid_value, "event filter: not configured");
+    }
+    size_t out = 0;
+    with_layout(revision, frequency, [&](auto layout) {
+        out = reduce_events<decltype(layout)>(data, len);
+    });
+    counts_.words_in += len;
+    counts_.words_out += out;
+    return out;
+}
+
+/*
+ * The reduced events are moved down over the dropped words so the output
+ * never overtakes the input. An event can continue into the next block so
+ * the words of a kept event still to come are passed and the words of a
+ * dropped event or a stripped trace are skipped when the next block
+ * arrives.
+ */
+template<typename Layout>
+size_t event_filter::reduce_events(uint32_t* data, size_t len) {
+    size_t in = 0;
+    size_t out = 0;
+    if (pass != 0) {
+        const size_t words = std::min(pass, len);
+        in += words;
+        out += words;
+        pass -= words;
+    }
+    if (skip != 0) {
+        const size_t words = std::min(skip, len - in);
+        in += words;
+        skip -= words;
+    }
+    while (in < len) {
+        uint32_t* event = data + in;
+        const size_t avail = len - in;
+        if (avail < min_words || avail < Layout::header_length::get(event)) {
+            held.assign(event, event + avail);
+            break;
+        }
+        const size_t header_length = Layout::header_length::get(event);
+        const size_t event_length = Layout::event_length::get(event);
+        if (header_length < min_words || event_length < header_length) {
+            throw error(error::code::invalid_event_length,
+                        "event filter: bad event length: header=" +
+                            std::to_string(header_length) +
+                            " event=" + std::to_string(event_length));
+        }
+        const size_t channel = Layout::channel_number::get(event);
+        const uint32_t energy = Layout::energy::get(event);
+        const bool pileup = Layout::finish_code::get(event) != 0;
+        bool keep = (policy_.channel_mask & (uint64_t(1) << channel)) != 0 &&
+            energy >= policy_.energy_min && energy <= policy_.energy_max;
+        if (policy_.finish_code == reduction::finish_codes::drop) {
+            keep = keep && !pileup;
+        } else if (policy_.finish_code == reduction::finish_codes::only) {
+            keep = keep && pileup;
+        }
+        const bool roi = keep && event_length > header_length &&
+            channel < policy_.trace_policy.size() &&
+            policy_.trace_policy[channel] == reduction::traces::roi;
+        if (roi && avail < event_length) {
+            held.assign(event, event + avail);
+            break;
+        }
+        ++counts_.events_in;
+        const size_t words = std::min(event_length, avail);
+        if (!keep) {
+            skip = event_length - words;
+            in += words;
+            continue;
+        }
+        ++counts_.events_out;
+        if (roi) {
+            const size_t trace_length = std::min(size_t(Layout::trace_length::get(event)),
+                                                 (event_length - header_length) * 2);
+            if (out != in) {
+                std::memmove(data + out, event, header_length * sizeof(uint32_t));
+            }
+            const size_t samples = policy_.trace_rois[channel].reduce(
+                event + header_length, trace_length, data + out + header_length);
+            ++counts_.traces_reduced;
+            Layout::event_length::set(data + out, uint32_t(header_length + samples / 2));
+            Layout::trace_length::set(data + out, uint32_t(samples));
+            in += words;
+            out += header_length + samples / 2;
+            continue;
+        }
+        bool strip = false;
+        if (event_length > header_length && channel < policy_.trace_policy.size()) {
+            switch (policy_.trace_policy[channel]) {
+                case reduction::traces::strip:
+                    strip = true;
+                    break;
+                case reduction::traces::pileup:
+                    strip = !pileup;
+                    break;
+                default:
+                    break;
+            }
+        }
+        const size_t kept = strip ? header_length : words;
+        if (out != in) {
+            std::memmove(data + out, event, kept * sizeof(uint32_t));
+        }
+        if (strip) {
+            ++counts_.traces_stripped;
+            Layout::event_length::set(data + out, uint32_t(header_length));
+            Layout::trace_length::set(data + out, 0);
+            skip = event_length - words;
+        } else {
+            pass = event_length - words;
+        }
+        in += words;
+        out += kept;
+    }
+    return out;
+}
+
+event_validator::stats::stats()
+    : blocks(0), words(0), events(0), faults(0), resyncs(0), skipped_words(0), zero_runs(0) {}
+
+event_validator::event_validator()
+    : revision(0), frequency(0), slot(0), crate(any_crate), zero_run_words(0), max_faults(0),
+      configured(false), offset(0), skip(0), zero_run(0), resyncing(false), fault_at(0), held(),
+      held_count(0) {}
+
+void event_validator::configure(size_t revision_, size_t frequency_, size_t slot_, size_t crate_,
+                                size_t zero_run_words_, size_t max_faults_) {
+    if (revision_ < min_rev) {
+        throw error(error::code::invalid_revision,
+                    "minimum supported firmware rev is " + std::to_string(min_rev));
+    }
+    with_layout(revision_, frequency_, [](auto) {});
+    revision = revision_;
+    frequency = frequency_;
+    slot = slot_;
+    crate = crate_;
+    zero_run_words = zero_run_words_;
+    max_faults = max_faults_;
+    faults_.reserve(max_faults);
+    configured = true;
+    reset();
+}
+
+void event_validator::reset() {
+    counts_ = stats();
+    faults_.clear();
+    offset = 0;
+    skip = 0;
+    zero_run = 0;
+    resyncing = false;
+    fault_at = 0;
+    held_count = 0;
+}
+
+void event_validator::clear_faults() {
+    faults_.clear();
+}
+
+size_t event_validator::validate(const uint32_t* data, size_t len) {
+    if (!configured) {
+        throw error(error::code::invalid_value, "event validator: not configured");
+    }
+    const size_t before = counts_.faults;
+    with_layout(revision, frequency, [&](auto layout) {
+        check_events<decltype(layout)>(data, len);
+    });
+    if (zero_run_words != 0) {
+        scan_zero_runs(data, len);
+    }
+    ++counts_.blocks;
+    counts_.words += len;
+    offset += len;
+    return counts_.faults - before;
+}
+
+void event_validator::note(fault_kind kind, size_t at, uint32_t word) {
+    if (kind == fault_kind::resync) {
+        ++counts_.resyncs;
+    } else {
+        ++counts_.faults;
+    }
+    if (faults_.size() < max_faults) {
+        faults_.push_back({kind, at, word});
+    }
+}
+
+template<typename Layout>
+size_t event_validator::check_header(const uint32_t* header, const size_t* at) {
+    const size_t header_length = Layout::header_length::get(header);
+    const size_t event_length = Layout::event_length::get(header);
+    fault_kind kind;
+    if (header_length < min_words || header_length > header_esum_qdc_ets ||
+        (header_length & 1) != 0) {
+        kind = fault_kind::header_length;
+    } else if (event_length != header_length + Layout::trace_length::get(header) / 2) {
+        kind = fault_kind::event_length;
+    } else if (Layout::slot_id::get(header) != slot) {
+        kind = fault_kind::slot;
+    } else if (crate != any_crate && Layout::crate_id::get(header) != crate) {
+        kind = fault_kind::crate;
+    } else {
+        return event_length;
+    }
+    if (at != nullptr) {
+        note(kind, *at, header[0]);
+    }
+    return 0;
+}
+
+/*
+ * An event is skipped by its length once its header is checked. After a
+ * fault each word is tried as a header until one passes the checks. A
+ * header or a word being tried that the end of a block splits is held
+ * until the next block.
+ */
+template<typename Layout>
+void event_validator::check_events(const uint32_t* data, size_t len) {
+    size_t pos = 0;
+    while (held_count != 0) {
+        const size_t take = std::min(min_words - held_count, len - pos);
+        std::copy(data + pos, data + pos + take, held.begin() + held_count);
+        held_count += take;
+        pos += take;
+        if (held_count < min_words) {
+            return;
+        }
+        const size_t at = offset + pos - min_words;
+        if (resyncing && check_header<Layout>(held.data(), nullptr) != 0) {
+            resynced(at);
+        }
+        const size_t event_length = resyncing ? 0 : check_header<Layout>(held.data(), &at);
+        if (event_length == 0) {
+            if (!resyncing) {
+                fail(at);
+            }
+            std::copy(held.begin() + 1, held.end(), held.begin());
+            held_count = min_words - 1;
+            ++counts_.skipped_words;
+            continue;
+        }
+        held_count = 0;
+        ++counts_.events;
+        skip = event_length - min_words;
+    }
+    if (skip != 0) {
+        const size_t words = std::min(skip, len - pos);
+        pos += words;
+        skip -= words;
+    }
+    while (pos < len) {
+        if (resyncing) {
+            const size_t from = pos;
+            while (len - pos >= min_words && check_header<Layout>(data + pos, nullptr) == 0) {
+                ++pos;
+            }
+            counts_.skipped_words += pos - from;
+            if (len - pos >= min_words) {
+                resynced(offset + pos);
+            }
+        }
+        const size_t avail = len - pos;
+        if (avail < min_words) {
+            std::copy(data + pos, data + len, held.begin());
+            held_count = avail;
+            break;
+        }
+        const size_t at = offset + pos;
+        const size_t event_length = check_header<Layout>(data + pos, &at);
+        if (event_length == 0) {
+            fail(at);
+            ++pos;
+            ++counts_.skipped_words;
+            continue;
+        }
+        ++counts_.events;
+        const size_t words = std::min(event_length, avail);
+        skip = event_length - words;
+        pos += words;
+    }
+}
+
+void event_validator::fail(size_t at) {
+    resyncing = true;
+    fault_at = at;
+}
+
+void event_validator::resynced(size_t at) {
+    resyncing = false;
+    note(fault_kind::resync, at, uint32_t(at - fault_at));
+}
+
+/*
+ * Most blocks have no zero words. SSE2 and NEON test 4 words per step and
+ * only a step with a zero word is scanned a word at a time.
+ */
+void event_validator::scan_zero_runs(const uint32_t* data, size_t len) {
+    auto scan = [this, data](size_t w) {
+        if (data[w] != 0) {
+            zero_run = 0;
+        } else if (++zero_run == zero_run_words) {
+            ++counts_.zero_runs;
+            note(fault_kind::zero_run, offset + w + 1 - zero_run, 0);
+        }
+    };
+    size_t w = 0;
+#if defined(PIXIE_LIST_MODE_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    for (; w + 4 <= len; w += 4) {
+        const __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + w));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(words, zero)) == 0) {
+            zero_run = 0;
+        } else {
+            scan(w);
+            scan(w + 1);
+            scan(w + 2);
+            scan(w + 3);
+        }
+    }
+#elif defined(PIXIE_LIST_MODE_NEON)
+    const uint32x4_t zero = vdupq_n_u32(0);
+    for (; w + 4 <= len; w += 4) {
+        const uint64x2_t zeros = vreinterpretq_u64_u32(vceqq_u32(vld1q_u32(data + w), zero));
+        if ((vgetq_lane_u64(zeros, 0) | vgetq_lane_u64(zeros, 1)) == 0) {
+            zero_run = 0;
+        } else {
+            scan(w);
+            scan(w + 1);
+            scan(w + 2);
+            scan(w + 3);
+        }
+    }
+#endif
+    for (; w < len; ++w) {
+        scan(w);
+    }
+}
+
+/*
+ * The filter time clock period in seconds.
+ */
+static double filter_period(size_t frequency) {
+    return frequency == 250 ? 8e-9 : 10e-9;
+}
+
+/*
+ * Walk the complete events of a window adding them to the checkpoint being
+ * built. Returns the words walked.
+ */
+template<typename Layout>
+static size_t walk_times(const uint32_t* data, size_t len, size_t base, size_t stride,
+                         time_checkpoint& current, time_index& index) {
+    const double period = filter_period(Layout::frequency);
+    size_t pos = 0;
+    while (len - pos >= min_words) {
+        const uint32_t* event = data + pos;
+        const size_t event_length = Layout::event_length::get(event);
+        if (event_length == 0) {
+            throw error(error::code::invalid_event_length, "bad event length: 0");
+        }
+        if (len - pos < event_length) {
+            break;
+        }
+        const double time = make_u64_double(Layout::event_time_high::get(event),
+                                             Layout::event_time_low::get(event)) *
+            period;
+        if (current.events == 0) {
+            current.offset = base + pos;
+            current.first_time = time;
+            current.min_time = time;
+            current.max_time = time;
+            current.crate = static_cast<event_batch::id_type>(Layout::crate_id::get(event));
+            current.slot = static_cast<event_batch::id_type>(Layout::slot_id::get(event));
+        } else {
+            current.min_time = std::min(current.min_time, time);
+            current.max_time = std::max(current.max_time, time);
+        }
+        if (++current.events == stride) {
+            index.add(current);
+            current = time_checkpoint();
+        }
+        pos += event_length;
+    }
+    return pos;
+}
+
+time_checkpoint::time_checkpoint()
+    : offset(0), events(0), first_time(0), min_time(0), max_time(0), crate(0), slot(0) {}
+
+constexpr size_t time_index::default_stride;
+
+/*
+ * The sidecar file is the header followed by the checkpoints. The words
+ * are in the host's byte order.
+ */
+static constexpr uint32_t time_index_magic = 0x544d4c58; /* "XLMT" */
+static constexpr uint32_t time_index_version = 1;
+
+time_index::time_index() : stride(default_stride), revision(0), frequency(0), file_words(0) {}
+
+std::string time_index::sidecar(const std::string& path) {
+    return path + ".lmi";
+}
+
+template<typename T>
+static void write_value(std::ofstream& out, const T value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template<typename T>
+static T read_value(std::ifstream& in) {
+    T value = 0;
+    in.read(reinterpret_cast<char*>(&value), sizeof(value));
+    return value;
+}
+
+void time_index::save(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw error(error::code::file_create_failure, "creating time index: " + path);
+    }
+    write_value(out, time_index_magic);
+    write_value(out, time_index_version);
+    write_value(out, static_cast<uint32_t>(revision));
+    write_value(out, static_cast<uint32_t>(frequency));
+    write_value(out, static_cast<uint64_t>(stride));
+    write_value(out, static_cast<uint64_t>(file_words));
+    write_value(out, static_cast<uint64_t>(checkpoints_.size()));
+    for (auto& cp : checkpoints_) {
+        write_value(out, static_cast<uint64_t>(cp.offset));
+        write_value(out, static_cast<uint64_t>(cp.events));
+        write_value(out, cp.first_time);
+        write_value(out, cp.min_time);
+        write_value(out, cp.max_time);
+        write_value(out, static_cast<uint32_t>(cp.crate));
+        write_value(out, static_cast<uint32_t>(cp.slot));
+    }
+    out.flush();
+    if (!out) {
+        throw error(error::code::file_write_failure, "writing time index: " + path);
+    }
+}
+
+bool time_index::load(const std::string& path, const file_reader& reader) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    if (read_value<uint32_t>(in) != time_index_magic ||
+        read_value<uint32_t>(in) != time_index_version) {
+        throw error(error::code::file_read_failure, "invalid time index: " + path);
+    }
+    const size_t rev = read_value<uint32_t>(in);
+    const size_t freq = read_value<uint32_t>(in);
+    const size_t stride_ = static_cast<size_t>(read_value<uint64_t>(in));
+    const size_t words = static_cast<size_t>(read_value<uint64_t>(in));
+    const size_t count = static_cast<size_t>(read_value<uint64_t>(in));
+    if (!in) {
+        throw error(error::code::file_read_failure, "invalid time index: " + path);
+    }
+    if (rev != reader.revision || freq != reader.frequency || words != reader.size()) {
+        return false;
+    }
+    clear();
+    stride = stride_;
+    revision = rev;
+    frequency = freq;
+    file_words = words;
+    for (size_t c = 0; c < count; ++c) {
+        time_checkpoint cp;
+        cp.offset = static_cast<size_t>(read_value<uint64_t>(in));
+        cp.events = static_cast<size_t>(read_value<uint64_t>(in));
+        cp.first_time = read_value<double>(in);
+        cp.min_time = read_value<double>(in);
+        cp.max_time = read_value<double>(in);
+        cp.crate = static_cast<event_batch::id_type>(read_value<uint32_t>(in));
+        cp.slot = static_cast<event_batch::id_type>(read_value<uint32_t>(in));
+        if (!in || cp.offset >= file_words ||
+            (!checkpoints_.empty() && cp.offset <= checkpoints_.back().offset)) {
+            clear();
+            throw error(error::code::file_read_failure, "invalid time index: " + path);
+        }
+        add(cp);
+    }
+    return true;
+}
+
+void time_index::add(const time_checkpoint& checkpoint) {
+    checkpoints_.push_back(checkpoint);
+    latest.push_back(latest.empty() ? checkpoint.max_time :
+                                      std::max(latest.back(), checkpoint.max_time));
+    /*
+     * The earliest time from each checkpoint on changes for all the
+     * checkpoints before the one added. Update back to the first that is
+     * not later.
+     */
+    earliest.push_back(checkpoint.min_time);
+    for (size_t cp = earliest.size() - 1; cp > 0 && earliest[cp - 1] > checkpoint.min_time;
+         --cp) {
+        earliest[cp - 1] = checkpoint.min_time;
+    }
+}
+
+void time_index::clear() {
+    checkpoints_.clear();
+    latest.clear();
+    earliest.clear();
+    file_words = 0;
+}
+
+size_t time_index::start(double time) const {
+    auto found = std::lower_bound(latest.begin(), latest.end(), time);
+    if (found == latest.end()) {
+        return file_words;
+    }
+    return checkpoints_[std::distance(latest.begin(), found)].offset;
+}
+
+size_t time_index::end(double time) const {
+    auto found = std::upper_bound(earliest.begin(), earliest.end(), time);
+    if (found == earliest.end()) {
+        return file_words;
+    }
+    return checkpoints_[std::distance(earliest.begin(), found)].offset;
+}
+
+constexpr size_t file_reader::default_window_words;
+constexpr size_t file_reader::min_window_words;
+
+file_reader::iterator::iterator(file_reader& reader_) : reader(&reader_) {
+    if (!reader->next(reader->batch)) {
+        reader = nullptr;
+    }
+}
+
+file_reader::iterator& file_reader::iterator::operator++() {
+    if (reader != nullptr && !reader->next(reader->batch)) {
+        reader = nullptr;
+    }
+    return *this;
+}
+
+file_reader::file_reader(const std::string& path_, size_t revision_, size_t frequency_,
+                         size_t window_words_, bool use_mmap)
+    : path(path_), revision(revision_), frequency(frequency_),
+      window_words(std::max(window_words_, min_window_words)), size_words(0), offset(0),
+      trailing_words(0), at_end(false), end_words(0), map(nullptr), map_bytes(0),
+      map_released(0),
+#if defined(_WIN64) || defined(_WIN32)
+      file_handle(INVALID_HANDLE_VALUE), mapping_handle(nullptr),
+#else
+      fd(-1),
+#endif
+      stream(nullptr), window_start(0), window_end(0), calib(nullptr), recover(nullptr),
+      layout_decoder(revision, frequency) {
+
+#if defined(_WIN64) || defined(_WIN32)
+    file_handle = ::CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        throw error(pixie::error::code::file_open_failure,
+                    "opening list-mode file: " + path + ": error " +
+                        std::to_string(::GetLastError()));
+    }
+    LARGE_INTEGER file_size;
+    if (!::GetFileSizeEx(file_handle, &file_size)) {
+        auto err = ::GetLastError();
+        close();
+        throw error(pixie::error::code::file_read_failure,
+                    "list-mode file size: " + path + ": error " + std::to_string(err));
+    }
+    size_words = static_cast<size_t>(file_size.QuadPart) / sizeof(uint32_t);
+    end_words = size_words;
+    if (use_mmap && size_words > 0) {
+        mapping_handle =
+            ::CreateFileMappingA(file_handle, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+        if (mapping_handle != nullptr) {
+            map = static_cast<uint32_t*>(
+                ::MapViewOfFile(mapping_handle, FILE_MAP_COPY, 0, 0, 0));
+        }
+    }
+    if (map == nullptr) {
+        close();
+    }
+#else
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw error(pixie::error::code::file_open_failure,
+                    "opening list-mode file: " + path + ": " + std::strerror(errno));
+    }
+    struct stat st;
+    if (::fstat(fd, &st) < 0) {
+        auto err = errno;
+        close();
+        throw error(pixie::error::code::file_read_failure,
+                    "list-mode file size: " + path + ": " + std::strerror(err));
+    }
+    size_words = static_cast<size_t>(st.st_size) / sizeof(uint32_t);
+    end_words = size_words;
+    if (use_mmap && size_words > 0) {
+        /*
+         * The mapping is private and writable so the decoder's non-const
+         * data pointer cannot modify the file.
+         */
+        void* addr = ::mmap(nullptr, size_words * sizeof(uint32_t), PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            map = static_cast<uint32_t*>(addr);
+            map_bytes = size_words * sizeof(uint32_t);
+            ::madvise(addr, map_bytes, MADV_SEQUENTIAL);
+        }
+    }
+    if (map == nullptr) {
+        close();
+    }
+#endif
+
+    if (map == nullptr) {
+        stream = std::fopen(path.c_str(), "rb");
+        if (stream == nullptr) {
+            throw error(pixie::error::code::file_open_failure,
+                        "opening list-mode file: " + path + ": " + std::strerror(errno));
+        }
+        std::setvbuf(stream, nullptr, _IONBF, 0);
+        window_data.resize(window_words);
+    }
+}
+
+file_reader::~file_reader() {
+    close();
+    if (stream != nullptr) {
+        std::fclose(stream);
+        stream = nullptr;
+    }
+}
+
+void file_reader::close() {
+#if defined(_WIN64) || defined(_WIN32)
+    if (map != nullptr) {
+        ::UnmapViewOfFile(map);
+        map = nullptr;
+    }
+    if (mapping_handle != nullptr) {
+        ::CloseHandle(mapping_handle);
+        mapping_handle = nullptr;
+    }
+    if (file_handle != INVALID_HANDLE_VALUE) {
+        ::CloseHandle(file_handle);
+        file_handle = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (map != nullptr) {
+        ::munmap(map, map_bytes);
+        map = nullptr;
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+#endif
+}
+
+/*
+ * The offset in bytes of the page holding a word.
+ */
+static size_t page_floor(size_t words) {
+#if defined(_WIN64) || defined(_WIN32)
+    return 0;
+#else
+    static const size_t page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    return ((words * sizeof(uint32_t)) / page_size) * page_size;
+#endif
+}
+
+bool file_reader::window(uint32_t*& data, size_t& len) {
+    if (at_end) {
+        return false;
+    }
+    if (map != nullptr) {
+        if (offset >= end_words) {
+            at_end = true;
+            return false;
+        }
+        data = map + offset;
+        len = std::min(window_words, end_words - offset);
+        return true;
+    }
+    /*
+     * Move the partial event at the end of the last window to the front
+     * and fill the rest of the window.
+     */
+    const size_t kept = window_end - window_start;
+    if (kept > 0 && window_start > 0) {
+        std::memmove(window_data.data(), window_data.data() + window_start,
+                     kept * sizeof(uint32_t));
+    }
+    window_start = 0;
+    window_end = kept;
+    const size_t wanted = std::min(window_words - kept, end_words - (offset + kept));
+    const size_t read =
+        wanted == 0 ? 0 : std::fread(window_data.data() + kept, sizeof(uint32_t), wanted, stream);
+    if (read < wanted && std::ferror(stream)) {
+        at_end = true;
+        throw error(pixie::error::code::file_read_failure,
+                    "reading list-mode file: " + path + ": " + std::strerror(errno));
+    }
+    window_end += read;
+    if (window_end == 0) {
+        at_end = true;
+        return false;
+    }
+    data = window_data.data();
+    len = window_end;
+    return true;
+}
+
+void file_reader::consume(size_t len, size_t leftover) {
+    const size_t used = len - leftover;
+    offset += used;
+    if (map != nullptr) {
+#if !defined(_WIN64) && !defined(_WIN32)
+        /*
+         * Release the pages behind the window so the resident memory
+         * stays flat for large files.
+         */
+        const size_t release = page_floor(offset);
+        if (release > map_released) {
+            ::madvise(reinterpret_cast<char*>(map) + map_released, release - map_released,
+                      MADV_DONTNEED);
+            map_released = release;
+        }
+#endif
+        if (leftover > 0 && (used == 0 || offset + leftover >= end_words)) {
+            trailing_words = leftover;
+            at_end = true;
+        }
+    } else {
+        window_start = used;
+        if (used == 0 ||
+            (leftover > 0 && (std::feof(stream) || offset + leftover >= end_words))) {
+            trailing_words = leftover;
+            at_end = true;
+        }
+    }
+}
+
+bool file_reader::next(event_batch& batch_) {
+    uint32_t* data;
+    size_t len;
+    while (window(data, len)) {
+        batch_.clear();
+        try {
+            layout_decoder.decode(data, len, batch_, leftover_data, calib, recover);
+        } catch (...) {
+            at_end = true;
+            throw;
+        }
+        consume(len, leftover_data.size());
+        if (!batch_.empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool file_reader::next(records& recs) {
+    uint32_t* data;
+    size_t len;
+    while (window(data, len)) {
+        try {
+            layout_decoder.decode(data, len, recs, leftover_data, calib, recover);
+        } catch (...) {
+            at_end = true;
+            throw;
+        }
+        consume(len, leftover_data.size());
+        if (!recs.empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool file_reader::next(size_t threads, const batch_handler& handler) {
+    uint32_t* data;
+    size_t len;
+    while (window(data, len)) {
+        try {
+            decode_data_block_parallel(data, len, revision, frequency, threads, handler,
+                                       leftover_data, batch.fields, calib);
+        } catch (...) {
+            at_end = true;
+            throw;
+        }
+        consume(len, leftover_data.size());
+        if (len > leftover_data.size()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void file_reader::set_fields(uint32_t fields_) {
+    batch.clear();
+    batch.fields = fields_;
+}
+
+file_reader::iterator file_reader::begin() {
+    return iterator(*this);
+}
+
+file_reader::iterator file_reader::end() {
+    return iterator();
+}
+
+void file_reader::rewind() {
+    offset = 0;
+    end_words = size_words;
+    trailing_words = 0;
+    at_end = false;
+    window_start = 0;
+    window_end = 0;
+    map_released = 0;
+    if (stream != nullptr) {
+        std::rewind(stream);
+    }
+}
+
+void file_reader::seek(size_t start, size_t end) {
+    end = std::min(end, size_words);
+    if (start > end) {
+        throw error(error::code::invalid_value,
+                    "list-mode file seek out of range: " + path + ": " + std::to_string(start));
+    }
+    if (stream != nullptr) {
+        const auto pos = start * sizeof(uint32_t);
+#if defined(_WIN64) || defined(_WIN32)
+        const int result = ::_fseeki64(stream, static_cast<__int64>(pos), SEEK_SET);
+#else
+        const int result = ::fseeko(stream, static_cast<off_t>(pos), SEEK_SET);
+#endif
+        if (result != 0) {
+            at_end = true;
+            throw error(pixie::error::code::file_read_failure,
+                        "seeking list-mode file: " + path + ": " + std::strerror(errno));
+        }
+    }
+    offset = start;
+    end_words = end;
+    trailing_words = 0;
+    at_end = false;
+    window_start = 0;
+    window_end = 0;
+    map_released = std::min(map_released, page_floor(start));
+    leftover_data.clear();
+}
+
+void file_reader::seek(const time_index& index, double start, double end) {
+    if (index.revision != revision || index.frequency != frequency ||
+        index.file_words != size_words) {
+        throw error(error::code::invalid_value, "time index is not for the file: " + path);
+    }
+    const size_t first = index.start(start);
+    seek(first, std::max(first, index.end(end)));
+}
+
+void file_reader::build_index(time_index& index, size_t stride) {
+    if (stride == 0) {
+        throw error(error::code::invalid_value, "time index stride cannot be 0");
+    }
+    index.clear();
+    index.stride = stride;
+    index.revision = revision;
+    index.frequency = frequency;
+    index.file_words = size_words;
+    seek(0);
+    time_checkpoint current;
+    uint32_t* data;
+    size_t len;
+    try {
+        while (window(data, len)) {
+            size_t walked = 0;
+            with_layout(revision, frequency, [&](auto layout) {
+                walked = walk_times<decltype(layout)>(data, len, offset, stride, current, index);
+            });
+            consume(len, len - walked);
+        }
+    } catch (...) {
+        rewind();
+        throw;
+    }
+    if (current.events > 0) {
+        index.add(current);
+    }
+    rewind();
+}
+
+}  // namespace list_mode
+}  // namespace data
+}  // namespace pixie
+}  // namespace xia
+
+std::ostream& operator<<(std::ostream& out, xia::pixie::data::list_mode::record& event) {
+    event.output(out);
+    return out;
+}
+
+std::ostream& operator<<(std::ostream& out,
+                         const xia::pixie::data::list_mode::event_validator::fault_kind kind) {
+    using fault_kind = xia::pixie::data::list_mode::event_validator::fault_kind;
+    switch (kind) {
+        case fault_kind::header_length:
+            out << "header-length";
+            break;
+        case fault_kind::event_length:
+            out << "event-length";
+            break;
+        case fault_kind::slot:
+            out << "slot";
+            break;
+        case fault_kind::crate:
+            out << "crate";
+            break;
+        case fault_kind::zero_run:
+            out << "zero-run";
+            break;
+        case fault_kind::resync:
+            out << "resync";
+            break;
+    }
     return out;
 }
\ No newline at end of file
@@ -0,0 +1,271 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file merge.cpp
+ * @brief Implements a time ordered merge of the list-mode streams of a crate's modules.
+ */
+
+#include <algorithm>
+#include <limits>
+
+#include <pixie/error.hpp>
+
+#include <pixie/data/merge.hpp>
+
+namespace xia {
+namespace pixie {
+namespace data {
+namespace list_mode {
+
+static const record::fixed_time_type time_min =
+    std::numeric_limits<record::fixed_time_type>::min();
+static const record::fixed_time_type time_max =
+    std::numeric_limits<record::fixed_time_type>::max();
+
+static bool time_less(const record& lhs, const record& rhs) {
+    return lhs.fixed_time < rhs.fixed_time;
+}
+
+/*
+ * The heap is a min-heap of the keys' times. Equal times keep the push
+ * order.
+ */
+template<typename Key>
+static bool key_later(const Key& lhs, const Key& rhs) {
+    return lhs.time > rhs.time || (lhs.time == rhs.time && lhs.sequence > rhs.sequence);
+}
+
+reorder::reorder(time_type window_, size_t max_held_, bool drop_late_)
+    : window(window_), max_held(max_held_), drop_late(drop_late_),
+      fixed_window(record::to_fixed_time(window_)), latest(time_min), released(time_min),
+      sequence(0), late_(0), dropped_(0) {
+    if (window < time_type(0)) {
+        throw error(error::code::invalid_value, "reorder: window cannot be negative");
+    }
+}
+
+void reorder::push(records& events) {
+    for (auto& event : events) {
+        const auto time = event.fixed_time;
+        if (time < released) {
+            ++late_;
+            if (drop_late) {
+                ++dropped_;
+                continue;
+            }
+        }
+        size_t slot;
+        if (free_slots.empty()) {
+            slot = slots.size();
+            slots.push_back(std::move(event));
+        } else {
+            slot = free_slots.back();
+            free_slots.pop_back();
+            slots[slot] = std::move(event);
+        }
+        heap.push_back({time, sequence++, slot});
+        std::push_heap(heap.begin(), heap.end(), key_later<key>);
+        latest = std::max(latest, time);
+    }
+    events.clear();
+}
+
+void reorder::release(records& out) {
+    std::pop_heap(heap.begin(), heap.end(), key_later<key>);
+    const auto next = heap.back();
+    heap.pop_back();
+    out.push_back(std::move(slots[next.slot]));
+    free_slots.push_back(next.slot);
+    released = std::max(released, next.time);
+}
+
+size_t reorder::release_until(records& out, fixed_time_type until) {
+    size_t count = 0;
+    while (!heap.empty() &&
+           (heap.front().time < until || (max_held != 0 && heap.size() > max_held))) {
+        release(out);
+        ++count;
+    }
+    return count;
+}
+
+size_t reorder::pop(records& out) {
+    const auto until = latest == time_min ? time_min : latest - fixed_window;
+    return release_until(out, until);
+}
+
+size_t reorder::flush(records& out) {
+    const size_t count = heap.size();
+    while (!heap.empty()) {
+        release(out);
+    }
+    slots.clear();
+    free_slots.clear();
+    return count;
+}
+
+merger::input::input() : watermark(time_min), started(false), finished(false) {}
+
+merger::merger(size_t streams, time_type window_, time_type lookahead_, size_t max_pending_)
+    : window(window_), lookahead(lookahead_), max_pending(max_pending_),
+      fixed_window(record::to_fixed_time(window_)),
+      fixed_lookahead(record::to_fixed_time(lookahead_)), inputs(streams), heap(), pending_(0) {
+    if (streams == 0) {
+        throw error(error::code::invalid_value, "merger: no streams");
+    }
+    if (window < time_type(0) || lookahead < time_type(0)) {
+        throw error(error::code::invalid_value, "merger: window and lookahead cannot be negative");
+    }
+    heap.reserve(streams);
+}
+
+merger::input& merger::get_input(size_t stream) {
+    if (stream >= inputs.size()) {
+        throw error(error::code::invalid_value,
+                    "merger: invalid stream: " + std::to_string(stream));
+    }
+    return inputs[stream];
+}
+
+void merger::push(size_t stream, records& events) {
+    auto& in = get_input(stream);
+    if (in.finished) {
+        throw error(error::code::invalid_value,
+                    "merger: stream finished: " + std::to_string(stream));
+    }
+    if (events.empty()) {
+        return;
+    }
+    if (!std::is_sorted(events.begin(), events.end(), time_less)) {
+        std::stable_sort(events.begin(), events.end(), time_less);
+    }
+    const auto latest = events.back().fixed_time;
+    const size_t mid = in.events.size();
+    for (auto& event : events) {
+        in.events.push_back(std::move(event));
+    }
+    /*
+     * The stream's events are only in order within the lookahead so the new
+     * events may start before the last held event.
+     */
+    if (mid > 0 && in.events[mid].fixed_time < in.events[mid - 1].fixed_time) {
+        std::inplace_merge(in.events.begin(), in.events.begin() + mid, in.events.end(),
+                           time_less);
+    }
+    pending_ += events.size();
+    events.clear();
+    in.watermark = std::max(in.watermark, latest - fixed_lookahead);
+    in.started = true;
+    merge();
+}
+
+void merger::advance(size_t stream, time_type time) {
+    auto& in = get_input(stream);
+    in.watermark = std::max(in.watermark, record::to_fixed_time(time));
+    in.started = true;
+    merge();
+}
+
+void merger::finish(size_t stream) {
+    get_input(stream).finished = true;
+    merge();
+}
+
+void merger::finish() {
+    for (auto& in : inputs) {
+        in.finished = true;
+    }
+    merge();
+}
+
+record::fixed_time_type merger::safe_time() const {
+    auto safe = time_max;
+    for (const auto& in : inputs) {
+        if (!in.finished) {
+            safe = std::min(safe, in.started ? in.watermark : time_min);
+        }
+    }
+    return safe;
+}
+
+void merger::merge() {
+    auto later = [this](size_t lhs, size_t rhs) {
+        const auto lt = inputs[lhs].events.front().fixed_time;
+        const auto rt = inputs[rhs].events.front().fixed_time;
+        return lt > rt || (lt == rt && lhs > rhs);
+    };
+    heap.clear();
+    for (size_t s = 0; s < inputs.size(); ++s) {
+        if (!inputs[s].events.empty()) {
+            heap.push_back(s);
+        }
+    }
+    std::make_heap(heap.begin(), heap.end(), later);
+    const auto safe = safe_time();
+    while (!heap.empty()) {
+        const size_t stream = heap.front();
+        auto& in = inputs[stream];
+        const bool force = max_pending != 0 && pending_ > max_pending;
+        if (in.events.front().fixed_time > safe && !force) {
+            break;
+        }
+        std::pop_heap(heap.begin(), heap.end(), later);
+        merged.push_back(std::move(in.events.front()));
+        in.events.pop_front();
+        --pending_;
+        if (in.events.empty()) {
+            heap.pop_back();
+        } else {
+            std::push_heap(heap.begin(), heap.end(), later);
+        }
+    }
+}
+
+bool merger::next(records& group) {
+    group.clear();
+    if (merged.empty()) {
+        return false;
+    }
+    const auto end_time = merged.front().fixed_time + fixed_window;
+    auto last = std::find_if(merged.begin(), merged.end(),
+                             [end_time](const record& rec) { return rec.fixed_time > end_time; });
+    if (last == merged.end()) {
+        /*
+         * All the merged events are in the window. The group is complete if
+         * no event still to be merged can be in the window.
+         */
+        auto bound = safe_time();
+        for (const auto& in : inputs) {
+            if (!in.events.empty()) {
+                bound = std::min(bound, in.events.front().fixed_time);
+            }
+        }
+        if (bound <= end_time) {
+            return false;
+        }
+    }
+    for (auto ev = merged.begin(); ev != last; ++ev) {
+        group.push_back(std::move(*ev));
+    }
+    merged.erase(merged.begin(), last);
+    return true;
+}
+}  // namespace list_mode
+}  // namespace data
+}  // namespace pixie
+}  // namespace xia
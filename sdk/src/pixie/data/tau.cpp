@@ -0,0 +1,321 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file tau.cpp
+ * @brief Implements the host side estimation of the preamplifier decay time from traces.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <thread>
+
+#include <pixie/error.hpp>
+
+#include <pixie/data/tau.hpp>
+
+namespace xia {
+namespace pixie {
+namespace data {
+namespace tau {
+using error = pixie::error::error;
+
+static const double nan = std::numeric_limits<double>::quiet_NaN();
+
+/*
+ * Independent partial sums let the loop vectorize without reordering a
+ * single floating point sum.
+ */
+static constexpr size_t sum_lanes = 8;
+
+double log_linear(const sample* trace, size_t length, sample* work) {
+    if (length < 2) {
+        return nan;
+    }
+    sample* weight = work;
+    sample* logs = work + length;
+    for (size_t i = 0; i < length; ++i) {
+        const sample y = std::max(trace[i], std::numeric_limits<sample>::min());
+        weight[i] = trace[i] > 0 ? y * y : 0;
+        logs[i] = std::log(y);
+    }
+    double sw[sum_lanes] = {};
+    double swx[sum_lanes] = {};
+    double swxx[sum_lanes] = {};
+    double swl[sum_lanes] = {};
+    double swxl[sum_lanes] = {};
+    size_t i = 0;
+    for (; i + sum_lanes <= length; i += sum_lanes) {
+        for (size_t l = 0; l < sum_lanes; ++l) {
+            const double w = weight[i + l];
+            const double x = double(i + l);
+            const double wl = w * logs[i + l];
+            sw[l] += w;
+            swx[l] += w * x;
+            swxx[l] += w * x * x;
+            swl[l] += wl;
+            swxl[l] += wl * x;
+        }
+    }
+    for (size_t l = 1; l < sum_lanes; ++l) {
+        sw[0] += sw[l];
+        swx[0] += swx[l];
+        swxx[0] += swxx[l];
+        swl[0] += swl[l];
+        swxl[0] += swxl[l];
+    }
+    for (; i < length; ++i) {
+        const double w = weight[i];
+        const double x = double(i);
+        const double wl = w * logs[i];
+        sw[0] += w;
+        swx[0] += w * x;
+        swxx[0] += w * x * x;
+        swl[0] += wl;
+        swxl[0] += wl * x;
+    }
+    const double denominator = sw[0] * swxx[0] - swx[0] * swx[0];
+    if (!(denominator > 0)) {
+        return nan;
+    }
+    const double slope = (sw[0] * swxl[0] - swx[0] * swl[0]) / denominator;
+    if (!(slope < 0)) {
+        return nan;
+    }
+    return -1.0 / slope;
+}
+
+config::config()
+    : sample_usecs(0), rise_samples(4), threshold(100), baseline_samples(32), peak_samples(64),
+      skip_samples(8), tail_fraction(0.05), min_fit_samples(32), max_fit_samples(4096),
+      min_tau_usecs(0.1), max_tau_usecs(10000) {}
+
+void config::validate() const {
+    if (!(sample_usecs > 0)) {
+        throw error(error::code::invalid_value, "tau: invalid sample period");
+    }
+    if (rise_samples == 0) {
+        throw error(error::code::invalid_value, "tau: no rise samples");
+    }
+    if (!(threshold > 0)) {
+        throw error(error::code::invalid_value, "tau: invalid threshold");
+    }
+    if (baseline_samples == 0) {
+        throw error(error::code::invalid_value, "tau: no baseline samples");
+    }
+    if (!(tail_fraction > 0 && tail_fraction < 1)) {
+        throw error(error::code::invalid_value, "tau: invalid tail fraction");
+    }
+    if (min_fit_samples < 2 || max_fit_samples < min_fit_samples) {
+        throw error(error::code::invalid_value, "tau: invalid fit samples");
+    }
+    if (!(min_tau_usecs >= 0 && max_tau_usecs > min_tau_usecs)) {
+        throw error(error::code::invalid_value, "tau: invalid decay time range");
+    }
+}
+
+estimate::estimate() : tau_usecs(nan), spread_usecs(nan), pulses(0), rejected(0) {}
+
+bool estimate::valid() const {
+    return pulses > 0 && std::isfinite(tau_usecs);
+}
+
+fitter::fitter(const config& cfg_) : cfg(cfg_), rejected(0) {
+    cfg.validate();
+}
+
+void fitter::add(const value* trace, size_t length) {
+    const size_t rise = cfg.rise_samples;
+    size_t i = cfg.baseline_samples;
+    while (i + rise < length) {
+        if (double(trace[i + rise]) - double(trace[i]) <= cfg.threshold) {
+            ++i;
+            continue;
+        }
+        /*
+         * The baseline is the mean of the window before the trigger. A
+         * window that is not flat holds the tail of an earlier pulse.
+         */
+        const value* window = trace + i - cfg.baseline_samples;
+        uint64_t total = 0;
+        value lowest = window[0];
+        value highest = window[0];
+        for (size_t s = 0; s < cfg.baseline_samples; ++s) {
+            total += window[s];
+            lowest = std::min(lowest, window[s]);
+            highest = std::max(highest, window[s]);
+        }
+        const double baseline = double(total) / double(cfg.baseline_samples);
+        const bool flat = double(highest) - double(lowest) <= cfg.threshold;
+        const size_t peak_end = std::min(length, i + rise + cfg.peak_samples);
+        size_t peak = i;
+        for (size_t p = i; p < peak_end; ++p) {
+            if (trace[p] > trace[peak]) {
+                peak = p;
+            }
+        }
+        const double floor = baseline + cfg.tail_fraction * (double(trace[peak]) - baseline);
+        const size_t start = std::min(length, peak + cfg.skip_samples);
+        size_t end = start;
+        while (end < length && end - start < cfg.max_fit_samples && double(trace[end]) > floor) {
+            if (end + rise < length &&
+                double(trace[end + rise]) - double(trace[end]) > cfg.threshold) {
+                break;
+            }
+            ++end;
+        }
+        const size_t fit_samples = end - start;
+        double tau_usecs = nan;
+        if (flat && fit_samples >= cfg.min_fit_samples) {
+            if (work.size() < fit_samples * 3) {
+                work.resize(fit_samples * 3);
+            }
+            for (size_t s = 0; s < fit_samples; ++s) {
+                work[s] = sample(double(trace[start + s]) - baseline);
+            }
+            tau_usecs =
+                log_linear(work.data(), fit_samples, work.data() + fit_samples) * cfg.sample_usecs;
+        }
+        if (tau_usecs >= cfg.min_tau_usecs && tau_usecs <= cfg.max_tau_usecs) {
+            taus.push_back(tau_usecs);
+        } else {
+            ++rejected;
+        }
+        i = std::max(end, i + 1);
+    }
+}
+
+static double median(std::vector<double>& values) {
+    const size_t middle = values.size() / 2;
+    std::nth_element(values.begin(), values.begin() + middle, values.end());
+    double result = values[middle];
+    if ((values.size() & 1) == 0) {
+        result = (result + *std::max_element(values.begin(), values.begin() + middle)) / 2;
+    }
+    return result;
+}
+
+estimate fitter::result() const {
+    estimate est;
+    est.pulses = taus.size();
+    est.rejected = rejected;
+    if (!taus.empty()) {
+        std::vector<double> values(taus);
+        est.tau_usecs = median(values);
+        for (auto& v : values) {
+            v = std::abs(v - est.tau_usecs);
+        }
+        est.spread_usecs = median(values);
+    }
+    return est;
+}
+
+void fitter::clear() {
+    taus.clear();
+    rejected = 0;
+}
+
+/*
+ * Run a task for each of a number of items on worker threads. The error of
+ * the lowest item is thrown once the workers have stopped.
+ */
+template<typename Task>
+static void parallel(size_t items, size_t threads, Task task) {
+    if (threads == 0) {
+        threads = std::max(std::thread::hardware_concurrency(), 1U);
+    }
+    threads = std::min(threads, items);
+
+    std::atomic_size_t next_item(0);
+    std::atomic_bool failed(false);
+    std::vector<std::exception_ptr> errors(items);
+
+    auto worker = [&]() {
+        while (!failed.load()) {
+            const size_t item = next_item++;
+            if (item >= items) {
+                break;
+            }
+            try {
+                task(item);
+            } catch (...) {
+                errors[item] = std::current_exception();
+                failed = true;
+            }
+        }
+    };
+
+    if (threads <= 1) {
+        worker();
+    } else {
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < threads; ++t) {
+            workers.emplace_back(worker);
+        }
+        for (auto& w : workers) {
+            w.join();
+        }
+    }
+
+    for (auto& e : errors) {
+        if (e) {
+            std::rethrow_exception(e);
+        }
+    }
+}
+
+void add(fitters& fits, const traces& channel_traces, size_t threads) {
+    if (channel_traces.size() != fits.size()) {
+        throw error(error::code::invalid_value, "tau: traces do not match the fitters");
+    }
+    parallel(fits.size(), threads,
+             [&fits, &channel_traces](size_t item) { fits[item].add(channel_traces[item]); });
+}
+
+void add(fitters& fits, const list_mode::event_batch& batch, size_t threads) {
+    if (!batch.holds(list_mode::scan_ids | list_mode::scan_traces)) {
+        throw error(error::code::invalid_value, "tau: batch has no traces or ids");
+    }
+    std::vector<std::vector<size_t>> events(fits.size());
+    for (size_t e = 0; e < batch.size(); ++e) {
+        const size_t channel = batch.channel[e];
+        if (channel < fits.size() && batch.trace_length[e] != 0) {
+            events[channel].push_back(e);
+        }
+    }
+    parallel(fits.size(), threads, [&fits, &batch, &events](size_t item) {
+        for (auto e : events[item]) {
+            auto view = batch.trace(e);
+            fits[item].add(view.data, view.length);
+        }
+    });
+}
+
+void results(const fitters& fits, estimates& out) {
+    out.clear();
+    for (auto& fit : fits) {
+        out.push_back(fit.result());
+    }
+}
+}  // namespace tau
+}  // namespace data
+}  // namespace pixie
+}  // namespace xia
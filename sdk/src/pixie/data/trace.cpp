@@ -0,0 +1,926 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file trace.cpp
+ * @brief Implements processing kernels for decoded list-mode traces.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+#if defined(PIXIE_OPENCL)
+#define CL_TARGET_OPENCL_VERSION 120
+#if defined(__APPLE__)
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+#endif
+
+#include <pixie/error.hpp>
+
+#include <pixie/data/trace.hpp>
+
+namespace xia {
+namespace pixie {
+namespace data {
+namespace trace {
+using error = pixie::error::error;
+
+static const double nan = std::numeric_limits<double>::quiet_NaN();
+
+/*
+ * Independent partial sums let the loop vectorize without reordering a
+ * single floating point sum.
+ */
+static constexpr size_t sum_lanes = 8;
+
+static double sum(const sample* values, size_t count) {
+    double partial[sum_lanes] = {};
+    size_t i = 0;
+    for (; i + sum_lanes <= count; i += sum_lanes) {
+        for (size_t l = 0; l < sum_lanes; ++l) {
+            partial[l] += values[i + l];
+        }
+    }
+    double total = 0;
+    for (size_t l = 0; l < sum_lanes; ++l) {
+        total += partial[l];
+    }
+    for (; i < count; ++i) {
+        total += values[i];
+    }
+    return total;
+}
+
+double mean(const value* trace, size_t length, size_t start, size_t count) {
+    if (start >= length) {
+        return nan;
+    }
+    count = std::min(count, length - start);
+    if (count == 0) {
+        return nan;
+    }
+    uint64_t total = 0;
+    for (size_t i = start; i < start + count; ++i) {
+        total += trace[i];
+    }
+    return double(total) / double(count);
+}
+
+void subtract(const value* trace, size_t length, sample baseline, sample* out) {
+    for (size_t i = 0; i < length; ++i) {
+        out[i] = sample(trace[i]) - baseline;
+    }
+}
+
+void subtract(sample* trace, size_t length, sample baseline) {
+    for (size_t i = 0; i < length; ++i) {
+        trace[i] -= baseline;
+    }
+}
+
+void moving_average(const sample* trace, size_t length, size_t window, sample* out) {
+    if (window == 0) {
+        window = 1;
+    }
+    double total = 0;
+    const size_t head = std::min(window, length);
+    for (size_t i = 0; i < head; ++i) {
+        total += trace[i];
+        out[i] = sample(total / double(i + 1));
+    }
+    const double scale = 1.0 / double(window);
+    for (size_t i = head; i < length; ++i) {
+        total += double(trace[i]) - double(trace[i - window]);
+        out[i] = sample(total * scale);
+    }
+}
+
+double cfd(const sample* trace, size_t length, size_t delay, sample fraction, sample threshold,
+           sample* work) {
+    if (delay == 0 || length <= delay) {
+        return nan;
+    }
+    for (size_t i = delay; i < length; ++i) {
+        work[i] = trace[i - delay] - fraction * trace[i];
+    }
+    size_t i = delay;
+    while (i < length && work[i] >= -threshold) {
+        ++i;
+    }
+    for (++i; i < length; ++i) {
+        if (work[i] >= 0) {
+            const double before = work[i - 1];
+            return double(i - 1) - before / (double(work[i]) - before);
+        }
+    }
+    return nan;
+}
+
+double integral(const sample* trace, size_t length, size_t start, size_t end) {
+    end = std::min(end, length);
+    if (start >= end) {
+        return 0;
+    }
+    return sum(trace + start, end - start);
+}
+
+double tail_total(const sample* trace, size_t length, size_t start, size_t tail, size_t end) {
+    const double total = integral(trace, length, start, end);
+    if (!(total > 0)) {
+        return nan;
+    }
+    return integral(trace, length, tail, end) / total;
+}
+
+config::config()
+    : baseline_start(0), baseline_samples(32), smoothing(0), cfd_delay(4), cfd_fraction(0.5),
+      cfd_threshold(10), total_start(-8), tail_start(8), end(64) {}
+
+void config::validate() const {
+    if (baseline_samples == 0) {
+        throw error(error::code::invalid_value, "trace: no baseline samples");
+    }
+    if (cfd_delay == 0) {
+        throw error(error::code::invalid_value, "trace: CFD delay is 0");
+    }
+    if (!(cfd_fraction > 0 && cfd_fraction <= 1)) {
+        throw error(error::code::invalid_value, "trace: invalid CFD fraction");
+    }
+    if (!(cfd_threshold >= 0)) {
+        throw error(error::code::invalid_value, "trace: invalid CFD threshold");
+    }
+    if (tail_start < total_start || end <= tail_start) {
+        throw error(error::code::invalid_value, "trace: invalid integration windows");
+    }
+}
+
+void results::clear() {
+    traces.clear();
+    baseline.clear();
+    cfd.clear();
+    total.clear();
+    psd.clear();
+}
+
+/*
+ * A window edge relative to the CFD sample limited to the trace.
+ */
+static size_t window_edge(double at, int offset, size_t length) {
+    const double edge = std::floor(at) + offset;
+    if (edge <= 0) {
+        return 0;
+    }
+    return std::min(size_t(edge), length);
+}
+
+void process(const list_mode::event_batch& batch, const config& cfg, results& out) {
+    cfg.validate();
+    const size_t events = batch.size();
+    out.traces.resize(batch.traces.size());
+    out.baseline.assign(events, nan);
+    out.cfd.assign(events, nan);
+    out.total.assign(events, nan);
+    out.psd.assign(events, nan);
+    const double smoothing_delay =
+        cfg.smoothing > 1 ? double(cfg.smoothing - 1) / 2 : 0;
+    for (size_t event = 0; event < events; ++event) {
+        const auto raw = batch.trace(event);
+        const size_t length = raw.length;
+        if (length == 0) {
+            continue;
+        }
+        const double base = mean(raw.data, length, cfg.baseline_start, cfg.baseline_samples);
+        if (std::isnan(base)) {
+            continue;
+        }
+        out.baseline[event] = base;
+        sample* trace = out.traces.data() + batch.trace_offset[event];
+        subtract(raw.data, length, sample(base), trace);
+        if (out.work.size() < length) {
+            out.work.resize(length);
+        }
+        const sample* input = trace;
+        if (cfg.smoothing > 1) {
+            if (out.smoothed.size() < length) {
+                out.smoothed.resize(length);
+            }
+            moving_average(trace, length, cfg.smoothing, out.smoothed.data());
+            input = out.smoothed.data();
+        }
+        double at = cfd(input, length, cfg.cfd_delay, sample(cfg.cfd_fraction),
+                        sample(cfg.cfd_threshold), out.work.data());
+        if (std::isnan(at)) {
+            continue;
+        }
+        at = std::max(at - smoothing_delay, 0.0);
+        out.cfd[event] = at;
+        const size_t start = window_edge(at, cfg.total_start, length);
+        const size_t tail = window_edge(at, cfg.tail_start, length);
+        const size_t end = window_edge(at, cfg.end, length);
+        const double total = integral(trace, length, start, end);
+        out.total[event] = total;
+        if (total > 0) {
+            out.psd[event] = integral(trace, length, tail, end) / total;
+        }
+    }
+}
+
+struct offload::engine {
+    virtual ~engine() = default;
+    virtual bool submit(const list_mode::event_batch& batch) = 0;
+    virtual bool collect(results& out) = 0;
+    virtual size_t in_flight() const = 0;
+    virtual std::string device() const = 0;
+};
+
+/*
+ * The host backend's batches are processed in order by a thread. The
+ * counters only increase, a batch's slot is its count modulo the depth.
+ */
+struct host_engine : public offload::engine {
+    struct slot {
+        const list_mode::event_batch* batch;
+        results out;
+        std::exception_ptr error;
+        slot() : batch(nullptr) {}
+    };
+
+    host_engine(const config& cfg_, size_t depth);
+    ~host_engine();
+
+    bool submit(const list_mode::event_batch& batch) override;
+    bool collect(results& out) override;
+    size_t in_flight() const override;
+    std::string device() const override {
+        return "host";
+    }
+
+    void worker();
+
+    const config& cfg;
+    std::vector<slot> slots;
+    size_t submitted;
+    size_t processed;
+    size_t collected;
+    bool stopping;
+    mutable std::mutex lock;
+    std::condition_variable queued;
+    std::condition_variable done;
+    std::thread thread;
+};
+
+host_engine::host_engine(const config& cfg_, size_t depth)
+    : cfg(cfg_), slots(depth), submitted(0), processed(0), collected(0), stopping(false) {
+    thread = std::thread(&host_engine::worker, this);
+}
+
+host_engine::~host_engine() {
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        stopping = true;
+    }
+    queued.notify_one();
+    thread.join();
+}
+
+bool host_engine::submit(const list_mode::event_batch& batch) {
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        if (submitted - collected >= slots.size()) {
+            return false;
+        }
+        auto& s = slots[submitted % slots.size()];
+        s.batch = &batch;
+        s.error = nullptr;
+        ++submitted;
+    }
+    queued.notify_one();
+    return true;
+}
+
+bool host_engine::collect(results& out) {
+    std::unique_lock<std::mutex> guard(lock);
+    if (collected == submitted) {
+        return false;
+    }
+    done.wait(guard, [this] { return processed > collected; });
+    auto& s = slots[collected % slots.size()];
+    std::swap(out, s.out);
+    s.batch = nullptr;
+    ++collected;
+    if (s.error) {
+        std::exception_ptr error_ = s.error;
+        s.error = nullptr;
+        std::rethrow_exception(error_);
+    }
+    return true;
+}
+
+size_t host_engine::in_flight() const {
+    std::unique_lock<std::mutex> guard(lock);
+    return submitted - collected;
+}
+
+void host_engine::worker() {
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+        queued.wait(guard, [this] { return stopping || processed < submitted; });
+        if (stopping) {
+            break;
+        }
+        auto& s = slots[processed % slots.size()];
+        guard.unlock();
+        try {
+            process(*s.batch, cfg, s.out);
+        } catch (...) {
+            s.error = std::current_exception();
+        }
+        guard.lock();
+        ++processed;
+        done.notify_all();
+    }
+}
+
+#if defined(PIXIE_OPENCL)
+/*
+ * The batch processing kernel, a work item for each event. The steps and
+ * the order of the sums are the host's so the results match. The CFD
+ * signal is computed as it is scanned so the kernel only needs the
+ * smoothed trace's work buffer.
+ */
+static const char* opencl_kernel = R"(
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#pragma OPENCL FP_CONTRACT OFF
+
+#define SUM_LANES 8
+
+double sum(__global const float* values, ulong count) {
+    double partial[SUM_LANES];
+    for (int l = 0; l < SUM_LANES; ++l) {
+        partial[l] = 0;
+    }
+    ulong i = 0;
+    for (; i + SUM_LANES <= count; i += SUM_LANES) {
+        for (int l = 0; l < SUM_LANES; ++l) {
+            partial[l] += values[i + l];
+        }
+    }
+    double total = 0;
+    for (int l = 0; l < SUM_LANES; ++l) {
+        total += partial[l];
+    }
+    for (; i < count; ++i) {
+        total += values[i];
+    }
+    return total;
+}
+
+double integral(__global const float* trace, ulong length, ulong start, ulong end) {
+    end = min(end, length);
+    if (start >= end) {
+        return 0;
+    }
+    return sum(trace + start, end - start);
+}
+
+ulong window_edge(double at, int offset, ulong length) {
+    const double edge = floor(at) + offset;
+    if (edge <= 0) {
+        return 0;
+    }
+    return min((ulong) edge, length);
+}
+
+float cfd_signal(__global const float* trace, ulong i, ulong delay, float fraction) {
+    return trace[i - delay] - fraction * trace[i];
+}
+
+__kernel void process(__global const ushort* raw, __global const ulong* offsets,
+                      __global const uint* lengths, const uint events,
+                      const ulong baseline_start, const ulong baseline_samples,
+                      const ulong smoothing, const ulong cfd_delay, const float cfd_fraction,
+                      const float cfd_threshold, const int total_start, const int tail_start,
+                      const int end_offset, const double smoothing_delay,
+                      __global float* traces, __global float* smoothed,
+                      __global double* columns) {
+    const uint event = get_global_id(0);
+    if (event >= events) {
+        return;
+    }
+    __global double* baseline = columns;
+    __global double* cfd = columns + events;
+    __global double* total = columns + events * 2;
+    __global double* psd = columns + events * 3;
+    const double nan_ = NAN;
+    baseline[event] = nan_;
+    cfd[event] = nan_;
+    total[event] = nan_;
+    psd[event] = nan_;
+    const ulong length = lengths[event];
+    if (length == 0 || baseline_start >= length) {
+        return;
+    }
+    const ulong offset = offsets[event];
+    __global const ushort* values = raw + offset;
+    const ulong count = min(baseline_samples, length - baseline_start);
+    ulong raw_total = 0;
+    for (ulong i = baseline_start; i < baseline_start + count; ++i) {
+        raw_total += values[i];
+    }
+    const double base = (double) raw_total / (double) count;
+    baseline[event] = base;
+    __global float* trace = traces + offset;
+    const float base_sample = (float) base;
+    for (ulong i = 0; i < length; ++i) {
+        trace[i] = (float) values[i] - base_sample;
+    }
+    __global const float* input = trace;
+    if (smoothing > 1) {
+        __global float* average = smoothed + offset;
+        double sum_ = 0;
+        const ulong head = min(smoothing, length);
+        for (ulong i = 0; i < head; ++i) {
+            sum_ += trace[i];
+            average[i] = (float) (sum_ / (double) (i + 1));
+        }
+        const double scale = 1.0 / (double) smoothing;
+        for (ulong i = head; i < length; ++i) {
+            sum_ += (double) trace[i] - (double) trace[i - smoothing];
+            average[i] = (float) (sum_ * scale);
+        }
+        input = average;
+    }
+    if (length <= cfd_delay) {
+        return;
+    }
+    ulong i = cfd_delay;
+    while (i < length && cfd_signal(input, i, cfd_delay, cfd_fraction) >= -cfd_threshold) {
+        ++i;
+    }
+    double at = nan_;
+    for (++i; i < length; ++i) {
+        const float signal = cfd_signal(input, i, cfd_delay, cfd_fraction);
+        if (signal >= 0) {
+            const double before = cfd_signal(input, i - 1, cfd_delay, cfd_fraction);
+            at = (double) (i - 1) - before / ((double) signal - before);
+            break;
+        }
+    }
+    if (isnan(at)) {
+        return;
+    }
+    at = max(at - smoothing_delay, 0.0);
+    cfd[event] = at;
+    const ulong start = window_edge(at, total_start, length);
+    const ulong tail = window_edge(at, tail_start, length);
+    const ulong end = window_edge(at, end_offset, length);
+    const double sum_total = integral(trace, length, start, end);
+    total[event] = sum_total;
+    if (sum_total > 0) {
+        psd[event] = integral(trace, length, tail, end) / sum_total;
+    }
+}
+)";
+
+static void opencl_check(cl_int status, error::code code, const char* what) {
+    if (status != CL_SUCCESS) {
+        throw error(code, std::string("trace: opencl: ") + what + ": " + std::to_string(status));
+    }
+}
+
+/*
+ * Find a GPU, or any device if there is no GPU.
+ */
+static bool opencl_find(cl_device_id& device) {
+    cl_uint platforms = 0;
+    if (clGetPlatformIDs(0, nullptr, &platforms) != CL_SUCCESS || platforms == 0) {
+        return false;
+    }
+    std::vector<cl_platform_id> ids(platforms);
+    if (clGetPlatformIDs(platforms, ids.data(), nullptr) != CL_SUCCESS) {
+        return false;
+    }
+    const cl_device_type types[] = {CL_DEVICE_TYPE_GPU, CL_DEVICE_TYPE_ALL};
+    for (auto type : types) {
+        for (auto platform : ids) {
+            cl_uint devices = 0;
+            if (clGetDeviceIDs(platform, type, 1, &device, &devices) == CL_SUCCESS &&
+                devices > 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/*
+ * A device buffer, or a pinned host buffer that is mapped while it
+ * exists. A buffer grows to the largest batch and is kept.
+ */
+struct opencl_buffer {
+    cl_context context;
+    cl_command_queue queue;
+    cl_mem_flags flags;
+    bool pinned;
+    cl_mem mem;
+    void* host;
+    size_t bytes;
+
+    opencl_buffer(cl_context context_, cl_command_queue queue_, cl_mem_flags flags_,
+                  bool pinned_);
+    ~opencl_buffer();
+
+    opencl_buffer(const opencl_buffer&) = delete;
+    opencl_buffer& operator=(const opencl_buffer&) = delete;
+
+    void reserve(size_t size);
+    void release();
+
+    template<typename T>
+    T* data() {
+        return static_cast<T*>(host);
+    }
+};
+
+opencl_buffer::opencl_buffer(cl_context context_, cl_command_queue queue_,
+                             cl_mem_flags flags_, bool pinned_)
+    : context(context_), queue(queue_), flags(flags_), pinned(pinned_), mem(nullptr),
+      host(nullptr), bytes(0) {}
+
+opencl_buffer::~opencl_buffer() {
+    release();
+}
+
+void opencl_buffer::reserve(size_t size) {
+    if (size <= bytes) {
+        return;
+    }
+    release();
+    size = std::max(size, bytes * 2);
+    cl_int status;
+    if (pinned) {
+        mem = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, size, nullptr,
+                             &status);
+        opencl_check(status, error::code::no_memory, "pinned buffer create");
+        host = clEnqueueMapBuffer(queue, mem, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, size, 0,
+                                  nullptr, nullptr, &status);
+        if (status != CL_SUCCESS) {
+            release();
+            opencl_check(status, error::code::no_memory, "pinned buffer map");
+        }
+    } else {
+        mem = clCreateBuffer(context, flags, size, nullptr, &status);
+        opencl_check(status, error::code::no_memory, "device buffer create");
+    }
+    bytes = size;
+}
+
+void opencl_buffer::release() {
+    if (mem != nullptr) {
+        if (host != nullptr) {
+            clEnqueueUnmapMemObject(queue, mem, host, 0, nullptr, nullptr);
+            clFinish(queue);
+        }
+        clReleaseMemObject(mem);
+    }
+    mem = nullptr;
+    host = nullptr;
+    bytes = 0;
+}
+
+/*
+ * The OpenCL backend. Each slot has a queue so a batch's copies overlap
+ * the kernel of the batch before it. The batch is copied to the slot's
+ * pinned buffers when submitted so the caller can reuse the batch.
+ */
+struct opencl_engine : public offload::engine {
+    struct slot {
+        cl_command_queue queue;
+        opencl_buffer raw_host, offsets_host, lengths_host, traces_host, columns_host;
+        opencl_buffer raw, offsets, lengths, traces, smoothed, columns;
+        cl_event done;
+        size_t events;
+        size_t arena;
+        slot(cl_context context, cl_command_queue queue_);
+        ~slot();
+    };
+    typedef std::unique_ptr<slot> slot_ptr;
+
+    opencl_engine(const config& cfg_, size_t depth);
+    ~opencl_engine();
+
+    bool submit(const list_mode::event_batch& batch) override;
+    bool collect(results& out) override;
+    size_t in_flight() const override {
+        return submitted - collected;
+    }
+    std::string device() const override {
+        return name;
+    }
+
+    const config& cfg;
+    cl_device_id device_id;
+    std::string name;
+    cl_context context;
+    cl_program program;
+    cl_kernel kernel;
+    std::vector<slot_ptr> slots;
+    size_t submitted;
+    size_t collected;
+};
+
+opencl_engine::slot::slot(cl_context context, cl_command_queue queue_)
+    : queue(queue_), raw_host(context, queue, 0, true), offsets_host(context, queue, 0, true),
+      lengths_host(context, queue, 0, true), traces_host(context, queue, 0, true),
+      columns_host(context, queue, 0, true), raw(context, queue, CL_MEM_READ_ONLY, false),
+      offsets(context, queue, CL_MEM_READ_ONLY, false),
+      lengths(context, queue, CL_MEM_READ_ONLY, false),
+      traces(context, queue, CL_MEM_READ_WRITE, false),
+      smoothed(context, queue, CL_MEM_READ_WRITE, false),
+      columns(context, queue, CL_MEM_WRITE_ONLY, false), done(nullptr), events(0), arena(0) {}
+
+opencl_engine::slot::~slot() {
+    clFinish(queue);
+    if (done != nullptr) {
+        clReleaseEvent(done);
+    }
+    raw_host.release();
+    offsets_host.release();
+    lengths_host.release();
+    traces_host.release();
+    columns_host.release();
+    raw.release();
+    offsets.release();
+    lengths.release();
+    traces.release();
+    smoothed.release();
+    columns.release();
+    clReleaseCommandQueue(queue);
+}
+
+opencl_engine::opencl_engine(const config& cfg_, size_t depth)
+    : cfg(cfg_), device_id(nullptr), context(nullptr), program(nullptr), kernel(nullptr),
+      submitted(0), collected(0) {
+    if (!opencl_find(device_id)) {
+        throw error(error::code::not_supported, "trace: opencl: no device");
+    }
+    char text[256] = {};
+    clGetDeviceInfo(device_id, CL_DEVICE_NAME, sizeof(text) - 1, text, nullptr);
+    name = text;
+    cl_int status;
+    context = clCreateContext(nullptr, 1, &device_id, nullptr, nullptr, &status);
+    opencl_check(status, error::code::device_initialize_failure, "context create");
+    try {
+        program = clCreateProgramWithSource(context, 1, &opencl_kernel, nullptr, &status);
+        opencl_check(status, error::code::device_initialize_failure, "program create");
+        status = clBuildProgram(program, 1, &device_id, nullptr, nullptr, nullptr);
+        if (status != CL_SUCCESS) {
+            size_t size = 0;
+            clGetProgramBuildInfo(program, device_id, CL_PROGRAM_BUILD_LOG, 0, nullptr, &size);
+            std::string log(size, '\0');
+            clGetProgramBuildInfo(program, device_id, CL_PROGRAM_BUILD_LOG, size, &log[0],
+                                  nullptr);
+            throw error(error::code::device_initialize_failure,
+                        "trace: opencl: program build: " + log);
+        }
+        kernel = clCreateKernel(program, "process", &status);
+        opencl_check(status, error::code::device_initialize_failure, "kernel create");
+        for (size_t s = 0; s < depth; ++s) {
+            cl_command_queue queue = clCreateCommandQueue(context, device_id, 0, &status);
+            opencl_check(status, error::code::device_initialize_failure, "queue create");
+            slots.emplace_back(new slot(context, queue));
+        }
+    } catch (...) {
+        slots.clear();
+        if (kernel != nullptr) {
+            clReleaseKernel(kernel);
+        }
+        if (program != nullptr) {
+            clReleaseProgram(program);
+        }
+        clReleaseContext(context);
+        throw;
+    }
+}
+
+opencl_engine::~opencl_engine() {
+    slots.clear();
+    clReleaseKernel(kernel);
+    clReleaseProgram(program);
+    clReleaseContext(context);
+}
+
+template<typename T>
+static void opencl_arg(cl_kernel kernel, cl_uint index, const T& value) {
+    opencl_check(clSetKernelArg(kernel, index, sizeof(T), &value),
+                 error::code::device_initialize_failure, "kernel argument");
+}
+
+bool opencl_engine::submit(const list_mode::event_batch& batch) {
+    if (submitted - collected >= slots.size()) {
+        return false;
+    }
+    auto& s = *slots[submitted % slots.size()];
+    const size_t events = batch.size();
+    const size_t arena = batch.traces.size();
+    if (events > std::numeric_limits<cl_uint>::max()) {
+        throw error(error::code::invalid_value, "trace: opencl: too many events in batch");
+    }
+    s.events = events;
+    s.arena = arena;
+    if (events == 0) {
+        ++submitted;
+        return true;
+    }
+    /*
+     * The buffers hold at least one sample so an empty arena is valid.
+     */
+    const size_t samples = std::max(arena, size_t(1));
+    s.raw_host.reserve(samples * sizeof(cl_ushort));
+    s.offsets_host.reserve(events * sizeof(cl_ulong));
+    s.lengths_host.reserve(events * sizeof(cl_uint));
+    s.traces_host.reserve(samples * sizeof(cl_float));
+    s.columns_host.reserve(events * 4 * sizeof(cl_double));
+    s.raw.reserve(samples * sizeof(cl_ushort));
+    s.offsets.reserve(events * sizeof(cl_ulong));
+    s.lengths.reserve(events * sizeof(cl_uint));
+    s.traces.reserve(samples * sizeof(cl_float));
+    s.smoothed.reserve(samples * sizeof(cl_float));
+    s.columns.reserve(events * 4 * sizeof(cl_double));
+
+    if (arena > 0) {
+        std::memcpy(s.raw_host.host, batch.traces.data(), arena * sizeof(cl_ushort));
+    }
+    auto offsets = s.offsets_host.data<cl_ulong>();
+    auto lengths = s.lengths_host.data<cl_uint>();
+    for (size_t e = 0; e < events; ++e) {
+        const auto view = batch.trace(e);
+        lengths[e] = cl_uint(view.length);
+        offsets[e] = view.length == 0 ? 0 : cl_ulong(batch.trace_offset[e]);
+    }
+
+    cl_int status;
+    status = clEnqueueWriteBuffer(s.queue, s.raw.mem, CL_FALSE, 0, samples * sizeof(cl_ushort),
+                                  s.raw_host.host, 0, nullptr, nullptr);
+    opencl_check(status, error::code::device_copy_failure, "trace write");
+    status = clEnqueueWriteBuffer(s.queue, s.offsets.mem, CL_FALSE, 0, events * sizeof(cl_ulong),
+                                  s.offsets_host.host, 0, nullptr, nullptr);
+    opencl_check(status, error::code::device_copy_failure, "offsets write");
+    status = clEnqueueWriteBuffer(s.queue, s.lengths.mem, CL_FALSE, 0, events * sizeof(cl_uint),
+                                  s.lengths_host.host, 0, nullptr, nullptr);
+    opencl_check(status, error::code::device_copy_failure, "lengths write");
+
+    opencl_arg(kernel, 0, s.raw.mem);
+    opencl_arg(kernel, 1, s.offsets.mem);
+    opencl_arg(kernel, 2, s.lengths.mem);
+    opencl_arg(kernel, 3, cl_uint(events));
+    opencl_arg(kernel, 4, cl_ulong(cfg.baseline_start));
+    opencl_arg(kernel, 5, cl_ulong(cfg.baseline_samples));
+    opencl_arg(kernel, 6, cl_ulong(cfg.smoothing));
+    opencl_arg(kernel, 7, cl_ulong(cfg.cfd_delay));
+    opencl_arg(kernel, 8, cl_float(cfg.cfd_fraction));
+    opencl_arg(kernel, 9, cl_float(cfg.cfd_threshold));
+    opencl_arg(kernel, 10, cl_int(cfg.total_start));
+    opencl_arg(kernel, 11, cl_int(cfg.tail_start));
+    opencl_arg(kernel, 12, cl_int(cfg.end));
+    opencl_arg(kernel, 13,
+               cl_double(cfg.smoothing > 1 ? double(cfg.smoothing - 1) / 2 : 0));
+    opencl_arg(kernel, 14, s.traces.mem);
+    opencl_arg(kernel, 15, s.smoothed.mem);
+    opencl_arg(kernel, 16, s.columns.mem);
+    const size_t global = events;
+    status =
+        clEnqueueNDRangeKernel(s.queue, kernel, 1, nullptr, &global, nullptr, 0, nullptr, nullptr);
+    opencl_check(status, error::code::device_hw_failure, "kernel enqueue");
+
+    status = clEnqueueReadBuffer(s.queue, s.traces.mem, CL_FALSE, 0, samples * sizeof(cl_float),
+                                 s.traces_host.host, 0, nullptr, nullptr);
+    opencl_check(status, error::code::device_copy_failure, "trace read");
+    /*
+     * The columns are one buffer so they are read with one copy.
+     */
+    status = clEnqueueReadBuffer(s.queue, s.columns.mem, CL_FALSE, 0,
+                                 events * 4 * sizeof(cl_double), s.columns_host.host, 0, nullptr,
+                                 &s.done);
+    opencl_check(status, error::code::device_copy_failure, "columns read");
+    clFlush(s.queue);
+    ++submitted;
+    return true;
+}
+
+bool opencl_engine::collect(results& out) {
+    if (collected == submitted) {
+        return false;
+    }
+    auto& s = *slots[collected % slots.size()];
+    ++collected;
+    const size_t events = s.events;
+    if (events == 0) {
+        out.traces.clear();
+        out.baseline.clear();
+        out.cfd.clear();
+        out.total.clear();
+        out.psd.clear();
+        return true;
+    }
+    cl_int status = clWaitForEvents(1, &s.done);
+    clReleaseEvent(s.done);
+    s.done = nullptr;
+    opencl_check(status, error::code::device_hw_failure, "batch wait");
+    out.traces.resize(s.arena);
+    if (s.arena > 0) {
+        std::memcpy(out.traces.data(), s.traces_host.host, s.arena * sizeof(sample));
+    }
+    const double* columns = s.columns_host.data<double>();
+    out.baseline.assign(columns, columns + events);
+    out.cfd.assign(columns + events, columns + events * 2);
+    out.total.assign(columns + events * 2, columns + events * 3);
+    out.psd.assign(columns + events * 3, columns + events * 4);
+    return true;
+}
+#endif
+
+bool available(backend which) {
+    switch (which) {
+    case backend::host:
+        return true;
+    case backend::opencl:
+#if defined(PIXIE_OPENCL)
+    {
+        cl_device_id device;
+        return opencl_find(device);
+    }
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+offload::offload(const config& cfg_, backend which_, size_t depth)
+    : cfg(cfg_), which(which_) {
+    cfg.validate();
+    if (depth == 0) {
+        throw error(error::code::invalid_value, "trace: offload depth is 0");
+    }
+    switch (which) {
+    case backend::host:
+        engine_.reset(new host_engine(cfg, depth));
+        break;
+    case backend::opencl:
+#if defined(PIXIE_OPENCL)
+        engine_.reset(new opencl_engine(cfg, depth));
+        break;
+#else
+        throw error(error::code::not_supported, "trace: OpenCL backend not built");
+#endif
+    default:
+        throw error(error::code::invalid_value, "trace: invalid backend");
+    }
+}
+
+offload::~offload() = default;
+
+bool offload::submit(const list_mode::event_batch& batch) {
+    return engine_->submit(batch);
+}
+
+bool offload::collect(results& out) {
+    return engine_->collect(out);
+}
+
+size_t offload::in_flight() const {
+    return engine_->in_flight();
+}
+
+std::string offload::device() const {
+    return engine_->device();
+}
+}  // namespace trace
+}  // namespace data
+}  // namespace pixie
+}  // namespace xia
@@ -21,7 +21,12 @@
  */
 
 #include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <map>
+#include <mutex>
 
 #include <pixie/eeprom.hpp>
 #include <pixie/log.hpp>
@@ -527,6 +532,217 @@ void eeprom::throw_bad_tag_type(const tag key) {
     throw error(error::code::device_eeprom_bad_type, oss.str());
 }
 
+/*
+ * Process wide host cache of EEPROM contents. The file is a magic, a
+ * version and the number of entries followed by each entry's length and
+ * contents. The words are little endian.
+ */
+struct contents_cache {
+    static constexpr uint32_t magic = 0x43454558; /* "XEEC" */
+    static constexpr uint32_t version = 1;
+
+    struct entry {
+        int serial_num;
+        contents data;
+    };
+
+    typedef std::map<uint32_t, entry> entries;
+
+    std::mutex lock;
+    std::string path;
+    entries files;
+    bool enabled;
+
+    contents_cache() : enabled(false) {}
+
+    void load();
+    void save();
+};
+
+static contents_cache cache;
+
+/*
+ * Validate the contents and return the CRC and serial number. Returns
+ * false if the contents do not have a valid CRC.
+ */
+static bool cache_validate(const contents& data, uint32_t& crc, int& serial_num) {
+    if (data.size() < header::size) {
+        return false;
+    }
+    try {
+        eeprom ee;
+        ee.data = data;
+        ee.process();
+        if (!ee.valid()) {
+            return false;
+        }
+        crc = ee.hdr.crc;
+        serial_num = ee.serial_num;
+    } catch (error&) {
+        return false;
+    }
+    return true;
+}
+
+static void cache_put32(std::ostream& out, uint32_t value) {
+    const uint8_t bytes[4] = {uint8_t(value), uint8_t(value >> 8), uint8_t(value >> 16),
+                              uint8_t(value >> 24)};
+    out.write(reinterpret_cast<const char*>(bytes), sizeof(bytes));
+}
+
+static bool cache_get32(std::istream& in, uint32_t& value) {
+    uint8_t bytes[4];
+    if (!in.read(reinterpret_cast<char*>(bytes), sizeof(bytes))) {
+        return false;
+    }
+    value = uint32_t(bytes[0]) | (uint32_t(bytes[1]) << 8) | (uint32_t(bytes[2]) << 16) |
+        (uint32_t(bytes[3]) << 24);
+    return true;
+}
+
+void contents_cache::load() {
+    files.clear();
+    std::ifstream in(path, std::ios::in | std::ios::binary);
+    if (!in) {
+        return;
+    }
+    uint32_t file_magic = 0;
+    uint32_t file_version = 0;
+    uint32_t count = 0;
+    if (!cache_get32(in, file_magic) || file_magic != magic || !cache_get32(in, file_version) ||
+        file_version != version || !cache_get32(in, count)) {
+        xia_log(log::warning) << "eeprom: cache: invalid file: " << path;
+        return;
+    }
+    for (uint32_t e = 0; e < count; ++e) {
+        uint32_t length = 0;
+        if (!cache_get32(in, length) || length > hw::eeprom_block_size * 8) {
+            xia_log(log::warning) << "eeprom: cache: invalid entry: " << path;
+            break;
+        }
+        contents data(length);
+        if (!in.read(reinterpret_cast<char*>(data.data()), length)) {
+            xia_log(log::warning) << "eeprom: cache: truncated: " << path;
+            break;
+        }
+        uint32_t crc;
+        int serial_num;
+        if (cache_validate(data, crc, serial_num)) {
+            files[crc] = {serial_num, data};
+        }
+    }
+    xia_log(log::debug) << "eeprom: cache: load: " << path << " entries=" << files.size();
+}
+
+void contents_cache::save() {
+    /*
+     * Write a temporary file and rename it so a process reading the cache
+     * does not see a partial file.
+     */
+    const std::string temp = path + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!out) {
+            xia_log(log::warning) << "eeprom: cache: create: " << temp << ": "
+                                  << std::strerror(errno);
+            return;
+        }
+        cache_put32(out, magic);
+        cache_put32(out, version);
+        cache_put32(out, uint32_t(files.size()));
+        for (auto& fe : files) {
+            auto& data = fe.second.data;
+            cache_put32(out, uint32_t(data.size()));
+            out.write(reinterpret_cast<const char*>(data.data()), data.size());
+        }
+        if (!out) {
+            xia_log(log::warning) << "eeprom: cache: write: " << temp;
+            return;
+        }
+    }
+    std::remove(path.c_str());
+    if (std::rename(temp.c_str(), path.c_str()) != 0) {
+        xia_log(log::warning) << "eeprom: cache: rename: " << path << ": "
+                              << std::strerror(errno);
+    }
+}
+
+void cache_open(const std::string& path) {
+    std::lock_guard<std::mutex> guard(cache.lock);
+    cache.path = path;
+    cache.enabled = true;
+    cache.load();
+}
+
+void cache_close() {
+    std::lock_guard<std::mutex> guard(cache.lock);
+    cache.enabled = false;
+    cache.path.clear();
+    cache.files.clear();
+}
+
+bool cache_enabled() {
+    std::lock_guard<std::mutex> guard(cache.lock);
+    return cache.enabled;
+}
+
+bool cache_find(const contents& hdr, contents& data) {
+    if (hdr.size() < header::size) {
+        return false;
+    }
+    const uint32_t crc = uint32_t(hdr[0]) | (uint32_t(hdr[1]) << 8) | (uint32_t(hdr[2]) << 16) |
+        (uint32_t(hdr[3]) << 24);
+    std::lock_guard<std::mutex> guard(cache.lock);
+    if (!cache.enabled) {
+        return false;
+    }
+    auto fi = cache.files.find(crc);
+    if (fi == cache.files.end()) {
+        return false;
+    }
+    auto& e = fi->second;
+    if (!std::equal(hdr.begin(), hdr.begin() + header::size, e.data.begin())) {
+        return false;
+    }
+    data = e.data;
+    xia_log(log::debug) << "eeprom: cache: hit: serial-num=" << e.serial_num;
+    return true;
+}
+
+void cache_add(const contents& data) {
+    uint32_t crc;
+    int serial_num;
+    if (!cache_validate(data, crc, serial_num)) {
+        return;
+    }
+    std::lock_guard<std::mutex> guard(cache.lock);
+    if (!cache.enabled) {
+        return;
+    }
+    auto fi = cache.files.find(crc);
+    if (fi != cache.files.end() && fi->second.data == data) {
+        return;
+    }
+    /*
+     * A module's EEPROM can be reprogrammed, drop its old contents.
+     */
+    for (auto i = cache.files.begin(); i != cache.files.end();) {
+        if (i->second.serial_num == serial_num) {
+            i = cache.files.erase(i);
+        } else {
+            ++i;
+        }
+    }
+    cache.files[crc] = {serial_num, data};
+    xia_log(log::debug) << "eeprom: cache: add: serial-num=" << serial_num;
+    cache.save();
+}
+
+size_t cache_entries() {
+    std::lock_guard<std::mutex> guard(cache.lock);
+    return cache.files.size();
+}
+
 }  // namespace eeprom
 }  // namespace pixie
 }  // namespace xia
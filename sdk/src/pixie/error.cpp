@@ -68,6 +68,7 @@ static const std::map<code, result_code> result_codes = {
     {code::module_invalid_slot, {215, "invalid module slot number"}},
     {code::module_not_found, {216, "module not found"}},
     {code::module_test_invalid, {217, "module test invalid"}},
+    {code::module_task_cancelled, {218, "module task cancelled"}},
     /*
      * Channel
      */
@@ -119,6 +120,7 @@ static const std::map<code, result_code> result_codes = {
     {code::file_read_failure, {702, "file read failure"}},
     {code::file_size_invalid, {703, "invalid file size"}},
     {code::file_create_failure, {704, "file create failure"}},
+    {code::file_write_failure, {705, "file write failure"}},
     /*
      * System
      */
@@ -0,0 +1,246 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file fft.cpp
+ * @brief Implements the fast Fourier transforms of traces.
+ */
+
+#include <cmath>
+#include <limits>
+#include <string>
+
+#include <pixie/error.hpp>
+#include <pixie/fft.hpp>
+
+namespace xia {
+namespace pixie {
+namespace fft {
+typedef pixie::error::error error;
+
+static const double two_pi = 2.0 * std::acos(-1.0);
+
+/*
+ * The butterflies work on the real and imaginary parts. A complex
+ * multiply of std::complex handles infinities and NaNs with a library
+ * call unless built with fast math, the twiddles are finite.
+ */
+static inline void multiply(const double ar, const double ai, const double br, const double bi,
+                            double& r, double& i) {
+    r = ar * br - ai * bi;
+    i = ar * bi + ai * br;
+}
+
+static void radix_2_stage(double* data, const size_t length) {
+    for (size_t i = 0; i < 2 * length; i += 4) {
+        const double ar = data[i];
+        const double ai = data[i + 1];
+        const double br = data[i + 2];
+        const double bi = data[i + 3];
+        data[i] = ar + br;
+        data[i + 1] = ai + bi;
+        data[i + 2] = ar - br;
+        data[i + 3] = ai - bi;
+    }
+}
+
+/*
+ * A radix-4 decimation in time stage. The four blocks of quarter span
+ * `L` of a group are the transforms of the group's inputs `4m`, `4m+2`,
+ * `4m+1` and `4m+3` in bit reversed order.
+ */
+template<bool inverse>
+static void radix_4_stage(double* data, const size_t length, const size_t quarter,
+                          const double* twiddles) {
+    const size_t q = 2 * quarter;
+    for (size_t g = 0; g < 2 * length; g += 4 * q) {
+        const double* tw = twiddles;
+        for (size_t k = g; k < g + q; k += 2, tw += 6) {
+            const double w1r = tw[0];
+            const double w1i = inverse ? -tw[1] : tw[1];
+            const double w2r = tw[2];
+            const double w2i = inverse ? -tw[3] : tw[3];
+            const double w3r = tw[4];
+            const double w3i = inverse ? -tw[5] : tw[5];
+            double* d0 = data + k;
+            double* d1 = d0 + q;
+            double* d2 = d1 + q;
+            double* d3 = d2 + q;
+            const double t0r = d0[0];
+            const double t0i = d0[1];
+            double t1r, t1i, t2r, t2i, t3r, t3i;
+            multiply(d1[0], d1[1], w2r, w2i, t1r, t1i);
+            multiply(d2[0], d2[1], w1r, w1i, t2r, t2i);
+            multiply(d3[0], d3[1], w3r, w3i, t3r, t3i);
+            const double sr = t0r + t1r;
+            const double si = t0i + t1i;
+            const double dr = t0r - t1r;
+            const double di = t0i - t1i;
+            const double ur = t2r + t3r;
+            const double ui = t2i + t3i;
+            /*
+             * `v` is `-i (t2 - t3)` forward and `i (t2 - t3)` inverse.
+             */
+            const double vr = inverse ? -(t2i - t3i) : (t2i - t3i);
+            const double vi = inverse ? (t2r - t3r) : -(t2r - t3r);
+            d0[0] = sr + ur;
+            d0[1] = si + ui;
+            d1[0] = dr + vr;
+            d1[1] = di + vi;
+            d2[0] = sr - ur;
+            d2[1] = si - ui;
+            d3[0] = dr - vr;
+            d3[1] = di - vi;
+        }
+    }
+}
+
+bool power_of_2(const size_t length) {
+    return length != 0 && (length & (length - 1)) == 0;
+}
+
+plan::plan(const size_t length) : length_(length), radix_2(false) {
+    if (!power_of_2(length)) {
+        throw error(error::code::invalid_value,
+                    "fft: length not a power of 2: " + std::to_string(length));
+    }
+    if (length > std::numeric_limits<uint32_t>::max()) {
+        throw error(error::code::invalid_value, "fft: length too large: " + std::to_string(length));
+    }
+    for (uint32_t i = 0, j = 0; i < length; ++i) {
+        if (j > i) {
+            swaps.emplace_back(i, j);
+        }
+        size_t bit = length >> 1;
+        while (bit != 0 && (j & bit) != 0) {
+            j ^= uint32_t(bit);
+            bit >>= 1;
+        }
+        j |= uint32_t(bit);
+    }
+    size_t log2 = 0;
+    while ((size_t(1) << log2) < length) {
+        ++log2;
+    }
+    radix_2 = (log2 % 2) != 0;
+    for (size_t quarter = radix_2 ? 2 : 1; 4 * quarter <= length; quarter *= 4) {
+        stages.push_back({quarter, twiddles.size()});
+        const double step = -two_pi / double(4 * quarter);
+        for (size_t k = 0; k < quarter; ++k) {
+            for (size_t p = 1; p <= 3; ++p) {
+                const double angle = step * double(p * k);
+                twiddles.emplace_back(std::cos(angle), std::sin(angle));
+            }
+        }
+    }
+}
+
+void plan::forward(value* data) const {
+    transform(data, false);
+}
+
+void plan::forward(values& data) const {
+    if (data.size() != length_) {
+        throw error(error::code::invalid_value, "fft: data length does not match the plan");
+    }
+    transform(data.data(), false);
+}
+
+void plan::inverse(value* data) const {
+    transform(data, true);
+}
+
+void plan::inverse(values& data) const {
+    if (data.size() != length_) {
+        throw error(error::code::invalid_value, "fft: data length does not match the plan");
+    }
+    transform(data.data(), true);
+}
+
+void plan::transform(value* data, const bool inverse) const {
+    for (auto& swap : swaps) {
+        std::swap(data[swap.first], data[swap.second]);
+    }
+    /*
+     * A std::complex is an array of its real and imaginary parts.
+     */
+    auto parts = reinterpret_cast<double*>(data);
+    auto tw = reinterpret_cast<const double*>(twiddles.data());
+    if (radix_2) {
+        radix_2_stage(parts, length_);
+    }
+    if (inverse) {
+        for (auto& stg : stages) {
+            radix_4_stage<true>(parts, length_, stg.span, tw + 2 * stg.twiddles);
+        }
+    } else {
+        for (auto& stg : stages) {
+            radix_4_stage<false>(parts, length_, stg.span, tw + 2 * stg.twiddles);
+        }
+    }
+}
+
+real_plan::real_plan(const size_t length) : length_(length), half(length / 2) {
+    if (length < 2 || !power_of_2(length)) {
+        throw error(error::code::invalid_value,
+                    "fft: real length not a power of 2 of 2 or more: " + std::to_string(length));
+    }
+    const double step = -two_pi / double(length);
+    for (size_t k = 0; k <= length / 4; ++k) {
+        const double angle = step * double(k);
+        twiddles.emplace_back(std::cos(angle), std::sin(angle));
+    }
+}
+
+void real_plan::check(const size_t input_length) const {
+    if (input_length != length_) {
+        throw error(error::code::invalid_value,
+                    "fft: input length does not match the plan: " + std::to_string(input_length));
+    }
+}
+
+/*
+ * The even and odd inputs were packed as the real and imaginary parts of
+ * the half length's values. Transform them and separate the even and odd
+ * transforms of each pair of bins `k` and `M - k`.
+ */
+void real_plan::unpack(value* output) const {
+    const size_t m = half.length();
+    half.forward(output);
+    const double z0r = output[0].real();
+    const double z0i = output[0].imag();
+    output[0] = value(z0r + z0i, 0);
+    output[m] = value(z0r - z0i, 0);
+    for (size_t k = 1; k <= m / 2; ++k) {
+        const value zk = output[k];
+        const value zmk = std::conj(output[m - k]);
+        const double er = 0.5 * (zk.real() + zmk.real());
+        const double ei = 0.5 * (zk.imag() + zmk.imag());
+        /*
+         * `o` is `-i (zk - zmk) / 2`.
+         */
+        const double orr = 0.5 * (zk.imag() - zmk.imag());
+        const double oi = -0.5 * (zk.real() - zmk.real());
+        double wr, wi;
+        multiply(orr, oi, twiddles[k].real(), twiddles[k].imag(), wr, wi);
+        output[k] = value(er + wr, ei + wi);
+        output[m - k] = value(er - wr, -(ei - wi));
+    }
+}
+}  // namespace fft
+}  // namespace pixie
+}  // namespace xia
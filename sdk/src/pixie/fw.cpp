@@ -33,6 +33,7 @@
 #include <pixie/error.hpp>
 #include <pixie/fw.hpp>
 #include <pixie/log.hpp>
+#include <pixie/profile.hpp>
 #include <pixie/util.hpp>
 
 #include <sys/types.h>
@@ -58,6 +59,67 @@ typedef pixie::error::error error;
  */
 static std::atomic_size_t total_image_size;
 
+/*
+ * Process wide image cache.
+ */
+struct image_cache {
+    struct entry {
+        size_t size;
+        time_t modified;
+        uint32_t crc;
+        image_ptr img;
+    };
+
+    typedef std::map<std::string, entry> entries;
+
+    std::mutex lock;
+    entries files;
+    bool enabled;
+
+    image_cache() : enabled(true) {}
+
+    bool find(const std::string& filename, const struct stat& sb, entry& found);
+    image_ptr add(const std::string& filename, const struct stat& sb, uint32_t crc,
+                  image_ptr img);
+};
+
+static image_cache cache;
+
+bool image_cache::find(const std::string& filename, const struct stat& sb, entry& found) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto fi = files.find(filename);
+    if (fi == files.end()) {
+        return false;
+    }
+    auto& e = fi->second;
+    if (e.size != size_t(sb.st_size) || e.modified != sb.st_mtime) {
+        files.erase(fi);
+        return false;
+    }
+    found = e;
+    return true;
+}
+
+image_ptr image_cache::add(const std::string& filename, const struct stat& sb, uint32_t crc,
+                           image_ptr img) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!enabled) {
+        return img;
+    }
+    /*
+     * Share the image of a file with the same contents.
+     */
+    for (auto& fe : files) {
+        auto& e = fe.second;
+        if (e.crc == crc && e.size == img->size() && *e.img == *img) {
+            img = e.img;
+            break;
+        }
+    }
+    files[filename] = {size_t(sb.st_size), sb.st_mtime, crc, img};
+    return img;
+}
+
 reader::reader(const image& img_, const size_t default_word_size_)
     : img(img_), default_word_size(default_word_size_), offset(0) {}
 
@@ -104,21 +166,23 @@ firmware::firmware(const std::string version_, const int mod_revision_, const in
                    const int mod_adc_bits_, const std::string device_)
     : tag(pixie::firmware::tag(mod_revision_, mod_adc_msps_, mod_adc_bits_)), version(version_),
       mod_revision(mod_revision_), mod_adc_msps(mod_adc_msps_), mod_adc_bits(mod_adc_bits_),
-      device(device_) {}
+      device(device_), crc(0) {}
 
 firmware::firmware(const firmware& orig) :
     tag(orig.tag), filename(orig.filename), version(orig.version), mod_revision(orig.mod_revision),
     mod_adc_msps(orig.mod_adc_msps), mod_adc_bits(orig.mod_adc_bits), device(orig.device),
-    slot(orig.slot) {
+    slot(orig.slot), crc(0) {
 }
 
 firmware::firmware(firmware&& from)
     : tag(from.tag), filename(from.filename), version(from.version), mod_revision(from.mod_revision),
       mod_adc_msps(from.mod_adc_msps), mod_adc_bits(from.mod_adc_bits), device(from.device),
-      slot(from.slot) {
+      slot(from.slot), crc(0) {
     lock_guard guard(from.lock);
+    data = std::move(from.data);
+    crc = from.crc;
     from.filename.clear();
-    from.data.clear();
+    from.data.reset();
 }
 
 std::string firmware::basename() const {
@@ -135,14 +199,16 @@ std::string firmware::basename() const {
 }
 
 void firmware::load() {
+    PIXIE_PROFILE_SCOPE("firmware::load");
     lock_guard guard(lock);
-    if (data.empty()) {
+    if (!data) {
         util::timepoint load_time(true);
         /*
          * Use C and the standard file system interfaces. They are faster
          * than the C++ stream interface
          */
         int fd = -1;
+        bool cached = false;
         try {
             fd = ::open(filename.c_str(), O_RDONLY);
             if (fd < 0) {
@@ -155,32 +221,61 @@ void firmware::load() {
                 throw error(error::code::file_not_found,
                             "firmware: image stat: " + tag + ": " + std::strerror(errno));
             }
-            size_t size = size_t(sb.st_size);
-            data.resize(size);
-            r = ::read(fd, data.data(), static_cast<unsigned int>(size));
-            if (r < 0) {
-                throw error(error::code::file_not_found,
-                            "firmware: image read: " + tag + ": " + std::strerror(errno));
+            image_cache::entry entry;
+            if (cache.find(filename, sb, entry)) {
+                data = entry.img;
+                crc = entry.crc;
+                cached = true;
+            } else {
+                size_t size = size_t(sb.st_size);
+                auto img = std::make_shared<image>(size);
+                size_t offset = 0;
+                while (offset < size) {
+                    auto nr = ::read(fd, img->data() + offset,
+                                     static_cast<unsigned int>(size - offset));
+                    if (nr < 0) {
+                        throw error(error::code::file_not_found,
+                                    "firmware: image read: " + tag + ": " + std::strerror(errno));
+                    }
+                    if (nr == 0) {
+                        throw error(error::code::file_not_found,
+                                    "firmware: image read: " + tag + ": short read");
+                    }
+                    offset += size_t(nr);
+                }
+                util::crc32 img_crc;
+                img_crc.update(*img);
+                crc = img_crc.value;
+                data = cache.add(filename, sb, crc, img);
             }
             ::close(fd);
-            total_image_size += size;
+            total_image_size += data->size();
         } catch (...) {
             if (fd >= 0) {
                 ::close(fd);
             }
             throw;
         }
-        xia_log(log::debug) << "firmware: load: tag=" << tag << " time=" << load_time
-                            << " total=" << total_image_size.load();
+        xia_log(log::debug) << "firmware: load: tag=" << tag << " cached=" << std::boolalpha
+                            << cached << " crc=" << std::hex << crc << std::dec
+                            << " time=" << load_time << " total=" << total_image_size.load();
     }
 }
 
+image_ptr firmware::get_image() {
+    lock_guard guard(lock);
+    if (!data) {
+        throw error(error::code::device_image_failure, "firmware: image not loaded: " + tag);
+    }
+    return data;
+}
+
 void firmware::clear() {
     lock_guard guard(lock);
-    if (!data.empty()) {
-        total_image_size -= data.size();
-        data.clear();
-        data.shrink_to_fit();
+    if (data) {
+        total_image_size -= data->size();
+        data.reset();
+        crc = 0;
     }
 }
 
@@ -190,7 +285,8 @@ size_t firmware::words() {
      * Size of the vector should be uint32_t aligned so rounding there
      * should be redundant, but it does not harm so lets keep it.
      */
-    return ((size_t(data.size()) - 1) / sizeof(image_value_type)) + 1;
+    const size_t size = data ? data->size() : 0;
+    return ((size - 1) / sizeof(image_value_type)) + 1;
 }
 
 bool firmware::operator==(const firmware& fw) const {
@@ -214,7 +310,7 @@ void firmware::output(T& out) const {
     } else {
         out << "default";
     }
-    out << " size:" << data.size();
+    out << " size:" << (data ? data->size() : 0);
 }
 
 std::string tag(const int revision, const int adc_msps, const int adc_bits) {
@@ -298,6 +394,24 @@ void clear(module& mod_fw) {
     }
 }
 
+void image_cache_enable(bool enable) {
+    std::lock_guard<std::mutex> guard(cache.lock);
+    cache.enabled = enable;
+    if (!enable) {
+        cache.files.clear();
+    }
+}
+
+void image_cache_clear() {
+    std::lock_guard<std::mutex> guard(cache.lock);
+    cache.files.clear();
+}
+
+size_t image_cache_files() {
+    std::lock_guard<std::mutex> guard(cache.lock);
+    return cache.files.size();
+}
+
 firmware parse(const std::string fw_desc, const char delimiter) {
     std::string version;
     int mod_revision = 0;
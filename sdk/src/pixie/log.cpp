@@ -22,6 +22,7 @@
 
 #include <cerrno>
 #include <chrono>
+#include <condition_variable>
 #include <cstring>
 #include <ctime>
 #include <fstream>
@@ -48,9 +49,163 @@ using error = xia::pixie::error::error;
 static std::atomic<log::level> log_level(xia::log::warning);
 
 /*
- * Synchronous outputter.
+ * The category levels. A value of 0 is not set and the category uses the
+ * logging level, else the value is the level plus 1.
+ */
+static std::atomic<int> category_levels[log::max_category];
+
+static log::level category_level(log::category category) {
+    if (category != log::general && category < log::max_category) {
+        int level = category_levels[category].load();
+        if (level != 0) {
+            return static_cast<log::level>(level - 1);
+        }
+    }
+    return log_level.load();
+}
+
+/*
+ * A per-thread pool of streams for log instances. A log instance can be
+ * created while another is active on the thread, for example when a value
+ * being logged logs, so the pool is a stack.
+ */
+struct stream_pool {
+    std::vector<std::unique_ptr<std::ostringstream>> streams;
+    size_t depth;
+
+    stream_pool() : depth(0) {}
+
+    std::ostringstream& acquire();
+    void release();
+};
+
+std::ostringstream& stream_pool::acquire() {
+    if (depth == streams.size()) {
+        streams.emplace_back(new std::ostringstream);
+    }
+    auto& stream = *streams[depth++];
+    stream.str(std::string());
+    stream.clear();
+    stream.flags(std::ios_base::dec | std::ios_base::skipws);
+    stream.fill(' ');
+    stream.width(0);
+    stream.precision(6);
+    return stream;
+}
+
+void stream_pool::release() {
+    --depth;
+}
+
+static thread_local stream_pool log_streams;
+
+/*
+ * A log entry queued for an asynchronous outputter.
+ */
+struct entry {
+    typedef std::chrono::system_clock::time_point time_point;
+
+    log::level level;
+    time_point when;
+    std::string text;
+
+    entry() : level(log::off) {}
+};
+
+/*
+ * Bounded lock free multiple producer, single consumer queue of entries.
  *
- * Can be made asynchronous with a fixed size queue and worker thread.
+ * Each cell has a sequence number that tells a producer the cell is free
+ * and the consumer the cell holds an entry. A producer claims a cell by
+ * advancing the enqueue position. The size is a power of 2.
+ */
+class entry_queue {
+public:
+    explicit entry_queue(size_t size);
+
+    bool push(entry& e);
+    bool pop(entry& e);
+    bool empty() const;
+
+private:
+    struct cell {
+        std::atomic<size_t> sequence;
+        entry data;
+    };
+
+    static size_t round_up(size_t size);
+
+    std::vector<cell> cells;
+    const size_t mask;
+    char pad_0[64];
+    std::atomic<size_t> enqueue_pos;
+    char pad_1[64];
+    size_t dequeue_pos;
+};
+
+entry_queue::entry_queue(size_t size)
+    : cells(round_up(size)), mask(cells.size() - 1), enqueue_pos(0), dequeue_pos(0) {
+    for (size_t c = 0; c < cells.size(); ++c) {
+        cells[c].sequence.store(c, std::memory_order_relaxed);
+    }
+}
+
+size_t entry_queue::round_up(size_t size) {
+    size_t rounded = 2;
+    while (rounded < size) {
+        rounded <<= 1;
+    }
+    return rounded;
+}
+
+bool entry_queue::push(entry& e) {
+    size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+    cell* c;
+    while (true) {
+        c = &cells[pos & mask];
+        size_t seq = c->sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+        if (diff == 0) {
+            if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+    c->data.level = e.level;
+    c->data.when = e.when;
+    c->data.text.swap(e.text);
+    c->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool entry_queue::pop(entry& e) {
+    cell& c = cells[dequeue_pos & mask];
+    if (c.sequence.load(std::memory_order_acquire) != dequeue_pos + 1) {
+        return false;
+    }
+    e.level = c.data.level;
+    e.when = c.data.when;
+    e.text.swap(c.data.text);
+    c.sequence.store(dequeue_pos + mask + 1, std::memory_order_release);
+    ++dequeue_pos;
+    return true;
+}
+
+bool entry_queue::empty() const {
+    const cell& c = cells[dequeue_pos & mask];
+    return c.sequence.load(std::memory_order_acquire) != dequeue_pos + 1;
+}
+
+/*
+ * Outputter.
+ *
+ * An outputter is synchronous and writes entries on the caller's thread
+ * unless started asynchronously. An asynchronous outputter queues the
+ * entries and a worker thread formats and writes them.
  */
 struct outputter {
     typedef std::mutex lock_type;
@@ -79,16 +234,42 @@ struct outputter {
      */
     int count_length;
 
+    /*
+     * Entries dropped because the queue was full.
+     */
+    std::atomic<size_t> dropped;
+
     outputter(const std::string& name, const std::string& filename, bool append);
     outputter(outputter&& op);
     ~outputter();
 
+    void start_async(size_t queue_size);
+    void stop_async();
+
     void write(const log& entry);
     void write(const log::level entry_level, const std::string& entry);
 
 private:
+    typedef entry::time_point time_point;
+
+    void write_entry(const log::level entry_level, const std::string& entry);
+    void output(const log::level entry_level, const time_point& when, const std::string& entry);
+    void worker();
+    void drain();
+
     std::shared_ptr<std::ofstream> outfile;
     std::ostream out;
+
+    /*
+     * Asynchronous output.
+     */
+    std::unique_ptr<entry_queue> queue;
+    std::thread worker_thread;
+    std::atomic_bool running;
+    std::atomic_bool idle;
+    std::mutex wake_lock;
+    std::condition_variable wake;
+    size_t reported_drops;
 };
 
 static outputters_ptr outputs;
@@ -105,7 +286,8 @@ static const char* level_label[log::max_level] = {"[OFF  ] ", "[ERROR] ", "[WARN
 
 outputter::outputter(const std::string& name_, const std::string& filename_, bool append)
     : name(name_), filename(filename_), counter(0), linefeed(true), flush(false),
-      show_level(true), show_counts(false), show_datetime(true), count_length(5), out(nullptr) {
+      show_level(true), show_counts(false), show_datetime(true), count_length(5), dropped(0),
+      out(nullptr), running(false), idle(false), reported_drops(0) {
     if (filename.empty() || filename == "stdout") {
         out.rdbuf(std::cout.rdbuf());
     } else {
@@ -134,11 +316,16 @@ outputter::outputter(outputter&& op)
     : name(op.name), filename(op.filename), counter(op.counter),
       linefeed(op.linefeed), flush(op.flush), show_level(op.show_level),
       show_counts(op.show_counts), show_datetime(op.show_datetime), count_length(op.count_length),
-      outfile(op.outfile), out(op.out.rdbuf()) {
+      dropped(op.dropped.load()), outfile(op.outfile), out(op.out.rdbuf()), running(false),
+      idle(false), reported_drops(op.reported_drops) {
+    if (op.queue) {
+        throw error(error::code::internal_failure, "log output move: output is asynchronous");
+    }
     op.outfile.reset();
 }
 
 outputter::~outputter() {
+    stop_async();
     if (outfile) {
         write(log::info, "end " + name);
         outfile->close();
@@ -149,21 +336,68 @@ outputter::~outputter() {
 }
 
 void outputter::write(const log& entry) {
-    log::level current_level = log_level.load();
+    log::level current_level = category_level(entry.get_category());
     log::level entry_level = entry.get_level();
-    if (current_level != log::off && current_level >= entry_level) {
-        write(entry_level, entry.output.str());
+    if (entry_level != log::off && current_level != log::off && current_level >= entry_level) {
+        write_entry(entry_level, entry.output.str());
+    }
+}
+
+void outputter::start_async(size_t queue_size) {
+    if (!queue) {
+        queue = std::unique_ptr<entry_queue>(new entry_queue(queue_size));
+        running = true;
+        worker_thread = std::thread(&outputter::worker, this);
+    }
+}
+
+void outputter::stop_async() {
+    if (queue) {
+        {
+            std::lock_guard<std::mutex> guard(wake_lock);
+            running = false;
+        }
+        wake.notify_one();
+        if (worker_thread.joinable()) {
+            worker_thread.join();
+        }
+        drain();
+        queue.reset();
     }
 }
 
 void outputter::write(const log::level entry_level, const std::string& entry) {
-    std::lock_guard<lock_type> guard(lock);
     log::level current_level = log_level.load();
 
     if (entry_level == log::level::off || current_level < entry_level) {
         return;
     }
 
+    write_entry(entry_level, entry);
+}
+
+void outputter::write_entry(const log::level entry_level, const std::string& entry) {
+    auto now = std::chrono::system_clock::now();
+
+    if (queue) {
+        logging::entry queued;
+        queued.level = entry_level;
+        queued.when = now;
+        queued.text = entry;
+        if (!queue->push(queued)) {
+            ++dropped;
+        } else if (idle.load()) {
+            wake.notify_one();
+        }
+        return;
+    }
+
+    std::lock_guard<lock_type> guard(lock);
+    output(entry_level, now, entry);
+}
+
+void outputter::output(const log::level entry_level, const time_point& when,
+                       const std::string& entry) {
     ++counter;
 
     if (show_level) {
@@ -176,12 +410,11 @@ void outputter::write(const log::level entry_level, const std::string& entry) {
 
     if (show_datetime) {
         typedef std::chrono::microseconds us;
-        auto now = std::chrono::system_clock::now();
-        auto as_time_t = std::chrono::system_clock::to_time_t(now);
-        const auto now_us = std::chrono::duration_cast<us>(now.time_since_epoch());
+        auto as_time_t = std::chrono::system_clock::to_time_t(when);
+        const auto when_us = std::chrono::duration_cast<us>(when.time_since_epoch());
         char timeBuffer[80];
         std::strftime(timeBuffer, 80, "%FT%T", localtime(&as_time_t));
-        out << timeBuffer << std::setfill('0') << '.' << std::setw(6) << now_us.count() % 1000000
+        out << timeBuffer << std::setfill('0') << '.' << std::setw(6) << when_us.count() % 1000000
             << ' ';
     }
 
@@ -196,6 +429,44 @@ void outputter::write(const log::level entry_level, const std::string& entry) {
     }
 }
 
+void outputter::worker() {
+    /*
+     * The producers do not take a lock to wake the worker so a wake up can
+     * be missed. The timed wait bounds the delay writing an entry.
+     */
+    const auto period = std::chrono::milliseconds(10);
+    while (running.load()) {
+        drain();
+        std::unique_lock<std::mutex> guard(wake_lock);
+        idle = true;
+        if (running.load() && queue->empty()) {
+            wake.wait_for(guard, period);
+        }
+        idle = false;
+    }
+}
+
+void outputter::drain() {
+    std::lock_guard<lock_type> guard(lock);
+    logging::entry queued;
+    bool written = false;
+    while (queue->pop(queued)) {
+        output(queued.level, queued.when, queued.text);
+        written = true;
+    }
+    const size_t drops = dropped.load();
+    if (drops != reported_drops) {
+        std::ostringstream oss;
+        oss << "log: " << name << ": dropped " << drops - reported_drops << " entries";
+        output(log::warning, std::chrono::system_clock::now(), oss.str());
+        reported_drops = drops;
+        written = true;
+    }
+    if (written) {
+        out << std::flush;
+    }
+}
+
 static void write(const log& entry) {
     for (auto& output : *outputs) {
         output.write(entry);
@@ -208,7 +479,7 @@ static void write(const log::level entry_level, const std::string& entry) {
     }
 }
 
-void start(const std::string name, const std::string file, bool append) {
+void start(const std::string name, const std::string file, bool append, size_t queue_size) {
     /*
      * If the log exists quietly return. Could be the API init call is
      * called again.
@@ -218,7 +489,10 @@ void start(const std::string name, const std::string file, bool append) {
             return;
         }
     }
-    outputs->push_back(outputter(name, file, append));
+    outputs->emplace_back(name, file, append);
+    if (queue_size != 0) {
+        outputs->back().start_async(queue_size);
+    }
 }
 
 void stop(const std::string name) {
@@ -231,10 +505,69 @@ void stop(const std::string name) {
     throw error(error::code::internal_failure, "invalid log output name in stop");
 }
 
+size_t dropped(const std::string name) {
+    for (auto& output : *outputs) {
+        if (output.name == name) {
+            return output.dropped.load();
+        }
+    }
+    throw error(error::code::internal_failure, "invalid log output name in dropped");
+}
+
 void set_level(log::level level) {
     log_level = level;
 }
 
+void set_level(log::category category, log::level level) {
+    if (category == log::general || category >= log::max_category) {
+        throw error(error::code::internal_failure, "invalid log category in set level");
+    }
+    category_levels[category] = static_cast<int>(level) + 1;
+}
+
+void clear_level(log::category category) {
+    if (category == log::general || category >= log::max_category) {
+        throw error(error::code::internal_failure, "invalid log category in clear level");
+    }
+    category_levels[category] = 0;
+}
+
+void set_levels(const std::string& levels) {
+    static const char* category_label[log::max_category] = {
+        "general", "fifo", "dma", "bus", "param"};
+    static const char* level_name[log::max_level] = {
+        "off", "error", "warning", "info", "debug"};
+    std::vector<std::pair<log::category, log::level>> settings;
+    std::istringstream iss(levels);
+    std::string setting;
+    while (std::getline(iss, setting, ',')) {
+        if (setting.empty()) {
+            continue;
+        }
+        auto eq = setting.find('=');
+        if (eq == std::string::npos) {
+            throw error(error::code::invalid_value, "invalid log category level: " + setting);
+        }
+        const auto category_name = setting.substr(0, eq);
+        const auto level_text = setting.substr(eq + 1);
+        int category = 1;
+        while (category < log::max_category && category_name != category_label[category]) {
+            ++category;
+        }
+        int level = 0;
+        while (level < log::max_level && level_text != level_name[level]) {
+            ++level;
+        }
+        if (category == log::max_category || level == log::max_level) {
+            throw error(error::code::invalid_value, "invalid log category level: " + setting);
+        }
+        settings.emplace_back(static_cast<log::category>(category), static_cast<log::level>(level));
+    }
+    for (auto& cl : settings) {
+        set_level(cl.first, cl.second);
+    }
+}
+
 void set_level_stamp(const std::string name, bool level) {
     for (auto& output : *outputs) {
         if (output.name == name) {
@@ -274,6 +607,15 @@ bool level_logging(log::level level) {
     return false;
 }
 
+bool level_logging(log::level level, log::category category) {
+    log::level current_level = category_level(category);
+    if ((current_level != log::off && current_level >= level) ||
+        (current_level == log::off && level == log::off)) {
+        return true;
+    }
+    return false;
+}
+
 void memdump(log::level level, const std::string label, const void* addr, size_t length,
              size_t size, size_t line_length, size_t offset) {
     if (level_logging(level) && length > 0) {
@@ -361,8 +703,12 @@ void memdump(log::level level, const std::string label, const void* addr, size_t
 
 }  // namespace logging
 
+log::log(level level__, category category__)
+    : level_(level__), category_(category__), output(logging::log_streams.acquire()) {}
+
 log::~log() {
     logging::write(*this);
+    logging::log_streams.release();
 }
 
 };  // namespace xia
@@ -24,8 +24,10 @@
 #include <cstring>
 #include <fstream>
 #include <iomanip>
+#include <mutex>
 #include <sstream>
 #include <stdexcept>
+#include <unordered_map>
 
 #include <pixie/error.hpp>
 #include <pixie/fw.hpp>
@@ -232,6 +234,24 @@ static const channel_var_map channel_vars = {
     {"Xwait", channel_var::Xwait},
 };
 
+/*
+ * Hashed indexes of the look up maps. The maps are ordered for output and
+ * the indexes are used to look up a name.
+ */
+template<typename M>
+using name_index = std::unordered_map<std::string, typename M::mapped_type>;
+
+template<typename M>
+static name_index<M> make_index(const M& map) {
+    return name_index<M>(map.begin(), map.end(), map.size());
+}
+
+static const name_index<system_param_map> system_params_index = make_index(system_params);
+static const name_index<module_param_map> module_params_index = make_index(module_params);
+static const name_index<channel_param_map> channel_params_index = make_index(channel_params);
+static const name_index<module_var_map> module_vars_index = make_index(module_vars);
+static const name_index<channel_var_map> channel_vars_index = make_index(channel_vars);
+
 static const module_var_descs module_var_descriptors_default = {
     {module_var::AECorr, enable, ro, 1, "AECorr"},
     {module_var::AOutBuffer, enable, ro, 1, "AOutBuffer"},
@@ -473,6 +493,16 @@ void address_map::set(const size_t max_channels, const module_var_descs& module_
     full.start = std::min(module.start, channels.start);
     full.end = std::max(module.end, channels.end);
     full.set_size();
+
+    extent.start = full.start;
+    extent.end = full.start;
+    for (auto& desc : module_descs) {
+        extent.end = std::max(extent.end, hw::address(desc.address + desc.size));
+    }
+    for (auto& desc : channel_descs) {
+        extent.end = std::max(extent.end, hw::address(desc.address + max_channels * desc.size));
+    }
+    extent.set_size();
 }
 
 void address_map::output(std::ostream& out, bool lines) const {
@@ -569,6 +599,136 @@ hw::address address_map::max(const desc_addresses& addresses) {
     return std::get<1>((*max));
 }
 
+image::image() : base_(0) {}
+
+void image::create(const address_map& map) {
+    clear();
+    base_ = map.extent.start;
+    words.resize(map.extent.size, 0);
+    dirty_bits.resize((words.size() + bits_per_word - 1) / bits_per_word, 0);
+}
+
+void image::clear() {
+    base_ = 0;
+    words.clear();
+    dirty_bits.clear();
+}
+
+size_t image::index(const hw::address address) const {
+    if (!contains(address)) {
+        std::ostringstream oss;
+        oss << "variable image: address not in image: 0x" << std::hex << address;
+        throw error(error::code::internal_failure, oss.str());
+    }
+    return address - base_;
+}
+
+void image::check(const image& other) const {
+    if (other.base_ != base_ || other.words.size() != words.size()) {
+        throw error(error::code::invalid_value, "variable image: address maps do not match");
+    }
+}
+
+hw::word image::get(const hw::address address) const {
+    return words[index(address)];
+}
+
+void image::set(const hw::address address, const hw::word value) {
+    auto i = index(address);
+    words[i] = value;
+    dirty_bits[i / bits_per_word] |= bits(1) << (i % bits_per_word);
+}
+
+void image::store(const hw::address address, const hw::word value) {
+    auto i = index(address);
+    words[i] = value;
+    dirty_bits[i / bits_per_word] &= ~(bits(1) << (i % bits_per_word));
+}
+
+bool image::dirty(const hw::address address) const {
+    auto i = index(address);
+    return (dirty_bits[i / bits_per_word] & (bits(1) << (i % bits_per_word))) != 0;
+}
+
+size_t image::dirty_words() const {
+    size_t count = 0;
+    for (auto b : dirty_bits) {
+        for (; b != 0; b &= b - 1) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+void image::clean() {
+    std::fill(dirty_bits.begin(), dirty_bits.end(), 0);
+}
+
+void image::dirty_runs(runs& dirty) const {
+    dirty.clear();
+    size_t i = 0;
+    while (i < words.size()) {
+        const auto b = dirty_bits[i / bits_per_word] >> (i % bits_per_word);
+        if (b == 0) {
+            /*
+             * Skip the rest of a clean bit word.
+             */
+            i = (i / bits_per_word + 1) * bits_per_word;
+            continue;
+        }
+        if ((b & 1) == 0) {
+            ++i;
+            continue;
+        }
+        size_t end = i + 1;
+        while (end < words.size() &&
+               (dirty_bits[end / bits_per_word] & (bits(1) << (end % bits_per_word))) != 0) {
+            ++end;
+        }
+        dirty.push_back({hw::address(base_ + i), i, end - i});
+        i = end;
+    }
+}
+
+bool image::same(const image& other) const {
+    check(other);
+    return words.empty() ||
+        std::memcmp(words.data(), other.words.data(), words.size() * sizeof(hw::word)) == 0;
+}
+
+void image::diff(const image& other, addresses& differ) const {
+    check(other);
+    differ.clear();
+    /*
+     * Compare blocks of the words and only look at the words of the
+     * blocks that differ.
+     */
+    const size_t block = 64;
+    for (size_t first = 0; first < words.size(); first += block) {
+        const size_t length = std::min(block, words.size() - first);
+        if (std::memcmp(&words[first], &other.words[first], length * sizeof(hw::word)) != 0) {
+            for (size_t w = first; w < first + length; ++w) {
+                if (words[w] != other.words[w]) {
+                    differ.push_back(hw::address(base_ + w));
+                }
+            }
+        }
+    }
+}
+
+size_t image::copy(const image& from) {
+    addresses differ;
+    from.diff(*this, differ);
+    if (!differ.empty()) {
+        std::memcpy(words.data(), from.words.data(), words.size() * sizeof(hw::word));
+        for (auto address : differ) {
+            auto i = address - base_;
+            dirty_bits[i / bits_per_word] |= bits(1) << (i % bits_per_word);
+        }
+    }
+    return differ.size();
+}
+
 const module_var_descs& get_module_var_descriptors() {
     return module_var_descriptors_default;
 }
@@ -577,78 +737,78 @@ const channel_var_descs& get_channel_var_descriptors() {
     return channel_var_descriptors_default;
 }
 
-const system_param_map get_system_param_map() {
+const system_param_map& get_system_param_map() {
     return system_params;
 }
 
-const module_param_map get_module_param_map() {
+const module_param_map& get_module_param_map() {
     return module_params;
 }
 
-const channel_param_map get_channel_param_map() {
+const channel_param_map& get_channel_param_map() {
     return channel_params;
 }
 
 bool is_system_param(const std::string& label) {
-    auto search = system_params.find(label);
-    return search != system_params.end();
+    auto search = system_params_index.find(label);
+    return search != system_params_index.end();
 }
 
 bool is_module_param(const std::string& label) {
-    auto search = module_params.find(label);
-    return search != module_params.end();
+    auto search = module_params_index.find(label);
+    return search != module_params_index.end();
 }
 
 bool is_channel_param(const std::string& label) {
-    auto search = channel_params.find(label);
-    return search != channel_params.end();
+    auto search = channel_params_index.find(label);
+    return search != channel_params_index.end();
 }
 
 bool is_module_var(const std::string& label) {
-    auto search = module_vars.find(label);
-    return search != module_vars.end();
+    auto search = module_vars_index.find(label);
+    return search != module_vars_index.end();
 }
 
 bool is_channel_var(const std::string& label) {
-    auto search = channel_vars.find(label);
-    return search != channel_vars.end();
+    auto search = channel_vars_index.find(label);
+    return search != channel_vars_index.end();
 }
 
 system_param lookup_system_param(const std::string& label) {
-    auto search = system_params.find(label);
-    if (search == system_params.end()) {
+    auto search = system_params_index.find(label);
+    if (search == system_params_index.end()) {
         throw error(error::code::crate_invalid_param, "invalid system param: " + label);
     }
     return search->second;
 }
 
 module_param lookup_module_param(const std::string& label) {
-    auto search = module_params.find(label);
-    if (search == module_params.end()) {
+    auto search = module_params_index.find(label);
+    if (search == module_params_index.end()) {
         throw error(error::code::module_invalid_param, "invalid module param: " + label);
     }
     return search->second;
 }
 
 channel_param lookup_channel_param(const std::string& label) {
-    auto search = channel_params.find(label);
-    if (search == channel_params.end()) {
+    auto search = channel_params_index.find(label);
+    if (search == channel_params_index.end()) {
         throw error(error::code::channel_invalid_param, "invalid channel param: " + label);
     }
     return search->second;
 }
 
 module_var lookup_module_var(const std::string& label) {
-    auto search = module_vars.find(label);
-    if (search == module_vars.end()) {
+    auto search = module_vars_index.find(label);
+    if (search == module_vars_index.end()) {
         throw error(error::code::module_invalid_var, "invalid module variable: " + label);
     }
     return search->second;
 }
 
 channel_var lookup_channel_var(const std::string& label) {
-    auto search = channel_vars.find(label);
-    if (search == channel_vars.end()) {
+    auto search = channel_vars_index.find(label);
+    if (search == channel_vars_index.end()) {
         throw error(error::code::channel_invalid_var, "invalid channel variable: " + label);
     }
     return search->second;
@@ -672,13 +832,13 @@ lookup_descriptor(const std::string& label, const Ds& descs, const V& vars) {
 
 const module_var_desc& lookup_module_descriptor(
     const std::string& label, const module_var_descs& descs) {
-    return lookup_descriptor<module_var_desc, module_var_descs, module_var_map>(
-        label, descs, module_vars);
+    return lookup_descriptor<module_var_desc, module_var_descs, name_index<module_var_map>>(
+        label, descs, module_vars_index);
 }
 const channel_var_desc& lookup_channel_descriptor(
     const std::string& label, const channel_var_descs& descs) {
-    return lookup_descriptor<channel_var_desc, channel_var_descs, channel_var_map>(
-        label, descs, channel_vars);
+    return lookup_descriptor<channel_var_desc, channel_var_descs, name_index<channel_var_map>>(
+        label, descs, channel_vars_index);
 }
 
 void load(const std::string& dspvarfile, module_var_descs& module_var_descriptors,
@@ -729,7 +889,8 @@ void load(firmware::firmware_ref& firmware, module_var_descs& module_var_descrip
     if (firmware->device != "var") {
         throw error(error::code::device_image_failure, "invalid image type");
     }
-    if (firmware->data.empty()) {
+    auto image = firmware->data;
+    if (!image || image->empty()) {
         throw error(error::code::device_image_failure, "no image loaded");
     }
 
@@ -738,12 +899,57 @@ void load(firmware::firmware_ref& firmware, module_var_descs& module_var_descrip
             this->setg(base, base, base + size);
         }
     };
-    char* data = static_cast<char*>(static_cast<void*>(firmware->data.data()));
-    membuf sbuf(data, firmware->data.size());
+    /*
+     * The image is shared and immutable. The stream buffer is only read.
+     */
+    char* data = const_cast<char*>(reinterpret_cast<const char*>(image->data()));
+    membuf sbuf(data, image->size());
     std::istream input(&sbuf);
     load(input, module_var_descriptors, channel_var_descriptors);
 }
 
+/*
+ * The cache of the loaded tables. An entry is valid while a module holds
+ * the table and the firmware's image has not been reloaded.
+ */
+namespace {
+struct var_table_entry {
+    std::weak_ptr<const var_table> table;
+    std::weak_ptr<const firmware::image> image;
+};
+std::mutex var_tables_lock;
+std::unordered_map<std::string, var_table_entry> var_tables;
+}  // namespace
+
+var_table_ref load_table(firmware::firmware_ref& firmware, const size_t max_channels) {
+    const std::string key =
+        firmware->tag + ':' + firmware->filename + ':' + std::to_string(max_channels);
+    std::lock_guard<std::mutex> guard(var_tables_lock);
+    auto& entry = var_tables[key];
+    auto table = entry.table.lock();
+    if (table && firmware->data && entry.image.lock() == firmware->data) {
+        xia_log(log::debug) << "firmware: var table cached: " << key;
+        return table;
+    }
+    auto loaded = std::make_shared<var_table>(
+        var_table{module_var_descriptors_default, channel_var_descriptors_default, {}});
+    load(firmware, loaded->module_descs, loaded->channel_descs);
+    loaded->addresses.set(max_channels, loaded->module_descs, loaded->channel_descs);
+    entry.table = loaded;
+    entry.image = firmware->data;
+    /*
+     * Drop the entries of released tables.
+     */
+    for (auto e = var_tables.begin(); e != var_tables.end();) {
+        if (e->second.table.expired() && e->first != key) {
+            e = var_tables.erase(e);
+        } else {
+            ++e;
+        }
+    }
+    return loaded;
+}
+
 void load(std::istream& input, module_var_descs& module_var_descriptors,
           channel_var_descs& channel_var_descriptors) {
     for (std::string line; std::getline(input, line);) {
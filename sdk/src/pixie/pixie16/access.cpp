@@ -0,0 +1,169 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file access.cpp
+ * @brief Implements the revision specialized hardware access paths of a module.
+ */
+
+#include <pixie/pixie16/access.hpp>
+#include <pixie/pixie16/csr.hpp>
+#include <pixie/pixie16/defs.hpp>
+#include <pixie/pixie16/memory.hpp>
+#include <pixie/pixie16/module.hpp>
+#include <pixie/pixie16/reglist.hpp>
+
+/*
+ * ADSP-21160 registers defined from
+ * https://www.analog.com/media/en/dsp-documentation/processor-manuals/ADSP-21160_hwr_rev4.1.pdf
+ * last accessed on 2021-06-24
+ */
+/*
+ * DMA channel status register
+ */
+#define DMASTAT 0x37
+
+namespace xia {
+namespace pixie {
+namespace hw {
+namespace access {
+/*
+ * The DSP DMA setup. The parameters are the DSP address, the length and
+ * the FIFO watermark level.
+ */
+template<typename Rev>
+static reglist::list& dsp_dma_setup_list() {
+    static reglist::list setup("dsp dma setup", {
+        reglist::write(hw::device::EXT_MEM_TEST, DMASTAT),
+        reglist::expect(hw::device::WRT_DSP_MMA, 1 << 11, 0, error::code::device_dma_busy,
+                        "dsp: DMA busy"),
+        reglist::write_param(hw::device::WRT_DSP_II11, 0),
+        reglist::write_param(hw::device::WRT_DSP_C11, 1),
+        reglist::write(hw::device::WRT_DSP_IM11, 1),
+        reglist::write_param(hw::device::WRT_DSP_EC11, 1),
+        reglist::write(hw::device::WRT_DSP_DMAC11, 0x905),
+        reglist::write_param(hw::device::RD_WRT_FIFO_WML, 2)
+    });
+    return setup;
+}
+
+/*
+ * The MCA read setup. The parameter is the MCA address.
+ */
+template<bool DummyRead>
+static reglist::list& mca_read_setup_list();
+
+template<>
+reglist::list& mca_read_setup_list<false>() {
+    static reglist::list setup("mca read setup", {
+        reglist::write_param(hw::device::WRT_EXT_MEM, 0),
+        reglist::write(hw::device::SET_EXMEM_FIFO, 0)
+    });
+    return setup;
+}
+
+template<>
+reglist::list& mca_read_setup_list<true>() {
+    static reglist::list setup("mca read setup rev-h", {
+        reglist::write_param(hw::device::WRT_EXT_MEM, 0),
+        reglist::read(memory::MCA_MEM_DATA),
+        reglist::write(hw::device::SET_EXMEM_FIFO, 0)
+    });
+    return setup;
+}
+
+template<typename Rev>
+static void fifo_read_setup(module::module& module, size_t length) {
+    module.write_word(hw::device::SET_EXT_FIFO, hw::word(length));
+
+    size_t polls = 1000;
+    while (polls-- > 0) {
+        if (module.read_word(hw::device::RD_WRT_FIFO_WML) >= length) {
+            break;
+        }
+    }
+    if (polls == 0) {
+        throw module::error(module.number, module.slot, module::error::code::device_fifo_failure,
+                            "FIFO failed to reach watermark");
+    }
+}
+
+template<typename Rev>
+void fifo_read(module::module& module, word_ptr buffer, size_t length) {
+    module::module::bus_guard guard(module, module::module::bus_priority::fifo);
+    fifo_read_setup<Rev>(module, length);
+    module.dma_read(memory::FIFO_MEM_DMA, buffer, length);
+}
+
+template<typename Rev>
+void mca_read(module::module& module, address addr, word_ptr values, size_t size) {
+    module::module::bus_guard guard(module);
+
+    /*
+     * Guard the PCI active bit, so it is cleared when we exit.
+     */
+    csr::set_clear csr(module, 1 << hw::bit::PCIACTIVE);
+
+    /*
+     * Set up the address to read from and the short FIFO in System FPGA.
+     */
+    word dummy;
+    mca_read_setup_list<Rev::mca_dummy_read>().run_held(module, {addr}, &dummy);
+
+    /*
+     * Read the data using DMA.
+     */
+    module.dma_read(memory::MCA_MEM_DATA, values, size);
+}
+
+template<typename Rev>
+void dsp_dma_setup(module::module& module, address addr, size_t length) {
+    dsp_dma_setup_list<Rev>().run_held(module, {addr, hw::word(length), hw::word(length) / 2});
+}
+
+template void fifo_read<rev_b_g>(module::module&, word_ptr, size_t);
+template void fifo_read<rev_h>(module::module&, word_ptr, size_t);
+template void mca_read<rev_b_g>(module::module&, address, word_ptr, size_t);
+template void mca_read<rev_h>(module::module&, address, word_ptr, size_t);
+template void dsp_dma_setup<rev_b_g>(module::module&, address, size_t);
+template void dsp_dma_setup<rev_h>(module::module&, address, size_t);
+
+template<typename Rev>
+static const table& table_of(const char* name) {
+    static const table paths = {
+        name,
+        fifo_read<Rev>,
+        mca_read<Rev>,
+        dsp_dma_setup<Rev>
+    };
+    return paths;
+}
+
+const table& select(int revision) {
+    if (revision >= rev_h::first) {
+        return table_of<rev_h>("rev-h");
+    }
+    return table_of<rev_b_g>("rev-b-g");
+}
+
+const table& make(const module::module& module) {
+    return select(module.revision);
+}
+}  // namespace access
+}  // namespace hw
+}  // namespace pixie
+}  // namespace xia
@@ -0,0 +1,228 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2022 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file await.cpp
+ * @brief Implements awaitable list-mode readout and control operations.
+ */
+
+#include <pixie/log.hpp>
+
+#include <pixie/pixie16/await.hpp>
+
+namespace xia {
+namespace pixie {
+namespace await {
+struct reactor::wait {
+    enum struct kind { buffers, run, operation };
+
+    kind type;
+    module::module* mod;
+    size_t max_buffers;
+    bool timed;
+    std::chrono::steady_clock::time_point deadline;
+    buffer::queue::handles buffers;
+    buffers_handler on_buffers;
+    done_handler on_done;
+    crate::operation op;
+
+    wait(kind type_) : type(type_), mod(nullptr), max_buffers(0), timed(false) {}
+};
+
+reactor::reactor(executor& exec_, size_t poll_usecs)
+    : exec(exec_), poll(poll_usecs), checking(0), running_(false) {}
+
+reactor::~reactor() {
+    stop();
+}
+
+void reactor::start() {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!running_) {
+        running_ = true;
+        thread = std::thread(&reactor::run, this);
+    }
+}
+
+void reactor::stop() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!running_) {
+            return;
+        }
+        running_ = false;
+    }
+    wake.notify_all();
+    thread.join();
+    waits cancelled;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        cancelled.swap(waiting);
+    }
+    for (auto& w : cancelled) {
+        complete(*w, error::code::module_task_cancelled);
+    }
+}
+
+bool reactor::running() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return running_;
+}
+
+size_t reactor::pending() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return waiting.size() + checking;
+}
+
+void reactor::next_buffers(module::module& mod, buffers_handler handler, size_t max_buffers,
+                           size_t timeout_usecs) {
+    wait_ptr w(new wait(wait::kind::buffers));
+    w->mod = &mod;
+    w->on_buffers = std::move(handler);
+    w->max_buffers = max_buffers;
+    if (timeout_usecs != 0) {
+        w->timed = true;
+        w->deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(timeout_usecs);
+    }
+    add(std::move(w));
+}
+
+void reactor::run_done(module::module& mod, done_handler handler) {
+    wait_ptr w(new wait(wait::kind::run));
+    w->mod = &mod;
+    w->on_done = std::move(handler);
+    add(std::move(w));
+}
+
+void reactor::operation_done(crate::operation&& op, done_handler handler) {
+    wait_ptr w(new wait(wait::kind::operation));
+    w->op = std::move(op);
+    w->on_done = std::move(handler);
+    add(std::move(w));
+}
+
+void reactor::add(wait_ptr w) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (running_) {
+            waiting.push_back(std::move(w));
+        }
+    }
+    if (w) {
+        complete(*w, error::code::module_task_cancelled);
+    } else {
+        wake.notify_all();
+    }
+}
+
+/*
+ * Check all the waits without the lock held so a slow module call does
+ * not block adding a wait. The waits added while checking are merged back
+ * with the waits still pending.
+ */
+void reactor::run() {
+    std::unique_lock<std::mutex> guard(lock);
+    while (running_) {
+        if (waiting.empty()) {
+            wake.wait(guard);
+            continue;
+        }
+        waits sweep;
+        sweep.swap(waiting);
+        checking = sweep.size();
+        guard.unlock();
+        waits still;
+        for (auto& w : sweep) {
+            if (!check(*w)) {
+                still.push_back(std::move(w));
+            }
+        }
+        guard.lock();
+        checking = 0;
+        for (auto& w : still) {
+            waiting.push_back(std::move(w));
+        }
+        if (!waiting.empty()) {
+            wake.wait_for(guard, poll);
+        }
+    }
+}
+
+bool reactor::check(wait& w) {
+    switch (w.type) {
+        case wait::kind::buffers: {
+            size_t words = 0;
+            auto code = w.mod->read_list_mode(w.buffers, w.max_buffers, words, std::nothrow);
+            if (code != error::code::success || words != 0 ||
+                (w.timed && std::chrono::steady_clock::now() >= w.deadline)) {
+                complete(w, code);
+                return true;
+            }
+            break;
+        }
+        case wait::kind::run: {
+            error::code code = error::code::success;
+            bool active = false;
+            try {
+                active = w.mod->run_active();
+            } catch (pixie::error::error& e) {
+                code = e.type;
+            } catch (...) {
+                code = error::code::unknown_error;
+            }
+            if (!active) {
+                complete(w, code);
+                return true;
+            }
+            break;
+        }
+        case wait::kind::operation:
+            if (w.op.ready()) {
+                complete(w, error::code::success);
+                return true;
+            }
+            break;
+    }
+    return false;
+}
+
+void reactor::complete(wait& w, error::code code) {
+    if (w.type == wait::kind::operation && code == error::code::success && w.op.valid()) {
+        try {
+            w.op.get();
+        } catch (pixie::error::error& e) {
+            code = e.type;
+        } catch (...) {
+            code = error::code::unknown_error;
+        }
+    }
+    try {
+        if (w.type == wait::kind::buffers) {
+            auto handler = std::move(w.on_buffers);
+            auto buffers = std::move(w.buffers);
+            exec.post([handler, code, buffers]() mutable { handler(code, buffers); });
+        } else {
+            auto handler = std::move(w.on_done);
+            exec.post([handler, code] { handler(code); });
+        }
+    } catch (std::exception& e) {
+        xia_log(log::error) << "await: reactor: completion: " << e.what();
+    }
+}
+}  // namespace await
+}  // namespace pixie
+}  // namespace xia
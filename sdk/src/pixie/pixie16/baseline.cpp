@@ -21,6 +21,7 @@
  */
 
 #include <algorithm>
+#include <cstdint>
 
 #include <pixie/pixie16/baseline.hpp>
 
@@ -46,6 +47,8 @@ void channel::start(size_t number_, int adc_bits_) {
     adc_bits = adc_bits_;
     bins.clear();
     bins.resize(bin_buckets::size_type(1) << adc_bits);
+    lane_bins.clear();
+    lane_bins.resize(bins.size() * lanes);
     runs = 0;
     baseline = -1;
 }
@@ -75,14 +78,14 @@ void channel::end() {
             to_bin = noise_bins;
         }
     }
-    int sum = 0;
-    int samples = 0;
+    int64_t sum = 0;
+    int64_t samples = 0;
     for (int b = from_bin; b < to_bin; ++b) {
-        sum += b * bins[b];
+        sum += int64_t(b) * bins[b];
         samples += bins[b];
     }
     if (samples > 0) {
-        baseline = sum / samples;
+        baseline = int(sum / samples);
     } else {
         baseline = 0;
     }
@@ -90,11 +93,37 @@ void channel::end() {
 
 void channel::update(const hw::adc_trace& trace) {
     ++runs;
-    for (auto sample : trace) {
-        if (sample >= bins.size()) {
-            sample = static_cast<unsigned short>(bins.size() - 1);
+    if (trace.empty()) {
+        return;
+    }
+    const size_t num_bins = bins.size();
+    const hw::adc_word top = static_cast<hw::adc_word>(num_bins - 1);
+    const hw::adc_word* samples = trace.data();
+    const size_t count = trace.size();
+    int* lane = lane_bins.data();
+    hw::adc_word low = top;
+    hw::adc_word high = 0;
+    size_t s = 0;
+    for (; s + lanes <= count; s += lanes) {
+        for (size_t l = 0; l < lanes; ++l) {
+            hw::adc_word sample = std::min(samples[s + l], top);
+            low = std::min(low, sample);
+            high = std::max(high, sample);
+            ++lane[l * num_bins + sample];
+        }
+    }
+    for (; s < count; ++s) {
+        hw::adc_word sample = std::min(samples[s], top);
+        low = std::min(low, sample);
+        high = std::max(high, sample);
+        ++lane[sample];
+    }
+    for (size_t l = 0; l < lanes; ++l) {
+        int* lb = lane + l * num_bins;
+        for (size_t b = low; b <= high; ++b) {
+            bins[b] += lb[b];
+            lb[b] = 0;
         }
-        ++bins[sample];
     }
 }
 
@@ -0,0 +1,141 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2022 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file capture.cpp
+ * @brief Implements the capture and replay files of a module's DMA stream.
+ */
+
+#include <pixie/error.hpp>
+
+#include <pixie/pixie16/capture.hpp>
+
+namespace xia {
+namespace pixie {
+namespace capture {
+typedef pixie::error::error error;
+
+template<typename T>
+static void write_value(std::ofstream& out, const T value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template<typename T>
+static bool read_value(std::ifstream& in, T& value) {
+    in.read(reinterpret_cast<char*>(&value), sizeof(value));
+    return bool(in);
+}
+
+header::header() : slot(0), revision(0), adc_msps(0) {}
+
+chunk::chunk() : usecs(0) {}
+
+writer::writer() : chunks(0), words(0) {}
+
+void writer::open(const std::string& path_, const header& hdr) {
+    close();
+    out.open(path_, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw error(error::code::file_create_failure, "capture: create: " + path_);
+    }
+    path = path_;
+    chunks = 0;
+    words = 0;
+    write_value(out, magic);
+    write_value(out, version);
+    write_value(out, hdr.slot);
+    write_value(out, hdr.revision);
+    write_value(out, hdr.adc_msps);
+    if (!out) {
+        throw error(error::code::file_write_failure, "capture: write: " + path);
+    }
+    started = clock::now();
+}
+
+void writer::close() {
+    if (out.is_open()) {
+        out.close();
+    }
+}
+
+bool writer::is_open() const {
+    return out.is_open();
+}
+
+void writer::write(clock::time_point at, const hw::word* values, const size_t size) {
+    const auto usecs = at > started ?
+        std::chrono::duration_cast<std::chrono::microseconds>(at - started).count() :
+        0;
+    write_value(out, uint64_t(usecs));
+    write_value(out, uint32_t(size));
+    out.write(reinterpret_cast<const char*>(values), std::streamsize(size * sizeof(hw::word)));
+    if (!out) {
+        throw error(error::code::file_write_failure, "capture: write: " + path);
+    }
+    ++chunks;
+    words += size;
+}
+
+reader::reader() {}
+
+void reader::open(const std::string& path_) {
+    close();
+    in.open(path_, std::ios::binary);
+    if (!in) {
+        throw error(error::code::file_open_failure, "capture: open: " + path_);
+    }
+    path = path_;
+    uint32_t file_magic = 0;
+    uint32_t file_version = 0;
+    if (!read_value(in, file_magic) || file_magic != magic || !read_value(in, file_version) ||
+        file_version != version || !read_value(in, hdr.slot) || !read_value(in, hdr.revision) ||
+        !read_value(in, hdr.adc_msps)) {
+        in.close();
+        throw error(error::code::file_read_failure, "capture: not a capture file: " + path);
+    }
+}
+
+void reader::close() {
+    if (in.is_open()) {
+        in.close();
+    }
+}
+
+bool reader::is_open() const {
+    return in.is_open();
+}
+
+bool reader::next(chunk& chk) {
+    uint64_t usecs;
+    if (!read_value(in, usecs)) {
+        return false;
+    }
+    uint32_t size;
+    if (!read_value(in, size)) {
+        throw error(error::code::file_read_failure, "capture: truncated chunk: " + path);
+    }
+    chk.usecs = usecs;
+    chk.words.resize(size);
+    in.read(reinterpret_cast<char*>(chk.words.data()), std::streamsize(size * sizeof(hw::word)));
+    if (!in) {
+        throw error(error::code::file_read_failure, "capture: truncated chunk: " + path);
+    }
+    return true;
+}
+}  // namespace capture
+}  // namespace pixie
+}  // namespace xia
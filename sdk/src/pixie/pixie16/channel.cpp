@@ -20,8 +20,11 @@
  * @brief Implements functions and data structures related to a Pixie-16 channel.
  */
 
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <numeric>
+#include <vector>
 
 #include <pixie/os_compat.hpp>
 
@@ -98,41 +101,46 @@ void baseline::find_cut(size_t num) {
 
     bl_values.resize(channels.size());
 
+    /*
+     * The variables are written to the module's copy and synced to the DSP
+     * in one transfer.
+     */
+    auto write_vars = [this](param::channel_var var, const param::values& values) {
+        for (size_t idx = 0; idx < channels.size(); idx++) {
+            module.write_var(var, values[idx], channels[idx], 0, false);
+        }
+    };
+
     for (size_t idx = 0; idx < channels.size(); idx++) {
         log2_bweight[idx] =
             module.read_var(param::channel_var::Log2Bweight, channels[idx], 0, false);
         current_bl_cut[idx] = module.read_var(param::channel_var::BLcut, channels[idx], 0, false);
-        module.write_var(param::channel_var::Log2Bweight, 0, channels[idx]);
-        module.write_var(param::channel_var::BLcut, 0, channels[idx]);
     }
 
     try {
+        const param::values zeros(channels.size(), 0);
+        write_vars(param::channel_var::Log2Bweight, zeros);
+        write_vars(param::channel_var::BLcut, zeros);
+        module.sync_vars();
         compute_cut(num);
-        for (size_t idx = 0; idx < channels.size(); idx++) {
-            module.write_var(param::channel_var::BLcut, cuts[idx], channels[idx]);
-        }
-        compute_cut(num);
-        for (size_t idx = 0; idx < channels.size(); idx++) {
-            module.write_var(param::channel_var::BLcut, cuts[idx], channels[idx]);
-            xia_log(log::info) << module::module_label(module) << "channel=" << channels[idx]
-                               << " bl cut=" << cuts[idx];
-        }
     } catch (...) {
         try {
-            for (size_t idx = 0; idx < channels.size(); idx++) {
-                module.write_var(param::channel_var::Log2Bweight, log2_bweight[idx], channels[idx]);
-                module.write_var(param::channel_var::Log2Bweight, current_bl_cut[idx], channels[idx]);
-            }
+            write_vars(param::channel_var::Log2Bweight, log2_bweight);
+            write_vars(param::channel_var::BLcut, current_bl_cut);
+            module.sync_vars();
         } catch (...) {
             /* ignore nesting exceptions, keep the first */
         }
         throw;
     }
 
+    write_vars(param::channel_var::BLcut, cuts);
+    write_vars(param::channel_var::Log2Bweight, log2_bweight);
+    module.sync_vars();
+
     for (size_t idx = 0; idx < channels.size(); idx++) {
-        module.write_var(param::channel_var::Log2Bweight, log2_bweight[idx], channels[idx]);
         xia_log(log::info) << module::module_label(module) << "channel=" << channels[idx]
-                           << "find bl cut: cut=" << cuts[idx];
+                           << " find bl cut: cut=" << cuts[idx];
     }
 
     tp.end();
@@ -149,12 +157,32 @@ double baseline::time(hw::word time_word0, hw::word time_word1) {
 }
 
 void baseline::get(baseline::channels_values& chan_values, bool run) {
-    hw::memory::dsp dsp(module);
-    hw::io_buffer buffer;
-
     xia_log(log::debug) << module::module_label(module) << "baseline get: channels=" << channels.size()
                         << " chan-values=" << chan_values.size();
 
+    visit(
+        [&chan_values](size_t c, size_t bl, double timestamp, double baseline) {
+            if (c < chan_values.size()) {
+                chan_values[c][bl] = value(timestamp, baseline);
+            }
+        },
+        run);
+}
+
+void baseline::get(stats::baseline_noises& noises, bool run) {
+    xia_log(log::debug) << module::module_label(module) << "baseline noise: channels="
+                        << channels.size();
+
+    noises.resize(channels.size());
+
+    visit([&noises](size_t c, size_t, double, double baseline) { noises[c].update(baseline); },
+          run);
+}
+
+void baseline::visit(const visitor& visit_, bool run) {
+    hw::memory::dsp dsp(module);
+    hw::io_buffer buffer;
+
     /*
      * A baseline is returned in words as:
      *
@@ -169,7 +197,7 @@ void baseline::get(baseline::channels_values& chan_values, bool run) {
                             "no channels in the channel range");
     }
 
-    if (chan_values[0].size() > (buffer.size() / bl_block_len)) {
+    if (max_num > (buffer.size() / bl_block_len)) {
         throw module::error(module.number, module.slot, error::code::invalid_value,
                             "channels values more than available baselines");
     }
@@ -183,55 +211,51 @@ void baseline::get(baseline::channels_values& chan_values, bool run) {
     double starttime = time(buffer[0], buffer[1]);
     size_t offset = 2;
 
+    /*
+     * Convert a block's baselines together.
+     */
+    std::vector<double> baselines(module.num_channels);
+
     for (size_t bl = 0; bl < max_num; ++bl, offset += bl_block_len) {
         double timestamp = time(buffer[offset], buffer[offset + 1]) - starttime;
-        for (size_t c = 0; c < channels.size() && c < chan_values.size(); ++c) {
-            auto chan = channels[c];
-            values& chan_vals = chan_values[c];
-            if (bl < chan_vals.size()) {
-                double baseline = util::ieee_float(buffer[offset + 2 + chan]);
-                chan_vals[bl] = value(timestamp, baseline);
-            }
+        util::ieee_float::to_doubles(&buffer[offset + 2], baselines.data(), baselines.size());
+        for (size_t c = 0; c < channels.size(); ++c) {
+            visit_(c, bl, timestamp, baselines[channels[c]]);
         }
     }
 }
 
 void baseline::compute_cut(size_t num) {
-    for (size_t count = 0; count < 10; ++count) {
-        get(bl_values);
-        for (size_t idx = 0; idx < channels.size(); idx++) {
-            double sdev = 0.0;
-            size_t sdev_count = 0;
-            cuts[idx] = 0;
-            for (size_t bl = 0; bl < (num - 1); ++bl) {
-                double val = (std::fabs(bl_values[idx][bl].second - bl_values[idx][bl + 1].second));
-                if (val != 0) {
-                    if (val < (10.0 * bl_values[idx][bl].second) &&
-                        val < (10.0 * bl_values[idx][bl + 1].second)) {
-                        /*
-                         * @todo This piece of logic does not make sense because
-                         * `cut` is set to 0 and not touched. It is a form of the
-                         * code from before but it needs to be checked.
-                         */
-                        if (cuts[idx] == 0 || val < cuts[idx]) {
-                            sdev += val;
-                            ++sdev_count;
-                        }
-                    }
-                }
-            }
-            if (sdev_count > 0) {
-                const double sqrpi = std::sqrt(M_PI_2);
-                double bl_sigma = sdev * sqrpi / sdev_count;
-                cuts[idx] = static_cast<param::value_type>(std::floor(8.0 * bl_sigma));
-            } else {
-                cuts[idx] = 0;
-            }
+    get(bl_values);
+    for (size_t idx = 0; idx < channels.size(); idx++) {
+        cuts[idx] = compute_cut(bl_values[idx], num);
+        xia_log(log::debug) << module::module_label(module) << " channel=" << channels[idx]
+                            << " computed cut=" << cuts[idx];
+    }
+}
 
-            xia_log(log::debug) << module::module_label(module) << " idxnel=" << channels[idx]
-                                << " computed cut=" << cuts[idx];
+param::value_type baseline::compute_cut(const values& vals, size_t num) {
+    num = std::min(num, vals.size());
+    std::vector<double> diffs;
+    diffs.reserve(num);
+    for (size_t bl = 0; bl + 1 < num; ++bl) {
+        const double val = std::fabs(vals[bl].second - vals[bl + 1].second);
+        if (val != 0 && val < (10.0 * vals[bl].second) && val < (10.0 * vals[bl + 1].second)) {
+            diffs.push_back(val);
         }
     }
+    if (diffs.empty()) {
+        return 0;
+    }
+    /*
+     * The absolute difference of successive baselines has a half normal
+     * distribution. Its median is 0.6745 of the difference's standard
+     * deviation.
+     */
+    auto median = diffs.begin() + diffs.size() / 2;
+    std::nth_element(diffs.begin(), median, diffs.end());
+    const double bl_sigma = *median / 0.6745;
+    return static_cast<param::value_type>(std::floor(8.0 * bl_sigma));
 }
 
 channel::channel(module::module& module_) : number(-1), module(module_) {}
@@ -250,10 +274,20 @@ channel& channel::operator=(const channel& c) {
 void channel::read_adc(hw::adc_word* buffer, size_t size) {
     module::module& mod = module.get();
     if (mod.run_config.dsp_get_traces) {
-        const hw::address addr =
-           hw::memory::IO_BUFFER_ADDR + static_cast<hw::address>(number * (fixture->config.max_adc_trace_length / 2));
+        const hw::address addr = adc_trace_address();
 
         hw::memory::dsp dsp(module);
+
+        /*
+         * The DSP packs a pair of samples into a word. If the host's word
+         * layout is the samples in order read directly into the buffer.
+         */
+        if (util::host_little_endian() &&
+            (reinterpret_cast<uintptr_t>(buffer) % alignof(hw::word)) == 0) {
+            dsp.read(addr, reinterpret_cast<hw::word_ptr>(buffer), size / 2);
+            return;
+        }
+
         hw::adc_trace_buffer adc_trace;
 
         dsp.read(addr, adc_trace, size / 2);
@@ -267,15 +301,23 @@ void channel::read_adc(hw::adc_word* buffer, size_t size) {
     }
 }
 
+hw::address channel::adc_trace_address() const {
+    return hw::memory::IO_BUFFER_ADDR +
+        static_cast<hw::address>(number * (fixture->config.max_adc_trace_length / 2));
+}
+
 void channel::read_histogram(hw::word_ptr values, const size_t size) {
     if (size != 0) {
-        const hw::address addr =
-            hw::memory::HISTOGRAM_MEMORY + static_cast<hw::address>(number * fixture->config.max_histogram_length);
         hw::memory::mca mca(module);
-        mca.read(addr, values, size);
+        mca.read(histogram_address(), values, size);
     }
 }
 
+hw::address channel::histogram_address() const {
+    return hw::memory::HISTOGRAM_MEMORY +
+        static_cast<hw::address>(number * fixture->config.max_histogram_length);
+}
+
 void channel::read_histogram(hw::words& values) {
     read_histogram(values.data(), values.size());
 }
@@ -0,0 +1,714 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file cluster.cpp
+ * @brief Implements the run control and readout of a system of crates on a number of hosts.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+#include <pixie/error.hpp>
+#include <pixie/log.hpp>
+
+#include <pixie/pixie16/cluster.hpp>
+#include <pixie/pixie16/recorder.hpp>
+
+#if !defined(_WIN64) && !defined(_WIN32)
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace xia {
+namespace pixie {
+namespace cluster {
+typedef pixie::error::error error;
+
+/*
+ * The period the node checks for a stop, units msecs.
+ */
+static constexpr int node_poll_msecs = 100;
+
+node_config::node_config() : crate_id(0), director(false), fw_revision(0), control_port(0) {}
+
+crate_address::crate_address() : control_port(0), time_offset(0) {}
+
+crate_address::crate_address(const std::string& host_, int control_port_,
+                             data::list_mode::record::time_type time_offset_)
+    : host(host_), control_port(control_port_), time_offset(time_offset_) {}
+
+controller::module_info::module_info()
+    : number(-1), slot(-1), revision(0), adc_bits(0), adc_msps(0) {}
+
+controller::crate_info::crate_info()
+    : crate_id(0), director(false), data_port(-1), first_stream(0) {}
+
+/*
+ * A controller's link to a node. The receiver thread decodes the crate's
+ * data and queues the events for a read.
+ */
+struct controller::link {
+    int fd;
+    std::string in;
+    size_t crate;
+    data::list_mode::record::time_type time_offset;
+    std::unique_ptr<server::client> data;
+    std::thread receiver;
+
+    std::mutex lock;
+    /*
+     * The module index of a module number.
+     */
+    std::map<int, size_t> index;
+    std::vector<data::list_mode::records> queued;
+    std::vector<data::list_mode::buffer> leftovers;
+    /*
+     * The next frame sequence of each module, the frames sent before the
+     * connection and the frames in the run when it ended.
+     */
+    std::vector<uint64_t> next;
+    std::vector<uint64_t> expected;
+    bool expecting;
+    std::atomic_bool closed;
+
+    link() : fd(-1), crate(0), time_offset(0), expecting(false), closed(false) {}
+};
+
+void controller::set_reorder(data::list_mode::record::time_type window, size_t max_held) {
+    if (window < data::list_mode::record::time_type(0)) {
+        throw error(error::code::invalid_value,
+                    "cluster: controller: reorder window cannot be negative");
+    }
+    reorder_window = window;
+    reorder_max_held = max_held;
+    reorders.clear();
+}
+
+size_t controller::late_events() const {
+    size_t late = 0;
+    for (auto& ro : reorders) {
+        late += ro->late();
+    }
+    return late;
+}
+
+#if defined(_WIN64) || defined(_WIN32)
+node::node(crate::crate& crate__, const node_config& cfg_)
+    : cfg(cfg_), crate_(crate__), listen_fd(-1), port_(-1), running_(false) {
+    throw error(error::code::not_supported, "cluster: not supported on Windows");
+}
+
+node::~node() {}
+
+void node::start() {}
+
+void node::stop() {}
+
+int node::data_port() const {
+    return -1;
+}
+
+controller::controller(const crate_addresses& crates)
+    : addresses(crates), ended(false), finished(false),
+      reorder_window(data::list_mode::record::time_type(0)), reorder_max_held(0) {
+    throw error(error::code::not_supported, "cluster: not supported on Windows");
+}
+
+controller::~controller() {}
+
+void controller::connect() {}
+
+void controller::disconnect() {}
+
+size_t controller::start_run(hw::run::run_mode) {
+    return 0;
+}
+
+void controller::end_run() {}
+
+size_t controller::read(data::list_mode::merger&) {
+    return 0;
+}
+
+bool controller::complete() const {
+    return false;
+}
+
+size_t controller::streams() const {
+    return 0;
+}
+#else
+static std::string errno_text() {
+    return std::strerror(errno);
+}
+
+static bool send_all(int fd, const std::string& text) {
+    const char* data = text.data();
+    size_t size = text.size();
+    while (size > 0) {
+        const ssize_t sent = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        size -= size_t(sent);
+    }
+    return true;
+}
+
+node::node(crate::crate& crate__, const node_config& cfg_)
+    : cfg(cfg_), crate_(crate__), listen_fd(-1), port_(-1), running_(false) {
+    crate_.ready();
+    recorder::sources srcs;
+    for (auto& module : crate_.modules) {
+        if (module->online()) {
+            module->write(param::module_param::crateid, param::value_type(cfg.crate_id));
+            srcs.push_back(recorder::module_source(*module));
+        }
+    }
+    if (srcs.empty()) {
+        throw error(error::code::crate_invalid_param, "cluster: node: no online modules");
+    }
+    server::config data_cfg = cfg.data;
+    if (data_cfg.port < 0) {
+        data_cfg.port = 0;
+    }
+    data.reset(new server::server(srcs, data_cfg));
+
+    listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        throw error(error::code::device_initialize_failure,
+                    "cluster: node: socket: " + errno_text());
+    }
+    const int on = 1;
+    ::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(cfg.control_port));
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if ((!cfg.address.empty() &&
+         ::inet_pton(AF_INET, cfg.address.c_str(), &addr.sin_addr) != 1) ||
+        ::bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        ::listen(listen_fd, 1) < 0) {
+        const auto what = errno_text();
+        ::close(listen_fd);
+        listen_fd = -1;
+        throw error(error::code::device_initialize_failure,
+                    "cluster: node: control port " + std::to_string(cfg.control_port) +
+                        ": " + what);
+    }
+    socklen_t len = sizeof(addr);
+    ::getsockname(listen_fd, reinterpret_cast<sockaddr*>(&addr), &len);
+    port_ = ntohs(addr.sin_port);
+    xia_log(log::info) << "cluster: node: crate-id=" << cfg.crate_id << std::boolalpha
+                       << " director=" << cfg.director << " control-port=" << port_
+                       << " data-port=" << data->port() << " modules=" << srcs.size();
+}
+
+node::~node() {
+    try {
+        stop();
+    } catch (std::exception& e) {
+        xia_log(log::error) << e.what();
+    }
+    if (listen_fd >= 0) {
+        ::close(listen_fd);
+    }
+}
+
+int node::data_port() const {
+    return data->port();
+}
+
+void node::start() {
+    if (running_.load()) {
+        throw error(error::code::module_invalid_operation, "cluster: node: already running");
+    }
+    data->start();
+    running_ = true;
+    thread = std::thread(&node::worker, this);
+}
+
+void node::stop() {
+    running_ = false;
+    if (thread.joinable()) {
+        thread.join();
+    }
+    if (data->running()) {
+        data->stop();
+    }
+}
+
+std::string node::request(const std::string& line) {
+    std::istringstream in(line);
+    std::string cmd;
+    in >> cmd;
+    std::ostringstream reply;
+    try {
+        if (cmd == "status") {
+            reply << "ok " << cfg.crate_id << ' ' << int(cfg.director) << ' ' << data->port();
+            size_t source = 0;
+            for (auto& module : crate_.modules) {
+                if (module->online()) {
+                    auto src = recorder::module_source(*module);
+                    if (cfg.fw_revision != 0) {
+                        src.revision = cfg.fw_revision;
+                    }
+                    reply << ' ' << src.number << ':' << src.slot << ':' << src.revision << ':'
+                          << src.adc_bits << ':' << src.adc_msps << ':' << data->frames(source++);
+                }
+            }
+        } else if (cmd == "prepare") {
+            int mode = -1;
+            in >> mode;
+            if (mode != 0 && mode != 1) {
+                throw error(error::code::invalid_value, "invalid run mode");
+            }
+            crate_.prepare_listmode(mode == 1 ? hw::run::run_mode::new_run :
+                                                hw::run::run_mode::resume,
+                                    run_start);
+            reply << "ok";
+        } else if (cmd == "enable") {
+            crate_.enable_run(run_start);
+            reply << "ok " << run_start.skew_usecs;
+        } else if (cmd == "end") {
+            crate_.end_run();
+            /*
+             * Send the data left so the frame counts are the run's data.
+             */
+            while (data->poll() != 0) {
+            }
+            reply << "ok";
+            size_t source = 0;
+            for (auto& module : crate_.modules) {
+                if (module->online()) {
+                    reply << ' ' << data->frames(source++);
+                }
+            }
+        } else {
+            reply << "error unknown request: " << cmd;
+        }
+    } catch (pixie::error::error& e) {
+        xia_log(log::error) << "cluster: node: " << cmd << ": " << e;
+        reply.str("");
+        reply << "error " << e.what();
+    } catch (std::exception& e) {
+        xia_log(log::error) << "cluster: node: " << cmd << ": " << e.what();
+        reply.str("");
+        reply << "error " << e.what();
+    }
+    return reply.str();
+}
+
+void node::worker() {
+    xia_log(log::debug) << "cluster: node: thread running";
+    int conn = -1;
+    std::string in;
+    while (running_.load()) {
+        pollfd pfd = {};
+        pfd.fd = conn >= 0 ? conn : listen_fd;
+        pfd.events = POLLIN;
+        if (::poll(&pfd, 1, node_poll_msecs) <= 0) {
+            continue;
+        }
+        if (conn < 0) {
+            conn = ::accept(listen_fd, nullptr, nullptr);
+            if (conn >= 0) {
+                xia_log(log::info) << "cluster: node: controller connected";
+            }
+            continue;
+        }
+        char buf[1024];
+        const ssize_t got = ::recv(conn, buf, sizeof(buf), 0);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            xia_log(log::info) << "cluster: node: controller disconnected";
+            ::close(conn);
+            conn = -1;
+            in.clear();
+            continue;
+        }
+        in.append(buf, size_t(got));
+        size_t nl;
+        while (conn >= 0 && (nl = in.find('\n')) != std::string::npos) {
+            const auto line = in.substr(0, nl);
+            in.erase(0, nl + 1);
+            xia_log(log::debug) << "cluster: node: request: " << line;
+            if (!send_all(conn, request(line) + '\n')) {
+                ::close(conn);
+                conn = -1;
+                in.clear();
+            }
+        }
+    }
+    if (conn >= 0) {
+        ::close(conn);
+    }
+    xia_log(log::debug) << "cluster: node: thread stopped";
+}
+
+controller::controller(const crate_addresses& crates)
+    : addresses(crates), ended(false), finished(false),
+      reorder_window(data::list_mode::record::time_type(0)), reorder_max_held(0) {
+    if (addresses.empty()) {
+        throw error(error::code::invalid_value, "cluster: controller: no crates");
+    }
+}
+
+controller::~controller() {
+    try {
+        disconnect();
+    } catch (std::exception& e) {
+        xia_log(log::error) << e.what();
+    }
+}
+
+static int connect_to(const std::string& host, int port) {
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* found = nullptr;
+    const int result = ::getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &found);
+    if (result != 0) {
+        throw error(error::code::invalid_value,
+                    "cluster: controller: " + host + ": " + ::gai_strerror(result));
+    }
+    int fd = -1;
+    for (auto ai = found; ai != nullptr && fd < 0; ai = ai->ai_next) {
+        fd = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd >= 0 && ::connect(fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    ::freeaddrinfo(found);
+    if (fd < 0) {
+        throw error(error::code::device_initialize_failure,
+                    "cluster: controller: connect: " + host + ':' + std::to_string(port) +
+                        ": " + errno_text());
+    }
+    return fd;
+}
+
+std::string controller::request(link& lk, const std::string& line) {
+    const auto& address = addresses[lk.crate];
+    const auto label = "cluster: controller: " + address.host + ':' +
+        std::to_string(address.control_port) + ": ";
+    if (!send_all(lk.fd, line + '\n')) {
+        throw error(error::code::device_initialize_failure, label + "send: " + errno_text());
+    }
+    size_t nl;
+    while ((nl = lk.in.find('\n')) == std::string::npos) {
+        char buf[1024];
+        const ssize_t got = ::recv(lk.fd, buf, sizeof(buf), 0);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            throw error(error::code::device_initialize_failure, label + "connection closed");
+        }
+        lk.in.append(buf, size_t(got));
+    }
+    auto reply = lk.in.substr(0, nl);
+    lk.in.erase(0, nl + 1);
+    if (reply.compare(0, 2, "ok") != 0) {
+        throw error(error::code::internal_failure,
+                    label + line + ": " + (reply.size() > 6 ? reply.substr(6) : reply));
+    }
+    return reply.size() > 3 ? reply.substr(3) : std::string();
+}
+
+void controller::connect() {
+    disconnect();
+    infos.clear();
+    size_t stream = 0;
+    for (size_t c = 0; c < addresses.size(); ++c) {
+        link_ptr lk(new link);
+        lk->crate = c;
+        lk->time_offset = addresses[c].time_offset;
+        lk->fd = connect_to(addresses[c].host, addresses[c].control_port);
+        links.push_back(std::move(lk));
+        auto& ln = *links.back();
+
+        crate_info info;
+        std::istringstream status(request(ln, "status"));
+        int director = 0;
+        status >> info.crate_id >> director >> info.data_port;
+        info.director = director != 0;
+        info.first_stream = stream;
+        std::string entry;
+        while (status >> entry) {
+            module_info mod;
+            uint64_t frames = 0;
+            char sep;
+            std::istringstream fields(entry);
+            fields >> mod.number >> sep >> mod.slot >> sep >> mod.revision >> sep >>
+                mod.adc_bits >> sep >> mod.adc_msps >> sep >> frames;
+            if (!fields) {
+                throw error(error::code::invalid_value,
+                            "cluster: controller: invalid status: " + entry);
+            }
+            ln.index[mod.number] = info.modules.size();
+            ln.next.push_back(frames);
+            info.modules.push_back(mod);
+        }
+        if (info.modules.empty()) {
+            throw error(error::code::invalid_value, "cluster: controller: crate has no modules");
+        }
+        stream += info.modules.size();
+        ln.queued.resize(info.modules.size());
+        ln.leftovers.resize(info.modules.size());
+        ln.expected = ln.next;
+        infos.push_back(info);
+
+        ln.data.reset(new server::client(addresses[c].host, info.data_port));
+    }
+    size_t directors = 0;
+    for (auto& info : infos) {
+        if (info.director) {
+            ++directors;
+        }
+    }
+    if (directors > 1) {
+        disconnect();
+        throw error(error::code::invalid_value, "cluster: controller: more than one director");
+    }
+    /*
+     * Receive each crate's data in a thread.
+     */
+    for (auto& lk : links) {
+        auto ln = lk.get();
+        const auto& info = infos[ln->crate];
+        ln->receiver = std::thread([ln, info]() {
+            server::frame_header header;
+            hw::words words;
+            try {
+                while (ln->data->receive(header, words)) {
+                    auto idx = ln->index.find(header.module);
+                    if (idx == ln->index.end()) {
+                        throw error(error::code::invalid_value,
+                                    "cluster: controller: frame of an unknown module: " +
+                                        std::to_string(header.module));
+                    }
+                    const auto m = idx->second;
+                    const auto& mod = info.modules[m];
+                    data::list_mode::records recs;
+                    data::list_mode::decode_data_block(words.data(), words.size(),
+                                                       size_t(mod.revision),
+                                                       size_t(mod.adc_msps), recs,
+                                                       ln->leftovers[m]);
+                    for (auto& rec : recs) {
+                        rec.crate_id = info.crate_id;
+                        rec.shift_time(ln->time_offset);
+                    }
+                    std::lock_guard<std::mutex> guard(ln->lock);
+                    auto& queue = ln->queued[m];
+                    queue.insert(queue.end(), std::make_move_iterator(recs.begin()),
+                                 std::make_move_iterator(recs.end()));
+                    ln->next[m] = header.sequence + 1;
+                }
+            } catch (pixie::error::error& e) {
+                xia_log(log::error) << "cluster: controller: crate " << info.crate_id
+                                    << ": receive: " << e;
+            }
+            ln->closed = true;
+        });
+    }
+    ended = false;
+    finished = false;
+    xia_log(log::info) << "cluster: controller: connected: crates=" << infos.size()
+                       << " streams=" << stream;
+}
+
+void controller::disconnect() {
+    for (auto& lk : links) {
+        if (lk->data) {
+            lk->data->shutdown();
+        }
+        if (lk->receiver.joinable()) {
+            lk->receiver.join();
+        }
+        if (lk->fd >= 0) {
+            ::close(lk->fd);
+        }
+    }
+    links.clear();
+}
+
+size_t controller::start_run(hw::run::run_mode mode) {
+    if (links.empty()) {
+        throw error(error::code::module_invalid_operation, "cluster: controller: not connected");
+    }
+    xia_log(log::info) << "cluster: controller: start run: mode=" << int(mode);
+    const std::string prepare =
+        std::string("prepare ") + (mode == hw::run::run_mode::new_run ? "1" : "0");
+    size_t prepared = 0;
+    try {
+        for (; prepared < links.size(); ++prepared) {
+            request(*links[prepared], prepare);
+        }
+    } catch (...) {
+        for (size_t c = 0; c < prepared; ++c) {
+            try {
+                request(*links[c], "end");
+            } catch (pixie::error::error& e) {
+                xia_log(log::error) << e;
+            }
+        }
+        throw;
+    }
+    for (auto& lk : links) {
+        std::lock_guard<std::mutex> guard(lk->lock);
+        lk->expecting = false;
+    }
+    ended = false;
+    finished = false;
+    /*
+     * The director crate is enabled last.
+     */
+    size_t skew = 0;
+    auto enable = [this, &skew](link& lk) {
+        size_t crate_skew = 0;
+        std::istringstream(request(lk, "enable")) >> crate_skew;
+        skew = std::max(skew, crate_skew);
+    };
+    for (auto& lk : links) {
+        if (!infos[lk->crate].director) {
+            enable(*lk);
+        }
+    }
+    for (auto& lk : links) {
+        if (infos[lk->crate].director) {
+            enable(*lk);
+        }
+    }
+    return skew;
+}
+
+void controller::end_run() {
+    if (links.empty()) {
+        throw error(error::code::module_invalid_operation, "cluster: controller: not connected");
+    }
+    xia_log(log::info) << "cluster: controller: end run";
+    auto end = [this](link& lk) {
+        std::istringstream frames(request(lk, "end"));
+        std::lock_guard<std::mutex> guard(lk.lock);
+        for (auto& expected : lk.expected) {
+            frames >> expected;
+        }
+        lk.expecting = true;
+    };
+    for (auto& lk : links) {
+        if (infos[lk->crate].director) {
+            end(*lk);
+        }
+    }
+    for (auto& lk : links) {
+        if (!infos[lk->crate].director) {
+            end(*lk);
+        }
+    }
+    ended = true;
+}
+
+size_t controller::read(data::list_mode::merger& merger) {
+    if (merger.streams() < streams()) {
+        throw error(error::code::invalid_value, "cluster: controller: merger has too few streams");
+    }
+    if (reorder_window > data::list_mode::record::time_type(0) && reorders.empty()) {
+        for (size_t s = 0; s < streams(); ++s) {
+            reorders.emplace_back(
+                new data::list_mode::reorder(reorder_window, reorder_max_held));
+        }
+    }
+    size_t events = 0;
+    bool all_received = ended;
+    for (auto& lk : links) {
+        const auto& info = infos[lk->crate];
+        std::vector<data::list_mode::records> queued(info.modules.size());
+        bool received = true;
+        {
+            std::lock_guard<std::mutex> guard(lk->lock);
+            std::swap(queued, lk->queued);
+            lk->queued.resize(info.modules.size());
+            for (size_t m = 0; m < info.modules.size(); ++m) {
+                if (!lk->expecting || lk->next[m] < lk->expected[m]) {
+                    received = false;
+                }
+            }
+        }
+        if (!received && !lk->closed.load()) {
+            all_received = false;
+        }
+        for (size_t m = 0; m < queued.size(); ++m) {
+            const size_t stream = info.first_stream + m;
+            if (!reorders.empty()) {
+                reorders[stream]->push(queued[m]);
+                reorders[stream]->pop(queued[m]);
+            }
+            if (!queued[m].empty()) {
+                events += queued[m].size();
+                merger.push(stream, queued[m]);
+            }
+        }
+    }
+    if (all_received && !finished) {
+        for (size_t s = 0; s < streams(); ++s) {
+            if (!reorders.empty()) {
+                data::list_mode::records held;
+                reorders[s]->flush(held);
+                if (!held.empty()) {
+                    events += held.size();
+                    merger.push(s, held);
+                }
+            }
+            merger.finish(s);
+        }
+        finished = true;
+    }
+    return events;
+}
+
+bool controller::complete() const {
+    return finished;
+}
+
+size_t controller::streams() const {
+    size_t count = 0;
+    for (auto& info : infos) {
+        count += info.modules.size();
+    }
+    return count;
+}
+#endif
+}  // namespace cluster
+}  // namespace pixie
+}  // namespace xia
@@ -21,17 +21,24 @@
  */
 
 #include <algorithm>
+#include <chrono>
+#include <fstream>
 #include <future>
 #include <iomanip>
 #include <numeric>
 #include <sstream>
+#include <thread>
 
 #include <pixie/config.hpp>
 #include <pixie/log.hpp>
+#include <pixie/profile.hpp>
+#include <pixie/tracepoint.hpp>
 
 #include <pixie/pixie16/backplane.hpp>
 #include <pixie/pixie16/crate.hpp>
 
+#include <nolhmann/json.hpp>
+
 namespace xia {
 namespace pixie {
 namespace crate {
@@ -49,9 +56,94 @@ crate::boot_params::boot_params()
     : force(true), boot_comms(true), boot_fippi(true), boot_dsp(true) {
 }
 
-crate::crate() : num_modules(0), revision(-1), ready_(false), users_(0) {}
+crate::run_start::run_start() : skew_usecs(0), prepare_usecs(0) {}
+
+crate::crate() : num_modules(0), revision(-1), pin_workers(false), ready_(false), users_(0) {}
+
+crate::~crate() {
+    workers_.stop();
+}
+
+/*
+ * Wait for the modules' tasks and throw the first error.
+ */
+static void wait_modules(const std::string& label, std::vector<std::future<void>>& futures) {
+    error::code first_error = error::code::success;
+    std::exception_ptr first_exception;
+
+    for (auto& future : futures) {
+        try {
+            future.get();
+        } catch (pixie::error::error& e) {
+            if (first_error == error::code::success) {
+                first_error = e.type;
+            }
+        } catch (...) {
+            if (!first_exception) {
+                first_exception = std::current_exception();
+            }
+        }
+    }
+
+    if (first_exception) {
+        std::rethrow_exception(first_exception);
+    }
+
+    if (first_error != error::code::success) {
+        throw error(first_error, "crate " + label + " error; see log");
+    }
+}
+
+operation::operation() : cancel_(std::make_shared<std::atomic_bool>(false)) {}
+
+bool operation::valid() const {
+    return !futures.empty();
+}
+
+bool operation::ready() const {
+    for (auto& future : futures) {
+        if (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void operation::wait() const {
+    for (auto& future : futures) {
+        future.wait();
+    }
+}
 
-crate::~crate() {}
+bool operation::wait_for(size_t msecs) const {
+    auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(msecs);
+    for (auto& future : futures) {
+        if (future.wait_until(until) != std::future_status::ready) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void operation::get() {
+    if (futures.empty()) {
+        throw error(error::code::module_invalid_operation,
+                    "crate " + label + ": no operation result");
+    }
+    auto pending = std::move(futures);
+    futures.clear();
+    wait_modules(label, pending);
+}
+
+void operation::cancel() {
+    if (cancel_) {
+        cancel_->store(true);
+    }
+}
+
+bool operation::cancelled() const {
+    return cancel_ && cancel_->load();
+}
 
 void crate::ready() {
     if (!ready_.load()) {
@@ -80,40 +172,94 @@ void crate::initialize(bool reg_trace) {
     lock_guard guard(lock_);
 
     try {
-        for (size_t device_number = 0; device_number < hw::max_slots; ++device_number) {
-
+        /*
+         * Scan for the devices once then open the devices in parallel.
+         * Devices are numbered from 0 and the first device not found ends
+         * the crate's modules. An open error is held and handled in device
+         * order so the results are the same as opening the devices in
+         * order.
+         */
+        const size_t devices = std::min(scan_devices(), size_t(hw::max_slots));
+        for (size_t device_number = 0; device_number < devices; ++device_number) {
             add_module();
+        }
+
+        module::modules opening;
+        std::swap(opening, modules);
+
+        std::vector<std::string> open_errors(opening.size());
+        std::vector<std::future<void>> futures;
+
+        util::thread_pool openers;
+        openers.start(opening.size());
+
+        for (size_t device_number = 0; device_number < opening.size(); ++device_number) {
+            auto module = opening[device_number];
+            auto& open_error = open_errors[device_number];
+            futures.push_back(
+                openers.submit(device_number, [module, &open_error, device_number, reg_trace] {
+                    try {
+                        module->module_var_descriptors =
+                            param::module_var_descs(param::get_module_var_descriptors());
+                        module->channel_var_descriptors =
+                            param::channel_var_descs(param::get_channel_var_descriptors());
+                        module->reg_trace = reg_trace;
+                        module->open(device_number);
+                    } catch (pixie::error::error& e) {
+                        open_error = e.what();
+                    }
+                }));
+        }
 
-            auto& module_ptr = modules.back();
-            module::module& module = *module_ptr;
+        std::exception_ptr first_exception;
 
+        for (auto& future : futures) {
             try {
-                module.module_var_descriptors =
-                    param::module_var_descs(param::get_module_var_descriptors());
-                module.channel_var_descriptors =
-                    param::channel_var_descs(param::get_channel_var_descriptors());
-                module.reg_trace = reg_trace;
-                module.open(device_number);
-            } catch (pixie::error::error& e) {
-                xia_log(log::error) << "module: device " << device_number << ": error: " << e.what();
+                future.get();
+            } catch (...) {
+                if (!first_exception) {
+                    first_exception = std::current_exception();
+                }
             }
+        }
+
+        openers.stop();
+
+        if (first_exception) {
+            std::rethrow_exception(first_exception);
+        }
+
+        bool devices_found = true;
+
+        for (size_t device_number = 0; device_number < opening.size(); ++device_number) {
+            auto& module = opening[device_number];
 
             /*
-             * Have all modules been found?
+             * Have all modules been found? Close any module opened after
+             * the last device.
              */
-            if (!module.device_present()) {
-                modules.pop_back();
-                break;
+            if (!devices_found || !module->device_present()) {
+                devices_found = false;
+                if (module->present()) {
+                    module->close();
+                }
+                continue;
+            }
+
+            if (!open_errors[device_number].empty()) {
+                xia_log(log::error) << "module: device " << device_number
+                                    << ": error: " << open_errors[device_number];
             }
 
-            if (module.present()) {
-                xia_log(log::info) << "module: device " << device_number << ": slot:" << module.slot
-                                   << " serial-number:" << module.serial_num
-                                   << " version:" << module.version_label();
+            if (module->present()) {
+                xia_log(log::info) << "module: device " << device_number
+                                   << ": slot:" << module->slot
+                                   << " serial-number:" << module->serial_num
+                                   << " version:" << module->version_label();
+                modules.push_back(module);
             } else {
                 xia_log(log::info) << "module offline: device " << device_number;
-                std::move(std::prev(modules.end()), modules.end(), std::back_inserter(offline));
-                modules.pop_back();
+                offline.push_back(module);
             }
         }
 
@@ -144,6 +290,10 @@ void crate::shutdown() {
     }
     modules.clear();
     ready_ = false;
+    {
+        std::lock_guard<std::mutex> workers_guard(workers_lock_);
+        workers_.stop();
+    }
     if (first_error != error::code::success) {
         throw error(first_error, "crate shutdown error; see log");
     }
@@ -175,9 +325,11 @@ bool crate::probe() {
     xia_log(log::info) << "crate: probe";
     ready();
     lock_guard guard(lock_);
+    module_numbers mod_nums(modules.size());
+    std::iota(mod_nums.begin(), mod_nums.end(), 0);
+    run_modules("probe", mod_nums, [](module::module& module) { module.probe(); });
     size_t online = 0;
     for (auto& module : modules) {
-        module->probe();
         if (module->online()) {
           ++online;
         }
@@ -186,7 +338,54 @@ bool crate::probe() {
     return online == num_modules;
 }
 
+/*
+ * Firmware fingerprints by module serial number.
+ */
+typedef std::map<int, module::fingerprint> module_fingerprints;
+
+static void fingerprints_load(const std::string& name, module_fingerprints& fps) {
+    using json = nlohmann::json;
+    fps.clear();
+    std::ifstream input(name);
+    if (!input) {
+        xia_log(log::info) << "crate: boot: no fingerprints: " << name;
+        return;
+    }
+    try {
+        auto fp_json = json::parse(input);
+        for (auto& mod : fp_json.at("modules")) {
+            auto& fp = fps[mod.at("serial-num").get<int>()];
+            fp.comms = mod.at("sys").get<uint32_t>();
+            fp.fippi = mod.at("fippi").get<uint32_t>();
+            fp.dsp = mod.at("dsp").get<uint32_t>();
+        }
+    } catch (json::exception& e) {
+        xia_log(log::warning) << "crate: boot: invalid fingerprints: " << name << ": "
+                              << e.what();
+        fps.clear();
+    }
+}
+
+static void fingerprints_save(const std::string& name, const module_fingerprints& fps) {
+    using json = nlohmann::json;
+    json fp_json;
+    fp_json["modules"] = json::array();
+    for (auto& fp : fps) {
+        fp_json["modules"].push_back({{"serial-num", fp.first},
+                                      {"sys", fp.second.comms},
+                                      {"fippi", fp.second.fippi},
+                                      {"dsp", fp.second.dsp}});
+    }
+    std::ofstream output(name, std::ios::trunc);
+    if (!output) {
+        throw error(error::code::file_create_failure,
+                    "crate: boot: fingerprints file create: " + name);
+    }
+    output << fp_json.dump(2) << std::endl;
+}
+
 void crate::boot(const crate::boot_params& params) {
+    PIXIE_PROFILE_SCOPE("crate::boot");
     xia_log(log::info) << "crate: boot: force=" << std::boolalpha << params.force
                        << " comms=" << params.boot_comms << " fippi=" << params.boot_fippi
                        << " dsp=" << params.boot_dsp;
@@ -209,49 +408,53 @@ void crate::boot(const crate::boot_params& params) {
     ready();
     lock_guard guard(lock_);
 
-    typedef std::promise<error::code> promise_error;
-    typedef std::future<error::code> future_error;
-
-    std::vector<promise_error> promises(modules.size());
-    std::vector<future_error> futures;
-    std::vector<std::thread> threads;
+    const bool use_fingerprints = !params.fingerprints.empty();
 
+    module_numbers boot_nums;
     for (auto mod_num : mod_nums) {
         auto module = modules[mod_num];
-        if (module->revision == 0 || (!params.force && module->online())) {
+        if (module->revision == 0 ||
+            (!use_fingerprints && !params.force && module->online())) {
             continue;
         }
-        futures.push_back(future_error(promises[mod_num].get_future()));
-        threads.push_back(std::thread([mod_num, &params, &promises, module] {
-            try {
-                module->boot(params.boot_comms, params.boot_fippi, params.boot_dsp);
-                promises[mod_num].set_value(error::code::success);
-            } catch (pixie::error::error& e) {
-                promises[mod_num].set_value(e.type);
-            } catch (...) {
-                try {
-                    promises[mod_num].set_exception(std::current_exception());
-                } catch (...) {
-                }
-            }
-        }));
+        boot_nums.push_back(mod_num);
     }
 
-    error::code first_error = error::code::success;
+    PIXIE_TRACEPOINT1(crate_boot_start, boot_nums.size());
 
-    for (size_t t = 0; t < threads.size(); ++t) {
-        error::code e = futures[t].get();
-        if (first_error == error::code::success) {
-            first_error = e;
+    if (use_fingerprints) {
+        /*
+         * Create the entries before the workers run so the map is not
+         * changed by more than one worker.
+         */
+        module_fingerprints fps;
+        fingerprints_load(params.fingerprints, fps);
+        for (auto mod_num : boot_nums) {
+            auto& fp = fps[modules[mod_num]->serial_num];
+            if (params.force) {
+                fp = module::fingerprint();
+            }
         }
-        threads[t].join();
+        try {
+            run_modules("boot", boot_nums, [&fps](module::module& module) {
+                module.boot_changed(fps.at(module.serial_num));
+            });
+        } catch (...) {
+            fingerprints_save(params.fingerprints, fps);
+            throw;
+        }
+        fingerprints_save(params.fingerprints, fps);
+    } else {
+        run_modules("boot", boot_nums, [&params](module::module& module) {
+            module.boot(params.boot_comms, params.boot_fippi, params.boot_dsp);
+        });
     }
 
-    if (first_error != error::code::success) {
-        throw error(first_error, "crate boot error; see log");
-    }
+    PIXIE_TRACEPOINT1(crate_boot_modules, boot_nums.size());
 
     backplane.reinit(modules, offline);
+
+    PIXIE_TRACEPOINT1(crate_boot_end, boot_nums.size());
 }
 
 void crate::set_firmware() {
@@ -275,17 +478,26 @@ void crate::set_firmware() {
     }
 }
 
-void crate::import_config(const std::string json_file, module::number_slots& loaded) {
-    xia_log(log::info) << "crate: import configuration";
+void crate::import_config(const std::string json_file, module::number_slots& loaded,
+                          bool changes_only) {
+    xia_log(log::info) << "crate: import configuration: changes-only=" << std::boolalpha
+                       << changes_only;
     ready();
     lock_guard guard(lock_);
     loaded.clear();
-    config::import_json(json_file, *this, loaded);
-    for (auto& module : modules) {
-        if (module->online()) {
-            module->sync_vars();
-        }
+    if (config::is_snapshot(json_file)) {
+        config::import_snapshot(json_file, *this, loaded, changes_only);
+    } else {
+        config::import_json(json_file, *this, loaded, changes_only);
     }
+
+    if (changes_only) {
+        run_modules("import config",
+                    [](module::module& module) { module.sync_changed_vars(); });
+    } else {
+        run_modules("import config", [](module::module& module) { module.sync_vars(); });
+    }
+
     backplane.reinit(modules, offline);
 }
 
@@ -295,53 +507,729 @@ void crate::initialize_afe() {
     ready();
     lock_guard guard(lock_);
 
-    typedef std::promise<error::code> promise_error;
-    typedef std::future<error::code> future_error;
+    run_modules("AFE initialize", [](module::module& module) { module.sync_hw(); });
+}
+
+void crate::set_dacs() {
+    xia_log(log::info) << "crate: set DACs";
+
+    ready();
+    lock_guard guard(lock_);
+
+    run_modules("set DACs", [](module::module& module) { module.set_dacs(); });
+}
+
+void crate::adjust_offsets() {
+    xia_log(log::info) << "crate: adjust offsets";
+
+    ready();
+    lock_guard guard(lock_);
+
+    run_modules("adjust offsets", [](module::module& module) { module.adjust_offsets(); });
+}
+
+void crate::read_histograms(const module_numbers& mod_nums, module_histograms& histograms,
+                            size_t length) {
+    xia_log(log::info) << "crate: read histograms: modules=" << mod_nums.size()
+                       << " length=" << length;
+
+    ready();
+    lock_guard guard(lock_);
+
+    histograms.clear();
+    histograms.resize(mod_nums.size());
+    std::map<int, hw::words*> by_number;
+    for (size_t m = 0; m < mod_nums.size(); ++m) {
+        by_number[int(mod_nums[m])] = &histograms[m];
+    }
+    run_modules("read histograms", mod_nums, [&by_number, length](module::module& module) {
+        channel::range channels(module.num_channels);
+        channel::range_set(channels);
+        module.read_histograms(channels, *by_number.at(module.number), length);
+    });
+}
+
+const hw::word crate::histogram_file_magic = 0x54534858; /* "XHST" */
+const hw::word crate::histogram_file_version = 1;
+
+void crate::save_histograms(const std::string& file_name, const module_numbers& mod_nums,
+                            histogram_format format, size_t length) {
+    xia_log(log::info) << "crate: save histograms: " << file_name
+                       << " modules=" << mod_nums.size()
+                       << " described=" << std::boolalpha
+                       << (format == histogram_format::described) << " length=" << length;
+
+    module_numbers nums = mod_nums;
+    if (nums.empty()) {
+        ready();
+        for (size_t m = 0; m < modules.size(); ++m) {
+            if (modules[m]->online()) {
+                nums.push_back(m);
+            }
+        }
+    }
+
+    module_histograms histograms;
+    read_histograms(nums, histograms, length);
+
+    /*
+     * Assemble the file in memory so it is a single write.
+     */
+    const bool described = format == histogram_format::described;
+    size_t words = described ? 3 + nums.size() * 8 : 0;
+    for (auto& values : histograms) {
+        words += values.size();
+    }
+    hw::words file_words;
+    file_words.reserve(words);
+    if (described) {
+        file_words.push_back(histogram_file_magic);
+        file_words.push_back(histogram_file_version);
+        file_words.push_back(hw::word(nums.size()));
+    }
+    for (size_t m = 0; m < nums.size(); ++m) {
+        auto& values = histograms[m];
+        if (described) {
+            const module::module& module = *modules[nums[m]];
+            const auto& configs = module.eeprom.configs;
+            const size_t chans = size_t(module.num_channels);
+            file_words.push_back(hw::word(module.number));
+            file_words.push_back(hw::word(module.slot));
+            file_words.push_back(hw::word(module.serial_num));
+            file_words.push_back(hw::word(module.revision));
+            file_words.push_back(hw::word(configs.empty() ? 0 : configs[0].adc_msps));
+            file_words.push_back(hw::word(configs.empty() ? 0 : configs[0].adc_bits));
+            file_words.push_back(hw::word(chans));
+            file_words.push_back(hw::word(chans == 0 ? 0 : values.size() / chans));
+        }
+        file_words.insert(file_words.end(), values.begin(), values.end());
+    }
+
+    std::ofstream output(file_name, std::ios::binary | std::ios::trunc);
+    if (!output) {
+        throw error(error::code::file_create_failure,
+                    "crate: save histograms: file create: " + file_name);
+    }
+    output.write(reinterpret_cast<const char*>(file_words.data()),
+                 std::streamsize(file_words.size() * sizeof(hw::word)));
+    output.close();
+    if (!output) {
+        throw error(error::code::file_write_failure,
+                    "crate: save histograms: file write: " + file_name);
+    }
+}
+
+void crate::read_adcs(const module_numbers& mod_nums, const adc_traces_task& analyze,
+                      bool run) {
+    xia_log(log::info) << "crate: read adcs: modules=" << mod_nums.size()
+                       << " run=" << std::boolalpha << run;
+
+    ready();
+    lock_guard guard(lock_);
+
+    run_modules("read adcs", mod_nums, [&analyze, run](module::module& module) {
+        channel::range channels(module.num_channels);
+        channel::range_set(channels);
+        hw::adc_traces traces;
+        module.read_adcs(channels, traces, run);
+        analyze(module, traces);
+    });
+}
+
+void crate::fit_taus(const module_numbers& mod_nums, const data::tau::config& cfg,
+                     module_taus& taus, size_t captures, bool write) {
+    xia_log(log::info) << "crate: fit taus: modules=" << mod_nums.size()
+                       << " captures=" << captures << " write=" << std::boolalpha << write;
+
+    ready();
+    lock_guard guard(lock_);
+
+    taus.clear();
+    taus.resize(mod_nums.size());
+    std::map<int, data::tau::estimates*> by_number;
+    for (size_t m = 0; m < mod_nums.size(); ++m) {
+        by_number[int(mod_nums[m])] = &taus[m];
+    }
+    run_modules("fit taus", mod_nums, [&by_number, &cfg, captures, write](module::module& module) {
+        channel::range channels(module.num_channels);
+        channel::range_set(channels);
+        module.fit_tau(channels, cfg, *by_number.at(module.number), captures, write);
+    });
+}
+
+void crate::read_stats(const module_numbers& mod_nums, stats::snapshot& snap) {
+    ready();
+    lock_guard guard(lock_);
+
+    module_numbers nums = mod_nums;
+    if (nums.empty()) {
+        for (size_t m = 0; m < modules.size(); ++m) {
+            if (modules[m]->online()) {
+                nums.push_back(m);
+            }
+        }
+    }
+    for (auto mod_num : nums) {
+        if (mod_num >= modules.size()) {
+            throw error(error::code::module_number_invalid,
+                        "crate read stats: module number invalid");
+        }
+    }
+
+    if (snap.numbers != nums || snap.modules.size() != nums.size()) {
+        snap.numbers = nums;
+        snap.modules.clear();
+        snap.modules.reserve(nums.size());
+        for (auto mod_num : nums) {
+            snap.modules.emplace_back(*modules[mod_num]);
+        }
+    }
+
+    std::map<int, size_t> by_number;
+    for (size_t m = 0; m < nums.size(); ++m) {
+        by_number[int(nums[m])] = m;
+    }
+
+    /*
+     * The workers spin at the gate so they start the reads together. A
+     * worker busy with another task does not hold the others for longer
+     * than the gate's timeout.
+     */
+    using clock = stats::snapshot::clock;
+    constexpr auto gate_timeout = std::chrono::milliseconds(100);
+    std::atomic_size_t arrived(0);
+    std::vector<clock::time_point> times(nums.size());
+
+    run_modules("read stats", nums, [&](module::module& module) {
+        const size_t m = by_number.at(module.number);
+        const auto deadline = clock::now() + gate_timeout;
+        ++arrived;
+        while (arrived.load() < times.size() && clock::now() < deadline) {
+            std::this_thread::yield();
+        }
+        module.read_stats(snap.modules[m]);
+        times[m] = clock::now();
+    });
+
+    if (times.empty()) {
+        snap.time = clock::now();
+        snap.skew = std::chrono::microseconds(0);
+    } else {
+        const auto range = std::minmax_element(times.begin(), times.end());
+        clock::duration offsets(0);
+        for (auto& time : times) {
+            offsets += time - *range.first;
+        }
+        snap.time = *range.first + offsets / times.size();
+        snap.skew =
+            std::chrono::duration_cast<std::chrono::microseconds>(*range.second - *range.first);
+    }
+}
+
+void crate::subscribe_list_mode(const module::list_mode_subscription& subscription) {
+    xia_log(log::info) << "crate: subscribe list-mode: threshold=" << subscription.threshold_words;
+
+    ready();
+    lock_guard guard(lock_);
+
+    for (auto& module : modules) {
+        if (module->online()) {
+            module->subscribe_list_mode(subscription);
+        }
+    }
+}
+
+void crate::unsubscribe_list_mode() {
+    xia_log(log::info) << "crate: unsubscribe list-mode";
+
+    lock_guard guard(lock_);
+
+    for (auto& module : modules) {
+        module->unsubscribe_list_mode();
+    }
+}
+
+void crate::start_listmode(hw::run::run_mode mode) {
+    run_start start;
+    start_listmode(mode, start);
+}
+
+typedef std::chrono::steady_clock run_clock;
+
+static size_t usecs_since(run_clock::time_point from) {
+    return size_t(
+        std::chrono::duration_cast<std::chrono::microseconds>(run_clock::now() - from).count());
+}
+
+void crate::start_listmode(hw::run::run_mode mode, run_start& start) {
+    xia_log(log::info) << "crate: start list-mode: mode=" << int(mode);
+
+    ready();
+    lock_guard guard(lock_);
+
+    prepare_listmode(mode, start);
+    enable_run(start);
+}
 
-    std::vector<promise_error> promises(modules.size());
-    std::vector<future_error> futures;
-    std::vector<std::thread> threads;
+void crate::prepare_listmode(hw::run::run_mode mode, run_start& start) {
+    xia_log(log::info) << "crate: prepare list-mode: mode=" << int(mode);
+
+    ready();
+    lock_guard guard(lock_);
 
+    backplane.sync_wait_valid();
+
+    module_numbers mod_nums;
     for (size_t m = 0; m < modules.size(); ++m) {
-        auto module = modules[m];
-        if (!module->online()) {
-            continue;
+        if (modules[m]->online()) {
+            mod_nums.push_back(m);
         }
-        futures.push_back(future_error(promises[m].get_future()));
-        threads.push_back(std::thread([m, &promises, module] {
-            try {
-                module->sync_hw();
-                promises[m].set_value(error::code::success);
-            } catch (pixie::error::error& e) {
-                promises[m].set_value(e.type);
-            } catch (...) {
+    }
+
+    start = run_start();
+    start.enable_usecs.resize(modules.size());
+
+    /*
+     * Each worker only sets its module's prepared flag.
+     */
+    std::vector<char> prepared(modules.size(), 0);
+    auto prepare_start = run_clock::now();
+    try {
+        run_modules("list-mode prepare", mod_nums, [mode, &prepared](module::module& module) {
+            module.prepare_listmode(mode);
+            prepared[size_t(module.number)] = 1;
+        });
+    } catch (...) {
+        for (auto mod_num : mod_nums) {
+            if (prepared[mod_num] != 0) {
                 try {
-                    promises[m].set_exception(std::current_exception());
-                } catch (...) {
+                    modules[mod_num]->run_end();
+                } catch (pixie::error::error& e) {
+                    xia_log(log::error) << module::module_label(*modules[mod_num])
+                                        << "list-mode prepare: run end: " << e;
                 }
             }
+        }
+        throw;
+    }
+    start.prepare_usecs = usecs_since(prepare_start);
+}
+
+void crate::enable_run(run_start& start) {
+    ready();
+    lock_guard guard(lock_);
+
+    module_numbers mod_nums;
+    for (size_t m = 0; m < modules.size(); ++m) {
+        if (modules[m]->online()) {
+            mod_nums.push_back(m);
+        }
+    }
+
+    start.enable_usecs.assign(modules.size(), 0);
+    start.skew_usecs = 0;
+
+    /*
+     * Enable the modules that are not the run leader then the leader. An
+     * enable is a register write so a loop is quicker than the workers.
+     */
+    const int leader = backplane.run.module();
+    int leader_index = -1;
+    run_clock::time_point first_enable;
+    bool enabled = false;
+    auto enable = [&](size_t mod_num) {
+        modules[mod_num]->enable_run();
+        if (!enabled) {
+            first_enable = run_clock::now();
+            enabled = true;
+        }
+        start.enable_usecs[mod_num] = usecs_since(first_enable);
+    };
+    for (auto mod_num : mod_nums) {
+        if (modules[mod_num]->number == leader) {
+            leader_index = int(mod_num);
+        } else {
+            enable(mod_num);
+        }
+    }
+    if (leader_index >= 0) {
+        enable(size_t(leader_index));
+    }
+    for (auto mod_num : mod_nums) {
+        start.skew_usecs = std::max(start.skew_usecs, start.enable_usecs[mod_num]);
+    }
+
+    xia_log(log::info) << "crate: start list-mode: modules=" << mod_nums.size()
+                       << " leader=" << leader << " prepare=" << start.prepare_usecs
+                       << " usecs skew=" << start.skew_usecs << " usecs";
+}
+
+void crate::end_run() {
+    xia_log(log::info) << "crate: end run";
+
+    ready();
+    lock_guard guard(lock_);
+
+    std::vector<size_t> end_usecs;
+    end_modules(end_usecs);
+}
+
+void crate::end_modules(std::vector<size_t>& end_usecs) {
+    /*
+     * The run leader stops the run of the modules in sync wait mode. The
+     * leader's data is read with the other modules' data.
+     */
+    const int leader = backplane.run.module();
+    module_numbers mod_nums;
+    for (size_t m = 0; m < modules.size(); ++m) {
+        if (modules[m]->online()) {
+            if (modules[m]->number == leader) {
+                modules[m]->run_stop();
+            }
+            mod_nums.push_back(m);
+        }
+    }
+
+    end_usecs.assign(modules.size(), 0);
+    run_modules("run end", mod_nums, [&end_usecs](module::module& module) {
+        auto start = run_clock::now();
+        module.run_end();
+        end_usecs[size_t(module.number)] = usecs_since(start);
+    });
+}
+
+crate::timed_run::timed_run()
+    : seconds(0), preset(false), preset_grace_msecs(1000), preset_ended(false),
+      counter_timed(false) {}
+
+void crate::run_listmode_for(hw::run::run_mode mode, timed_run& run) {
+    xia_log(log::info) << "crate: timed list-mode: secs=" << run.seconds
+                       << " preset=" << std::boolalpha << run.preset;
+
+    if (!(run.seconds > 0)) {
+        throw error(error::code::invalid_value, "crate: timed list-mode: invalid run time");
+    }
+
+    ready();
+    lock_guard guard(lock_);
+
+    module_numbers mod_nums;
+    for (size_t m = 0; m < modules.size(); ++m) {
+        if (modules[m]->online()) {
+            mod_nums.push_back(m);
+        }
+    }
+    if (mod_nums.empty()) {
+        throw error(error::code::module_total_invalid, "crate: timed list-mode: no modules");
+    }
+
+    run.run_secs.assign(modules.size(), 0);
+    run.host_secs.assign(modules.size(), 0);
+    run.end_usecs.assign(modules.size(), 0);
+    run.preset_ended = false;
+    run.counter_timed = false;
+
+    if (run.preset) {
+        const param::value_type preset = util::ieee_float(run.seconds);
+        run_modules("timed list-mode preset", mod_nums, [preset](module::module& module) {
+            module.write(param::module_param::host_rt_preset, preset);
+        });
+    }
+
+    prepare_listmode(mode, run.start);
+    enable_run(run.start);
+
+    /*
+     * The leader is enabled last. The enable times are from the first
+     * module's enable.
+     */
+    const auto enabled = run_clock::now();
+    const auto first_enable = enabled - std::chrono::microseconds(run.start.skew_usecs);
+    const auto run_time = std::chrono::duration_cast<run_clock::duration>(
+        std::chrono::duration<double>(run.seconds));
+
+    size_t timer = mod_nums.front();
+    const int leader = backplane.run.module();
+    for (auto mod_num : mod_nums) {
+        if (modules[mod_num]->number == leader) {
+            timer = mod_num;
+        }
+    }
+    auto& timer_module = *modules[timer];
+
+    if (run.preset) {
+        /*
+         * Wait for the firmware to end the runs.
+         */
+        const auto deadline =
+            enabled + run_time + std::chrono::milliseconds(run.preset_grace_msecs);
+        const auto poll = std::chrono::milliseconds(10);
+        std::this_thread::sleep_until(enabled + run_time);
+        while (true) {
+            bool active = false;
+            for (auto mod_num : mod_nums) {
+                if (modules[mod_num]->run_active()) {
+                    active = true;
+                    break;
+                }
+            }
+            if (!active) {
+                run.preset_ended = true;
+                break;
+            }
+            if (run_clock::now() >= deadline) {
+                break;
+            }
+            std::this_thread::sleep_for(poll);
+        }
+    } else {
+        /*
+         * Sleep until close to the end then time the rest of the run from
+         * the run time counter. A module that does not count the run time
+         * is stopped at the host's time.
+         */
+        const auto margin =
+            std::min(run_time / 10, run_clock::duration(std::chrono::milliseconds(100)));
+        std::this_thread::sleep_until(enabled + run_time - margin);
+        const double counted = timer_module.run_real_time();
+        if (counted > 0) {
+            run.counter_timed = true;
+            const double remaining = run.seconds - counted;
+            if (remaining > 0) {
+                std::this_thread::sleep_for(std::chrono::duration<double>(remaining));
+            }
+        } else {
+            std::this_thread::sleep_until(enabled + run_time);
+        }
+    }
+
+    const auto stopped = run_clock::now();
+    for (auto mod_num : mod_nums) {
+        const auto module_enabled =
+            first_enable + std::chrono::microseconds(run.start.enable_usecs[mod_num]);
+        run.host_secs[mod_num] = std::chrono::duration<double>(stopped - module_enabled).count();
+    }
+
+    end_modules(run.end_usecs);
+
+    run_modules("timed list-mode run time", mod_nums, [&run](module::module& module) {
+        run.run_secs[size_t(module.number)] = module.run_real_time();
+    });
+
+    for (auto mod_num : mod_nums) {
+        xia_log(log::info) << module::module_label(*modules[mod_num])
+                           << "timed list-mode: run=" << run.run_secs[mod_num]
+                           << " secs host=" << run.host_secs[mod_num]
+                           << " secs end=" << run.end_usecs[mod_num] << " usecs";
+    }
+    xia_log(log::info) << "crate: timed list-mode: preset-ended=" << std::boolalpha
+                       << run.preset_ended << " counter-timed=" << run.counter_timed;
+}
+
+void crate::write_batch(const module_param_writes& writes) {
+    xia_log(log::info) << "crate: write batch: modules=" << writes.size();
+
+    ready();
+    lock_guard guard(lock_);
+
+    module_numbers mod_nums;
+    for (auto& mw : writes) {
+        mod_nums.push_back(mw.first);
+    }
+    run_modules("write batch", mod_nums, [&writes](module::module& module) {
+        module.write_batch(writes.at(size_t(module.number)));
+    });
+}
+
+void crate::stage_writes(const module_param_writes& writes) {
+    xia_log(log::info) << "crate: stage writes: modules=" << writes.size();
+
+    ready();
+    lock_guard guard(lock_);
+
+    module_numbers mod_nums;
+    for (auto& mw : writes) {
+        mod_nums.push_back(mw.first);
+    }
+    run_modules("stage writes", mod_nums, [&writes](module::module& module) {
+        module.stage_writes(writes.at(size_t(module.number)));
+    });
+}
+
+void crate::commit_staged() {
+    xia_log(log::info) << "crate: commit staged";
+
+    ready();
+    lock_guard guard(lock_);
+
+    run_modules("commit staged", [](module::module& module) { module.commit_staged(); });
+}
+
+void crate::run_modules(const std::string& label, const module_task& task) {
+    module_numbers mod_nums;
+    for (size_t m = 0; m < modules.size(); ++m) {
+        if (modules[m]->online()) {
+            mod_nums.push_back(m);
+        }
+    }
+    run_modules(label, mod_nums, task);
+}
+
+util::thread_pool& crate::workers() {
+    std::lock_guard<std::mutex> guard(workers_lock_);
+    const size_t count = std::max(modules.size(), size_t(1));
+    if (workers_.size() != count) {
+        util::thread_pool::affinities affinity;
+        if (pin_workers) {
+            affinity.resize(modules.size());
+            for (size_t m = 0; m < modules.size(); ++m) {
+                modules[m]->pci_local_cpus(affinity[m]);
+            }
+        }
+        xia_log(log::info) << "crate: workers: start: count=" << count
+                           << " pinned=" << std::boolalpha << pin_workers;
+        workers_.start(count, affinity);
+    }
+    return workers_;
+}
+
+void crate::run_modules(const std::string& label, const module_numbers& mod_nums,
+                        const module_task& task) {
+    for (auto mod_num : mod_nums) {
+        if (mod_num >= modules.size()) {
+            throw error(error::code::module_number_invalid,
+                        "crate " + label + ": module number invalid");
+        }
+    }
+
+    auto& pool = workers();
+
+    std::vector<std::future<void>> futures;
+
+    for (auto mod_num : mod_nums) {
+        auto module = modules[mod_num];
+        futures.push_back(pool.submit(mod_num, [&label, &task, module] {
+            try {
+                task(*module);
+            } catch (pixie::error::error& e) {
+                xia_log(log::error) << module::module_label(*module) << label << ": " << e;
+                throw;
+            }
         }));
     }
 
-    error::code first_error = error::code::success;
+    wait_modules(label, futures);
+}
+
+operation crate::run_modules_async(const std::string& label, const module_numbers& mod_nums,
+                                   module_task task) {
+    lock_guard guard(lock_);
 
-    for (size_t t = 0; t < threads.size(); ++t) {
-        error::code e = futures[t].get();
-        if (first_error == error::code::success) {
-            first_error = e;
+    module_numbers nums = mod_nums;
+    if (nums.empty()) {
+        for (size_t m = 0; m < modules.size(); ++m) {
+            if (modules[m]->online()) {
+                nums.push_back(m);
+            }
+        }
+    }
+    for (auto mod_num : nums) {
+        if (mod_num >= modules.size()) {
+            throw error(error::code::module_number_invalid,
+                        "crate " + label + ": module number invalid");
         }
-        threads[t].join();
     }
 
-    if (first_error != error::code::success) {
-        throw error(first_error, "crate AFE intialize error; see log");
+    xia_log(log::info) << "crate: " << label << ": async: modules=" << nums.size();
+
+    auto& pool = workers();
+
+    operation op;
+    op.label = label;
+
+    auto shared_task = std::make_shared<module_task>(std::move(task));
+    auto cancel = op.cancel_;
+
+    for (auto mod_num : nums) {
+        auto module = modules[mod_num];
+        op.futures.push_back(pool.submit(mod_num, [label, shared_task, cancel, module] {
+            if (cancel->load()) {
+                throw error(error::code::module_task_cancelled,
+                            module::module_label(*module) + label + ": cancelled");
+            }
+            try {
+                (*shared_task)(*module);
+            } catch (pixie::error::error& e) {
+                xia_log(log::error) << module::module_label(*module) << label << ": " << e;
+                throw;
+            }
+        }));
     }
+
+    return op;
 }
 
-void crate::export_config(const std::string json_file) {
+operation crate::boot_async(const module_numbers& mod_nums, bool boot_comms, bool boot_fippi,
+                            bool boot_dsp) {
+    /*
+     * A module is online once booted so empty is all modules.
+     */
+    module_numbers nums = mod_nums;
+    if (nums.empty()) {
+        nums.resize(modules.size());
+        std::iota(nums.begin(), nums.end(), 0);
+    }
+    return run_modules_async(
+        "boot", nums, [boot_comms, boot_fippi, boot_dsp](module::module& module) {
+            module.boot(boot_comms, boot_fippi, boot_dsp);
+        });
+}
+
+operation crate::set_dacs_async(const module_numbers& mod_nums) {
+    ready();
+    return run_modules_async("set DACs", mod_nums,
+                             [](module::module& module) { module.set_dacs(); });
+}
+
+operation crate::adjust_offsets_async(const module_numbers& mod_nums) {
+    ready();
+    return run_modules_async("adjust offsets", mod_nums,
+                             [](module::module& module) { module.adjust_offsets(); });
+}
+
+operation crate::acquire_baselines_async(const module_numbers& mod_nums) {
+    ready();
+    return run_modules_async("acquire baselines", mod_nums,
+                             [](module::module& module) { module.acquire_baselines(); });
+}
+
+operation crate::tau_finder_async(const module_numbers& mod_nums) {
+    ready();
+    return run_modules_async("tau finder", mod_nums,
+                             [](module::module& module) { module.tau_finder(); });
+}
+
+operation crate::get_traces_async(const module_numbers& mod_nums) {
+    ready();
+    return run_modules_async("get traces", mod_nums,
+                             [](module::module& module) { module.get_traces(); });
+}
+
+void crate::export_config(const std::string json_file, bool snapshot) {
     xia_log(log::info) << "crate: export configuration";
     lock_guard guard(lock_);
-    config::export_json(json_file, *this);
+    if (snapshot) {
+        config::export_snapshot(json_file, *this);
+    } else {
+        config::export_json(json_file, *this);
+    }
+}
+
+void crate::export_config_and_snapshot(const std::string json_file,
+                                       const std::string snapshot_file) {
+    xia_log(log::info) << "crate: export configuration and snapshot";
+    lock_guard guard(lock_);
+    config::export_config(json_file, snapshot_file, *this);
 }
 
 void crate::move_offlines() {
@@ -442,6 +1330,10 @@ void crate::add_module() {
     modules.push_back(std::make_unique<module::module>(backplane));
 }
 
+size_t crate::scan_devices() {
+    return module::device_scan(true);
+}
+
 void crate::check_slots() {
     using duplicate = std::pair<module::module_ptr, module::module_ptr>;
     using duplicates = std::vector<duplicate>;
@@ -21,6 +21,8 @@
  */
 
 #include <algorithm>
+#include <cmath>
+#include <cstdlib>
 #include <cstring>
 
 #include <pixie/error.hpp>
@@ -358,6 +360,137 @@ void afe_dbs::get_traces() {
     }
 }
 
+/*
+ * A channel's search for the OffsetDAC value that moves its baseline to the
+ * target. The baseline is linear in the DAC value between the ADC's rails.
+ * Each measurement bounds the DAC value to one side. The next DAC value is
+ * the secant step, Newton's method using the slope of the last two
+ * measurements off the rails, kept inside the bounds. If there is no secant
+ * the bounds are bisected and with one bound the DAC steps towards the
+ * target. The step doubles each time a rail is hit.
+ */
+struct offset_search {
+    static constexpr int dac_max = 65535;
+    static constexpr int probe_step = 200;
+    static constexpr int rail_step = (dac_max + 1) / 32;
+
+    const int target;
+    const int origin;
+    int dac;
+
+    /*
+     * The DAC values measured with the baseline below and above the
+     * target, -1 if not measured.
+     */
+    int below;
+    int above;
+
+    /*
+     * The last two measurements off the rails.
+     */
+    int samples;
+    int sample_dacs[2];
+    int sample_bls[2];
+
+    /*
+     * The sign of the baseline's slope to the DAC value. The slope is
+     * assumed to be positive until measured.
+     */
+    int slope;
+    bool slope_known;
+
+    int step;
+    bool done;
+
+    offset_search(int target, int dac);
+
+    int next(int baseline, bool railed);
+};
+
+constexpr int offset_search::dac_max;
+constexpr int offset_search::probe_step;
+constexpr int offset_search::rail_step;
+
+offset_search::offset_search(int target_, int dac_)
+    : target(target_), origin(dac_), dac(dac_), below(-1), above(-1), samples(0),
+      sample_dacs{0, 0}, sample_bls{0, 0}, slope(1), slope_known(false), step(rail_step),
+      done(false) {}
+
+int offset_search::next(int baseline, bool railed) {
+    if (baseline < target) {
+        below = dac;
+    } else {
+        above = dac;
+    }
+    const bool bounded = below >= 0 && above >= 0;
+    if (!railed) {
+        sample_dacs[0] = sample_dacs[1];
+        sample_bls[0] = sample_bls[1];
+        sample_dacs[1] = dac;
+        sample_bls[1] = baseline;
+        samples = std::min(samples + 1, 2);
+    }
+    const bool secant = samples == 2 && sample_dacs[0] != sample_dacs[1] &&
+        sample_bls[0] != sample_bls[1];
+    if (!slope_known) {
+        if (secant) {
+            const bool bl_down = sample_bls[1] < sample_bls[0];
+            const bool dac_down = sample_dacs[1] < sample_dacs[0];
+            slope = bl_down == dac_down ? 1 : -1;
+            slope_known = true;
+        } else if (bounded) {
+            slope = above > below ? 1 : -1;
+            slope_known = true;
+        }
+    }
+    if (bounded && std::abs(above - below) <= 1) {
+        done = true;
+        return dac;
+    }
+    int next_dac;
+    if (secant || bounded) {
+        double estimate = -1;
+        if (secant) {
+            estimate = sample_dacs[1] + double(target - sample_bls[1]) *
+                double(sample_dacs[1] - sample_dacs[0]) / double(sample_bls[1] - sample_bls[0]);
+        }
+        const bool inside = estimate > std::min(below, above) && estimate < std::max(below, above);
+        if (bounded && !inside) {
+            estimate = (double(below) + double(above)) / 2;
+        }
+        next_dac = int(std::lround(estimate));
+    } else {
+        const int direction = (baseline < target ? 1 : -1) * slope;
+        if (railed) {
+            next_dac = dac + (direction * step);
+            step *= 2;
+        } else {
+            next_dac = dac + (direction * probe_step);
+        }
+        /*
+         * A DAC limit has been reached without finding the target so the
+         * slope is the other way. Search from the start in the other
+         * direction.
+         */
+        if ((next_dac < 0 && dac == 0) || (next_dac > dac_max && dac == dac_max)) {
+            if (slope_known) {
+                done = true;
+                return dac;
+            }
+            slope = -slope;
+            slope_known = true;
+            step = rail_step;
+            next_dac = origin - (direction * step);
+        }
+    }
+    next_dac = std::max(0, std::min(dac_max, next_dac));
+    if (next_dac == dac) {
+        done = true;
+    }
+    dac = next_dac;
+    return dac;
+}
+
 void afe_dbs::adjust_offsets() {
     const std::string log_leader =
         pixie::module::module_label(module_, "fixture: afe_dbs");
@@ -371,16 +504,13 @@ void afe_dbs::adjust_offsets() {
      *  - The speed we can capture ADC traces for all channels
      *  - The settling time of the offset voltage circuit.
      *
-     * The offset procedure consists of 2 stages. The first moves the DAC a
-     * small amount measuring the baseline at each point and the least squares
-     * estimate. The second stage uses the least squares estimate to
-     * interpolate the target ADC baseline value to a DAC value. Repeat until
-     * the baseline converges to the target ADC value.
+     * All channels are searched together. Each run measures the baselines
+     * of the channels still searching, sets each channel's next DAC value
+     * and waits once for the DACs to settle. A channel is finished when its
+     * baseline is within the noise margin of the target and it is not
+     * measured again. See @ref offset_search.
      */
     const double voffset_start_voltage = 0.0;
-    const int dac_bits = 16;
-    const int dac_linear_fit_steps = 200;
-    const int dac_linear_fit_samples = 2;
     const int runs = 30;
 
     util::timepoint tp(true);
@@ -390,149 +520,109 @@ void afe_dbs::adjust_offsets() {
      */
     set_channel_voffset(module_, voffset_start_voltage, 1);
 
-    std::vector<double> bl_percents;
-    std::vector<std::pair<int, int>> offsetdacs;
-    std::vector<bool> has_offset_dacs;
+    std::vector<offset_search> searches;
+    pixie::channel::range searching;
 
     for (auto& channel : module_.channels) {
-        bl_percents.push_back(channel.baseline_percent());
-        offsetdacs.push_back(
-            std::make_pair(module_.read_var(param::channel_var::OffsetDAC, channel.number), 0));
+        const int adc_top_rail = 1 << channel.fixture->config.adc_bits;
+        const int adc_target = int(adc_top_rail * (channel.baseline_percent() / 100));
+        searches.emplace_back(
+            adc_target, int(module_.read_var(param::channel_var::OffsetDAC, channel.number)));
         bool has_offset_dac;
         channel.fixture->get("HAS_OFFSET_DAC", has_offset_dac);
-        has_offset_dacs.push_back(has_offset_dac);
+        if (has_offset_dac) {
+            searching.push_back(channel.number);
+        }
     }
 
-    using bl_linear_fit = util::linear_fit<int>;
-    std::vector<bl_linear_fit> bl_fits(module_.num_channels);
-    std::vector<bool> inverted(module_.num_channels, false);
-
     /*
      * Run while the baseline of a channel is outside the percent+noise margin
      */
-    bool run_again = true;
-    for (int run = 0; run_again && run < runs; ++run) {
-        log(log::debug) << log_leader << "adjust-offsets: run=" << run;
-        run_again = false;
+    int run = 0;
+    for (; !searching.empty() && run < runs; ++run) {
+        log(log::debug) << log_leader << "adjust-offsets: run=" << run
+                        << " channels=" << searching.size();
         baseline::channels baselines;
-        analyze_channel_baselines(baselines, 1);
-        for (size_t chan = 0; chan < module_.num_channels; ++chan) {
+        analyze_channel_baselines(baselines, searching, 1);
+        pixie::channel::range updated;
+        for (auto chan : searching) {
             auto& channel = module_.channels[chan];
-            if (has_offset_dacs[chan]) {
-                auto& bl = baselines[chan];
-                const int adc_bottom_rail = 0;
-                const int adc_top_rail = 1 << bl.adc_bits;
-                const int adc_rail_dac_step = adc_top_rail / (runs - 5);
-                const int adc_target =
-                    int((adc_top_rail - adc_bottom_rail) * (bl_percents[chan] / 100));
-                auto& offsetdac = offsetdacs[chan];
-                int dac = std::get<0>(offsetdac);
-                /*
-                 * The compare includes the noise margin that is set in the
-                 * baseline
-                 */
-                if (bl != adc_target) {
-                    /*
-                     * If a rail has been been hit do not update the linear fit
-                     * because the ADC value is unknown, ie we cannot see past
-                     * the voltage rail we have hit. Half the step distance and
-                     * try again.
-                     */
-                    log(log::debug) << log_leader
-                                    << "adjust-offsets: channel=" << chan
-                                    << " adc-target=" << adc_target
-                                    << " bl=" << bl.baseline
-                                    << " offset-dac=" << dac;
-                    bl_linear_fit& bl_fit = bl_fits[chan];
-                    bl_fit.update(bl.baseline, dac);
-                    if (bl_fit.count == 2) {
-                        const int delta_adc =
-                            std::get<0>(bl_fit.samples[1]) - std::get<0>(bl_fit.samples[0]);
-                        const int delta_dac =
-                            std::get<1>(bl_fit.samples[1]) - std::get<1>(bl_fit.samples[0]);
-                        if ((delta_adc < 0) != (delta_dac < 0) && !inverted[chan]) {
-                            inverted[chan] = true;
-                            log(log::info) << log_leader
-                                           << "adjust-offsets: channel=" << chan
-                                           << " input signal may be inverted";
-                        }
-                    }
-                    const char* action = "none";
-                    if (bl.baseline == 0 || bl.baseline == adc_top_rail) {
-                        action = "rail hit";
-                        dac = std::get<0>(offsetdac) +
-                            (adc_rail_dac_step * (inverted[chan] ? -1 : 1));
-                        log(log::debug) << log_leader
-                                        << "adjust-offsets: rail-hit: channel=" << chan
-                                        << " baseline=" << bl.baseline
-                                        << " od<0>=" << std::get<0>(offsetdac)
-                                        << " od<1>=" << std::get<1>(offsetdac)
-                                        << " dac=" << dac;
-
-                    } else {
-                        if (bl_fit.count < dac_linear_fit_samples) {
-                            action = "linear-fit";
-                            const int steps = dac_linear_fit_steps * (inverted[chan] ? 1 : -1);
-                            if (adc_target > bl.baseline) {
-                                dac += steps;
-                            } else {
-                                dac -= steps;
-                            }
-                        } else {
-                            action = "interpolate";
-                            bl_fit.calc();
-                            log(log::debug) << log_leader
-                                            << "adjust-offsets: update: channel=" << chan
-                                            << " " << bl_fit.k << "X + " << bl_fit.c;
-                            dac = bl_fit.y(adc_target);
-                        }
-                    }
-                    dac = std::max(0, dac);
-                    dac = std::min(1 << dac_bits, dac);
-                    log(log::debug) << log_leader
-                                    << "adjust-offsets: update: channel=" << chan
-                                    << " action=" << action
-                                    << ": adc-error=" << adc_target - bl.baseline
-                                    << " dac-error=" << std::get<0>(offsetdac) - dac
-                                    << " dac=" << dac;
-                    offsetdacs[chan] = std::make_pair(dac, std::get<0>(offsetdac));
-                    channel.fixture->set_dac(dac);
-                    run_again = true;
-                }
+            auto& search = searches[chan];
+            auto& bl = baselines[chan];
+            /*
+             * The compare includes the noise margin that is set in the
+             * baseline
+             */
+            if (bl == search.target) {
+                continue;
+            }
+            const int adc_top_rail = (1 << bl.adc_bits) - 1;
+            const bool railed = bl.baseline <= 0 || bl.baseline >= adc_top_rail;
+            const int last_dac = search.dac;
+            const bool slope_known = search.slope_known;
+            const int dac = search.next(bl.baseline, railed);
+            if (!slope_known && search.slope_known && search.slope < 0) {
+                log(log::info) << log_leader
+                               << "adjust-offsets: channel=" << chan
+                               << " input signal may be inverted";
             }
+            log(log::debug) << log_leader
+                            << "adjust-offsets: update: channel=" << chan
+                            << " adc-target=" << search.target
+                            << " bl=" << bl.baseline
+                            << " railed=" << std::boolalpha << railed
+                            << " adc-error=" << search.target - bl.baseline
+                            << " dac-error=" << last_dac - dac
+                            << " dac=" << dac;
+            if (search.done) {
+                log(log::warning) << log_leader
+                                  << "adjust-offsets: channel=" << chan
+                                  << " target not reached: adc-target=" << search.target
+                                  << " bl=" << bl.baseline << " dac=" << dac;
+                continue;
+            }
+            channel.fixture->set_dac(dac);
+            updated.push_back(chan);
         }
-        if (run_again) {
+        if (!updated.empty()) {
             /*
              * Wait until the signal settles after the update.
              */
             wait_dac_settle_period(module_);
         }
+        searching = updated;
     }
     for (size_t chan = 0; chan < module_.num_channels; ++chan) {
-        module_.write_var(
-            param::channel_var::OffsetDAC, std::get<0>(offsetdacs[chan]), chan);
+        module_.write_var(param::channel_var::OffsetDAC, searches[chan].dac, chan);
     }
     log(log::debug) << log_leader
-                    << "adjust-offsets: duration=" << tp;
+                    << "adjust-offsets: runs=" << run << " duration=" << tp;
 }
 
 void afe_dbs::analyze_channel_baselines(
     baseline::channels& baselines, const int traces) {
+    pixie::channel::range channels(module_.num_channels);
+    pixie::channel::range_set(channels);
+    analyze_channel_baselines(baselines, channels, traces);
+}
+
+void afe_dbs::analyze_channel_baselines(
+    baseline::channels& baselines, const pixie::channel::range& channels, const int traces) {
     baselines.resize(
         module_.num_channels,
         baseline::channel(baseline_noise_bins, baseline_noise_margin));
-    for (auto& channel : module_.channels) {
-        baselines[channel.number].start(channel.number, channel.fixture->config.adc_bits);
+    for (auto chan : channels) {
+        baselines[chan].start(chan, module_.channels[chan].fixture->config.adc_bits);
     }
     for (int t = 0; t < traces; ++t) {
-        module_.get_traces();
-        for (auto& channel : module_.channels) {
-            xia::pixie::hw::adc_trace trace;
-            module_.read_adc(channel.number, trace, false);
-            baselines[channel.number].update(trace);
+        hw::adc_traces adc_traces;
+        module_.read_adcs(channels, adc_traces);
+        for (size_t chan = 0; chan < channels.size(); ++chan) {
+            baselines[channels[chan]].update(adc_traces[chan]);
         }
     }
-    for (auto& bl : baselines) {
+    for (auto chan : channels) {
+        auto& bl = baselines[chan];
         bl.end();
         log(log::debug) << pixie::module::module_label(module_, "afe-dbs: analyze-baselines")
                         << "channel=" << bl.number
@@ -76,11 +76,13 @@ namespace pixie {
 namespace hw {
 namespace dsp {
 dsp::dsp(module::module& module_, bool trace_)
-    : module(module_), online(false), trace(trace_), hbr(module_, false) {}
+    : module(module_), online(false), trace(trace_), load_chunk(default_load_chunk),
+      hbr(module_, false) {}
 
 dsp& dsp::operator=(dsp&& d) {
     trace = d.trace;
     online = d.online;
+    load_chunk = d.load_chunk;
     d.trace = false;
     d.online = false;
     return *this;
@@ -91,6 +93,7 @@ void dsp::boot(const firmware::image& image, int retries) {
                        << " retries=" << retries;
 
     bool running = false;
+    size_t chunk = load_chunk;
 
     module::module::bus_guard guard(module);
 
@@ -172,7 +175,7 @@ void dsp::boot(const firmware::image& image, int retries) {
                     case ZERO_PM48:
                     case ZERO_DM64:
                     case ZERO_PM64:
-                        section_load(reader, 0);
+                        section_load(reader, 0, chunk);
                         wait(2000);
                         break;
                     case INIT_DM16:
@@ -180,20 +183,14 @@ void dsp::boot(const firmware::image& image, int retries) {
                     case INIT_DM32:
                     case INIT_PM32:
                     case INIT_PM48:
-                        section_load(reader, sizeof(load_value_type));
+                        section_load(reader, sizeof(load_value_type), chunk);
                         break;
                     case INIT_DM64:
                     case INIT_PM64:
-                        section_load(reader, 2 * sizeof(load_value_type));
+                        section_load(reader, 2 * sizeof(load_value_type), chunk);
                         break;
                     case FINAL_INIT:
-                        hbr.request();
-                        for (size_t i = 0; i < 258; ++i) {
-                            bus_write(hw::device::WRT_DSP_MMA, reader.get());
-                            bus_write(hw::device::WRT_DSP_MMA, reader.get());
-                            bus_write(hw::device::WRT_DSP_MMA, reader.get());
-                        }
-                        hbr.release();
+                        instructions_load(reader, 258, 258);
                         break;
                     default: {
                         std::ostringstream oss;
@@ -231,6 +228,10 @@ void dsp::boot(const firmware::image& image, int retries) {
             }
             xia_log(log::error) << "dsp [slot " << module.slot << "] retries: " << retries << ": "
                                 << e.what();
+            /*
+             * Retry with the host bus requested for each instruction.
+             */
+            chunk = 0;
         }
     }
 
@@ -253,30 +254,31 @@ bool dsp::init_done() {
     return value == 1;
 }
 
-void dsp::section_load(firmware::reader& reader, const size_t wordsize) {
-    hbr.request();
-    bus_write(hw::device::WRT_DSP_MMA, reader.get());
-    bus_write(hw::device::WRT_DSP_MMA, reader.get());
-    bus_write(hw::device::WRT_DSP_MMA, reader.get());
-    hbr.release();
+void dsp::section_load(firmware::reader& reader, const size_t wordsize, const size_t chunk) {
+    instructions_load(reader, 1, chunk);
     size_t wordcount = reader.peek();
-    hbr.request();
-    bus_write(hw::device::WRT_DSP_MMA, reader.get());
-    bus_write(hw::device::WRT_DSP_MMA, reader.get());
-    bus_write(hw::device::WRT_DSP_MMA, reader.get());
-    hbr.release();
+    instructions_load(reader, 1, chunk);
     if (wordsize != 0) {
         if ((reader.remaining()) < (wordcount * 3 * wordsize)) {
             throw error(error::code::device_image_failure, make_what("image section too small"));
         }
         wordcount *= wordsize / sizeof(load_value_type);
-        for (size_t i = 0; i < wordcount; ++i) {
-            hbr.request();
+        instructions_load(reader, wordcount, chunk);
+    }
+}
+
+void dsp::instructions_load(firmware::reader& reader, size_t count, const size_t chunk) {
+    const size_t per_request = chunk == 0 ? 1 : chunk;
+    while (count > 0) {
+        const size_t instructions = count < per_request ? count : per_request;
+        hbr.request();
+        for (size_t i = 0; i < instructions; ++i) {
             bus_write(hw::device::WRT_DSP_MMA, reader.get());
             bus_write(hw::device::WRT_DSP_MMA, reader.get());
             bus_write(hw::device::WRT_DSP_MMA, reader.get());
-            hbr.release();
         }
+        hbr.release();
+        count -= instructions;
     }
 }
 
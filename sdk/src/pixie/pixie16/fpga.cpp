@@ -24,6 +24,7 @@
 #include <iostream>
 
 #include <pixie/log.hpp>
+#include <pixie/util.hpp>
 
 #include <pixie/pixie16/fpga.hpp>
 #include <pixie/pixie16/module.hpp>
@@ -69,7 +70,6 @@ void control::load(const firmware::image& image, int& backoff, int retries) {
         uint32_t data;
 
         bool cleared = false;
-        int timeout_msec = 25;
 
         while (!cleared) {
             xia_log(log::debug) << "fpga-" << name << " [slot " << module.slot
@@ -96,29 +96,21 @@ void control::load(const firmware::image& image, int& backoff, int retries) {
             data |= load_ctrl.set;
             bus_write(reg.CTRLCS, data, backoff);
 
-            while (true) {
-                wait(1000);
-                data = bus_read(reg.RDCS);
-                if ((data & clear_ctrl.done) == clear_ctrl.done) {
-                    /*
-                     * Clear
-                     */
-                    cleared = true;
-                    break;
-                }
-                --timeout_msec;
-                if (timeout_msec <= 0) {
-                    --retries;
-                    if (retries <= 0) {
-                        throw error(
-                            error::code::device_load_failure, make_what("clear failure"));
-                    }
-                    backoff += backoff_step;
-                    xia_log(log::debug) << "fpga-" << name
-                                        << " [slot " << module.slot
-                                        << "] retry: backoff=" << backoff;
-                    break;
+            if (poll(clear_ctrl.done, timeout_usecs)) {
+                /*
+                 * Clear
+                 */
+                cleared = true;
+            } else {
+                --retries;
+                if (retries <= 0) {
+                    throw error(
+                        error::code::device_load_failure, make_what("clear failure"));
                 }
+                backoff += backoff_step;
+                xia_log(log::debug) << "fpga-" << name
+                                    << " [slot " << module.slot
+                                    << "] retry: backoff=" << backoff;
             }
         }
 
@@ -142,37 +134,40 @@ void control::load(const firmware::image& image, int& backoff, int retries) {
         xia_log(log::debug) << "fpga-" << name
                             << " [slot " << module.slot << "] waiting for done";
 
-        timeout_msec = 25;
-
-        while (true) {
-            wait(1000);
-            auto is_done = done();
-            if (is_done) {
-                /*
-                 * Programmed
-                 */
-                programmed = true;
-                break;
-            }
-            --timeout_msec;
-            if (timeout_msec <= 0) {
-                --retries;
-                if (retries <= 0) {
-                    throw error(
-                        error::code::device_load_failure, make_what("programming failure"));
-                }
-                backoff += backoff_step;
-                xia_log(log::debug) << "fpga-" << name
-                                    << " [slot " << module.slot
-                                    << "] retry: backoff=" << backoff;
-                break;
+        if (poll(load_ctrl.done, timeout_usecs)) {
+            /*
+             * Programmed
+             */
+            programmed = true;
+        } else {
+            --retries;
+            if (retries <= 0) {
+                throw error(
+                    error::code::device_load_failure, make_what("programming failure"));
             }
+            backoff += backoff_step;
+            xia_log(log::debug) << "fpga-" << name
+                                << " [slot " << module.slot
+                                << "] retry: backoff=" << backoff;
         }
     }
 
     xia_log(log::debug) << "fpga-" << name << " [slot " << module.slot << "] done";
 }
 
+bool control::poll(const uint32_t mask, const size_t timeout) {
+    util::timepoint period(true);
+    while (true) {
+        wait(poll_usecs);
+        if ((bus_read(reg.RDCS) & mask) == mask) {
+            return true;
+        }
+        if (period.usecs() >= timeout) {
+            return false;
+        }
+    }
+}
+
 bool control::done() {
     return (bus_read(reg.RDCS) & load_ctrl.done) == load_ctrl.done;
 }
@@ -0,0 +1,205 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2022 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file histogram.cpp
+ * @brief Implements snapshots of a module's histograms taken during a run.
+ */
+
+#include <algorithm>
+
+#include <pixie/error.hpp>
+#include <pixie/log.hpp>
+
+#include <pixie/pixie16/histogram.hpp>
+
+namespace xia {
+namespace pixie {
+namespace histogram {
+typedef pixie::error::error error;
+
+delta::delta() : channel(0), reset(false), counts(0) {}
+
+update::update() : sequence(0), period(0), length(0), snapshot(nullptr) {}
+
+void make_delta(hw::word_ptr previous, hw::word_ptr current, size_t length, format fmt,
+                delta& change) {
+    change.reset = false;
+    change.counts = 0;
+    change.dense.clear();
+    change.sparse.clear();
+    for (size_t bin = 0; bin < length; ++bin) {
+        if (current[bin] < previous[bin]) {
+            change.reset = true;
+            break;
+        }
+    }
+    if (fmt == format::dense) {
+        change.dense.resize(length);
+    }
+    for (size_t bin = 0; bin < length; ++bin) {
+        hw::word count = change.reset ? current[bin] : current[bin] - previous[bin];
+        change.counts += count;
+        if (fmt == format::dense) {
+            change.dense[bin] = count;
+        } else if (count != 0) {
+            change.sparse.emplace_back(hw::word(bin), count);
+        }
+    }
+}
+
+snapshots::snapshots(module::module& module, const channel::range& channels_, size_t length_)
+    : channels(channels_),
+      length(length_ != 0 || channels_.empty() ?
+                 length_ :
+                 module.channels.at(channels_[0]).fixture->config.max_histogram_length),
+      next_id(1), period_wake(period_lock), period_msecs(0), running_(false), sequence_(0),
+      errors_(0) {
+    read = [&module, this](hw::words& values) {
+        module.read_histograms(channels, values, length);
+    };
+}
+
+snapshots::snapshots(const channel::range& channels_, size_t length_, reader read_)
+    : channels(channels_), length(length_), read(read_), next_id(1), period_wake(period_lock),
+      period_msecs(0), running_(false), sequence_(0), errors_(0) {}
+
+snapshots::~snapshots() {
+    stop();
+}
+
+snapshots::subscriber_id snapshots::subscribe(subscriber sub, format fmt) {
+    sync::variable::lock_guard guard(lock);
+    auto id = next_id++;
+    subs[id] = {sub, fmt};
+    return id;
+}
+
+void snapshots::unsubscribe(subscriber_id id) {
+    sync::variable::lock_guard guard(lock);
+    subs.erase(id);
+}
+
+void snapshots::start(size_t period_msecs_) {
+    if (running_.load()) {
+        throw error(error::code::module_invalid_operation,
+                    "histogram snapshots: already running");
+    }
+    if (period_msecs_ == 0) {
+        throw error(error::code::invalid_value, "histogram snapshots: invalid period");
+    }
+    period_msecs = period_msecs_;
+    running_ = true;
+    thread = std::thread(&snapshots::worker, this);
+}
+
+void snapshots::stop() {
+    running_ = false;
+    {
+        sync::variable::lock_guard guard(period_lock);
+        period_wake.notify();
+    }
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void snapshots::poll() {
+    /*
+     * Read the snapshot without the lock held so the subscribers and
+     * copies are not held by the hardware read.
+     */
+    hw::words values;
+    read(values);
+    if (values.size() != channels.size() * length) {
+        throw error(error::code::internal_failure,
+                    "histogram snapshots: invalid snapshot size: " +
+                        std::to_string(values.size()));
+    }
+    sync::variable::lock_guard guard(lock);
+    if (current.size() != values.size()) {
+        current.assign(values.size(), 0);
+    }
+    previous.swap(current);
+    current.swap(values);
+    update changes;
+    changes.sequence = ++sequence_;
+    changes.period = since.running() ? double(since.usecs()) / 1e6 : 0;
+    changes.length = length;
+    changes.snapshot = &current;
+    since.restart();
+    /*
+     * Compute the changes in a format once for all subscribers of the
+     * format.
+     */
+    std::map<format, deltas> formatted;
+    for (auto& s : subs) {
+        auto fd = formatted.find(s.second.fmt);
+        if (fd == formatted.end()) {
+            deltas& ds = formatted[s.second.fmt];
+            ds.resize(channels.size());
+            for (size_t c = 0; c < channels.size(); ++c) {
+                ds[c].channel = channels[c];
+                make_delta(previous.data() + c * length, current.data() + c * length, length,
+                           s.second.fmt, ds[c]);
+            }
+            fd = formatted.find(s.second.fmt);
+        }
+        changes.changes.swap(fd->second);
+        s.second.sub(changes);
+        changes.changes.swap(fd->second);
+    }
+}
+
+void snapshots::reset() {
+    sync::variable::lock_guard guard(lock);
+    previous.clear();
+    current.clear();
+    since.reset();
+}
+
+void snapshots::snapshot(hw::words& values) {
+    sync::variable::lock_guard guard(lock);
+    values = current;
+}
+
+void snapshots::worker() {
+    xia_log(log::debug) << "histogram snapshots: thread started: period=" << period_msecs
+                        << "msecs";
+    while (running_.load()) {
+        {
+            sync::variable::lock_guard guard(period_lock);
+            if (!running_.load()) {
+                break;
+            }
+            period_wake.wait(period_msecs * 1000);
+        }
+        if (!running_.load()) {
+            break;
+        }
+        try {
+            poll();
+        } catch (std::exception& e) {
+            ++errors_;
+            xia_log(log::error) << "histogram snapshots: " << e.what();
+        }
+    }
+    xia_log(log::debug) << "histogram snapshots: thread stopped";
+}
+}  // namespace histogram
+}  // namespace pixie
+}  // namespace xia
@@ -98,14 +98,55 @@ std::string get_module_fixture_label(const module_fixture fixture_id) {
                 "invalid fixture id: " + std::to_string(static_cast<int>(fixture_id)));
 }
 
-void wait(size_t microseconds) {
-    if (microseconds < 100) {
-        volatile size_t count = 10 * microseconds;
-        while (count > 0) {
-            --count;
+/*
+ * Measure how long a short sleep oversleeps. The largest of a few sleeps
+ * is used so the sleep part of a wait does not overrun the deadline.
+ */
+static size_t measure_sleep_overshoot() {
+    using clock = std::chrono::steady_clock;
+    const auto request = std::chrono::microseconds(50);
+    clock::duration overshoot = clock::duration::zero();
+    for (int s = 0; s < 5; ++s) {
+        auto start = clock::now();
+        std::this_thread::sleep_for(request);
+        auto slept = clock::now() - start - request;
+        if (slept > overshoot) {
+            overshoot = slept;
+        }
+    }
+    return size_t(std::chrono::duration_cast<std::chrono::microseconds>(overshoot).count());
+}
+
+size_t wait_sleep_overshoot() {
+    static const size_t overshoot = measure_sleep_overshoot();
+    return overshoot;
+}
+
+void wait_until(const std::chrono::steady_clock::time_point deadline) {
+    using clock = std::chrono::steady_clock;
+    /*
+     * Sleep while the deadline is more than the overshoot and a margin
+     * away, then spin. Spin by yielding when the wait is still long enough
+     * for another thread to run.
+     */
+    const auto sleep_margin = std::chrono::microseconds(wait_sleep_overshoot() + 20);
+    const auto yield_margin = std::chrono::microseconds(20);
+    auto now = clock::now();
+    if (deadline - now > sleep_margin) {
+        std::this_thread::sleep_for(deadline - now - sleep_margin);
+        now = clock::now();
+    }
+    while (now < deadline) {
+        if (deadline - now > yield_margin) {
+            std::this_thread::yield();
         }
-    } else {
-        std::this_thread::sleep_for(std::chrono::microseconds(microseconds));
+        now = clock::now();
+    }
+}
+
+void wait(size_t microseconds) {
+    if (microseconds != 0) {
+        wait_until(std::chrono::steady_clock::now() + std::chrono::microseconds(microseconds));
     }
 }
 };  // namespace hw
@@ -20,6 +20,7 @@
  * @brief Implements I2C bit bash data structures and functions
  */
 
+#include <cmath>
 #include <iomanip>
 #include <iostream>
 
@@ -37,9 +38,18 @@ bitbash::bitbash(module::module& module_, int reg_, size_t bus_freq_, uint32_t S
     : module(module_), reg(reg_), bus_freq(bus_freq_), SDA(SDA_), SCL(SCL_), CTRL(CTRL_),
       trace(trace_), access_backoff(0), access_multiplier(1), access_multiplier_limit(4) {
     /*
-     * Maximum clock freq is 200KHz
+     * Hold each SCL level for half the bus clock period. The read period
+     * is measured once when the module is opened. The bus write that sets
+     * a level is an access so it counts towards the period.
      */
-    access_backoff = static_cast<size_t>(((1.0 / bus_freq) / module.i2c_read_period)) + 2;
+    const double half_period_usecs = 1000000.0 / (2.0 * static_cast<double>(bus_freq));
+    const double accesses = std::ceil(half_period_usecs / module.i2c_read_period);
+    access_backoff = accesses > 2 ? static_cast<size_t>(accesses) - 1 : 1;
+    if (trace) {
+        xia_log(log::debug) << "i2c-bb: bus-freq=" << bus_freq
+                            << " read-period=" << module.i2c_read_period
+                            << "usecs access-backoff=" << access_backoff;
+    }
 }
 
 bitbash::~bitbash() {
@@ -123,19 +133,24 @@ void bitbash::write(uint8_t data) {
         xia_log(log::info) << "i2c-bb: write " << std::hex << (int) data;
     }
 
-    uint32_t data_bit = 0;
+    /*
+     * Batch the byte's bus states and write them as one sequence.
+     */
+    uint8_t states[(8 * 3) + 1];
+    size_t count = 0;
+    uint8_t data_bit = 0;
 
     for (int bit = 7; bit >= 0; bit--) {
         /*
-         * SDA = 0; SCL = 0; CTRL = 1
+         * SDA = data_bit; SCL = 0; CTRL = 1
          */
-        bus_write(CTRL | data_bit);
+        states[count++] = static_cast<uint8_t>(CTRL | data_bit);
 
         /*
          * Get the bit to send, MSB to LSB.
          */
         if ((data & (1 << bit)) != 0) {
-            data_bit = SDA;
+            data_bit = static_cast<uint8_t>(SDA);
         } else {
             data_bit = 0;
         }
@@ -143,18 +158,20 @@ void bitbash::write(uint8_t data) {
         /*
          * SDA = data_bit; SCL = 0; CTRL = 1
          */
-        bus_write(CTRL | data_bit);
+        states[count++] = static_cast<uint8_t>(CTRL | data_bit);
 
         /*
          * SDA = data_bit; SCL = 1; CTRL = 1
          */
-        bus_write(CTRL | SCL | data_bit);
+        states[count++] = static_cast<uint8_t>(CTRL | SCL | data_bit);
     }
 
     /*
      * SDA = data_bit; SCL = 0; CTRL = 0
      */
-    bus_write(data_bit);
+    states[count++] = data_bit;
+
+    bus_sequence(states, count);
 }
 
 uint8_t bitbash::read() {
@@ -169,10 +186,12 @@ uint8_t bitbash::read() {
         /*
          * SDA = 0; SCL = 1; CTRL = 0
          */
-        bus_write(SCL);
+        bus_set(SCL);
+        bus_wait(1);
 
         /*
-         * Read the bit, MSB to LSB.
+         * Read the bit, MSB to LSB. The read is the last access of the
+         * SCL high period.
          */
         data_bit = bus_read() & SDA;
         if (data_bit != 0) {
@@ -202,7 +221,8 @@ bool bitbash::get_ack() {
     /*
      * SDA = 0; SCL = 1; CTRL = 0
      */
-    bus_write(SCL);
+    bus_set(SCL);
+    bus_wait(1);
 
     /*
      * Read SDA
@@ -265,16 +285,32 @@ void bitbash::send_nack() {
 }
 
 void bitbash::bus_write(uint8_t data) {
-    module.write_word(reg, static_cast<word>(data));
+    bus_set(data);
     bus_wait();
 }
 
+void bitbash::bus_set(uint8_t data) {
+    module.write_word(reg, static_cast<word>(data));
+}
+
 uint8_t bitbash::bus_read() {
     return static_cast<uint8_t>(module.read_word(reg));
 }
 
-void bitbash::bus_wait() {
+void bitbash::bus_sequence(const uint8_t* states, size_t count) {
+    const size_t polls = access_backoff * access_multiplier;
+    for (size_t s = 0; s < count; ++s) {
+        bus_set(states[s]);
+        for (size_t p = 0; p < polls; ++p) {
+            volatile uint8_t tmp = bus_read();
+            (void) tmp;
+        }
+    }
+}
+
+void bitbash::bus_wait(size_t accesses) {
     size_t polls = access_backoff * access_multiplier;
+    polls = polls > accesses ? polls - accesses : 0;
     while (polls-- > 0) {
         volatile uint8_t tmp = bus_read();
         (void) tmp;
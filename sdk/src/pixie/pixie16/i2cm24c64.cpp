@@ -33,6 +33,9 @@ i2cm24c64::i2cm24c64(module::module& module, int reg, uint32_t SDA, uint32_t SCL
 void i2cm24c64::read(int address, size_t length, eeprom::contents& data) {
     module::module::bus_guard guard(module);
     data.clear();
+    if (length == 0) {
+        return;
+    }
     data.reserve(length);
 
     start();
@@ -41,6 +44,10 @@ void i2cm24c64::read(int address, size_t length, eeprom::contents& data) {
     write_ack(address >> 8, "i2cm24c64::sequential_read: no ACK after addr (MSB)");
     write_ack(address & 0xff, "i2cm24c64::sequential_read: no ACK after addr (LSB)");
 
+    /*
+     * A sequential read increments the address after each byte so the
+     * block is read in one transaction.
+     */
     start();
     write_ack(0xA1, "i2cm24c64::sequential_read: no ACK after DevSel");
     for (size_t k = 0; k < length - 1; k++) {
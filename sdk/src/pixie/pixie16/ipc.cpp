@@ -0,0 +1,660 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file ipc.cpp
+ * @brief Implements a crate server that serves a resident crate to local processes.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <pixie/error.hpp>
+#include <pixie/log.hpp>
+
+#include <pixie/pixie16/ipc.hpp>
+
+#if !defined(_WIN64) && !defined(_WIN32)
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace xia {
+namespace pixie {
+namespace ipc {
+typedef pixie::error::error error;
+
+/*
+ * The size of the ring name in the hello response's payload.
+ */
+static constexpr size_t ring_name_bytes = 64;
+
+/*
+ * The time a client has to send the rest of a request.
+ */
+static constexpr size_t request_timeout_msecs = 1000;
+
+config::config() : ring_name("/pixie-sdk-crate"), max_clients(16), poll_msecs(10) {}
+
+server::client::client() : fd(-1), req(), received(0) {}
+
+#if defined(_WIN64) || defined(_WIN32)
+server::server(crate::crate& crate, const config& cfg_)
+    : cfg(cfg_), crate_(crate), listen_fd(-1), running_(false), clients_(0), requests_(0),
+      errors_(0), published_(0) {
+    throw error(error::code::not_supported, "ipc: not supported on Windows");
+}
+
+server::~server() {}
+
+void server::start() {}
+
+void server::stop() {}
+
+size_t server::poll(size_t) {
+    return 0;
+}
+
+client::client(const std::string&) : fd(-1) {
+    throw error(error::code::not_supported, "ipc: not supported on Windows");
+}
+
+client::~client() {}
+
+double client::read(int, const std::string&, int) {
+    return 0;
+}
+
+void client::write(int, const std::string&, double, int) {}
+
+void client::start_listmode(int, hw::run::run_mode) {}
+
+void client::start_histograms(int, hw::run::run_mode) {}
+
+void client::end_run(int) {}
+
+bool client::run_active(int) {
+    return false;
+}
+
+void client::read_histogram(int, int, hw::words&) {}
+
+std::unique_ptr<buffer::shm::subscriber> client::subscribe() const {
+    return {};
+}
+#else
+static std::string errno_text() {
+    return std::strerror(errno);
+}
+
+static bool send_all(int fd, const void* data, size_t size) {
+    auto bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        const ssize_t sent = ::send(fd, bytes, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        bytes += sent;
+        size -= size_t(sent);
+    }
+    return true;
+}
+
+static bool recv_all(int fd, void* data, size_t size) {
+    auto bytes = static_cast<char*>(data);
+    while (size > 0) {
+        const ssize_t got = ::recv(fd, bytes, size, 0);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        bytes += got;
+        size -= size_t(got);
+    }
+    return true;
+}
+
+static sockaddr_un socket_address(const std::string& path) {
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        throw error(error::code::invalid_value, "ipc: invalid socket path: " + path);
+    }
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    return addr;
+}
+
+static std::string request_name(const request& req) {
+    return std::string(req.name, ::strnlen(req.name, sizeof(req.name)));
+}
+
+server::server(crate::crate& crate, const config& cfg_)
+    : cfg(cfg_), crate_(crate), listen_fd(-1), running_(false), clients_(0), requests_(0),
+      errors_(0), published_(0) {
+    crate_.ready();
+    modules = crate_.modules;
+    for (auto& module : modules) {
+        srcs.push_back(recorder::module_source(*module));
+    }
+    pending.resize(srcs.size());
+    if (cfg.ring_name.size() >= ring_name_bytes) {
+        throw error(error::code::invalid_value, "ipc: ring name too long: " + cfg.ring_name);
+    }
+    try {
+        listen();
+        ring.reset(new buffer::shm::publisher(cfg.ring_name, cfg.ring));
+    } catch (...) {
+        if (listen_fd >= 0) {
+            ::close(listen_fd);
+            ::unlink(cfg.socket.c_str());
+            listen_fd = -1;
+        }
+        throw;
+    }
+    xia_log(log::info) << "ipc: socket=" << cfg.socket << " ring=" << cfg.ring_name
+                       << " modules=" << modules.size();
+}
+
+server::~server() {
+    try {
+        stop();
+    } catch (std::exception& e) {
+        xia_log(log::error) << e.what();
+    }
+    sync::variable::lock_guard guard(lock);
+    for (auto& cl : connections) {
+        ::close(cl.fd);
+    }
+    connections.clear();
+    if (listen_fd >= 0) {
+        ::close(listen_fd);
+        ::unlink(cfg.socket.c_str());
+    }
+}
+
+void server::listen() {
+    auto addr = socket_address(cfg.socket);
+    listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        throw error(error::code::device_initialize_failure, "ipc: socket: " + errno_text());
+    }
+    /*
+     * A socket file left by a server that exited is removed. A server
+     * still listening on it is an error.
+     */
+    if (::connect(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+        ::close(listen_fd);
+        listen_fd = -1;
+        throw error(error::code::device_initialize_failure,
+                    "ipc: server already running: " + cfg.socket);
+    }
+    ::close(listen_fd);
+    ::unlink(cfg.socket.c_str());
+    listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        throw error(error::code::device_initialize_failure, "ipc: socket: " + errno_text());
+    }
+    if (::bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        throw error(error::code::device_initialize_failure,
+                    "ipc: bind: " + cfg.socket + ": " + errno_text());
+    }
+    if (::listen(listen_fd, static_cast<int>(cfg.max_clients)) < 0) {
+        throw error(error::code::device_initialize_failure, "ipc: listen: " + errno_text());
+    }
+    ::fcntl(listen_fd, F_SETFL, ::fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+}
+
+void server::start() {
+    if (running_.load()) {
+        throw error(error::code::module_invalid_operation, "ipc: already running");
+    }
+    running_ = true;
+    thread = std::thread(&server::worker, this);
+}
+
+void server::stop() {
+    running_ = false;
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void server::accept() {
+    while (true) {
+        const int fd = ::accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                ++errors_;
+                xia_log(log::warning) << "ipc: accept: " << errno_text();
+            }
+            return;
+        }
+        if (connections.size() >= cfg.max_clients) {
+            xia_log(log::warning) << "ipc: too many clients";
+            ::close(fd);
+            continue;
+        }
+        timeval timeout = {};
+        timeout.tv_sec = static_cast<time_t>(request_timeout_msecs / 1000);
+        timeout.tv_usec = static_cast<suseconds_t>((request_timeout_msecs % 1000) * 1000);
+        ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        client cl;
+        cl.fd = fd;
+        connections.push_back(cl);
+        clients_ = connections.size();
+        xia_log(log::info) << "ipc: client connected: fd=" << fd;
+    }
+}
+
+size_t server::poll(size_t wait_msecs) {
+    sync::variable::lock_guard guard(lock);
+    std::vector<pollfd> fds(connections.size() + 1);
+    fds[0].fd = listen_fd;
+    fds[0].events = POLLIN;
+    for (size_t c = 0; c < connections.size(); ++c) {
+        fds[c + 1].fd = connections[c].fd;
+        fds[c + 1].events = POLLIN;
+    }
+    size_t answered = 0;
+    if (::poll(fds.data(), fds.size(), static_cast<int>(wait_msecs)) > 0) {
+        for (size_t c = 0; c < connections.size(); ++c) {
+            const auto events = fds[c + 1].revents;
+            if (events == 0) {
+                continue;
+            }
+            bool done = false;
+            if ((events & POLLIN) != 0 && answer(connections[c], done)) {
+                if (done) {
+                    ++answered;
+                }
+                continue;
+            }
+            if ((events & (POLLIN | POLLHUP | POLLERR)) != 0) {
+                xia_log(log::info) << "ipc: client disconnected: fd=" << connections[c].fd;
+                ::close(connections[c].fd);
+                connections[c].fd = -1;
+            }
+        }
+        connections.erase(std::remove_if(connections.begin(), connections.end(),
+                                         [](const client& cl) { return cl.fd < 0; }),
+                          connections.end());
+        if ((fds[0].revents & POLLIN) != 0) {
+            accept();
+        }
+        clients_ = connections.size();
+    }
+    publish();
+    return answered;
+}
+
+/*
+ * Answer a client's request. The request is read without blocking so a
+ * slow client does not stall the other clients or the publishing. Returns
+ * false if the client is to be closed.
+ */
+bool server::answer(client& cl, bool& answered) {
+    answered = false;
+    while (cl.received < sizeof(cl.req)) {
+        const ssize_t got = ::recv(cl.fd, reinterpret_cast<char*>(&cl.req) + cl.received,
+                                   sizeof(cl.req) - cl.received, MSG_DONTWAIT);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        cl.received += size_t(got);
+    }
+    const request req = cl.req;
+    cl.received = 0;
+    answered = true;
+    if (req.magic != request_magic) {
+        ++errors_;
+        xia_log(log::warning) << "ipc: invalid request";
+        return false;
+    }
+    response resp = {};
+    resp.magic = response_magic;
+    std::vector<uint8_t> payload;
+    try {
+        resp.value = handle(req, payload);
+    } catch (pixie::error::error& e) {
+        resp.result = static_cast<int32_t>(e.type);
+        const std::string what = e.what();
+        payload.assign(what.begin(), what.end());
+    } catch (std::exception& e) {
+        resp.result = static_cast<int32_t>(error::code::unknown_error);
+        const std::string what = e.what();
+        payload.assign(what.begin(), what.end());
+    }
+    ++requests_;
+    if (resp.result != 0) {
+        ++errors_;
+    }
+    resp.bytes = payload.size();
+    return send_all(cl.fd, &resp, sizeof(resp)) &&
+        send_all(cl.fd, payload.data(), payload.size());
+}
+
+double server::handle(const request& req, std::vector<uint8_t>& payload) {
+    using hw::run::run_mode;
+    const auto name = request_name(req);
+    const bool all = req.module < 0;
+    const auto mode = static_cast<run_mode>(req.mode);
+    xia_log(log::debug) << "ipc: request: command=" << int(req.cmd) << " module=" << req.module
+                        << " channel=" << req.channel << " name=" << name;
+    if (req.cmd == command::hello) {
+        payload.resize(ring_name_bytes + modules.size() * sizeof(module_info), 0);
+        std::memcpy(payload.data(), cfg.ring_name.c_str(), cfg.ring_name.size());
+        auto info = payload.data() + ring_name_bytes;
+        for (auto& module : modules) {
+            module_info mi = {};
+            mi.number = module->number;
+            mi.slot = module->slot;
+            mi.serial_num = module->serial_num;
+            mi.revision = module->revision;
+            mi.num_channels = static_cast<int32_t>(module->num_channels);
+            mi.online = module->online() ? 1 : 0;
+            if (!module->channels.empty() && module->channels[0].fixture) {
+                mi.adc_bits = module->channels[0].fixture->config.adc_bits;
+                mi.adc_msps = module->channels[0].fixture->config.adc_msps;
+            }
+            std::memcpy(info, &mi, sizeof(mi));
+            info += sizeof(mi);
+        }
+        return double(modules.size());
+    }
+    if (all) {
+        crate::crate::user user(crate_);
+        switch (req.cmd) {
+        case command::start_listmode:
+            crate_.start_listmode(mode);
+            return 0;
+        case command::start_histograms:
+            for (auto& module : modules) {
+                if (module->online()) {
+                    module->start_histograms(mode);
+                }
+            }
+            return 0;
+        case command::end_run:
+            crate_.end_run();
+            return 0;
+        default:
+            throw error(error::code::invalid_value, "ipc: request needs a module");
+        }
+    }
+    crate::crate::user user(crate_);
+    auto& module = crate_[req.module];
+    switch (req.cmd) {
+    case command::read_param:
+        if (req.channel < 0) {
+            return double(module.read(name));
+        }
+        return module.read(name, size_t(req.channel));
+    case command::write_param:
+        if (req.channel < 0) {
+            module.write(name, static_cast<param::value_type>(req.value));
+        } else {
+            module.write(name, size_t(req.channel), req.value);
+        }
+        return 0;
+    case command::start_listmode:
+        module.start_listmode(mode);
+        return 0;
+    case command::start_histograms:
+        module.start_histograms(mode);
+        return 0;
+    case command::end_run:
+        module.run_end();
+        return 0;
+    case command::run_active:
+        return module.run_active() ? 1 : 0;
+    case command::read_histogram: {
+        if (req.channel < 0) {
+            throw error(error::code::invalid_value, "ipc: histogram read needs a channel");
+        }
+        module.channel_check(size_t(req.channel));
+        /*
+         * A length of 0 is the channel's histogram length.
+         */
+        const size_t max_length =
+            module.channels[size_t(req.channel)].fixture->config.max_histogram_length;
+        if (!(req.value >= 0 && req.value <= double(max_length))) {
+            throw error(error::code::invalid_value, "ipc: invalid histogram length");
+        }
+        size_t length = static_cast<size_t>(req.value);
+        if (length == 0) {
+            length = max_length;
+        }
+        hw::words values(length);
+        module.read_histogram(size_t(req.channel), values);
+        payload.resize(values.size() * sizeof(hw::word));
+        std::memcpy(payload.data(), values.data(), payload.size());
+        return double(values.size());
+    }
+    default:
+        break;
+    }
+    throw error(error::code::invalid_value,
+                "ipc: invalid command: " + std::to_string(int(req.cmd)));
+}
+
+size_t server::publish() {
+    size_t words = 0;
+    for (size_t s = 0; s < srcs.size(); ++s) {
+        auto& buffers = pending[s];
+        try {
+            srcs[s].read(buffers);
+        } catch (std::exception& e) {
+            ++errors_;
+            xia_log(log::warning) << "ipc: " << e.what();
+        }
+        /*
+         * A lossless ring with no space leaves the buffers to be published
+         * in the next poll.
+         */
+        words += ring->publish(static_cast<uint32_t>(srcs[s].number), buffers);
+    }
+    /*
+     * Blocks held by the clients that have exited are reclaimed.
+     */
+    if (std::any_of(pending.begin(), pending.end(),
+                    [](const buffer::queue::handles& buffers) { return !buffers.empty(); })) {
+        ring->reap();
+    }
+    published_ += words;
+    return words;
+}
+
+void server::worker() {
+    xia_log(log::debug) << "ipc: thread started: period=" << cfg.poll_msecs << "msecs";
+    while (running_.load()) {
+        try {
+            poll(cfg.poll_msecs);
+        } catch (std::exception& e) {
+            ++errors_;
+            xia_log(log::error) << "ipc: " << e.what();
+        }
+    }
+    xia_log(log::debug) << "ipc: thread stopped";
+}
+
+client::client(const std::string& socket) : fd(-1) {
+    auto addr = socket_address(socket);
+    fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        throw error(error::code::device_initialize_failure, "ipc: socket: " + errno_text());
+    }
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        const auto text = errno_text();
+        ::close(fd);
+        fd = -1;
+        throw error(error::code::device_initialize_failure,
+                    "ipc: connect: " + socket + ": " + text);
+    }
+    try {
+        request req = {};
+        req.cmd = command::hello;
+        std::vector<uint8_t> payload;
+        const auto count = static_cast<size_t>(call(req, payload));
+        if (payload.size() != ring_name_bytes + count * sizeof(module_info)) {
+            throw error(error::code::invalid_value, "ipc: invalid hello response");
+        }
+        auto name = reinterpret_cast<const char*>(payload.data());
+        ring_name.assign(name, ::strnlen(name, ring_name_bytes));
+        modules.resize(count);
+        if (count != 0) {
+            std::memcpy(modules.data(), payload.data() + ring_name_bytes,
+                        count * sizeof(module_info));
+        }
+    } catch (...) {
+        ::close(fd);
+        fd = -1;
+        throw;
+    }
+}
+
+client::~client() {
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+double client::call(request& req, std::vector<uint8_t>& payload) {
+    req.magic = request_magic;
+    if (!send_all(fd, &req, sizeof(req))) {
+        throw error(error::code::internal_failure, "ipc: request send: " + errno_text());
+    }
+    response resp;
+    if (!read(&resp, sizeof(resp)) || resp.magic != response_magic) {
+        throw error(error::code::internal_failure, "ipc: invalid response");
+    }
+    payload.resize(resp.bytes);
+    if (!read(payload.data(), payload.size())) {
+        throw error(error::code::internal_failure, "ipc: response payload short");
+    }
+    if (resp.result != 0) {
+        auto code = error::code::unknown_error;
+        if (resp.result > 0 && resp.result < int32_t(error::code::last)) {
+            code = static_cast<error::code>(resp.result);
+        }
+        throw error(code, std::string(payload.begin(), payload.end()));
+    }
+    return resp.value;
+}
+
+bool client::read(void* data, size_t size) {
+    return recv_all(fd, data, size);
+}
+
+static void set_name(request& req, const std::string& name) {
+    if (name.size() >= sizeof(req.name)) {
+        throw error(error::code::invalid_value, "ipc: parameter name too long: " + name);
+    }
+    std::strncpy(req.name, name.c_str(), sizeof(req.name) - 1);
+}
+
+double client::read(int module, const std::string& par, int channel) {
+    request req = {};
+    req.cmd = command::read_param;
+    req.module = module;
+    req.channel = channel;
+    set_name(req, par);
+    std::vector<uint8_t> payload;
+    return call(req, payload);
+}
+
+void client::write(int module, const std::string& par, double value, int channel) {
+    request req = {};
+    req.cmd = command::write_param;
+    req.module = module;
+    req.channel = channel;
+    req.value = value;
+    set_name(req, par);
+    std::vector<uint8_t> payload;
+    call(req, payload);
+}
+
+void client::start_listmode(int module, hw::run::run_mode mode) {
+    request req = {};
+    req.cmd = command::start_listmode;
+    req.module = module;
+    req.mode = static_cast<uint32_t>(mode);
+    std::vector<uint8_t> payload;
+    call(req, payload);
+}
+
+void client::start_histograms(int module, hw::run::run_mode mode) {
+    request req = {};
+    req.cmd = command::start_histograms;
+    req.module = module;
+    req.mode = static_cast<uint32_t>(mode);
+    std::vector<uint8_t> payload;
+    call(req, payload);
+}
+
+void client::end_run(int module) {
+    request req = {};
+    req.cmd = command::end_run;
+    req.module = module;
+    std::vector<uint8_t> payload;
+    call(req, payload);
+}
+
+bool client::run_active(int module) {
+    request req = {};
+    req.cmd = command::run_active;
+    req.module = module;
+    std::vector<uint8_t> payload;
+    return call(req, payload) != 0;
+}
+
+void client::read_histogram(int module, int channel, hw::words& values) {
+    request req = {};
+    req.cmd = command::read_histogram;
+    req.module = module;
+    req.channel = channel;
+    req.value = double(values.size());
+    std::vector<uint8_t> payload;
+    const auto length = static_cast<size_t>(call(req, payload));
+    if (payload.size() != length * sizeof(hw::word)) {
+        throw error(error::code::invalid_value, "ipc: invalid histogram response");
+    }
+    values.resize(length);
+    std::memcpy(values.data(), payload.data(), payload.size());
+}
+
+std::unique_ptr<buffer::shm::subscriber> client::subscribe() const {
+    return std::unique_ptr<buffer::shm::subscriber>(new buffer::shm::subscriber(ring_name));
+}
+#endif
+}  // namespace ipc
+}  // namespace pixie
+}  // namespace xia
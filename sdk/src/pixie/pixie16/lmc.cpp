@@ -0,0 +1,650 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2022 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file lmc.cpp
+ * @brief Implements a compressed and indexed list-mode container file.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include <nolhmann/json.hpp>
+
+#include <pixie/error.hpp>
+#include <pixie/log.hpp>
+#include <pixie/util.hpp>
+
+#include <pixie/pixie16/lmc.hpp>
+
+namespace xia {
+namespace pixie {
+namespace lmc {
+typedef pixie::error::error error;
+
+/*
+ * The on disk sizes in words.
+ */
+static constexpr size_t file_header_words = 4;
+static constexpr size_t block_header_words = 12;
+static constexpr size_t index_entry_words = 2 + block_header_words;
+static constexpr size_t trailer_words = 4;
+
+/*
+ * The event framing fields of the first header word. These are the same
+ * for all revisions except the event length's width.
+ */
+static constexpr hw::word event_length_mask = 0x7FFE0000;
+static constexpr hw::word narrow_event_length_mask = 0x3FFE0000;
+static constexpr size_t min_header_length = 4;
+static constexpr size_t max_header_length = 31;
+
+/*
+ * The trace samples are packed in groups with the same bit width.
+ */
+static constexpr size_t trace_group = 32;
+
+static uint32_t low(uint64_t value) {
+    return uint32_t(value);
+}
+
+static uint32_t high(uint64_t value) {
+    return uint32_t(value >> 32);
+}
+
+static uint64_t make_u64(uint32_t low_, uint32_t high_) {
+    return (uint64_t(high_) << 32) | low_;
+}
+
+static hw::word length_mask(int revision) {
+    return revision < 29432 ? narrow_event_length_mask : event_length_mask;
+}
+
+static size_t header_length(hw::word w0) {
+    return (w0 >> 12) & 0x1f;
+}
+
+static size_t event_length(hw::word w0, hw::word mask) {
+    return (w0 & mask) >> 17;
+}
+
+static uint64_t event_time(const hw::word* event) {
+    return make_u64(event[1], event[2] & 0xffff);
+}
+
+static void put_varint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(uint8_t(value) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(uint8_t(value));
+}
+
+static uint64_t get_varint(const uint8_t*& in, const uint8_t* end) {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (in >= end) {
+            break;
+        }
+        const uint8_t byte = *in++;
+        value |= uint64_t(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    throw error(error::code::file_read_failure, "lmc: truncated block payload");
+}
+
+static uint64_t zigzag(int64_t value) {
+    return (uint64_t(value) << 1) ^ uint64_t(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+    return int64_t(value >> 1) ^ -int64_t(value & 1);
+}
+
+static uint16_t trace_sample(const hw::word* words, size_t sample) {
+    const hw::word w = words[sample / 2];
+    return uint16_t((sample & 1) == 0 ? w : w >> 16);
+}
+
+/*
+ * The samples are the difference to the previous sample zigzag encoded
+ * and packed in groups prefixed by the group's bit width.
+ */
+static void encode_trace(const hw::word* words, size_t count, std::vector<uint8_t>& out) {
+    const size_t samples = count * 2;
+    uint16_t prev = 0;
+    uint16_t group[trace_group];
+    for (size_t start = 0; start < samples; start += trace_group) {
+        const size_t n = std::min(trace_group, samples - start);
+        uint16_t bits = 0;
+        for (size_t s = 0; s < n; ++s) {
+            const uint16_t sample = trace_sample(words, start + s);
+            const uint16_t diff = uint16_t(sample - prev);
+            prev = sample;
+            group[s] = uint16_t((diff << 1) ^ ((diff & 0x8000) != 0 ? 0xffff : 0));
+            bits |= group[s];
+        }
+        uint8_t width = 0;
+        while (bits != 0) {
+            ++width;
+            bits >>= 1;
+        }
+        out.push_back(width);
+        uint64_t acc = 0;
+        size_t acc_bits = 0;
+        for (size_t s = 0; s < n; ++s) {
+            acc |= uint64_t(group[s]) << acc_bits;
+            acc_bits += width;
+            while (acc_bits >= 8) {
+                out.push_back(uint8_t(acc));
+                acc >>= 8;
+                acc_bits -= 8;
+            }
+        }
+        if (acc_bits > 0) {
+            out.push_back(uint8_t(acc));
+        }
+    }
+}
+
+static void decode_trace(const uint8_t*& in, const uint8_t* end, size_t count, hw::word* words) {
+    const size_t samples = count * 2;
+    uint16_t prev = 0;
+    std::fill(words, words + count, 0);
+    for (size_t start = 0; start < samples; start += trace_group) {
+        const size_t n = std::min(trace_group, samples - start);
+        if (in >= end) {
+            throw error(error::code::file_read_failure, "lmc: truncated trace");
+        }
+        const size_t width = *in++;
+        if (width > 16 || size_t(end - in) < (n * width + 7) / 8) {
+            throw error(error::code::file_read_failure, "lmc: invalid trace group");
+        }
+        const uint64_t mask = (uint64_t(1) << width) - 1;
+        uint64_t acc = 0;
+        size_t acc_bits = 0;
+        for (size_t s = 0; s < n; ++s) {
+            while (acc_bits < width) {
+                acc |= uint64_t(*in++) << acc_bits;
+                acc_bits += 8;
+            }
+            const uint16_t z = uint16_t(acc & mask);
+            acc >>= width;
+            acc_bits -= width;
+            const uint16_t diff = uint16_t((z >> 1) ^ ((z & 1) != 0 ? 0xffff : 0));
+            const uint16_t sample = uint16_t(prev + diff);
+            prev = sample;
+            const size_t sn = start + s;
+            words[sn / 2] |= (sn & 1) == 0 ? hw::word(sample) : hw::word(sample) << 16;
+        }
+    }
+}
+
+/*
+ * The header words are encoded against the previous event's words. The
+ * first and fourth words are XORed, the timestamp is a signed difference
+ * and the remaining words are signed differences of the same word.
+ */
+static void encode_events(const hw::word* data, size_t words, hw::word mask,
+                          std::vector<uint8_t>& out) {
+    hw::word prev[max_header_length] = {};
+    uint64_t prev_time = 0;
+    size_t pos = 0;
+    while (pos < words) {
+        const hw::word* event = data + pos;
+        const size_t head = header_length(event[0]);
+        const size_t length = event_length(event[0], mask);
+        const uint64_t time = event_time(event);
+        put_varint(out, event[0] ^ prev[0]);
+        put_varint(out, zigzag(int64_t(time - prev_time)));
+        put_varint(out, event[2] >> 16);
+        put_varint(out, event[3] ^ prev[3]);
+        for (size_t w = min_header_length; w < head; ++w) {
+            put_varint(out, zigzag(int32_t(event[w] - prev[w])));
+        }
+        encode_trace(event + head, length - head, out);
+        std::copy(event, event + head, prev);
+        prev_time = time;
+        pos += length;
+    }
+}
+
+static void decode_events(const uint8_t* in, const uint8_t* end, size_t events, size_t words,
+                          hw::word mask, hw::words& out) {
+    out.resize(words);
+    hw::word prev[max_header_length] = {};
+    uint64_t prev_time = 0;
+    size_t pos = 0;
+    for (size_t e = 0; e < events; ++e) {
+        hw::word header[min_header_length];
+        header[0] = hw::word(get_varint(in, end)) ^ prev[0];
+        const uint64_t time = prev_time + uint64_t(unzigzag(get_varint(in, end)));
+        header[1] = low(time);
+        header[2] = (hw::word(get_varint(in, end)) << 16) | (high(time) & 0xffff);
+        header[3] = hw::word(get_varint(in, end)) ^ prev[3];
+        const size_t head = header_length(header[0]);
+        const size_t length = event_length(header[0], mask);
+        if (head < min_header_length || length < head || pos + length > words) {
+            throw error(error::code::file_read_failure, "lmc: invalid event in block");
+        }
+        hw::word* event = out.data() + pos;
+        std::copy(header, header + min_header_length, event);
+        for (size_t w = min_header_length; w < head; ++w) {
+            event[w] = prev[w] + hw::word(unzigzag(get_varint(in, end)));
+        }
+        decode_trace(in, end, length - head, event + head);
+        std::copy(event, event + head, prev);
+        prev_time = time;
+        pos += length;
+    }
+    if (pos != words) {
+        throw error(error::code::file_read_failure, "lmc: block length mismatch");
+    }
+}
+
+/*
+ * Find the complete events up to the limit of words. Returns the words of
+ * the events. Corrupt is set if an event cannot be framed.
+ */
+static size_t frame(const hw::word* data, size_t words, size_t limit, hw::word mask,
+                    size_t& events, bool& corrupt) {
+    size_t pos = 0;
+    events = 0;
+    corrupt = false;
+    while (pos < words && pos < limit) {
+        if (words - pos < min_header_length) {
+            break;
+        }
+        const size_t head = header_length(data[pos]);
+        const size_t length = event_length(data[pos], mask);
+        if (head < min_header_length || length < head) {
+            corrupt = true;
+            break;
+        }
+        if (pos + length > words) {
+            break;
+        }
+        pos += length;
+        ++events;
+    }
+    return pos;
+}
+
+static void block_to_words(const block& blk, hw::word* words) {
+    words[0] = block_magic;
+    words[1] = blk.module;
+    words[2] = blk.flags;
+    words[3] = blk.events;
+    words[4] = blk.words;
+    words[5] = blk.bytes;
+    words[6] = blk.channels;
+    words[7] = blk.crc;
+    words[8] = low(blk.first_time);
+    words[9] = high(blk.first_time);
+    words[10] = low(blk.last_time);
+    words[11] = high(blk.last_time);
+}
+
+static bool words_to_block(const hw::word* words, block& blk) {
+    if (words[0] != block_magic) {
+        return false;
+    }
+    blk.module = words[1];
+    blk.flags = words[2];
+    blk.events = words[3];
+    blk.words = words[4];
+    blk.bytes = words[5];
+    blk.channels = words[6];
+    blk.crc = words[7];
+    blk.first_time = make_u64(words[8], words[9]);
+    blk.last_time = make_u64(words[10], words[11]);
+    return true;
+}
+
+static uint32_t payload_crc(const std::vector<uint8_t>& payload) {
+    util::crc32 crc;
+    if (!payload.empty()) {
+        crc.update(payload);
+    }
+    return crc.value;
+}
+
+module_info::module_info() : number(-1), revision(0), adc_msps(0) {}
+
+module_info::module_info(int number_, int revision_, int adc_msps_)
+    : number(number_), revision(revision_), adc_msps(adc_msps_) {}
+
+double module_info::tick_period() const {
+    return adc_msps == 250 ? 8e-9 : 10e-9;
+}
+
+block::block()
+    : offset(0), module(0), flags(0), events(0), words(0), bytes(0), channels(0), crc(0),
+      first_time(0), last_time(0) {}
+
+writer::writer(const output& out_, const module_infos& modules, const std::string& header,
+               size_t block_words_)
+    : block_words(std::max(block_words_, size_t(1))), out(out_), bytes_(0), words_(0),
+      finished(false) {
+    if (!out) {
+        throw error(error::code::invalid_value, "lmc: writer: no output");
+    }
+    for (auto& mod : modules) {
+        streams.emplace_back();
+        streams.back().info = mod;
+    }
+    const hw::word head[file_header_words] = {file_magic, version, hw::word(header.size()), 0};
+    write(head, sizeof(head));
+    write(header.data(), header.size());
+}
+
+void writer::add(int module, const hw::word* data, size_t words) {
+    if (finished) {
+        throw error(error::code::invalid_value, "lmc: writer: finished");
+    }
+    auto& s = get_stream(module);
+    s.pending.insert(s.pending.end(), data, data + words);
+    words_ += words;
+    if (s.pending.size() >= block_words) {
+        emit(s, false);
+    }
+}
+
+void writer::flush() {
+    for (auto& s : streams) {
+        emit(s, true);
+    }
+}
+
+void writer::finish() {
+    if (finished) {
+        return;
+    }
+    for (auto& s : streams) {
+        emit(s, true);
+        if (!s.pending.empty()) {
+            write_block(s, s.pending.data(), s.pending.size(), 0, true);
+            s.pending.clear();
+        }
+    }
+    const uint64_t index_offset = bytes_;
+    for (auto& blk : index_) {
+        hw::word entry[index_entry_words];
+        entry[0] = low(blk.offset);
+        entry[1] = high(blk.offset);
+        block_to_words(blk, entry + 2);
+        write(entry, sizeof(entry));
+    }
+    const hw::word trailer[trailer_words] = {low(index_offset), high(index_offset),
+                                             hw::word(index_.size()), index_magic};
+    write(trailer, sizeof(trailer));
+    finished = true;
+}
+
+writer::stream& writer::get_stream(int module) {
+    for (auto& s : streams) {
+        if (s.info.number == module) {
+            return s;
+        }
+    }
+    throw error(error::code::invalid_value,
+                "lmc: writer: invalid module: " + std::to_string(module));
+}
+
+void writer::emit(stream& s, bool partial_blocks) {
+    const hw::word mask = length_mask(s.info.revision);
+    size_t start = 0;
+    while (start < s.pending.size()) {
+        const hw::word* data = s.pending.data() + start;
+        const size_t available = s.pending.size() - start;
+        size_t events;
+        bool corrupt;
+        const size_t words = frame(data, available, block_words, mask, events, corrupt);
+        if (!corrupt && (words == 0 || (!partial_blocks && words < block_words))) {
+            break;
+        }
+        if (words > 0) {
+            write_block(s, data, words, events, false);
+            start += words;
+        }
+        if (corrupt) {
+            xia_log(log::warning) << "lmc: module " << s.info.number
+                                  << ": data cannot be framed, writing raw";
+            write_block(s, s.pending.data() + start, s.pending.size() - start, 0, true);
+            start = s.pending.size();
+        }
+    }
+    s.pending.erase(s.pending.begin(), s.pending.begin() + ptrdiff_t(start));
+}
+
+void writer::write_block(stream& s, const hw::word* data, size_t words, size_t events,
+                         bool raw) {
+    block blk;
+    blk.offset = bytes_;
+    blk.module = hw::word(s.info.number);
+    blk.words = hw::word(words);
+    blk.events = hw::word(events);
+    payload.clear();
+    if (raw) {
+        blk.flags = block::raw;
+        auto bytes = reinterpret_cast<const uint8_t*>(data);
+        payload.assign(bytes, bytes + words * sizeof(hw::word));
+    } else {
+        const hw::word mask = length_mask(s.info.revision);
+        if (mask == narrow_event_length_mask) {
+            blk.flags |= block::narrow_length;
+        }
+        blk.first_time = std::numeric_limits<uint64_t>::max();
+        for (size_t pos = 0; pos < words; pos += event_length(data[pos], mask)) {
+            const uint64_t time = event_time(data + pos);
+            blk.first_time = std::min(blk.first_time, time);
+            blk.last_time = std::max(blk.last_time, time);
+            blk.channels |= 1U << (data[pos] & 0xf);
+        }
+        encode_events(data, words, mask, payload);
+    }
+    blk.bytes = hw::word(payload.size());
+    blk.crc = payload_crc(payload);
+    hw::word head[block_header_words];
+    block_to_words(blk, head);
+    write(head, sizeof(head));
+    write(payload.data(), payload.size());
+    index_.push_back(blk);
+}
+
+void writer::write(const void* data, size_t size) {
+    if (size > 0) {
+        out(data, size);
+        bytes_ += size;
+    }
+}
+
+reader::reader(const std::string& path_) : path(path_), indexed_(false) {
+    in.open(path, std::ios::binary);
+    if (!in) {
+        throw error(error::code::file_open_failure, "lmc: open: " + path);
+    }
+    in.seekg(0, std::ios::end);
+    const uint64_t size = uint64_t(in.tellg());
+    in.seekg(0);
+    hw::word head[file_header_words];
+    if (size < sizeof(head) || !in.read(reinterpret_cast<char*>(head), sizeof(head)) ||
+        head[0] != file_magic) {
+        throw error(error::code::file_read_failure, "lmc: not a container: " + path);
+    }
+    if (head[1] != version) {
+        throw error(error::code::file_read_failure,
+                    "lmc: unsupported version: " + std::to_string(head[1]) + ": " + path);
+    }
+    const uint64_t data_start = sizeof(head) + uint64_t(head[2]);
+    if (data_start > size) {
+        throw error(error::code::file_size_invalid, "lmc: truncated header: " + path);
+    }
+    header_.resize(head[2]);
+    in.read(&header_[0], std::streamsize(header_.size()));
+    try {
+        auto meta = nlohmann::json::parse(header_);
+        for (auto& mod : meta.at("modules")) {
+            modules_.emplace_back(mod.at("number").get<int>(), mod.value("revision", 0),
+                                  mod.value("adc-msps", 0));
+        }
+    } catch (std::exception& e) {
+        xia_log(log::warning) << "lmc: " << path << ": no module metadata: " << e.what();
+    }
+    hw::word trailer[trailer_words];
+    if (size >= data_start + sizeof(trailer)) {
+        in.seekg(std::streamoff(size - sizeof(trailer)));
+        in.read(reinterpret_cast<char*>(trailer), sizeof(trailer));
+        const uint64_t index_offset = make_u64(trailer[0], trailer[1]);
+        const uint64_t entries = trailer[2];
+        if (in && trailer[3] == index_magic && index_offset >= data_start &&
+            index_offset + entries * index_entry_words * sizeof(hw::word) + sizeof(trailer) ==
+                size) {
+            in.seekg(std::streamoff(index_offset));
+            for (uint64_t e = 0; e < entries; ++e) {
+                hw::word entry[index_entry_words];
+                block blk;
+                if (!in.read(reinterpret_cast<char*>(entry), sizeof(entry)) ||
+                    !words_to_block(entry + 2, blk)) {
+                    throw error(error::code::file_read_failure, "lmc: invalid index: " + path);
+                }
+                blk.offset = make_u64(entry[0], entry[1]);
+                index_.push_back(blk);
+            }
+            indexed_ = true;
+        }
+    }
+    if (!indexed_) {
+        in.clear();
+        scan(data_start, size);
+    }
+    for (size_t b = 0; b < index_.size(); ++b) {
+        const int module = int(index_[b].module);
+        auto mb = std::find_if(by_module.begin(), by_module.end(),
+                               [module](const module_blocks& m) { return m.module == module; });
+        if (mb == by_module.end()) {
+            by_module.emplace_back();
+            mb = by_module.end() - 1;
+            mb->module = module;
+        }
+        const uint64_t latest = mb->latest.empty() ? 0 : mb->latest.back();
+        mb->blocks.push_back(b);
+        mb->latest.push_back(std::max(latest, index_[b].last_time));
+    }
+}
+
+void reader::scan(uint64_t start, uint64_t size) {
+    xia_log(log::info) << "lmc: no index, scanning: " << path;
+    uint64_t offset = start;
+    while (offset + block_header_words * sizeof(hw::word) <= size) {
+        hw::word head[block_header_words];
+        in.seekg(std::streamoff(offset));
+        block blk;
+        if (!in.read(reinterpret_cast<char*>(head), sizeof(head)) || !words_to_block(head, blk)) {
+            break;
+        }
+        const uint64_t next = offset + sizeof(head) + blk.bytes;
+        if (next > size) {
+            break;
+        }
+        blk.offset = offset;
+        index_.push_back(blk);
+        offset = next;
+    }
+    in.clear();
+}
+
+size_t reader::find_ticks(uint64_t ticks, int module) const {
+    size_t found = index_.size();
+    for (auto& mb : by_module) {
+        if (module >= 0 && mb.module != module) {
+            continue;
+        }
+        auto at = std::lower_bound(mb.latest.begin(), mb.latest.end(), ticks);
+        if (at != mb.latest.end()) {
+            found = std::min(found, mb.blocks[size_t(at - mb.latest.begin())]);
+        }
+    }
+    return found;
+}
+
+size_t reader::find(double secs, int module) const {
+    size_t found = index_.size();
+    for (auto& mb : by_module) {
+        if (module >= 0 && mb.module != module) {
+            continue;
+        }
+        double period = module_info().tick_period();
+        for (auto& mod : modules_) {
+            if (mod.number == mb.module) {
+                period = mod.tick_period();
+            }
+        }
+        const uint64_t ticks = secs <= 0 ? 0 : uint64_t(secs / period);
+        found = std::min(found, find_ticks(ticks, mb.module));
+    }
+    return found;
+}
+
+void reader::read(size_t number, hw::words& words) {
+    if (number >= index_.size()) {
+        throw error(error::code::invalid_value,
+                    "lmc: invalid block: " + std::to_string(number) + ": " + path);
+    }
+    const auto& blk = index_[number];
+    hw::word head[block_header_words];
+    block check;
+    in.seekg(std::streamoff(blk.offset));
+    if (!in.read(reinterpret_cast<char*>(head), sizeof(head)) || !words_to_block(head, check) ||
+        check.bytes != blk.bytes) {
+        in.clear();
+        throw error(error::code::file_read_failure,
+                    "lmc: invalid block header: " + std::to_string(number) + ": " + path);
+    }
+    payload.resize(blk.bytes);
+    if (blk.bytes > 0 &&
+        !in.read(reinterpret_cast<char*>(payload.data()), std::streamsize(blk.bytes))) {
+        in.clear();
+        throw error(error::code::file_read_failure,
+                    "lmc: truncated block: " + std::to_string(number) + ": " + path);
+    }
+    if (payload_crc(payload) != blk.crc) {
+        throw error(error::code::file_read_failure,
+                    "lmc: block CRC mismatch: " + std::to_string(number) + ": " + path);
+    }
+    if ((blk.flags & block::raw) != 0) {
+        if (blk.bytes != blk.words * sizeof(hw::word)) {
+            throw error(error::code::file_read_failure,
+                        "lmc: invalid raw block: " + std::to_string(number) + ": " + path);
+        }
+        words.resize(blk.words);
+        if (blk.words > 0) {
+            std::memcpy(words.data(), payload.data(), blk.bytes);
+        }
+        return;
+    }
+    const hw::word mask =
+        (blk.flags & block::narrow_length) != 0 ? narrow_event_length_mask : event_length_mask;
+    decode_events(payload.data(), payload.data() + payload.size(), blk.events, blk.words, mask,
+                  words);
+}
+}  // namespace lmc
+}  // namespace pixie
+}  // namespace xia
@@ -24,22 +24,14 @@
 #include <iostream>
 
 #include <pixie/log.hpp>
+#include <pixie/tracepoint.hpp>
 
+#include <pixie/pixie16/access.hpp>
 #include <pixie/pixie16/csr.hpp>
 #include <pixie/pixie16/defs.hpp>
 #include <pixie/pixie16/memory.hpp>
 #include <pixie/pixie16/module.hpp>
 
-/*
- * ADSP-21160 registers defined from
- * https://www.analog.com/media/en/dsp-documentation/processor-manuals/ADSP-21160_hwr_rev4.1.pdf
- * last accessed on 2021-06-24
- */
-/*
- * DMA channel status register
- */
-#define DMASTAT 0x37
-
 namespace xia {
 namespace pixie {
 namespace hw {
@@ -73,27 +65,35 @@ word host_bus::read(const size_t channel, const size_t offset, const address add
 }
 
 void host_bus::read(const address addr, word_ptr buffer, const size_t length) {
-    module::module::bus_guard guard(module);
+    read(blocks{{addr, buffer, length}});
+}
 
-    size_t size = length;
-    size_t offset = 0;
-    /*
-     * The 48 is taken from the legacy code. The significance of this value
-     * is unknown.
-     */
-    while (size > 48) {
-        const size_t block_size = size > hw::max_dma_block_size ? hw::max_dma_block_size : size;
-        dma_read(hw::address(addr + offset), buffer + offset, block_size);
-        size -= block_size;
-        offset += block_size;
-    }
-    if (size > 0) {
-        hbr::host_bus_request hbr(module, access);
-        bus_write(hw::device::EXT_MEM_TEST, hw::word(addr + offset));
-        buffer += offset;
-        while (size-- > 0) {
-        *buffer = bus_read(hw::device::WRT_DSP_MMA);
-            ++buffer;
+void host_bus::read(const blocks& reads) {
+    module::module::bus_guard guard(module);
+    hbr::host_bus_request hbr(module, false, access);
+
+    for (auto& block : reads) {
+        size_t size = block.length;
+        size_t offset = 0;
+        /*
+         * The DMA threshold is taken from the legacy code. The significance
+         * of this value is unknown.
+         */
+        while (size > dma_read_threshold) {
+            const size_t block_size =
+                size > hw::max_dma_block_size ? hw::max_dma_block_size : size;
+            dma_read(hw::address(block.addr + offset), block.buffer + offset, block_size, hbr);
+            size -= block_size;
+            offset += block_size;
+        }
+        if (size > 0) {
+            hbr.request();
+            bus_write(hw::device::EXT_MEM_TEST, hw::word(block.addr + offset));
+            word_ptr buffer = block.buffer + offset;
+            while (size-- > 0) {
+                *buffer = bus_read(hw::device::WRT_DSP_MMA);
+                ++buffer;
+            }
         }
     }
 }
@@ -128,27 +128,29 @@ void host_bus::write(const address addr, const words& values) {
     }
 }
 
-void host_bus::dma_read(const address addr, word_ptr buffer, const size_t length) {
-    xia_log(log::debug) << module::module_label(module) << "dsp dma read: addr=0x" << std::hex << addr
-                        << " length=" << std::dec << length;
+void host_bus::write(const blocks& writes) {
+    module::module::bus_guard guard(module);
+    hbr::host_bus_request hbr(module, access);
+    for (auto& block : writes) {
+        bus_write(hw::device::EXT_MEM_TEST, block.addr);
+        for (size_t w = 0; w < block.length; ++w) {
+            bus_write(hw::device::WRT_DSP_MMA, block.buffer[w]);
+        }
+    }
+}
+
+void host_bus::dma_read(const address addr, word_ptr buffer, const size_t length,
+                        hbr::host_bus_request& hbr) {
+    xia_logc(log::bus, log::debug) << module::module_label(module) << "dsp dma read: addr=0x"
+                                   << std::hex << addr << " length=" << std::dec << length;
 
     /*
      * The bus is held on entry.
      */
 
-    hbr::host_bus_request hbr(module, access);
-
-    bus_write(hw::device::EXT_MEM_TEST, DMASTAT);
-    if ((bus_read(hw::device::WRT_DSP_MMA) & (1 << 11)) != 0) {
-        throw error(error::code::device_dma_busy, "dsp: DMA busy");
-    }
+    hbr.request();
 
-    bus_write(hw::device::WRT_DSP_II11, addr);
-    bus_write(hw::device::WRT_DSP_C11, hw::word(length));
-    bus_write(hw::device::WRT_DSP_IM11, 1);
-    bus_write(hw::device::WRT_DSP_EC11, hw::word(length));
-    bus_write(hw::device::WRT_DSP_DMAC11, 0x905);
-    bus_write(hw::device::RD_WRT_FIFO_WML, hw::word(length) / 2);
+    module.hw_access->dsp_dma_setup(module, addr, length);
 
     hbr.release();
 
@@ -184,37 +186,14 @@ void mca::read(const address addr, words& values) {
 }
 
 void mca::read(const address addr, word_ptr values, size_t size) {
-    module::module::bus_guard guard(module);
-
-    /*
-     * Guard the PCI active bit, so it is cleared when we exit.
-     */
-    csr::set_clear csr(module, 1 << hw::bit::PCIACTIVE);
-
-    /*
-     * Set up the address to read from.
-     */
-    bus_write(hw::device::WRT_EXT_MEM, addr);
-
-    /*
-     * Dummy read to make the FPGA not glitch at the end of addr write.
-     */
-    if (module >= hw::rev_H) {
-        (void) bus_read(MCA_MEM_DATA);
-    }
-
-    /*
-     * Set up short FIFO in System FPGA
-     */
-    bus_write(hw::device::SET_EXMEM_FIFO, 0);
-
-    /*
-     * Read the data using DMA.
-     */
-    module.dma_read(MCA_MEM_DATA, values, size);
+    module.hw_access->mca_read(module, addr, values, size);
 }
 
 void mca::write(const address addr, const words& values) {
+    write(addr, values.data(), values.size());
+}
+
+void mca::write(const address addr, const word* values, size_t size) {
     module::module::bus_guard guard(module);
 
     /*
@@ -223,35 +202,31 @@ void mca::write(const address addr, const words& values) {
     csr::set_clear csr(module, 1 << hw::bit::PCIACTIVE);
 
     bus_write(hw::device::WRT_EXT_MEM, addr);
-    for (auto value : values) {
-        bus_write(MCA_MEM_DATA, value);
+
+    /*
+     * The data register's local address is constant so a DMA write
+     * streams the block into the memory the same as the word writes.
+     */
+    if (size > dma_write_threshold) {
+        module.dma_write(MCA_MEM_DATA, values, size);
+    } else {
+        for (size_t w = 0; w < size; ++w) {
+            bus_write(MCA_MEM_DATA, values[w]);
+        }
     }
 }
 
 fifo::fifo(module::module& module_) : bus(module_) {}
 
 size_t fifo::level() {
-    module::module::bus_guard guard(module);
-    return size_t(bus_read(hw::device::RD_WRT_FIFO_WML));
+    module::module::bus_guard guard(module, module::module::bus_priority::fifo);
+    auto words = size_t(bus_read(hw::device::RD_WRT_FIFO_WML));
+    PIXIE_TRACEPOINT2(fifo_level, module.number, words);
+    return words;
 }
 
 void fifo::read(word_ptr buffer, const size_t length) {
-    module::module::bus_guard guard(module);
-
-    bus_write(hw::device::SET_EXT_FIFO, hw::word(length));
-
-    size_t polls = 1000;
-    while (polls-- > 0) {
-        if (bus_read(hw::device::RD_WRT_FIFO_WML) >= length) {
-            break;
-        }
-    }
-    if (polls == 0) {
-        throw module::error(module.number, module.slot, module::error::code::device_fifo_failure,
-                            "FIFO failed to reach watermark");
-    }
-
-    module.dma_read(FIFO_MEM_DMA, buffer, length);
+    module.hw_access->fifo_read(module, buffer, length);
 }
 };  // namespace memory
 };  // namespace hw
@@ -0,0 +1,397 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file metrics.cpp
+ * @brief Implements an exporter of a crate's statistics in the OpenMetrics text format.
+ */
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <sstream>
+
+#include <pixie/error.hpp>
+#include <pixie/log.hpp>
+#include <pixie/stats.hpp>
+
+#include <pixie/pixie16/metrics.hpp>
+
+#if !defined(_WIN64) && !defined(_WIN32)
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace xia {
+namespace pixie {
+namespace metrics {
+typedef pixie::error::error error;
+
+/*
+ * The period the thread checks for scrapes and a stop, units msecs.
+ */
+static constexpr int serve_poll_msecs = 100;
+
+/*
+ * The limit of a scrape's request and the time a client has to send it.
+ */
+static constexpr size_t max_request_bytes = 8192;
+static constexpr int request_timeout_msecs = 1000;
+
+config::config() : port(-1), stats_period_msecs(5000) {}
+
+channel_values::channel_values()
+    : input_counts(0), input_count_rate(0), output_counts(0), output_count_rate(0),
+      live_time(0) {}
+
+module_values::module_values(size_t num_channels_)
+    : processed_events(0), real_time(0), reads(0), errors(0),
+      channels(new channel_values[num_channels_]), num_channels(num_channels_) {}
+
+/*
+ * Writes a metric family's samples. Counters have the `_total` suffix.
+ */
+struct family {
+    std::ostringstream& out;
+    std::string name;
+    std::string type;
+
+    family(std::ostringstream& out_, const std::string& name_, const std::string& type_,
+           const std::string& help)
+        : out(out_), name(name_), type(type_) {
+        out << "# TYPE " << name << ' ' << type << '\n'
+            << "# HELP " << name << ' ' << help << '\n';
+    }
+
+    template<typename T>
+    void sample(const std::string& labels, T value) {
+        out << name << (type == "counter" ? "_total" : "") << '{' << labels << "} " << value
+            << '\n';
+    }
+};
+
+static std::string module_labels(const module::module& module) {
+    return "module=\"" + std::to_string(module.number) + "\",slot=\"" +
+        std::to_string(module.slot) + '"';
+}
+
+#if defined(_WIN64) || defined(_WIN32)
+void exporter::listen() {
+    throw error(error::code::not_supported, "metrics: endpoint not supported on Windows");
+}
+
+size_t exporter::serve() {
+    return 0;
+}
+
+static void close_fd(int) {}
+#else
+static std::string errno_text() {
+    return std::strerror(errno);
+}
+
+static void close_fd(int fd) {
+    ::close(fd);
+}
+
+void exporter::listen() {
+    listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        throw error(error::code::device_initialize_failure, "metrics: socket: " + errno_text());
+    }
+    const int on = 1;
+    ::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(cfg.port));
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (!cfg.address.empty() && ::inet_pton(AF_INET, cfg.address.c_str(), &addr.sin_addr) != 1) {
+        throw error(error::code::invalid_value, "metrics: invalid address: " + cfg.address);
+    }
+    if (::bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        throw error(error::code::device_initialize_failure,
+                    "metrics: bind: port " + std::to_string(cfg.port) + ": " + errno_text());
+    }
+    if (::listen(listen_fd, 4) < 0) {
+        throw error(error::code::device_initialize_failure, "metrics: listen: " + errno_text());
+    }
+    ::fcntl(listen_fd, F_SETFL, ::fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+    socklen_t len = sizeof(addr);
+    ::getsockname(listen_fd, reinterpret_cast<sockaddr*>(&addr), &len);
+    port_ = ntohs(addr.sin_port);
+}
+
+/*
+ * Read a scrape's request line and headers. Returns an empty string if the
+ * client does not send a request in time.
+ */
+static std::string read_request(int fd) {
+    std::string request;
+    while (request.find("\r\n\r\n") == std::string::npos &&
+           request.size() < max_request_bytes) {
+        pollfd pfd = {};
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        if (::poll(&pfd, 1, request_timeout_msecs) <= 0) {
+            return std::string();
+        }
+        char buf[1024];
+        const ssize_t got = ::recv(fd, buf, sizeof(buf), 0);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            break;
+        }
+        request.append(buf, size_t(got));
+    }
+    return request;
+}
+
+size_t exporter::serve() {
+    if (listen_fd < 0) {
+        return 0;
+    }
+    size_t scrapes = 0;
+    while (true) {
+        const int fd = ::accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            break;
+        }
+        const auto request = read_request(fd);
+        const auto path_end = request.find(' ', 4);
+        const auto path =
+            request.compare(0, 4, "GET ") == 0 && path_end != std::string::npos ?
+                request.substr(4, path_end - 4) : std::string();
+        std::string response;
+        if (path == "/metrics" || path == "/") {
+            const auto body = text();
+            response = "HTTP/1.1 200 OK\r\n"
+                       "Content-Type: application/openmetrics-text; version=1.0.0; "
+                       "charset=utf-8\r\n"
+                       "Content-Length: " +
+                std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+            ++scrapes;
+        } else {
+            response = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n"
+                       "Connection: close\r\n\r\n";
+        }
+        const char* data = response.data();
+        size_t size = response.size();
+        while (size > 0) {
+            const ssize_t sent = ::send(fd, data, size, MSG_NOSIGNAL);
+            if (sent < 0 && errno == EINTR) {
+                continue;
+            }
+            if (sent <= 0) {
+                xia_log(log::warning) << "metrics: send: " << errno_text();
+                break;
+            }
+            data += sent;
+            size -= size_t(sent);
+        }
+        ::close(fd);
+    }
+    return scrapes;
+}
+#endif
+
+exporter::exporter(crate::crate& crate, const config& cfg_)
+    : cfg(cfg_), listen_fd(-1), port_(-1), running_(false) {
+    crate.ready();
+    modules = crate.modules;
+    for (auto& module : modules) {
+        values.emplace_back(new module_values(module->num_channels));
+    }
+    if (cfg.port >= 0) {
+        try {
+            listen();
+        } catch (...) {
+            if (listen_fd >= 0) {
+                close_fd(listen_fd);
+                listen_fd = -1;
+            }
+            throw;
+        }
+    }
+    xia_log(log::info) << "metrics: modules=" << modules.size() << " port=" << port_
+                       << " stats-period=" << cfg.stats_period_msecs << "msecs";
+}
+
+exporter::~exporter() {
+    stop();
+    if (listen_fd >= 0) {
+        close_fd(listen_fd);
+    }
+}
+
+void exporter::start() {
+    if (running_.load()) {
+        throw error(error::code::module_invalid_operation, "metrics: already running");
+    }
+    running_ = true;
+    thread = std::thread(&exporter::worker, this);
+}
+
+void exporter::stop() {
+    running_ = false;
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+size_t exporter::poll_stats() {
+    size_t read = 0;
+    for (size_t m = 0; m < modules.size(); ++m) {
+        auto& module = *modules[m];
+        auto& vals = *values[m];
+        if (!module.online()) {
+            continue;
+        }
+        try {
+            stats::stats stats(module);
+            module.read_stats(stats);
+            vals.processed_events = stats.mod.processed_events();
+            vals.real_time = stats.mod.real_time();
+            for (size_t c = 0; c < stats.chans.size() && c < vals.num_channels; ++c) {
+                auto& chan = stats.chans[c];
+                auto& chan_vals = vals.channels[c];
+                chan_vals.input_counts = chan.input_counts();
+                chan_vals.input_count_rate = chan.input_count_rate();
+                chan_vals.output_counts = chan.output_counts();
+                chan_vals.output_count_rate = chan.output_count_rate();
+                chan_vals.live_time = chan.live_time();
+            }
+            ++vals.reads;
+            ++read;
+        } catch (std::exception& e) {
+            ++vals.errors;
+            xia_log(log::warning) << "metrics: " << e.what();
+        }
+    }
+    return read;
+}
+
+std::string exporter::text() const {
+    std::ostringstream out;
+    out.precision(17);
+
+    auto modules_family = [this, &out](const std::string& name, const std::string& type,
+                                       const std::string& help,
+                                       std::function<double(size_t)> value) {
+        family f(out, name, type, help);
+        for (size_t m = 0; m < modules.size(); ++m) {
+            f.sample(module_labels(*modules[m]), value(m));
+        }
+    };
+    auto channels_family = [this, &out](const std::string& name, const std::string& type,
+                                        const std::string& help,
+                                        std::function<double(const channel_values&)> value) {
+        family f(out, name, type, help);
+        for (size_t m = 0; m < modules.size(); ++m) {
+            const auto labels = module_labels(*modules[m]);
+            for (size_t c = 0; c < values[m]->num_channels; ++c) {
+                f.sample(labels + ",channel=\"" + std::to_string(c) + '"',
+                         value(values[m]->channels[c]));
+            }
+        }
+    };
+    auto fifo = [this](size_t m) -> const module::module::fifo_stats& {
+        return modules[m]->run_stats;
+    };
+
+    modules_family("pixie_module_online", "gauge", "The module is online.",
+                   [this](size_t m) { return modules[m]->online() ? 1 : 0; });
+    modules_family("pixie_module_run_task", "gauge", "The module's run task, 0 is none.",
+                   [this](size_t m) { return int(modules[m]->run_task.load()); });
+    modules_family("pixie_fifo_in_words", "counter", "Words queued from the FIFO in the run.",
+                   [&fifo](size_t m) { return fifo(m).in.load(); });
+    modules_family("pixie_fifo_out_words", "counter", "Words read from the queue in the run.",
+                   [&fifo](size_t m) { return fifo(m).out.load(); });
+    modules_family("pixie_fifo_dma_in_words", "counter", "Words read by DMA in the run.",
+                   [&fifo](size_t m) { return fifo(m).dma_in.load(); });
+    modules_family("pixie_fifo_overflows", "counter", "FIFO queue overflows in the run.",
+                   [&fifo](size_t m) { return fifo(m).overflows.load(); });
+    modules_family("pixie_fifo_dropped", "counter", "FIFO queue buffers dropped in the run.",
+                   [&fifo](size_t m) { return fifo(m).dropped.load(); });
+    modules_family("pixie_fifo_hw_overflows", "counter", "Estimated FIFO hardware overflows.",
+                   [&fifo](size_t m) { return fifo(m).hw_overflows.load(); });
+    modules_family("pixie_fifo_bandwidth_megabytes_per_second", "gauge",
+                   "The FIFO read bandwidth.",
+                   [&fifo](size_t m) { return fifo(m).bandwidth.load(); });
+    modules_family("pixie_module_processed_events", "counter",
+                   "Events processed in the run at the last stats read.",
+                   [this](size_t m) { return double(values[m]->processed_events.load()); });
+    modules_family("pixie_module_real_time_seconds", "gauge",
+                   "The run's real time at the last stats read.",
+                   [this](size_t m) { return values[m]->real_time.load(); });
+    modules_family("pixie_module_stats_reads", "counter", "Stats reads of the module.",
+                   [this](size_t m) { return double(values[m]->reads.load()); });
+    modules_family("pixie_module_stats_errors", "counter", "Stats reads that failed.",
+                   [this](size_t m) { return double(values[m]->errors.load()); });
+    channels_family("pixie_channel_input_counts", "gauge", "The channel's input counts.",
+                    [](const channel_values& v) { return v.input_counts.load(); });
+    channels_family("pixie_channel_input_count_rate", "gauge",
+                    "The channel's input count rate in counts per second.",
+                    [](const channel_values& v) { return v.input_count_rate.load(); });
+    channels_family("pixie_channel_output_counts", "gauge", "The channel's output counts.",
+                    [](const channel_values& v) { return v.output_counts.load(); });
+    channels_family("pixie_channel_output_count_rate", "gauge",
+                    "The channel's output count rate in counts per second.",
+                    [](const channel_values& v) { return v.output_count_rate.load(); });
+    channels_family("pixie_channel_live_time_seconds", "gauge", "The channel's live time.",
+                    [](const channel_values& v) { return v.live_time.load(); });
+
+    out << "# EOF\n";
+    return out.str();
+}
+
+void exporter::worker() {
+    xia_log(log::debug) << "metrics: thread started";
+    typedef std::chrono::steady_clock clock;
+    auto next_stats = clock::now();
+    while (running_.load()) {
+        if (cfg.stats_period_msecs != 0 && clock::now() >= next_stats) {
+            poll_stats();
+            next_stats = clock::now() + std::chrono::milliseconds(cfg.stats_period_msecs);
+        }
+        try {
+            serve();
+        } catch (std::exception& e) {
+            xia_log(log::error) << "metrics: " << e.what();
+        }
+#if !defined(_WIN64) && !defined(_WIN32)
+        if (listen_fd >= 0) {
+            pollfd pfd = {};
+            pfd.fd = listen_fd;
+            pfd.events = POLLIN;
+            ::poll(&pfd, 1, serve_poll_msecs);
+            continue;
+        }
+#endif
+        std::this_thread::sleep_for(std::chrono::milliseconds(serve_poll_msecs));
+    }
+    xia_log(log::debug) << "metrics: thread stopped";
+}
+}  // namespace metrics
+}  // namespace pixie
+}  // namespace xia
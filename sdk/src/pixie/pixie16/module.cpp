@@ -22,12 +22,23 @@
 
 #include <algorithm>
 #include <cctype>
+#include <chrono>
 #include <cmath>
+#include <cstring>
+#include <exception>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
 
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
 #include <pixie/log.hpp>
+#include <pixie/profile.hpp>
+#include <pixie/tracepoint.hpp>
 #include <pixie/util.hpp>
 
 #include <pixie/pixie16/channel.hpp>
@@ -117,6 +128,8 @@ static const char* pci_error_labels[] = {"PLX_STATUS_OK",
 #define PLX_STATUS_INVALID_OBJECT ApiInvalidDeviceInfo
 #define PLX_STATUS_INVALID_ACCESS ApiDmaChannelUnavailable
 #define PLX_STATUS_IN_PROGRESS ApiDmaInProgress
+#define PLX_STATUS_TIMEOUT ApiWaitTimeout
+#define PLX_STATUS_CANCELED ApiWaitCanceled
 #define PLX_STATUS_RSVD_LAST_ERROR ApiLastError
 
 static const char* pci_error_labels[] = {"ApiSuccess",
@@ -169,6 +182,8 @@ struct pci_bus_handle {
     PLX_DEVICE_OBJECT handle;
     PLX_DEVICE_KEY key;
     PLX_DMA_PROP dma;
+    PLX_INTERRUPT irq;
+    PLX_NOTIFY_OBJECT notify;
     pci_bus_handle();
     unsigned int domain() const;
     unsigned int bus() const;
@@ -178,6 +193,8 @@ struct pci_bus_handle {
 pci_bus_handle::pci_bus_handle() : device_number(-1) {
     ::memset(&key, PCI_FIELD_IGNORE, sizeof(PLX_DEVICE_KEY));
     ::memset(&dma, 0, sizeof(PLX_DMA_PROP));
+    ::memset(&irq, 0, sizeof(PLX_INTERRUPT));
+    ::memset(&notify, 0, sizeof(PLX_NOTIFY_OBJECT));
     key.VendorId = vendor_id;
     key.DeviceId = device_id;
 }
@@ -208,20 +225,144 @@ std::string pci_error_text(PLX_STATUS ps) {
     return oss.str();
 }
 
-module::guard::guard(module& mod) : lock_(mod.lock_), guard_(lock_) {}
+/*
+ * The device keys of the last device scan in device number order.
+ */
+struct device_scan_cache {
+    std::mutex lock;
+    bool valid;
+    std::vector<PLX_DEVICE_KEY> keys;
+    device_scan_cache() : valid(false) {}
+};
+
+static device_scan_cache& scan_cache() {
+    static device_scan_cache cache;
+    return cache;
+}
+
+/*
+ * Find a device's key. The scan's key is used if there is a valid scan
+ * else the device is searched for. Returns false if the device is not
+ * found and sets cached if the key is the scan's key.
+ */
+static bool find_device(size_t device_number, PLX_DEVICE_KEY& key, bool& cached) {
+    auto& cache = scan_cache();
+    {
+        std::lock_guard<std::mutex> guard(cache.lock);
+        cached = cache.valid;
+        if (cached) {
+            if (device_number >= cache.keys.size()) {
+                return false;
+            }
+            key = cache.keys[device_number];
+            return true;
+        }
+    }
+    return ::PlxPci_DeviceFind(&key, uint16_t(device_number)) == PLX_STATUS_OK;
+}
+
+module::guard::guard(module& mod)
+    : module_(mod), lock_(mod.lock_), guard_(mod.lock_acquire(), std::adopt_lock) {}
 
 void module::guard::lock() {
-    lock_.lock();
+    module_.lock_acquire();
 }
 
 void module::guard::unlock() {
     lock_.unlock();
 }
 
-module::bus_guard::bus_guard(module& mod) : lock_(mod.bus_lock_), guard_(lock_) {}
+module::bus_stats::bus_stats()
+    : holds(0), fifo_holds(0), max_hold_usecs(0), max_fifo_hold_usecs(0), total_hold_usecs(0),
+      fifo_waits(0), waits(0), max_wait_usecs(0), total_wait_usecs(0) {}
+
+module::lock_stats::lock_stats() : locks(0), waits(0), max_wait_usecs(0), total_wait_usecs(0) {}
+
+module::bus_lock_type::bus_lock_type()
+    : locked(false), fifo_waiters(0), holder(bus_priority::normal) {}
+
+void module::bus_lock_type::lock(bus_priority priority) {
+    std::unique_lock<std::mutex> guard(mutex);
+    const bool contended =
+        locked || (priority == bus_priority::normal && fifo_waiters != 0);
+    const auto start = contended ? clock::now() : clock::time_point();
+    if (priority == bus_priority::fifo) {
+        if (locked) {
+            ++stats_.fifo_waits;
+            ++fifo_waiters;
+            released.wait(guard, [this] { return !locked; });
+            --fifo_waiters;
+        }
+    } else {
+        released.wait(guard, [this] { return !locked && fifo_waiters == 0; });
+    }
+    if (contended) {
+        auto waited = size_t(
+            std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - start).count());
+        ++stats_.waits;
+        stats_.total_wait_usecs += waited;
+        stats_.max_wait_usecs = std::max(stats_.max_wait_usecs, waited);
+    }
+    locked = true;
+    holder = priority;
+    acquired = clock::now();
+}
+
+bool module::bus_lock_type::held() {
+    std::lock_guard<std::mutex> guard(mutex);
+    return locked;
+}
+
+bool module::bus_lock_type::try_lock() {
+    std::lock_guard<std::mutex> guard(mutex);
+    if (locked || fifo_waiters != 0) {
+        return false;
+    }
+    locked = true;
+    holder = bus_priority::normal;
+    acquired = clock::now();
+    return true;
+}
+
+void module::bus_lock_type::unlock() {
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        auto held = size_t(
+            std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - acquired)
+                .count());
+        ++stats_.holds;
+        stats_.total_hold_usecs += held;
+        stats_.max_hold_usecs = std::max(stats_.max_hold_usecs, held);
+        if (holder == bus_priority::fifo) {
+            ++stats_.fifo_holds;
+            stats_.max_fifo_hold_usecs = std::max(stats_.max_fifo_hold_usecs, held);
+        }
+        locked = false;
+    }
+    released.notify_all();
+}
+
+module::bus_stats module::bus_lock_type::stats() const {
+    std::lock_guard<std::mutex> guard(mutex);
+    return stats_;
+}
+
+void module::bus_lock_type::stats_reset() {
+    std::lock_guard<std::mutex> guard(mutex);
+    stats_ = bus_stats();
+}
+
+module::bus_guard::bus_guard(module& mod, bus_priority priority_)
+    : lock_(mod.bus_lock_), priority(priority_) {
+    lock_.lock(priority);
+}
+
+module::bus_guard::~bus_guard() {
+    lock_.unlock();
+}
 
 void module::bus_guard::lock() {
-    lock_.lock();
+    lock_.lock(priority);
 }
 
 void module::bus_guard::unlock() {
@@ -243,16 +384,78 @@ void module::reg_trace_guard::disable() {
     reg_trace = false;
 }
 
+module::fifo_histogram::fifo_histogram() {
+    clear();
+}
+
+module::fifo_histogram::fifo_histogram(const fifo_histogram& h) {
+    *this = h;
+}
+
+module::fifo_histogram& module::fifo_histogram::operator=(const fifo_histogram& h) {
+    for (size_t b = 0; b < bins; ++b) {
+        counts[b].store(h.counts[b].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    return *this;
+}
+
+void module::fifo_histogram::record(size_t value) {
+    counts[bin(value)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void module::fifo_histogram::clear() {
+    for (auto& count : counts) {
+        count.store(0, std::memory_order_relaxed);
+    }
+}
+
+size_t module::fifo_histogram::bin(size_t value) {
+    size_t b = 0;
+    while (value != 0 && b < bins - 1) {
+        value >>= 1;
+        ++b;
+    }
+    return b;
+}
+
+size_t module::fifo_histogram::bin_lower(size_t bin) {
+    return bin == 0 ? 0 : size_t(1) << (bin - 1);
+}
+
+size_t module::fifo_histogram::total() const {
+    size_t sum = 0;
+    for (auto& count : counts) {
+        sum += count.load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+std::string module::fifo_histogram::output() const {
+    std::ostringstream oss;
+    const char* sep = "";
+    for (size_t b = 0; b < bins; ++b) {
+        auto count = counts[b].load(std::memory_order_relaxed);
+        if (count != 0) {
+            oss << sep << bin_lower(b) << ':' << count;
+            sep = " ";
+        }
+    }
+    return oss.str();
+}
+
 module::fifo_stats::fifo_stats() {
     clear();
 }
 
 module::fifo_stats::fifo_stats(const module::fifo_stats& s)
-    : in(s.in.load()), out(s.out.load()), dma_in(s.dma_in.load()),
-      overflows(s.overflows.load()), dropped(s.dropped.load()),
-      hw_overflows(s.hw_overflows.load()), bandwidth(s.bandwidth.load()),
+    : in(s.in.load()), dma_in(s.dma_in.load()), overflows(s.overflows.load()),
+      dropped(s.dropped.load()), filtered(s.filtered.load()), hw_overflows(s.hw_overflows.load()),
+      faults(s.faults.load()), bandwidth(s.bandwidth.load()),
       max_bandwidth(s.max_bandwidth.load()), min_bandwidth(s.min_bandwidth.load()),
-      last_update(0), last_dma_in(0) {
+      out(s.out.load()), level_words(s.level_words), dma_usecs(s.dma_usecs), dma_words(s.dma_words),
+      latency_usecs(s.latency_usecs), queue_depth(s.queue_depth), poll_usecs(s.poll_usecs),
+      compact_usecs(s.compact_usecs), allocations(s.allocations), last_update(0),
+      last_dma_in(0) {
 }
 
 void module::fifo_stats::start() {
@@ -277,10 +480,20 @@ void module::fifo_stats::clear() {
     dma_in = 0;
     overflows = 0;
     dropped = 0;
+    filtered = 0;
     hw_overflows = 0;
+    faults = 0;
     bandwidth = 0;
     max_bandwidth = 0;
     min_bandwidth = 0;
+    level_words.clear();
+    dma_usecs.clear();
+    dma_words.clear();
+    latency_usecs.clear();
+    queue_depth.clear();
+    poll_usecs.clear();
+    compact_usecs.clear();
+    allocations.reset();
     interval.reset();
     last_update = 0;
     last_dma_in = 0;
@@ -295,10 +508,20 @@ module::fifo_stats& module::fifo_stats::operator=(const module::fifo_stats& s) {
     dma_in = s.dma_in.load();
     overflows = s.overflows.load();
     dropped = s.dropped.load();
+    filtered = s.filtered.load();
     hw_overflows = s.hw_overflows.load();
+    faults = s.faults.load();
     bandwidth = s.bandwidth.load();
     max_bandwidth = s.max_bandwidth.load();
     min_bandwidth = s.min_bandwidth.load();
+    level_words = s.level_words;
+    dma_usecs = s.dma_usecs;
+    dma_words = s.dma_words;
+    latency_usecs = s.latency_usecs;
+    queue_depth = s.queue_depth;
+    poll_usecs = s.poll_usecs;
+    compact_usecs = s.compact_usecs;
+    allocations = s.allocations;
     return *this;
 }
 
@@ -332,7 +555,9 @@ std::string module::fifo_stats::output() const {
         << " out=" << get_out_bytes()
         << " dma-in=" << get_dma_in_bytes()
         << " overflows=" << overflows.load() << " dropped=" << dropped.load()
-        << " hw-overflows=" << hw_overflows.load();
+        << " filtered=" << filtered.load() << " hw-overflows=" << hw_overflows.load()
+        << " faults=" << faults.load()
+        << " allocations=" << allocations.allocations() << '/' << allocations.bytes();
     return oss.str();
 }
 
@@ -364,12 +589,17 @@ bool module::fifo_stats::calc_bandwidth(bool update_min_max) {
  * FIFO Worker settings
  */
 const size_t module::default_fifo_buffers = 100;
+const size_t module::default_fifo_buffer_words = 64 * 1024;
+const size_t module::default_fifo_tune_msecs = 2000;
 const size_t module::default_fifo_run_wait_usec = 5000;
 const size_t module::default_fifo_idle_wait_usec = 150000;
 const size_t module::default_fifo_hold_usec = 10000;
 const size_t module::default_fifo_dma_trigger_level = 1024;
+const size_t module::fifo_adaptive_target_level = hw::fifo_size_words / 4;
 const size_t module::min_fifo_buffers = 10;
 const size_t module::max_fifo_buffers = 10000000;
+const size_t module::min_fifo_buffer_words = fifo_tuner::min_buffer_words;
+const size_t module::max_fifo_buffer_words = fifo_tuner::max_buffer_words;
 const size_t module::min_fifo_run_wait_usec = 500;
 const size_t module::max_fifo_run_wait_usec = 200000;
 const size_t module::min_fifo_idle_wait_usec = 10000;
@@ -379,42 +609,233 @@ const size_t module::max_fifo_hold_usec = 100000;
 const size_t module::min_fifo_dma_trigger_level = 512;
 const size_t module::max_fifo_dma_trigger_level = hw::max_dma_block_size;
 
+fingerprint::fingerprint() : comms(0), fippi(0), dsp(0) {}
+
+worker_placement::worker_placement()
+    : pci_local(false), policy(util::sched_policy::other), priority(0), numa_local(false) {}
+
+list_mode_subscription::list_mode_subscription()
+    : threshold_words(0), timeout_usecs(0), max_buffers(0) {}
+
+fifo_rate::fifo_rate() : rate(0), valid(false) {}
+
+void fifo_rate::reset() {
+    rate = 0;
+    valid = false;
+}
+
+void fifo_rate::sample(size_t level, size_t remaining, size_t usecs) {
+    if (usecs == 0) {
+        return;
+    }
+    const size_t arrived = level > remaining ? level - remaining : 0;
+    const double sample_rate = double(arrived) / usecs;
+    if (valid) {
+        rate += smoothing * (sample_rate - rate);
+    } else {
+        rate = sample_rate;
+        valid = true;
+    }
+}
+
+size_t fifo_rate::wait_usecs(size_t level, size_t target, size_t min_wait,
+                             size_t max_wait) const {
+    if (!valid || rate <= 0) {
+        return max_wait;
+    }
+    const size_t room = target > level ? target - level : 0;
+    const double wait = room / rate;
+    if (wait < double(min_wait)) {
+        return min_wait;
+    }
+    if (wait > double(max_wait)) {
+        return max_wait;
+    }
+    return size_t(wait);
+}
+
+size_t fifo_rate::trigger_level(size_t wait, size_t min_level, size_t max_level) const {
+    const double expected = rate * wait;
+    if (expected < double(min_level)) {
+        return min_level;
+    }
+    if (expected > double(max_level)) {
+        return max_level;
+    }
+    return size_t(expected);
+}
+
+fifo_tuning::fifo_tuning()
+    : buffer_words(0), buffers(0), dmas(0), max_dma_words(0), max_event_words(0),
+      max_queue_depth(0), capped(false), over_budget(false), valid(false) {}
+
+constexpr size_t fifo_tuner::headroom_buffers;
+constexpr size_t fifo_tuner::min_buffer_words;
+constexpr size_t fifo_tuner::max_buffer_words;
+
+fifo_tuner::fifo_tuner() {
+    reset();
+}
+
+void fifo_tuner::reset() {
+    dmas = 0;
+    max_dma_words = 0;
+    max_event_words = 0;
+    max_queue_depth = 0;
+    capacity = 0;
+    capped = false;
+    carry = 0;
+}
+
+void fifo_tuner::sample(const hw::word* data, size_t words, size_t buffer_capacity,
+                        size_t depth) {
+    ++dmas;
+    max_dma_words = std::max(max_dma_words, words);
+    max_queue_depth = std::max(max_queue_depth, depth);
+    if (words >= buffer_capacity) {
+        capped = true;
+        capacity = std::max(capacity, buffer_capacity);
+    }
+    /*
+     * Walk the event headers. An event can span transfers so the words of
+     * the last event in this transfer are skipped in the next. A length
+     * of 0 is not event data and the walk stops.
+     */
+    size_t w = carry;
+    carry = 0;
+    while (w < words) {
+        const size_t length = (data[w] >> 17) & 0x3FFF;
+        if (length == 0) {
+            return;
+        }
+        max_event_words = std::max(max_event_words, length);
+        w += length;
+    }
+    carry = w - words;
+}
+
+fifo_tuning fifo_tuner::tune(size_t budget_bytes, size_t min_buffers, size_t max_buffers) const {
+    fifo_tuning tuning;
+    if (dmas == 0) {
+        return tuning;
+    }
+    size_t words = std::max(max_dma_words, max_event_words);
+    if (capped) {
+        words = std::max(words, capacity * 2);
+    }
+    size_t buffer_words = min_buffer_words;
+    while (buffer_words < words && buffer_words < max_buffer_words) {
+        buffer_words <<= 1;
+    }
+    size_t buffers = 2 * max_queue_depth + headroom_buffers;
+    buffers = std::min(std::max(buffers, min_buffers), max_buffers);
+    if (budget_bytes != 0) {
+        const size_t min_buffers_held =
+            std::min(std::max(min_buffers, max_queue_depth + headroom_buffers), buffers);
+        const size_t min_words = std::max(size_t(min_buffer_words), max_event_words);
+        while (buffers * buffer_words * sizeof(hw::word) > budget_bytes) {
+            if (buffers > min_buffers_held) {
+                buffers = std::max(min_buffers_held,
+                                   budget_bytes / (buffer_words * sizeof(hw::word)));
+            } else if (buffer_words / 2 >= min_words) {
+                buffer_words /= 2;
+            } else {
+                tuning.over_budget = true;
+                break;
+            }
+        }
+    }
+    tuning.buffer_words = buffer_words;
+    tuning.buffers = buffers;
+    tuning.dmas = dmas;
+    tuning.max_dma_words = max_dma_words;
+    tuning.max_event_words = max_event_words;
+    tuning.max_queue_depth = max_queue_depth;
+    tuning.capped = capped;
+    tuning.valid = true;
+    return tuning;
+}
+
+param_write::param_write(param::module_param par, param::value_type value_)
+    : module_par(true), mod_par(par), chan_par(param::channel_param::END), channel(0),
+      value(double(value_)) {}
+
+param_write::param_write(param::channel_param par, size_t channel_, double value_)
+    : module_par(false), mod_par(param::module_param::END), chan_par(par), channel(channel_),
+      value(value_) {}
+
 module::module(backplane::backplane& backplane_)
     : slot(0), number(-1), serial_num(0), revision(0), major_revision(0), minor_revision(0),
       num_channels(0), vmaddr(nullptr), backplane(backplane_), eeprom_format(-1),
+      hw_access(&hw::access::select(0)),
       run_task(hw::run::run_task::nop), control_task(hw::run::control_task::nop),
-      fifo_buffers(default_fifo_buffers), fifo_run_wait_usecs(default_fifo_run_wait_usec),
+      fifo_buffers(default_fifo_buffers), fifo_buffers_max(0),
+      fifo_buffer_words(default_fifo_buffer_words), fifo_run_wait_usecs(default_fifo_run_wait_usec),
       fifo_idle_wait_usecs(default_fifo_idle_wait_usec), fifo_hold_usecs(default_fifo_hold_usec),
       fifo_dma_trigger_level(default_fifo_dma_trigger_level), fifo_bandwidth(0),
-      crate_revision(-1), board_revision(-1), reg_trace(false), i2c_read_period(100),
-      io_cpld_version_old(false), fifo_worker_running(false), fifo_worker_finished(false),
-      fifo_worker_req(fifo_worker_working), fifo_worker_resp(fifo_worker_working), in_use(0),
-      present_(false), online_(false), forced_offline_(false), pause_fifo_worker(true),
+      fifo_interrupt(false), fifo_crc(false), fifo_adaptive(false), fifo_huge_pages(false),
+      fifo_steady_state(false), fifo_auto_tune(false), fifo_tune_budget(0),
+      fifo_tune_msecs(default_fifo_tune_msecs), fifo_direct(false), fifo_filtering(false),
+      fifo_validating(false), fifo_capturing(false), mca_clear_policy(mca_clear::run_start), run_mca_cleared(false),
+      crate_revision(-1),
+      board_revision(-1),
+      reg_trace(false), i2c_read_period(100), io_cpld_version_old(false), fifo_worker_running(false),
+      fifo_worker_finished(false), fifo_worker_req(fifo_worker_working),
+      fifo_worker_resp(fifo_worker_working), fifo_worker_requested(false),
+      fifo_irq_running(false), fifo_irq_pending(false), fifo_crc_value(0),
+      fifo_tuning_run(false), fifo_tune_pending(false), fifo_subscribed(false), fifo_notify_threshold(0), fifo_notify_pending(false),
+      fifo_notify(fifo_notify_lock), fifo_notify_running(false), fifo_event_fd(-1),
+      in_use(0), present_(false), online_(false), forced_offline_(false), pause_fifo_worker(true),
+      run_prepared(false), mca_memory_(mca_state::dirty), mca_clear_abort(false),
       comms_fpga(false), fippi_fpga(false), have_hardware(false), vars_loaded(false),
-      cfg_ctrlcs(0xaaa), device(std::make_unique<pci_bus_handle>()), test_mode(test::off) {}
+      cfg_ctrlcs(0xaaa), batch_depth(0), batch_program_fippi(false), batch_set_dacs(false),
+      staging(false), staged_program_fippi(false), staged_set_dacs(false),
+      device(std::make_unique<pci_bus_handle>()), test_mode(test::off) {}
 
 module::module(module&& m)
     : slot(m.slot), number(m.number), serial_num(m.serial_num), revision(m.revision),
       major_revision(0), minor_revision(0), num_channels(m.num_channels), vmaddr(m.vmaddr),
       backplane(m.backplane), eeprom(m.eeprom), eeprom_format(m.eeprom_format),
+      hw_access(m.hw_access),
       module_var_descriptors(std::move(m.module_var_descriptors)),
       module_vars(std::move(m.module_vars)),
       channel_var_descriptors(std::move(m.channel_var_descriptors)),
-      channels(std::move(m.channels)), firmware(std::move(m.firmware)), run_task(m.run_task.load()),
+      channels(std::move(m.channels)), var_image(std::move(m.var_image)),
+      firmware(std::move(m.firmware)), run_task(m.run_task.load()),
       control_task(m.control_task.load()), fifo_buffers(m.fifo_buffers),
+      fifo_buffers_max(m.fifo_buffers_max), fifo_buffer_words(m.fifo_buffer_words),
       fifo_run_wait_usecs(m.fifo_run_wait_usecs.load()),
       fifo_idle_wait_usecs(m.fifo_idle_wait_usecs.load()),
       fifo_hold_usecs(m.fifo_hold_usecs.load()),
       fifo_dma_trigger_level(m.fifo_dma_trigger_level.load()),
-      fifo_bandwidth(m.fifo_bandwidth.load()),
-      run_stats(m.run_stats), crate_revision(m.crate_revision),
-      board_revision(m.board_revision), reg_trace(m.reg_trace), i2c_read_period(100),
+      fifo_bandwidth(m.fifo_bandwidth.load()), fifo_interrupt(m.fifo_interrupt.load()),
+      fifo_crc(m.fifo_crc.load()), fifo_adaptive(m.fifo_adaptive.load()),
+      fifo_huge_pages(m.fifo_huge_pages.load()), fifo_steady_state(m.fifo_steady_state.load()),
+      fifo_auto_tune(m.fifo_auto_tune.load()), fifo_tune_budget(m.fifo_tune_budget.load()),
+      fifo_tune_msecs(m.fifo_tune_msecs.load()), fifo_direct(m.fifo_direct.load()),
+      fifo_placement(m.fifo_placement), fifo_filter(m.fifo_filter),
+      fifo_filtering(m.fifo_filtering.load()), fifo_validator(m.fifo_validator),
+      fifo_validating(m.fifo_validating.load()), fifo_capturing(false), run_stats(m.run_stats),
+      task_latencies(m.task_latencies), mca_clear_policy(m.mca_clear_policy.load()),
+      run_mca_cleared(m.run_mca_cleared.load()),
+      crate_revision(m.crate_revision), board_revision(m.board_revision), reg_trace(m.reg_trace),
+      i2c_read_period(100),
       io_cpld_version_old(false), fifo_worker_running(false), fifo_worker_finished(false),
       fifo_worker_req(fifo_worker_working), fifo_worker_resp(fifo_worker_working),
-      in_use(0), present_(m.present_.load()), online_(m.online_.load()),
+      fifo_worker_requested(false), fifo_irq_running(false), fifo_irq_pending(false),
+      fifo_crc_value(m.fifo_crc_value.load()), fifo_tuning_run(false), fifo_tuned(m.fifo_tuned),
+      fifo_tune_pending(false), fifo_subscribed(false),
+      fifo_notify_threshold(0), fifo_notify_pending(false), fifo_notify(fifo_notify_lock),
+      fifo_notify_running(false), fifo_event_fd(-1), in_use(0),
+      present_(m.present_.load()), online_(m.online_.load()),
       forced_offline_(m.forced_offline_.load()), pause_fifo_worker(m.pause_fifo_worker.load()),
+      run_prepared(m.run_prepared.load()), mca_memory_(mca_state::dirty), mca_clear_abort(false),
       comms_fpga(m.comms_fpga), fippi_fpga(m.fippi_fpga), have_hardware(false), vars_loaded(false),
-      cfg_ctrlcs(0xaaa), device(std::move(m.device)), test_mode(m.test_mode.load()) {
+      cfg_ctrlcs(0xaaa), batch_depth(0), batch_program_fippi(false), batch_set_dacs(false),
+      staging(false), staged_program_fippi(false), staged_set_dacs(false),
+      device(std::move(m.device)), test_mode(m.test_mode.load()) {
+    m.wait_mca_clear();
+    mca_memory_ = m.mca_memory_.load();
     m.slot = 0;
     m.number = -1;
     m.serial_num = 0;
@@ -429,15 +850,38 @@ module::module(module&& m)
     m.module_vars.clear();
     m.channel_var_descriptors.clear();
     m.channels.clear();
+    m.var_image.clear();
     m.run_task = hw::run::run_task::nop;
     m.control_task = hw::run::control_task::nop;
     m.fifo_buffers = default_fifo_buffers;
+    m.fifo_buffers_max = 0;
+    m.fifo_buffer_words = default_fifo_buffer_words;
     m.fifo_run_wait_usecs = default_fifo_run_wait_usec;
     m.fifo_idle_wait_usecs = default_fifo_idle_wait_usec;
     m.fifo_hold_usecs = default_fifo_hold_usec;
     m.fifo_dma_trigger_level = default_fifo_dma_trigger_level;
     m.fifo_bandwidth = 0;
+    m.fifo_interrupt = false;
+    m.fifo_crc = false;
+    m.fifo_adaptive = false;
+    m.fifo_huge_pages = false;
+    m.fifo_steady_state = false;
+    m.fifo_auto_tune = false;
+    m.fifo_tune_budget = 0;
+    m.fifo_tune_msecs = default_fifo_tune_msecs;
+    m.fifo_direct = false;
+    m.fifo_placement = worker_placement();
+    m.fifo_filter = data::list_mode::event_filter();
+    m.fifo_filtering = false;
+    m.fifo_validator = data::list_mode::event_validator();
+    m.fifo_validating = false;
+    m.fifo_crc_value = 0;
+    m.fifo_tuned = fifo_tuning();
     m.run_stats.clear();
+    m.task_latencies.clear();
+    m.mca_clear_policy = mca_clear::run_start;
+    m.run_mca_cleared = false;
+    m.mca_memory_ = mca_state::dirty;
     m.crate_revision = -1;
     m.board_revision = -1;
     m.reg_trace = false;
@@ -462,6 +906,8 @@ module::~module() {
     } catch (pixie::error::error& e) {
         xia_log(log::error) << e;
     }
+    mca_clear_abort = true;
+    wait_mca_clear();
     device.release();
 }
 
@@ -477,6 +923,7 @@ module& module::operator=(module&& m) {
     number = m.number;
     serial_num = m.serial_num;
     revision = m.revision;
+    hw_access = m.hw_access;
     major_revision = m.major_revision;
     minor_revision = m.minor_revision;
     num_channels = m.num_channels;
@@ -487,15 +934,40 @@ module& module::operator=(module&& m) {
     channel_var_descriptors = std::move(m.channel_var_descriptors);
     module_vars = std::move(m.module_vars);
     channels = std::move(m.channels);
+    var_image = std::move(m.var_image);
     run_task = m.run_task.load();
     control_task = m.control_task.load();
     fifo_buffers = m.fifo_buffers;
+    fifo_buffers_max = m.fifo_buffers_max;
+    fifo_buffer_words = m.fifo_buffer_words;
     fifo_run_wait_usecs = m.fifo_run_wait_usecs.load();
     fifo_idle_wait_usecs = m.fifo_idle_wait_usecs.load();
     fifo_hold_usecs = m.fifo_hold_usecs.load();
     fifo_dma_trigger_level = m.fifo_dma_trigger_level.load();
     fifo_bandwidth = m.fifo_bandwidth.load();
+    fifo_interrupt = m.fifo_interrupt.load();
+    fifo_crc = m.fifo_crc.load();
+    fifo_adaptive = m.fifo_adaptive.load();
+    fifo_huge_pages = m.fifo_huge_pages.load();
+    fifo_steady_state = m.fifo_steady_state.load();
+    fifo_auto_tune = m.fifo_auto_tune.load();
+    fifo_tune_budget = m.fifo_tune_budget.load();
+    fifo_tune_msecs = m.fifo_tune_msecs.load();
+    fifo_direct = m.fifo_direct.load();
+    fifo_placement = m.fifo_placement;
+    fifo_filter = m.fifo_filter;
+    fifo_filtering = m.fifo_filtering.load();
+    fifo_validator = m.fifo_validator;
+    fifo_validating = m.fifo_validating.load();
+    fifo_crc_value = m.fifo_crc_value.load();
+    fifo_tuned = m.fifo_tuned;
     run_stats = m.run_stats;
+    task_latencies = m.task_latencies;
+    wait_mca_clear();
+    m.wait_mca_clear();
+    mca_clear_policy = m.mca_clear_policy.load();
+    run_mca_cleared = m.run_mca_cleared.load();
+    mca_memory_ = m.mca_memory_.load();
     crate_revision = m.crate_revision;
     board_revision = m.board_revision;
     reg_trace = m.reg_trace;
@@ -505,6 +977,7 @@ module& module::operator=(module&& m) {
     online_ = m.online_.load();
     forced_offline_ = m.forced_offline_.load();
     pause_fifo_worker = m.pause_fifo_worker.load();
+    run_prepared = m.run_prepared.load();
     comms_fpga = m.comms_fpga;
     fippi_fpga = m.fippi_fpga;
     have_hardware = m.have_hardware;
@@ -527,12 +1000,34 @@ module& module::operator=(module&& m) {
     m.run_task = hw::run::run_task::nop;
     m.control_task = hw::run::control_task::nop;
     m.fifo_buffers = default_fifo_buffers;
+    m.fifo_buffers_max = 0;
+    m.fifo_buffer_words = default_fifo_buffer_words;
     m.fifo_run_wait_usecs = default_fifo_run_wait_usec;
     m.fifo_idle_wait_usecs = default_fifo_idle_wait_usec;
     m.fifo_hold_usecs = default_fifo_hold_usec;
     m.fifo_dma_trigger_level = default_fifo_dma_trigger_level;
     m.fifo_bandwidth = 0;
+    m.fifo_interrupt = false;
+    m.fifo_crc = false;
+    m.fifo_adaptive = false;
+    m.fifo_huge_pages = false;
+    m.fifo_steady_state = false;
+    m.fifo_auto_tune = false;
+    m.fifo_tune_budget = 0;
+    m.fifo_tune_msecs = default_fifo_tune_msecs;
+    m.fifo_direct = false;
+    m.fifo_placement = worker_placement();
+    m.fifo_filter = data::list_mode::event_filter();
+    m.fifo_filtering = false;
+    m.fifo_validator = data::list_mode::event_validator();
+    m.fifo_validating = false;
+    m.fifo_crc_value = 0;
+    m.fifo_tuned = fifo_tuning();
     m.run_stats.clear();
+    m.task_latencies.clear();
+    m.mca_clear_policy = mca_clear::run_start;
+    m.run_mca_cleared = false;
+    m.mca_memory_ = mca_state::dirty;
     m.crate_revision = -1;
     m.board_revision = -1;
     m.reg_trace = false;
@@ -581,8 +1076,8 @@ void module::open(size_t device_number) {
     if (!device_present()) {
         PLX_STATUS ps;
 
-        ps = ::PlxPci_DeviceFind(&device->key, uint16_t(device_number));
-        if (ps != PLX_STATUS_OK) {
+        bool cached;
+        if (!find_device(device_number, device->key, cached)) {
             /*
              * Module not found so the device is not present. Users
              * need to check for the device or module being present.
@@ -590,12 +1085,26 @@ void module::open(size_t device_number) {
             return;
         }
 
+        ps = ::PlxPci_DeviceOpen(&device->key, &device->handle);
+        if (ps != PLX_STATUS_OK && cached) {
+            /*
+             * The bus has changed since the scan. Search for the device.
+             */
+            xia_log(log::warning) << "module: open: device: " << device_number
+                                  << ": scanned device not found, searching";
+            device_scan_reset();
+            device = std::make_unique<pci_bus_handle>();
+            if (!find_device(device_number, device->key, cached)) {
+                return;
+            }
+            ps = ::PlxPci_DeviceOpen(&device->key, &device->handle);
+        }
+
         /*
          * The module device is present.
          */
         device->device_number = int(device_number);
 
-        ps = ::PlxPci_DeviceOpen(&device->key, &device->handle);
         if (ps != PLX_STATUS_OK) {
             std::ostringstream oss;
             oss << "PCI open: device: " << device_number << ": " << pci_error_text(ps);
@@ -704,7 +1213,25 @@ void module::open(size_t device_number) {
                             << ", board version: " << std::hex << board_revision;
 
         hw::i2c::i2cm24c64 i2cm24c64(*this, hw::device::I2CM24C64, i2c_SDA, i2c_SCL, i2c_CTRL);
-        i2cm24c64.read(0, hw::eeprom_block_size, eeprom.data);
+
+        /*
+         * Read the EEPROM's header and use the host's cached contents if
+         * the header matches else sequentially read the rest of the block.
+         */
+        bool eeprom_cached = false;
+        if (pixie::eeprom::cache_enabled()) {
+            pixie::eeprom::contents header;
+            i2cm24c64.read(0, pixie::eeprom::header::size, header);
+            eeprom_cached = pixie::eeprom::cache_find(header, eeprom.data);
+            if (!eeprom_cached) {
+                pixie::eeprom::contents rest;
+                i2cm24c64.read(int(header.size()), hw::eeprom_block_size - header.size(), rest);
+                eeprom.data = header;
+                eeprom.data.insert(eeprom.data.end(), rest.begin(), rest.end());
+            }
+        } else {
+            i2cm24c64.read(0, hw::eeprom_block_size, eeprom.data);
+        }
 
         if (eeprom.data.size() != hw::eeprom_block_size) {
             have_hardware = false;
@@ -719,6 +1246,10 @@ void module::open(size_t device_number) {
 
         eeprom.process();
 
+        if (!eeprom_cached) {
+            pixie::eeprom::cache_add(eeprom.data);
+        }
+
         num_channels = eeprom.num_channels;
         max_channels = eeprom.max_channels;
         serial_num = eeprom.serial_num;
@@ -734,6 +1265,7 @@ void module::open(size_t device_number) {
 
         fixtures = fixture::make(*this);
         run_config = hw::run::make(*this);
+        hw_access = &hw::access::make(*this);
 
         start_fifo_services();
 
@@ -742,6 +1274,11 @@ void module::open(size_t device_number) {
 }
 
 void module::close() {
+    /*
+     * The dispatcher reads the data with the module lock held.
+     */
+    unsubscribe_list_mode();
+
     lock_guard guard(lock_);
 
     if (online()) {
@@ -750,6 +1287,9 @@ void module::close() {
         }
     }
 
+    mca_clear_abort = true;
+    wait_mca_clear();
+
     if (device && device->device_number >= 0) {
         PLX_STATUS ps_dma;
         PLX_STATUS ps_unmap_bar = PLX_STATUS_OK;
@@ -834,6 +1374,7 @@ void module::check_channel_num(T num) {
 }
 
 void module::probe() {
+    PIXIE_PROFILE_SCOPE("module::probe");
     lock_guard guard(lock_);
 
     if (!present()) {
@@ -873,6 +1414,7 @@ void module::probe() {
 }
 
 void module::boot(bool boot_comms, bool boot_fippi, bool boot_dsp) {
+    PIXIE_PROFILE_SCOPE("module::boot");
     lock_guard guard(lock_);
 
     if (!present()) {
@@ -916,7 +1458,7 @@ void module::boot(bool boot_comms, bool boot_fippi, bool boot_dsp) {
         hw::fpga::comms comms(*this);
         comms_fpga = false;
         fw->load();
-        comms.boot(fw->data, io_cpld_backoff);
+        comms.boot(*fw->get_image(), io_cpld_backoff);
         comms_fpga = comms.done();
         if (comms_fpga) {
             fixtures->fgpa_comms_loaded();
@@ -935,7 +1477,7 @@ void module::boot(bool boot_comms, bool boot_fippi, bool boot_dsp) {
         hw::fpga::fippi fippi(*this);
         fippi_fpga = false;
         fw->load();
-        fippi.boot(fw->data, io_cpld_backoff);
+        fippi.boot(*fw->get_image(), io_cpld_backoff);
         fippi_fpga = fippi.done();
         if (fippi_fpga) {
             fixtures->fgpa_fippi_loaded();
@@ -954,7 +1496,8 @@ void module::boot(bool boot_comms, bool boot_fippi, bool boot_dsp) {
         hw::dsp::dsp dsp(*this);
         dsp_online = false;
         fw->load();
-        dsp.boot(fw->data);
+        dsp.boot(*fw->get_image());
+        invalidate_vars();
         dsp_online = dsp.init_done();
         if (dsp_online) {
             fixtures->dsp_loaded();
@@ -980,6 +1523,38 @@ void module::boot(bool boot_comms, bool boot_fippi, bool boot_dsp) {
     }
 }
 
+bool module::boot_changed(fingerprint& loaded) {
+    auto expected = firmware_fingerprint();
+    bool boot_comms = !comms_fpga || loaded.comms != expected.comms;
+    bool boot_fippi = !fippi_fpga || loaded.fippi != expected.fippi;
+    bool boot_dsp = !dsp_online || loaded.dsp != expected.dsp;
+    xia_log(log::info) << module_label(*this) << std::boolalpha
+                       << "boot changed: sys-fpga=" << boot_comms << " fippi-fpga=" << boot_fippi
+                       << " dsp=" << boot_dsp;
+    bool booted = boot_comms || boot_fippi || boot_dsp;
+    if (booted || !online()) {
+        boot(boot_comms, boot_fippi, boot_dsp);
+    }
+    loaded.comms = comms_fpga ? expected.comms : 0;
+    loaded.fippi = fippi_fpga ? expected.fippi : 0;
+    loaded.dsp = dsp_online ? expected.dsp : 0;
+    return booted;
+}
+
+fingerprint module::firmware_fingerprint() {
+    fingerprint fp;
+    firmware::firmware_ref comms = get("sys");
+    firmware::firmware_ref fippi = get("fippi");
+    firmware::firmware_ref dsp = get("dsp");
+    comms->load();
+    fippi->load();
+    dsp->load();
+    fp.comms = comms->crc;
+    fp.fippi = fippi->crc;
+    fp.dsp = dsp->crc;
+    return fp;
+}
+
 void module::initialize() {
     if (fixtures) {
         fixtures->initialize();
@@ -1032,12 +1607,12 @@ firmware::firmware_ref module::get(const std::string device) {
 }
 
 param::value_type module::read(const std::string& par) {
-    xia_log(log::info) << module_label(*this) << "read: par=" << par;
+    xia_logc(log::param, log::info) << module_label(*this) << "read: par=" << par;
     return read(param::lookup_module_param(par));
 }
 
 param::value_type module::read(param::module_param par) {
-    xia_log(log::debug) << module_label(*this) << "read: par=" << int(par);
+    xia_logc(log::param, log::debug) << module_label(*this) << "read: par=" << int(par);
     online_check();
     const param::module_var var = param::map_module_param(par);
     size_t offset;
@@ -1050,12 +1625,12 @@ param::value_type module::read(param::module_param par) {
 }
 
 double module::read(const std::string& par, size_t channel) {
-    xia_log(log::info) << module_label(*this) << "read: par=" << par;
+    xia_logc(log::param, log::info) << module_label(*this) << "read: par=" << par;
     return read(param::lookup_channel_param(par), channel);
 }
 
 double module::read(param::channel_param par, size_t channel) {
-    xia_log(log::debug) << module_label(*this) << "read: par=" << int(par);
+    xia_logc(log::param, log::debug) << module_label(*this) << "read: par=" << int(par);
     online_check();
     channel_check(channel);
     lock_guard guard(lock_);
@@ -1168,13 +1743,14 @@ double module::read(param::channel_param par, size_t channel) {
 }
 
 bool module::write(const std::string& par, param::value_type value) {
-    xia_log(log::info) << module_label(*this) << "write: module par=" << par << " value=" << value;
+    xia_logc(log::param, log::info) << module_label(*this) << "write: module par=" << par
+                                    << " value=" << value;
     return write(param::lookup_module_param(par), value);
 }
 
 bool module::write(param::module_param par, param::value_type value) {
-    xia_log(log::debug) << module_label(*this) << "write: module par=" << int(par)
-                        << " value=" << value;
+    xia_logc(log::param, log::debug) << module_label(*this) << "write: module par=" << int(par)
+                                     << " value=" << value;
     online_check();
     std::ostringstream oss;
     size_t offset = 0;
@@ -1224,14 +1800,14 @@ bool module::write(param::module_param par, param::value_type value) {
 }
 
 void module::write(const std::string& par, size_t channel, double value) {
-    xia_log(log::info) << module_label(*this) << "write: par=" << par << " channel=" << channel
-                       << " value=" << value;
+    xia_logc(log::param, log::info) << module_label(*this) << "write: par=" << par << " channel="
+                                    << channel << " value=" << value;
     write(param::lookup_channel_param(par), channel, value);
 }
 
 void module::write(param::channel_param par, size_t channel, double value) {
-    xia_log(log::debug) << module_label(*this) << "write: par=" << int(par) << " channel=" << channel
-                        << " value=" << value;
+    xia_logc(log::param, log::debug) << module_label(*this) << "write: par=" << int(par)
+                                     << " channel=" << channel << " value=" << value;
     online_check();
     channel_check(channel);
     std::ostringstream oss;
@@ -1341,9 +1917,150 @@ void module::write(param::channel_param par, size_t channel, double value) {
     }
 }
 
+bool module::write_batch(const param_writes& writes) {
+    xia_logc(log::param, log::info) << module_label(*this) << "write batch: writes="
+                                    << writes.size();
+    online_check();
+    lock_guard guard(lock_);
+    bool bcast = false;
+    ++batch_depth;
+    try {
+        for (auto& w : writes) {
+            if (w.module_par) {
+                if (write(w.mod_par, param::value_type(w.value))) {
+                    bcast = true;
+                }
+            } else {
+                write(w.chan_par, w.channel, w.value);
+            }
+        }
+    } catch (...) {
+        /*
+         * The writes applied before the failure still need their control
+         * tasks. The tasks are run if this is the outermost batch and a
+         * task's failure is logged so the write's error is reported.
+         */
+        if (--batch_depth == 0) {
+            try {
+                run_batch_controls();
+            } catch (std::exception& e) {
+                xia_logc(log::param, log::error) << module_label(*this)
+                                                 << "write batch: control: " << e.what();
+            }
+        }
+        throw;
+    }
+    if (--batch_depth == 0) {
+        run_batch_controls();
+    }
+    return bcast;
+}
+
+void module::run_batch_controls() {
+    const bool program_fippi = batch_program_fippi;
+    const bool set_dacs = batch_set_dacs;
+    batch_program_fippi = false;
+    batch_set_dacs = false;
+    if (program_fippi) {
+        hw::run::control(*this, hw::run::control_task::program_fippi);
+    }
+    if (set_dacs) {
+        hw::run::control(*this, hw::run::control_task::set_dacs);
+    }
+}
+
+bool module::stage_writes(const param_writes& writes) {
+    xia_logc(log::param, log::info) << module_label(*this) << "stage writes: writes="
+                                    << writes.size();
+    online_check();
+    lock_guard guard(lock_);
+    staging = true;
+    bool bcast = false;
+    for (auto& w : writes) {
+        if (w.module_par) {
+            if (write(w.mod_par, param::value_type(w.value))) {
+                bcast = true;
+            }
+        } else {
+            write(w.chan_par, w.channel, w.value);
+        }
+    }
+    return bcast;
+}
+
+void module::commit_staged() {
+    online_check();
+    lock_guard guard(lock_);
+    if (!staging.load()) {
+        return;
+    }
+    if (run_active()) {
+        throw error(number, slot, error::code::module_invalid_operation,
+                    "commit staged: run active");
+    }
+    const bool program_fippi = staged_program_fippi;
+    const bool set_dacs = staged_set_dacs;
+    xia_log(log::info) << module_label(*this) << std::boolalpha
+                       << "commit staged: program_fippi=" << program_fippi
+                       << " set_dacs=" << set_dacs;
+    staging = false;
+    staged_program_fippi = false;
+    staged_set_dacs = false;
+    sync_vars();
+    if (program_fippi) {
+        hw::run::control(*this, hw::run::control_task::program_fippi);
+    }
+    if (set_dacs) {
+        hw::run::control(*this, hw::run::control_task::set_dacs);
+    }
+}
+
+void module::discard_staged() {
+    online_check();
+    lock_guard guard(lock_);
+    if (!staging.load()) {
+        return;
+    }
+    xia_log(log::info) << module_label(*this) << "discard staged";
+    staging = false;
+    staged_program_fippi = false;
+    staged_set_dacs = false;
+    sync_vars(sync_from_dsp);
+}
+
+bool module::defer_control(hw::run::control_task task) {
+    lock_guard guard(lock_);
+    if (staging.load()) {
+        switch (task) {
+            case hw::run::control_task::program_fippi:
+                staged_program_fippi = true;
+                return true;
+            case hw::run::control_task::set_dacs:
+                staged_set_dacs = true;
+                return true;
+            default:
+                break;
+        }
+    }
+    if (batch_depth == 0) {
+        return false;
+    }
+    switch (task) {
+        case hw::run::control_task::program_fippi:
+            batch_program_fippi = true;
+            break;
+        case hw::run::control_task::set_dacs:
+            batch_set_dacs = true;
+            break;
+        default:
+            return false;
+    }
+    return true;
+}
+
 param::value_type module::read_var(const std::string& var, size_t channel, size_t offset, bool io) {
-    xia_log(log::info) << module_label(*this) << "read: var=" << var << " channel=" << channel
-                       << " offset=" << offset << " io=" << io;
+    xia_logc(log::param, log::info) << module_label(*this) << "read: var=" << var << " channel="
+                                    << channel << " offset=" << offset << " io=" << io;
     if (param::is_module_var(var)) {
         return read_var(param::lookup_module_var(var), offset, io);
     } else if (param::is_channel_var(var)) {
@@ -1362,8 +2079,8 @@ param::value_type module::read_var(param::module_var var, size_t offset, bool io
         throw error(number, slot, error::code::module_invalid_var, oss.str());
     }
     const auto& desc = module_var_descriptors[index];
-    xia_log(log::debug) << module_label(*this) << "read_var: module var=" << desc.name
-                        << " offset=" << offset;
+    xia_logc(log::param, log::debug) << module_label(*this) << "read_var: module var=" << desc.name
+                                     << " offset=" << offset;
     if (desc.state == param::disable) {
         throw error(number, slot, error::code::module_param_disabled,
                     "module variable disabled: " + desc.name);
@@ -1379,18 +2096,26 @@ param::value_type module::read_var(param::module_var var, size_t offset, bool io
     param::value_type value;
     {
         lock_guard guard(lock_);
-        if (have_hardware && io) {
+        auto& data = module_vars[index].value[offset];
+        /*
+         * A staged value is not in the DSP.
+         */
+        const bool staged_value = staging.load() && data.dirty;
+        if (have_hardware && io && (desc.mode == param::ro || (!data.cached && !staged_value))) {
             hw::memory::dsp dsp(*this);
             hw::word mem = dsp.read(offset, desc.address);
             hw::convert(mem, value);
-            module_vars[index].value[offset].value = value;
-            module_vars[index].value[offset].dirty = false;
+            data.value = value;
+            data.dirty = false;
+            data.cached = true;
+            image_var(hw::address(desc.address + offset), mem, false);
         } else {
-            value = module_vars[index].value[offset].value;
+            value = data.value;
         }
     }
-    xia_log(log::debug) << module_label(*this) << "read_var: module var=" << desc.name << " value["
-                        << offset << "]=" << value << " (0x" << std::hex << value << ')';
+    xia_logc(log::param, log::debug) << module_label(*this) << "read_var: module var=" << desc.name
+                                     << " value[" << offset << "]=" << value << " (0x" << std::hex
+                                     << value << ')';
     return value;
 }
 
@@ -1404,8 +2129,9 @@ param::value_type module::read_var(param::channel_var var, size_t channel, size_
         throw error(number, slot, error::code::channel_invalid_var, oss.str());
     }
     const auto& desc = channel_var_descriptors[index];
-    xia_log(log::debug) << module_label(*this) << "read_var: channel var=" << desc.name
-                        << " channel=" << channel << " offset=" << offset << " io=" << io;
+    xia_logc(log::param, log::debug) << module_label(*this) << "read_var: channel var=" << desc.name
+                                     << " channel=" << channel << " offset=" << offset << " io="
+                                     << io;
     if (desc.state == param::disable) {
         throw error(number, slot, error::code::channel_param_disabled,
                     "channel variable disabled: " + desc.name);
@@ -1421,24 +2147,34 @@ param::value_type module::read_var(param::channel_var var, size_t channel, size_
     param::value_type value;
     {
         lock_guard guard(lock_);
-        if (have_hardware && io) {
+        auto& data = channels[channel].vars[index].value[offset];
+        /*
+         * A staged value is not in the DSP.
+         */
+        const bool staged_value = staging.load() && data.dirty;
+        if (have_hardware && io && (desc.mode == param::ro || (!data.cached && !staged_value))) {
             hw::memory::dsp dsp(*this);
-            hw::convert(dsp.read(channel, offset, desc.address), value);
-            channels[channel].vars[index].value[offset].value = value;
-            channels[channel].vars[index].value[offset].dirty = false;
+            hw::word mem = dsp.read(channel, offset, desc.address);
+            hw::convert(mem, value);
+            data.value = value;
+            data.dirty = false;
+            data.cached = true;
+            image_var(channels[channel], hw::address(desc.address + offset), mem, false);
         } else {
-            value = channels[channel].vars[index].value[offset].value;
+            value = data.value;
         }
     }
-    xia_log(log::debug) << module_label(*this) << "read_var: channel var=" << desc.name << " value["
-                        << offset << "]=" << value << " (0x" << std::hex << value << ')';
+    xia_logc(log::param, log::debug) << module_label(*this) << "read_var: channel var=" << desc.name
+                                     << " value[" << offset << "]=" << value << " (0x" << std::hex
+                                     << value << ')';
     return value;
 }
 
 void module::write_var(const std::string& var, param::value_type value, size_t channel,
                        size_t offset, bool io) {
-    xia_log(log::info) << module_label(*this) << "write: var=" << var << " channel=" << channel
-                       << " value[" << offset << "]=" << value << " (0x" << std::hex << value << ')';
+    xia_logc(log::param, log::info) << module_label(*this) << "write: var=" << var << " channel="
+                                    << channel << " value[" << offset << "]=" << value << " (0x"
+                                    << std::hex << value << ')';
     if (param::is_module_var(var)) {
         write_var(param::lookup_module_var(var), value, offset, io);
     } else if (param::is_channel_var(var)) {
@@ -1457,8 +2193,9 @@ void module::write_var(param::module_var var, param::value_type value, size_t of
         throw error(number, slot, error::code::module_invalid_var, oss.str());
     }
     const auto& desc = module_var_descriptors[index];
-    xia_log(log::debug) << module_label(*this) << "write_var: module var=" << desc.name << " value["
-                        << offset << "]=" << value << " (0x" << std::hex << value << ')';
+    xia_logc(log::param, log::debug) << module_label(*this) << "write_var: module var=" << desc.name
+                                     << " value[" << offset << "]=" << value << " (0x" << std::hex
+                                     << value << ')';
     if (desc.state == param::disable) {
         throw error(number, slot, error::code::module_param_disabled,
                     "module variable disabled: " + desc.name);
@@ -1472,15 +2209,20 @@ void module::write_var(param::module_var var, param::value_type value, size_t of
                     "invalid module variable offset: " + desc.name);
     }
     lock_guard guard(lock_);
-    module_vars[index].value[offset].value = value;
-    module_vars[index].value[offset].dirty = true;
-    if (have_hardware && io) {
-        hw::word word;
-        hw::convert(value, word);
+    auto& data = module_vars[index].value[offset];
+    data.value = value;
+    data.dirty = true;
+    data.cached = false;
+    hw::word word;
+    hw::convert(value, word);
+    const bool write_io = have_hardware && io && !staging.load();
+    if (write_io) {
         hw::memory::dsp dsp(*this);
         dsp.write(offset, desc.address, word);
-        module_vars[index].value[offset].dirty = false;
+        data.dirty = false;
+        data.cached = true;
     }
+    image_var(hw::address(desc.address + offset), word, !write_io);
 }
 
 void module::write_var(param::channel_var var, param::value_type value, size_t channel,
@@ -1494,9 +2236,9 @@ void module::write_var(param::channel_var var, param::value_type value, size_t c
         throw error(number, slot, error::code::channel_invalid_var, oss.str());
     }
     const auto& desc = channel_var_descriptors[index];
-    xia_log(log::debug) << module_label(*this) << "write_var: channel var=" << desc.name
-                        << " channel=" << channel << " value[" << offset << "]=" << value << " (0x"
-                        << std::hex << value << ')';
+    xia_logc(log::param, log::debug) << module_label(*this) << "write_var: channel var="
+                                     << desc.name << " channel=" << channel << " value[" << offset
+                                     << "]=" << value << " (0x" << std::hex << value << ')';
     if (desc.state == param::disable) {
         throw error(number, slot, error::code::channel_param_disabled,
                     "channel variable disabled: " + desc.name);
@@ -1510,76 +2252,245 @@ void module::write_var(param::channel_var var, param::value_type value, size_t c
                     "invalid channel variable offset: " + desc.name);
     }
     lock_guard guard(lock_);
-    channels[channel].vars[index].value[offset].value = value;
-    channels[channel].vars[index].value[offset].dirty = true;
-    if (have_hardware && io) {
-        hw::word word;
-        hw::convert(value, word);
+    auto& data = channels[channel].vars[index].value[offset];
+    data.value = value;
+    data.dirty = true;
+    data.cached = false;
+    hw::word word;
+    hw::convert(value, word);
+    const bool write_io = have_hardware && io && !staging.load();
+    if (write_io) {
         hw::memory::dsp dsp(*this);
         dsp.write(channel, offset, desc.address, word);
-        channels[channel].vars[index].value[offset].dirty = false;
+        data.dirty = false;
+        data.cached = true;
     }
+    image_var(channels[channel], hw::address(desc.address + offset), word, !write_io);
 }
 
-void module::sync_vars(const sync_var_mode sync_mode) {
+bool module::update_var(param::module_var var, param::value_type value, size_t offset) {
     online_check();
-    xia_log(log::info) << module_label(*this) << "sync variables: mode: "
-                       << (char*) (sync_mode == sync_to_dsp ? "to dsp" : "from dsp");
-    if (!have_hardware) {
-        return;
+    {
+        lock_guard guard(lock_);
+        const size_t index = static_cast<size_t>(var);
+        if (index < module_vars.size() && offset < module_vars[index].value.size()) {
+            auto& data = module_vars[index].value[offset];
+            if (data.value == value && (data.cached || data.dirty || !have_hardware)) {
+                return false;
+            }
+        }
     }
-    lock_guard guard(lock_);
-    hw::memory::dsp dsp(*this);
-    for (auto& var : module_vars) {
+    write_var(var, value, offset, false);
+    return true;
+}
+
+bool module::update_var(param::channel_var var, param::value_type value, size_t channel,
+                        size_t offset) {
+    online_check();
+    channel_check(channel);
+    {
+        lock_guard guard(lock_);
+        const size_t index = static_cast<size_t>(var);
+        auto& vars = channels[channel].vars;
+        if (index < vars.size() && offset < vars[index].value.size()) {
+            auto& data = vars[index].value[offset];
+            if (data.value == value && (data.cached || data.dirty || !have_hardware)) {
+                return false;
+            }
+        }
+    }
+    write_var(var, value, channel, offset, false);
+    return true;
+}
+
+/*
+ * Visit the DSP address and value of the enabled writable variables.
+ * Channels without a variable index are not visited.
+ */
+template<typename Visit>
+static void visit_writable_vars(module& mod, Visit visit) {
+    for (auto& var : mod.module_vars) {
         const auto& desc = var.var;
         if (desc.state == param::enable && desc.mode != param::ro) {
             for (size_t v = 0; v < var.value.size(); ++v) {
-                auto& value = var.value[v];
-                if (sync_mode == sync_to_dsp) {
-                    if (value.dirty) {
-                        hw::word word;
-                        hw::convert(value.value, word);
-                        dsp.write(v, desc.address, word);
-                    }
-                } else {
-                    hw::convert(dsp.read(v, desc.address), value.value);
-                }
-                value.dirty = false;
+                visit(hw::address(desc.address + v), var.value[v]);
             }
         }
     }
-    for (auto& channel : channels) {
+    for (auto& channel : mod.channels) {
+        const auto index = channel.fixture->config.index;
+        if (index < 0) {
+            continue;
+        }
         for (auto& var : channel.vars) {
             const auto& desc = var.var;
             if (desc.state == param::enable && desc.mode != param::ro) {
                 for (size_t v = 0; v < var.value.size(); ++v) {
-                    auto& value = var.value[v];
-                    if (sync_mode == sync_to_dsp) {
-                        if (value.dirty) {
-                            hw::word word;
-                            hw::convert(value.value, word);
-                            dsp.write(channel.number, v, desc.address, word);
-                        }
-                    } else {
-                        hw::convert(dsp.read(channel.number, v, desc.address), value.value);
-                    }
-                    value.dirty = false;
+                    visit(hw::address(desc.address + index + v), var.value[v]);
                 }
             }
         }
     }
-    fixtures->sync_vars();
 }
 
-void module::sync_hw(const bool program_fippi, const bool program_dacs) {
-    online_check();
-    xia_log(log::info) << module_label(*this) << std::boolalpha << "sync hardware: "
-                       << "program_fippi=" << program_fippi << " program_dacs=" << program_dacs;
-
-    lock_guard guard(lock_);
-
-    if (program_fippi) {
-        hw::run::control(*this, hw::run::control_task::program_fippi);
+void module::create_var_image() {
+    var_image.clear();
+    var_image_reads.clear();
+    if (!vars_loaded) {
+        return;
+    }
+    var_image.create(param_addresses);
+    auto& image = var_image;
+    std::vector<bool> writable(image.size(), false);
+    visit_writable_vars(*this, [&image, &writable](hw::address address, auto& value) {
+        hw::word word;
+        hw::convert(value.value, word);
+        image.store(address, word);
+        writable[address - image.base()] = true;
+    });
+    /*
+     * A read can cross small gaps between the writable words because
+     * reading the DSP memory has no side effects.
+     */
+    const size_t read_gap = 16;
+    size_t w = 0;
+    while (w < writable.size()) {
+        if (!writable[w]) {
+            ++w;
+            continue;
+        }
+        size_t last = w;
+        for (size_t n = w + 1; n < writable.size() && n - last <= read_gap; ++n) {
+            if (writable[n]) {
+                last = n;
+            }
+        }
+        var_image_reads.push_back({hw::address(image.base() + w), w, last - w + 1});
+        w = last + 1;
+    }
+}
+
+void module::stage_var_image() {
+    auto& image = var_image;
+    visit_writable_vars(*this, [&image](hw::address address, auto& value) {
+        if (value.dirty) {
+            hw::word word;
+            hw::convert(value.value, word);
+            image.set(address, word);
+        }
+    });
+}
+
+void module::image_var(const hw::address address, const hw::word word, const bool dirty) {
+    if (var_image.contains(address)) {
+        if (dirty) {
+            var_image.set(address, word);
+        } else {
+            var_image.store(address, word);
+        }
+    }
+}
+
+void module::image_var(channel::channel& channel, const hw::address address,
+                       const hw::word word, const bool dirty) {
+    const auto index = channel.fixture->config.index;
+    if (index >= 0) {
+        image_var(hw::address(address + index), word, dirty);
+    }
+}
+
+void module::sync_vars(const sync_var_mode sync_mode) {
+    online_check();
+    xia_log(log::info) << module_label(*this) << "sync variables: mode: "
+                       << (char*) (sync_mode == sync_to_dsp ? "to dsp" : "from dsp");
+    if (!have_hardware) {
+        return;
+    }
+    lock_guard guard(lock_);
+
+    if (!var_image.valid()) {
+        throw error(number, slot, error::code::internal_failure,
+                    "sync variables: no variable image");
+    }
+    for (auto& channel : channels) {
+        if (channel.fixture->config.index < 0) {
+            bool dirty = sync_mode == sync_from_dsp;
+            for (auto& var : channel.vars) {
+                for (auto& value : var.value) {
+                    dirty = dirty || value.dirty;
+                }
+            }
+            if (dirty) {
+                throw error(number, slot, error::code::channel_invalid_index,
+                            "dsp: invalid index: module=" + std::to_string(number) +
+                                " channel=" + std::to_string(channel.number));
+            }
+        }
+    }
+
+    /*
+     * The variable image is the transfer buffer. A write moves the runs of
+     * dirty words and a read the runs of the writable variables' words.
+     */
+    hw::memory::dsp dsp(*this);
+    hw::memory::dsp::blocks blocks;
+    if (sync_mode == sync_to_dsp) {
+        stage_var_image();
+        param::image::runs runs;
+        var_image.dirty_runs(runs);
+        blocks.reserve(runs.size());
+        for (auto& r : runs) {
+            blocks.push_back({r.address, var_image.data() + r.offset, r.length});
+        }
+        dsp.write(blocks);
+        visit_writable_vars(*this, [](hw::address, auto& value) {
+            if (value.dirty) {
+                value.dirty = false;
+                value.cached = true;
+            }
+        });
+    } else {
+        blocks.reserve(var_image_reads.size());
+        for (auto& r : var_image_reads) {
+            blocks.push_back({r.address, var_image.data() + r.offset, r.length});
+        }
+        dsp.read(blocks);
+        const auto& image = var_image;
+        visit_writable_vars(*this, [&image](hw::address address, auto& value) {
+            hw::convert(image.get(address), value.value);
+            value.dirty = false;
+            value.cached = true;
+        });
+    }
+    var_image.clean();
+    fixtures->sync_vars();
+}
+
+void module::invalidate_vars() {
+    lock_guard guard(lock_);
+    for (auto& var : module_vars) {
+        for (auto& value : var.value) {
+            value.cached = false;
+        }
+    }
+    for (auto& channel : channels) {
+        for (auto& var : channel.vars) {
+            for (auto& value : var.value) {
+                value.cached = false;
+            }
+        }
+    }
+}
+
+void module::sync_hw(const bool program_fippi, const bool program_dacs) {
+    online_check();
+    xia_log(log::info) << module_label(*this) << std::boolalpha << "sync hardware: "
+                       << "program_fippi=" << program_fippi << " program_dacs=" << program_dacs;
+
+    lock_guard guard(lock_);
+
+    if (program_fippi) {
+        hw::run::control(*this, hw::run::control_task::program_fippi);
     }
 
     if (program_dacs) {
@@ -1599,7 +2510,102 @@ void module::sync_hw(const bool program_fippi, const bool program_dacs) {
     fixtures->sync_hw();
 }
 
+void module::sync_changed_vars() {
+    online_check();
+    lock_guard guard(lock_);
+    /*
+     * The module variables only used by the DSP when a run starts or a
+     * task runs.
+     */
+    static const std::vector<param::module_var> dsp_only = {
+        param::module_var::HostRunTimePreset, param::module_var::MaxEvents,
+        param::module_var::HostIO, param::module_var::UserIn};
+    size_t changed = 0;
+    bool program_fippi = false;
+    bool program_dacs = false;
+    for (auto& var : module_vars) {
+        for (auto& value : var.value) {
+            if (value.dirty) {
+                ++changed;
+                if (std::find(dsp_only.begin(), dsp_only.end(), var.var.par) == dsp_only.end()) {
+                    program_fippi = true;
+                }
+            }
+        }
+    }
+    for (auto& channel : channels) {
+        for (auto& var : channel.vars) {
+            for (auto& value : var.value) {
+                if (value.dirty) {
+                    ++changed;
+                    if (var.var.par == param::channel_var::OffsetDAC) {
+                        program_dacs = true;
+                    } else {
+                        program_fippi = true;
+                    }
+                }
+            }
+        }
+    }
+    xia_log(log::info) << module_label(*this) << std::boolalpha
+                       << "sync changed variables: changed=" << changed
+                       << " program_fippi=" << program_fippi << " program_dacs=" << program_dacs;
+    if (changed == 0) {
+        return;
+    }
+    sync_vars();
+    if (program_fippi) {
+        sync_hw(true, program_dacs);
+    } else if (program_dacs) {
+        set_dacs();
+    }
+}
+
+void module::export_vars(param::image& image) {
+    online_check();
+    lock_guard guard(lock_);
+    if (!var_image.valid()) {
+        throw error(number, slot, error::code::module_invalid_operation,
+                    "export variables: no variable image");
+    }
+    stage_var_image();
+    image = var_image;
+    image.clean();
+}
+
+size_t module::import_vars(const param::image& image) {
+    online_check();
+    lock_guard guard(lock_);
+    if (!var_image.valid()) {
+        throw error(number, slot, error::code::module_invalid_operation,
+                    "import variables: no variable image");
+    }
+    stage_var_image();
+    if (var_image.same(image)) {
+        return 0;
+    }
+    /*
+     * Only the writable variables are imported, the read-only words of
+     * the image are the DSP's outputs.
+     */
+    size_t changed = 0;
+    auto& local = var_image;
+    visit_writable_vars(*this, [&image, &local, &changed](hw::address address, auto& value) {
+        const auto word = image.get(address);
+        if (word != local.get(address)) {
+            hw::convert(word, value.value);
+            value.dirty = true;
+            value.cached = false;
+            local.set(address, word);
+            ++changed;
+        }
+    });
+    xia_log(log::info) << module_label(*this) << "import variables: changed=" << changed;
+    return changed;
+}
+
 void module::run_end() {
+    PIXIE_PROFILE_SCOPE("module::run_end");
     online_check();
     lock_guard guard(lock_);
     bool running = true;
@@ -1622,14 +2628,46 @@ void module::run_end() {
      */
     hw::run::end(*this);
     run_interval.end();
-    sync_worker_run(true);
+    if (fifo_direct.load()) {
+        buffer::lock_guard fifo_guard(fifo_read_lock);
+        fifo_direct_read();
+    } else {
+        sync_worker_run(true);
+    }
     pause_fifo_worker = true;
     run_stats.stop();
     if (running) {
         log_stats("run", run_stats);
+        if (mca_clear_policy.load() == mca_clear::run_end) {
+            start_mca_clear();
+        }
     }
 }
 
+void module::run_stop() {
+    online_check();
+    lock_guard guard(lock_);
+    xia_log(log::info) << module_label(*this) << "run_stop: stopping run";
+    hw::run::stop(*this);
+}
+
+double module::run_real_time() {
+    online_check();
+    lock_guard guard(lock_);
+    /*
+     * The counter is two words. Read the high word again to detect a carry
+     * between the reads.
+     */
+    stats::module counter;
+    param::value_type high;
+    do {
+        high = read_var(param::module_var::RunTimeA, 0);
+        counter.runtime_b = read_var(param::module_var::RunTimeB, 0);
+        counter.runtime_a = read_var(param::module_var::RunTimeA, 0);
+    } while (counter.runtime_a != high);
+    return counter.real_time();
+}
+
 bool module::run_active() {
     online_check();
     lock_guard guard(lock_);
@@ -1695,9 +2733,18 @@ void module::start_histograms(hw::run::run_mode mode) {
 }
 
 void module::start_listmode(hw::run::run_mode mode) {
+    PIXIE_PROFILE_SCOPE("module::start_listmode");
     xia_log(log::info) << module_label(*this) << "start-list-mode: mode=" << int(mode);
     online_check();
     lock_guard guard(lock_);
+    prepare_listmode(mode);
+    enable_run();
+}
+
+void module::prepare_listmode(hw::run::run_mode mode) {
+    xia_log(log::info) << module_label(*this) << "prepare-list-mode: mode=" << int(mode);
+    online_check();
+    lock_guard guard(lock_);
     if (run_task != hw::run::run_task::nop) {
         throw error(number, slot, error::code::module_invalid_operation,
                     "module already running a task");
@@ -1707,13 +2754,150 @@ void module::start_listmode(hw::run::run_mode mode) {
                     "test running; cannot start a run task");
     }
     backplane.sync_wait_valid();
+    /*
+     * Resize the pool to the last run's tuning before the run starts. A
+     * pool that cannot be resized is left as it is.
+     */
+    if (fifo_auto_tune.load()) {
+        try {
+            apply_fifo_tuning();
+        } catch (pixie::error::error& e) {
+            xia_logc(log::fifo, log::warning) << module_label(*this)
+                                              << "fifo: apply tuning: " << e.what();
+        }
+        fifo_tune_pending = true;
+    }
     run_stats.start();
-    fifo_data.flush();
+    {
+        buffer::lock_guard fifo_guard(fifo_read_lock);
+        fifo_ring.flush();
+        fifo_data.flush();
+        /*
+         * A steady-state run has the pool's maximum buffers and a queue
+         * that holds them before it starts.
+         */
+        if (fifo_steady_state.load()) {
+            while (fifo_pool.grow()) {
+            }
+            fifo_data.reserve(fifo_pool.number.load());
+        }
+    }
+    {
+        buffer::lock_guard filter_guard(fifo_filter_lock);
+        fifo_filter.reset();
+    }
+    {
+        buffer::lock_guard validator_guard(fifo_validator_lock);
+        fifo_validator.reset();
+    }
+    fifo_crc_value = 0;
     pause_fifo_worker = false;
-    hw::run::run(*this, mode, hw::run::run_task::list_mode);
+    run_prepared = true;
+    hw::run::prepare(*this, mode, hw::run::run_task::list_mode, hw::run::control_task::nop);
+}
+
+void module::enable_run() {
+    online_check();
+    lock_guard guard(lock_);
+    if (run_task != hw::run::run_task::list_mode && run_task != hw::run::run_task::histogram) {
+        throw error(number, slot, error::code::module_invalid_operation,
+                    "no run task prepared");
+    }
+    hw::run::enable(*this);
+    run_prepared = false;
     run_interval.restart();
 }
 
+void module::set_mca_clear(mca_clear policy) {
+    xia_log(log::info) << module_label(*this) << "mca-clear: policy=" << int(policy);
+    lock_guard guard(lock_);
+    mca_clear_policy = policy;
+}
+
+void module::start_mca_clear() {
+    xia_log(log::debug) << module_label(*this) << "mca-clear: start";
+    online_check();
+    lock_guard guard(lock_);
+    if (run_task != hw::run::run_task::nop) {
+        throw error(number, slot, error::code::module_invalid_operation,
+                    "mca clear: module running a task");
+    }
+    if (wait_mca_clear()) {
+        return;
+    }
+    mca_memory_ = mca_state::clearing;
+    mca_clear_abort = false;
+    mca_clear_thread = std::thread(&module::mca_clear_worker, this);
+}
+
+bool module::wait_mca_clear() {
+    if (mca_clear_thread.joinable()) {
+        mca_clear_thread.join();
+    }
+    return mca_memory_.load() == mca_state::clear;
+}
+
+module::mca_state module::mca_memory() const {
+    return mca_memory_.load();
+}
+
+/*
+ * A new run waits for a background clear. The run's histograms are written
+ * into the memory so it is no longer clear.
+ */
+void module::prepare_mca(hw::run::run_task run_tsk) {
+    bool cleared = wait_mca_clear();
+    if (!cleared) {
+        if (run_tsk == hw::run::run_task::list_mode &&
+            mca_clear_policy.load() == mca_clear::skip_list_mode) {
+            xia_log(log::debug) << module_label(*this) << "mca-clear: skipped";
+        } else {
+            util::timepoint tp(true);
+            cleared = clear_mca_memory();
+            tp.end();
+            xia_log(log::debug) << module_label(*this) << "mca-clear: duration=" << tp;
+        }
+    }
+    run_mca_cleared = cleared;
+    mca_memory_ = mca_state::dirty;
+}
+
+void module::mca_clear_worker() {
+    util::timepoint tp(true);
+    try {
+        if (clear_mca_memory()) {
+            mca_memory_ = mca_state::clear;
+        } else {
+            mca_memory_ = mca_state::dirty;
+        }
+    } catch (pixie::error::error& e) {
+        mca_memory_ = mca_state::dirty;
+        xia_log(log::error) << module_label(*this) << "mca-clear: " << e.what();
+    }
+    tp.end();
+    xia_log(log::debug) << module_label(*this) << "mca-clear: background: duration=" << tp
+                        << " clear=" << std::boolalpha << (mca_memory_.load() == mca_state::clear);
+}
+
+/*
+ * Zero the MCA memory in blocks. The bus is locked for each block so a
+ * background clear does not hold off other bus users. Returns false if
+ * the clear is aborted.
+ */
+bool module::clear_mca_memory() {
+    static const size_t block_size = hw::large_histogram_length * 4;
+    static const hw::words zero(block_size);
+    const size_t mca_end = hw::large_histogram_length * num_channels;
+    hw::memory::mca mca(*this);
+    for (hw::address addr = 0; addr < mca_end; addr += block_size) {
+        if (mca_clear_abort.load()) {
+            return false;
+        }
+        mca.write(addr, zero.data(), std::min(block_size, mca_end - addr));
+    }
+    return true;
+}
+
 void module::read_adc(size_t channel, hw::adc_word* buffer, size_t size, bool run) {
     xia_log(log::info) << module_label(*this) << "read-adc: channel=" << channel << " size=" << size
                        << " run=" << std::boolalpha << run;
@@ -1738,7 +2922,123 @@ void module::read_adc(size_t channel, hw::adc_trace& buffer, bool run) {
     read_adc(channel, buffer.data(), buffer.size(), run);
 }
 
+void module::read_adcs(const channel::range& channels_, hw::adc_traces& traces, bool run) {
+    xia_log(log::info) << module_label(*this) << "read-adcs: channels=" << channels_.size()
+                       << " run=" << std::boolalpha << run;
+    online_check();
+    for (auto c : channels_) {
+        channel_check(c);
+    }
+    lock_guard guard(lock_);
+    if (run) {
+        get_traces();
+    }
+    if (control_task != hw::run::control_task::get_traces) {
+        throw error(number, slot, error::code::module_invalid_operation,
+                    "control task not `get_traces`");
+    }
+    traces.resize(channels_.size());
+    for (size_t t = 0; t < channels_.size(); ++t) {
+        auto& trace = traces[t];
+        auto max_length = channels[channels_[t]].fixture->config.max_adc_trace_length;
+        if (trace.empty()) {
+            trace.resize(max_length);
+        } else if (trace.size() > max_length) {
+            throw error(number, slot, error::code::invalid_value,
+                        "ADC trace length greater than channel's trace: channel=" +
+                            std::to_string(channels_[t]));
+        }
+    }
+    if (!run_config.dsp_get_traces) {
+        for (size_t t = 0; t < channels_.size(); ++t) {
+            channels[channels_[t]].read_adc(traces[t].data(), traces[t].size());
+        }
+        return;
+    }
+    /*
+     * The DSP packs a pair of samples into a word. Read the traces into a
+     * single buffer with a block for each run of channels that follow each
+     * other in the IO buffer and then unpack the samples.
+     */
+    std::vector<size_t> offsets(channels_.size());
+    size_t total = 0;
+    for (size_t t = 0; t < channels_.size(); ++t) {
+        offsets[t] = total;
+        total += traces[t].size() / 2;
+    }
+    hw::words buffer(total);
+    hw::memory::host_bus::blocks reads;
+    for (size_t t = 0; t < channels_.size(); ++t) {
+        const auto& chan = channels[channels_[t]];
+        const size_t length = traces[t].size() / 2;
+        if (length == 0) {
+            continue;
+        }
+        if (!reads.empty()) {
+            auto& last = reads.back();
+            if (chan.adc_trace_address() == last.addr + last.length &&
+                buffer.data() + offsets[t] == last.buffer + last.length) {
+                last.length += length;
+                continue;
+            }
+        }
+        reads.push_back({chan.adc_trace_address(), buffer.data() + offsets[t], length});
+    }
+    hw::memory::dsp dsp(*this);
+    dsp.read(reads);
+    const bool host_order = util::host_little_endian();
+    for (size_t t = 0; t < channels_.size(); ++t) {
+        auto& trace = traces[t];
+        const hw::word* words = buffer.data() + offsets[t];
+        const size_t length = trace.size() / 2;
+        if (host_order) {
+            std::memcpy(trace.data(), words, length * sizeof(hw::word));
+        } else {
+            for (size_t w = 0; w < length; ++w) {
+                trace[w * 2] = hw::adc_word(words[w] & 0xffff);
+                trace[w * 2 + 1] = hw::adc_word((words[w] >> 16) & 0xffff);
+            }
+        }
+    }
+}
+
+void module::fit_tau(const channel::range& channels_, const data::tau::config& cfg,
+                     data::tau::estimates& taus, size_t captures, bool write, size_t threads) {
+    xia_log(log::info) << module_label(*this) << "fit-tau: channels=" << channels_.size()
+                       << " captures=" << captures << " write=" << std::boolalpha << write;
+    online_check();
+    for (auto c : channels_) {
+        channel_check(c);
+    }
+    if (captures == 0) {
+        throw error(number, slot, error::code::invalid_value, "fit tau: no captures");
+    }
+    lock_guard guard(lock_);
+    data::tau::fitters fits;
+    for (auto c : channels_) {
+        data::tau::config chan_cfg(cfg);
+        if (chan_cfg.sample_usecs == 0) {
+            chan_cfg.sample_usecs = channels[c].xdt();
+        }
+        fits.emplace_back(chan_cfg);
+    }
+    hw::adc_traces traces;
+    for (size_t capture = 0; capture < captures; ++capture) {
+        read_adcs(channels_, traces);
+        data::tau::add(fits, traces, threads);
+    }
+    data::tau::results(fits, taus);
+    if (write) {
+        for (size_t t = 0; t < channels_.size(); ++t) {
+            if (taus[t].valid()) {
+                channels[channels_[t]].tau(taus[t].tau_usecs);
+            }
+        }
+    }
+}
+
 void module::bl_find_cut(channel::range& channels_, param::values& cuts) {
+    PIXIE_PROFILE_SCOPE("module::bl_find_cut");
     xia_log(log::info) << module_label(*this) << "bl-find-cut: channels=" << channels.size();
     cuts.clear();
     channel::baseline bl(*this, channels_);
@@ -1759,11 +3059,23 @@ void module::bl_get(channel::range& channels_, channel::baseline::channels_value
     bl.get(values, run);
 }
 
+void module::bl_noise(channel::range& channels_, stats::baseline_noises& noises, bool run) {
+    xia_log(log::info) << module_label(*this) << "bl-noise: channels=" << channels_.size();
+    channel::baseline bl(*this, channels_);
+    lock_guard guard(lock_);
+    if (!run && control_task != hw::run::control_task::get_baselines) {
+        throw error(number, slot, error::code::module_invalid_operation,
+                    "control task `get_baseline` has not run");
+    }
+    bl.get(noises, run);
+}
+
 void module::read_histogram(size_t channel, hw::words& values) {
     xia_log(log::info) << module_label(*this) << "read-histogram: channel=" << channel
                        << " length=" << values.size();
     online_check();
     lock_guard guard(lock_);
+    wait_mca_clear();
     channels[channel].read_histogram(values);
 }
 
@@ -1772,61 +3084,400 @@ void module::read_histogram(size_t channel, hw::word_ptr values, const size_t si
                        << " length=" << size;
     online_check();
     lock_guard guard(lock_);
+    wait_mca_clear();
     channels[channel].read_histogram(values, size);
 }
 
-size_t module::read_list_mode_level() {
-    xia_log(log::debug) << module_label(*this) << "read-list-mode-level";
+void module::read_histograms(const channel::range& channels_, hw::words& values, size_t length) {
+    xia_log(log::info) << module_label(*this) << "read-histograms: channels=" << channels_.size()
+                       << " length=" << length;
     online_check();
-    if (!fifo_worker_running.load()) {
-        xia_log(log::debug) << module_label(*this) << "read-list-mode-level: FIFO worker not running";
+    if (channels_.empty()) {
+        values.clear();
+        return;
+    }
+    for (auto c : channels_) {
+        channel_check(c);
     }
     lock_guard guard(lock_);
-    auto size = fifo_data.size();
-    if (fifo_run_wait_usecs.load() == 0) {
+    wait_mca_clear();
+    if (length == 0) {
+        length = channels[channels_[0]].fixture->config.max_histogram_length;
+    }
+    for (auto c : channels_) {
+        if (length > channels[c].fixture->config.max_histogram_length) {
+            throw error(number, slot, error::code::invalid_value,
+                        "histogram length greater than channel's histogram: channel=" +
+                            std::to_string(c));
+        }
+    }
+    values.resize(channels_.size() * length);
+    hw::memory::mca mca(*this);
+    size_t first = 0;
+    while (first < channels_.size()) {
+        /*
+         * Extend over the next channels if their histograms follow in the
+         * MCA memory and are read in full.
+         */
+        size_t last = first + 1;
+        while (last < channels_.size()) {
+            const auto& prev = channels[channels_[last - 1]];
+            const auto& next = channels[channels_[last]];
+            if (length != prev.fixture->config.max_histogram_length ||
+                next.histogram_address() != prev.histogram_address() + length) {
+                break;
+            }
+            ++last;
+        }
+        mca.read(channels[channels_[first]].histogram_address(), values.data() + first * length,
+                 (last - first) * length);
+        first = last;
+    }
+}
+
+size_t module::read_list_mode_level() {
+    xia_logc(log::fifo, log::debug) << module_label(*this) << "read-list-mode-level";
+    online_check();
+    if (!fifo_worker_running.load() && !fifo_direct.load()) {
+        xia_logc(log::fifo, log::debug) << module_label(*this)
+                                        << "read-list-mode-level: FIFO worker not running";
+    }
+    return fifo_level();
+}
+
+size_t module::read_list_mode(hw::words& values) {
+    return read_list_mode(values.data(), values.size());
+}
+
+size_t module::read_list_mode(hw::word_ptr values, const size_t size) {
+    xia_logc(log::fifo, log::debug) << module_label(*this) << "read-list-mode: length=" << size
+                                    << " fifo-size=" << fifo_data.size();
+    online_check();
+    if (!fifo_worker_running.load() && !fifo_direct.load()) {
+        xia_logc(log::fifo, log::warning) << module_label(*this)
+                                          << "read-list-mode: FIFO worker not running";
+    }
+    return fifo_copy(values, size);
+}
+
+size_t module::read_list_mode(buffer::queue::handles& buffers, const size_t max_buffers) {
+    xia_logc(log::fifo, log::debug) << module_label(*this) << "read-list-mode: buffers: max="
+                                    << max_buffers << " fifo-size=" << fifo_data.size();
+    online_check();
+    if (!fifo_worker_running.load() && !fifo_direct.load()) {
+        xia_logc(log::fifo, log::warning) << module_label(*this)
+                                          << "read-list-mode: FIFO worker not running";
+    }
+    return fifo_pop(buffers, max_buffers);
+}
+
+void module::requeue_list_mode(buffer::queue::handles& buffers) {
+    online_check();
+    fifo_requeue(buffers);
+}
+
+size_t module::save_list_mode(const std::string& file_name, const size_t min_words) {
+    xia_logc(log::fifo, log::debug) << module_label(*this) << "save-list-mode: file="
+                                    << file_name << " min-words=" << min_words;
+    online_check();
+    if (read_list_mode_level() <= min_words) {
+        return 0;
+    }
+    std::ofstream output(file_name, std::ios::binary | std::ios::app);
+    if (!output) {
+        throw error(number, slot, error::code::file_open_failure,
+                    "save list mode: file open: " + file_name);
+    }
+    buffer::queue::handles buffers;
+    read_list_mode(buffers);
+    /*
+     * Each buffer is flushed so a failed write leaves the buffers not
+     * written to be requeued.
+     */
+    size_t words = 0;
+    while (!buffers.empty()) {
+        auto& buf = buffers.front();
+        output.write(reinterpret_cast<const char*>(buf->data()),
+                     std::streamsize(buf->size() * sizeof(hw::word)));
+        output.flush();
+        if (!output) {
+            fifo_requeue(buffers);
+            throw error(number, slot, error::code::file_write_failure,
+                        "save list mode: file write: " + file_name);
+        }
+        words += buf->size();
+        buffers.pop_front();
+    }
+    return words;
+}
+
+std::shared_ptr<buffer::fanout> module::tee_list_mode(const size_t max_held) {
+    online_check();
+    const size_t held = max_held != 0 ? max_held : std::max(fifo_buffers / 2, size_t(1));
+    xia_logc(log::fifo, log::info) << module_label(*this) << "tee-list-mode: max-held=" << held;
+    return std::make_shared<buffer::fanout>(
+        [this](buffer::queue::handles& buffers) { return read_list_mode(buffers); }, held);
+}
+
+/*
+ * The non-throwing variants only catch hardware errors. The routine
+ * results are checked before the reads.
+ */
+template<typename Read>
+static error::code nothrow_read(module& mod, Read read) noexcept {
+    if (!mod.online()) {
+        return error::code::module_offline;
+    }
+    try {
+        read();
+    } catch (pixie::error::error& e) {
+        xia_logc(log::fifo, log::error) << module_label(mod) << e.what();
+        return e.type;
+    } catch (std::bad_alloc&) {
+        return error::code::bad_allocation;
+    } catch (...) {
+        return error::code::unknown_error;
+    }
+    return error::code::success;
+}
+
+error::code module::read_list_mode_level(size_t& level, const std::nothrow_t&) noexcept {
+    level = 0;
+    return nothrow_read(*this, [this, &level] { level = fifo_level(); });
+}
+
+error::code module::read_list_mode(hw::word_ptr values, const size_t size, size_t& words,
+                                   const std::nothrow_t&) noexcept {
+    words = 0;
+    return nothrow_read(*this, [this, values, size, &words] { words = fifo_copy(values, size); });
+}
+
+error::code module::read_list_mode(buffer::queue::handles& buffers, const size_t max_buffers,
+                                   size_t& words, const std::nothrow_t&) noexcept {
+    words = 0;
+    return nothrow_read(*this, [this, &buffers, max_buffers, &words] {
+        words = fifo_pop(buffers, max_buffers);
+    });
+}
+
+/*
+ * The list-mode reads do not take the module lock. Control calls can hold
+ * it for seconds and a readout stalled behind them lets the EXT FIFO
+ * overflow. The ring's single consumer is serialized by the FIFO read
+ * lock, the queue and the bus have their own locks and the synchronous
+ * worker handshake is serialized by the worker's working lock.
+ */
+size_t module::fifo_level() {
+    auto size = fifo_ring.size() + fifo_data.size();
+    if (fifo_direct.load() || fifo_run_wait_usecs.load() == 0) {
         hw::memory::fifo fifo(*this);
         size += fifo.level();
     }
     if (size > 0) {
-        xia_log(log::debug) << module_label(*this) << "read-list-mode-level: FIFO = " << size;
+        xia_logc(log::fifo, log::debug) << module_label(*this) << "read-list-mode-level: FIFO = "
+                                        << size;
     }
     return size;
 }
 
-size_t module::read_list_mode(hw::words& values) {
-    xia_log(log::debug) << module_label(*this) << "read-list-mode: length=" << values.size()
-                        << " fifo-size=" << fifo_data.size();
-    online_check();
-    if (!fifo_worker_running.load()) {
-        xia_log(log::warning) << module_label(*this) << "read-list-mode: FIFO worker not running";
+pixie::alloc::counter* module::run_allocations() {
+    if (fifo_steady_state.load() && run_task.load() == hw::run::run_task::list_mode) {
+        return &run_stats.allocations;
     }
-    lock_guard guard(lock_);
+    return nullptr;
+}
+
+size_t module::fifo_copy(hw::word_ptr values, const size_t size) {
+    buffer::lock_guard guard(fifo_read_lock);
+    pixie::alloc::watch watching(run_allocations());
     sync_worker_run();
+    fifo_notify_pending = false;
+    fifo_ring.drain(fifo_data);
     if (fifo_data.empty()) {
         return 0;
     }
-    auto out = fifo_data.copy(values);
+    auto out = fifo_data.copy(values, size);
     run_stats.out += out;
-    xia_log(log::debug) << module_label(*this) << "read-list-mode: values=" << values.size()
-                        << " out=" << out << " fifo-size=" << fifo_data.size();
+    xia_logc(log::fifo, log::debug) << module_label(*this) << "read-list-mode: values=" << size
+                                    << " out=" << out << " fifo-size=" << fifo_data.size();
     return out;
 }
 
-size_t module::read_list_mode(hw::word_ptr values, const size_t size) {
-    xia_log(log::info) << module_label(*this) << "read-list-mode: length=" << size
-                       << " fifo-size=" << fifo_data.size();
-    online_check();
+size_t module::fifo_pop(buffer::queue::handles& buffers, const size_t max_buffers) {
+    buffer::lock_guard guard(fifo_read_lock);
+    pixie::alloc::watch watching(run_allocations());
+    sync_worker_run();
+    fifo_notify_pending = false;
+    fifo_ring.drain(fifo_data);
     if (fifo_data.empty()) {
         return 0;
     }
-    lock_guard guard(lock_);
-    auto out = fifo_data.copy(values, size);
-    run_stats.out += size;
-    xia_log(log::debug) << module_label(*this) << "read-list-mode: values=" << size
-                        << " out=" << out << " fifo-size=" << fifo_data.size();
+    auto out = fifo_data.pop(buffers, max_buffers);
+    run_stats.out += out;
+    xia_logc(log::fifo, log::debug) << module_label(*this) << "read-list-mode: buffers="
+                                    << buffers.size() << " out=" << out << " fifo-size="
+                                    << fifo_data.size();
     return out;
 }
 
+void module::fifo_requeue(buffer::queue::handles& buffers) {
+    buffer::lock_guard guard(fifo_read_lock);
+    size_t words = 0;
+    for (auto& buf : buffers) {
+        words += buf->size();
+    }
+    fifo_data.requeue(buffers);
+    run_stats.out -= words;
+    xia_logc(log::fifo, log::warning) << module_label(*this) << "read-list-mode: requeued="
+                                      << words << " fifo-size=" << fifo_data.size();
+}
+
+void module::subscribe_list_mode(const list_mode_subscription& subscription) {
+    xia_logc(log::fifo, log::info) << module_label(*this) << "subscribe-list-mode: threshold="
+                                   << subscription.threshold_words
+                                   << " timeout=" << subscription.timeout_usecs
+                                   << " usecs handler=" << std::boolalpha
+                                   << bool(subscription.callback);
+    unsubscribe_list_mode();
+    fifo_subscription = subscription;
+    fifo_notify_threshold = subscription.threshold_words;
+    fifo_notify_pending = false;
+#if defined(__linux__)
+    int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0) {
+        throw error(number, slot, error::code::internal_failure,
+                    std::string("subscribe-list-mode: eventfd: ") + std::strerror(errno));
+    }
+    {
+        sync::variable::lock_guard guard(fifo_notify_lock);
+        fifo_event_fd = fd;
+    }
+#endif
+    fifo_subscribed = true;
+    if (subscription.callback) {
+        fifo_notify_running = true;
+        fifo_notify_thread = std::thread(&module::list_mode_dispatcher, this);
+    }
+    /*
+     * Data queued before the subscription signals it.
+     */
+    if (fifo_ring.size() >= std::max(subscription.threshold_words, size_t(1))) {
+        notify_list_mode();
+    }
+}
+
+void module::unsubscribe_list_mode() {
+    if (!fifo_subscribed.load()) {
+        return;
+    }
+    if (fifo_notify_thread.joinable() &&
+        fifo_notify_thread.get_id() == std::this_thread::get_id()) {
+        throw error(number, slot, error::code::internal_failure,
+                    "unsubscribe-list-mode: cannot unsubscribe from the handler");
+    }
+    xia_logc(log::fifo, log::info) << module_label(*this) << "unsubscribe-list-mode";
+    fifo_subscribed = false;
+    fifo_notify_running = false;
+    {
+        sync::variable::lock_guard guard(fifo_notify_lock);
+        fifo_notify.cv.notify_all();
+    }
+    if (fifo_notify_thread.joinable()) {
+        fifo_notify_thread.join();
+    }
+    /*
+     * The worker writes the descriptor with the notify lock held so it is
+     * closed with the lock held.
+     */
+    {
+        sync::variable::lock_guard guard(fifo_notify_lock);
+        int fd = fifo_event_fd.exchange(-1);
+#if defined(__linux__)
+        if (fd >= 0) {
+            ::close(fd);
+        }
+#else
+        (void) fd;
+#endif
+    }
+    fifo_subscription = list_mode_subscription();
+    fifo_notify_pending = false;
+}
+
+bool module::wait_list_mode(size_t timeout_usecs) {
+    std::unique_lock<sync::variable::lock_type> guard(fifo_notify_lock);
+    auto signalled = [this] { return fifo_notify_pending.load() || !fifo_subscribed.load(); };
+    if (timeout_usecs == 0) {
+        fifo_notify.cv.wait(guard, signalled);
+    } else {
+        fifo_notify.cv.wait_for(guard, std::chrono::microseconds(timeout_usecs), signalled);
+    }
+    return fifo_subscribed.load() && fifo_notify_pending.load();
+}
+
+void module::notify_list_mode() {
+    if (fifo_notify_pending.exchange(true)) {
+        return;
+    }
+    sync::variable::lock_guard guard(fifo_notify_lock);
+    fifo_notify.cv.notify_all();
+#if defined(__linux__)
+    int fd = fifo_event_fd.load();
+    if (fd >= 0) {
+        uint64_t one = 1;
+        auto written = ::write(fd, &one, sizeof(one));
+        (void) written;
+    }
+#endif
+}
+
+void module::list_mode_dispatcher() {
+    xia_logc(log::fifo, log::debug) << module_label(*this) << "list-mode dispatcher: running";
+    const size_t timeout = fifo_subscription.timeout_usecs;
+    bool more = false;
+    while (fifo_notify_running.load()) {
+        bool timedout = false;
+        if (!more) {
+            std::unique_lock<sync::variable::lock_type> guard(fifo_notify_lock);
+            auto signalled = [this] {
+                return fifo_notify_pending.load() || !fifo_notify_running.load();
+            };
+            if (timeout == 0) {
+                fifo_notify.cv.wait(guard, signalled);
+            } else {
+                timedout =
+                    !fifo_notify.cv.wait_for(guard, std::chrono::microseconds(timeout), signalled);
+            }
+        }
+        if (!fifo_notify_running.load()) {
+            break;
+        }
+        if (timedout && fifo_ring.empty() && fifo_data.empty()) {
+            continue;
+        }
+        try {
+            buffer::queue::handles buffers;
+            read_list_mode(buffers, fifo_subscription.max_buffers);
+            /*
+             * A limited read can leave data queued.
+             */
+            more = fifo_subscription.max_buffers != 0 && !fifo_data.empty();
+            if (!buffers.empty()) {
+                fifo_subscription.callback(*this, buffers);
+            }
+        } catch (pixie::error::error& e) {
+            more = false;
+            xia_logc(log::fifo, log::error) << module_label(*this)
+                                            << "list-mode dispatcher: " << e.what();
+        } catch (std::exception& e) {
+            more = false;
+            xia_logc(log::fifo, log::error) << module_label(*this)
+                                            << "list-mode dispatcher: " << e.what();
+        }
+    }
+    xia_logc(log::fifo, log::debug) << module_label(*this) << "list-mode dispatcher: finished";
+}
+
 void module::read_stats(stats::stats& stats) {
     xia_log(log::info) << module_label(*this) << "read-stats: channels=" << channels.size();
     online_check();
@@ -1834,6 +3485,13 @@ void module::read_stats(stats::stats& stats) {
     stats::read(*this, stats);
 }
 
+error::code module::read_stats(stats::stats& stats, const std::nothrow_t&) noexcept {
+    return nothrow_read(*this, [this, &stats] {
+        lock_guard guard(lock_);
+        stats::read(*this, stats);
+    });
+}
+
 void module::read_autotau(hw::doubles& taus) {
     xia_log(log::info) << module_label(*this) << "read-autotau";
     online_check();
@@ -1849,22 +3507,82 @@ void module::set_fifo_buffers(const size_t buffers) {
         throw error(number, slot, error::code::module_invalid_var,
                     "fifo: buffer value out of range");
     }
-    xia_log(log::debug) << module_label(*this) << "fifo: buffers=" << buffers;
+    xia_logc(log::fifo, log::debug) << module_label(*this) << "fifo: buffers=" << buffers;
     fifo_buffers = buffers;
 }
 
+void module::set_fifo_buffers_max(const size_t buffers) {
+    if (buffers != 0 && (buffers < min_fifo_buffers || buffers > max_fifo_buffers)) {
+        throw error(number, slot, error::code::module_invalid_var,
+                    "fifo: buffer maximum value out of range");
+    }
+    xia_logc(log::fifo, log::debug) << module_label(*this) << "fifo: buffers-max=" << buffers;
+    fifo_buffers_max = buffers;
+}
+
+void module::set_fifo_buffer_words(const size_t words) {
+    if (words < min_fifo_buffer_words || words > max_fifo_buffer_words) {
+        throw error(number, slot, error::code::module_invalid_var,
+                    "fifo: buffer words value out of range");
+    }
+    xia_logc(log::fifo, log::debug) << module_label(*this) << "fifo: buffer-words=" << words;
+    fifo_buffer_words = words;
+}
+
+void module::set_fifo_auto_tune(const bool auto_tune, const size_t budget_bytes,
+                                const size_t tune_msecs) {
+    if (auto_tune && tune_msecs == 0) {
+        throw error(number, slot, error::code::module_invalid_var,
+                    "fifo: auto-tune period value out of range");
+    }
+    xia_logc(log::fifo, log::debug) << module_label(*this) << std::boolalpha
+                                    << "fifo: auto-tune=" << auto_tune
+                                    << " budget=" << budget_bytes << " period=" << tune_msecs;
+    fifo_tune_budget = budget_bytes;
+    fifo_tune_msecs = tune_msecs;
+    fifo_auto_tune = auto_tune;
+}
+
+fifo_tuning module::get_fifo_tuning() const {
+    buffer::lock_guard guard(fifo_tuned_lock);
+    return fifo_tuned;
+}
+
+bool module::apply_fifo_tuning() {
+    lock_guard guard(lock_);
+    if (run_task != hw::run::run_task::nop || test_mode.load() != test::off) {
+        throw error(number, slot, error::code::module_invalid_operation,
+                    "fifo: cannot apply the tuning while a task is running");
+    }
+    const fifo_tuning tuning = get_fifo_tuning();
+    if (!tuning.valid) {
+        return false;
+    }
+    xia_logc(log::fifo, log::info) << module_label(*this)
+                                   << "fifo: apply tuning: buffer-words=" << tuning.buffer_words
+                                   << " buffers=" << tuning.buffers;
+    const bool resize =
+        fifo_buffer_words != tuning.buffer_words || fifo_buffers != tuning.buffers;
+    fifo_buffer_words = tuning.buffer_words;
+    fifo_buffers = tuning.buffers;
+    if (resize && fifo_pool.number.load() != 0) {
+        recreate_fifo_pool();
+    }
+    return true;
+}
+
 void module::set_fifo_run_wait(const size_t run_wait) {
     if ((run_wait != 0 && run_wait < min_fifo_run_wait_usec) ||
         run_wait > max_fifo_run_wait_usec) {
         throw error(number, slot, error::code::module_invalid_var,
                     "fifo: run wait value out of range");
     }
-    xia_log(log::debug) << module_label(*this) << "fifo: run-wait=" << run_wait;
+    xia_logc(log::fifo, log::debug) << module_label(*this) << "fifo: run-wait=" << run_wait;
     if (run_wait == 0) {
-        xia_log(log::warning) << module_label(*this)
-                              << "fifo: setting run-wait to zero is not recommended, it may result in data loss";
-        xia_log(log::warning) << module_label(*this)
-                              << "fifo: setting run-wait to zero may be deprecated in future versions";
+        xia_logc(log::fifo, log::warning) << module_label(*this)
+                                          << "fifo: setting run-wait to zero is not recommended, it may result in data loss";
+        xia_logc(log::fifo, log::warning) << module_label(*this)
+                                          << "fifo: setting run-wait to zero may be deprecated in future versions";
     }
     fifo_run_wait_usecs = run_wait;
 }
@@ -1874,7 +3592,7 @@ void module::set_fifo_idle_wait(const size_t idle_wait) {
         throw error(number, slot, error::code::module_invalid_var,
                     "fifo: idle wait value out of range");
     }
-    xia_log(log::debug) << module_label(*this) << "fifo: idle-wait=" << idle_wait;
+    xia_logc(log::fifo, log::debug) << module_label(*this) << "fifo: idle-wait=" << idle_wait;
     fifo_idle_wait_usecs = idle_wait;
 }
 
@@ -1882,7 +3600,7 @@ void module::set_fifo_hold(const size_t hold) {
     if (hold < min_fifo_hold_usec || hold > max_fifo_hold_usec) {
         throw error(number, slot, error::code::module_invalid_var, "fifo: hold value out of range");
     }
-    xia_log(log::debug) << module_label(*this) << "fifo: hold=" << hold;
+    xia_logc(log::fifo, log::debug) << module_label(*this) << "fifo: hold=" << hold;
     fifo_hold_usecs = hold;
 }
 
@@ -1892,7 +3610,8 @@ void module::set_fifo_dma_trigger_level(const size_t dma_trigger_level) {
         throw error(number, slot, error::code::module_invalid_var,
                     "fifo: dma trigger level value out of range");
     }
-    xia_log(log::debug) << module_label(*this) << "fifo: dma-trigger-level=" << dma_trigger_level;
+    xia_logc(log::fifo, log::debug) << module_label(*this) << "fifo: dma-trigger-level="
+                                    << dma_trigger_level;
     fifo_dma_trigger_level = dma_trigger_level;
 }
 
@@ -1901,10 +3620,174 @@ void module::set_fifo_bandwidth(const size_t bandwidth) {
         throw error(number, slot, error::code::module_invalid_var,
                     "fifo: bandwidth value out of range");
     }
-    xia_log(log::debug) << module_label(*this) << "fifo: bandwidth=" << bandwidth;
+    xia_logc(log::fifo, log::debug) << module_label(*this) << "fifo: bandwidth=" << bandwidth;
     fifo_bandwidth = bandwidth;
 }
 
+void module::set_fifo_interrupt(const bool interrupt) {
+    xia_logc(log::fifo, log::debug) << module_label(*this) << std::boolalpha << "fifo: interrupt="
+                                    << interrupt;
+    lock_guard guard(lock_);
+    fifo_interrupt = interrupt;
+    if (fifo_worker_running.load()) {
+        if (interrupt) {
+            start_fifo_interrupt();
+        } else {
+            stop_fifo_interrupt();
+        }
+    }
+}
+
+void module::set_fifo_crc(const bool crc) {
+    xia_logc(log::fifo, log::debug) << module_label(*this) << std::boolalpha << "fifo: crc=" << crc;
+    fifo_crc = crc;
+}
+
+void module::set_fifo_adaptive(const bool adaptive) {
+    xia_logc(log::fifo, log::debug) << module_label(*this) << std::boolalpha
+                                    << "fifo: adaptive=" << adaptive;
+    fifo_adaptive = adaptive;
+}
+
+void module::set_fifo_huge_pages(const bool huge_pages) {
+    xia_logc(log::fifo, log::debug) << module_label(*this) << std::boolalpha
+                                    << "fifo: huge-pages=" << huge_pages;
+    fifo_huge_pages = huge_pages;
+}
+
+void module::set_fifo_steady_state(const bool steady_state) {
+    xia_logc(log::fifo, log::debug) << module_label(*this) << std::boolalpha
+                                    << "fifo: steady-state=" << steady_state;
+    fifo_steady_state = steady_state;
+}
+
+void module::set_fifo_direct(const bool direct) {
+    xia_logc(log::fifo, log::debug) << module_label(*this) << std::boolalpha
+                                    << "fifo: direct=" << direct;
+    lock_guard guard(lock_);
+    if (run_task != hw::run::run_task::nop || test_mode.load() != test::off) {
+        throw error(number, slot, error::code::module_invalid_operation,
+                    "fifo: cannot set direct reads while a task is running");
+    }
+    /*
+     * The worker is stopped before a reader can read directly and a
+     * direct read has finished before the worker starts. The worker only
+     * runs when the FIFO services are running.
+     */
+    const bool services = fifo_pool.valid();
+    if (direct && services) {
+        stop_fifo_worker();
+    }
+    {
+        buffer::lock_guard fifo_guard(fifo_read_lock);
+        fifo_direct = direct;
+    }
+    if (!direct && services) {
+        start_fifo_worker();
+    }
+}
+
+void module::set_fifo_filter(const data::list_mode::reduction& policy, const size_t fw_revision) {
+    lock_guard guard(lock_);
+    if (run_task != hw::run::run_task::nop) {
+        throw error(number, slot, error::code::module_invalid_operation,
+                    "fifo: cannot set the filter while a task is running");
+    }
+    if (channels.empty() || !channels[0].fixture) {
+        throw error(number, slot, error::code::module_invalid_operation,
+                    "fifo: filter needs the module's channels");
+    }
+    const size_t frequency = size_t(channels[0].fixture->config.adc_msps);
+    data::list_mode::event_filter filter;
+    filter.configure(policy, fw_revision, frequency);
+    xia_logc(log::fifo, log::debug) << module_label(*this) << std::boolalpha
+                                    << "fifo: filter: enabled=" << filter.enabled()
+                                    << " revision=" << fw_revision << " frequency=" << frequency;
+    buffer::lock_guard filter_guard(fifo_filter_lock);
+    fifo_filter = filter;
+    fifo_filtering = filter.enabled();
+}
+
+void module::set_fifo_validation(const bool validate, const size_t fw_revision,
+                                 const size_t zero_run_words) {
+    lock_guard guard(lock_);
+    if (run_task != hw::run::run_task::nop) {
+        throw error(number, slot, error::code::module_invalid_operation,
+                    "fifo: cannot set the validation while a task is running");
+    }
+    data::list_mode::event_validator validator;
+    if (validate) {
+        if (channels.empty() || !channels[0].fixture) {
+            throw error(number, slot, error::code::module_invalid_operation,
+                        "fifo: validation needs the module's channels");
+        }
+        const size_t frequency = size_t(channels[0].fixture->config.adc_msps);
+        validator.configure(fw_revision, frequency, size_t(slot),
+                            data::list_mode::event_validator::any_crate, zero_run_words);
+        xia_logc(log::fifo, log::debug) << module_label(*this) << "fifo: validation: revision="
+                                        << fw_revision << " frequency=" << frequency
+                                        << " zero-run=" << zero_run_words;
+    }
+    buffer::lock_guard validator_guard(fifo_validator_lock);
+    fifo_validator = validator;
+    fifo_validating = validator.enabled();
+}
+
+void module::start_fifo_capture(const std::string& path) {
+    lock_guard guard(lock_);
+    capture::header hdr;
+    hdr.slot = uint32_t(slot);
+    hdr.revision = uint32_t(revision);
+    if (!channels.empty() && channels[0].fixture) {
+        hdr.adc_msps = uint32_t(channels[0].fixture->config.adc_msps);
+    }
+    buffer::lock_guard capture_guard(fifo_capture_lock);
+    fifo_capturing = false;
+    fifo_capture.open(path, hdr);
+    fifo_capturing = true;
+    xia_logc(log::fifo, log::info) << module_label(*this) << "fifo: capture: start: " << path;
+}
+
+void module::stop_fifo_capture() {
+    lock_guard guard(lock_);
+    buffer::lock_guard capture_guard(fifo_capture_lock);
+    fifo_capturing = false;
+    if (fifo_capture.is_open()) {
+        xia_logc(log::fifo, log::info)
+            << module_label(*this) << "fifo: capture: stop: " << fifo_capture.path
+            << " chunks=" << fifo_capture.chunks << " words=" << fifo_capture.words;
+        fifo_capture.close();
+    }
+}
+
+void module::set_fifo_placement(const worker_placement& placement) {
+    if (placement.policy != util::sched_policy::other &&
+        (placement.priority < 1 || placement.priority > 99)) {
+        throw error(number, slot, error::code::module_invalid_var,
+                    "fifo: worker priority value out of range");
+    }
+    xia_logc(log::fifo, log::debug) << module_label(*this) << std::boolalpha
+                                    << "fifo: placement: cpus=" << util::cpu_list(placement.cpus)
+                                    << " pci-local=" << placement.pci_local
+                                    << " policy=" << int(placement.policy)
+                                    << " priority=" << placement.priority
+                                    << " numa-local=" << placement.numa_local;
+    lock_guard guard(lock_);
+    fifo_placement = placement;
+    apply_fifo_placement();
+}
+
+void module::set_fifo_watermarks(const size_t high, const size_t low,
+                                 buffer::pool::watermark_handler handler) {
+    xia_logc(log::fifo, log::debug) << module_label(*this) << "fifo: watermarks: high=" << high
+                                    << " low=" << low;
+    fifo_pool.set_watermarks(high, low, handler);
+}
+
+util::crc32::value_type module::fifo_data_crc() const {
+    return fifo_crc_value.load();
+}
+
 void module::select_port(const int port) {
     bus_guard guard(*this);
     cfg_ctrlcs &= ~(7 << 19);
@@ -1936,6 +3819,44 @@ char module::revision_label() const {
     return static_cast<char>(revision + 55);
 }
 
+module::bus_stats module::bus_hold_stats() const {
+    return bus_lock_.stats();
+}
+
+void module::bus_hold_stats_reset() {
+    bus_lock_.stats_reset();
+}
+
+module::lock_stats module::lock_wait_stats() const {
+    std::lock_guard<std::mutex> guard(lock_stats_lock);
+    return lock_stats_;
+}
+
+void module::lock_wait_stats_reset() {
+    std::lock_guard<std::mutex> guard(lock_stats_lock);
+    lock_stats_ = lock_stats();
+}
+
+module::lock_type& module::lock_acquire() {
+    typedef std::chrono::steady_clock clock;
+    size_t waited = 0;
+    const bool contended = !lock_.try_lock();
+    if (contended) {
+        const auto start = clock::now();
+        lock_.lock();
+        waited = size_t(
+            std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - start).count());
+    }
+    std::lock_guard<std::mutex> guard(lock_stats_lock);
+    ++lock_stats_.locks;
+    if (contended) {
+        ++lock_stats_.waits;
+        lock_stats_.total_wait_usecs += waited;
+        lock_stats_.max_wait_usecs = std::max(lock_stats_.max_wait_usecs, waited);
+    }
+    return lock_;
+}
+
 void module::report(std::ostream& out) const {
     util::ostream_guard flags(out);
 
@@ -1965,10 +3886,37 @@ void module::report(std::ostream& out) const {
         << "EEPROM Format   : " << eeprom_format << std::endl
         << std::endl
         << "FIFO Buffers    : " << fifo_buffers << std::endl
+        << "FIFO Buffers Max: " << fifo_buffers_max << std::endl
+        << "FIFO Buf Words  : " << fifo_buffer_words << std::endl
+        << "FIFO Auto-tune  : " << std::boolalpha << fifo_auto_tune.load() << std::noboolalpha
+        << std::endl
         << "FIFO Run wait   : " << fifo_run_wait_usecs << " usecs" << std::endl
         << "FIFO Idle wait  : " << fifo_idle_wait_usecs << " usecs" << std::endl
         << "FIFO Hold       : " << fifo_hold_usecs << " usecs" << std::endl
         << "FIFO DMA Trig   : " << fifo_dma_trigger_level << " words" << std::endl
+        << "FIFO Adaptive   : " << std::boolalpha << fifo_adaptive.load() << std::noboolalpha
+        << std::endl
+        << "FIFO Huge pages : " << std::boolalpha << fifo_huge_pages.load() << std::noboolalpha
+        << std::endl
+        << "FIFO Steady     : " << std::boolalpha << fifo_steady_state.load() << std::noboolalpha
+        << std::endl
+        << "FIFO Direct     : " << std::boolalpha << fifo_direct.load() << std::noboolalpha
+        << std::endl
+        << "FIFO Filter     : " << std::boolalpha << fifo_filtering.load() << std::noboolalpha
+        << std::endl
+        << "FIFO Validate   : " << std::boolalpha << fifo_validating.load() << std::noboolalpha
+        << std::endl
+        << "FIFO Capture    : " << std::boolalpha << fifo_capturing.load() << std::noboolalpha
+        << std::endl
+        << "FIFO CPUs       : "
+        << (fifo_placement.cpus.empty() && fifo_placement.pci_local ?
+                "pci-local" :
+                util::cpu_list(fifo_placement.cpus))
+        << std::endl
+        << "FIFO Sched      : policy=" << int(fifo_placement.policy)
+        << " priority=" << fifo_placement.priority << std::endl
+        << "FIFO NUMA local : " << std::boolalpha << fifo_placement.numa_local
+        << std::noboolalpha << std::endl
         << "FIFO Bandwidth  : ";
     if (fifo_bandwidth == 0) {
         out << "unlimited";
@@ -1981,6 +3929,42 @@ void module::report(std::ostream& out) const {
         << "IO CPLD old     : " << io_cpld_version_old << std::endl
         << std::endl;
 
+    auto bus = bus_hold_stats();
+    out << "Bus Holds       : " << bus.holds << std::endl
+        << "Bus Max Hold    : " << bus.max_hold_usecs << " usecs" << std::endl
+        << "Bus Total Hold  : " << bus.total_hold_usecs << " usecs" << std::endl
+        << "Bus FIFO Holds  : " << bus.fifo_holds << std::endl
+        << "Bus FIFO Max    : " << bus.max_fifo_hold_usecs << " usecs" << std::endl
+        << "Bus FIFO Waits  : " << bus.fifo_waits << std::endl
+        << "Bus Waits       : " << bus.waits << std::endl
+        << "Bus Max Wait    : " << bus.max_wait_usecs << " usecs" << std::endl
+        << "Bus Total Wait  : " << bus.total_wait_usecs << " usecs" << std::endl
+        << std::endl;
+
+    auto locks = lock_wait_stats();
+    out << "Lock Locks      : " << locks.locks << std::endl
+        << "Lock Waits      : " << locks.waits << std::endl
+        << "Lock Max Wait   : " << locks.max_wait_usecs << " usecs" << std::endl
+        << "Lock Total Wait : " << locks.total_wait_usecs << " usecs" << std::endl
+        << std::endl;
+
+    out << "Task Latency    : count last min max expected polls, usecs" << std::endl;
+    auto task_latency = [&out, this](hw::run::control_task task, const char* label) {
+        auto latency = task_latencies.get(task);
+        if (latency.count != 0) {
+            out << "  " << std::left << std::setw(14) << label << std::right << ": "
+                << latency.count << ' ' << latency.last_usecs << ' ' << latency.min_usecs << ' '
+                << latency.max_usecs << ' ' << latency.expected_usecs << ' '
+                << latency.last_polls << std::endl;
+        }
+    };
+    for (int task = 0; task < int(hw::run::control_task::reset_adc) + 1; ++task) {
+        auto control_tsk = hw::run::control_task(task);
+        task_latency(control_tsk, hw::run::control_task_label(control_tsk));
+    }
+    task_latency(hw::run::control_task::nop, "run_end");
+    out << std::endl;
+
     if (online()) {
         out << "Address Map" << std::endl << "-----------" << std::endl;
         param_addresses.output(out, true);
@@ -2020,22 +4004,8 @@ void module::dma_read(const hw::address source, hw::words& values) {
     dma_read(source, values.data(), values.size());
 }
 
-void module::dma_read(const hw::address source, hw::word_ptr values, const size_t size) {
-    xia_log(log::debug) << module_label(*this) << "dma read: addr=0x" << std::hex << source
-                        << " length=" << std::dec << size;
-
-    online_check();
-
-    if (bus_lock_.try_lock()) {
-        bus_lock_.unlock();
-        throw error(number, slot, error::code::device_dma_failure, "bus lock not held");
-    }
-
-    util::timepoint tp;
-    tp.start();
-
-    PLX_DMA_PARAMS dma_params;
-
+static void dma_read_params(PLX_DMA_PARAMS& dma_params, const hw::address source,
+                            hw::word_ptr values, const size_t size) {
     memset(&dma_params, 0, sizeof(PLX_DMA_PARAMS));
 
 #if PLX_SDK_VERSION_MAJOR < 6
@@ -2047,6 +4017,45 @@ void module::dma_read(const hw::address source, hw::word_ptr values, const size_
 #endif
     dma_params.LocalAddr = source;
     dma_params.ByteCount = U32(size * sizeof(hw::words::value_type));
+}
+
+static void dma_write_params(PLX_DMA_PARAMS& dma_params, const hw::address dest,
+                             const hw::word* values, const size_t size) {
+    memset(&dma_params, 0, sizeof(PLX_DMA_PARAMS));
+
+    /*
+     * The PLX API does not take a const buffer, the buffer is only read.
+     */
+    hw::word_ptr buffer = const_cast<hw::word_ptr>(values);
+#if PLX_SDK_VERSION_MAJOR < 6
+    dma_params.u.UserVa = static_cast<PLX_UINT_PTR>(buffer);
+    dma_params.LocalToPciDma = 0;
+#else
+    dma_params.UserVa = PLX_PTR_TO_INT(buffer);
+    dma_params.Direction = PLX_DMA_PCI_TO_LOC;
+#endif
+    dma_params.LocalAddr = dest;
+    dma_params.ByteCount = U32(size * sizeof(hw::words::value_type));
+}
+
+void module::dma_read(const hw::address source, hw::word_ptr values, const size_t size) {
+    PIXIE_PROFILE_SCOPE("module::dma_read");
+    xia_logc(log::dma, log::debug) << module_label(*this) << "dma read: addr=0x" << std::hex
+                                   << source << " length=" << std::dec << size;
+
+    online_check();
+
+    if (!bus_lock_.held()) {
+        throw error(number, slot, error::code::device_dma_failure, "bus lock not held");
+    }
+
+    PIXIE_TRACEPOINT3(dma_read_entry, number, source, size);
+
+    util::timepoint tp;
+    tp.start();
+
+    PLX_DMA_PARAMS dma_params;
+    dma_read_params(dma_params, source, values, size);
 
     /*
      * Wait while reading. The call will block until the interrupt happens.
@@ -2060,7 +4069,41 @@ void module::dma_read(const hw::address source, hw::word_ptr values, const size_
 
     tp.end();
 
-    xia_log(log::debug) << module_label(*this) << "dma read: done, period=" << tp;
+    PIXIE_TRACEPOINT3(dma_read_exit, number, size, tp.usecs());
+
+    xia_logc(log::dma, log::debug) << module_label(*this) << "dma read: done, period=" << tp;
+}
+
+void module::dma_write(const hw::address dest, const hw::word* values, const size_t size) {
+    xia_logc(log::dma, log::debug) << module_label(*this) << "dma write: addr=0x" << std::hex
+                                   << dest << " length=" << std::dec << size;
+
+    online_check();
+
+    if (!bus_lock_.held()) {
+        throw error(number, slot, error::code::device_dma_failure, "bus lock not held");
+    }
+
+    if (!have_hardware || size == 0) {
+        return;
+    }
+
+    util::timepoint tp;
+    tp.start();
+
+    PLX_DMA_PARAMS dma_params;
+    dma_write_params(dma_params, dest, values, size);
+
+    PLX_STATUS ps = ::PlxPci_DmaTransferUserBuffer(&device->handle, 0, &dma_params, 5 * 1000);
+    if (ps != PLX_STATUS_OK) {
+        std::ostringstream oss;
+        oss << "DMA write: " << pci_error_text(ps);
+        throw error(number, slot, error::code::device_dma_failure, oss.str());
+    }
+
+    tp.end();
+
+    xia_logc(log::dma, log::debug) << module_label(*this) << "dma write: done, period=" << tp;
 }
 
 hw::rev_tag module::get_rev_tag() const {
@@ -2123,6 +4166,29 @@ int module::pci_slot() {
     return -1;
 }
 
+void module::pci_local_cpus(util::cpus& cpus) {
+    cpus.clear();
+#if defined(__linux__)
+    lock_guard guard(lock_);
+    if (device && device->device_number >= 0) {
+        std::ostringstream path;
+        path << "/sys/bus/pci/devices/" << std::hex << std::setfill('0') << std::setw(4)
+             << device->domain() << ':' << std::setw(2) << device->bus() << ':' << std::setw(2)
+             << device->slot() << '.' << int(device->key.function) << "/local_cpulist";
+        std::ifstream in(path.str());
+        std::string list;
+        if (in && std::getline(in, list)) {
+            try {
+                util::parse_cpu_list(cpus, list);
+            } catch (std::runtime_error& e) {
+                xia_log(log::warning) << module_label(*this) << "PCI local CPUs: " << e.what();
+                cpus.clear();
+            }
+        }
+    }
+#endif
+}
+
 void module::start_test(const test mode) {
     xia_log(log::info) << module_label(*this) << "start-test: mode=" << int(mode);
     online_check();
@@ -2136,12 +4202,12 @@ void module::start_test(const test mode) {
     }
     switch (mode) {
         case test::lm_fifo:
-            xia_log(log::debug) << "pause the FIFO worker";
+            xia_logc(log::fifo, log::debug) << "pause the FIFO worker";
             test_mode = mode;
             run_stats.start();
             hw::run::start(*this, hw::run::run_mode::new_run, hw::run::run_task::nop,
                            hw::run::control_task::fill_ext_fifo);
-            xia_log(log::debug) << "unpause the FIFO worker";
+            xia_logc(log::fifo, log::debug) << "unpause the FIFO worker";
             pause_fifo_worker = false;
             break;
         default:
@@ -2159,12 +4225,22 @@ void module::set_bus_device_number(size_t device_number) {
     device->device_number = int(device_number);
 }
 
+hw::word module::no_hw_read_word(int ) {
+    return 0;
+}
+
+void module::no_hw_write_word(int , const hw::word ) {}
+
 void module::load_vars() {
     if (!vars_loaded) {
         firmware::firmware_ref vars = get("var");
         vars->load();
-        param::load(vars, module_var_descriptors, channel_var_descriptors);
-        param_addresses.set(max_channels, module_var_descriptors, channel_var_descriptors);
+        auto table = param::load_table(vars, max_channels);
+        module_var_descriptors =
+            param::shared_module_var_descs::descs_ptr(table, &table->module_descs);
+        channel_var_descriptors =
+            param::shared_channel_var_descs::descs_ptr(table, &table->channel_descs);
+        param_addresses = table->addresses;
         vars_loaded = true;
         xia_log(log::info) << module_label(*this) << "address map: " << param_addresses;
     }
@@ -2222,6 +4298,7 @@ void module::init_channels() {
     if (fixtures) {
         fixtures->init_channels();
     }
+    create_var_image();
 }
 
 void module::module_csrb(param::value_type value, size_t offset, bool io) {
@@ -2380,8 +4457,10 @@ void module::start_fifo_services() {
         if (fippi.done()) {
             hw::csr::reset(*this);
             if (!fifo_pool.valid()) {
-                fifo_pool.create(fifo_buffers, 64 * 1024);
-                start_fifo_worker();
+                create_fifo_pool();
+                if (!fifo_direct.load()) {
+                    start_fifo_worker();
+                }
                 hw::run::end(*this);
             }
         }
@@ -2390,24 +4469,93 @@ void module::start_fifo_services() {
 
 void module::stop_fifo_services() {
     stop_fifo_worker();
+    buffer::lock_guard guard(fifo_read_lock);
+    fifo_ring.destroy();
     fifo_data.flush();
     fifo_pool.destroy();
 }
 
+void module::create_fifo_pool() {
+    /*
+     * An elastic pool grows by a tenth of its base size and the
+     * ring holds the maximum number of buffers.
+     */
+    const size_t buffers_max = std::max(fifo_buffers, fifo_buffers_max);
+    fifo_pool.set_elastic(buffers_max > fifo_buffers ? buffers_max : 0,
+                          std::max(fifo_buffers / 10, size_t(1)));
+    /*
+     * A NUMA local pool is created by a thread pinned to the
+     * worker's CPUs. Locking the pages faults them in so the
+     * first touch places the memory on the thread's node.
+     */
+    util::cpus cpus;
+    if (fifo_placement.numa_local) {
+        fifo_placement_cpus(cpus);
+    }
+    if (cpus.empty()) {
+        fifo_pool.create(fifo_buffers, fifo_buffer_words, true, fifo_huge_pages.load());
+    } else {
+        std::exception_ptr create_error;
+        std::thread allocator([this, &cpus, &create_error]() {
+            try {
+                util::set_thread_affinity(cpus);
+                fifo_pool.create(fifo_buffers, fifo_buffer_words, true, fifo_huge_pages.load());
+            } catch (...) {
+                create_error = std::current_exception();
+            }
+        });
+        allocator.join();
+        if (create_error) {
+            std::rethrow_exception(create_error);
+        }
+    }
+    fifo_ring.create(buffers_max);
+}
+
+void module::recreate_fifo_pool() {
+    const bool worker = fifo_worker_running.load();
+    stop_fifo_worker();
+    {
+        buffer::lock_guard guard(fifo_read_lock);
+        fifo_ring.flush();
+        fifo_data.flush();
+        try {
+            fifo_pool.destroy();
+        } catch (...) {
+            if (worker) {
+                start_fifo_worker();
+            }
+            throw;
+        }
+        fifo_ring.destroy();
+    }
+    create_fifo_pool();
+    if (worker) {
+        start_fifo_worker();
+    }
+}
+
 void module::start_fifo_worker() {
-    xia_log(log::debug) << module_label(*this) << std::boolalpha
-                        << "FIFO worker: starting: running=" << fifo_worker_running.load();
+    xia_logc(log::fifo, log::debug) << module_label(*this) << std::boolalpha
+                                    << "FIFO worker: starting: running="
+                                    << fifo_worker_running.load();
     if (!fifo_worker_running.load()) {
         pause_fifo_worker = true;
         fifo_worker_finished = false;
         fifo_worker_running = true;
         fifo_thread = std::thread(&module::fifo_worker, this);
+        apply_fifo_placement();
+        if (fifo_interrupt.load()) {
+            start_fifo_interrupt();
+        }
     }
 }
 
 void module::stop_fifo_worker() {
-    xia_log(log::debug) << module_label(*this) << std::boolalpha
-                        << "FIFO worker: stopping: running=" << fifo_worker_running.load();
+    xia_logc(log::fifo, log::debug) << module_label(*this) << std::boolalpha
+                                    << "FIFO worker: stopping: running="
+                                    << fifo_worker_running.load();
+    stop_fifo_interrupt();
     fifo_worker_running = false;
     {
         sync::variable::lock_guard guard(fifo_worker_working);
@@ -2418,12 +4566,133 @@ void module::stop_fifo_worker() {
     }
 }
 
+void module::fifo_placement_cpus(util::cpus& cpus) {
+    cpus = fifo_placement.cpus;
+    if (cpus.empty() && fifo_placement.pci_local) {
+        pci_local_cpus(cpus);
+    }
+}
+
+void module::apply_fifo_placement() {
+    if (!fifo_thread.joinable()) {
+        return;
+    }
+    /*
+     * The placement is a performance hint, a worker that cannot be placed
+     * still runs.
+     */
+    util::cpus cpus;
+    fifo_placement_cpus(cpus);
+    if (!cpus.empty() && !util::set_thread_affinity(fifo_thread, cpus)) {
+        xia_logc(log::fifo, log::warning) << module_label(*this)
+                                          << "FIFO worker: CPU affinity not set: cpus="
+                                          << util::cpu_list(cpus);
+    }
+    if (fifo_placement.policy != util::sched_policy::other &&
+        !util::set_thread_scheduling(fifo_thread, fifo_placement.policy,
+                                     fifo_placement.priority)) {
+        xia_logc(log::fifo, log::warning) << module_label(*this)
+                                          << "FIFO worker: scheduling not set: policy="
+                                          << int(fifo_placement.policy)
+                                          << " priority=" << fifo_placement.priority;
+    }
+}
+
+void module::start_fifo_interrupt() {
+    if (fifo_irq_running.load()) {
+        return;
+    }
+    stop_fifo_interrupt();
+    if (!have_hardware || device->device_number < 0) {
+        xia_logc(log::fifo, log::warning) << module_label(*this)
+                                          << "FIFO interrupt: no hardware, FIFO worker polling";
+        return;
+    }
+    xia_logc(log::fifo, log::debug) << module_label(*this) << "FIFO interrupt: starting";
+    ::memset(&device->irq, 0, sizeof(PLX_INTERRUPT));
+    /*
+     * The local interrupt (LINTi#) from the System FPGA.
+     */
+    device->irq.LocalToPci = 1;
+    PLX_STATUS ps = ::PlxPci_NotificationRegisterFor(&device->handle, &device->irq,
+                                                     &device->notify);
+    if (ps == PLX_STATUS_OK) {
+        ps = ::PlxPci_InterruptEnable(&device->handle, &device->irq);
+        if (ps != PLX_STATUS_OK) {
+            ::PlxPci_NotificationCancel(&device->handle, &device->notify);
+        }
+    }
+    if (ps != PLX_STATUS_OK) {
+        xia_logc(log::fifo, log::warning) << module_label(*this) << "FIFO interrupt: arm failed: "
+                                          << pci_error_text(ps) << ", FIFO worker polling";
+        return;
+    }
+    fifo_irq_pending = false;
+    fifo_irq_running = true;
+    fifo_irq_thread = std::thread(&module::fifo_interrupt_notifier, this);
+}
+
+void module::stop_fifo_interrupt() {
+    /*
+     * The notifier can exit on an error so check the thread and not the
+     * running flag.
+     */
+    if (!fifo_irq_thread.joinable()) {
+        return;
+    }
+    xia_logc(log::fifo, log::debug) << module_label(*this) << "FIFO interrupt: stopping";
+    fifo_irq_running = false;
+    /*
+     * Cancelling the notification releases the notifier's wait.
+     */
+    ::PlxPci_InterruptDisable(&device->handle, &device->irq);
+    ::PlxPci_NotificationCancel(&device->handle, &device->notify);
+    fifo_irq_thread.join();
+    fifo_irq_pending = false;
+}
+
+void module::fifo_interrupt_notifier() {
+    xia_logc(log::fifo, log::info) << module_label(*this) << "FIFO interrupt: running";
+    while (fifo_irq_running.load()) {
+        /*
+         * Time out at the idle period so a stop is seen if the cancel is
+         * missed. The PLX wait period is in milliseconds.
+         */
+        const U64 timeout_msecs = (fifo_idle_wait_usecs.load() + 999) / 1000;
+        PLX_STATUS ps = ::PlxPci_NotificationWait(&device->handle, &device->notify,
+                                                  timeout_msecs);
+        if (!fifo_irq_running.load()) {
+            break;
+        }
+        if (ps == PLX_STATUS_OK) {
+            fifo_irq_pending = true;
+            {
+                sync::variable::lock_guard guard(fifo_worker_working);
+                fifo_worker_req.notify();
+            }
+            /*
+             * The driver masks the interrupt when it fires, enable it for
+             * the next event.
+             */
+            ::PlxPci_InterruptEnable(&device->handle, &device->irq);
+        } else if (ps != PLX_STATUS_TIMEOUT) {
+            xia_logc(log::fifo, log::warning) << module_label(*this)
+                                              << "FIFO interrupt: wait failed: "
+                                              << pci_error_text(ps) << ", FIFO worker polling";
+            break;
+        }
+    }
+    fifo_irq_running = false;
+    xia_logc(log::fifo, log::info) << module_label(*this) << "FIFO interrupt: finishing";
+}
+
 void module::fifo_worker() {
     hw::memory::fifo fifo(*this);
 
     size_t level = fifo.level();
 
-    xia_log(log::info) << module_label(*this) << "FIFO worker: running, level=" << level;
+    xia_logc(log::fifo, log::info) << module_label(*this) << "FIFO worker: running, level="
+                                   << level;
 
     /*
      * The worker must not hold the module's lock. That lock is for
@@ -2441,6 +4710,49 @@ void module::fifo_worker() {
 
         int requested_wait_loops = 0;
 
+        /*
+         * Telemetry of the worker. The data latency is from the poll that
+         * first sees data in the FIFO to the data being queued.
+         */
+        typedef std::chrono::steady_clock worker_clock;
+        auto elapsed_usecs = [](worker_clock::time_point from, worker_clock::time_point to) {
+            return size_t(std::chrono::duration_cast<std::chrono::microseconds>(to - from).count());
+        };
+        worker_clock::time_point last_poll;
+        bool polled = false;
+        worker_clock::time_point data_seen;
+        bool data_pending = false;
+
+        /*
+         * Adaptive scheduling. The remaining level is the FIFO level left
+         * after the last poll's reads.
+         */
+        bool adaptive = false;
+        fifo_rate data_rate;
+        size_t remaining = 0;
+        size_t dma_trigger_level = fifo_dma_trigger_level.load();
+
+        auto read_level = [&]() {
+            auto now = worker_clock::now();
+            size_t since_poll = polled ? elapsed_usecs(last_poll, now) : 0;
+            if (polled) {
+                run_stats.poll_usecs.record(since_poll);
+            }
+            last_poll = now;
+            polled = true;
+            size_t fifo_level = fifo.level();
+            run_stats.level_words.record(fifo_level);
+            if (adaptive && fifo_level != std::numeric_limits<hw::word>::max()) {
+                data_rate.sample(fifo_level, remaining, since_poll);
+                remaining = fifo_level;
+            }
+            if (fifo_level != 0 && !data_pending) {
+                data_seen = now;
+                data_pending = true;
+            }
+            return fifo_level;
+        };
+
         sync::variable::lock_guard guard(fifo_worker_working);
 
         while (fifo_worker_running.load()) {
@@ -2453,6 +4765,23 @@ void module::fifo_worker() {
 
             hw::run::run_task this_run_tsk = run_task.load();
 
+            /*
+             * A run that ends in the tune period finishes the tuning.
+             */
+            if (fifo_tuning_run && this_run_tsk != hw::run::run_task::list_mode) {
+                fifo_tune_finish();
+            }
+
+            pixie::alloc::watch watching(run_allocations());
+
+            /*
+             * Shrink a grown pool when idle. Only the unused buffers are
+             * freed.
+             */
+            if (this_run_tsk == hw::run::run_task::nop && fifo_pool.grown()) {
+                fifo_pool.shrink();
+            }
+
             /*
              * If the run wait time is set to the 0 the worker is
              * synchronous to the user's calls and there is no wait
@@ -2474,13 +4803,40 @@ void module::fifo_worker() {
              */
             bool mode_asynchronous = run_wait != 0;
 
+            /*
+             * If the interrupt is armed the worker is woken when there is
+             * data and only polls at the idle period.
+             */
+            const bool irq_armed = fifo_irq_running.load();
+
+            /*
+             * Adaptive scheduling sets the wait period from the data rate
+             * during a list-mode run so the FIFO level at the next poll is
+             * the target level.
+             */
+            const bool was_adaptive = adaptive;
+            adaptive = mode_asynchronous && fifo_adaptive.load() && !irq_armed &&
+                this_run_tsk == hw::run::run_task::list_mode && test_mode.load() == test::off;
+            if (!adaptive) {
+                data_rate.reset();
+                dma_trigger_level = fifo_dma_trigger_level.load();
+            } else if (!was_adaptive) {
+                remaining = 0;
+            }
+
             if (mode_asynchronous) {
-                if (this_run_tsk == hw::run::run_task::list_mode) {
-                    wait_time = run_wait;
+                if (adaptive) {
+                    wait_time = data_rate.wait_usecs(remaining, fifo_adaptive_target_level,
+                                                     min_fifo_run_wait_usec,
+                                                     fifo_idle_wait_usecs.load());
+                    dma_trigger_level = data_rate.trigger_level(
+                        wait_time, min_fifo_dma_trigger_level, fifo_adaptive_target_level);
+                } else if (this_run_tsk == hw::run::run_task::list_mode) {
+                    wait_time = irq_armed ? fifo_idle_wait_usecs.load() : run_wait;
                 }
                 if (test_mode.load() != test::off) {
                     wait_time = run_wait;
-                } else {
+                } else if (!adaptive) {
                     const size_t idle_wait_time = fifo_idle_wait_usecs.load();
                     /*
                      * WHen the wait time is equal to the idle period nothing
@@ -2503,8 +4859,8 @@ void module::fifo_worker() {
                  * The level is read only once when the mode is
                  * synchronous.
                  */
-                level = fifo.level();
-                xia_log(log::debug) << "fifo worker: fifo-level = " << level;
+                level = read_level();
+                xia_logc(log::fifo, log::debug) << "fifo worker: fifo-level = " << level;
             }
 
             /*
@@ -2522,22 +4878,25 @@ void module::fifo_worker() {
                  */
                 this_run_tsk = run_task.load();
                 if (this_run_tsk != hw::run::run_task::nop &&
-                    this_run_tsk != hw::run::run_task::run_stopping && !hw::run::active(*this)) {
+                    this_run_tsk != hw::run::run_task::run_stopping && !run_prepared.load() &&
+                    !hw::run::active(*this)) {
                     run_task = hw::run::run_task::nop;
-                    xia_log(log::info) << module_label(*this) << "FIFO worker: run not active";
+                    xia_logc(log::fifo, log::info) << module_label(*this)
+                                                   << "FIFO worker: run not active";
                 }
                 /*
                  * Read the level of the FIFO every loop when the mode
                  * is asynchronous.
                  */
                 if (mode_asynchronous) {
-                    level = fifo.level();
-                    xia_log(log::debug) << "fifo worker: fifo-level = " << level;
+                    level = read_level();
+                    xia_logc(log::fifo, log::debug) << "fifo worker: fifo-level = " << level;
                 }
                 if (level >= hw::fifo_size_words) {
                     if (!fifo_full_logged) {
                         fifo_full_logged = true;
-                        xia_log(log::warning) << module_label(*this) << "FIFO worker: FIFO full";
+                        xia_logc(log::fifo, log::warning) << module_label(*this)
+                                                          << "FIFO worker: FIFO full";
                     }
                     run_stats.hw_overflows++;
                 }
@@ -2553,25 +4912,35 @@ void module::fifo_worker() {
                 if (level == 0 ||
                     (mode_asynchronous && !requester_waiting &&
                      hold_time < fifo_hold_usecs.load() &&
-                     level < fifo_dma_trigger_level.load())) {
+                     level < dma_trigger_level)) {
                     break;
                 }
                 if (level == std::numeric_limits<hw::word>::max()) {
                     auto level2 = fifo.level();
-                    xia_log(log::debug) << module_label(*this) << "invalid FIFO level: " << level
-                                        << " repeat read: " << level2;
+                    xia_logc(log::fifo, log::debug) << module_label(*this) << "invalid FIFO level: "
+                                                    << level << " repeat read: " << level2;
                     break;
                 }
                 /*
                  * We do not bother compacting if we are less than 3
                  */
-                const size_t fifo_pool_count = fifo_pool.count();
+                size_t fifo_pool_count = fifo_pool.count();
+                /*
+                 * Grow an elastic pool before compacting.
+                 */
+                if (fifo_pool_count < 4 && fifo_pool.grow()) {
+                    fifo_pool_count = fifo_pool.count();
+                }
                 if (fifo_pool_count < 4 && fifo_pool_count > 1) {
                     if (!pool_empty_logged) {
-                        xia_log(log::warning) << module_label(*this) << "FIFO worker: pool empty,"
-                                              << " compacting queue ...";
+                        xia_logc(log::fifo, log::warning) << module_label(*this)
+                                                          << "FIFO worker: pool empty,"
+                                                          << " compacting queue ...";
                     }
+                    auto compact_start = worker_clock::now();
                     fifo_data.compact();
+                    run_stats.compact_usecs.record(
+                        elapsed_usecs(compact_start, worker_clock::now()));
                 }
                 /*
                  * Queue the buffer if there is more than one
@@ -2590,35 +4959,29 @@ void module::fifo_worker() {
                         read_words = buf->capacity();
                     }
                     buf->resize(read_words);
-                    fifo.read(*buf, read_words);
+                    /*
+                     * The read holds the bus with FIFO priority for the
+                     * transfer only. The buffer is queued once the bus is
+                     * released.
+                     */
+                    auto dma_start = worker_clock::now();
+                    fifo.read(buf->data(), read_words);
+                    auto dma_end = worker_clock::now();
                     run_stats.dma_in += read_words;
-                    if (queue_buf) {
-                        run_stats.in += read_words;
-                        fifo_data.push(buf);
-                    } else {
-                        run_stats.dropped += read_words;
-                        xia_log(log::debug) << module_label(*this)
-                                            << std::boolalpha
-                                            << "buffer drop: fifo_pool_count="
-                                            << (fifo_pool_count > 1)
-                                            << " fifo-worker-paused="
-                                            << pause_fifo_worker.load();
+                    run_stats.dma_usecs.record(elapsed_usecs(dma_start, dma_end));
+                    run_stats.dma_words.record(read_words);
+                    if (fifo_tuning_run || fifo_tune_pending.load()) {
+                        fifo_tune_sample(buf, dma_end);
                     }
+                    fifo_queue(buf, queue_buf, data_pending ? data_seen : dma_start, dma_start);
                     /*
-                     * If the logging level is `debug` compute the CRC32 of the data
-                     * queued. This can be used to verify the data received by the
-                     * user API.
+                     * Data left in the FIFO is seen from the end of this
+                     * transfer.
                      */
-                    util::crc32 crc;
-                    if (logging::level_logging(log::debug)) {
-                        crc.update(*buf);
-                    }
-                    xia_log(log::debug) << module_label(*this)
-                                        << "FIFO read, level=" << level
-                                        << " read-words=" << read_words
-                                        << " data-fifo-words=" << fifo_data.count()
-                                        << " crc=0x" << std::hex << crc.value
-                                        << std::boolalpha << " queue-buf=" << queue_buf;
+                    data_pending = level > read_words;
+                    data_seen = dma_end;
+                    xia_logc(log::fifo, log::debug) << module_label(*this) << "FIFO read, level="
+                                                    << level << " read-words=" << read_words;
                     hold_time = 0;
                     pool_empty_logged = false;
                     fifo_full_logged = false;
@@ -2626,10 +4989,11 @@ void module::fifo_worker() {
                      * Update the level for synchronous mode.
                      */
                     level -= read_words;
+                    remaining = level;
                 } else {
                     if (!pool_empty_logged) {
-                        xia_log(log::warning) << module_label(*this)
-                                              << "FIFO worker: pool empty";
+                        xia_logc(log::fifo, log::warning) << module_label(*this)
+                                                          << "FIFO worker: pool empty";
                         pool_empty_logged = true;
                     }
                     break;
@@ -2639,8 +5003,8 @@ void module::fifo_worker() {
                  * Bandwidth of run FIFO performance stats.
                  */
                 if (run_stats.update_bandwidth()) {
-                     xia_log(log::debug) << module_label(*this)
-                                         << "FIFO stats:  run: " << run_stats.output();
+                     xia_logc(log::fifo, log::debug) << module_label(*this) << "FIFO stats:  run: "
+                                                     << run_stats.output();
                 }
 
                 if (mode_asynchronous) {
@@ -2656,7 +5020,8 @@ void module::fifo_worker() {
                             if (wait_time < slice) {
                                 wait_time = slice;
                             }
-                            xia_log(log::debug) << "BW limiter: data in:: " << data_in_bw << "MB";
+                            xia_logc(log::fifo, log::debug) << "BW limiter: data in:: "
+                                                            << data_in_bw << "MB";
                             break;
                         }
                     }
@@ -2671,7 +5036,8 @@ void module::fifo_worker() {
              */
             if (requester_waiting) {
                 if (requested_wait_loops == 0) {
-                    xia_log(log::debug) << module_label(*this) << "FIFO worker: respond to request";
+                    xia_logc(log::fifo, log::debug) << module_label(*this)
+                                                    << "FIFO worker: respond to request";
                     requester_waiting = false;
                     fifo_worker_resp.notify();
                 } else {
@@ -2679,8 +5045,20 @@ void module::fifo_worker() {
                 }
             }
 
-            if (!fifo_worker_req.wait(mode_asynchronous ? wait_time : 0)) {
-                xia_log(log::debug) << module_label(*this) << "FIFO worker: run requested";
+            bool notified = !fifo_worker_req.wait(mode_asynchronous ? wait_time : 0);
+            if (fifo_irq_pending.exchange(false)) {
+                /*
+                 * Data is waiting, read it without holding for the
+                 * trigger level.
+                 */
+                xia_logc(log::fifo, log::debug) << module_label(*this) << "FIFO worker: interrupt";
+                hold_time = fifo_hold_usecs.load();
+                notified = fifo_worker_requested.load();
+            }
+            if (notified) {
+                xia_logc(log::fifo, log::debug) << module_label(*this)
+                                                << "FIFO worker: run requested";
+                fifo_worker_requested = false;
                 requester_waiting = true;
                 if (mode_asynchronous) {
                     requested_wait_loops = 5;
@@ -2701,7 +5079,11 @@ void module::fifo_worker() {
          * Flush the buffers from the queue back into the pool. Any user
          * active calls should be done in a few seconds.
          */
-        fifo_data.flush();
+        {
+            buffer::lock_guard guard(fifo_read_lock);
+            fifo_ring.flush();
+            fifo_data.flush();
+        }
         size_t wait_period = 5 * 1000 / 10;
         while (wait_period-- > 0) {
             if (fifo_pool.full()) {
@@ -2710,15 +5092,26 @@ void module::fifo_worker() {
             hw::wait(10000);
         }
     } catch (pixie::error::error& e) {
-        xia_log(log::error) << "FIFO worker: " << e;
+        xia_logc(log::fifo, log::error) << "FIFO worker: " << e;
     } catch (std::exception& e) {
-        xia_log(log::error) << "FIFO worker: error: " << e.what();
+        xia_logc(log::fifo, log::error) << "FIFO worker: error: " << e.what();
     } catch (...) {
-        xia_log(log::error) << "FIFO worker: unhandled exception";
+        xia_logc(log::fifo, log::error) << "FIFO worker: unhandled exception";
     }
 
     level = fifo.level();
-    xia_log(log::info) << module_label(*this) << "FIFO worker: finishing, level=" << level;
+    xia_logc(log::fifo, log::info) << module_label(*this) << "FIFO worker: finishing, level="
+                                   << level;
+
+    auto bus = bus_lock_.stats();
+    xia_logc(log::fifo, log::info) << module_label(*this) << "FIFO worker: bus: holds="
+                                   << bus.fifo_holds << " max-hold=" << bus.max_fifo_hold_usecs
+                                   << "usecs waits=" << bus.fifo_waits;
+    xia_logc(log::fifo, log::debug) << module_label(*this) << "FIFO worker: telemetry: "
+                                    << "dma-usecs=[" << run_stats.dma_usecs.output()
+                                    << "] dma-words=[" << run_stats.dma_words.output()
+                                    << "] latency-usecs=[" << run_stats.latency_usecs.output()
+                                    << "] queue-depth=[" << run_stats.queue_depth.output() << "]";
 
     fifo_worker_running = false;
     fifo_worker_finished = true;
@@ -2798,32 +5191,250 @@ void module::calc_io_cpld_bus_speed() {
 }
 
 void module::wait_usec_timed(size_t period) {
-    size_t loops = size_t((period / i2c_read_period)) + 1;
-    while (loops-- != 0) {
+    /*
+     * Read the bus until the period has passed. There is always a read so
+     * the writes before the wait are flushed.
+     */
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(period);
+    do {
         volatile uint32_t tmp = read_word(hw::device::PCF8574);
         (void) tmp;
-    }
+    } while (std::chrono::steady_clock::now() < deadline);
 }
 
 void module::log_stats(const char* label, const fifo_stats& stats) {
     xia_log(log::info) << module_label(*this) << label << ": " << stats.output();
 }
 
+/*
+ * Queue a buffer read from the FIFO. The data is captured, validated and
+ * filtered as read. The buffer is dropped if it is not to be queued or
+ * the ring is full.
+ */
+void module::fifo_queue(buffer::handle& buf, bool queue_buf, fifo_clock::time_point seen,
+                        fifo_clock::time_point start) {
+    auto elapsed = [](fifo_clock::time_point from) {
+        return size_t(
+            std::chrono::duration_cast<std::chrono::microseconds>(fifo_clock::now() - from)
+                .count());
+    };
+    /*
+     * Capture the transfer as read. A write error stops the
+     * capture.
+     */
+    if (fifo_capturing.load()) {
+        buffer::lock_guard capture_guard(fifo_capture_lock);
+        try {
+            if (fifo_capture.is_open()) {
+                fifo_capture.write(start, buf->data(), buf->size());
+            }
+        } catch (pixie::error::error& e) {
+            fifo_capturing = false;
+            fifo_capture.close();
+            xia_logc(log::fifo, log::error)
+                << module_label(*this) << "FIFO capture: stopped: " << e.what();
+        }
+    }
+    /*
+     * Check the data as read so a fault is reported with the
+     * module and the offset in the run's data.
+     */
+    if (fifo_validating.load()) {
+        buffer::lock_guard validator_guard(fifo_validator_lock);
+        const size_t held = fifo_validator.found().size();
+        const size_t found = fifo_validator.validate(*buf);
+        if (found != 0) {
+            run_stats.faults += found;
+            auto& faults = fifo_validator.found();
+            if (held < faults.size()) {
+                auto& first = faults[held];
+                xia_logc(log::fifo, log::warning)
+                    << module_label(*this) << "FIFO validate: faults=" << found
+                    << " first=" << first.kind << " offset=" << first.offset
+                    << " word=0x" << std::hex << first.word;
+            } else {
+                xia_logc(log::fifo, log::warning)
+                    << module_label(*this) << "FIFO validate: faults=" << found;
+            }
+        }
+    }
+    /*
+     * Reduce the data before it is queued. A filter error is a
+     * corrupt event and the filter is stopped so the rest of the
+     * run's data is queued as read.
+     */
+    if (queue_buf && fifo_filtering.load()) {
+        buffer::lock_guard filter_guard(fifo_filter_lock);
+        const auto& counts = fifo_filter.counts();
+        const size_t before = counts.words_in - counts.words_out;
+        try {
+            fifo_filter.reduce(*buf);
+            run_stats.filtered += counts.words_in - counts.words_out - before;
+        } catch (pixie::error::error& e) {
+            fifo_filtering = false;
+            xia_logc(log::fifo, log::error)
+                << module_label(*this) << "FIFO filter: stopped: " << e.what();
+        }
+    }
+    const size_t read_words = buf->size();
+    if (read_words == 0) {
+        buf.reset();
+        return;
+    }
+    if (queue_buf && !fifo_ring.push(buf)) {
+        queue_buf = false;
+    }
+    if (queue_buf) {
+        run_stats.in += read_words;
+        run_stats.latency_usecs.record(elapsed(seen));
+        run_stats.queue_depth.record(fifo_ring.count());
+        if (fifo_subscribed.load() &&
+            fifo_ring.size() >= std::max(fifo_notify_threshold.load(), size_t(1))) {
+            notify_list_mode();
+        }
+    } else {
+        run_stats.dropped += read_words;
+        xia_logc(log::fifo, log::debug) << module_label(*this) << std::boolalpha
+                                        << "buffer drop: fifo-worker-paused="
+                                        << pause_fifo_worker.load();
+    }
+    /*
+     * If the logging level is `debug` compute the CRC32 of the data
+     * queued. This can be used to verify the data received by the
+     * user API. If CRC tagging is enabled the queued data is added
+     * to the run's CRC.
+     */
+    util::crc32 crc;
+    if (logging::level_logging(log::debug)) {
+        crc.update(*buf);
+    }
+    if (queue_buf && fifo_crc.load()) {
+        util::crc32 run_crc;
+        run_crc.value = fifo_crc_value.load();
+        run_crc.update(*buf);
+        fifo_crc_value = run_crc.value;
+    }
+    xia_logc(log::fifo, log::debug) << module_label(*this) << "FIFO queue: words="
+                                    << read_words << " data-fifo-buffers="
+                                    << fifo_ring.count() << " crc=0x" << std::hex
+                                    << crc.value << std::boolalpha << " queue-buf="
+                                    << queue_buf;
+    buf.reset();
+}
+
+/*
+ * A direct read is the worker's synchronous pass made by the reading
+ * thread. The level is read once and the FIFO is read into pool buffers
+ * until the level is drained or the pool is empty. The caller holds the
+ * FIFO read lock.
+ */
+void module::fifo_direct_read() {
+    if (pause_fifo_worker.load() || !fifo_pool.valid()) {
+        return;
+    }
+    if (run_task.load() == hw::run::run_task::nop && fifo_pool.grown()) {
+        fifo_pool.shrink();
+    }
+    hw::memory::fifo fifo(*this);
+    size_t level = fifo.level();
+    if (level == std::numeric_limits<hw::word>::max()) {
+        xia_logc(log::fifo, log::debug) << module_label(*this) << "invalid FIFO level: " << level;
+        return;
+    }
+    run_stats.level_words.record(level);
+    if (level >= hw::fifo_size_words) {
+        xia_logc(log::fifo, log::warning) << module_label(*this) << "FIFO direct: FIFO full";
+        run_stats.hw_overflows++;
+    }
+    const auto seen = fifo_clock::now();
+    while (level != 0) {
+        size_t fifo_pool_count = fifo_pool.count();
+        if (fifo_pool_count < 4 && fifo_pool.grow()) {
+            fifo_pool_count = fifo_pool.count();
+        }
+        if (fifo_pool_count < 4 && fifo_pool_count > 1) {
+            fifo_data.compact();
+        }
+        if (fifo_pool.empty()) {
+            xia_logc(log::fifo, log::warning) << module_label(*this) << "FIFO direct: pool empty";
+            break;
+        }
+        const bool queue_buf = fifo_pool_count > 1;
+        buffer::handle buf = fifo_pool.request();
+        const size_t read_words = std::min(level, buf->capacity());
+        buf->resize(read_words);
+        const auto dma_start = fifo_clock::now();
+        fifo.read(buf->data(), read_words);
+        const auto dma_end = fifo_clock::now();
+        run_stats.dma_in += read_words;
+        run_stats.dma_usecs.record(size_t(
+            std::chrono::duration_cast<std::chrono::microseconds>(dma_end - dma_start).count()));
+        run_stats.dma_words.record(read_words);
+        xia_logc(log::fifo, log::debug) << module_label(*this) << "FIFO direct read, level="
+                                        << level << " read-words=" << read_words;
+        fifo_queue(buf, queue_buf, seen, dma_start);
+        level -= read_words;
+    }
+    run_stats.update_bandwidth();
+}
+
 bool module::fifo_worker_run(size_t timeout_usecs) {
     sync::variable::lock_guard guard(fifo_worker_working);
+    fifo_worker_requested = true;
     fifo_worker_req.notify();
     return fifo_worker_resp.wait(timeout_usecs);
 }
 
 void module::sync_worker_run(bool forced) {
     /*
-     * Run the worker if forced or the mode is synchronous.
+     * Read the FIFO directly if there is no worker else run the worker
+     * if forced or the mode is synchronous.
      */
-    if (forced || fifo_run_wait_usecs.load() == 0) {
+    if (fifo_direct.load()) {
+        fifo_direct_read();
+    } else if (forced || fifo_run_wait_usecs.load() == 0) {
         fifo_worker_run(250 * 1000);
     }
 }
 
+void module::fifo_tune_sample(const buffer::handle& buf, fifo_clock::time_point now) {
+    if (!fifo_tuning_run) {
+        if (!fifo_tune_pending.exchange(false) ||
+            run_task.load() != hw::run::run_task::list_mode) {
+            return;
+        }
+        fifo_tune.reset();
+        fifo_tune_end = now + std::chrono::milliseconds(fifo_tune_msecs.load());
+        fifo_tuning_run = true;
+    }
+    const size_t in_use = fifo_pool.number.load() - fifo_pool.count();
+    fifo_tune.sample(buf->data(), buf->size(), buf->capacity(), in_use);
+    if (now >= fifo_tune_end) {
+        fifo_tune_finish();
+    }
+}
+
+void module::fifo_tune_finish() {
+    fifo_tuning_run = false;
+    const fifo_tuning tuning =
+        fifo_tune.tune(fifo_tune_budget.load(), min_fifo_buffers, max_fifo_buffers);
+    if (!tuning.valid) {
+        return;
+    }
+    {
+        buffer::lock_guard guard(fifo_tuned_lock);
+        fifo_tuned = tuning;
+    }
+    xia_logc(log::fifo, log::info) << module_label(*this) << std::boolalpha
+                                   << "FIFO worker: tuned: buffer-words=" << tuning.buffer_words
+                                   << " buffers=" << tuning.buffers << " dmas=" << tuning.dmas
+                                   << " max-dma=" << tuning.max_dma_words
+                                   << " max-event=" << tuning.max_event_words
+                                   << " max-depth=" << tuning.max_queue_depth
+                                   << " capped=" << tuning.capped
+                                   << " over-budget=" << tuning.over_budget;
+}
+
 void module::trace_reg(char type, const char* ptr, void* vmaddr, int reg, hw::word value) {
     xia_log(log::debug) << "M " << type << " " << std::setfill('0') << std::hex << vmaddr
                         << ':' << std::setw(2)
@@ -2871,6 +5482,36 @@ void assign(modules& modules_, const number_slots& numbers) {
     }
 }
 
+size_t device_scan(bool rescan) {
+    auto& cache = scan_cache();
+    std::lock_guard<std::mutex> guard(cache.lock);
+    if (cache.valid && !rescan) {
+        return cache.keys.size();
+    }
+    cache.valid = false;
+    cache.keys.clear();
+    for (size_t device_number = 0; device_number < hw::max_slots; ++device_number) {
+        pci_bus_handle device;
+        if (::PlxPci_DeviceFind(&device.key, uint16_t(device_number)) != PLX_STATUS_OK) {
+            break;
+        }
+        xia_log(log::debug) << "module: device scan: device-number=" << device_number
+                            << " domain=" << device.domain() << " bus=" << device.bus()
+                            << " slot=" << device.slot();
+        cache.keys.push_back(device.key);
+    }
+    cache.valid = !cache.keys.empty();
+    xia_log(log::info) << "module: device scan: devices=" << cache.keys.size();
+    return cache.keys.size();
+}
+
+void device_scan_reset() {
+    auto& cache = scan_cache();
+    std::lock_guard<std::mutex> guard(cache.lock);
+    cache.valid = false;
+    cache.keys.clear();
+}
+
 void order_by_number(modules& mods) {
     std::sort(mods.begin(), mods.end(), [](module_ptr& a, module_ptr& b) {
         return a->number != -1 && b->number != -1 && a->number < b->number;
@@ -0,0 +1,264 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2022 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file pipeline.cpp
+ * @brief Implements a pipeline that decodes modules' list-mode data.
+ */
+
+#include <algorithm>
+
+#include <pixie/error.hpp>
+#include <pixie/log.hpp>
+
+#include <pixie/pixie16/pipeline.hpp>
+
+namespace xia {
+namespace pixie {
+namespace pipeline {
+typedef pixie::error::error error;
+
+namespace list_mode = data::list_mode;
+
+config::config()
+    : workers(0), chunk_words(64 * 1024), max_chunks(64), fields(list_mode::scan_all),
+      calib(nullptr), poll_msecs(10) {}
+
+batch::batch() : number(-1), sequence(0) {}
+
+pipeline::stream::stream(const recorder::source& src_)
+    : src(src_), next_sequence(0), next_consume(0) {}
+
+pipeline::pipeline(const recorder::sources& sources, const config& cfg_, consumer consume)
+    : cfg(cfg_), consume_(std::move(consume)), next_worker(0), chunks(0),
+      period_wake(period_lock), running_(false), words_(0), decoded_words_(0), batches_(0),
+      events_(0), errors_(0) {
+    if (sources.empty()) {
+        throw error(error::code::invalid_value, "pipeline: no sources");
+    }
+    if (!consume_) {
+        throw error(error::code::invalid_value, "pipeline: no consumer");
+    }
+    if (cfg.chunk_words == 0 || cfg.max_chunks == 0) {
+        throw error(error::code::invalid_value, "pipeline: chunk size or limit is 0");
+    }
+    for (auto& src : sources) {
+        streams.emplace_back(new stream(src));
+    }
+    size_t count = cfg.workers;
+    if (count == 0) {
+        count = std::max(std::thread::hardware_concurrency(), 1U);
+    }
+    workers.start(count);
+}
+
+pipeline::~pipeline() {
+    try {
+        stop();
+    } catch (std::exception& e) {
+        xia_log(log::error) << e.what();
+    }
+    workers.stop();
+}
+
+void pipeline::start() {
+    if (running_.load()) {
+        throw error(error::code::module_invalid_operation, "pipeline: already running");
+    }
+    running_ = true;
+    thread = std::thread(&pipeline::worker, this);
+}
+
+void pipeline::stop() {
+    running_ = false;
+    {
+        sync::variable::lock_guard guard(period_lock);
+        period_wake.notify();
+    }
+    if (thread.joinable()) {
+        thread.join();
+    }
+    /*
+     * Decode and consume the data left.
+     */
+    while (poll() != 0) {
+    }
+    flush();
+}
+
+size_t pipeline::poll() {
+    std::lock_guard<std::mutex> guard(poll_lock);
+    size_t words = 0;
+    for (auto& strm_ptr : streams) {
+        auto& strm = *strm_ptr;
+        buffer::queue::handles buffers;
+        size_t read = strm.src.read(buffers);
+        if (read == 0) {
+            continue;
+        }
+        words += read;
+        words_ += read;
+        /*
+         * Stitch the partial event of the last read to the data.
+         */
+        list_mode::buffer data;
+        data.swap(strm.leftovers);
+        data.reserve(data.size() + read);
+        for (auto& buf : buffers) {
+            data.insert(data.end(), buf->begin(), buf->end());
+        }
+        buffers.clear();
+        std::vector<size_t> boundaries;
+        size_t complete = 0;
+        try {
+            complete = list_mode::find_event_boundaries(
+                data.data(), data.size(), size_t(strm.src.revision), size_t(strm.src.adc_msps),
+                cfg.chunk_words, boundaries);
+        } catch (pixie::error::error& e) {
+            /*
+             * The stream has lost its event boundaries, drop the data.
+             */
+            ++errors_;
+            xia_log(log::error) << "pipeline: module " << strm.src.number << ": " << e;
+            continue;
+        }
+        for (size_t b = 1; b < boundaries.size(); ++b) {
+            list_mode::buffer chunk(data.begin() + boundaries[b - 1], data.begin() + boundaries[b]);
+            queue(strm, chunk);
+        }
+        strm.leftovers.assign(data.begin() + complete, data.end());
+    }
+    return words;
+}
+
+void pipeline::flush() {
+    std::unique_lock<std::mutex> guard(chunks_lock);
+    chunks_wake.wait(guard, [this] { return chunks == 0; });
+}
+
+size_t pipeline::leftovers() const {
+    size_t words = 0;
+    for (auto& strm : streams) {
+        words += strm->leftovers.size();
+    }
+    return words;
+}
+
+void pipeline::queue(stream& strm, list_mode::buffer& chunk) {
+    {
+        std::unique_lock<std::mutex> guard(chunks_lock);
+        chunks_wake.wait(guard, [this] { return chunks < cfg.max_chunks; });
+        ++chunks;
+    }
+    const size_t sequence = strm.next_sequence++;
+    auto data = std::make_shared<list_mode::buffer>();
+    data->swap(chunk);
+    workers.submit(next_worker++, [this, &strm, sequence, data] {
+        decode(strm, sequence, *data);
+    });
+}
+
+void pipeline::decode(stream& strm, size_t sequence, list_mode::buffer& chunk) {
+    auto decoded = get_batch();
+    decoded->number = strm.src.number;
+    decoded->sequence = sequence;
+    try {
+        list_mode::buffer leftovers;
+        list_mode::scan_data_block(chunk.data(), chunk.size(), size_t(strm.src.revision),
+                                   size_t(strm.src.adc_msps), cfg.fields, decoded->events,
+                                   leftovers, cfg.calib);
+        decoded_words_ += chunk.size();
+    } catch (std::exception& e) {
+        ++errors_;
+        decoded->events.clear();
+        xia_log(log::error) << "pipeline: module " << strm.src.number << ": decode: " << e.what();
+    }
+    consume(strm, sequence, std::move(decoded));
+}
+
+/*
+ * The worker that decodes the next batch in sequence consumes it and the
+ * held batches that follow it. A batch that failed to decode is empty and
+ * is not consumed.
+ */
+void pipeline::consume(stream& strm, size_t sequence, batch_ptr decoded) {
+    std::lock_guard<std::mutex> guard(strm.lock);
+    strm.done.emplace(sequence, std::move(decoded));
+    while (!strm.done.empty() && strm.done.begin()->first == strm.next_consume) {
+        auto next = std::move(strm.done.begin()->second);
+        strm.done.erase(strm.done.begin());
+        ++strm.next_consume;
+        if (!next->events.empty()) {
+            try {
+                consume_(*next);
+                ++batches_;
+                events_ += next->events.size();
+            } catch (std::exception& e) {
+                ++errors_;
+                xia_log(log::error) << "pipeline: module " << strm.src.number
+                                    << ": consumer: " << e.what();
+            }
+        }
+        put_batch(std::move(next));
+    }
+}
+
+pipeline::batch_ptr pipeline::get_batch() {
+    {
+        std::lock_guard<std::mutex> guard(chunks_lock);
+        if (!free_batches.empty()) {
+            auto b = std::move(free_batches.back());
+            free_batches.pop_back();
+            return b;
+        }
+    }
+    return batch_ptr(new batch);
+}
+
+void pipeline::put_batch(batch_ptr b) {
+    {
+        std::lock_guard<std::mutex> guard(chunks_lock);
+        b->events.clear();
+        free_batches.push_back(std::move(b));
+        --chunks;
+    }
+    chunks_wake.notify_all();
+}
+
+void pipeline::worker() {
+    xia_log(log::debug) << "pipeline: thread started: period=" << cfg.poll_msecs << "msecs";
+    while (running_.load()) {
+        size_t words = 0;
+        try {
+            words = poll();
+        } catch (std::exception& e) {
+            ++errors_;
+            xia_log(log::error) << "pipeline: " << e.what();
+        }
+        if (words == 0) {
+            sync::variable::lock_guard guard(period_lock);
+            if (!running_.load()) {
+                break;
+            }
+            period_wake.wait(cfg.poll_msecs * 1000);
+        }
+    }
+    xia_log(log::debug) << "pipeline: thread stopped";
+}
+}  // namespace pipeline
+}  // namespace pixie
+}  // namespace xia
@@ -0,0 +1,511 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2022 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file recorder.cpp
+ * @brief Implements a recorder that writes modules' list-mode data to disk.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <nolhmann/json.hpp>
+
+#include <pixie/error.hpp>
+#include <pixie/log.hpp>
+
+#include <pixie/pixie16/recorder.hpp>
+
+namespace xia {
+namespace pixie {
+namespace recorder {
+typedef pixie::error::error error;
+
+/*
+ * Direct I/O transfers are made in multiples of the alignment from a
+ * staging buffer aligned to it.
+ */
+static constexpr size_t direct_alignment = 4096;
+static constexpr size_t direct_stage_size = 1024 * 1024;
+
+config::config()
+    : merged(false), rotate_bytes(0), rotate_secs(0), direct(true), compressed(false),
+      block_words(lmc::default_block_words), poll_msecs(50) {}
+
+source::source() : number(-1), slot(0), serial_num(0), revision(0), adc_bits(0), adc_msps(0) {}
+
+source module_source(module::module& module) {
+    source src;
+    src.number = module.number;
+    src.slot = module.slot;
+    src.serial_num = module.serial_num;
+    src.revision = module.revision;
+    if (!module.channels.empty() && module.channels[0].fixture) {
+        src.adc_bits = module.channels[0].fixture->config.adc_bits;
+        src.adc_msps = module.channels[0].fixture->config.adc_msps;
+    }
+    if (module.fifo_filtering.load()) {
+        buffer::lock_guard guard(module.fifo_filter_lock);
+        src.reduction = module.fifo_filter.policy();
+    }
+    src.read = [&module](buffer::queue::handles& buffers) {
+        return module.read_list_mode(buffers);
+    };
+    src.requeue = [&module](buffer::queue::handles& buffers) {
+        module.requeue_list_mode(buffers);
+    };
+    return src;
+}
+
+source module_source(module::module& module, buffer::fanout& tee) {
+    source src = module_source(module);
+    auto consumer = tee.subscribe();
+    src.read = [consumer](buffer::queue::handles& buffers) {
+        return consumer->read(buffers);
+    };
+    src.requeue = nullptr;
+    return src;
+}
+
+/*
+ * A file written directly or through the page cache.
+ */
+class recorder::file {
+public:
+    file(const std::string& name, bool direct);
+    ~file();
+
+    void write(const void* data, size_t size);
+    void close();
+
+    size_t size() const {
+        return size_;
+    }
+    size_t secs() {
+        return opened.secs();
+    }
+
+    const std::string name;
+
+private:
+    void write_out(const char* data, size_t size);
+
+    bool direct;
+#if defined(__linux__)
+    int fd;
+#else
+    std::ofstream out;
+#endif
+    std::vector<char> stage_mem;
+    char* stage;
+    size_t staged;
+    size_t size_;
+    util::timepoint opened;
+};
+
+recorder::file::file(const std::string& name_, bool direct_)
+    : name(name_), direct(direct_), stage(nullptr), staged(0), size_(0) {
+#if defined(__linux__)
+    const int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    fd = -1;
+    if (direct) {
+        fd = ::open(name.c_str(), flags | O_DIRECT, 0644);
+        if (fd < 0 && errno == EINVAL) {
+            xia_log(log::info) << "recorder: direct I/O not supported: " << name;
+            direct = false;
+        }
+    }
+    if (fd < 0 && !direct) {
+        fd = ::open(name.c_str(), flags, 0644);
+    }
+    if (fd < 0) {
+        throw error(error::code::file_create_failure,
+                    "recorder: open: " + name + ": " + std::strerror(errno));
+    }
+#else
+    direct = false;
+    out.open(name, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw error(error::code::file_create_failure,
+                    "recorder: open: " + name + ": " + std::strerror(errno));
+    }
+#endif
+    if (direct) {
+        stage_mem.resize(direct_stage_size + direct_alignment);
+        auto addr = reinterpret_cast<std::uintptr_t>(stage_mem.data());
+        stage = stage_mem.data() + (direct_alignment - (addr % direct_alignment)) %
+            direct_alignment;
+    }
+    opened.start();
+}
+
+recorder::file::~file() {
+    try {
+        close();
+    } catch (std::exception& e) {
+        xia_log(log::error) << e.what();
+    }
+}
+
+void recorder::file::write(const void* data, size_t size) {
+    auto bytes = static_cast<const char*>(data);
+    size_ += size;
+    if (!direct) {
+        write_out(bytes, size);
+        return;
+    }
+    while (size > 0) {
+        const size_t copy = std::min(direct_stage_size - staged, size);
+        std::memcpy(stage + staged, bytes, copy);
+        staged += copy;
+        bytes += copy;
+        size -= copy;
+        if (staged == direct_stage_size) {
+            write_out(stage, staged);
+            staged = 0;
+        }
+    }
+}
+
+void recorder::file::close() {
+#if defined(__linux__)
+    if (fd < 0) {
+        return;
+    }
+    if (direct && staged > 0) {
+        /*
+         * Write the aligned blocks and then the tail through the page
+         * cache.
+         */
+        const size_t aligned = staged - (staged % direct_alignment);
+        if (aligned > 0) {
+            write_out(stage, aligned);
+        }
+        if (staged > aligned) {
+            ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) & ~O_DIRECT);
+            write_out(stage + aligned, staged - aligned);
+        }
+        staged = 0;
+    }
+    const int result = ::close(fd);
+    fd = -1;
+    if (result < 0) {
+        throw error(error::code::file_write_failure,
+                    "recorder: close: " + name + ": " + std::strerror(errno));
+    }
+#else
+    if (out.is_open()) {
+        out.close();
+    }
+#endif
+}
+
+void recorder::file::write_out(const char* data, size_t size) {
+#if defined(__linux__)
+    while (size > 0) {
+        auto written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw error(error::code::file_write_failure,
+                        "recorder: write: " + name + ": " + std::strerror(errno));
+        }
+        data += written;
+        size -= size_t(written);
+    }
+#else
+    out.write(data, size);
+    if (!out) {
+        throw error(error::code::file_write_failure, "recorder: write: " + name);
+    }
+#endif
+}
+
+recorder::output::output() : number(-1), sequence(0), header_bytes(0) {}
+
+recorder::output::output(output&& o)
+    : number(o.number), sequence(o.sequence), header_bytes(o.header_bytes),
+      out(std::move(o.out)), container(std::move(o.container)) {}
+
+recorder::output::~output() {}
+
+recorder::recorder(const sources& sources_, const config& cfg_)
+    : cfg(cfg_), srcs(sources_), period_wake(period_lock), running_(false), bytes_(0),
+      files_(0), errors_(0) {
+    if (cfg.path.empty()) {
+        throw error(error::code::invalid_value, "recorder: no path");
+    }
+    if (srcs.empty()) {
+        throw error(error::code::invalid_value, "recorder: no sources");
+    }
+    if (cfg.merged) {
+        outputs.resize(1);
+    } else {
+        for (auto& src : srcs) {
+            outputs.emplace_back();
+            outputs.back().number = src.number;
+        }
+    }
+}
+
+recorder::~recorder() {
+    try {
+        stop();
+    } catch (std::exception& e) {
+        xia_log(log::error) << e.what();
+    }
+}
+
+void recorder::start() {
+    if (running_.load()) {
+        throw error(error::code::module_invalid_operation, "recorder: already running");
+    }
+    running_ = true;
+    thread = std::thread(&recorder::worker, this);
+}
+
+void recorder::stop() {
+    running_ = false;
+    {
+        sync::variable::lock_guard guard(period_lock);
+        period_wake.notify();
+    }
+    if (thread.joinable()) {
+        thread.join();
+    }
+    /*
+     * Write the data queued when stopped and close the files. A run still
+     * taking data is not followed.
+     */
+    try {
+        poll();
+    } catch (...) {
+        sync::variable::lock_guard guard(lock);
+        for (auto& out : outputs) {
+            abandon(out);
+        }
+        throw;
+    }
+    sync::variable::lock_guard guard(lock);
+    for (auto& out : outputs) {
+        close(out);
+    }
+}
+
+size_t recorder::poll() {
+    sync::variable::lock_guard guard(lock);
+    size_t words = 0;
+    for (size_t s = 0; s < srcs.size(); ++s) {
+        auto& src = srcs[s];
+        auto& out = outputs[cfg.merged ? 0 : s];
+        buffer::queue::handles buffers;
+        size_t read = src.read(buffers);
+        if (read == 0) {
+            continue;
+        }
+        /*
+         * A buffer is popped once it has been written so the buffers left
+         * on a failure are the ones not written.
+         */
+        try {
+            if (!out.out) {
+                open(out);
+            } else {
+                rotate(out);
+            }
+            if (cfg.merged && !out.container) {
+                hw::word block[block_header_words] = {block_magic, hw::word(src.number),
+                                                      hw::word(read), 0};
+                out.out->write(block, sizeof(block));
+            }
+            while (!buffers.empty()) {
+                auto& buf = buffers.front();
+                if (out.container) {
+                    out.container->add(src.number, buf->data(), buf->size());
+                } else {
+                    out.out->write(buf->data(), buf->size() * sizeof(hw::word));
+                }
+                bytes_ += buf->size() * sizeof(hw::word);
+                words += buf->size();
+                buffers.pop_front();
+            }
+        } catch (std::exception& e) {
+            abandon(out);
+            if (!src.requeue) {
+                running_ = false;
+                throw error(error::code::file_write_failure,
+                            std::string(e.what()) + ": data lost, recorder stopped");
+            }
+            src.requeue(buffers);
+            throw;
+        }
+    }
+    return words;
+}
+
+util::strings recorder::names() {
+    sync::variable::lock_guard guard(lock);
+    return names_;
+}
+
+void recorder::open(output& out) {
+    std::ostringstream name;
+    name << cfg.path;
+    if (!cfg.merged) {
+        name << '-' << out.number;
+    }
+    name << '-' << std::setfill('0') << std::setw(4) << out.sequence
+         << (cfg.compressed ? ".lmc" : ".lmd");
+    xia_log(log::info) << "recorder: open: " << name.str();
+    out.out.reset(new file(name.str(), cfg.direct));
+    auto head = header(out);
+    if (cfg.compressed) {
+        lmc::module_infos modules;
+        for (auto& src : srcs) {
+            if (cfg.merged || src.number == out.number) {
+                modules.emplace_back(src.number, src.revision, src.adc_msps);
+            }
+        }
+        auto& file = *out.out;
+        out.container.reset(new lmc::writer(
+            [&file](const void* data, size_t size) { file.write(data, size); }, modules, head,
+            cfg.block_words));
+    } else {
+        head.resize(header_size, '\0');
+        out.out->write(head.data(), head.size());
+    }
+    out.header_bytes = out.out->size();
+    names_.push_back(name.str());
+    ++files_;
+}
+
+void recorder::close(output& out) {
+    if (out.container) {
+        auto finishing = std::move(out.container);
+        finishing->finish();
+    }
+    if (out.out) {
+        xia_log(log::info) << "recorder: close: " << out.out->name
+                           << " size=" << out.out->size();
+        auto closing = std::move(out.out);
+        closing->close();
+    }
+}
+
+/*
+ * Close a file after a failure and start the next file at the next
+ * sequence number. A partly written file is not appended to.
+ */
+void recorder::abandon(output& out) {
+    const bool opened = bool(out.out);
+    try {
+        close(out);
+    } catch (std::exception& e) {
+        xia_log(log::error) << e.what();
+    }
+    out.container.reset();
+    out.out.reset();
+    if (opened) {
+        ++out.sequence;
+    }
+}
+
+void recorder::rotate(output& out) {
+    const size_t data_bytes = out.out->size() - out.header_bytes;
+    if ((cfg.rotate_bytes != 0 && data_bytes >= cfg.rotate_bytes) ||
+        (cfg.rotate_secs != 0 && out.out->secs() >= cfg.rotate_secs)) {
+        close(out);
+        ++out.sequence;
+        open(out);
+    }
+}
+
+std::string recorder::header(const output& out) {
+    using json = nlohmann::json;
+    json head;
+    head["format"] = "pixie-list-mode";
+    head["format-version"] = 1;
+    head["header-size"] = header_size;
+    head["merged"] = cfg.merged;
+    head["compressed"] = cfg.compressed;
+    head["sequence"] = out.sequence;
+    head["start-time"] = std::time(nullptr);
+    head["metadata"] = cfg.metadata;
+    head["modules"] = json::array();
+    for (auto& src : srcs) {
+        if (cfg.merged || src.number == out.number) {
+            json mod = {{"number", src.number},
+                        {"slot", src.slot},
+                        {"serial-num", src.serial_num},
+                        {"revision", src.revision},
+                        {"adc-bits", src.adc_bits},
+                        {"adc-msps", src.adc_msps}};
+            auto& policy = src.reduction.trace_policy;
+            for (size_t channel = 0; channel < policy.size(); ++channel) {
+                if (policy[channel] == data::list_mode::reduction::traces::roi) {
+                    auto& roi = src.reduction.trace_rois[channel];
+                    mod["trace-rois"].push_back({{"channel", channel},
+                                                 {"start", roi.start},
+                                                 {"length", roi.length},
+                                                 {"decimation", roi.decimation}});
+                }
+            }
+            head["modules"].push_back(mod);
+        }
+    }
+    auto text = head.dump();
+    if (text.size() >= header_size) {
+        throw error(error::code::invalid_value, "recorder: header too large");
+    }
+    return text;
+}
+
+void recorder::worker() {
+    xia_log(log::debug) << "recorder: thread started: period=" << cfg.poll_msecs << "msecs";
+    while (running_.load()) {
+        size_t words = 0;
+        try {
+            words = poll();
+        } catch (std::exception& e) {
+            ++errors_;
+            xia_log(log::error) << "recorder: " << e.what();
+        }
+        if (words == 0) {
+            sync::variable::lock_guard guard(period_lock);
+            if (!running_.load()) {
+                break;
+            }
+            period_wake.wait(cfg.poll_msecs * 1000);
+        }
+    }
+    xia_log(log::debug) << "recorder: thread stopped";
+}
+}  // namespace recorder
+}  // namespace pixie
+}  // namespace xia
@@ -0,0 +1,256 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file reglist.cpp
+ * @brief Implements register command lists for fixed sequences of bus accesses.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+
+#include <pixie/log.hpp>
+
+#include <pixie/pixie16/module.hpp>
+#include <pixie/pixie16/reglist.hpp>
+
+namespace xia {
+namespace pixie {
+namespace hw {
+namespace reglist {
+typedef pixie::error::error error;
+typedef std::chrono::steady_clock clock;
+
+command::command()
+    : operation(op::write), reg(0), value(0), mask(0), param(0),
+      code(error::code::success), what(nullptr) {}
+
+command write(int reg, word value) {
+    command cmd;
+    cmd.operation = op::write;
+    cmd.reg = reg;
+    cmd.value = value;
+    return cmd;
+}
+
+command write_param(int reg, size_t param) {
+    command cmd;
+    cmd.operation = op::write_param;
+    cmd.reg = reg;
+    cmd.param = param;
+    return cmd;
+}
+
+command read(int reg) {
+    command cmd;
+    cmd.operation = op::read;
+    cmd.reg = reg;
+    return cmd;
+}
+
+command set_bits(int reg, word mask) {
+    command cmd;
+    cmd.operation = op::set_bits;
+    cmd.reg = reg;
+    cmd.mask = mask;
+    return cmd;
+}
+
+command clear_bits(int reg, word mask) {
+    command cmd;
+    cmd.operation = op::clear_bits;
+    cmd.reg = reg;
+    cmd.mask = mask;
+    return cmd;
+}
+
+command expect(int reg, word mask, word value, error::code code, const char* what) {
+    command cmd;
+    cmd.operation = op::expect;
+    cmd.reg = reg;
+    cmd.mask = mask;
+    cmd.value = value;
+    cmd.code = code;
+    cmd.what = what;
+    return cmd;
+}
+
+timing::timing() : runs(0), total_nsecs(0), max_nsecs(0) {}
+
+double timing::mean_nsecs() const {
+    if (runs == 0) {
+        return 0;
+    }
+    return double(total_nsecs) / double(runs);
+}
+
+list::list(const std::string& name_, std::initializer_list<command> cmds_)
+    : name(name_), cmds(cmds_), num_params(0), num_reads(0), runs(0), total_nsecs(0),
+      max_nsecs(0) {
+    validate();
+}
+
+list::list(const std::string& name_, const commands& cmds_)
+    : name(name_), cmds(cmds_), num_params(0), num_reads(0), runs(0), total_nsecs(0),
+      max_nsecs(0) {
+    validate();
+}
+
+void list::validate() {
+    if (cmds.empty()) {
+        throw error(error::code::invalid_value, "reglist: " + name + ": no commands");
+    }
+    for (auto& cmd : cmds) {
+        if (cmd.reg < 0 || (cmd.reg % int(sizeof(word))) != 0) {
+            std::ostringstream oss;
+            oss << "reglist: " << name << ": invalid register: 0x" << std::hex << cmd.reg;
+            throw error(error::code::invalid_value, oss.str());
+        }
+        switch (cmd.operation) {
+            case op::write_param:
+                num_params = std::max(num_params, cmd.param + 1);
+                break;
+            case op::read:
+                ++num_reads;
+                break;
+            case op::set_bits:
+            case op::clear_bits:
+                if (cmd.mask == 0) {
+                    throw error(error::code::invalid_value, "reglist: " + name + ": no bits");
+                }
+                break;
+            case op::expect:
+                if (cmd.mask == 0 || (cmd.value & ~cmd.mask) != 0 || cmd.what == nullptr) {
+                    throw error(error::code::invalid_value,
+                                "reglist: " + name + ": invalid expect");
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+void list::run(module::module& module, std::initializer_list<word> params, word* results) {
+    module::module::bus_guard guard(module);
+    run_held(module, params, results);
+}
+
+void list::run_held(module::module& module, std::initializer_list<word> params,
+                    word* results) {
+    if (params.size() < num_params) {
+        throw error(error::code::invalid_value, "reglist: " + name + ": not enough parameters");
+    }
+    if (num_reads != 0 && results == nullptr) {
+        throw error(error::code::invalid_value, "reglist: " + name + ": no results");
+    }
+
+    /*
+     * The list is traced as a whole once it has run.
+     */
+    const bool tracing = module.reg_trace;
+    module::module::reg_trace_guard trace_guard(module);
+    trace_guard.disable();
+    words values;
+    if (tracing) {
+        values.resize(cmds.size());
+    }
+
+    const word* param = params.begin();
+    size_t result = 0;
+    const auto start = clock::now();
+    for (size_t c = 0; c < cmds.size(); ++c) {
+        const command& cmd = cmds[c];
+        word value = 0;
+        switch (cmd.operation) {
+            case op::write:
+                value = cmd.value;
+                module.write_word(cmd.reg, value);
+                break;
+            case op::write_param:
+                value = param[cmd.param];
+                module.write_word(cmd.reg, value);
+                break;
+            case op::read:
+                value = module.read_word(cmd.reg);
+                results[result++] = value;
+                break;
+            case op::set_bits:
+                value = module.read_word(cmd.reg) | cmd.mask;
+                module.write_word(cmd.reg, value);
+                break;
+            case op::clear_bits:
+                value = module.read_word(cmd.reg) & ~cmd.mask;
+                module.write_word(cmd.reg, value);
+                break;
+            case op::expect:
+                value = module.read_word(cmd.reg);
+                if ((value & cmd.mask) != cmd.value) {
+                    throw error(cmd.code, cmd.what);
+                }
+                break;
+        }
+        if (tracing) {
+            values[c] = value;
+        }
+    }
+    const size_t nsecs = size_t(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count());
+
+    ++runs;
+    total_nsecs += nsecs;
+    size_t max = max_nsecs.load();
+    while (nsecs > max && !max_nsecs.compare_exchange_weak(max, nsecs)) {
+    }
+
+    if (tracing) {
+        trace(module, values);
+    }
+}
+
+void list::trace(module::module& module, const words& values) const {
+    std::ostringstream oss;
+    oss << module::module_label(module) << "reglist: " << name << ':' << std::hex
+        << std::setfill('0');
+    for (size_t c = 0; c < cmds.size(); ++c) {
+        const command& cmd = cmds[c];
+        const bool reads = cmd.operation == op::read || cmd.operation == op::expect;
+        oss << ' ' << std::setw(2) << cmd.reg << (reads ? "=>" : "<=") << std::setw(8)
+            << values[c];
+    }
+    xia_log(log::debug) << oss.str();
+}
+
+timing list::times() const {
+    timing t;
+    t.runs = runs.load();
+    t.total_nsecs = total_nsecs.load();
+    t.max_nsecs = max_nsecs.load();
+    return t;
+}
+
+void list::times_reset() {
+    runs = 0;
+    total_nsecs = 0;
+    max_nsecs = 0;
+}
+}  // namespace reglist
+}  // namespace hw
+}  // namespace pixie
+}  // namespace xia
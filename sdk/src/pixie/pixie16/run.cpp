@@ -20,7 +20,11 @@
  * @brief Implements run control enumerators and functions for the Pixie-16 hardware.
  */
 
+#include <algorithm>
+#include <chrono>
+
 #include <pixie/log.hpp>
+#include <pixie/tracepoint.hpp>
 #include <pixie/util.hpp>
 
 #include <pixie/pixie16/csr.hpp>
@@ -66,7 +70,117 @@ module_config make(module::module& module) {
     return run_config_default;
 }
 
-static const char* control_task_labels(control_task control_tsk) {
+/*
+ * Typical control task durations in usecs. These are the first expected
+ * durations of a module's tasks. A task not listed polls from the start.
+ */
+struct expected_duration {
+    control_task task;
+    size_t usecs;
+};
+
+static const expected_duration expected_durations[] = {
+    {control_task::set_dacs, 500},
+    {control_task::ramp_offsetdacs, 1000000},
+    {control_task::get_traces, 2000},
+    {control_task::program_fippi, 500},
+    {control_task::get_baselines, 20000},
+    {control_task::adjust_offsets, 50000},
+    {control_task::tau_finder, 1000000},
+    {control_task::reset_adc, 5000},
+    {control_task::fill_ext_fifo, 500}
+};
+
+/*
+ * The completion poll spins for the first period, waits for this fraction
+ * of the expected duration then backs off from the minimum to the maximum
+ * poll period.
+ */
+static const size_t poll_spin_usecs = 50;
+static const size_t poll_expected_percent = 80;
+static const size_t poll_min_usecs = 10;
+static const size_t poll_max_usecs = 1000;
+
+task_latency::task_latency(size_t expected_usecs_)
+    : count(0), last_usecs(0), min_usecs(0), max_usecs(0), total_usecs(0), last_polls(0),
+      expected_usecs(expected_usecs_) {}
+
+void task_latency::record(size_t usecs, size_t polls) {
+    if (count == 0 || usecs < min_usecs) {
+        min_usecs = usecs;
+    }
+    if (usecs > max_usecs) {
+        max_usecs = usecs;
+    }
+    ++count;
+    last_usecs = usecs;
+    total_usecs += usecs;
+    last_polls = polls;
+    /*
+     * Follow the measured durations. The first measurement replaces the
+     * table's duration.
+     */
+    if (count == 1) {
+        expected_usecs = usecs;
+    } else {
+        expected_usecs = (expected_usecs * 3 + usecs) / 4;
+    }
+}
+
+latencies::latencies() {
+    clear();
+}
+
+latencies::latencies(const latencies& l) {
+    std::lock_guard<std::mutex> guard(l.lock);
+    tasks = l.tasks;
+}
+
+latencies& latencies::operator=(const latencies& l) {
+    if (this != &l) {
+        task_latencies copy;
+        {
+            std::lock_guard<std::mutex> guard(l.lock);
+            copy = l.tasks;
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        tasks = copy;
+    }
+    return *this;
+}
+
+size_t latencies::index(control_task task) {
+    auto i = size_t(task);
+    if (i < control_tasks) {
+        return i;
+    }
+    return run_end_slot;
+}
+
+task_latency latencies::get(control_task task) const {
+    std::lock_guard<std::mutex> guard(lock);
+    return tasks[index(task)];
+}
+
+void latencies::record(control_task task, size_t usecs, size_t polls) {
+    std::lock_guard<std::mutex> guard(lock);
+    tasks[index(task)].record(usecs, polls);
+}
+
+size_t latencies::expected_usecs(control_task task) const {
+    std::lock_guard<std::mutex> guard(lock);
+    return tasks[index(task)].expected_usecs;
+}
+
+void latencies::clear() {
+    std::lock_guard<std::mutex> guard(lock);
+    tasks.fill(task_latency());
+    for (auto& expected : expected_durations) {
+        tasks[index(expected.task)].expected_usecs = expected.usecs;
+    }
+}
+
+const char* control_task_label(control_task control_tsk) {
     switch (control_tsk) {
         case control_task::set_dacs:
             return "set_dacs";
@@ -120,22 +234,28 @@ static bool run_ended(module::module& module) {
 }
 
 void start(module::module& module, run_mode mode, run_task run_tsk, control_task control_tsk) {
-    xia_log(log::debug) << module::module_label(module, "run") << "start: run-mode=" << int(mode)
+    PIXIE_TRACEPOINT4(run_start, module.number, int(mode), int(run_tsk), int(control_tsk));
+    prepare(module, mode, run_tsk, control_tsk);
+    enable(module);
+}
+
+void prepare(module::module& module, run_mode mode, run_task run_tsk, control_task control_tsk) {
+    xia_log(log::debug) << module::module_label(module, "run") << "prepare: run-mode=" << int(mode)
                         << " run-tsk=" << std::hex << int(run_tsk) << std::dec
                         << " control-tsk=" << int(control_tsk);
 
     end(module);
 
     if (mode == run_mode::new_run && run_tsk != run_task::nop) {
-        static const size_t block_size = hw::large_histogram_length * 4;
-        static const size_t mca_end = hw::large_histogram_length * module.num_channels;
-        words zero(block_size);
-        memory::mca mca(module);
-        for (address addr = 0; addr < mca_end; addr += block_size) {
-            mca.write(addr, zero);
-        }
+        module.prepare_mca(run_tsk);
         module.run_task = run_tsk;
     } else {
+        /*
+         * A resumed run continues its task without clearing the MCA.
+         */
+        if (run_tsk != run_task::nop) {
+            module.run_task = run_tsk;
+        }
         module.control_task = control_tsk;
     }
 
@@ -143,32 +263,77 @@ void start(module::module& module, run_mode mode, run_task run_tsk, control_task
     module.write_var(param::module_var::ControlTask, param::value_type(control_tsk));
     module.write_var(param::module_var::Resume, param::value_type(mode));
 
+    /*
+     * The DSP can change variables while running a task.
+     */
+    module.invalidate_vars();
+}
+
+void enable(module::module& module) {
     module::module::bus_guard guard(module);
     csr::set(module, 1 << hw::bit::RUNENA);
 }
 
+static void clear_run_enable(module::module& module) {
+    module::module::bus_guard guard(module);
+    csr::clear(module, 1 << hw::bit::RUNENA);
+}
+
+/*
+ * Poll for a task's completion. The poll spins, waits for most of the
+ * expected duration then backs off. An ending run has RUNENA cleared again
+ * at each poll of the maximum period. Returns the duration in usecs if the
+ * task completes before the timeout else returns false.
+ */
+static bool poll_completion(module::module& module, size_t expected_usecs, size_t timeout_usecs,
+                            bool ending, size_t& usecs, size_t& polls) {
+    using clock = std::chrono::steady_clock;
+    const auto start = clock::now();
+    const auto deadline = start + std::chrono::microseconds(timeout_usecs);
+    const auto expected =
+        start + std::chrono::microseconds(expected_usecs * poll_expected_percent / 100);
+    const auto spin = start + std::chrono::microseconds(poll_spin_usecs);
+    size_t backoff = poll_min_usecs;
+    polls = 0;
+    while (true) {
+        ++polls;
+        if (!active(module) || (ending && run_ended(module))) {
+            usecs = size_t(
+                std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - start)
+                    .count());
+            return true;
+        }
+        const auto now = clock::now();
+        if (now >= deadline) {
+            return false;
+        }
+        if (now < spin) {
+            continue;
+        }
+        if (now < expected) {
+            hw::wait_until(std::min(expected, deadline));
+            continue;
+        }
+        hw::wait_until(std::min(now + std::chrono::microseconds(backoff), deadline));
+        if (backoff < poll_max_usecs) {
+            backoff = std::min(backoff * 2, poll_max_usecs);
+        } else if (ending) {
+            clear_run_enable(module);
+        }
+    }
+}
+
 void end(module::module& module) {
     if (active(module)) {
+        PIXIE_TRACEPOINT1(run_end_entry, module.number);
         xia_log(log::debug) << module::module_label(module, "run") << "ending";
-        util::timepoint tp;
-        int wait_msecs = 1000;
-        int msecs = 0;
+        const size_t wait_usecs = 1000 * 1000;
         module.run_task = run_task::run_stopping;
-        tp.start();
-        while (msecs < wait_msecs) {
-            {
-                module::module::bus_guard guard(module);
-                csr::clear(module, 1 << hw::bit::RUNENA);
-            }
-            ++msecs;
-            if (!hw::run::active(module) || run_ended(module)) {
-                tp.end();
-                xia_log(log::debug) << module::module_label(module, "run") << "ended, duration=" << tp;
-                break;
-            }
-            hw::wait(1000);
-        }
-        if (msecs >= wait_msecs) {
+        clear_run_enable(module);
+        size_t usecs = 0;
+        size_t polls = 0;
+        if (!poll_completion(module, module.task_latencies.expected_usecs(control_task::nop),
+                             wait_usecs, true, usecs, polls)) {
             module.run_task = run_task::nop;
             module.control_task = control_task::nop;
             xia_log(log::error) << module::module_label(module, "run")
@@ -176,11 +341,23 @@ void end(module::module& module) {
             throw error(error::code::module_task_timeout,
                         "failed to end active run task; module reboot required");
         }
+        module.task_latencies.record(control_task::nop, usecs, polls);
+        xia_log(log::debug) << module::module_label(module, "run") << "ended, duration="
+                            << usecs << " usecs polls=" << polls;
+        PIXIE_TRACEPOINT2(run_end_exit, module.number, usecs);
     }
     module.run_task = run_task::nop;
     module.control_task = control_task::nop;
 }
 
+void stop(module::module& module) {
+    if (active(module)) {
+        xia_log(log::debug) << module::module_label(module, "run") << "stopping";
+        module.run_task = run_task::run_stopping;
+        clear_run_enable(module);
+    }
+}
+
 bool active(module::module& module) {
     module::module::bus_guard guard(module);
     return (csr::read(module) & ((1 << hw::bit::RUNENA) | (1 << hw::bit::RUNACTIVE))) != 0;
@@ -238,16 +415,23 @@ static void control_task_postrun(module::module& , control_task control_tsk, int
 
 void control_run_on_dsp(module::module& module, control_task control_tsk, int wait_msecs) {
     xia_log(log::debug) << module::module_label(module, "run on dsp")
-                        << "control=" << control_task_labels(control_tsk) << " wait=" << wait_msecs;
-    bool finished = false;
+                        << "control=" << control_task_label(control_tsk) << " wait=" << wait_msecs;
     start(module, run_mode::new_run, run_task::nop, control_tsk);
-    for (int msecs = 0; !finished && msecs < wait_msecs; ++msecs) {
-        if (active(module)) {
-            hw::wait(1000);
-        } else {
-            finished = true;
-        }
+    size_t usecs = 0;
+    size_t polls = 0;
+    const bool finished =
+        poll_completion(module, module.task_latencies.expected_usecs(control_tsk),
+                        size_t(wait_msecs) * 1000, false, usecs, polls);
+    if (finished) {
+        module.task_latencies.record(control_tsk, usecs, polls);
+        xia_log(log::debug) << module::module_label(module, "run on dsp")
+                            << "control=" << control_task_label(control_tsk)
+                            << " duration=" << usecs << " usecs polls=" << polls;
     }
+    /*
+     * Drop any values cached while the task was running.
+     */
+    module.invalidate_vars();
     if (!finished) {
         std::ostringstream oss;
         oss << "control task failed to end: " << int(control_tsk);
@@ -257,16 +441,27 @@ void control_run_on_dsp(module::module& module, control_task control_tsk, int wa
 
 void control(module::module& module, control_task control_tsk, int wait_msecs) {
     xia_log(log::debug) << module::module_label(module, "run")
-                        << "control=" << control_task_labels(control_tsk) << " wait=" << wait_msecs;
+                        << "control=" << control_task_label(control_tsk) << " wait=" << wait_msecs;
+    if (module.defer_control(control_tsk)) {
+        xia_log(log::debug) << module::module_label(module, "run") << "control="
+                            << control_task_label(control_tsk) << " deferred";
+        return;
+    }
     util::timepoint tp;
     tp.start();
     if (control_task_prerun(module, control_tsk, wait_msecs)) {
         control_run_on_dsp(module, control_tsk, wait_msecs);
+    } else {
+        /*
+         * A fixture ran the task. Record it the same as a DSP task so the
+         * task's results can be read, for example the ADC traces.
+         */
+        module.control_task = control_tsk;
     }
     control_task_postrun(module, control_tsk, wait_msecs);
     tp.end();
     xia_log(log::debug) << module::module_label(module, "control")
-                        << "control=" << control_task_labels(control_tsk) << " duration=" << tp;
+                        << "control=" << control_task_label(control_tsk) << " duration=" << tp;
 }
 
 void run(module::module& module, run_mode mode, run_task run_tsk) {
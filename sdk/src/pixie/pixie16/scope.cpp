@@ -0,0 +1,228 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file scope.cpp
+ * @brief Implements a continuous oscilloscope that streams a module's ADC traces.
+ */
+
+#include <algorithm>
+#include <string>
+
+#include <pixie/error.hpp>
+#include <pixie/log.hpp>
+
+#include <pixie/pixie16/scope.hpp>
+
+namespace xia {
+namespace pixie {
+namespace scope {
+typedef pixie::error::error error;
+
+/*
+ * The period the thread waits when an acquisition is skipped or fails.
+ */
+static constexpr size_t idle_msecs = 100;
+
+config::config() : depth(8), length(0), period_msecs(0) {}
+
+frame::frame() : sequence(0) {}
+
+scope::slot::slot() : sequence(0) {}
+
+scope::channel_ring::channel_ring() : number(0), latest(0) {}
+
+scope::scope(module::module& module, const config& cfg_)
+    : cfg(cfg_), module_(module), period_wake(period_lock), running_(false), sequence_(0),
+      errors_(0) {
+    if (!module_.online()) {
+        throw error(error::code::module_offline, "scope: module not online");
+    }
+    if (cfg.depth == 0) {
+        throw error(error::code::invalid_value, "scope: depth is 0");
+    }
+    channels = cfg.channels;
+    if (channels.empty()) {
+        channels.resize(module_.num_channels);
+        channel::range_set(channels);
+    }
+    for (auto c : channels) {
+        if (c >= module_.num_channels) {
+            throw error(error::code::channel_number_invalid,
+                        "scope: invalid channel: " + std::to_string(c));
+        }
+        const size_t max_length = module_.channels[c].fixture->config.max_adc_trace_length;
+        const size_t length = cfg.length == 0 ? max_length : cfg.length;
+        if (length > max_length) {
+            throw error(error::code::invalid_value,
+                        "scope: length greater than channel's trace: channel=" +
+                            std::to_string(c));
+        }
+        auto chan = std::make_unique<channel_ring>();
+        chan->number = c;
+        chan->slots.reset(new slot[cfg.depth]);
+        for (size_t d = 0; d < cfg.depth; ++d) {
+            chan->slots[d].samples.resize(length);
+        }
+        rings.push_back(std::move(chan));
+        traces.emplace_back(length);
+    }
+}
+
+scope::~scope() {
+    try {
+        stop();
+    } catch (std::exception& e) {
+        xia_log(log::error) << e.what();
+    }
+}
+
+void scope::start() {
+    if (running_.load()) {
+        throw error(error::code::module_invalid_operation, "scope: already running");
+    }
+    running_ = true;
+    thread = std::thread(&scope::worker, this);
+}
+
+void scope::stop() {
+    running_ = false;
+    {
+        sync::variable::lock_guard guard(period_lock);
+        period_wake.notify();
+    }
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+bool scope::acquire() {
+    sync::variable::lock_guard guard(lock);
+    if (module_.run_task.load() != hw::run::run_task::nop) {
+        return false;
+    }
+    module_.read_adcs(channels, traces, true);
+    const auto now = clock::now();
+    const size_t seq = sequence_.load() + 1;
+    for (size_t t = 0; t < traces.size(); ++t) {
+        publish(*rings[t], seq, now, traces[t]);
+    }
+    sequence_ = seq;
+    return true;
+}
+
+bool scope::latest(size_t channel, frame& out) const {
+    const channel_ring& chan = ring(channel);
+    while (true) {
+        const size_t seq = chan.latest.load(std::memory_order_acquire);
+        if (seq == 0) {
+            return false;
+        }
+        if (copy(chan, seq, out)) {
+            return true;
+        }
+    }
+}
+
+size_t scope::history(size_t channel, frames& out) const {
+    const channel_ring& chan = ring(channel);
+    out.clear();
+    const size_t newest = chan.latest.load(std::memory_order_acquire);
+    for (size_t seq = newest; seq > 0 && newest - seq < cfg.depth; --seq) {
+        frame fr;
+        if (copy(chan, seq, fr)) {
+            out.push_back(std::move(fr));
+        }
+    }
+    return out.size();
+}
+
+const scope::channel_ring& scope::ring(size_t channel) const {
+    for (auto& chan : rings) {
+        if (chan->number == channel) {
+            return *chan;
+        }
+    }
+    throw error(error::code::channel_number_invalid,
+                "scope: channel not streamed: " + std::to_string(channel));
+}
+
+/*
+ * A reader checks the slot's sequence before and after the copy. If the
+ * thread wrote the slot during the copy the sequence has changed and the
+ * copy is discarded. The thread never waits for a reader.
+ */
+bool scope::copy(const channel_ring& chan, size_t seq, frame& out) const {
+    const slot& sl = chan.slots[seq % cfg.depth];
+    if (sl.sequence.load(std::memory_order_acquire) != seq) {
+        return false;
+    }
+    out.time = sl.time;
+    out.samples.assign(sl.samples.begin(), sl.samples.end());
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (sl.sequence.load(std::memory_order_relaxed) != seq) {
+        return false;
+    }
+    out.sequence = seq;
+    return true;
+}
+
+void scope::publish(channel_ring& chan, size_t seq, clock::time_point time,
+                    const hw::adc_trace& trace) {
+    slot& sl = chan.slots[seq % cfg.depth];
+    sl.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    sl.time = time;
+    std::copy(trace.begin(), trace.end(), sl.samples.begin());
+    sl.sequence.store(seq, std::memory_order_release);
+    chan.latest.store(seq, std::memory_order_release);
+}
+
+void scope::worker() {
+    xia_log(log::debug) << "scope: thread started: module=" << module_.number
+                        << " channels=" << channels.size() << " period=" << cfg.period_msecs
+                        << "msecs";
+    while (running_.load()) {
+        const auto start = clock::now();
+        bool acquired = false;
+        try {
+            acquired = acquire();
+        } catch (std::exception& e) {
+            ++errors_;
+            xia_log(log::error) << "scope: " << e.what();
+        }
+        size_t wait_usecs = idle_msecs * 1000;
+        if (acquired) {
+            const size_t elapsed = size_t(
+                std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - start)
+                    .count());
+            const size_t period_usecs = cfg.period_msecs * 1000;
+            wait_usecs = period_usecs > elapsed ? period_usecs - elapsed : 0;
+        }
+        if (wait_usecs > 0) {
+            sync::variable::lock_guard guard(period_lock);
+            if (!running_.load()) {
+                break;
+            }
+            period_wake.wait(wait_usecs);
+        }
+    }
+    xia_log(log::debug) << "scope: thread stopped: module=" << module_.number;
+}
+}  // namespace scope
+}  // namespace pixie
+}  // namespace xia
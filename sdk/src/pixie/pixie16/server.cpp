@@ -0,0 +1,670 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file server.cpp
+ * @brief Implements a network server that streams modules' list-mode data.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <pixie/error.hpp>
+#include <pixie/log.hpp>
+#include <pixie/util.hpp>
+
+#include <pixie/pixie16/server.hpp>
+
+#if !defined(_WIN64) && !defined(_WIN32)
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <linux/errqueue.h>
+#endif
+#endif
+
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+#define PIXIE_SERVER_ZEROCOPY 1
+#else
+#define PIXIE_SERVER_ZEROCOPY 0
+#endif
+
+namespace xia {
+namespace pixie {
+namespace server {
+typedef pixie::error::error error;
+
+/*
+ * The largest number of I/O vectors in a call. Each frame uses two.
+ */
+static constexpr size_t max_iov = 1024;
+
+/*
+ * The time to wait for the zero copy sends to complete when a client is
+ * closed.
+ */
+static constexpr size_t zerocopy_close_msecs = 100;
+
+/*
+ * A batch holds the frames read in a poll. The headers and buffers are
+ * held until all the clients' zero copy sends of them have completed.
+ */
+struct server::batch {
+    std::vector<frame_header> headers;
+    buffer::queue::handles buffers;
+    size_t bytes;
+    batch() : bytes(0) {}
+};
+
+config::config()
+    : port(-1), max_clients(16), send_timeout_msecs(1000), zerocopy(false), group_port(0),
+      group_ttl(1), datagram_bytes(1472), batch_frames(256), crc(true), poll_msecs(10) {}
+
+server::client::client() : fd(-1), zerocopy(false), next_send(0) {}
+
+#if defined(_WIN64) || defined(_WIN32)
+server::server(const recorder::sources& sources_, const config& cfg_)
+    : cfg(cfg_), srcs(sources_), listen_fd(-1), port_(-1), group_fd(-1),
+      period_wake(period_lock), running_(false), clients_(0), dropped_(0), bytes_(0),
+      errors_(0) {
+    throw error(error::code::not_supported, "server: not supported on Windows");
+}
+
+server::~server() {}
+
+void server::start() {}
+
+void server::stop() {}
+
+size_t server::poll() {
+    return 0;
+}
+
+uint64_t server::frames(size_t) {
+    return 0;
+}
+
+client::client(const std::string&, int) : fd(-1) {
+    throw error(error::code::not_supported, "server: not supported on Windows");
+}
+
+client::~client() {}
+
+bool client::receive(frame_header&, hw::words&) {
+    return false;
+}
+
+void client::shutdown() {}
+#else
+static std::string errno_text() {
+    return std::strerror(errno);
+}
+
+server::server(const recorder::sources& sources_, const config& cfg_)
+    : cfg(cfg_), srcs(sources_), listen_fd(-1), port_(-1), group_fd(-1),
+      period_wake(period_lock), running_(false), clients_(0), dropped_(0), bytes_(0),
+      errors_(0) {
+    if (srcs.empty()) {
+        throw error(error::code::invalid_value, "server: no sources");
+    }
+    if (cfg.port < 0 && cfg.group.empty()) {
+        throw error(error::code::invalid_value, "server: no port or group");
+    }
+    if (cfg.batch_frames == 0) {
+        throw error(error::code::invalid_value, "server: batch frames is 0");
+    }
+    if (!cfg.group.empty() && cfg.datagram_bytes < sizeof(frame_header) + sizeof(hw::word)) {
+        throw error(error::code::invalid_value, "server: datagram size too small");
+    }
+    sequences.resize(srcs.size(), 0);
+    try {
+        if (cfg.port >= 0) {
+            listen();
+        }
+        if (!cfg.group.empty()) {
+            group_fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+            if (group_fd < 0) {
+                throw error(error::code::device_initialize_failure,
+                            "server: group socket: " + errno_text());
+            }
+            sockaddr_in addr = {};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(static_cast<uint16_t>(cfg.group_port));
+            if (::inet_pton(AF_INET, cfg.group.c_str(), &addr.sin_addr) != 1) {
+                throw error(error::code::invalid_value, "server: invalid group: " + cfg.group);
+            }
+            const unsigned char ttl = static_cast<unsigned char>(cfg.group_ttl);
+            ::setsockopt(group_fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+            if (!cfg.group_interface.empty()) {
+                in_addr iface = {};
+                if (::inet_pton(AF_INET, cfg.group_interface.c_str(), &iface) != 1 ||
+                    ::setsockopt(group_fd, IPPROTO_IP, IP_MULTICAST_IF, &iface,
+                                 sizeof(iface)) < 0) {
+                    throw error(error::code::invalid_value,
+                                "server: invalid group interface: " + cfg.group_interface);
+                }
+            }
+            auto bytes = reinterpret_cast<const uint8_t*>(&addr);
+            group_addr.assign(bytes, bytes + sizeof(addr));
+        }
+    } catch (...) {
+        if (listen_fd >= 0) {
+            ::close(listen_fd);
+        }
+        if (group_fd >= 0) {
+            ::close(group_fd);
+        }
+        throw;
+    }
+    xia_log(log::info) << "server: port=" << port_ << " group=" << cfg.group << ':'
+                       << cfg.group_port << " sources=" << srcs.size()
+                       << " zerocopy=" << std::boolalpha << (cfg.zerocopy && PIXIE_SERVER_ZEROCOPY);
+}
+
+server::~server() {
+    try {
+        stop();
+    } catch (std::exception& e) {
+        xia_log(log::error) << e.what();
+    }
+    sync::variable::lock_guard guard(lock);
+    for (auto& cl : connections) {
+        disconnect(cl);
+    }
+    connections.clear();
+    if (listen_fd >= 0) {
+        ::close(listen_fd);
+        listen_fd = -1;
+    }
+    if (group_fd >= 0) {
+        ::close(group_fd);
+        group_fd = -1;
+    }
+}
+
+void server::listen() {
+    listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        throw error(error::code::device_initialize_failure, "server: socket: " + errno_text());
+    }
+    const int on = 1;
+    ::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(cfg.port));
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (!cfg.address.empty() && ::inet_pton(AF_INET, cfg.address.c_str(), &addr.sin_addr) != 1) {
+        throw error(error::code::invalid_value, "server: invalid address: " + cfg.address);
+    }
+    if (::bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        throw error(error::code::device_initialize_failure,
+                    "server: bind: port " + std::to_string(cfg.port) + ": " + errno_text());
+    }
+    if (::listen(listen_fd, static_cast<int>(cfg.max_clients)) < 0) {
+        throw error(error::code::device_initialize_failure, "server: listen: " + errno_text());
+    }
+    ::fcntl(listen_fd, F_SETFL, ::fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+    socklen_t len = sizeof(addr);
+    ::getsockname(listen_fd, reinterpret_cast<sockaddr*>(&addr), &len);
+    port_ = ntohs(addr.sin_port);
+}
+
+void server::start() {
+    if (running_.load()) {
+        throw error(error::code::module_invalid_operation, "server: already running");
+    }
+    running_ = true;
+    thread = std::thread(&server::worker, this);
+}
+
+void server::stop() {
+    running_ = false;
+    {
+        sync::variable::lock_guard guard(period_lock);
+        period_wake.notify();
+    }
+    if (thread.joinable()) {
+        thread.join();
+    }
+    /*
+     * Send the data left.
+     */
+    while (poll() != 0) {
+    }
+}
+
+void server::accept() {
+    while (listen_fd >= 0) {
+        sockaddr_in addr = {};
+        socklen_t len = sizeof(addr);
+        const int fd = ::accept(listen_fd, reinterpret_cast<sockaddr*>(&addr), &len);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                ++errors_;
+                xia_log(log::warning) << "server: accept: " << errno_text();
+            }
+            return;
+        }
+        char host[INET_ADDRSTRLEN] = {};
+        ::inet_ntop(AF_INET, &addr.sin_addr, host, sizeof(host));
+        const std::string peer = std::string(host) + ':' + std::to_string(ntohs(addr.sin_port));
+        if (connections.size() >= cfg.max_clients) {
+            xia_log(log::warning) << "server: too many clients: " << peer;
+            ::close(fd);
+            continue;
+        }
+        timeval timeout = {};
+        timeout.tv_sec = static_cast<time_t>(cfg.send_timeout_msecs / 1000);
+        timeout.tv_usec = static_cast<suseconds_t>((cfg.send_timeout_msecs % 1000) * 1000);
+        ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        client cl;
+        cl.fd = fd;
+        cl.peer = peer;
+#if PIXIE_SERVER_ZEROCOPY
+        if (cfg.zerocopy) {
+            const int on = 1;
+            cl.zerocopy = ::setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) == 0;
+        }
+#endif
+        xia_log(log::info) << "server: client connected: " << peer << std::boolalpha
+                           << " zerocopy=" << cl.zerocopy;
+        connections.push_back(std::move(cl));
+        clients_ = connections.size();
+    }
+}
+
+size_t server::poll() {
+    sync::variable::lock_guard guard(lock);
+    accept();
+    auto frames = std::make_shared<batch>();
+    size_t words = 0;
+    for (size_t s = 0; s < srcs.size(); ++s) {
+        auto& src = srcs[s];
+        const size_t first = frames->buffers.size();
+        words += src.read(frames->buffers);
+        for (size_t b = first; b < frames->buffers.size(); ++b) {
+            auto& buf = *frames->buffers[b];
+            frame_header header = {};
+            header.magic = frame_magic;
+            header.module = static_cast<uint16_t>(src.number);
+            header.slot = static_cast<uint16_t>(src.slot);
+            header.sequence = sequences[s]++;
+            header.words = static_cast<uint32_t>(buf.size());
+            header.count = header.words;
+            if (cfg.crc && !buf.empty()) {
+                util::crc32 crc;
+                crc.update(buf);
+                header.crc = crc.value;
+            }
+            frames->headers.push_back(header);
+            frames->bytes += sizeof(frame_header) + buf.size() * sizeof(hw::word);
+        }
+    }
+    for (auto& cl : connections) {
+        complete(cl, false);
+    }
+    if (frames->headers.empty()) {
+        return 0;
+    }
+    for (auto& cl : connections) {
+        if (!send(cl, frames)) {
+            ++dropped_;
+            disconnect(cl);
+        }
+    }
+    connections.erase(std::remove_if(connections.begin(), connections.end(),
+                                 [](const client& cl) { return cl.fd < 0; }),
+                  connections.end());
+    clients_ = connections.size();
+    if (group_fd >= 0) {
+        multicast(*frames);
+    }
+    return words;
+}
+
+uint64_t server::frames(size_t source) {
+    sync::variable::lock_guard guard(lock);
+    if (source >= sequences.size()) {
+        throw error(error::code::invalid_value, "server: invalid source");
+    }
+    return sequences[source];
+}
+
+bool server::send(client& cl, const batch_ptr& frames) {
+    const size_t per_call = std::min(cfg.batch_frames * 2, max_iov) & ~size_t(1);
+    std::vector<iovec> iov;
+    iov.reserve(std::min(frames->headers.size() * 2, per_call));
+    int flags = MSG_NOSIGNAL;
+#if PIXIE_SERVER_ZEROCOPY
+    if (cl.zerocopy) {
+        flags |= MSG_ZEROCOPY;
+    }
+#endif
+    for (size_t frame = 0; frame < frames->headers.size();) {
+        iov.clear();
+        for (; frame < frames->headers.size() && iov.size() < per_call; ++frame) {
+            auto& buf = *frames->buffers[frame];
+            iov.push_back({&frames->headers[frame], sizeof(frame_header)});
+            iov.push_back({buf.data(), buf.size() * sizeof(hw::word)});
+        }
+        /*
+         * Send the vectors, a partial send continues from where it
+         * stopped.
+         */
+        size_t next = 0;
+        while (next < iov.size()) {
+            msghdr msg = {};
+            msg.msg_iov = iov.data() + next;
+            msg.msg_iovlen = iov.size() - next;
+            const ssize_t sent = ::sendmsg(cl.fd, &msg, flags);
+            if (sent < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+#if PIXIE_SERVER_ZEROCOPY
+                if (errno == ENOBUFS && (flags & MSG_ZEROCOPY) != 0) {
+                    /*
+                     * The socket's locked memory limit is reached, wait
+                     * for sends to complete or copy if none are in flight.
+                     */
+                    if (cl.in_flight.empty()) {
+                        flags &= ~MSG_ZEROCOPY;
+                    } else {
+                        complete(cl, true);
+                    }
+                    continue;
+                }
+#endif
+                xia_log(log::warning) << "server: client dropped: " << cl.peer << ": "
+                                      << errno_text();
+                return false;
+            }
+#if PIXIE_SERVER_ZEROCOPY
+            if ((flags & MSG_ZEROCOPY) != 0) {
+                cl.in_flight.emplace_back(cl.next_send++, frames);
+            }
+#endif
+            bytes_ += static_cast<size_t>(sent);
+            size_t done = static_cast<size_t>(sent);
+            while (next < iov.size() && done >= iov[next].iov_len) {
+                done -= iov[next].iov_len;
+                ++next;
+            }
+            if (done > 0) {
+                iov[next].iov_base = static_cast<char*>(iov[next].iov_base) + done;
+                iov[next].iov_len -= done;
+            }
+        }
+    }
+    return true;
+}
+
+void server::complete(client& cl, bool wait) {
+#if PIXIE_SERVER_ZEROCOPY
+    /*
+     * The kernel reports each range of zero copy sends completed on the
+     * socket's error queue. The sends complete in order on a TCP socket.
+     */
+    util::timepoint waited;
+    waited.start();
+    while (!cl.in_flight.empty()) {
+        char control[128];
+        msghdr msg = {};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (::recvmsg(cl.fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            if (errno == EAGAIN && wait && waited.msecs() < zerocopy_close_msecs) {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+                continue;
+            }
+            break;
+        }
+        for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if ((cmsg->cmsg_level != SOL_IP || cmsg->cmsg_type != IP_RECVERR) &&
+                (cmsg->cmsg_level != SOL_IPV6 || cmsg->cmsg_type != IPV6_RECVERR)) {
+                continue;
+            }
+            sock_extended_err err;
+            std::memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+            if (err.ee_errno != 0 || err.ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            while (!cl.in_flight.empty() &&
+                   int32_t(cl.in_flight.front().first - err.ee_data) <= 0) {
+                cl.in_flight.pop_front();
+            }
+        }
+        wait = false;
+    }
+#else
+    (void) wait;
+#endif
+    if (!cl.zerocopy) {
+        cl.in_flight.clear();
+    }
+}
+
+void server::disconnect(client& cl) {
+    if (cl.fd >= 0) {
+        complete(cl, true);
+        ::close(cl.fd);
+        cl.fd = -1;
+        /*
+         * The kernel holds the pages of the sends still in flight.
+         */
+        cl.in_flight.clear();
+        xia_log(log::info) << "server: client disconnected: " << cl.peer;
+    }
+}
+
+void server::multicast(const batch& frames) {
+    /*
+     * Split the buffers into datagrams of fragments. The headers of the
+     * fragments are built for the call and the data is sent from the
+     * buffers.
+     */
+    const size_t fragment_words = (cfg.datagram_bytes - sizeof(frame_header)) / sizeof(hw::word);
+    std::vector<frame_header> headers;
+    std::vector<iovec> iov;
+    headers.reserve(cfg.batch_frames);
+    iov.reserve(cfg.batch_frames * 2);
+#if defined(__linux__)
+    std::vector<mmsghdr> msgs;
+    msgs.reserve(cfg.batch_frames);
+#endif
+    auto flush = [&]() {
+#if defined(__linux__)
+        msgs.clear();
+        for (size_t d = 0; d < headers.size(); ++d) {
+            mmsghdr m = {};
+            m.msg_hdr.msg_name = const_cast<uint8_t*>(group_addr.data());
+            m.msg_hdr.msg_namelen = static_cast<socklen_t>(group_addr.size());
+            m.msg_hdr.msg_iov = &iov[d * 2];
+            m.msg_hdr.msg_iovlen = 2;
+            msgs.push_back(m);
+        }
+        size_t next = 0;
+        while (next < msgs.size()) {
+            const int sent = ::sendmmsg(group_fd, msgs.data() + next,
+                                        static_cast<unsigned int>(msgs.size() - next), 0);
+            if (sent <= 0) {
+                if (sent < 0 && errno == EINTR) {
+                    continue;
+                }
+                ++errors_;
+                xia_log(log::warning) << "server: group send: " << errno_text();
+                break;
+            }
+            for (int d = 0; d < sent; ++d) {
+                bytes_ += msgs[next + size_t(d)].msg_len;
+            }
+            next += size_t(sent);
+        }
+#else
+        for (size_t d = 0; d < headers.size(); ++d) {
+            msghdr m = {};
+            m.msg_name = const_cast<uint8_t*>(group_addr.data());
+            m.msg_namelen = static_cast<socklen_t>(group_addr.size());
+            m.msg_iov = &iov[d * 2];
+            m.msg_iovlen = 2;
+            const ssize_t sent = ::sendmsg(group_fd, &m, 0);
+            if (sent < 0) {
+                ++errors_;
+                break;
+            }
+            bytes_ += size_t(sent);
+        }
+#endif
+        headers.clear();
+        iov.clear();
+    };
+    /*
+     * The vectors point at the headers so they are built once the headers
+     * of a call are made. A call only holds the fragments of one buffer.
+     */
+    auto send_fragments = [&](const buffer::buffer& buf) {
+        for (auto& h : headers) {
+            iov.push_back({&h, sizeof(frame_header)});
+            iov.push_back({const_cast<hw::word*>(buf.data()) + h.offset,
+                           h.count * sizeof(hw::word)});
+        }
+        flush();
+    };
+    for (size_t frame = 0; frame < frames.headers.size(); ++frame) {
+        auto& buf = *frames.buffers[frame];
+        size_t offset = 0;
+        do {
+            frame_header header = frames.headers[frame];
+            header.offset = static_cast<uint32_t>(offset);
+            header.count = static_cast<uint32_t>(std::min(fragment_words, buf.size() - offset));
+            headers.push_back(header);
+            offset += header.count;
+            if (headers.size() == cfg.batch_frames) {
+                send_fragments(buf);
+            }
+        } while (offset < buf.size());
+        send_fragments(buf);
+    }
+}
+
+void server::worker() {
+    xia_log(log::debug) << "server: thread started: period=" << cfg.poll_msecs << "msecs";
+    while (running_.load()) {
+        size_t words = 0;
+        try {
+            words = poll();
+        } catch (std::exception& e) {
+            ++errors_;
+            xia_log(log::error) << "server: " << e.what();
+        }
+        if (words == 0) {
+            sync::variable::lock_guard guard(period_lock);
+            if (!running_.load()) {
+                break;
+            }
+            period_wake.wait(cfg.poll_msecs * 1000);
+        }
+    }
+    xia_log(log::debug) << "server: thread stopped";
+}
+
+client::client(const std::string& host, int port) : fd(-1) {
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* found = nullptr;
+    const int result =
+        ::getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &found);
+    if (result != 0) {
+        throw error(error::code::invalid_value,
+                    "client: " + host + ": " + ::gai_strerror(result));
+    }
+    for (auto ai = found; ai != nullptr && fd < 0; ai = ai->ai_next) {
+        fd = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd >= 0 && ::connect(fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    ::freeaddrinfo(found);
+    if (fd < 0) {
+        throw error(error::code::device_initialize_failure,
+                    "client: connect: " + host + ':' + std::to_string(port) + ": " +
+                        errno_text());
+    }
+}
+
+client::~client() {
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+void client::shutdown() {
+    if (fd >= 0) {
+        ::shutdown(fd, SHUT_RDWR);
+    }
+}
+
+bool client::read(void* data, size_t size) {
+    auto bytes = static_cast<char*>(data);
+    while (size > 0) {
+        const ssize_t got = ::recv(fd, bytes, size, 0);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        bytes += got;
+        size -= size_t(got);
+    }
+    return true;
+}
+
+bool client::receive(frame_header& header, hw::words& words) {
+    if (!read(&header, sizeof(header))) {
+        return false;
+    }
+    if (header.magic != frame_magic || header.offset != 0 || header.count != header.words) {
+        throw error(error::code::invalid_value, "client: invalid frame header");
+    }
+    words.resize(header.words);
+    if (!read(words.data(), words.size() * sizeof(hw::word))) {
+        return false;
+    }
+    if (header.crc != 0) {
+        util::crc32 crc;
+        crc.update(words);
+        if (crc.value != header.crc) {
+            throw error(error::code::invalid_value,
+                        "client: frame CRC mismatch: module " + std::to_string(header.module));
+        }
+    }
+    return true;
+}
+#endif
+}  // namespace server
+}  // namespace pixie
+}  // namespace xia
@@ -21,12 +21,16 @@
  */
 
 #include <algorithm>
+#include <cmath>
 #include <cstring>
 #include <fstream>
 
 #include <pixie/log.hpp>
 #include <pixie/util.hpp>
 
+#include <pixie/data/list_mode.hpp>
+
+#include <pixie/pixie16/memory.hpp>
 #include <pixie/pixie16/sim.hpp>
 
 namespace xia {
@@ -34,6 +38,283 @@ namespace pixie {
 namespace sim {
 module_defs mod_defs;
 
+/*
+ * The words of the optional header sections.
+ */
+static constexpr size_t esum_words = 4;
+static constexpr size_t qdc_words = 8;
+static constexpr size_t ets_words = 2;
+
+/*
+ * The simulated ADC's baseline and maximum.
+ */
+static constexpr hw::word trace_baseline = 1000;
+static constexpr hw::word trace_max = 0x3fff;
+
+channel_events::channel_events() : rate(0), energy(1000), energy_sigma(0), trace_length(0) {}
+
+generator_config::generator_config()
+    : header_length(data::list_mode::header_length::header), pileup_ns(0), seed(1) {}
+
+generator::generator()
+    : events(0), lost(0), pileups(0), slot(0), wide_layout(false), tick_ns(10),
+      running_(false), head(0), count(0) {}
+
+void generator::configure(const generator_config& config_, int slot_, size_t num_channels,
+                          int adc_msps) {
+    namespace lm = data::list_mode;
+    switch (config_.header_length) {
+        case lm::header_length::header:
+        case lm::header_length::header_ets:
+        case lm::header_length::header_esum:
+        case lm::header_length::header_esum_ets:
+        case lm::header_length::header_qdc:
+        case lm::header_length::header_qdc_ets:
+        case lm::header_length::header_esum_qdc:
+        case lm::header_length::header_esum_qdc_ets:
+            break;
+        default:
+            throw error(error::code::invalid_value,
+                        "sim: generator: invalid header length: " +
+                            std::to_string(config_.header_length));
+    }
+    if (config_.channels.size() > 1 && config_.channels.size() != num_channels) {
+        throw error(error::code::invalid_value,
+                    "sim: generator: channel count does not match the module");
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    config = config_;
+    slot = slot_;
+    wide_layout = num_channels > 16;
+    tick_ns = adc_msps == 250 ? 8 : 10;
+    random.seed(config.seed);
+    channels.clear();
+    if (config.enabled()) {
+        channels.resize(num_channels);
+        for (size_t c = 0; c < num_channels; ++c) {
+            auto& chan = channels[c];
+            chan.events = config.channels[config.channels.size() == 1 ? 0 : c];
+            chan.events.trace_length &= ~size_t(1);
+            /*
+             * A pulse with an exponential decay a quarter of the way into
+             * the trace. The trace is the same for all of the channel's
+             * events.
+             */
+            const size_t samples = chan.events.trace_length;
+            const double amplitude = std::min(chan.events.energy, double(trace_max));
+            const double tau = std::max(double(samples) / 8, 1.0);
+            std::vector<hw::word> trace(samples, trace_baseline);
+            for (size_t t = samples / 4; t < samples; ++t) {
+                const double value =
+                    trace_baseline + amplitude * std::exp(-double(t - samples / 4) / tau);
+                trace[t] = hw::word(std::min(value, double(trace_max)));
+            }
+            chan.trace.resize(samples / 2);
+            for (size_t w = 0; w < chan.trace.size(); ++w) {
+                chan.trace[w] = trace[w * 2] | (trace[w * 2 + 1] << 16);
+            }
+        }
+        fifo.resize(hw::fifo_size_words);
+    } else {
+        fifo.clear();
+    }
+    head = 0;
+    count = 0;
+    running_ = false;
+}
+
+bool generator::enabled() {
+    std::lock_guard<std::mutex> guard(lock);
+    return !channels.empty();
+}
+
+void generator::start() {
+    std::lock_guard<std::mutex> guard(lock);
+    events = 0;
+    lost = 0;
+    pileups = 0;
+    head = 0;
+    count = 0;
+    for (auto& chan : channels) {
+        chan.next = interval(chan.events.rate);
+        chan.last = 0;
+        chan.first = true;
+    }
+    started = clock::now();
+    running_ = true;
+}
+
+void generator::stop() {
+    std::lock_guard<std::mutex> guard(lock);
+    generate();
+    running_ = false;
+}
+
+bool generator::running() {
+    std::lock_guard<std::mutex> guard(lock);
+    return running_;
+}
+
+size_t generator::level() {
+    std::lock_guard<std::mutex> guard(lock);
+    generate();
+    return count;
+}
+
+void generator::read(hw::word_ptr values, const size_t size) {
+    std::lock_guard<std::mutex> guard(lock);
+    const size_t words = std::min(size, count);
+    const size_t first = std::min(words, fifo.size() - head);
+    std::copy(&fifo[head], &fifo[head] + first, values);
+    std::copy(fifo.data(), fifo.data() + words - first, values + first);
+    std::fill(values + words, values + size, 0);
+    head = (head + words) % fifo.size();
+    count -= words;
+}
+
+void generator::generate() {
+    if (!running_) {
+        return;
+    }
+    const auto now = clock::now() - started;
+    const uint64_t ticks =
+        uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count() / tick_ns);
+    /*
+     * Merge the channels' events in time order.
+     */
+    while (true) {
+        channel_state* next = nullptr;
+        size_t channel = 0;
+        for (size_t c = 0; c < channels.size(); ++c) {
+            auto& chan = channels[c];
+            if (chan.events.rate > 0 && (next == nullptr || chan.next < next->next)) {
+                next = &chan;
+                channel = c;
+            }
+        }
+        if (next == nullptr || next->next > ticks) {
+            break;
+        }
+        const uint64_t time = next->next;
+        const bool pileup = config.pileup_ns != 0 && !next->first &&
+            double(time - next->last) * tick_ns < double(config.pileup_ns);
+        encode(channel, time, pileup);
+        next->last = time;
+        next->first = false;
+        next->next = time + interval(next->events.rate);
+    }
+}
+
+void generator::encode(size_t channel, uint64_t time, bool pileup) {
+    auto& chan = channels[channel];
+    const size_t event_length = config.header_length + chan.trace.size();
+    ++events;
+    if (pileup) {
+        ++pileups;
+    }
+    if (fifo.size() - count < event_length) {
+        ++lost;
+        return;
+    }
+    double energy = chan.events.energy;
+    if (chan.events.energy_sigma > 0) {
+        energy = std::normal_distribution<double>(energy, chan.events.energy_sigma)(random);
+    }
+    const hw::word energy_value = hw::word(std::max(std::min(energy, 65535.0), 0.0));
+    record.resize(event_length);
+    auto rec = record.data();
+    if (wide_layout) {
+        rec[0] = hw::word(channel & 0x3f) | (hw::word(slot & 0xf) << 6);
+    } else {
+        rec[0] = hw::word(channel & 0xf) | (hw::word(slot & 0xf) << 4);
+    }
+    rec[0] |= (hw::word(config.header_length) << 12) | (hw::word(event_length) << 17) |
+        (pileup ? (hw::word(1) << 31) : 0);
+    rec[1] = hw::word(time);
+    rec[2] = hw::word(time >> 32) & 0xffff;
+    rec[3] = energy_value | (hw::word(chan.events.trace_length) << 16);
+    namespace lm = data::list_mode;
+    const size_t length = config.header_length;
+    const bool ets = length == lm::header_length::header_ets ||
+        length == lm::header_length::header_esum_ets ||
+        length == lm::header_length::header_qdc_ets ||
+        length == lm::header_length::header_esum_qdc_ets;
+    const bool qdc = length >= lm::header_length::header_qdc;
+    const bool esum = (length - (ets ? ets_words : 0) - (qdc ? qdc_words : 0)) >
+        size_t(lm::header_length::header);
+    size_t w = 4;
+    if (esum) {
+        rec[w++] = energy_value;
+        rec[w++] = energy_value;
+        rec[w++] = energy_value / 2;
+        rec[w++] = util::ieee_float(double(trace_baseline));
+    }
+    if (qdc) {
+        for (size_t q = 0; q < qdc_words; ++q) {
+            rec[w++] = energy_value / hw::word(qdc_words);
+        }
+    }
+    if (ets) {
+        rec[w++] = rec[1];
+        rec[w++] = rec[2];
+    }
+    std::copy(chan.trace.begin(), chan.trace.end(), rec + w);
+    push(rec, event_length);
+}
+
+void generator::push(const hw::word* values, const size_t size) {
+    size_t tail = (head + count) % fifo.size();
+    const size_t first = std::min(size, fifo.size() - tail);
+    std::copy(values, values + first, &fifo[tail]);
+    std::copy(values + first, values + size, fifo.data());
+    count += size;
+}
+
+uint64_t generator::interval(double rate) {
+    if (rate <= 0) {
+        return 0;
+    }
+    const double secs = std::exponential_distribution<double>(rate)(random);
+    return std::max(uint64_t(secs * 1e9 / tick_ns), uint64_t(1));
+}
+
+/*
+ * A channel's ADC trace is the baseline with a pulse decaying with the
+ * channel's tau sampled at the channel's XDT. The pulse moves along the
+ * trace with each acquisition.
+ */
+struct channel_fixture : public xia::pixie::fixture::channel {
+    channel_fixture(xia::pixie::channel::channel& module_channel_, const hw::config& config_);
+    virtual void acquire_adc() override;
+    virtual void read_adc(hw::adc_word* buffer, size_t size) override;
+    size_t acquisitions;
+};
+
+channel_fixture::channel_fixture(xia::pixie::channel::channel& module_channel_,
+                                 const hw::config& config_)
+    : xia::pixie::fixture::channel(module_channel_, config_), acquisitions(0) {
+    label = "sim";
+}
+
+void channel_fixture::acquire_adc() {
+    ++acquisitions;
+}
+
+void channel_fixture::read_adc(hw::adc_word* buffer, size_t size) {
+    static const double baseline = 1000;
+    static const double amplitude = 4000;
+    const double tau = module_channel.tau();
+    const double xdt = module_channel.xdt();
+    const size_t start = size / 8 + (acquisitions * 37) % std::max(size / 4, size_t(1));
+    for (size_t s = 0; s < size; ++s) {
+        double value = baseline + double((s * 7919) % 9) - 4;
+        if (s >= start && tau > 0 && xdt > 0) {
+            value += amplitude * std::exp(-double(s - start) * xdt / tau);
+        }
+        buffer[s] = hw::adc_word(value);
+    }
+}
+
 struct fixture : public xia::pixie::fixture::module {
     fixture(xia::pixie::module::module& module_);
     virtual ~fixture() override;
@@ -75,17 +356,119 @@ void fixture::boot() {}
 void fixture::erase_values() {}
 void fixture::init_values() {}
 void fixture::erase_channels() {}
-void fixture::init_channels() { xia::pixie::fixture::module::init_channels(); }
+void fixture::init_channels() {
+    for (auto& chan : module_.channels) {
+        chan.fixture = std::make_shared<channel_fixture>(chan, module_.eeprom.configs[chan.number]);
+        chan.fixture->open();
+    }
+}
 void fixture::sync_hw() {}
 void fixture::sync_vars() {}
 void fixture::set_dacs() {}
-void fixture::get_traces() {}
+void fixture::get_traces() {
+    for (auto& chan : module_.channels) {
+        chan.fixture->acquire_adc();
+    }
+}
 void fixture::adjust_offsets() {}
 void fixture::tau_finder() {}
 
+replay::replay()
+    : chunks(0), words(0), timed(true), running_(false), next(0), offset(0) {}
+
+void replay::load(const std::string& path, bool timed_) {
+    capture::reader reader;
+    reader.open(path);
+    std::vector<capture::chunk> chunks_;
+    capture::chunk chk;
+    while (reader.next(chk)) {
+        chunks_.push_back(std::move(chk));
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    hdr = reader.hdr;
+    data = std::move(chunks_);
+    timed = timed_;
+    running_ = false;
+    next = 0;
+    offset = 0;
+}
+
+void replay::unload() {
+    std::lock_guard<std::mutex> guard(lock);
+    data.clear();
+    running_ = false;
+}
+
+bool replay::enabled() {
+    std::lock_guard<std::mutex> guard(lock);
+    return !data.empty();
+}
+
+void replay::start() {
+    std::lock_guard<std::mutex> guard(lock);
+    chunks = 0;
+    words = 0;
+    next = 0;
+    offset = 0;
+    started = clock::now();
+    running_ = true;
+}
+
+void replay::stop() {
+    std::lock_guard<std::mutex> guard(lock);
+    running_ = false;
+}
+
+bool replay::running() {
+    std::lock_guard<std::mutex> guard(lock);
+    return running_ && next < data.size();
+}
+
+size_t replay::level() {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!running_ || next >= data.size()) {
+        return 0;
+    }
+    if (timed) {
+        const auto now = std::chrono::duration_cast<std::chrono::microseconds>(
+            clock::now() - started);
+        if (uint64_t(now.count()) < data[next].usecs) {
+            return 0;
+        }
+    }
+    return data[next].words.size() - offset;
+}
+
+void replay::read(hw::word_ptr values, const size_t size) {
+    std::lock_guard<std::mutex> guard(lock);
+    size_t copied = 0;
+    if (next < data.size()) {
+        const auto& chunk = data[next].words;
+        copied = std::min(size, chunk.size() - offset);
+        std::copy(chunk.data() + offset, chunk.data() + offset + copied, values);
+        offset += copied;
+        words += copied;
+        if (offset == chunk.size()) {
+            ++next;
+            ++chunks;
+            offset = 0;
+        }
+    }
+    std::fill(values + copied, values + size, 0);
+}
+
 module::module(xia::pixie::backplane::backplane& backplane_) : xia::pixie::module::module(backplane_) {}
 
-module::~module() {}
+module::~module() {
+    /*
+     * The FIFO worker reads the generator.
+     */
+    try {
+        stop_fifo_services();
+    } catch (pixie::error::error& e) {
+        xia_log(log::error) << e;
+    }
+}
 
 void module::open(size_t device_number) {
     if (vmaddr != nullptr) {
@@ -115,19 +498,30 @@ void module::open(size_t device_number) {
             eeprom.configs.resize(num_channels, config);
 
             var_defaults = mod_def.var_defaults;
+            gen_config = mod_def.gen_config;
 
             fixtures = std::make_shared<fixture>(*this);
+            /*
+             * The fixtures run the control tasks.
+             */
+            run_config = hw::run::module_config();
+            hw_access = &hw::access::make(*this);
 
             present_ = true;
             return;
         }
     }
 
-    throw error(number, slot, error::code::module_initialize_failure, "no device found");
+    /*
+     * Module not found so the device is not present, the same as the
+     * hardware's open.
+     */
+    xia_log(log::debug) << "sim: module: open: device not found: device=" << device_number;
 }
 
 void module::close() {
     xia_log(log::info) << "sim: module: close";
+    stop_fifo_services();
     present_ = false;
     vmaddr = nullptr;
     pci_memory.release();
@@ -142,6 +536,7 @@ void module::probe() {
     init_channels();
     online_ = dsp_online = fippi_fpga = comms_fpga = true;
     fixtures->online();
+    set_generator(gen_config);
 }
 
 void module::boot(bool boot_comms, bool boot_fippi, bool boot_dsp) {
@@ -162,10 +557,98 @@ void module::boot(bool boot_comms, bool boot_fippi, bool boot_dsp) {
     init_values();
     init_channels();
     online_ = comms_fpga && fippi_fpga && dsp_online;
+    if (online_) {
+        set_generator(gen_config);
+    }
 }
 
 void module::initialize() {}
 
+void module::dma_read(const hw::address source, hw::word_ptr values, const size_t size) {
+    if (source == hw::memory::FIFO_MEM_DMA && replayer.enabled()) {
+        replayer.read(values, size);
+        return;
+    }
+    if (source == hw::memory::FIFO_MEM_DMA && gen.enabled()) {
+        gen.read(values, size);
+        return;
+    }
+    xia::pixie::module::module::dma_read(source, values, size);
+}
+
+void module::set_generator(const generator_config& config) {
+    gen.configure(config, slot, num_channels, eeprom.configs.empty() ?
+                                                   0 :
+                                                   eeprom.configs[0].adc_msps);
+    gen_config = config;
+    if (online() && config.enabled()) {
+        xia_log(log::info) << "sim: module: generator: header-length=" << config.header_length
+                           << " channels=" << config.channels.size();
+        start_fifo_services();
+    }
+}
+
+void module::set_replay(const std::string& path, bool timed) {
+    replayer.load(path, timed);
+    xia_log(log::info) << "sim: module: replay: " << path << " timed=" << std::boolalpha
+                       << timed;
+    if (online()) {
+        start_fifo_services();
+    }
+}
+
+void module::clear_replay() {
+    replayer.unload();
+}
+
+/*
+ * Run a list-mode source, the replay or the generator.
+ */
+template<typename Source>
+static void run_source(Source& source, const hw::word value, const bool list_mode) {
+    const bool run_enable = (value & (1 << hw::bit::RUNENA)) != 0;
+    if (run_enable && list_mode) {
+        if (!source.running()) {
+            source.start();
+        }
+    } else if (!run_enable && source.running()) {
+        source.stop();
+    }
+}
+
+hw::word module::no_hw_read_word(int reg) {
+    const bool replaying = replayer.enabled();
+    if (!replaying && !gen.enabled()) {
+        return 0;
+    }
+    /*
+     * The FPGAs are loaded, the run is active while the source is running
+     * and the FIFO level is the source's.
+     */
+    if (reg == int(hw::device::CFG_RDCS)) {
+        return comms_fpga && fippi_fpga ? ~hw::word(0) : 0;
+    }
+    if (reg == int(hw::device::CSR)) {
+        const bool running = replaying ? replayer.running() : gen.running();
+        return running ? (1 << hw::bit::RUNENA) | (1 << hw::bit::RUNACTIVE) : 0;
+    }
+    if (reg == int(hw::device::RD_WRT_FIFO_WML)) {
+        return hw::word(replaying ? replayer.level() : gen.level());
+    }
+    return 0;
+}
+
+void module::no_hw_write_word(int reg, const hw::word value) {
+    if (reg == int(hw::device::CSR)) {
+        const bool list_mode = run_task.load() == hw::run::run_task::list_mode;
+        if (replayer.enabled()) {
+            run_source(replayer, value, list_mode);
+        } else if (gen.enabled()) {
+            run_source(gen, value, list_mode);
+        }
+    }
+}
+
 void module::init_values() {
     pixie::module::module::init_values();
     if (!var_defaults.empty()) {
@@ -225,6 +708,10 @@ void crate::add_module() {
     modules.push_back(std::make_unique<module>(backplane));
 }
 
+size_t crate::scan_devices() {
+    return hw::max_slots;
+}
+
 module_def::module_def()
     : device_number(0), slot(0), revision(0), eeprom_format(0), serial_num(0), num_channels(0),
       adc_bits(0), adc_msps(0), adc_clk_div(0) {}
@@ -283,6 +770,32 @@ void add_module_def(const std::string mod_desc, const char delimiter) {
                 mod_def.adc_clk_div = std::stoul(label_value[1]);
             } else if (label_value[0] == "var-defaults") {
                 mod_def.var_defaults = label_value[1];
+            } else if (label_value[0].compare(0, 4, "gen-") == 0) {
+                auto& gen = mod_def.gen_config;
+                if (label_value[0] == "gen-header") {
+                    gen.header_length = std::stoul(label_value[1]);
+                } else if (label_value[0] == "gen-pileup-ns") {
+                    gen.pileup_ns = std::stoul(label_value[1]);
+                } else if (label_value[0] == "gen-seed") {
+                    gen.seed = std::stoul(label_value[1]);
+                } else {
+                    if (gen.channels.empty()) {
+                        gen.channels.resize(1);
+                    }
+                    auto& events = gen.channels[0];
+                    if (label_value[0] == "gen-rate") {
+                        events.rate = std::stod(label_value[1]);
+                    } else if (label_value[0] == "gen-energy") {
+                        events.energy = std::stod(label_value[1]);
+                    } else if (label_value[0] == "gen-energy-sigma") {
+                        events.energy_sigma = std::stod(label_value[1]);
+                    } else if (label_value[0] == "gen-trace-length") {
+                        events.trace_length = std::stoul(label_value[1]);
+                    } else {
+                        throw error(error::code::invalid_value,
+                                    "invalid module definition: " + field);
+                    }
+                }
             } else {
                 throw error(error::code::invalid_value, "invalid module definition: " + field);
             }
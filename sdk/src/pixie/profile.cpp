@@ -0,0 +1,288 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2022 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file profile.cpp
+ * @brief Implements a profiler of named code sites.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <mutex>
+
+#include <pixie/profile.hpp>
+
+namespace xia {
+namespace pixie {
+namespace profile {
+/*
+ * A thread's aggregate of a site. Only the thread writes it so the values
+ * are loaded and stored without a read-modify-write. A dump reads it from
+ * another thread.
+ */
+struct counter {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> min;
+    std::atomic<uint64_t> max;
+    std::array<std::atomic<uint64_t>, bins> histogram;
+
+    void clear() {
+        count.store(0, std::memory_order_relaxed);
+        total.store(0, std::memory_order_relaxed);
+        min.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+        max.store(0, std::memory_order_relaxed);
+        for (auto& bin : histogram) {
+            bin.store(0, std::memory_order_relaxed);
+        }
+    }
+};
+
+struct thread_table {
+    std::array<counter, max_sites> counters;
+    /*
+     * A reset increments the registry's generation. A thread clears its
+     * counters when it next records so a reset does not write another
+     * thread's counters.
+     */
+    std::atomic<uint64_t> generation;
+
+    thread_table();
+    ~thread_table();
+
+    void clear() {
+        for (auto& c : counters) {
+            c.clear();
+        }
+    }
+};
+
+struct registry {
+    std::mutex lock;
+    std::vector<std::string> names;
+    std::vector<thread_table*> tables;
+    /*
+     * The aggregates of the threads that have exited.
+     */
+    std::vector<stats> retired;
+    std::atomic<uint64_t> generation;
+    std::atomic_bool enabled;
+
+    registry() : retired(max_sites), generation(0), enabled(false) {}
+};
+
+static registry& get_registry() {
+    static registry reg;
+    return reg;
+}
+
+static size_t bin(uint64_t nsecs) {
+    size_t b = 0;
+    while (nsecs != 0 && b < bins - 1) {
+        nsecs >>= 1;
+        ++b;
+    }
+    return b;
+}
+
+static void merge(stats& into, const counter& c) {
+    const auto count = c.count.load(std::memory_order_relaxed);
+    if (count == 0) {
+        return;
+    }
+    into.count += count;
+    into.total_nsecs += c.total.load(std::memory_order_relaxed);
+    into.min_nsecs = std::min(into.min_nsecs, c.min.load(std::memory_order_relaxed));
+    into.max_nsecs = std::max(into.max_nsecs, c.max.load(std::memory_order_relaxed));
+    for (size_t b = 0; b < bins; ++b) {
+        into.histogram[b] += c.histogram[b].load(std::memory_order_relaxed);
+    }
+}
+
+thread_table::thread_table() {
+    auto& reg = get_registry();
+    clear();
+    std::lock_guard<std::mutex> guard(reg.lock);
+    generation = reg.generation.load();
+    reg.tables.push_back(this);
+}
+
+thread_table::~thread_table() {
+    auto& reg = get_registry();
+    std::lock_guard<std::mutex> guard(reg.lock);
+    if (generation.load() == reg.generation.load()) {
+        for (size_t s = 0; s < max_sites; ++s) {
+            merge(reg.retired[s], counters[s]);
+        }
+    }
+    reg.tables.erase(std::remove(reg.tables.begin(), reg.tables.end(), this), reg.tables.end());
+}
+
+static thread_table& local_table() {
+    thread_local thread_table table;
+    return table;
+}
+
+stats::stats()
+    : count(0), total_nsecs(0), min_nsecs(std::numeric_limits<uint64_t>::max()), max_nsecs(0) {
+    histogram.fill(0);
+}
+
+double stats::mean_usecs() const {
+    return count == 0 ? 0 : double(total_nsecs) / double(count) / 1000;
+}
+
+uint64_t stats::percentile_nsecs(const double percentile) const {
+    if (count == 0) {
+        return 0;
+    }
+    const auto target = uint64_t(std::ceil(percentile * double(count)));
+    uint64_t sum = 0;
+    for (size_t b = 0; b < bins - 1; ++b) {
+        sum += histogram[b];
+        if (sum >= std::max(target, uint64_t(1))) {
+            const uint64_t upper = b == 0 ? 0 : (uint64_t(1) << b) - 1;
+            return std::min(upper, max_nsecs);
+        }
+    }
+    return max_nsecs;
+}
+
+site::site(const char* name) : index(max_sites) {
+    auto& reg = get_registry();
+    std::lock_guard<std::mutex> guard(reg.lock);
+    auto found = std::find(reg.names.begin(), reg.names.end(), name);
+    if (found != reg.names.end()) {
+        index = size_t(found - reg.names.begin());
+    } else if (reg.names.size() < max_sites) {
+        index = reg.names.size();
+        reg.names.emplace_back(name);
+    }
+}
+
+void site::record(const uint64_t nsecs) {
+    if (index >= max_sites) {
+        return;
+    }
+    auto& table = local_table();
+    const auto generation = get_registry().generation.load(std::memory_order_relaxed);
+    if (table.generation.load(std::memory_order_relaxed) != generation) {
+        table.clear();
+        table.generation.store(generation, std::memory_order_release);
+    }
+    auto& c = table.counters[index];
+    auto add = [](std::atomic<uint64_t>& value, uint64_t amount) {
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    };
+    add(c.count, 1);
+    add(c.total, nsecs);
+    if (nsecs < c.min.load(std::memory_order_relaxed)) {
+        c.min.store(nsecs, std::memory_order_relaxed);
+    }
+    if (nsecs > c.max.load(std::memory_order_relaxed)) {
+        c.max.store(nsecs, std::memory_order_relaxed);
+    }
+    add(c.histogram[bin(nsecs)], 1);
+}
+
+void site::record(util::timepoint& tp) {
+    record(tp.usecs() * 1000);
+}
+
+timer::timer(site& site__) : site_(enabled() ? &site__ : nullptr) {
+    if (site_ != nullptr) {
+        start = clock::now();
+    }
+}
+
+timer::~timer() {
+    stop();
+}
+
+void timer::stop() {
+    if (site_ != nullptr) {
+        const auto period = clock::now() - start;
+        site_->record(
+            uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(period).count()));
+        site_ = nullptr;
+    }
+}
+
+void enable(const bool on) {
+    get_registry().enabled = on;
+}
+
+bool enabled() {
+    return get_registry().enabled.load(std::memory_order_relaxed);
+}
+
+void reset() {
+    auto& reg = get_registry();
+    std::lock_guard<std::mutex> guard(reg.lock);
+    ++reg.generation;
+    for (auto& r : reg.retired) {
+        r = stats();
+    }
+}
+
+void dump(stats_list& sites) {
+    auto& reg = get_registry();
+    std::lock_guard<std::mutex> guard(reg.lock);
+    const auto generation = reg.generation.load();
+    sites.clear();
+    for (size_t s = 0; s < reg.names.size(); ++s) {
+        stats st = reg.retired[s];
+        for (auto table : reg.tables) {
+            if (table->generation.load(std::memory_order_acquire) == generation) {
+                merge(st, table->counters[s]);
+            }
+        }
+        if (st.count != 0) {
+            st.name = reg.names[s];
+            sites.push_back(st);
+        }
+    }
+}
+
+void output(std::ostream& out) {
+    stats_list sites;
+    dump(sites);
+    util::ostream_guard guard(out);
+    size_t width = 4;
+    for (auto& st : sites) {
+        width = std::max(width, st.name.size());
+    }
+    auto usecs = [](uint64_t nsecs) { return double(nsecs) / 1000; };
+    out << std::left << std::setw(int(width)) << "site" << std::right << std::setw(10)
+        << "count" << std::setw(12) << "total-ms" << std::setw(12) << "mean-us" << std::setw(12)
+        << "min-us" << std::setw(12) << "max-us" << std::setw(12) << "p50-us" << std::setw(12)
+        << "p99-us" << std::endl;
+    out << std::fixed << std::setprecision(3);
+    for (auto& st : sites) {
+        out << std::left << std::setw(int(width)) << st.name << std::right << std::setw(10)
+            << st.count << std::setw(12) << double(st.total_nsecs) / 1e6 << std::setw(12)
+            << st.mean_usecs() << std::setw(12) << usecs(st.min_nsecs) << std::setw(12)
+            << usecs(st.max_nsecs) << std::setw(12) << usecs(st.percentile_nsecs(0.5))
+            << std::setw(12) << usecs(st.percentile_nsecs(0.99)) << std::endl;
+    }
+}
+}  // namespace profile
+}  // namespace pixie
+}  // namespace xia
@@ -0,0 +1,481 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file shm.cpp
+ * @brief Implements a shared memory ring to publish data buffers to other processes
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <thread>
+
+#include <pixie/error.hpp>
+#include <pixie/log.hpp>
+#include <pixie/os_compat.hpp>
+#include <pixie/shm.hpp>
+
+#if !defined(_WIN64) && !defined(_WIN32)
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace xia {
+namespace buffer {
+namespace shm {
+/*
+ * The segment is the header, the subscriber slots and the blocks. Each is
+ * cache line aligned so the publisher and subscribers do not share lines
+ * they write.
+ */
+static constexpr size_t line = 64;
+static constexpr uint32_t magic = 0x52534d58; /* "XMSR" */
+static constexpr uint32_t version = 1;
+
+/*
+ * The time a waiting read sleeps between checks.
+ */
+static constexpr size_t wait_poll_usecs = 100;
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+              "shared memory atomics must be lock free");
+
+struct alignas(line) segment {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t mode;
+    uint32_t subscribers;
+    uint64_t blocks;
+    uint64_t block_words;
+    uint64_t block_bytes;
+    /*
+     * The next sequence number to publish.
+     */
+    alignas(line) std::atomic<uint64_t> head;
+    std::atomic<uint32_t> closed;
+};
+
+/*
+ * A slot is claimed by a subscriber setting the state to claiming, then
+ * the cursor is set and the state is set to active. The publisher only
+ * checks the cursors of active slots.
+ */
+enum slot_state : uint32_t { slot_free = 0, slot_claiming = 1, slot_active = 2 };
+
+struct alignas(line) subscriber_slot {
+    std::atomic<uint32_t> state;
+    std::atomic<uint32_t> pid;
+    /*
+     * The next sequence number to read.
+     */
+    std::atomic<uint64_t> cursor;
+    std::atomic<uint64_t> dropped;
+};
+
+/*
+ * The commit is the block's sequence number plus 1 once the block is
+ * written and 0 while it is being written.
+ */
+struct alignas(line) block_header {
+    std::atomic<uint64_t> commit;
+    uint32_t source;
+    uint32_t flags;
+    uint64_t words;
+};
+
+static size_t round_up(size_t value) {
+    return ((value + line - 1) / line) * line;
+}
+
+static size_t block_bytes(size_t block_words) {
+    return round_up(sizeof(block_header) + block_words * sizeof(buffer_value));
+}
+
+static size_t segment_bytes(const config& cfg) {
+    return sizeof(segment) + cfg.subscribers * sizeof(subscriber_slot) +
+        cfg.blocks * block_bytes(cfg.block_words);
+}
+
+static subscriber_slot* slots(segment* seg) {
+    return reinterpret_cast<subscriber_slot*>(reinterpret_cast<char*>(seg) + sizeof(segment));
+}
+
+static block_header* block_at(segment* seg, uint64_t sequence) {
+    char* blocks =
+        reinterpret_cast<char*>(seg) + sizeof(segment) + seg->subscribers * sizeof(subscriber_slot);
+    return reinterpret_cast<block_header*>(blocks + (sequence % seg->blocks) * seg->block_bytes);
+}
+
+static std::string shm_name(const std::string& name) {
+    if (name.empty()) {
+        throw error(error::code::invalid_value, "shm: no name");
+    }
+    return name[0] == '/' ? name : '/' + name;
+}
+
+#if !defined(_WIN64) && !defined(_WIN32)
+static bool process_exists(uint32_t pid) {
+    return ::kill(static_cast<pid_t>(pid), 0) == 0 || errno != ESRCH;
+}
+#endif
+
+config::config() : blocks(128), block_words(64 * 1024), subscribers(8), mode(policy::lossy) {}
+
+block_view::block_view() : sequence(0), source(0), flags(0), data(nullptr), words(0) {}
+
+#if defined(_WIN64) || defined(_WIN32)
+publisher::publisher(const std::string& name_, const config& cfg_)
+    : name(name_), cfg(cfg_), seg(nullptr), bytes(0), full_(0) {
+    throw error(error::code::not_supported, "shm: not supported on Windows");
+}
+
+publisher::~publisher() {}
+
+bool publisher::publish(uint32_t, const buffer_value*, size_t) {
+    return false;
+}
+
+size_t publisher::space() {
+    return 0;
+}
+
+size_t publisher::reap() {
+    return 0;
+}
+#else
+publisher::publisher(const std::string& name_, const config& cfg_)
+    : name(shm_name(name_)), cfg(cfg_), seg(nullptr), bytes(0), full_(0) {
+    if (cfg.blocks == 0 || cfg.block_words == 0 || cfg.subscribers == 0) {
+        throw error(error::code::invalid_value, "shm: invalid config: " + name);
+    }
+    bytes = segment_bytes(cfg);
+    /*
+     * A ring left by a publisher that did not exit cleanly is replaced.
+     */
+    ::shm_unlink(name.c_str());
+    int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0660);
+    if (fd < 0) {
+        throw error(error::code::file_create_failure,
+                    "shm: create: " + name + ": " + std::strerror(errno));
+    }
+    if (::ftruncate(fd, static_cast<off_t>(bytes)) < 0) {
+        auto err = errno;
+        ::close(fd);
+        ::shm_unlink(name.c_str());
+        throw error(error::code::file_create_failure,
+                    "shm: size: " + name + ": " + std::strerror(err));
+    }
+    void* addr = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    auto err = errno;
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        ::shm_unlink(name.c_str());
+        throw error(error::code::file_create_failure,
+                    "shm: map: " + name + ": " + std::strerror(err));
+    }
+    /*
+     * The new memory is zero so the slots are free and the blocks have
+     * no commit. The header is written before the magic is set.
+     */
+    seg = new (addr) segment;
+    seg->version = version;
+    seg->mode = static_cast<uint32_t>(cfg.mode);
+    seg->subscribers = static_cast<uint32_t>(cfg.subscribers);
+    seg->blocks = cfg.blocks;
+    seg->block_words = cfg.block_words;
+    seg->block_bytes = block_bytes(cfg.block_words);
+    seg->head.store(0);
+    seg->closed.store(0);
+    auto slot = slots(seg);
+    for (size_t s = 0; s < cfg.subscribers; ++s) {
+        new (&slot[s]) subscriber_slot;
+        slot[s].state.store(slot_free);
+    }
+    for (size_t b = 0; b < cfg.blocks; ++b) {
+        new (block_at(seg, b)) block_header;
+        block_at(seg, b)->commit.store(0);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    seg->magic = magic;
+    xia_log(log::info) << "shm: publish: " << name << " blocks=" << cfg.blocks
+                       << " block-words=" << cfg.block_words
+                       << " subscribers=" << cfg.subscribers
+                       << " lossless=" << std::boolalpha << (cfg.mode == policy::lossless);
+}
+
+publisher::~publisher() {
+    if (seg != nullptr) {
+        seg->closed.store(1, std::memory_order_release);
+        ::munmap(seg, bytes);
+        ::shm_unlink(name.c_str());
+        seg = nullptr;
+    }
+}
+
+bool publisher::publish(uint32_t source, const buffer_value* data, size_t words) {
+    const size_t pieces = std::max((words + cfg.block_words - 1) / cfg.block_words, size_t(1));
+    if (cfg.mode == policy::lossless) {
+        if (pieces > cfg.blocks) {
+            throw error(error::code::invalid_value,
+                        "shm: data larger than the ring: " + name + ": " + std::to_string(words));
+        }
+        if (space() < pieces) {
+            if (reap() == 0 || space() < pieces) {
+                ++full_;
+                return false;
+            }
+        }
+    }
+    uint64_t sequence = seg->head.load(std::memory_order_relaxed);
+    for (size_t piece = 0; piece < pieces; ++piece, ++sequence) {
+        const size_t count = std::min(words, cfg.block_words);
+        auto block = block_at(seg, sequence);
+        block->commit.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        block->source = source;
+        block->flags = piece + 1 < pieces ? uint32_t(block_view::continued) : uint32_t(0);
+        block->words = count;
+        if (count > 0) {
+            std::memcpy(reinterpret_cast<char*>(block) + sizeof(*block), data,
+                        count * sizeof(buffer_value));
+        }
+        block->commit.store(sequence + 1, std::memory_order_release);
+        seg->head.store(sequence + 1, std::memory_order_release);
+        data += count;
+        words -= count;
+    }
+    return true;
+}
+
+size_t publisher::space() {
+    if (cfg.mode == policy::lossy) {
+        return cfg.blocks;
+    }
+    const uint64_t head = seg->head.load(std::memory_order_relaxed);
+    uint64_t oldest = head;
+    auto slot = slots(seg);
+    for (size_t s = 0; s < cfg.subscribers; ++s) {
+        if (slot[s].state.load(std::memory_order_acquire) == slot_active) {
+            oldest = std::min(oldest, slot[s].cursor.load(std::memory_order_acquire));
+        }
+    }
+    return cfg.blocks - std::min(size_t(head - oldest), cfg.blocks);
+}
+
+size_t publisher::reap() {
+    size_t reaped = 0;
+    auto slot = slots(seg);
+    for (size_t s = 0; s < cfg.subscribers; ++s) {
+        if (slot[s].state.load(std::memory_order_acquire) == slot_active &&
+            !process_exists(slot[s].pid.load())) {
+            xia_log(log::warning) << "shm: " << name << ": reap subscriber: pid "
+                                  << slot[s].pid.load();
+            slot[s].state.store(slot_free, std::memory_order_release);
+            ++reaped;
+        }
+    }
+    return reaped;
+}
+#endif
+
+size_t publisher::publish(uint32_t source, queue::handles& buffers) {
+    size_t words = 0;
+    while (!buffers.empty()) {
+        auto& buf = *buffers.front();
+        if (!publish(source, buf.data(), buf.size())) {
+            break;
+        }
+        words += buf.size();
+        buffers.pop_front();
+    }
+    return words;
+}
+
+uint64_t publisher::sequence() const {
+    return seg == nullptr ? 0 : seg->head.load(std::memory_order_acquire);
+}
+
+size_t publisher::subscribers() const {
+    size_t count = 0;
+    if (seg != nullptr) {
+        auto slot = slots(seg);
+        for (size_t s = 0; s < cfg.subscribers; ++s) {
+            if (slot[s].state.load(std::memory_order_acquire) == slot_active) {
+                ++count;
+            }
+        }
+    }
+    return count;
+}
+
+#if defined(_WIN64) || defined(_WIN32)
+subscriber::subscriber(const std::string& name_)
+    : name(name_), seg(nullptr), bytes(0), slot(0) {
+    throw error(error::code::not_supported, "shm: not supported on Windows");
+}
+
+subscriber::~subscriber() {}
+
+bool subscriber::read(block_view&, size_t) {
+    return false;
+}
+
+bool subscriber::release(const block_view&) {
+    return false;
+}
+#else
+subscriber::subscriber(const std::string& name_)
+    : name(shm_name(name_)), seg(nullptr), bytes(0), slot(0) {
+    int fd = ::shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+        throw error(error::code::file_open_failure,
+                    "shm: open: " + name + ": " + std::strerror(errno));
+    }
+    struct stat st;
+    if (::fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(segment)) {
+        ::close(fd);
+        throw error(error::code::file_size_invalid, "shm: invalid ring: " + name);
+    }
+    bytes = static_cast<size_t>(st.st_size);
+    void* addr = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    auto err = errno;
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        throw error(error::code::file_open_failure,
+                    "shm: map: " + name + ": " + std::strerror(err));
+    }
+    seg = static_cast<segment*>(addr);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (seg->magic != magic || seg->version != version) {
+        ::munmap(seg, bytes);
+        throw error(error::code::file_size_invalid, "shm: invalid ring: " + name);
+    }
+    cfg.blocks = seg->blocks;
+    cfg.block_words = seg->block_words;
+    cfg.subscribers = seg->subscribers;
+    cfg.mode = static_cast<policy>(seg->mode);
+    if (segment_bytes(cfg) > bytes) {
+        ::munmap(seg, bytes);
+        throw error(error::code::file_size_invalid, "shm: invalid ring: " + name);
+    }
+    auto slot_ = slots(seg);
+    for (slot = 0; slot < cfg.subscribers; ++slot) {
+        uint32_t state = slot_free;
+        if (slot_[slot].state.compare_exchange_strong(state, slot_claiming)) {
+            slot_[slot].pid.store(static_cast<uint32_t>(::getpid()));
+            slot_[slot].dropped.store(0);
+            slot_[slot].cursor.store(seg->head.load(std::memory_order_acquire));
+            slot_[slot].state.store(slot_active, std::memory_order_release);
+            return;
+        }
+    }
+    ::munmap(seg, bytes);
+    throw error(error::code::invalid_value, "shm: no free subscriber slots: " + name);
+}
+
+subscriber::~subscriber() {
+    if (seg != nullptr) {
+        slots(seg)[slot].state.store(slot_free, std::memory_order_release);
+        ::munmap(seg, bytes);
+        seg = nullptr;
+    }
+}
+
+bool subscriber::read(block_view& view, size_t wait_usecs) {
+    auto& sub = slots(seg)[slot];
+    auto waited = std::chrono::steady_clock::now();
+    while (true) {
+        const uint64_t head = seg->head.load(std::memory_order_acquire);
+        uint64_t cursor = sub.cursor.load(std::memory_order_relaxed);
+        if (cursor < head) {
+            /*
+             * Skip the blocks that have been overwritten.
+             */
+            if (head - cursor > cfg.blocks) {
+                sub.dropped.fetch_add(head - cfg.blocks - cursor, std::memory_order_relaxed);
+                cursor = head - cfg.blocks;
+                sub.cursor.store(cursor, std::memory_order_release);
+            }
+            auto block = block_at(seg, cursor);
+            if (block->commit.load(std::memory_order_acquire) == cursor + 1) {
+                view.sequence = cursor;
+                view.source = block->source;
+                view.flags = block->flags;
+                view.words = static_cast<size_t>(block->words);
+                view.data = reinterpret_cast<const buffer_value*>(
+                    reinterpret_cast<const char*>(block) + sizeof(*block));
+                return true;
+            }
+            /*
+             * The block is being written by the publisher lapping the
+             * cursor.
+             */
+            sub.dropped.fetch_add(1, std::memory_order_relaxed);
+            sub.cursor.store(cursor + 1, std::memory_order_release);
+            continue;
+        }
+        if (seg->closed.load(std::memory_order_acquire) != 0) {
+            return false;
+        }
+        const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                                 std::chrono::steady_clock::now() - waited)
+                                 .count();
+        if (size_t(elapsed) >= wait_usecs) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(wait_poll_usecs));
+    }
+}
+
+bool subscriber::release(const block_view& view) {
+    auto& sub = slots(seg)[slot];
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const bool valid =
+        block_at(seg, view.sequence)->commit.load(std::memory_order_relaxed) == view.sequence + 1;
+    if (!valid) {
+        sub.dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (sub.cursor.load(std::memory_order_relaxed) == view.sequence) {
+        sub.cursor.store(view.sequence + 1, std::memory_order_release);
+    }
+    return valid;
+}
+#endif
+
+size_t subscriber::available() const {
+    const uint64_t head = seg->head.load(std::memory_order_acquire);
+    const uint64_t cursor = slots(seg)[slot].cursor.load(std::memory_order_relaxed);
+    return std::min(size_t(head - cursor), cfg.blocks);
+}
+
+uint64_t subscriber::dropped() const {
+    return slots(seg)[slot].dropped.load(std::memory_order_relaxed);
+}
+
+bool subscriber::closed() const {
+    return seg->closed.load(std::memory_order_acquire) != 0;
+}
+}  // namespace shm
+}  // namespace buffer
+}  // namespace xia
@@ -17,11 +17,15 @@
  */
 
 /** @file stats.cpp
- * @brief Implements functions and data structures related to hardware statistics.
+ * @brief Implements functions and data structures related to hardware statistics
+ * and streaming statistics accumulators.
  */
 
 #include <algorithm>
+#include <cmath>
+#include <limits>
 
+#include <pixie/error.hpp>
 #include <pixie/stats.hpp>
 
 #include <pixie/pixie16/memory.hpp>
@@ -112,34 +116,371 @@ void read(pixie::module::module& module_, stats& stats_) {
         param::get_descriptor(chan_descs, param::channel_var::ChanEventsB).address,
     };
 
-    const hw::address addr_low =
-        *std::min_element(addrs.begin(), addrs.end(), [](auto& a, auto& b) { return a < b; });
-    const hw::address addr_high =
-        *std::max_element(addrs.begin(), addrs.end(), [](auto& a, auto& b) { return a < b; });
-    const size_t words = addr_high - addr_low + module_.num_channels + 1;
+    /*
+     * The module and channel statistics are in separate regions of the DSP
+     * memory. Read each region's span in a single batch.
+     */
+    const auto mod_addrs = std::minmax_element(addrs.begin(), addrs.begin() + 4);
+    const auto chan_addrs = std::minmax_element(addrs.begin() + 4, addrs.end());
+    const hw::address mod_low = *mod_addrs.first;
+    const hw::address chan_low = *chan_addrs.first;
+    const size_t mod_words = *mod_addrs.second - mod_low + 1;
+    const size_t chan_words = *chan_addrs.second - chan_low + module_.num_channels;
 
     hw::memory::dsp dsp(module_);
-    hw::words vars(words);
+    hw::words mod_vars(mod_words);
+    hw::words chan_vars(chan_words);
 
-    dsp.read(addr_low, vars);
+    dsp.read({{mod_low, mod_vars.data(), mod_words}, {chan_low, chan_vars.data(), chan_words}});
 
-    stats_.mod.num_events_a = vars[addrs[0] - addr_low];
-    stats_.mod.num_events_b = vars[addrs[1] - addr_low];
-    stats_.mod.runtime_a = vars[addrs[2] - addr_low];
-    stats_.mod.runtime_b = vars[addrs[3] - addr_low];
+    stats_.mod.num_events_a = mod_vars[addrs[0] - mod_low];
+    stats_.mod.num_events_b = mod_vars[addrs[1] - mod_low];
+    stats_.mod.runtime_a = mod_vars[addrs[2] - mod_low];
+    stats_.mod.runtime_b = mod_vars[addrs[3] - mod_low];
 
     for (auto& channel : stats_.chans) {
         const auto index = channel.config.index;
-        channel.fast_peaks_a = vars[addrs[4] + index - addr_low];
-        channel.fast_peaks_b = vars[addrs[5] + index - addr_low];
-        channel.live_time_a = vars[addrs[6] + index - addr_low];
-        channel.live_time_b = vars[addrs[7] + index - addr_low];
-        channel.chan_events_a = vars[addrs[8] + index - addr_low];
-        channel.chan_events_b = vars[addrs[9] + index - addr_low];
+        channel.fast_peaks_a = chan_vars[addrs[4] + index - chan_low];
+        channel.fast_peaks_b = chan_vars[addrs[5] + index - chan_low];
+        channel.live_time_a = chan_vars[addrs[6] + index - chan_low];
+        channel.live_time_b = chan_vars[addrs[7] + index - chan_low];
+        channel.chan_events_a = chan_vars[addrs[8] + index - chan_low];
+        channel.chan_events_b = chan_vars[addrs[9] + index - chan_low];
         channel.runtime_a = stats_.mod.runtime_a;
         channel.runtime_b = stats_.mod.runtime_b;
     }
 }
+
+/*
+ * The difference of a counter between two reads. The counters restart
+ * from 0 when a new run starts.
+ */
+static uint64_t counter_delta(uint64_t from, uint64_t to, bool restarted) {
+    if (restarted || to < from) {
+        return to;
+    }
+    return to - from;
+}
+
+static double live_time_secs(uint64_t ticks, const hw::config& config) {
+    return double(ticks) * config.adc_clk_div * (1.0e-6 / config.adc_msps);
+}
+
+static double real_time_secs(uint64_t ticks) {
+    return double(ticks) * (1.0e-6 / hw::system_clock_mhz);
+}
+
+channel_interval::channel_interval()
+    : input_counts(0), output_counts(0), live_time(0), real_time(0) {}
+
+channel_interval::channel_interval(const channel& from, const channel& to) {
+    const uint64_t from_runtime = make_u64(from.runtime_a, from.runtime_b);
+    const uint64_t to_runtime = make_u64(to.runtime_a, to.runtime_b);
+    const bool restarted = to_runtime < from_runtime;
+    input_counts = double(counter_delta(make_u64(from.fast_peaks_a, from.fast_peaks_b),
+                                        make_u64(to.fast_peaks_a, to.fast_peaks_b), restarted));
+    output_counts =
+        double(counter_delta(make_u64(from.chan_events_a, from.chan_events_b),
+                             make_u64(to.chan_events_a, to.chan_events_b), restarted));
+    live_time = live_time_secs(counter_delta(make_u64(from.live_time_a, from.live_time_b),
+                                             make_u64(to.live_time_a, to.live_time_b),
+                                             restarted),
+                               to.config);
+    real_time = real_time_secs(counter_delta(from_runtime, to_runtime, restarted));
+}
+
+double channel_interval::input_count_rate() const {
+    if (live_time == 0.0) {
+        return 0.0;
+    }
+    return input_counts / live_time;
+}
+
+double channel_interval::output_count_rate() const {
+    if (real_time == 0.0) {
+        return 0.0;
+    }
+    return output_counts / real_time;
+}
+
+double channel_interval::live_fraction() const {
+    if (real_time == 0.0) {
+        return 0.0;
+    }
+    return live_time / real_time;
+}
+
+interval::interval() : processed_events(0), real_time(0) {}
+
+interval::interval(const stats& from, const stats& to) {
+    if (from.chans.size() != to.chans.size()) {
+        throw error::error(error::code::invalid_value, "stats: interval channels do not match");
+    }
+    const uint64_t from_runtime = make_u64(from.mod.runtime_a, from.mod.runtime_b);
+    const uint64_t to_runtime = make_u64(to.mod.runtime_a, to.mod.runtime_b);
+    const bool restarted = to_runtime < from_runtime;
+    processed_events = counter_delta(from.mod.processed_events(), to.mod.processed_events(),
+                                     restarted);
+    real_time = real_time_secs(counter_delta(from_runtime, to_runtime, restarted));
+    chans.reserve(to.chans.size());
+    for (size_t channel = 0; channel < to.chans.size(); ++channel) {
+        chans.emplace_back(from.chans[channel], to.chans[channel]);
+    }
+}
+
+snapshot::snapshot() : sequence(0), skew(0) {}
+
+double snapshot::elapsed(const snapshot& earlier) const {
+    return std::chrono::duration<double>(time - earlier.time).count();
+}
+
+snapshots::snapshots(size_t depth) : slots(std::max(depth, size_t(2))) {
+    clear();
+}
+
+void snapshots::push(snapshot& snap) {
+    snap.sequence = ++pushed;
+    slots[next] = snap;
+    next = (next + 1) % slots.size();
+    count = std::min(count + 1, slots.size());
+}
+
+void snapshots::clear() {
+    next = 0;
+    count = 0;
+    pushed = 0;
+}
+
+const snapshot& snapshots::at(size_t age) const {
+    if (age >= count) {
+        throw error::error(error::code::invalid_value, "stats: no snapshot of that age");
+    }
+    return slots[(next + slots.size() - 1 - age) % slots.size()];
+}
+
+void snapshots::rates(intervals& out, size_t age) const {
+    const snapshot& newest = at(0);
+    const snapshot& earlier = at(age);
+    if (newest.numbers != earlier.numbers) {
+        throw error::error(error::code::invalid_value, "stats: snapshots' modules do not match");
+    }
+    out.clear();
+    out.reserve(newest.modules.size());
+    for (size_t m = 0; m < newest.modules.size(); ++m) {
+        out.emplace_back(earlier.modules[m], newest.modules[m]);
+    }
+}
+
+moments::moments() {
+    clear();
+}
+
+void moments::clear() {
+    count = 0;
+    mean = 0;
+    min = std::numeric_limits<double>::max();
+    max = std::numeric_limits<double>::lowest();
+    m2 = 0;
+}
+
+void moments::update(double value) {
+    ++count;
+    const double delta = value - mean;
+    mean += delta / double(count);
+    m2 += delta * (value - mean);
+    min = std::min(min, value);
+    max = std::max(max, value);
+}
+
+void moments::merge(const moments& other) {
+    if (other.count == 0) {
+        return;
+    }
+    if (count == 0) {
+        *this = other;
+        return;
+    }
+    const double total = double(count + other.count);
+    const double delta = other.mean - mean;
+    mean += delta * double(other.count) / total;
+    m2 += other.m2 + delta * delta * double(count) * double(other.count) / total;
+    count += other.count;
+    min = std::min(min, other.min);
+    max = std::max(max, other.max);
+}
+
+double moments::variance() const {
+    if (count < 2) {
+        return 0;
+    }
+    return m2 / double(count - 1);
+}
+
+double moments::stddev() const {
+    return std::sqrt(variance());
+}
+
+quantile::quantile(double p_) : p(p_) {
+    clear();
+}
+
+void quantile::clear() {
+    count_ = 0;
+    heights.fill(0);
+    positions = {{0, 1, 2, 3, 4}};
+    desired = {{0, 2 * p, 4 * p, 2 + 2 * p, 4}};
+    increments = {{0, p / 2, p, (1 + p) / 2, 1}};
+}
+
+void quantile::update(double value) {
+    /*
+     * The first 5 values are the markers' heights.
+     */
+    if (count_ < heights.size()) {
+        heights[count_++] = value;
+        if (count_ == heights.size()) {
+            std::sort(heights.begin(), heights.end());
+        }
+        return;
+    }
+    ++count_;
+    size_t cell;
+    if (value < heights[0]) {
+        heights[0] = value;
+        cell = 0;
+    } else if (value >= heights[4]) {
+        heights[4] = value;
+        cell = 3;
+    } else {
+        cell = 0;
+        while (value >= heights[cell + 1]) {
+            ++cell;
+        }
+    }
+    for (size_t i = cell + 1; i < positions.size(); ++i) {
+        positions[i] += 1;
+    }
+    for (size_t i = 0; i < desired.size(); ++i) {
+        desired[i] += increments[i];
+    }
+    /*
+     * Move the middle markers that are off their desired positions by a
+     * position if it does not overtake a neighbour.
+     */
+    for (size_t i = 1; i < 4; ++i) {
+        const double d = desired[i] - positions[i];
+        if ((d >= 1 && positions[i + 1] - positions[i] > 1) ||
+            (d <= -1 && positions[i - 1] - positions[i] < -1)) {
+            const int step = d < 0 ? -1 : 1;
+            double height = parabolic(i, step);
+            if (height <= heights[i - 1] || height >= heights[i + 1]) {
+                height = linear(i, step);
+            }
+            heights[i] = height;
+            positions[i] += step;
+        }
+    }
+}
+
+double quantile::value() const {
+    if (count_ == 0) {
+        return 0;
+    }
+    if (count_ < heights.size()) {
+        std::array<double, 5> sorted = heights;
+        std::sort(sorted.begin(), sorted.begin() + count_);
+        const auto index = size_t(std::lround(p * double(count_ - 1)));
+        return sorted[index];
+    }
+    return heights[2];
+}
+
+double quantile::parabolic(size_t i, double d) const {
+    return heights[i] +
+        d / (positions[i + 1] - positions[i - 1]) *
+        ((positions[i] - positions[i - 1] + d) * (heights[i + 1] - heights[i]) /
+             (positions[i + 1] - positions[i]) +
+         (positions[i + 1] - positions[i] - d) * (heights[i] - heights[i - 1]) /
+             (positions[i] - positions[i - 1]));
+}
+
+double quantile::linear(size_t i, int d) const {
+    const size_t n = d < 0 ? i - 1 : i + 1;
+    return heights[i] + d * (heights[n] - heights[i]) / (positions[n] - positions[i]);
+}
+
+histogram::histogram(double low_, double high_, size_t num_bins)
+    : low(low_), high(high_), width(num_bins > 0 ? (high_ - low_) / double(num_bins) : 0),
+      counts(num_bins) {
+    if (num_bins == 0 || !(high > low)) {
+        throw error::error(error::code::invalid_value, "stats: histogram: invalid range or bins");
+    }
+    clear();
+}
+
+void histogram::clear() {
+    std::fill(counts.begin(), counts.end(), 0);
+    underflow = 0;
+    overflow = 0;
+    total = 0;
+}
+
+void histogram::update(double value, size_t count) {
+    total += count;
+    if (value < low) {
+        underflow += count;
+    } else if (value >= high) {
+        overflow += count;
+    } else {
+        const auto bin = std::min(size_t((value - low) / width), counts.size() - 1);
+        counts[bin] += count;
+    }
+}
+
+double histogram::bin_low(size_t bin) const {
+    return low + double(bin) * width;
+}
+
+double histogram::quantile(double p) const {
+    if (total == 0) {
+        return 0;
+    }
+    const double rank = p * double(total);
+    double seen = double(underflow);
+    if (rank <= seen) {
+        return low;
+    }
+    for (size_t bin = 0; bin < counts.size(); ++bin) {
+        const double in_bin = double(counts[bin]);
+        if (in_bin > 0 && rank <= seen + in_bin) {
+            return bin_low(bin) + width * (rank - seen) / in_bin;
+        }
+        seen += in_bin;
+    }
+    return high;
+}
+
+baseline_noise::baseline_noise() : last(0) {}
+
+void baseline_noise::clear() {
+    values.clear();
+    diffs.clear();
+    median.clear();
+    last = 0;
+}
+
+void baseline_noise::update(double baseline) {
+    if (values.count > 0) {
+        diffs.update(baseline - last);
+    }
+    last = baseline;
+    values.update(baseline);
+    median.update(baseline);
+}
+
+double baseline_noise::noise() const {
+    return std::sqrt(diffs.variance() / 2);
+}
 }  // namespace stats
 }  // namespace pixie
 }  // namespace xia
@@ -30,6 +30,20 @@
 #include <sstream>
 #include <stdexcept>
 
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PIXIE_UTIL_SSE2 1
+#endif
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 #include <pixie/error.hpp>
 #include <pixie/util.hpp>
 
@@ -82,6 +96,19 @@ void trim(std::string& s) {
     rtrim(s);
 }
 
+bool host_little_endian() {
+#if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__)
+    return __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+#elif defined(_WIN32)
+    return true;
+#else
+    const uint32_t word = 1;
+    uint8_t first;
+    std::memcpy(&first, &word, 1);
+    return first == 1;
+#endif
+}
+
 timepoint::timepoint(bool autostart)
     : active(false), suspended(false), captured(false), locked(false) {
     if (autostart) {
@@ -257,14 +284,84 @@ bool ieee_float::operator==(const value_type num) const {
 }
 
 ieee_float::operator double() const {
-    return out();
+    return out(value);
 }
 
 ieee_float::operator value_type() const {
     return value;
 }
 
-ieee_float::value_type ieee_float::in(const double dec_num) const {
+void ieee_float::to_doubles(const value_type* values, double* doubles, const size_t count) {
+    size_t v = 0;
+#if PIXIE_UTIL_SSE2
+    /*
+     * Four values at a time if they are all normal numbers.
+     */
+    const __m128i exp_mask = _mm_set1_epi32(0x7F800000);
+    const __m128i zero = _mm_setzero_si128();
+    for (; v + 4 <= count; v += 4) {
+        const __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + v));
+        const __m128i exp = _mm_and_si128(words, exp_mask);
+        const __m128i special =
+            _mm_or_si128(_mm_cmpeq_epi32(exp, zero), _mm_cmpeq_epi32(exp, exp_mask));
+        if (_mm_movemask_epi8(special) == 0) {
+            const __m128 floats = _mm_castsi128_ps(words);
+            _mm_storeu_pd(doubles + v, _mm_cvtps_pd(floats));
+            _mm_storeu_pd(doubles + v + 2, _mm_cvtps_pd(_mm_movehl_ps(floats, floats)));
+        } else {
+            for (size_t s = v; s < v + 4; ++s) {
+                doubles[s] = out(values[s]);
+            }
+        }
+    }
+#endif
+    for (; v < count; ++v) {
+        doubles[v] = out(values[v]);
+    }
+}
+
+void ieee_float::to_values(const double* doubles, value_type* values, const size_t count) {
+    for (size_t v = 0; v < count; ++v) {
+        values[v] = in(doubles[v]);
+    }
+}
+
+ieee_float::value_type ieee_float::in(const double dec_num) {
+    /*
+     * A double's exponent from -9 to 22 is truncated to the single format
+     * by the bits. The exponent is rebiased from 1023 to 127 and the low 29
+     * bits of the mantissa are dropped.
+     */
+    static_assert(sizeof(double) == sizeof(uint64_t), "double is not 64 bits");
+    uint64_t bits;
+    std::memcpy(&bits, &dec_num, sizeof(bits));
+    const auto exponent = int((bits >> 52) & 0x7FF) - 1023;
+    if (exponent >= -9 && exponent <= 22) {
+        const auto sign = value_type(bits >> 63) << 31;
+        const auto magnitude =
+            ((bits & 0x7FFFFFFFFFFFFFFFULL) >> 29) - (uint64_t(1023 - 127) << 23);
+        return sign | value_type(magnitude);
+    }
+    return in_bitwise(dec_num);
+}
+
+double ieee_float::out(const value_type value_) {
+    /*
+     * Normal numbers are a copy of the bits. A zero exponent is not a zero
+     * or a subnormal number and a maximum exponent is not an infinity or a
+     * NaN in the original conversion.
+     */
+    static_assert(sizeof(float) == sizeof(value_type), "float is not 32 bits");
+    const auto exponent = value_ & 0x7F800000;
+    if (exponent != 0 && exponent != 0x7F800000) {
+        float single;
+        std::memcpy(&single, &value_, sizeof(single));
+        return double(single);
+    }
+    return out_bitwise(value_);
+}
+
+ieee_float::value_type ieee_float::in_bitwise(const double dec_num) {
     if (dec_num == 0) {
         return 0;
     }
@@ -358,7 +455,7 @@ ieee_float::value_type ieee_float::in(const double dec_num) const {
     return result;
 }
 
-double ieee_float::out() const {
+double ieee_float::out_bitwise(const value_type value) {
     auto signbit = static_cast<short>(value >> 31);
     auto exponent = static_cast<short>(((value & 0x7F800000) >> 23) - 127);
     double mantissa = 1.0 + ((double(value & 0x7FFFFF) / double(1 << 23)));
@@ -403,11 +500,58 @@ crc32::operator const std::string() const {
     return oss.str();
 }
 
+/*
+ * Slice-by-8 tables. Table 0 is the bytewise table and table N is the CRC
+ * of a byte followed by N zero bytes.
+ */
+struct crc32_slices {
+    crc32::value_type table[8][256];
+    crc32_slices(const crc32::value_type* base) {
+        for (size_t b = 0; b < 256; ++b) {
+            table[0][b] = base[b];
+        }
+        for (size_t b = 0; b < 256; ++b) {
+            for (size_t s = 1; s < 8; ++s) {
+                const auto prev = table[s - 1][b];
+                table[s][b] = (prev >> 8) ^ table[0][prev & 0xff];
+            }
+        }
+    }
+};
+
 void crc32::update(const unsigned char* data, int len) {
+    size_t remaining = len < 0 ? 0 : static_cast<size_t>(len);
     value = ~value;
-    while (len-- != 0) {
+#if defined(__ARM_FEATURE_CRC32)
+    /*
+     * ARMv8 has CRC32 instructions for this polynomial.
+     */
+    while (remaining >= 8) {
+        uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        value = __crc32d(value, word);
+        data += 8;
+        remaining -= 8;
+    }
+    while (remaining-- != 0) {
+        value = __crc32b(value, *data++);
+    }
+#else
+    static const crc32_slices slices(table);
+    const auto& t = slices.table;
+    while (remaining >= 8) {
+        const uint32_t one = value ^ (uint32_t(data[0]) | (uint32_t(data[1]) << 8) |
+                                      (uint32_t(data[2]) << 16) | (uint32_t(data[3]) << 24));
+        value = t[7][one & 0xff] ^ t[6][(one >> 8) & 0xff] ^ t[5][(one >> 16) & 0xff] ^
+                t[4][one >> 24] ^ t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^
+                t[0][data[7]];
+        data += 8;
+        remaining -= 8;
+    }
+    while (remaining-- != 0) {
         value = table[(value ^ *data++) & 0xff] ^ (value >> 8);
     }
+#endif
     value = ~value;
 }
 
@@ -450,6 +594,205 @@ const crc32::value_type crc32::table[256] = {
     0xcdd70693L, 0x54de5729L, 0x23d967bfL, 0xb3667a2eL, 0xc4614ab8L, 0x5d681b02L, 0x2a6f2b94L,
     0xb40bbe37L, 0xc30c8ea1L, 0x5a05df1bL, 0x2d02ef8dUL};
 
+void parse_cpu_list(cpus& set, const std::string& list) {
+    set.clear();
+    strings ranges;
+    split(ranges, list, ',');
+    for (auto& range : ranges) {
+        if (range.empty()) {
+            continue;
+        }
+        try {
+            auto dash = range.find('-');
+            int first = std::stoi(range.substr(0, dash));
+            int last = first;
+            if (dash != std::string::npos) {
+                last = std::stoi(range.substr(dash + 1));
+            }
+            if (first < 0 || last < first) {
+                throw std::invalid_argument(range);
+            }
+            for (int cpu = first; cpu <= last; ++cpu) {
+                set.push_back(cpu);
+            }
+        } catch (std::logic_error&) {
+            throw std::runtime_error("invalid CPU list: " + list);
+        }
+    }
+}
+
+std::string cpu_list(const cpus& set) {
+    std::ostringstream oss;
+    const char* sep = "";
+    for (size_t c = 0; c < set.size();) {
+        size_t last = c;
+        while (last + 1 < set.size() && set[last + 1] == set[last] + 1) {
+            ++last;
+        }
+        oss << sep << set[c];
+        if (last != c) {
+            oss << '-' << set[last];
+        }
+        sep = ",";
+        c = last + 1;
+    }
+    return oss.str();
+}
+
+#if defined(__linux__)
+static bool set_native_affinity(pthread_t thread, const cpus& set) {
+    if (set.empty()) {
+        return false;
+    }
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (auto cpu : set) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &cpu_set);
+        }
+    }
+    return ::pthread_setaffinity_np(thread, sizeof(cpu_set), &cpu_set) == 0;
+}
+#endif
+
+bool set_thread_affinity(std::thread& thread, const cpus& set) {
+#if defined(__linux__)
+    return thread.joinable() && set_native_affinity(thread.native_handle(), set);
+#else
+    (void) thread;
+    (void) set;
+    return false;
+#endif
+}
+
+bool set_thread_affinity(const cpus& set) {
+#if defined(__linux__)
+    return set_native_affinity(::pthread_self(), set);
+#else
+    (void) set;
+    return false;
+#endif
+}
+
+bool set_thread_scheduling(std::thread& thread, sched_policy policy, int priority) {
+#if defined(__linux__)
+    if (!thread.joinable()) {
+        return false;
+    }
+    int native_policy = SCHED_OTHER;
+    switch (policy) {
+        case sched_policy::fifo:
+            native_policy = SCHED_FIFO;
+            break;
+        case sched_policy::round_robin:
+            native_policy = SCHED_RR;
+            break;
+        case sched_policy::other:
+        default:
+            priority = 0;
+            break;
+    }
+    sched_param param;
+    std::memset(&param, 0, sizeof(param));
+    param.sched_priority = priority;
+    return ::pthread_setschedparam(thread.native_handle(), native_policy, &param) == 0;
+#else
+    (void) thread;
+    (void) policy;
+    (void) priority;
+    return false;
+#endif
+}
+
+size_t thread_cpu_usecs(std::thread& thread) {
+#if defined(__linux__)
+    if (!thread.joinable()) {
+        return 0;
+    }
+    clockid_t clock;
+    struct timespec ts;
+    if (::pthread_getcpuclockid(thread.native_handle(), &clock) != 0 ||
+        ::clock_gettime(clock, &ts) != 0) {
+        return 0;
+    }
+    return size_t(ts.tv_sec) * 1000000 + size_t(ts.tv_nsec) / 1000;
+#else
+    (void) thread;
+    return 0;
+#endif
+}
+
+thread_pool::worker::worker() : finish(false) {}
+
+void thread_pool::worker::run() {
+    while (true) {
+        std::packaged_task<void()> work;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [this] { return finish || !tasks.empty(); });
+            if (tasks.empty()) {
+                return;
+            }
+            work = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        work();
+    }
+}
+
+thread_pool::thread_pool() {}
+
+thread_pool::~thread_pool() {
+    stop();
+}
+
+void thread_pool::start(size_t workers_, const affinities& affinity) {
+    stop();
+    for (size_t w = 0; w < workers_; ++w) {
+        workers.emplace_back(new worker);
+        auto& wkr = *workers.back();
+        wkr.thread = std::thread(&worker::run, &wkr);
+        if (w < affinity.size() && !affinity[w].empty()) {
+            /*
+             * Pinning is a performance hint, a worker that cannot be pinned
+             * still runs.
+             */
+            set_thread_affinity(wkr.thread, affinity[w]);
+        }
+    }
+}
+
+void thread_pool::stop() {
+    for (auto& wkr : workers) {
+        {
+            std::lock_guard<std::mutex> guard(wkr->lock);
+            wkr->finish = true;
+        }
+        wkr->wake.notify_one();
+    }
+    for (auto& wkr : workers) {
+        if (wkr->thread.joinable()) {
+            wkr->thread.join();
+        }
+    }
+    workers.clear();
+}
+
+std::future<void> thread_pool::submit(size_t worker_, task work) {
+    if (workers.empty()) {
+        throw std::runtime_error("thread pool not running");
+    }
+    auto& wkr = *workers[worker_ % workers.size()];
+    std::packaged_task<void()> queued(std::move(work));
+    auto future = queued.get_future();
+    {
+        std::lock_guard<std::mutex> guard(wkr.lock);
+        wkr.tasks.push_back(std::move(queued));
+    }
+    wkr.wake.notify_one();
+    return future;
+}
+
 }  // namespace util
 }  // namespace xia
 
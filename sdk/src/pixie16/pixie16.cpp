@@ -21,12 +21,17 @@
  */
 
 #include <bitset>
+#include <cstdlib>
 #include <cstring>
+#include <memory>
+#include <mutex>
 
 #include <pixie16/pixie16.h>
 
 #include <pixie/config.hpp>
+#include <pixie/eeprom.hpp>
 #include <pixie/error.hpp>
+#include <pixie/fft.hpp>
 #include <pixie/log.hpp>
 #include <pixie/os_compat.hpp>
 #include <pixie/stats.hpp>
@@ -35,6 +40,9 @@
 #include <pixie/pixie16/crate.hpp>
 #include <pixie/pixie16/legacy.hpp>
 #include <pixie/pixie16/run.hpp>
+#if defined(PIXIE16_API_SIM)
+#include <pixie/pixie16/sim.hpp>
+#endif
 
 /*
  * Local types for convenience.
@@ -73,8 +81,20 @@ typedef stats_legacy* stats_legacy_ptr;
 
 /*
  * The crate. We only handle a single crate with the legacy API.
+ *
+ * A test tool built with PIXIE16_API_SIM defined compiles the API into its
+ * executable and a module definitions file in the environment selects the
+ * simulated crate. The API library is not built with it.
  */
+#if defined(PIXIE16_API_SIM)
+static xia::pixie::crate::crate hw_crate;
+static xia::pixie::sim::crate sim_crate;
+static const char* sim_module_defs = std::getenv("PIXIE16_SIM_MODULE_DEFS");
+static xia::pixie::crate::crate& crate =
+    sim_module_defs != nullptr ? static_cast<xia::pixie::crate::crate&>(sim_crate) : hw_crate;
+#else
 static xia::pixie::crate::crate crate;
+#endif
 
 stats_legacy::stats_legacy(const xia::pixie::hw::configs& configs)
     : marker_1(mark_1), marker_2(mark_2) {
@@ -89,6 +109,22 @@ void stats_legacy::validate() const {
     }
 }
 
+static xia::pixie::param::channel_param chan_par_handle(unsigned int handle) {
+    if (handle >= static_cast<unsigned int>(xia::pixie::param::channel_param::END)) {
+        throw xia_error(xia_error::code::channel_invalid_param,
+                        "invalid channel parameter handle: " + std::to_string(handle));
+    }
+    return static_cast<xia::pixie::param::channel_param>(handle);
+}
+
+static xia::pixie::param::module_param mod_par_handle(unsigned int handle) {
+    if (handle >= static_cast<unsigned int>(xia::pixie::param::module_param::END)) {
+        throw xia_error(xia_error::code::module_invalid_param,
+                        "invalid module parameter handle: " + std::to_string(handle));
+    }
+    return static_cast<xia::pixie::param::module_param>(handle);
+}
+
 static int not_supported() {
     return xia::pixie::error::return_code_not_supported();
 }
@@ -136,6 +172,19 @@ T test_bit(const std::string& name, unsigned short& bit, T value) {
     return false;
 }
 
+/*
+ * The polling and readout calls use the non-throwing module calls so
+ * routine results, for example an offline module, are not exceptions.
+ * Returns the code as an API return code.
+ */
+static int poll_result(const char* label, xia::pixie::error::code code) {
+    if (code == xia::pixie::error::code::success) {
+        return 0;
+    }
+    xia_log(xia::log::error) << label << ": " << xia::pixie::error::api_result_text(code);
+    return xia::pixie::error::return_code(xia::pixie::error::api_result(code));
+}
+
 PIXIE_EXPORT unsigned short PIXIE_API APP16_TstBit(unsigned short bit, unsigned short value) {
     return test_bit("APP16_TstBit", bit, value);
 }
@@ -326,10 +375,7 @@ PIXIE_EXPORT int PIXIE_API Pixie16AdjustOffsets(unsigned short ModNum) {
     try {
         crate.ready();
         if (ModNum == crate.num_modules) {
-            for (size_t mod_num = 0; mod_num < crate.num_modules; mod_num++) {
-                xia::pixie::crate::module_handle module(crate, mod_num);
-                module->adjust_offsets();
-            }
+            crate.adjust_offsets();
         } else {
             xia::pixie::crate::module_handle module(crate, ModNum);
             module->adjust_offsets();
@@ -497,27 +543,19 @@ PIXIE_EXPORT int PIXIE_API Pixie16CheckExternalFIFOStatus(unsigned int* nFIFOWor
                                                           unsigned short ModNum) {
     xia_log(xia::log::debug) << "Pixie16CheckExternalFIFOStatus: ModNum=" << ModNum;
 
-    int result = 0;
+    if (nFIFOWords == nullptr) {
+        return poll_result("Pixie16CheckExternalFIFOStatus", xia_error::code::invalid_value);
+    }
 
-    try {
-        crate.ready();
-        xia::pixie::crate::module_handle module(crate, ModNum);
-        *nFIFOWords = static_cast<unsigned int>(module->read_list_mode_level());
-    } catch (xia_error& e) {
-        xia_log(xia::log::error) << e;
-        return e.return_code();
-    } catch (std::bad_alloc& e) {
-        xia_log(xia::log::error) << "bad allocation: " << e.what();
-        return xia::pixie::error::return_code_bad_alloc_error();
-    } catch (std::exception& e) {
-        xia_log(xia::log::error) << "unknown error: " << e.what();
-        return xia::pixie::error::return_code_unknown_error();
-    } catch (...) {
-        xia_log(xia::log::error) << "unknown error: unhandled exception";
-        return xia::pixie::error::return_code_unknown_error();
+    xia::pixie::crate::module_poll_handle module(crate, ModNum);
+    auto result = module.result;
+    if (module) {
+        size_t level = 0;
+        result = module->read_list_mode_level(level, std::nothrow);
+        *nFIFOWords = static_cast<unsigned int>(level);
     }
 
-    return result;
+    return poll_result("Pixie16CheckExternalFIFOStatus", result);
 }
 
 PIXIE_EXPORT int PIXIE_API Pixie16CheckRunStatus(unsigned short ModNum) {
@@ -801,6 +839,48 @@ PIXIE_EXPORT int PIXIE_API Pixie16CopyDSPParameters(unsigned short BitMask,
     return 0;
 }
 
+PIXIE_EXPORT int PIXIE_API Pixie16complexFFT(double* data, unsigned int length) {
+    xia_log(xia::log::debug) << "Pixie16complexFFT: length=" << length;
+
+    /*
+     * The last length's plan is kept for repeated calls.
+     */
+    static std::mutex plan_lock;
+    static std::shared_ptr<xia::pixie::fft::plan> plan;
+
+    try {
+        if (data == nullptr) {
+            throw xia_error(xia_error::code::invalid_value, "data pointer is NULL");
+        }
+        std::shared_ptr<xia::pixie::fft::plan> fft;
+        {
+            std::lock_guard<std::mutex> guard(plan_lock);
+            if (!plan || plan->length() != length) {
+                plan = std::make_shared<xia::pixie::fft::plan>(length);
+            }
+            fft = plan;
+        }
+        /*
+         * The legacy transform's exponent is positive.
+         */
+        fft->inverse(reinterpret_cast<xia::pixie::fft::value*>(data));
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (std::exception& e) {
+        xia_log(xia::log::error) << "unknown error: " << e.what();
+        return xia::pixie::error::return_code_unknown_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+
+    return 0;
+}
+
 PIXIE_EXPORT int PIXIE_API Pixie16LoadDSPParametersFromFile(const char* FileName) {
     xia_log(xia::log::debug) << "Pixie16LoadDSPParametersFromFile: FileName=" << FileName;
 
@@ -833,10 +913,7 @@ PIXIE_EXPORT int PIXIE_API Pixie16EndRun(unsigned short ModNum) {
     try {
         crate.ready();
         if (ModNum == crate.num_modules) {
-            for (size_t mod_num = 0; mod_num < crate.num_modules; mod_num++) {
-                xia::pixie::crate::module_handle module(crate, mod_num);
-                module->run_end();
-            }
+            crate.end_run();
         } else {
             xia::pixie::crate::module_handle module(crate, ModNum);
             module->run_end();
@@ -869,6 +946,15 @@ PIXIE_EXPORT int PIXIE_API Pixie16ExitSystem(unsigned short ModNum) {
                                                         xia::pixie::crate::module_handle::present);
                 module->close();
             }
+#if defined(PIXIE16_API_SIM)
+            /*
+             * Remove the simulated modules so their FIFO services stop
+             * before the process exits.
+             */
+            if (sim_module_defs != nullptr) {
+                crate.shutdown();
+            }
+#endif
         } else {
             xia::pixie::crate::module_handle module(crate, ModNum,
                                                     xia::pixie::crate::module_handle::present);
@@ -910,9 +996,42 @@ PIXIE_EXPORT int PIXIE_API Pixie16InitSystem(unsigned short NumModules, unsigned
             log_level = xia::log::error;
         }
     }
-    xia::logging::start("log", "Pixie16Msg.log", true);
+    /*
+     * A log queue size makes the log asynchronous so logging does not block
+     * the FIFO workers on file I/O.
+     */
+    size_t log_queue = 0;
+    const char* env_log_queue = std::getenv("PIXIE16_LOG_QUEUE");
+    if (env_log_queue != nullptr) {
+        log_queue = std::strtoul(env_log_queue, nullptr, 0);
+    }
+    xia::logging::start("log", "Pixie16Msg.log", true, log_queue);
     xia::logging::set_level(log_level);
 
+    /*
+     * The category levels, for example "bus=debug".
+     */
+    const char* env_log_categories = std::getenv("PIXIE16_LOG_CATEGORIES");
+    if (env_log_categories != nullptr) {
+        try {
+            xia::logging::set_levels(env_log_categories);
+        } catch (xia_error& e) {
+            xia_log(xia::log::warning) << "PIXIE16_LOG_CATEGORIES: " << e.what();
+        }
+    }
+
+    /*
+     * A host cache of the modules' EEPROM contents shortens the probe.
+     */
+    const char* env_eeprom_cache = std::getenv("PIXIE16_EEPROM_CACHE");
+    if (env_eeprom_cache != nullptr) {
+        try {
+            xia::pixie::eeprom::cache_open(env_eeprom_cache);
+        } catch (xia_error& e) {
+            xia_log(xia::log::warning) << "PIXIE16_EEPROM_CACHE: " << e.what();
+        }
+    }
+
     xia_log(xia::log::info) << "Pixie16InitSystem: NumModules=" << NumModules
                            << " PXISlotMap=" << PXISlotMap << " OfflineMode=" << OfflineMode;
 
@@ -932,6 +1051,14 @@ PIXIE_EXPORT int PIXIE_API Pixie16InitSystem(unsigned short NumModules, unsigned
             numbers.push_back(number_slot(i, PXISlotMap[i]));
         }
 
+#if defined(PIXIE16_API_SIM)
+        if (sim_module_defs != nullptr) {
+            xia_log(xia::log::info) << "Pixie16InitSystem: simulate: " << sim_module_defs;
+            xia::pixie::sim::mod_defs.clear();
+            xia::pixie::sim::load_module_defs(sim_module_defs);
+        }
+#endif
+
         crate.initialize();
 
         if (crate.modules.size() == 0) {
@@ -996,20 +1123,145 @@ PIXIE_EXPORT int PIXIE_API Pixie16ReadDataFromExternalFIFO(unsigned int* ExtFIFO
     xia_log(xia::log::debug) << "Pixie16ReadDataFromExternalFIFO: ModNum=" << ModNum
                             << " nFIFOWords=" << nFIFOWords;
 
-    try {
-        crate.ready();
-        xia::pixie::crate::module_handle module(crate, ModNum);
+    if (ExtFIFO_Data == nullptr) {
+        return poll_result("Pixie16ReadDataFromExternalFIFO", xia_error::code::invalid_value);
+    }
 
-        xia::pixie::hw::words data(nFIFOWords);
-        auto copied = module->read_list_mode(data);
-        if (copied != nFIFOWords) {
+    xia::pixie::crate::module_poll_handle module(crate, ModNum);
+    auto result = module.result;
+    if (module) {
+        size_t copied = 0;
+        result = module->read_list_mode(ExtFIFO_Data, nFIFOWords, copied, std::nothrow);
+        if (result == xia_error::code::success && copied != nFIFOWords) {
             xia_log(xia::log::error)
                 << "Failed to read FIFO words, requested nFIFOWords (" << nFIFOWords
                 << "), copied " << copied << " for Module " << ModNum
                 << ". Remaining values filled with zero.";
+            std::fill(ExtFIFO_Data + copied, ExtFIFO_Data + nFIFOWords, 0);
+        }
+    }
+
+    return poll_result("Pixie16ReadDataFromExternalFIFO", result);
+}
+
+PIXIE_EXPORT int PIXIE_API PixieReadListModeBuffer(unsigned int** Data, unsigned int* NumWords,
+                                                   void** Buffer, unsigned short ModNum) {
+    xia_log(xia::log::debug) << "PixieReadListModeBuffer: ModNum=" << ModNum;
+
+    if (Data == nullptr || NumWords == nullptr || Buffer == nullptr) {
+        return poll_result("PixieReadListModeBuffer", xia_error::code::invalid_value);
+    }
+
+    *Data = nullptr;
+    *NumWords = 0;
+    *Buffer = nullptr;
+
+    xia::pixie::crate::module_poll_handle module(crate, ModNum);
+    auto result = module.result;
+    if (module) {
+        xia::buffer::queue::handles buffers;
+        size_t words = 0;
+        result = module->read_list_mode(buffers, 1, words, std::nothrow);
+        if (result == xia_error::code::success && words > 0) {
+            auto buf = new (std::nothrow) xia::buffer::handle(buffers.front());
+            if (buf == nullptr) {
+                result = xia_error::code::bad_allocation;
+            } else {
+                *Data = (*buf)->data();
+                *NumWords = static_cast<unsigned int>((*buf)->size());
+                *Buffer = buf;
+            }
+        }
+    }
+
+    return poll_result("PixieReadListModeBuffer", result);
+}
+
+PIXIE_EXPORT int PIXIE_API PixieReleaseListModeBuffer(void* Buffer) {
+    xia_log(xia::log::debug) << "PixieReleaseListModeBuffer";
+
+    try {
+        delete static_cast<xia::buffer::handle*>(Buffer);
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+
+    return 0;
+}
+
+/*
+ * Check a range of modules for the crate calls. The crate user is held by
+ * the caller for all the modules.
+ */
+static void crate_modules_check(unsigned short NumModules) {
+    crate.ready();
+    if (NumModules > crate.num_modules) {
+        throw xia_error(xia_error::code::module_number_invalid,
+                        "number of modules greater than the crate's modules");
+    }
+    for (unsigned short mod_num = 0; mod_num < NumModules; ++mod_num) {
+        if (!crate[mod_num].online()) {
+            throw xia_error(xia_error::code::module_offline,
+                            "module not online: " + std::to_string(mod_num));
+        }
+    }
+}
+
+PIXIE_EXPORT int PIXIE_API PixieCheckCrateFIFOStatus(unsigned int* nFIFOWords,
+                                                     unsigned short NumModules) {
+    xia_log(xia::log::debug) << "PixieCheckCrateFIFOStatus: NumModules=" << NumModules;
+
+    try {
+        if (nFIFOWords == nullptr) {
+            throw xia_error(xia_error::code::invalid_value, "invalid FIFO words pointer");
+        }
+
+        xia::pixie::crate::crate::user user(crate);
+        crate_modules_check(NumModules);
+
+        for (unsigned short mod_num = 0; mod_num < NumModules; ++mod_num) {
+            nFIFOWords[mod_num] =
+                static_cast<unsigned int>(crate[mod_num].read_list_mode_level());
+        }
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (std::exception& e) {
+        xia_log(xia::log::error) << "unknown error: " << e.what();
+        return xia::pixie::error::return_code_unknown_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+
+    return 0;
+}
+
+PIXIE_EXPORT int PIXIE_API PixieReadCrateFIFO(unsigned int** Data, const unsigned int* MaxWords,
+                                              unsigned int* NumWords, unsigned short NumModules) {
+    xia_log(xia::log::debug) << "PixieReadCrateFIFO: NumModules=" << NumModules;
+
+    try {
+        if (Data == nullptr || MaxWords == nullptr || NumWords == nullptr) {
+            throw xia_error(xia_error::code::invalid_value, "invalid buffer pointer(s)");
         }
-        for (size_t i = 0; i < copied; i++) {
-            ExtFIFO_Data[i] = data[i];
+
+        xia::pixie::crate::crate::user user(crate);
+        crate_modules_check(NumModules);
+
+        for (unsigned short mod_num = 0; mod_num < NumModules; ++mod_num) {
+            NumWords[mod_num] = 0;
+            if (Data[mod_num] != nullptr && MaxWords[mod_num] != 0) {
+                NumWords[mod_num] = static_cast<unsigned int>(
+                    crate[mod_num].read_list_mode(Data[mod_num], MaxWords[mod_num]));
+            }
         }
     } catch (xia_error& e) {
         xia_log(xia::log::error) << e;
@@ -1302,12 +1554,18 @@ PIXIE_EXPORT int PIXIE_API Pixie16ReadStatisticsFromModule(unsigned int* Statist
         if (Statistics == nullptr) {
             throw xia_error(xia_error::code::invalid_value, "statistics pointer is NULL");
         }
-        crate.ready();
-        xia::pixie::crate::module_handle module(crate, ModNum);
+        xia::pixie::crate::module_poll_handle module(crate, ModNum);
+        if (!module) {
+            poll_result("Pixie16ReadStatisticsFromModule", module.result);
+            return 0;
+        }
         stats_legacy_ptr legacy_stats = new (Statistics) stats_legacy(module->eeprom.configs);
         legacy_stats->validate();
         xia::pixie::stats::stats stats(*module);
-        module->read_stats(stats);
+        if (poll_result("Pixie16ReadStatisticsFromModule",
+                        module->read_stats(stats, std::nothrow)) != 0) {
+            return 0;
+        }
         legacy_stats->num_channels = module->num_channels;
         legacy_stats->module = stats.mod;
         for (size_t channel = 0; channel < module->num_channels; ++channel) {
@@ -1346,11 +1604,68 @@ PIXIE_EXPORT int PIXIE_API Pixie16SaveDSPParametersToFile(const char* FileName)
     return 0;
 }
 
+PIXIE_EXPORT int PIXIE_API Pixie16SaveExternalFIFODataToFile(const char* FileName,
+                                                             unsigned int* nFIFOWords,
+                                                             unsigned short ModNum,
+                                                             unsigned short EndOfRunRead) {
+    xia_log(xia::log::debug) << "Pixie16SaveExternalFIFODataToFile: ModNum=" << ModNum
+                            << " EndOfRunRead=" << EndOfRunRead;
+
+    try {
+        if (FileName == nullptr || nFIFOWords == nullptr) {
+            throw xia_error(xia_error::code::invalid_value, "file name or words pointer is NULL");
+        }
+        *nFIFOWords = 0;
+        xia::pixie::crate::module_poll_handle module(crate, ModNum);
+        if (!module) {
+            return poll_result("Pixie16SaveExternalFIFODataToFile", module.result);
+        }
+        const size_t min_words = EndOfRunRead != 0 ? 0 : EXTFIFO_READ_THRESH;
+        *nFIFOWords = static_cast<unsigned int>(module->save_list_mode(FileName, min_words));
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (std::exception& e) {
+        xia_log(xia::log::error) << "unknown error: " << e.what();
+        return xia::pixie::error::return_code_unknown_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+
+    return 0;
+}
+
 PIXIE_EXPORT int PIXIE_API Pixie16SaveHistogramToFile(const char* FileName, unsigned short ModNum) {
     xia_log(xia::log::debug) << "Pixie16SaveHistogramToFile: ModNum=" << ModNum
                             << " FileName=" << FileName;
 
-    return not_supported();
+    try {
+        crate.ready();
+        xia::pixie::crate::crate::module_numbers mod_nums;
+        if (ModNum != crate.num_modules) {
+            xia::pixie::crate::module_handle module(crate, ModNum);
+            mod_nums.push_back(ModNum);
+        }
+        crate.save_histograms(FileName, mod_nums);
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (std::exception& e) {
+        xia_log(xia::log::error) << "unknown error: " << e.what();
+        return xia::pixie::error::return_code_unknown_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+
+    return 0;
 }
 
 PIXIE_EXPORT int PIXIE_API Pixie16SetDACs(unsigned short ModNum) {
@@ -1359,10 +1674,7 @@ PIXIE_EXPORT int PIXIE_API Pixie16SetDACs(unsigned short ModNum) {
     try {
         crate.ready();
         if (ModNum == crate.num_modules) {
-            for (size_t mod_num = 0; mod_num < crate.num_modules; mod_num++) {
-                xia::pixie::crate::module_handle module(crate, mod_num);
-                module->set_dacs();
-            }
+            crate.set_dacs();
         } else {
             xia::pixie::crate::module_handle module(crate, ModNum);
             module->set_dacs();
@@ -1450,10 +1762,7 @@ PIXIE_EXPORT int PIXIE_API Pixie16StartListModeRun(unsigned short ModNum, unsign
 
         crate.ready();
         if (ModNum == crate.num_modules) {
-            for (size_t mod_num = 0; mod_num < crate.num_modules; mod_num++) {
-                xia::pixie::crate::module_handle module(crate, mod_num);
-                module->start_listmode(run_mode);
-            }
+            crate.start_listmode(run_mode);
         } else {
             xia::pixie::crate::module_handle module(crate, ModNum);
             module->start_listmode(run_mode);
@@ -1637,6 +1946,78 @@ PIXIE_EXPORT int PIXIE_API PixieBootCrate(const char* settings_file,
     return 0;
 }
 
+PIXIE_EXPORT int PIXIE_API PixieGetChanParHandle(const char* ChanParName, unsigned int* Handle) {
+    xia_log(xia::log::debug) << "PixieGetChanParHandle: ChanParName=" << ChanParName;
+
+    try {
+        if (Handle == nullptr) {
+            throw xia_error(xia_error::code::invalid_value, "handle pointer is NULL");
+        }
+        *Handle = static_cast<unsigned int>(xia::pixie::param::lookup_channel_param(ChanParName));
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (std::exception& e) {
+        xia_log(xia::log::error) << "unknown error: " << e.what();
+        return xia::pixie::error::return_code_unknown_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+
+    return 0;
+}
+
+PIXIE_EXPORT int PIXIE_API PixieGetFifoDataCrc(const unsigned short mod_num, unsigned int* crc) {
+    xia_log(xia::log::debug) << "PixieGetFifoDataCrc: Module=" << mod_num;
+
+    try {
+        crate.ready();
+        xia::pixie::crate::module_handle module(crate, mod_num,
+                                                xia::pixie::crate::module_handle::present);
+        *crc = module->fifo_data_crc();
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+
+    return 0;
+}
+
+PIXIE_EXPORT int PIXIE_API PixieGetModParHandle(const char* ModParName, unsigned int* Handle) {
+    xia_log(xia::log::debug) << "PixieGetModParHandle: ModParName=" << ModParName;
+
+    try {
+        if (Handle == nullptr) {
+            throw xia_error(xia_error::code::invalid_value, "handle pointer is NULL");
+        }
+        *Handle = static_cast<unsigned int>(xia::pixie::param::lookup_module_param(ModParName));
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (std::exception& e) {
+        xia_log(xia::log::error) << "unknown error: " << e.what();
+        return xia::pixie::error::return_code_unknown_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+
+    return 0;
+}
+
 PIXIE_EXPORT int PIXIE_API PixieGetWorkerConfiguration(const unsigned short mod_num,
                                                        fifo_worker_config* worker_config) {
     xia_log(xia::log::debug) << "PixieGetWorkerConfiguration: Module=" << mod_num;
@@ -1665,6 +2046,73 @@ PIXIE_EXPORT int PIXIE_API PixieGetWorkerConfiguration(const unsigned short mod_
 }
 
 
+/*
+ * Is an options field within the size the caller set?
+ */
+template<typename Field>
+static bool worker_option(const fifo_worker_options* options, const Field& field) {
+    const size_t offset = size_t(reinterpret_cast<const char*>(&field) -
+                                 reinterpret_cast<const char*>(options));
+    return options->struct_size >= offset + sizeof(Field);
+}
+
+static void worker_options_check(const fifo_worker_options* options) {
+    if (options == nullptr || options->struct_size < sizeof(options->struct_size)) {
+        throw xia_error(xia_error::code::invalid_value, "worker options: invalid struct size");
+    }
+}
+
+PIXIE_EXPORT int PIXIE_API PixieGetWorkerOptions(const unsigned short mod_num,
+                                                 fifo_worker_options* worker_options) {
+    xia_log(xia::log::debug) << "PixieGetWorkerOptions: Module=" << mod_num;
+
+    try {
+        worker_options_check(worker_options);
+        crate.ready();
+        xia::pixie::crate::module_handle module(crate, mod_num,
+                                                xia::pixie::crate::module_handle::present);
+        auto* opts = worker_options;
+        const auto& placement = module->fifo_placement;
+        if (worker_option(opts, opts->interrupt_mode)) {
+            opts->interrupt_mode = module->fifo_interrupt ? 1 : 0;
+        }
+        if (worker_option(opts, opts->crc_mode)) {
+            opts->crc_mode = module->fifo_crc ? 1 : 0;
+        }
+        if (worker_option(opts, opts->adaptive_mode)) {
+            opts->adaptive_mode = module->fifo_adaptive ? 1 : 0;
+        }
+        if (worker_option(opts, opts->cpu_list)) {
+            std::string cpus = placement.cpus.empty() && placement.pci_local ?
+                "pci" : xia::util::cpu_list(placement.cpus);
+            std::strncpy(opts->cpu_list, cpus.c_str(), PIXIE16_API_WORKER_CPU_LIST_MAX - 1);
+            opts->cpu_list[PIXIE16_API_WORKER_CPU_LIST_MAX - 1] = '\0';
+        }
+        if (worker_option(opts, opts->sched_policy)) {
+            opts->sched_policy = static_cast<unsigned int>(placement.policy);
+        }
+        if (worker_option(opts, opts->sched_priority)) {
+            opts->sched_priority = placement.priority;
+        }
+        if (worker_option(opts, opts->numa_local)) {
+            opts->numa_local = placement.numa_local ? 1 : 0;
+        }
+        if (worker_option(opts, opts->max_buffers)) {
+            opts->max_buffers = module->fifo_buffers_max;
+        }
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+    return 0;
+}
+
 PIXIE_EXPORT int PIXIE_API PixieRegisterFirmware(const unsigned int version, const int revision,
                                                  const int adc_msps, const int adc_bits,
                                                  const char* device, const char* path,
@@ -1708,6 +2156,62 @@ PIXIE_EXPORT int PIXIE_API PixieRegisterFirmware(const unsigned int version, con
     return 0;
 }
 
+PIXIE_EXPORT int PIXIE_API PixieReadSglChanParHandle(unsigned int Handle, double* ChanParData,
+                                                     unsigned short ModNum,
+                                                     unsigned short ChanNum) {
+    xia_log(xia::log::debug) << "PixieReadSglChanParHandle: ModNum=" << ModNum
+                             << " ChanNum=" << ChanNum << " Handle=" << Handle;
+
+    try {
+        const auto par = chan_par_handle(Handle);
+        crate.ready();
+        xia::pixie::crate::module_handle module(crate, ModNum);
+        module->channel_check(ChanNum);
+        *ChanParData = module->read(par, ChanNum);
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (std::exception& e) {
+        xia_log(xia::log::error) << "unknown error: " << e.what();
+        return xia::pixie::error::return_code_unknown_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+
+    return 0;
+}
+
+PIXIE_EXPORT int PIXIE_API PixieReadSglModParHandle(unsigned int Handle, unsigned int* ModParData,
+                                                    unsigned short ModNum) {
+    xia_log(xia::log::debug) << "PixieReadSglModParHandle: ModNum=" << ModNum
+                             << " Handle=" << Handle;
+
+    try {
+        const auto par = mod_par_handle(Handle);
+        crate.ready();
+        xia::pixie::crate::module_handle module(crate, ModNum);
+        *ModParData = module->read(par);
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (std::exception& e) {
+        xia_log(xia::log::error) << "unknown error: " << e.what();
+        return xia::pixie::error::return_code_unknown_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+
+    return 0;
+}
+
 PIXIE_EXPORT int PIXIE_API PixieSetWorkerConfiguration(const unsigned short mod_num,
                                                        fifo_worker_config* worker_config) {
     xia_log(xia::log::debug) << "PixieGetWorkerConfiguration: Module=" << mod_num;
@@ -1735,6 +2239,87 @@ PIXIE_EXPORT int PIXIE_API PixieSetWorkerConfiguration(const unsigned short mod_
     return 0;
 }
 
+PIXIE_EXPORT int PIXIE_API PixieSetWorkerOptions(const unsigned short mod_num,
+                                                 fifo_worker_options* worker_options) {
+    xia_log(xia::log::debug) << "PixieSetWorkerOptions: Module=" << mod_num;
+
+    try {
+        worker_options_check(worker_options);
+        crate.ready();
+        xia::pixie::crate::module_handle module(crate, mod_num,
+                                                xia::pixie::crate::module_handle::present);
+        const auto* opts = worker_options;
+        if (worker_option(opts, opts->interrupt_mode)) {
+            module->set_fifo_interrupt(opts->interrupt_mode != 0);
+        }
+        if (worker_option(opts, opts->crc_mode)) {
+            module->set_fifo_crc(opts->crc_mode != 0);
+        }
+        if (worker_option(opts, opts->adaptive_mode)) {
+            module->set_fifo_adaptive(opts->adaptive_mode != 0);
+        }
+        xia::pixie::module::worker_placement placement = module->fifo_placement;
+        bool placing = false;
+        if (worker_option(opts, opts->cpu_list)) {
+            std::string cpus(opts->cpu_list,
+                             strnlen(opts->cpu_list, PIXIE16_API_WORKER_CPU_LIST_MAX));
+            placement.cpus.clear();
+            placement.pci_local = false;
+            if (cpus == "pci") {
+                placement.pci_local = true;
+            } else {
+                try {
+                    xia::util::parse_cpu_list(placement.cpus, cpus);
+                } catch (std::runtime_error& e) {
+                    throw xia_error(xia_error::code::invalid_value, e.what());
+                }
+            }
+            placing = true;
+        }
+        if (worker_option(opts, opts->sched_policy)) {
+            switch (opts->sched_policy) {
+                case 0:
+                    placement.policy = xia::util::sched_policy::other;
+                    break;
+                case 1:
+                    placement.policy = xia::util::sched_policy::fifo;
+                    break;
+                case 2:
+                    placement.policy = xia::util::sched_policy::round_robin;
+                    break;
+                default:
+                    throw xia_error(xia_error::code::invalid_value,
+                                    "invalid worker scheduling policy");
+            }
+            placing = true;
+        }
+        if (worker_option(opts, opts->sched_priority)) {
+            placement.priority = opts->sched_priority;
+            placing = true;
+        }
+        if (worker_option(opts, opts->numa_local)) {
+            placement.numa_local = opts->numa_local != 0;
+            placing = true;
+        }
+        if (placing) {
+            module->set_fifo_placement(placement);
+        }
+        if (worker_option(opts, opts->max_buffers)) {
+            module->set_fifo_buffers_max(opts->max_buffers);
+        }
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+    return 0;
+}
+
 PIXIE_EXPORT int PIXIE_API PixieReadRunFifoStats(unsigned short mod_num,
                                                  struct module_fifo_stats* fifo_stats) {
     xia_log(xia::log::debug) << "PixieReadModuleRunFifoStats: Module=" << mod_num;
@@ -1763,3 +2348,146 @@ PIXIE_EXPORT int PIXIE_API PixieReadRunFifoStats(unsigned short mod_num,
     }
     return 0;
 }
+
+PIXIE_EXPORT int PIXIE_API PixieReadLockStats(unsigned short mod_num,
+                                              struct module_lock_stats* lock_stats,
+                                              unsigned short reset) {
+    xia_log(xia::log::debug) << "PixieReadLockStats: Module=" << mod_num << " reset=" << reset;
+
+    if (lock_stats == nullptr) {
+        return poll_result("PixieReadLockStats", xia_error::code::invalid_value);
+    }
+
+    xia::pixie::crate::module_poll_handle module(crate, mod_num);
+    auto result = module.result;
+    if (module) {
+        auto locks = module->lock_wait_stats();
+        auto bus = module->bus_hold_stats();
+        if (reset != 0) {
+            module->lock_wait_stats_reset();
+            module->bus_hold_stats_reset();
+        }
+        lock_stats->locks = locks.locks;
+        lock_stats->lock_waits = locks.waits;
+        lock_stats->lock_max_wait_usecs = locks.max_wait_usecs;
+        lock_stats->lock_total_wait_usecs = locks.total_wait_usecs;
+        lock_stats->bus_holds = bus.holds;
+        lock_stats->bus_waits = bus.waits;
+        lock_stats->bus_max_wait_usecs = bus.max_wait_usecs;
+        lock_stats->bus_total_wait_usecs = bus.total_wait_usecs;
+        lock_stats->bus_max_hold_usecs = bus.max_hold_usecs;
+        lock_stats->bus_total_hold_usecs = bus.total_hold_usecs;
+        lock_stats->bus_fifo_waits = bus.fifo_waits;
+    }
+
+    return poll_result("PixieReadLockStats", result);
+}
+
+PIXIE_EXPORT int PIXIE_API PixieReadRunFifoHistograms(
+    unsigned short mod_num, struct module_fifo_histograms* fifo_histograms) {
+    xia_log(xia::log::debug) << "PixieReadRunFifoHistograms: Module=" << mod_num;
+
+    static_assert(PIXIE16_API_FIFO_HISTOGRAM_BINS ==
+                      xia::pixie::module::module::fifo_histogram::bins,
+                  "FIFO histogram bins do not match");
+
+    try {
+        crate.ready();
+        xia::pixie::crate::module_handle module(crate, mod_num,
+                                                xia::pixie::crate::module_handle::present);
+        xia::pixie::module::module::fifo_stats snapshot;
+        snapshot = module->run_stats;
+        auto copy = [](const xia::pixie::module::module::fifo_histogram& hist, size_t* bins) {
+            for (size_t b = 0; b < PIXIE16_API_FIFO_HISTOGRAM_BINS; ++b) {
+                bins[b] = hist.counts[b].load();
+            }
+        };
+        copy(snapshot.level_words, fifo_histograms->level_words);
+        copy(snapshot.dma_usecs, fifo_histograms->dma_usecs);
+        copy(snapshot.dma_words, fifo_histograms->dma_words);
+        copy(snapshot.latency_usecs, fifo_histograms->latency_usecs);
+        copy(snapshot.queue_depth, fifo_histograms->queue_depth);
+        copy(snapshot.poll_usecs, fifo_histograms->poll_usecs);
+        copy(snapshot.compact_usecs, fifo_histograms->compact_usecs);
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+    return 0;
+}
+
+PIXIE_EXPORT int PIXIE_API PixieWriteSglChanParHandle(unsigned int Handle, double ChanParData,
+                                                      unsigned short ModNum,
+                                                      unsigned short ChanNum) {
+    xia_log(xia::log::debug) << "PixieWriteSglChanParHandle: ModNum=" << ModNum
+                             << " ChanNum=" << ChanNum << " Handle=" << Handle
+                             << " ChanParData=" << ChanParData;
+
+    try {
+        const auto par = chan_par_handle(Handle);
+        crate.ready();
+        xia::pixie::crate::module_handle module(crate, ModNum);
+        module->channel_check(ChanNum);
+        module->write(par, ChanNum, ChanParData);
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (std::exception& e) {
+        xia_log(xia::log::error) << "unknown error: " << e.what();
+        return xia::pixie::error::return_code_unknown_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+
+    return 0;
+}
+
+PIXIE_EXPORT int PIXIE_API PixieWriteSglModParHandle(unsigned int Handle, unsigned int ModParData,
+                                                     unsigned short ModNum) {
+    xia_log(xia::log::debug) << "PixieWriteSglModParHandle: ModNum=" << ModNum
+                             << " Handle=" << Handle << " ModParData=" << ModParData;
+
+    try {
+        const auto par = mod_par_handle(Handle);
+        crate.ready();
+        bool bcast;
+        if (ModNum == crate.num_modules) {
+            bcast = true;
+        } else {
+            xia::pixie::crate::module_handle module(crate, ModNum);
+            bcast = module->write(par, ModParData);
+        }
+        if (bcast) {
+            xia::pixie::crate::crate::user user(crate);
+            for (auto& module : crate.modules) {
+                if (ModNum != module->number && module->online()) {
+                    module->write(par, ModParData);
+                }
+            }
+        }
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (std::exception& e) {
+        xia_log(xia::log::error) << "unknown error: " << e.what();
+        return xia::pixie::error::return_code_unknown_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+
+    return 0;
+}
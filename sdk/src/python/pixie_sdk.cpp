@@ -0,0 +1,841 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file pixie_sdk.cpp
+ * @brief Python bindings of the crate, the module readout and the list-mode decode.
+ *
+ * The arrays returned are read-only buffer protocol objects that wrap the
+ * SDK's memory, a list-mode buffer from the module's FIFO pool, a
+ * histogram or trace read or a column of a decoded event batch. Use
+ * `numpy.asarray()` or `memoryview()` to view the data without copying
+ * it. An array holds its owner so a list-mode buffer is returned to the
+ * pool when the last view of it is released.
+ *
+ * The GIL is released while the SDK accesses the hardware and while a
+ * data block is decoded.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <exception>
+#include <new>
+#include <string>
+#include <utility>
+
+#include <pixie/error.hpp>
+#include <pixie/fw.hpp>
+
+#include <pixie/data/list_mode.hpp>
+
+#include <pixie/pixie16/crate.hpp>
+#include <pixie/pixie16/sim.hpp>
+
+namespace xia {
+namespace pixie {
+namespace python {
+typedef pixie::error::error error;
+typedef data::list_mode::event_batch event_batch;
+
+/*
+ * The SDK's error with the error's code in `code`.
+ */
+static PyObject* error_type = nullptr;
+
+static void set_error(const error& e) {
+    PyObject* exc = PyObject_CallFunction(error_type, "s", e.what());
+    if (exc == nullptr) {
+        return;
+    }
+    PyObject* code = PyLong_FromLong(e.return_code());
+    if (code != nullptr) {
+        PyObject_SetAttrString(exc, "code", code);
+        Py_DECREF(code);
+    }
+    PyErr_SetObject(error_type, exc);
+    Py_DECREF(exc);
+}
+
+/*
+ * Call into the SDK and convert an exception to a Python error. The GIL
+ * is released if the call accesses the hardware or decodes data. Returns
+ * false if there is an error.
+ */
+template<typename Func>
+static bool call(Func func, bool release_gil = false) {
+    std::exception_ptr ep;
+    PyThreadState* state = release_gil ? PyEval_SaveThread() : nullptr;
+    try {
+        func();
+    } catch (...) {
+        ep = std::current_exception();
+    }
+    if (state != nullptr) {
+        PyEval_RestoreThread(state);
+    }
+    if (ep) {
+        try {
+            std::rethrow_exception(ep);
+        } catch (error& e) {
+            set_error(e);
+        } catch (std::bad_alloc&) {
+            PyErr_NoMemory();
+        } catch (std::exception& e) {
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+        } catch (...) {
+            PyErr_SetString(PyExc_RuntimeError, "unknown error");
+        }
+        return false;
+    }
+    return true;
+}
+
+/*
+ * The buffer protocol format of an array's values.
+ */
+template<typename T>
+struct format;
+template<>
+struct format<uint8_t> {
+    static constexpr const char* code = "B";
+};
+template<>
+struct format<uint16_t> {
+    static constexpr const char* code = "H";
+};
+template<>
+struct format<uint32_t> {
+    static constexpr const char* code = "I";
+};
+template<>
+struct format<uint64_t> {
+    static constexpr const char* code = "Q";
+};
+template<>
+struct format<double> {
+    static constexpr const char* code = "d";
+};
+
+/*
+ * The C++ storage an array owns.
+ */
+struct holder {
+    virtual ~holder() = default;
+};
+
+template<typename T>
+struct holder_of : public holder {
+    T value;
+    explicit holder_of(T&& value_) : value(std::move(value_)) {}
+};
+
+/*
+ * A read-only one dimensional array of SDK owned memory. The memory is
+ * owned by the array's holder or by the base object.
+ */
+struct array_object {
+    PyObject_HEAD
+    void* data;
+    Py_ssize_t length;
+    Py_ssize_t itemsize;
+    const char* format;
+    holder* owner;
+    PyObject* base;
+};
+
+static void array_dealloc(PyObject* self) {
+    auto arr = reinterpret_cast<array_object*>(self);
+    delete arr->owner;
+    Py_XDECREF(arr->base);
+    Py_TYPE(self)->tp_free(self);
+}
+
+static int array_getbuffer(PyObject* self, Py_buffer* view, int flags) {
+    auto arr = reinterpret_cast<array_object*>(self);
+    if ((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE) {
+        PyErr_SetString(PyExc_BufferError, "array is read-only");
+        view->obj = nullptr;
+        return -1;
+    }
+    view->buf = arr->data;
+    view->obj = self;
+    Py_INCREF(self);
+    view->len = arr->length * arr->itemsize;
+    view->readonly = 1;
+    view->itemsize = arr->itemsize;
+    view->format =
+        (flags & PyBUF_FORMAT) == PyBUF_FORMAT ? const_cast<char*>(arr->format) : nullptr;
+    view->ndim = 1;
+    view->shape = (flags & PyBUF_ND) == PyBUF_ND ? &arr->length : nullptr;
+    view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? &arr->itemsize : nullptr;
+    view->suboffsets = nullptr;
+    view->internal = nullptr;
+    return 0;
+}
+
+static Py_ssize_t array_length(PyObject* self) {
+    return reinterpret_cast<array_object*>(self)->length;
+}
+
+static PyBufferProcs array_buffer = {array_getbuffer, nullptr};
+
+static PySequenceMethods array_sequence = {array_length};
+
+static PyTypeObject array_type = {PyVarObject_HEAD_INIT(nullptr, 0)};
+
+template<typename T>
+static PyObject* make_array(const T* data, size_t length, holder* owner, PyObject* base) {
+    auto arr = PyObject_New(array_object, &array_type);
+    if (arr == nullptr) {
+        delete owner;
+        return nullptr;
+    }
+    arr->data = const_cast<T*>(data);
+    arr->length = Py_ssize_t(length);
+    arr->itemsize = Py_ssize_t(sizeof(T));
+    arr->format = format<T>::code;
+    arr->owner = owner;
+    arr->base = base;
+    Py_XINCREF(base);
+    return reinterpret_cast<PyObject*>(arr);
+}
+
+/*
+ * Move a vector into an array. The vector's memory is not copied.
+ */
+template<typename T>
+static PyObject* make_array(std::vector<T>&& values, PyObject* base = nullptr) {
+    auto owner = new holder_of<std::vector<T>>(std::move(values));
+    return make_array(owner->value.data(), owner->value.size(), owner, base);
+}
+
+/*
+ * A crate of modules. A simulated crate uses the module definitions added
+ * with `add_sim_module()`.
+ */
+struct crate_object {
+    PyObject_HEAD
+    crate::crate* crate;
+};
+
+static void crate_dealloc(PyObject* self) {
+    auto crt = reinterpret_cast<crate_object*>(self);
+    if (crt->crate != nullptr) {
+        Py_BEGIN_ALLOW_THREADS
+        try {
+            delete crt->crate;
+        } catch (...) {
+        }
+        Py_END_ALLOW_THREADS
+        crt->crate = nullptr;
+    }
+    Py_TYPE(self)->tp_free(self);
+}
+
+static int crate_init(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"simulate", nullptr};
+    auto crt = reinterpret_cast<crate_object*>(self);
+    int simulate = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|p", const_cast<char**>(keywords),
+                                     &simulate)) {
+        return -1;
+    }
+    if (crt->crate != nullptr) {
+        PyErr_SetString(PyExc_RuntimeError, "crate is already created");
+        return -1;
+    }
+    bool ok = call([crt, simulate] {
+        if (simulate) {
+            crt->crate = new sim::crate;
+        } else {
+            crt->crate = new crate::crate;
+        }
+    });
+    return ok ? 0 : -1;
+}
+
+static PyObject* crate_initialize(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"reg_trace", nullptr};
+    auto& crate = *reinterpret_cast<crate_object*>(self)->crate;
+    int reg_trace = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|p", const_cast<char**>(keywords),
+                                     &reg_trace)) {
+        return nullptr;
+    }
+    if (!call([&crate, reg_trace] { crate.initialize(reg_trace != 0); }, true)) {
+        return nullptr;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject* crate_shutdown(PyObject* self, PyObject*) {
+    auto& crate = *reinterpret_cast<crate_object*>(self)->crate;
+    if (!call([&crate] { crate.shutdown(); }, true)) {
+        return nullptr;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject* crate_probe(PyObject* self, PyObject*) {
+    auto& crate = *reinterpret_cast<crate_object*>(self)->crate;
+    bool online = false;
+    if (!call([&crate, &online] { online = crate.probe(); }, true)) {
+        return nullptr;
+    }
+    return PyBool_FromLong(online);
+}
+
+static PyObject* crate_add_firmware(PyObject* self, PyObject* args) {
+    auto& crate = *reinterpret_cast<crate_object*>(self)->crate;
+    const char* spec;
+    if (!PyArg_ParseTuple(args, "s", &spec)) {
+        return nullptr;
+    }
+    bool ok = call([&crate, spec] {
+        auto fw = firmware::parse(spec, ':');
+        if (firmware::check(crate.firmware, fw)) {
+            throw error(error::code::invalid_value, std::string("duplicate firmware: ") + spec);
+        }
+        firmware::add(crate.firmware, fw);
+    });
+    if (!ok) {
+        return nullptr;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject* crate_boot(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"force", nullptr};
+    auto& crate = *reinterpret_cast<crate_object*>(self)->crate;
+    int force = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|p", const_cast<char**>(keywords), &force)) {
+        return nullptr;
+    }
+    bool ok = call(
+        [&crate, force] {
+            crate.set_firmware();
+            firmware::load(crate.firmware);
+            crate::crate::boot_params params;
+            params.force = force != 0;
+            crate.boot(params);
+        },
+        true);
+    if (!ok) {
+        return nullptr;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject* crate_import_config(PyObject* self, PyObject* args) {
+    auto& crate = *reinterpret_cast<crate_object*>(self)->crate;
+    const char* json_file;
+    if (!PyArg_ParseTuple(args, "s", &json_file)) {
+        return nullptr;
+    }
+    module::number_slots loaded;
+    bool ok = call(
+        [&crate, json_file, &loaded] {
+            crate.import_config(json_file, loaded);
+            crate.initialize_afe();
+        },
+        true);
+    if (!ok) {
+        return nullptr;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject* crate_num_modules(PyObject* self, void*) {
+    auto& crate = *reinterpret_cast<crate_object*>(self)->crate;
+    return PyLong_FromLong(crate.num_modules);
+}
+
+static PyObject* crate_module(PyObject* self, PyObject* args);
+
+static PyMethodDef crate_methods[] = {
+    {"initialize", reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)()>(crate_initialize)),
+     METH_VARARGS | METH_KEYWORDS, "Initialize the crate and open the modules."},
+    {"shutdown", crate_shutdown, METH_NOARGS, "Close the modules."},
+    {"probe", crate_probe, METH_NOARGS, "Probe the modules, returns True if all are online."},
+    {"add_firmware", crate_add_firmware, METH_VARARGS,
+     "Add a firmware, `version:revision:adc-msps:adc-bits:device:filename`."},
+    {"boot", reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)()>(crate_boot)),
+     METH_VARARGS | METH_KEYWORDS, "Load the firmware and boot the modules."},
+    {"import_config", crate_import_config, METH_VARARGS,
+     "Import a JSON configuration and initialize the AFE."},
+    {"module", crate_module, METH_VARARGS, "The module by number."},
+    {nullptr, nullptr, 0, nullptr}};
+
+static PyGetSetDef crate_getset[] = {
+    {"num_modules", crate_num_modules, nullptr, "The number of online modules.", nullptr},
+    {nullptr, nullptr, nullptr, nullptr, nullptr}};
+
+static PyTypeObject crate_type = {PyVarObject_HEAD_INIT(nullptr, 0)};
+
+/*
+ * A module of a crate. The module holds its crate.
+ */
+struct module_object {
+    PyObject_HEAD
+    PyObject* crate;
+    module::module_ptr* module;
+};
+
+static module::module& module_of(PyObject* self) {
+    return **reinterpret_cast<module_object*>(self)->module;
+}
+
+static void module_dealloc(PyObject* self) {
+    auto mod = reinterpret_cast<module_object*>(self);
+    delete mod->module;
+    Py_XDECREF(mod->crate);
+    Py_TYPE(self)->tp_free(self);
+}
+
+static PyTypeObject module_type = {PyVarObject_HEAD_INIT(nullptr, 0)};
+
+static PyObject* crate_module(PyObject* self, PyObject* args) {
+    auto& crate = *reinterpret_cast<crate_object*>(self)->crate;
+    int number;
+    if (!PyArg_ParseTuple(args, "i", &number)) {
+        return nullptr;
+    }
+    module::module_ptr module;
+    bool ok = call([&crate, number, &module] {
+        /*
+         * The index checks the number.
+         */
+        crate[number];
+        module = crate.modules[size_t(number)];
+    });
+    if (!ok) {
+        return nullptr;
+    }
+    auto mod = PyObject_New(module_object, &module_type);
+    if (mod == nullptr) {
+        return nullptr;
+    }
+    mod->module = new module::module_ptr(module);
+    mod->crate = self;
+    Py_INCREF(self);
+    return reinterpret_cast<PyObject*>(mod);
+}
+
+static PyObject* module_start_listmode(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"new_run", nullptr};
+    auto& module = module_of(self);
+    int new_run = 1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|p", const_cast<char**>(keywords),
+                                     &new_run)) {
+        return nullptr;
+    }
+    auto mode = new_run ? hw::run::run_mode::new_run : hw::run::run_mode::resume;
+    if (!call([&module, mode] { module.start_listmode(mode); }, true)) {
+        return nullptr;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject* module_start_histograms(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"new_run", nullptr};
+    auto& module = module_of(self);
+    int new_run = 1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|p", const_cast<char**>(keywords),
+                                     &new_run)) {
+        return nullptr;
+    }
+    auto mode = new_run ? hw::run::run_mode::new_run : hw::run::run_mode::resume;
+    if (!call([&module, mode] { module.start_histograms(mode); }, true)) {
+        return nullptr;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject* module_run_end(PyObject* self, PyObject*) {
+    auto& module = module_of(self);
+    if (!call([&module] { module.run_end(); }, true)) {
+        return nullptr;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject* module_run_active(PyObject* self, PyObject*) {
+    auto& module = module_of(self);
+    bool active = false;
+    if (!call([&module, &active] { active = module.run_active(); }, true)) {
+        return nullptr;
+    }
+    return PyBool_FromLong(active);
+}
+
+static PyObject* module_read_list_mode_level(PyObject* self, PyObject*) {
+    auto& module = module_of(self);
+    size_t level = 0;
+    if (!call([&module, &level] { level = module.read_list_mode_level(); }, true)) {
+        return nullptr;
+    }
+    return PyLong_FromSize_t(level);
+}
+
+static PyObject* module_read_list_mode(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"max_buffers", nullptr};
+    auto& module = module_of(self);
+    Py_ssize_t max_buffers = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|n", const_cast<char**>(keywords),
+                                     &max_buffers)) {
+        return nullptr;
+    }
+    if (max_buffers < 0) {
+        PyErr_SetString(PyExc_ValueError, "max_buffers is negative");
+        return nullptr;
+    }
+    buffer::queue::handles buffers;
+    bool ok = call([&module, &buffers, max_buffers] {
+        module.read_list_mode(buffers, size_t(max_buffers));
+    }, true);
+    if (!ok) {
+        return nullptr;
+    }
+    PyObject* list = PyList_New(Py_ssize_t(buffers.size()));
+    if (list == nullptr) {
+        return nullptr;
+    }
+    Py_ssize_t index = 0;
+    for (auto& buf : buffers) {
+        auto owner = new holder_of<buffer::handle>(std::move(buf));
+        auto arr = make_array(owner->value->data(), owner->value->size(), owner, self);
+        if (arr == nullptr) {
+            Py_DECREF(list);
+            return nullptr;
+        }
+        PyList_SET_ITEM(list, index++, arr);
+    }
+    return list;
+}
+
+static PyObject* module_read_histogram(PyObject* self, PyObject* args) {
+    auto& module = module_of(self);
+    Py_ssize_t channel;
+    if (!PyArg_ParseTuple(args, "n", &channel)) {
+        return nullptr;
+    }
+    hw::words values;
+    if (!call([&module, channel, &values] { module.read_histogram(size_t(channel), values); },
+              true)) {
+        return nullptr;
+    }
+    return make_array(std::move(values));
+}
+
+static PyObject* module_read_adc(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"channel", "run", nullptr};
+    auto& module = module_of(self);
+    Py_ssize_t channel;
+    int run = 1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "n|p", const_cast<char**>(keywords), &channel,
+                                     &run)) {
+        return nullptr;
+    }
+    hw::adc_trace trace;
+    bool ok = call(
+        [&module, channel, &trace, run] { module.read_adc(size_t(channel), trace, run != 0); },
+        true);
+    if (!ok) {
+        return nullptr;
+    }
+    return make_array(std::move(trace));
+}
+
+static int module_adc_config(module::module& module, bool bits) {
+    if (module.channels.empty() || !module.channels[0].fixture) {
+        return 0;
+    }
+    auto& config = module.channels[0].fixture->config;
+    return bits ? config.adc_bits : config.adc_msps;
+}
+
+static PyMethodDef module_methods[] = {
+    {"start_listmode",
+     reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)()>(module_start_listmode)),
+     METH_VARARGS | METH_KEYWORDS, "Start a list-mode run."},
+    {"start_histograms",
+     reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)()>(module_start_histograms)),
+     METH_VARARGS | METH_KEYWORDS, "Start a histogram run."},
+    {"run_end", module_run_end, METH_NOARGS, "End the run."},
+    {"run_active", module_run_active, METH_NOARGS, "True if a run is active."},
+    {"read_list_mode_level", module_read_list_mode_level, METH_NOARGS,
+     "The number of list-mode words queued."},
+    {"read_list_mode",
+     reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)()>(module_read_list_mode)),
+     METH_VARARGS | METH_KEYWORDS,
+     "Read the queued list-mode buffers, up to `max_buffers` or all if 0. "
+     "Returns a list of uint32 arrays that wrap the FIFO pool's buffers."},
+    {"read_histogram", module_read_histogram, METH_VARARGS,
+     "Read a channel's histogram as a uint32 array."},
+    {"read_adc", reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)()>(module_read_adc)),
+     METH_VARARGS | METH_KEYWORDS, "Read a channel's ADC trace as a uint16 array."},
+    {nullptr, nullptr, 0, nullptr}};
+
+static PyGetSetDef module_getset[] = {
+    {"number", [](PyObject* self, void*) { return PyLong_FromLong(module_of(self).number); },
+     nullptr, "The module's number.", nullptr},
+    {"slot", [](PyObject* self, void*) { return PyLong_FromLong(module_of(self).slot); }, nullptr,
+     "The module's slot.", nullptr},
+    {"serial_num",
+     [](PyObject* self, void*) { return PyLong_FromLong(module_of(self).serial_num); }, nullptr,
+     "The module's serial number.", nullptr},
+    {"revision", [](PyObject* self, void*) { return PyLong_FromLong(module_of(self).revision); },
+     nullptr, "The module's hardware revision.", nullptr},
+    {"num_channels",
+     [](PyObject* self, void*) { return PyLong_FromSize_t(module_of(self).num_channels); },
+     nullptr, "The number of channels.", nullptr},
+    {"adc_bits",
+     [](PyObject* self, void*) {
+         return PyLong_FromLong(module_adc_config(module_of(self), true));
+     },
+     nullptr, "The ADC's bits.", nullptr},
+    {"adc_msps",
+     [](PyObject* self, void*) {
+         return PyLong_FromLong(module_adc_config(module_of(self), false));
+     },
+     nullptr, "The ADC's sample rate in MSPS.", nullptr},
+    {nullptr, nullptr, nullptr, nullptr, nullptr}};
+
+/*
+ * A batch of decoded events. The columns are arrays of the batch's memory.
+ */
+struct batch_object {
+    PyObject_HEAD
+    event_batch* batch;
+};
+
+static event_batch& batch_of(PyObject* self) {
+    return *reinterpret_cast<batch_object*>(self)->batch;
+}
+
+static void batch_dealloc(PyObject* self) {
+    delete reinterpret_cast<batch_object*>(self)->batch;
+    Py_TYPE(self)->tp_free(self);
+}
+
+static Py_ssize_t batch_length(PyObject* self) {
+    return Py_ssize_t(batch_of(self).size());
+}
+
+template<typename T, std::vector<T> event_batch::*column>
+static PyObject* batch_column(PyObject* self, void*) {
+    auto& values = batch_of(self).*column;
+    return make_array(values.data(), values.size(), nullptr, self);
+}
+
+static PyObject* batch_trace(PyObject* self, PyObject* args) {
+    auto& batch = batch_of(self);
+    Py_ssize_t event;
+    if (!PyArg_ParseTuple(args, "n", &event)) {
+        return nullptr;
+    }
+    if (event < 0 || size_t(event) >= batch.size()) {
+        PyErr_SetString(PyExc_IndexError, "event out of range");
+        return nullptr;
+    }
+    auto trace = batch.trace(size_t(event));
+    return make_array(trace.data, trace.length, nullptr, self);
+}
+
+static PyMethodDef batch_methods[] = {
+    {"trace", batch_trace, METH_VARARGS, "The event's trace as a view of the trace arena."},
+    {nullptr, nullptr, 0, nullptr}};
+
+#define PIXIE_BATCH_COLUMN(_type, _name, _doc) \
+    { #_name, batch_column<_type, &event_batch::_name>, nullptr, _doc, nullptr }
+
+static PyGetSetDef batch_getset[] = {
+    PIXIE_BATCH_COLUMN(double, time, "The event times in seconds."),
+    PIXIE_BATCH_COLUMN(double, filter_time, "The filter times in seconds."),
+    PIXIE_BATCH_COLUMN(double, cfd_fractional_time, "The CFD fractional times in seconds."),
+    PIXIE_BATCH_COLUMN(double, external_time, "The external times in seconds."),
+    PIXIE_BATCH_COLUMN(double, energy, "The energies."),
+    PIXIE_BATCH_COLUMN(double, filter_baseline, "The filter baselines."),
+    PIXIE_BATCH_COLUMN(event_batch::id_type, crate, "The crate ids."),
+    PIXIE_BATCH_COLUMN(event_batch::id_type, slot, "The slots."),
+    PIXIE_BATCH_COLUMN(event_batch::id_type, channel, "The channels."),
+    PIXIE_BATCH_COLUMN(uint8_t, cfd_trigger_source, "The CFD trigger sources."),
+    PIXIE_BATCH_COLUMN(uint8_t, flags, "The flag bits."),
+    PIXIE_BATCH_COLUMN(uint16_t, header_length, "The header lengths in words."),
+    PIXIE_BATCH_COLUMN(uint32_t, event_length, "The event lengths in words."),
+    PIXIE_BATCH_COLUMN(size_t, energy_sums_offset, "The offsets into the energy sums."),
+    PIXIE_BATCH_COLUMN(size_t, qdc_offset, "The offsets into the QDCs."),
+    PIXIE_BATCH_COLUMN(size_t, trace_offset, "The offsets into the traces."),
+    PIXIE_BATCH_COLUMN(uint32_t, trace_length, "The trace lengths."),
+    PIXIE_BATCH_COLUMN(uint32_t, energy_sums, "The energy sums arena."),
+    PIXIE_BATCH_COLUMN(uint32_t, qdc, "The QDC arena."),
+    PIXIE_BATCH_COLUMN(event_batch::trace_value, traces, "The trace arena."),
+    {nullptr, nullptr, nullptr, nullptr, nullptr}};
+
+#undef PIXIE_BATCH_COLUMN
+
+static PySequenceMethods batch_sequence = {batch_length};
+
+static PyTypeObject batch_type = {PyVarObject_HEAD_INIT(nullptr, 0)};
+
+static PyObject* decode_data_block(PyObject*, PyObject* args) {
+    PyObject* data;
+    Py_ssize_t revision;
+    Py_ssize_t frequency;
+    if (!PyArg_ParseTuple(args, "Onn", &data, &revision, &frequency)) {
+        return nullptr;
+    }
+    Py_buffer view;
+    if (PyObject_GetBuffer(data, &view, PyBUF_C_CONTIGUOUS) < 0) {
+        return nullptr;
+    }
+    if ((view.len % sizeof(uint32_t)) != 0) {
+        PyBuffer_Release(&view);
+        PyErr_SetString(PyExc_ValueError, "data is not a whole number of words");
+        return nullptr;
+    }
+    auto batch = PyObject_New(batch_object, &batch_type);
+    if (batch == nullptr) {
+        PyBuffer_Release(&view);
+        return nullptr;
+    }
+    batch->batch = nullptr;
+    data::list_mode::buffer leftovers;
+    /*
+     * The decode does not write to the data.
+     */
+    auto words = static_cast<uint32_t*>(view.buf);
+    size_t len = size_t(view.len) / sizeof(uint32_t);
+    bool ok = call(
+        [batch, words, len, revision, frequency, &leftovers] {
+            batch->batch = new event_batch;
+            data::list_mode::decode_data_block(words, len, size_t(revision), size_t(frequency),
+                                               *batch->batch, leftovers);
+        },
+        true);
+    PyBuffer_Release(&view);
+    if (!ok) {
+        Py_DECREF(batch);
+        return nullptr;
+    }
+    PyObject* left = make_array(std::move(leftovers));
+    if (left == nullptr) {
+        Py_DECREF(batch);
+        return nullptr;
+    }
+    return Py_BuildValue("(NN)", batch, left);
+}
+
+static PyObject* add_sim_module(PyObject*, PyObject* args) {
+    const char* definition;
+    if (!PyArg_ParseTuple(args, "s", &definition)) {
+        return nullptr;
+    }
+    if (!call([definition] { sim::add_module_def(definition); })) {
+        return nullptr;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef methods[] = {
+    {"decode_data_block", decode_data_block, METH_VARARGS,
+     "decode_data_block(data, revision, frequency) -> (EventBatch, leftovers)\n\n"
+     "Decode a list-mode data block of any buffer of words into an event batch. "
+     "Prepend the leftover words to the next block."},
+    {"add_sim_module", add_sim_module, METH_VARARGS,
+     "Add a simulated module definition, for example "
+     "`device-number=0 slot=2 revision=15 num-channels=16 adc-bits=14 adc-msps=250`."},
+    {nullptr, nullptr, 0, nullptr}};
+
+static PyModuleDef module_def = {PyModuleDef_HEAD_INIT, "pixie_sdk",
+                                 "Python bindings of the Pixie SDK.", -1, methods};
+
+static bool add_type(PyObject* mod, PyTypeObject& type, const char* name) {
+    if (PyType_Ready(&type) < 0) {
+        return false;
+    }
+    Py_INCREF(&type);
+    if (PyModule_AddObject(mod, name, reinterpret_cast<PyObject*>(&type)) < 0) {
+        Py_DECREF(&type);
+        return false;
+    }
+    return true;
+}
+
+static PyObject* init() {
+    array_type.tp_name = "pixie_sdk.Array";
+    array_type.tp_doc = "A read-only array of SDK memory supporting the buffer protocol.";
+    array_type.tp_basicsize = sizeof(array_object);
+    array_type.tp_flags = Py_TPFLAGS_DEFAULT;
+    array_type.tp_dealloc = array_dealloc;
+    array_type.tp_as_buffer = &array_buffer;
+    array_type.tp_as_sequence = &array_sequence;
+
+    crate_type.tp_name = "pixie_sdk.Crate";
+    crate_type.tp_doc = "Crate(simulate=False)\n\nA crate of modules.";
+    crate_type.tp_basicsize = sizeof(crate_object);
+    crate_type.tp_flags = Py_TPFLAGS_DEFAULT;
+    crate_type.tp_new = PyType_GenericNew;
+    crate_type.tp_init = crate_init;
+    crate_type.tp_dealloc = crate_dealloc;
+    crate_type.tp_methods = crate_methods;
+    crate_type.tp_getset = crate_getset;
+
+    module_type.tp_name = "pixie_sdk.Module";
+    module_type.tp_doc = "A module of a crate.";
+    module_type.tp_basicsize = sizeof(module_object);
+    module_type.tp_flags = Py_TPFLAGS_DEFAULT;
+    module_type.tp_dealloc = module_dealloc;
+    module_type.tp_methods = module_methods;
+    module_type.tp_getset = module_getset;
+
+    batch_type.tp_name = "pixie_sdk.EventBatch";
+    batch_type.tp_doc = "A batch of decoded events stored as columns.";
+    batch_type.tp_basicsize = sizeof(batch_object);
+    batch_type.tp_flags = Py_TPFLAGS_DEFAULT;
+    batch_type.tp_dealloc = batch_dealloc;
+    batch_type.tp_methods = batch_methods;
+    batch_type.tp_getset = batch_getset;
+    batch_type.tp_as_sequence = &batch_sequence;
+
+    PyObject* mod = PyModule_Create(&module_def);
+    if (mod == nullptr) {
+        return nullptr;
+    }
+    error_type = PyErr_NewException("pixie_sdk.Error", PyExc_RuntimeError, nullptr);
+    if (error_type == nullptr) {
+        Py_DECREF(mod);
+        return nullptr;
+    }
+    Py_INCREF(error_type);
+    if (PyModule_AddObject(mod, "Error", error_type) < 0 ||
+        !add_type(mod, array_type, "Array") || !add_type(mod, crate_type, "Crate") ||
+        !add_type(mod, module_type, "Module") || !add_type(mod, batch_type, "EventBatch")) {
+        Py_DECREF(error_type);
+        Py_DECREF(mod);
+        return nullptr;
+    }
+    return mod;
+}
+}  // namespace python
+}  // namespace pixie
+}  // namespace xia
+
+PyMODINIT_FUNC PyInit_pixie_sdk(void) {
+    return xia::pixie::python::init();
+}
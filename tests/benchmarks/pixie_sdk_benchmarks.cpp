@@ -0,0 +1,469 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2022 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file pixie_sdk_benchmarks.cpp
+ * @brief Microbenchmarks of the SDK's buffer, decode and CRC hot paths.
+ *
+ * Each benchmark runs a fixed number of iterations a number of times and
+ * reports the minimum, median and maximum time per iteration as JSON. The
+ * data is generated from fixed seeds so runs are comparable between
+ * releases.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include <pixie/buffer.hpp>
+#include <pixie/util.hpp>
+
+#include <pixie/data/energy.hpp>
+#include <pixie/data/list_mode.hpp>
+#include <pixie/data/trace.hpp>
+
+#include <args/args.hxx>
+#include <nolhmann/json.hpp>
+
+using json = nlohmann::json;
+
+namespace buffer = xia::buffer;
+namespace list_mode = xia::pixie::data::list_mode;
+namespace util = xia::util;
+
+/*
+ * A benchmark. The body runs the iterations and returns the number of
+ * items and bytes processed by one iteration.
+ */
+struct benchmark {
+    struct work {
+        size_t items;
+        size_t bytes;
+    };
+    typedef std::function<work(size_t iterations)> body;
+
+    std::string name;
+    size_t iterations;
+    body run;
+};
+
+typedef std::vector<benchmark> benchmarks;
+
+/*
+ * Stops the compiler removing a result.
+ */
+static volatile size_t sink;
+
+static json run_benchmark(const benchmark& bm, size_t repeats) {
+    typedef std::chrono::steady_clock clock;
+    std::vector<double> nsecs;
+    benchmark::work done = {0, 0};
+    /*
+     * The first run warms the caches and allocations and is not reported.
+     */
+    bm.run(std::max(bm.iterations / 10, size_t(1)));
+    for (size_t r = 0; r < repeats; ++r) {
+        auto start = clock::now();
+        done = bm.run(bm.iterations);
+        auto end = clock::now();
+        nsecs.push_back(double(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+                                   .count()) /
+                        double(bm.iterations));
+    }
+    std::sort(nsecs.begin(), nsecs.end());
+    const double median = nsecs[nsecs.size() / 2];
+    json result;
+    result["name"] = bm.name;
+    result["iterations"] = bm.iterations;
+    result["repeats"] = repeats;
+    result["ns-per-iteration"] = {
+        {"min", nsecs.front()}, {"median", median}, {"max", nsecs.back()}};
+    result["items-per-iteration"] = done.items;
+    result["bytes-per-iteration"] = done.bytes;
+    if (median > 0) {
+        result["items-per-sec"] = double(done.items) * 1e9 / median;
+        result["bytes-per-sec"] = double(done.bytes) * 1e9 / median;
+    }
+    return result;
+}
+
+/*
+ * Buffer pool, queue and ring.
+ */
+static void buffer_benchmarks(benchmarks& bms) {
+    bms.push_back({"buffer/pool/request-release", 1000000, [](size_t iterations) {
+                       buffer::pool pool;
+                       pool.create(16, 1024);
+                       for (size_t i = 0; i < iterations; ++i) {
+                           auto buf = pool.request();
+                           sink = buf->capacity();
+                       }
+                       pool.destroy();
+                       return benchmark::work{1, 0};
+                   }});
+    /*
+     * The fill patterns are the words in each buffer pushed: full 64K word
+     * DMA blocks, quarter filled blocks and small 16 word blocks.
+     */
+    struct fill {
+        const char* label;
+        size_t words;
+    };
+    for (auto pattern : {fill{"full", 64 * 1024}, fill{"quarter", 16 * 1024},
+                         fill{"small", 16}}) {
+        const size_t words = pattern.words;
+        const size_t buffers = 32;
+        bms.push_back({std::string("buffer/queue/push-copy/") + pattern.label,
+                       (64 * 1024 * 1024) / (words * buffers),
+                       [words, buffers](size_t iterations) {
+                           buffer::pool pool;
+                           pool.create(buffers, 64 * 1024);
+                           buffer::queue queue;
+                           buffer::buffer out(words * buffers);
+                           for (size_t i = 0; i < iterations; ++i) {
+                               for (size_t b = 0; b < buffers; ++b) {
+                                   auto buf = pool.request();
+                                   buf->resize(words, buffer::buffer_value(b));
+                                   queue.push(buf);
+                               }
+                               sink = queue.copy(out.data(), out.size());
+                           }
+                           pool.destroy();
+                           return benchmark::work{buffers,
+                                                  words * buffers *
+                                                      sizeof(buffer::buffer_value)};
+                       }});
+        bms.push_back({std::string("buffer/queue/compact/") + pattern.label,
+                       (64 * 1024 * 1024) / (words * buffers),
+                       [words, buffers](size_t iterations) {
+                           buffer::pool pool;
+                           pool.create(buffers, 64 * 1024);
+                           buffer::queue queue;
+                           for (size_t i = 0; i < iterations; ++i) {
+                               for (size_t b = 0; b < buffers; ++b) {
+                                   auto buf = pool.request();
+                                   buf->resize(words, buffer::buffer_value(b));
+                                   queue.push(buf);
+                               }
+                               queue.compact();
+                               sink = queue.count();
+                               queue.flush();
+                           }
+                           pool.destroy();
+                           return benchmark::work{buffers,
+                                                  words * buffers *
+                                                      sizeof(buffer::buffer_value)};
+                       }});
+    }
+    bms.push_back({"buffer/ring/push-pop", 1000000, [](size_t iterations) {
+                       buffer::pool pool;
+                       pool.create(16, 1024);
+                       buffer::ring ring;
+                       ring.create(16);
+                       for (size_t i = 0; i < iterations; ++i) {
+                           auto buf = pool.request();
+                           buf->resize(1);
+                           ring.push(buf);
+                           buf.reset();
+                           sink = ring.pop()->size();
+                       }
+                       ring.destroy();
+                       pool.destroy();
+                       return benchmark::work{1, 0};
+                   }});
+}
+
+/*
+ * Make a block of list-mode records in the revision 34688, 500 MSPS layout.
+ */
+static list_mode::buffer make_records(size_t header_length, size_t trace_length,
+                                      size_t count) {
+    std::mt19937 random(1234);
+    std::uniform_int_distribution<uint32_t> energy(100, 30000);
+    std::uniform_int_distribution<uint32_t> channel(0, 15);
+    list_mode::buffer data;
+    const size_t event_length = header_length + trace_length / 2;
+    uint64_t time = 1000;
+    for (size_t e = 0; e < count; ++e) {
+        time += 1 + random() % 1000;
+        uint32_t header[list_mode::header_length::header_esum_qdc_ets] = {};
+        header[0] = channel(random) | (2 << 4) | (uint32_t(header_length) << 12) |
+            (uint32_t(event_length) << 17);
+        header[1] = uint32_t(time);
+        header[2] = uint32_t(time >> 32) & 0xffff;
+        header[3] = energy(random) | (uint32_t(trace_length) << 16);
+        data.insert(data.end(), header, header + header_length);
+        for (size_t w = 0; w < trace_length / 2; ++w) {
+            data.push_back(0x03e803e8 + uint32_t(w));
+        }
+    }
+    return data;
+}
+
+static void decode_benchmarks(benchmarks& bms) {
+    struct variant {
+        const char* label;
+        size_t length;
+    };
+    const variant variants[] = {
+        {"header", list_mode::header_length::header},
+        {"header-ets", list_mode::header_length::header_ets},
+        {"header-esum", list_mode::header_length::header_esum},
+        {"header-esum-ets", list_mode::header_length::header_esum_ets},
+        {"header-qdc", list_mode::header_length::header_qdc},
+        {"header-qdc-ets", list_mode::header_length::header_qdc_ets},
+        {"header-esum-qdc", list_mode::header_length::header_esum_qdc},
+        {"header-esum-qdc-ets", list_mode::header_length::header_esum_qdc_ets}};
+    const size_t events = 10000;
+    for (auto& v : variants) {
+        for (size_t trace_length : {size_t(0), size_t(500)}) {
+            auto data = std::make_shared<list_mode::buffer>(
+                make_records(v.length, trace_length, events));
+            std::string name = std::string("decode/") + v.label +
+                (trace_length == 0 ? "/no-trace" : "/trace-500");
+            bms.push_back({name, size_t(trace_length == 0 ? 200 : 20), [data](size_t iterations) {
+                               list_mode::record_arena arena;
+                               list_mode::buffer leftovers;
+                               for (size_t i = 0; i < iterations; ++i) {
+                                   list_mode::decode_data_block(data->data(), data->size(),
+                                                                34688, 500, arena, leftovers);
+                                   sink = arena.size();
+                               }
+                               return benchmark::work{events,
+                                                      data->size() * sizeof(uint32_t)};
+                           }});
+        }
+    }
+    /*
+     * Small blocks with the layout selected for each block and selected
+     * once by a decoder.
+     */
+    const size_t block_events = 16;
+    auto blocks = std::make_shared<list_mode::buffer>(
+        make_records(list_mode::header_length::header, 0, block_events));
+    bms.push_back({"decode/small-block/per-call", 100000, [blocks](size_t iterations) {
+                       list_mode::event_batch batch;
+                       list_mode::buffer leftovers;
+                       for (size_t i = 0; i < iterations; ++i) {
+                           batch.clear();
+                           list_mode::decode_data_block(blocks->data(), blocks->size(), 34688,
+                                                        500, batch, leftovers);
+                           sink = batch.size();
+                       }
+                       return benchmark::work{block_events, blocks->size() * sizeof(uint32_t)};
+                   }});
+    bms.push_back({"decode/small-block/decoder", 100000, [blocks](size_t iterations) {
+                       list_mode::decoder decoder(34688, 500);
+                       list_mode::event_batch batch;
+                       list_mode::buffer leftovers;
+                       for (size_t i = 0; i < iterations; ++i) {
+                           batch.clear();
+                           decoder.decode(blocks->data(), blocks->size(), batch, leftovers);
+                           sink = batch.size();
+                       }
+                       return benchmark::work{block_events, blocks->size() * sizeof(uint32_t)};
+                   }});
+}
+
+/*
+ * Baseline, CFD and PSD processing of a batch of decoded traces.
+ */
+static void trace_benchmarks(benchmarks& bms) {
+    const size_t events = 1000;
+    const size_t trace_length = 500;
+    auto data = std::make_shared<list_mode::buffer>(
+        make_records(list_mode::header_length::header, trace_length, events));
+    auto batch = std::make_shared<list_mode::event_batch>();
+    list_mode::buffer leftovers;
+    list_mode::decode_data_block(data->data(), data->size(), 34688, 500, *batch, leftovers);
+    for (size_t smoothing : {size_t(0), size_t(4)}) {
+        std::string name = std::string("trace/process/trace-500") +
+            (smoothing == 0 ? "" : "/smoothed");
+        bms.push_back({name, 100, [batch, smoothing](size_t iterations) {
+                           xia::pixie::data::trace::config cfg;
+                           cfg.smoothing = smoothing;
+                           xia::pixie::data::trace::results results;
+                           for (size_t i = 0; i < iterations; ++i) {
+                               xia::pixie::data::trace::process(*batch, cfg, results);
+                               sink = results.size();
+                           }
+                           return benchmark::work{events, batch->traces.size() *
+                                                      sizeof(list_mode::event_batch::trace_value)};
+                       }});
+    }
+}
+
+/*
+ * Energy recomputation of a batch of events from the energy sums.
+ */
+static void energy_benchmarks(benchmarks& bms) {
+    const size_t events = 10000;
+    auto data = std::make_shared<list_mode::buffer>(
+        make_records(list_mode::header_length::header_esum, 0, events));
+    auto batch = std::make_shared<list_mode::event_batch>();
+    list_mode::buffer leftovers;
+    list_mode::decode_data_block(data->data(), data->size(), 34688, 500, *batch, leftovers);
+    auto filters = std::make_shared<xia::pixie::data::energy::filters>(16);
+    for (auto& filt : *filters) {
+        filt.rise_time_usecs = 1;
+        filt.flat_top_usecs = 0.5;
+        filt.tau_usecs = 50;
+        filt.sample_usecs = 0.008;
+    }
+    bms.push_back({"energy/recompute", 1000, [batch, filters](size_t iterations) {
+                       xia::pixie::data::energy::results results;
+                       for (size_t i = 0; i < iterations; ++i) {
+                           xia::pixie::data::energy::recompute(*batch, *filters, results);
+                           sink = results.size();
+                       }
+                       return benchmark::work{events, batch->energy_sums.size() *
+                                                  sizeof(uint32_t)};
+                   }});
+}
+
+/*
+ * CRC32 and IEEE float conversions.
+ */
+static void util_benchmarks(benchmarks& bms) {
+    for (size_t words : {size_t(16), size_t(64 * 1024)}) {
+        auto data = std::make_shared<std::vector<uint32_t>>(words);
+        std::mt19937 random(5678);
+        for (auto& w : *data) {
+            w = random();
+        }
+        bms.push_back({"util/crc32/update/" + std::to_string(words) + "-words",
+                       (256 * 1024 * 1024) / (words * sizeof(uint32_t)),
+                       [data](size_t iterations) {
+                           for (size_t i = 0; i < iterations; ++i) {
+                               util::crc32 crc;
+                               crc.update(*data);
+                               sink = crc.value;
+                           }
+                           return benchmark::work{1, data->size() * sizeof(uint32_t)};
+                       }});
+    }
+    auto values = std::make_shared<std::vector<double>>(1024);
+    std::mt19937 random(91011);
+    std::uniform_real_distribution<double> dist(-1e6, 1e6);
+    for (auto& v : *values) {
+        v = dist(random);
+    }
+    bms.push_back({"util/ieee-float/from-double", 10000, [values](size_t iterations) {
+                       size_t sum = 0;
+                       for (size_t i = 0; i < iterations; ++i) {
+                           for (auto v : *values) {
+                               util::ieee_float f(v);
+                               sum += util::ieee_float::value_type(f);
+                           }
+                       }
+                       sink = sum;
+                       return benchmark::work{values->size(), 0};
+                   }});
+    bms.push_back({"util/ieee-float/to-double", 10000, [values](size_t iterations) {
+                       std::vector<util::ieee_float> floats;
+                       for (auto v : *values) {
+                           floats.emplace_back(v);
+                       }
+                       double sum = 0;
+                       for (size_t i = 0; i < iterations; ++i) {
+                           for (auto& f : floats) {
+                               sum += double(f);
+                           }
+                       }
+                       sink = size_t(sum);
+                       return benchmark::work{floats.size(), 0};
+                   }});
+}
+
+int main(int argc, char* argv[]) {
+    args::ArgumentParser parser("Microbenchmarks of the PixieSDK hot paths.");
+    parser.LongSeparator("=");
+    args::HelpFlag help(parser, "help", "Display this help menu", {'h', "help"});
+    args::ValueFlag<size_t> repeats_flag(parser, "repeats", "The number of timed runs",
+                                         {'r', "repeats"}, 5);
+    args::ValueFlag<std::string> filter_flag(parser, "filter",
+                                             "Run the benchmarks matching the regex",
+                                             {'f', "filter"}, "");
+    args::ValueFlag<std::string> output_flag(parser, "output",
+                                             "The JSON output file, stdout if not set",
+                                             {'o', "output"}, "");
+    args::Flag list_flag(parser, "list", "List the benchmarks", {'l', "list"});
+
+    try {
+        parser.ParseCLI(argc, argv);
+    } catch (args::Help&) {
+        std::cout << parser;
+        return EXIT_SUCCESS;
+    } catch (args::Error& e) {
+        std::cerr << e.what() << std::endl << parser;
+        return EXIT_FAILURE;
+    }
+
+    benchmarks bms;
+    buffer_benchmarks(bms);
+    decode_benchmarks(bms);
+    trace_benchmarks(bms);
+    energy_benchmarks(bms);
+    util_benchmarks(bms);
+
+    if (list_flag) {
+        for (auto& bm : bms) {
+            std::cout << bm.name << std::endl;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    const size_t repeats = std::max(args::get(repeats_flag), size_t(1));
+    const std::regex filter(args::get(filter_flag));
+
+    json results;
+    results["suite"] = "pixie-sdk-benchmarks";
+    results["format-version"] = 1;
+    results["benchmarks"] = json::array();
+
+    try {
+        for (auto& bm : bms) {
+            if (!args::get(filter_flag).empty() && !std::regex_search(bm.name, filter)) {
+                continue;
+            }
+            std::cerr << "benchmark: " << bm.name << std::endl;
+            results["benchmarks"].push_back(run_benchmark(bm, repeats));
+        }
+    } catch (std::exception& e) {
+        std::cerr << "error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (args::get(output_flag).empty()) {
+        std::cout << results.dump(2) << std::endl;
+    } else {
+        std::ofstream out(args::get(output_flag));
+        if (!out) {
+            std::cerr << "error: cannot open: " << args::get(output_flag) << std::endl;
+            return EXIT_FAILURE;
+        }
+        out << results.dump(2) << std::endl;
+    }
+
+    return EXIT_SUCCESS;
+}
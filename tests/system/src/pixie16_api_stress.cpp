@@ -0,0 +1,449 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2022 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file pixie16_api_stress.cpp
+ * @brief Concurrency stress of the Pixie16 C API.
+ *
+ * A mix of threads calls the API concurrently for a fixed time, for example
+ * a FIFO reader per module, slow control parameter readers and writers and
+ * statistics pollers. The latency percentiles of each call and the modules'
+ * lock wait statistics are reported as JSON so lock contention regressions
+ * can be measured. Run it against hardware or set PIXIE16_SIM_MODULE_DEFS to
+ * a module definitions file to run against the simulated crate. The program
+ * is built with its own copy of the API with the simulated crate.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pixie16/pixie16.h>
+
+#include <args/args.hxx>
+#include <nolhmann/json.hpp>
+
+using json = nlohmann::json;
+
+typedef std::chrono::steady_clock clock_type;
+
+/*
+ * The latencies and errors of a call.
+ */
+struct call_stats {
+    std::vector<uint64_t> nsecs;
+    size_t errors;
+
+    call_stats() : errors(0) {}
+};
+
+typedef std::map<std::string, call_stats> calls;
+
+/*
+ * A worker thread. The body makes one round of calls and records them.
+ */
+struct worker {
+    typedef std::function<void(calls&)> body;
+
+    std::string name;
+    body round;
+    calls stats;
+    std::thread thread;
+};
+
+typedef std::vector<std::unique_ptr<worker>> workers;
+
+/*
+ * Time a call. The API returns a negative value on error.
+ */
+template<typename Call>
+static int timed(calls& stats, const char* name, Call call) {
+    auto start = clock_type::now();
+    int rc = call();
+    auto end = clock_type::now();
+    auto& s = stats[name];
+    s.nsecs.push_back(
+        uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()));
+    if (rc < 0) {
+        ++s.errors;
+    }
+    return rc;
+}
+
+static double percentile(const std::vector<uint64_t>& sorted, double pc) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    auto index = size_t(pc / 100 * double(sorted.size() - 1) + 0.5);
+    return double(sorted[std::min(index, sorted.size() - 1)]) / 1000.0;
+}
+
+static json report_calls(const calls& stats, double secs) {
+    json result = json::object();
+    for (auto& entry : stats) {
+        auto sorted = entry.second.nsecs;
+        std::sort(sorted.begin(), sorted.end());
+        uint64_t total = 0;
+        for (auto ns : sorted) {
+            total += ns;
+        }
+        json call;
+        call["count"] = sorted.size();
+        call["errors"] = entry.second.errors;
+        call["calls-per-sec"] = secs > 0 ? double(sorted.size()) / secs : 0;
+        call["usecs"] = {
+            {"mean", sorted.empty() ? 0 : double(total) / double(sorted.size()) / 1000.0},
+            {"p50", percentile(sorted, 50)},
+            {"p90", percentile(sorted, 90)},
+            {"p99", percentile(sorted, 99)},
+            {"p99.9", percentile(sorted, 99.9)},
+            {"max", sorted.empty() ? 0 : double(sorted.back()) / 1000.0}};
+        result[entry.first] = call;
+    }
+    return result;
+}
+
+static void merge(calls& into, const calls& from) {
+    for (auto& entry : from) {
+        auto& s = into[entry.first];
+        s.nsecs.insert(s.nsecs.end(), entry.second.nsecs.begin(), entry.second.nsecs.end());
+        s.errors += entry.second.errors;
+    }
+}
+
+static json report_locks(unsigned short mod_num) {
+    module_lock_stats stats;
+    json result;
+    if (PixieReadLockStats(mod_num, &stats, 0) < 0) {
+        result["error"] = "lock stats read failed";
+        return result;
+    }
+    result["module"] = {{"locks", stats.locks},
+                        {"waits", stats.lock_waits},
+                        {"max-wait-usecs", stats.lock_max_wait_usecs},
+                        {"total-wait-usecs", stats.lock_total_wait_usecs}};
+    result["bus"] = {{"holds", stats.bus_holds},
+                     {"waits", stats.bus_waits},
+                     {"max-wait-usecs", stats.bus_max_wait_usecs},
+                     {"total-wait-usecs", stats.bus_total_wait_usecs},
+                     {"max-hold-usecs", stats.bus_max_hold_usecs},
+                     {"total-hold-usecs", stats.bus_total_hold_usecs},
+                     {"fifo-waits", stats.bus_fifo_waits}};
+    return result;
+}
+
+/*
+ * The simulated modules boot with any firmware files so write empty ones.
+ */
+static std::string sim_firmware_file(const std::string& device) {
+    auto name = "pixie16_api_stress.sim." + device;
+    std::ofstream out(name);
+    out << "sim" << std::endl;
+    return name;
+}
+
+static void check(const char* label, int rc) {
+    if (rc < 0) {
+        throw std::runtime_error(std::string(label) + ": error code=" + std::to_string(rc));
+    }
+}
+
+int main(int argc, char* argv[]) {
+    args::ArgumentParser parser("Concurrency stress of the Pixie16 C API.",
+                                "Set PIXIE16_SIM_MODULE_DEFS to a module definitions file to "
+                                "run against the simulated crate.");
+    parser.LongSeparator("=");
+    args::HelpFlag help(parser, "help", "Display this help menu", {'h', "help"});
+    args::ValueFlag<std::string> sys_flag(parser, "sys", "The system FPGA firmware file",
+                                          {"sys"}, "");
+    args::ValueFlag<std::string> fippi_flag(parser, "fippi", "The FIPPI FPGA firmware file",
+                                            {"fippi"}, "");
+    args::ValueFlag<std::string> dsp_flag(parser, "dsp", "The DSP code file", {"dsp"}, "");
+    args::ValueFlag<std::string> var_flag(parser, "var", "The DSP variable file", {"var"}, "");
+    args::ValueFlag<std::string> settings_flag(parser, "settings", "The DSP settings file",
+                                               {"settings"}, "");
+    args::ValueFlag<unsigned int> duration_flag(parser, "duration", "The run time in seconds",
+                                                {'d', "duration"}, 10);
+    args::ValueFlag<unsigned int> period_flag(
+        parser, "period", "The minimum period of a thread's rounds in usecs", {'p', "period"}, 0);
+    args::ValueFlag<unsigned int> fifo_flag(parser, "fifo-readers",
+                                            "The FIFO reader threads per module",
+                                            {"fifo-readers"}, 1);
+    args::ValueFlag<unsigned int> chanpar_flag(parser, "chanpar-readers",
+                                               "The channel parameter reader threads",
+                                               {"chanpar-readers"}, 1);
+    args::ValueFlag<unsigned int> chanpar_write_flag(parser, "chanpar-writers",
+                                                     "The channel parameter writer threads",
+                                                     {"chanpar-writers"}, 0);
+    args::ValueFlag<unsigned int> modpar_flag(parser, "modpar-readers",
+                                              "The module parameter reader threads",
+                                              {"modpar-readers"}, 0);
+    args::ValueFlag<unsigned int> stats_flag(parser, "stats-pollers",
+                                             "The statistics poller threads", {"stats-pollers"},
+                                             1);
+    args::ValueFlag<unsigned int> status_flag(parser, "status-pollers",
+                                              "The run status poller threads",
+                                              {"status-pollers"}, 0);
+    args::Flag list_mode_flag(parser, "list-mode", "Run list-mode while the threads run",
+                              {'l', "list-mode"});
+    args::ValueFlag<std::string> output_flag(parser, "output",
+                                             "The JSON output file, stdout if not set",
+                                             {'o', "output"}, "");
+    args::PositionalList<unsigned short> slots_flag(parser, "slots", "The slot of each module");
+
+    try {
+        parser.ParseCLI(argc, argv);
+    } catch (args::Help&) {
+        std::cout << parser;
+        return EXIT_SUCCESS;
+    } catch (args::Error& e) {
+        std::cerr << e.what() << std::endl << parser;
+        return EXIT_FAILURE;
+    }
+
+    auto slots = args::get(slots_flag);
+    if (slots.empty()) {
+        std::cerr << "error: no slots" << std::endl << parser;
+        return EXIT_FAILURE;
+    }
+    const auto num_modules = static_cast<unsigned short>(slots.size());
+    const bool simulate = std::getenv("PIXIE16_SIM_MODULE_DEFS") != nullptr;
+
+    json results;
+    results["suite"] = "pixie16-api-stress";
+    results["format-version"] = 1;
+    results["simulate"] = simulate;
+
+    try {
+        check("init", Pixie16InitSystem(num_modules, slots.data(), 0));
+
+        std::string sys = args::get(sys_flag);
+        std::string fippi = args::get(fippi_flag);
+        std::string dsp = args::get(dsp_flag);
+        std::string var = args::get(var_flag);
+        std::string settings = args::get(settings_flag);
+        unsigned short boot_pattern = 0x7F;
+        if (simulate) {
+            sys = sys.empty() ? sim_firmware_file("sys") : sys;
+            fippi = fippi.empty() ? sim_firmware_file("fippi") : fippi;
+            dsp = dsp.empty() ? sim_firmware_file("dsp") : dsp;
+            var = var.empty() ? sim_firmware_file("var") : var;
+        }
+        if (settings.empty()) {
+            /*
+             * No settings file, boot without loading the DSP parameters.
+             */
+            boot_pattern &= ~(1 << 4);
+        }
+        check("boot", Pixie16BootModule(sys.c_str(), fippi.c_str(), nullptr, dsp.c_str(),
+                                        settings.c_str(), var.c_str(), num_modules,
+                                        boot_pattern));
+
+        std::vector<unsigned short> channels(num_modules);
+        for (unsigned short mod = 0; mod < num_modules; ++mod) {
+            module_config cfg;
+            check("module info", PixieGetModuleInfo(mod, &cfg));
+            channels[mod] = cfg.number_of_channels;
+        }
+
+        workers threads;
+        auto add = [&threads](const std::string& name, worker::body round) {
+            threads.push_back(std::unique_ptr<worker>(new worker));
+            threads.back()->name = name;
+            threads.back()->round = round;
+        };
+
+        for (unsigned short mod = 0; mod < num_modules; ++mod) {
+            for (unsigned int t = 0; t < args::get(fifo_flag); ++t) {
+                auto data = std::make_shared<std::vector<unsigned int>>(EXTFIFO_READ_THRESH * 64);
+                add("fifo-reader", [mod, data](calls& stats) {
+                    unsigned int words = 0;
+                    int rc = timed(stats, "Pixie16CheckExternalFIFOStatus", [&words, mod] {
+                        return Pixie16CheckExternalFIFOStatus(&words, mod);
+                    });
+                    if (rc >= 0 && words > 0) {
+                        words = std::min(words, static_cast<unsigned int>(data->size()));
+                        timed(stats, "Pixie16ReadDataFromExternalFIFO", [&words, &data, mod] {
+                            return Pixie16ReadDataFromExternalFIFO(data->data(), words, mod);
+                        });
+                    }
+                });
+            }
+        }
+
+        for (unsigned int t = 0; t < args::get(chanpar_flag); ++t) {
+            add("chanpar-reader", [num_modules, channels](calls& stats) {
+                for (unsigned short mod = 0; mod < num_modules; ++mod) {
+                    for (unsigned short chan = 0; chan < channels[mod]; ++chan) {
+                        double value;
+                        timed(stats, "Pixie16ReadSglChanPar", [&value, mod, chan] {
+                            return Pixie16ReadSglChanPar("TRIGGER_THRESHOLD", &value, mod, chan);
+                        });
+                    }
+                }
+            });
+        }
+
+        for (unsigned int t = 0; t < args::get(chanpar_write_flag); ++t) {
+            add("chanpar-writer", [num_modules, channels](calls& stats) {
+                for (unsigned short mod = 0; mod < num_modules; ++mod) {
+                    for (unsigned short chan = 0; chan < channels[mod]; ++chan) {
+                        double value;
+                        if (Pixie16ReadSglChanPar("TRIGGER_THRESHOLD", &value, mod, chan) >= 0) {
+                            timed(stats, "Pixie16WriteSglChanPar", [value, mod, chan] {
+                                return Pixie16WriteSglChanPar("TRIGGER_THRESHOLD", value, mod,
+                                                              chan);
+                            });
+                        }
+                    }
+                }
+            });
+        }
+
+        for (unsigned int t = 0; t < args::get(modpar_flag); ++t) {
+            add("modpar-reader", [num_modules](calls& stats) {
+                for (unsigned short mod = 0; mod < num_modules; ++mod) {
+                    unsigned int value;
+                    timed(stats, "Pixie16ReadSglModPar", [&value, mod] {
+                        return Pixie16ReadSglModPar("SLOW_FILTER_RANGE", &value, mod);
+                    });
+                }
+            });
+        }
+
+        for (unsigned int t = 0; t < args::get(stats_flag); ++t) {
+            auto statistics = std::make_shared<std::vector<unsigned int>>(
+                Pixie16GetStatisticsSize() / sizeof(unsigned int) + 1);
+            add("stats-poller", [num_modules, statistics](calls& stats) {
+                for (unsigned short mod = 0; mod < num_modules; ++mod) {
+                    timed(stats, "Pixie16ReadStatisticsFromModule", [&statistics, mod] {
+                        return Pixie16ReadStatisticsFromModule(statistics->data(), mod);
+                    });
+                }
+            });
+        }
+
+        for (unsigned int t = 0; t < args::get(status_flag); ++t) {
+            add("status-poller", [num_modules](calls& stats) {
+                for (unsigned short mod = 0; mod < num_modules; ++mod) {
+                    timed(stats, "Pixie16CheckRunStatus",
+                          [mod] { return Pixie16CheckRunStatus(mod); });
+                }
+            });
+        }
+
+        if (list_mode_flag) {
+            check("list-mode start", Pixie16StartListModeRun(num_modules, LIST_MODE_RUN, NEW_RUN));
+        }
+
+        for (unsigned short mod = 0; mod < num_modules; ++mod) {
+            module_lock_stats reset;
+            check("lock stats reset", PixieReadLockStats(mod, &reset, 1));
+        }
+
+        std::atomic_bool running(true);
+        const auto period = std::chrono::microseconds(args::get(period_flag));
+        auto start = clock_type::now();
+        for (auto& w : threads) {
+            auto wp = w.get();
+            wp->thread = std::thread([wp, &running, period] {
+                while (running) {
+                    auto round_start = clock_type::now();
+                    wp->round(wp->stats);
+                    if (period.count() != 0) {
+                        std::this_thread::sleep_until(round_start + period);
+                    }
+                }
+            });
+        }
+
+        std::this_thread::sleep_for(std::chrono::seconds(args::get(duration_flag)));
+        running = false;
+        for (auto& w : threads) {
+            w->thread.join();
+        }
+        const double secs =
+            std::chrono::duration<double>(clock_type::now() - start).count();
+
+        json modules = json::array();
+        for (unsigned short mod = 0; mod < num_modules; ++mod) {
+            json module;
+            module["number"] = mod;
+            module["slot"] = slots[mod];
+            module["locks"] = report_locks(mod);
+            modules.push_back(module);
+        }
+
+        if (list_mode_flag) {
+            check("list-mode end", Pixie16EndRun(num_modules));
+        }
+
+        calls all;
+        std::map<std::string, calls> by_thread;
+        for (auto& w : threads) {
+            merge(all, w->stats);
+            merge(by_thread[w->name], w->stats);
+        }
+
+        json mix = json::object();
+        for (auto& entry : by_thread) {
+            mix[entry.first] = size_t(std::count_if(
+                threads.begin(), threads.end(),
+                [&entry](const std::unique_ptr<worker>& w) { return w->name == entry.first; }));
+        }
+
+        results["modules"] = modules;
+        results["duration-secs"] = secs;
+        results["threads"] = mix;
+        results["calls"] = report_calls(all, secs);
+        json thread_calls = json::object();
+        for (auto& entry : by_thread) {
+            thread_calls[entry.first] = report_calls(entry.second, secs);
+        }
+        results["thread-calls"] = thread_calls;
+
+        Pixie16ExitSystem(num_modules);
+    } catch (std::exception& e) {
+        std::cerr << "error: " << e.what() << std::endl;
+        Pixie16ExitSystem(num_modules);
+        return EXIT_FAILURE;
+    }
+
+    if (args::get(output_flag).empty()) {
+        std::cout << results.dump(2) << std::endl;
+    } else {
+        std::ofstream out(args::get(output_flag));
+        if (!out) {
+            std::cerr << "error: cannot open: " << args::get(output_flag) << std::endl;
+            return EXIT_FAILURE;
+        }
+        out << results.dump(2) << std::endl;
+    }
+
+    return EXIT_SUCCESS;
+}
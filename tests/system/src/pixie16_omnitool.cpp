@@ -31,12 +31,19 @@
 #include <sstream>
 
 #include <pixie/config.hpp>
+#include <pixie/eeprom.hpp>
 #include <pixie/log.hpp>
+#include <pixie/profile.hpp>
+#include <pixie/shm.hpp>
 #include <pixie/util.hpp>
 
 #include <pixie/pixie16/crate.hpp>
+#include <pixie/pixie16/ipc.hpp>
 #include <pixie/pixie16/legacy.hpp>
+#include <pixie/pixie16/lmc.hpp>
 #include <pixie/pixie16/memory.hpp>
+#include <pixie/pixie16/scope.hpp>
+#include <pixie/pixie16/server.hpp>
 #include <pixie/pixie16/sim.hpp>
 
 #include <pixie/pixie16/fpga_comms.hpp>
@@ -209,6 +216,15 @@ static const command adj_off_cmd = {
     "adj-off modules(s)"
 };
 
+command_handler_decl(bench);
+static const command bench_cmd = {
+    "bench", bench,
+    {},
+    {"init", "probe"},
+    "Benchmark the list-mode throughput of modules reporting in JSON",
+    "bench [-w key=value,..] [-g key=value,..] [-o file] module(s) secs"
+};
+
 command_handler_decl(bl_acq);
 static const command bl_acq_cmd = {
     "bl-acq", bl_acq,
@@ -227,6 +243,15 @@ static const command bl_save_cmd = {
     "bl-save module(s) [channel(s)]"
 };
 
+command_handler_decl(bl_stats);
+static const command bl_stats_cmd = {
+    "bl-stats", bl_stats,
+    {},
+    {"init", "probe"},
+    "Report the noise figures of the module's baselines",
+    "bl-stats module(s) [channel(s)]"
+};
+
 command_handler_decl(boot);
 static const command boot_cmd = {
     "boot", boot,
@@ -245,6 +270,15 @@ static const command crate_cmd = {
     "crate"
 };
 
+command_handler_decl(crate_serve);
+static const command crate_serve_cmd = {
+    "crate-serve", crate_serve,
+    {},
+    {"init", "probe"},
+    "Serve the crate to local clients with the list-mode data in a shared memory ring",
+    "crate-serve secs socket [ring]"
+};
+
 command_handler_decl(db);
 static const command db_cmd = {
     "db", db,
@@ -259,8 +293,9 @@ static const command export_cmd = {
     "export", export_,
     {},
     {"init", "probe"},
-    "Export a configuration to a JSON file",
-    "export file"
+    "Export a configuration to a JSON file or a binary snapshot (-s), "
+    "add '-a snapshot' to also write a snapshot",
+    "export [-s] [-a snapshot] file"
 };
 
 command_handler_decl(help);
@@ -272,6 +307,16 @@ static const command help_cmd = {
     "help [-l] [command]"
 };
 
+command_handler_decl(hist_export);
+static const command hist_export_cmd = {
+    "hist-export", hist_export,
+    {},
+    {"init", "probe"},
+    "Read the modules' histograms in parallel and save them to a binary file, "
+    "add '-d' for the self-describing format",
+    "hist-export [-d] [-b bins] file module(s)"
+};
+
 command_handler_decl(hist_resume);
 static const command hist_resume_cmd = {
     "hist-resume", hist_resume,
@@ -304,8 +349,9 @@ static const command import_cmd = {
     "import", import,
     {},
     {"init", "probe"},
-    "Import a JSON configuration file",
-    "import file"
+    "Import a JSON configuration file or a binary snapshot. "
+    "Changes only (-c) syncs the changed values and the hardware they need.",
+    "import [-c] file"
 };
 
 command_handler_decl(list_mode);
@@ -313,7 +359,7 @@ static const command list_mode_cmd = {
     "list-mode", list_mode,
     {"lm"},
     {"init", "probe"},
-    "Run list mode saving the data to a file",
+    "Run list mode saving the data to a file, .lmc is compressed",
     "list-mode module(s) secs file"
 };
 
@@ -331,10 +377,19 @@ static const command list_save_cmd = {
     "list-save", list_save,
     {"ls"},
     {"init", "probe"},
-    "Save a module's list-mode data to a file",
+    "Save a module's list-mode data to a file, .lmc is compressed, shm:name publishes",
     "list-save module(s) secs file"
 };
 
+command_handler_decl(list_serve);
+static const command list_serve_cmd = {
+    "list-serve", list_serve,
+    {},
+    {"init", "probe"},
+    "Stream the modules' list-mode data to TCP clients",
+    "list-serve module(s) secs port"
+};
+
 command_handler_decl(list_start);
 static const command list_start_cmd = {
     "list-start", list_start,
@@ -344,6 +399,15 @@ static const command list_start_cmd = {
     "list-start module(s)"
 };
 
+command_handler_decl(list_timed);
+static const command list_timed_cmd = {
+    "list-timed", list_timed,
+    {"lt"},
+    {"init", "probe"},
+    "Run list mode on all modules for a time, -p uses the firmware run time preset",
+    "list-timed [-p] secs"
+};
+
 command_handler_decl(lset_import);
 static const command lset_import_cmd = {
     "lset-import", lset_import,
@@ -389,6 +453,15 @@ static const command par_write_cmd = {
     "par-write module(s) [channel(s)] param value"
 };
 
+command_handler_decl(profile);
+static const command profile_cmd = {
+    "profile", profile,
+    {},
+    {"none"},
+    "Control the profiler and output the timings of profiled sites",
+    "profile [on/off/dump/reset]"
+};
+
 command_handler_decl(report);
 static const command report_cmd = {
     "report", report,
@@ -398,6 +471,16 @@ static const command report_cmd = {
     "report file"
 };
 
+command_handler_decl(rates);
+static const command rates_cmd = {
+    "rates", rates,
+    {},
+    {"init", "probe"},
+    "Read the modules' stats together at a period and report the interval "
+    "count rates",
+    "rates [-p period-msecs] [-n reads] module(s) [channel(s)]"
+};
+
 command_handler_decl(reg_read);
 static const command reg_read_cmd = {
     "reg-read", reg_read,
@@ -434,6 +517,16 @@ static const command run_end_cmd = {
     "run-end module(s)"
 };
 
+command_handler_decl(scope);
+static const command scope_cmd = {
+    "scope", scope,
+    {},
+    {"init", "probe"},
+    "Stream the modules' ADC traces in the background for a period and report the "
+    "acquisition rate",
+    "scope [-p period-msecs] secs module(s) [channel(s)]"
+};
+
 command_handler_decl(set_dacs);
 static const command set_dacs_cmd = {
     "set-dacs", set_dacs,
@@ -452,6 +545,28 @@ static const command stats_cmd = {
     "stats [-s stat (pe/ocr/rt/lt)] module(s) [channel(s)]"
 };
 
+command_handler_decl(sweep);
+static const command sweep_cmd = {
+    "sweep", sweep,
+    {"sw"},
+    {"init", "probe"},
+    "Sweep parameters over a range running the modules concurrently. "
+    "The parameters are nested loops with the first the outermost. "
+    "A range is start:end[:step] or a list of values.",
+    "sweep [-o file] [-c channel(s)] module(s) param=range [param=range ..] "
+    "hist secs/read"
+};
+
+command_handler_decl(tau_fit);
+static const command tau_fit_cmd = {
+    "tau-fit", tau_fit,
+    {},
+    {"init", "probe"},
+    "Fit the preamplifier decay time of channels from their ADC traces on the host. "
+    "Write the fitted taus to the channels with '-w'.",
+    "tau-fit [-w] [-n captures] module(s) [channel(s)]"
+};
+
 command_handler_decl(test);
 static const command test_cmd = {
     "test", test,
@@ -494,13 +609,17 @@ static const command_map commands = {
     {"adc-acq", adc_acq_cmd},
     {"adc-save", adc_save_cmd},
     {"adj-off", adj_off_cmd},
+    {"bench", bench_cmd},
     {"bl-acq", bl_acq_cmd},
     {"bl-save", bl_save_cmd},
+    {"bl-stats", bl_stats_cmd},
     {"boot", boot_cmd},
     {"crate", crate_cmd},
+    {"crate-serve", crate_serve_cmd},
     {"db", db_cmd},
     {"export", export_cmd},
     {"help", help_cmd},
+    {"hist-export", hist_export_cmd},
     {"hist-resume", hist_resume_cmd},
     {"hist-save", hist_save_cmd},
     {"hist-start", hist_start_cmd},
@@ -508,19 +627,26 @@ static const command_map commands = {
     {"list-mode", list_mode_cmd},
     {"list-resume", list_resume_cmd},
     {"list-save", list_save_cmd},
+    {"list-serve", list_serve_cmd},
     {"list-start", list_start_cmd},
+    {"list-timed", list_timed_cmd},
     {"lset-import", lset_import_cmd},
     {"lset-load", lset_load_cmd},
     {"lset-report", lset_report_cmd},
     {"par-read", par_read_cmd},
     {"par-write", par_write_cmd},
+    {"profile", profile_cmd},
+    {"rates", rates_cmd},
     {"reg-read", reg_read_cmd},
     {"reg-write", reg_write_cmd},
     {"report", report_cmd},
     {"run-active", run_active_cmd},
     {"run-end", run_end_cmd},
+    {"scope", scope_cmd},
     {"set-dacs", set_dacs_cmd},
     {"stats", stats_cmd},
+    {"sweep", sweep_cmd},
+    {"tau-fit", tau_fit_cmd},
     {"test", test_cmd},
     {"var-read", var_read_cmd},
     {"var-write", var_write_cmd},
@@ -1165,12 +1291,13 @@ void module_threads(
     using future_error = std::future<error::code>;
     std::vector<promise_error> promises(mod_nums.size());
     std::vector<future_error> futures;
-    std::vector<std::thread> threads;
+    std::vector<std::future<void>> tasks;
+    auto& pool = crate.workers();
     for (size_t m = 0; m < mod_nums.size(); ++m) {
         auto module = crate.modules[mod_nums[m]];
         auto& worker = workers[m];
         futures.push_back(future_error(promises[m].get_future()));
-        threads.push_back(std::thread([args, m, &promises, module, &worker] {
+        tasks.push_back(pool.submit(mod_nums[m], [args, m, &promises, module, &worker] {
             try {
                 worker.running = true;
                 worker.worker(args.opts, *module);
@@ -1191,9 +1318,9 @@ void module_threads(
     size_t show_secs = 5;
     xia::util::timepoint duration(true);
     xia::util::timepoint interval(true);
-    while (finished != threads.size()) {
-        finished = threads.size();
-        for (size_t t = 0; t < threads.size(); ++t) {
+    while (finished != tasks.size()) {
+        finished = tasks.size();
+        for (size_t t = 0; t < tasks.size(); ++t) {
             auto& future = futures[t];
             if (future.valid()) {
                 auto zero = std::chrono::seconds(0);
@@ -1208,7 +1335,7 @@ void module_threads(
                     if (first_error == error::code::success) {
                         first_error = e;
                     }
-                    threads[t].join();
+                    tasks[t].get();
                 } else {
                     --finished;
                 }
@@ -1218,7 +1345,7 @@ void module_threads(
         if (show_performance && interval.secs() > show_secs) {
             auto secs = interval.secs();
             interval.restart();
-            args.opts.out << "running: " << threads.size() - finished << std::endl;
+            args.opts.out << "running: " << tasks.size() - finished << std::endl;
             size_t all_total = 0;
             for (auto& w : workers) {
                 if (w.period.secs() > 0) {
@@ -1349,12 +1476,8 @@ static void adc_save(command_args& args) {
     for (auto mod_num : mod_nums) {
         xia::pixie::channel::range channels;
         channels_option(channels, chans_opt, crate[mod_num].num_channels);
-        std::vector<xia::pixie::hw::adc_trace> traces;
-        for (auto channel : channels) {
-            xia::pixie::hw::adc_trace adc_trace(length);
-            crate[mod_num].read_adc(channel, adc_trace, false);
-            traces.push_back(adc_trace);
-        }
+        xia::pixie::hw::adc_traces traces(channels.size(), xia::pixie::hw::adc_trace(length));
+        crate[mod_num].read_adcs(channels, traces, false);
         std::ostringstream name;
         name << std::setfill('0') << adc_prefix
              << '-' << std::setw(2) << mod_num << ".csv";
@@ -1391,6 +1514,262 @@ static void adj_off(command_args& args) {
     }
 }
 
+struct bench_worker : public module_thread_worker {
+    size_t seconds;
+    size_t cpu_usecs;
+    xia::pixie::module::module::fifo_stats stats;
+    xia::pixie::module::fifo_tuning tuning;
+
+    bench_worker();
+    void worker(
+        process_command_options& process_opts,
+        xia::pixie::module::module& module);
+};
+
+bench_worker::bench_worker() : seconds(0), cpu_usecs(0) {}
+
+void bench_worker::worker(
+    process_command_options& , xia::pixie::module::module& module) {
+    using namespace xia::pixie::hw::run;
+    /*
+     * The data is taken from the queue without a copy so the benchmark
+     * measures the SDK's data path.
+     */
+    xia::buffer::queue::handles buffers;
+    const size_t poll_period_usecs = 10 * 1000;
+    const size_t cpu_start = module.fifo_worker_cpu_usecs();
+    module.start_listmode(run_mode::new_run);
+    total = 0;
+    period.start();
+    while (period.secs() < seconds) {
+        auto words = module.read_list_mode(buffers);
+        buffers.clear();
+        if (words > 0) {
+            total += words;
+        } else {
+            xia::pixie::hw::wait(poll_period_usecs);
+        }
+    }
+    module.run_end();
+    total += module.read_list_mode(buffers);
+    buffers.clear();
+    period.end();
+    cpu_usecs = module.fifo_worker_cpu_usecs() - cpu_start;
+    stats = module.run_stats;
+    tuning = module.get_fifo_tuning();
+}
+
+static void bench_settings(
+    const std::string& opt, std::map<std::string, std::string>& settings) {
+    if (opt.empty()) {
+        return;
+    }
+    xia::util::strings fields;
+    xia::util::split(fields, opt, ',');
+    for (auto& field : fields) {
+        xia::util::strings key_value;
+        xia::util::split(key_value, field, '=');
+        if (key_value.size() != 2) {
+            throw std::runtime_error("bench: invalid setting: " + field);
+        }
+        settings[key_value[0]] = key_value[1];
+    }
+}
+
+static json bench_histogram(
+    const xia::pixie::module::module::fifo_histogram& histogram) {
+    json hist = json::object();
+    for (size_t bin = 0; bin < histogram.bins; ++bin) {
+        auto count = histogram.counts[bin].load();
+        if (count != 0) {
+            hist[std::to_string(histogram.bin_lower(bin))] = count;
+        }
+    }
+    return hist;
+}
+
+static void bench(command_args& args) {
+    args_command worker_opt;
+    args_command generator_opt;
+    args_command output_opt;
+    /*
+     * The switches can be in any order.
+     */
+    while (true) {
+        auto opt = switch_option("-w", args);
+        if (!opt.empty()) {
+            worker_opt = opt;
+            continue;
+        }
+        opt = switch_option("-g", args);
+        if (!opt.empty()) {
+            generator_opt = opt;
+            continue;
+        }
+        opt = switch_option("-o", args);
+        if (!opt.empty()) {
+            output_opt = opt;
+            continue;
+        }
+        break;
+    }
+    if (!valid_option(args, 2)) {
+        throw std::runtime_error("bench: not enough options");
+    }
+    auto& crate = args.crate;
+    auto mod_nums_opt = get_and_next(args);
+    auto secs_opt = get_and_next(args);
+    module_range mod_nums;
+    modules_option(mod_nums, mod_nums_opt, crate.num_modules);
+    auto secs = get_value<size_t>(secs_opt);
+    module_check(crate, mod_nums);
+    if (secs == 0) {
+        throw std::runtime_error(std::string("bench: period is 0"));
+    }
+    std::map<std::string, std::string> worker_settings;
+    std::map<std::string, std::string> generator_settings;
+    bench_settings(worker_opt, worker_settings);
+    bench_settings(generator_opt, generator_settings);
+    /*
+     * Generated data needs the simulation.
+     */
+    xia::pixie::sim::generator_config gen;
+    if (!generator_settings.empty()) {
+        gen.channels.resize(1);
+        for (auto& setting : generator_settings) {
+            if (setting.first == "rate") {
+                gen.channels[0].rate = get_value<double>(setting.second);
+            } else if (setting.first == "energy") {
+                gen.channels[0].energy = get_value<double>(setting.second);
+            } else if (setting.first == "trace") {
+                gen.channels[0].trace_length = get_value<size_t>(setting.second);
+            } else if (setting.first == "header") {
+                gen.header_length = get_value<size_t>(setting.second);
+            } else if (setting.first == "pileup-ns") {
+                gen.pileup_ns = get_value<size_t>(setting.second);
+            } else {
+                throw std::runtime_error("bench: invalid generator setting: " + setting.first);
+            }
+        }
+    }
+    for (auto mod_num : mod_nums) {
+        auto& module = crate[mod_num];
+        for (auto& setting : worker_settings) {
+            auto& key = setting.first;
+            auto& value = setting.second;
+            if (key == "buffers") {
+                module.set_fifo_buffers(get_value<size_t>(value));
+            } else if (key == "buffers-max") {
+                module.set_fifo_buffers_max(get_value<size_t>(value));
+            } else if (key == "buffer-words") {
+                module.set_fifo_buffer_words(get_value<size_t>(value));
+            } else if (key == "auto-tune") {
+                module.set_fifo_auto_tune(true, get_value<size_t>(value));
+            } else if (key == "run-wait") {
+                module.set_fifo_run_wait(get_value<size_t>(value));
+            } else if (key == "idle-wait") {
+                module.set_fifo_idle_wait(get_value<size_t>(value));
+            } else if (key == "hold") {
+                module.set_fifo_hold(get_value<size_t>(value));
+            } else if (key == "dma-trigger") {
+                module.set_fifo_dma_trigger_level(get_value<size_t>(value));
+            } else if (key == "bandwidth") {
+                module.set_fifo_bandwidth(get_value<size_t>(value));
+            } else if (key == "interrupt") {
+                module.set_fifo_interrupt(get_value<size_t>(value) != 0);
+            } else if (key == "adaptive") {
+                module.set_fifo_adaptive(get_value<size_t>(value) != 0);
+            } else if (key == "cpus") {
+                xia::pixie::module::worker_placement placement = module.fifo_placement;
+                placement.cpus.clear();
+                placement.pci_local = value == "pci";
+                if (!placement.pci_local) {
+                    xia::util::parse_cpu_list(placement.cpus, value);
+                }
+                module.set_fifo_placement(placement);
+            } else {
+                throw std::runtime_error("bench: invalid worker setting: " + key);
+            }
+        }
+        if (gen.enabled()) {
+            auto sim_module = dynamic_cast<xia::pixie::sim::module*>(&module);
+            if (sim_module == nullptr) {
+                throw std::runtime_error("bench: generated data needs simulation");
+            }
+            sim_module->set_generator(gen);
+        }
+    }
+    auto benches = std::vector<bench_worker>(mod_nums.size());
+    set_num_slot(crate, mod_nums, benches);
+    for (auto& b : benches) {
+        b.seconds = secs;
+    }
+    module_threads(args, mod_nums, benches, "bench command error; see log");
+    /*
+     * The report is JSON so hosts can be compared.
+     */
+    json report;
+    report["duration-secs"] = secs;
+    report["worker-settings"] = worker_settings;
+    report["generator-settings"] = generator_settings;
+    report["modules"] = json::array();
+    size_t crate_bytes = 0;
+    double crate_secs = 0;
+    for (auto& b : benches) {
+        const size_t bytes = b.total * sizeof(xia::pixie::hw::word);
+        const double period = b.period.secs();
+        json mod;
+        mod["number"] = b.number;
+        mod["slot"] = b.slot;
+        mod["pci-bus"] = b.pci_bus;
+        mod["pci-slot"] = b.pci_slot;
+        mod["error"] = b.has_error;
+        mod["bytes"] = bytes;
+        mod["secs"] = period;
+        mod["mb-per-sec"] = period > 0 ? double(bytes) / period / 1e6 : 0;
+        mod["worker-cpu-usecs"] = b.cpu_usecs;
+        mod["worker-cpu-percent"] = period > 0 ? double(b.cpu_usecs) / (period * 1e4) : 0;
+        mod["fifo"] = {{"in", b.stats.in.load()},
+                       {"out", b.stats.out.load()},
+                       {"dma-in", b.stats.dma_in.load()},
+                       {"overflows", b.stats.overflows.load()},
+                       {"dropped", b.stats.dropped.load()},
+                       {"hw-overflows", b.stats.hw_overflows.load()},
+                       {"max-bandwidth", b.stats.max_bandwidth.load()},
+                       {"min-bandwidth", b.stats.min_bandwidth.load()}};
+        mod["dma-words"] = bench_histogram(b.stats.dma_words);
+        mod["dma-usecs"] = bench_histogram(b.stats.dma_usecs);
+        mod["level-words"] = bench_histogram(b.stats.level_words);
+        mod["latency-usecs"] = bench_histogram(b.stats.latency_usecs);
+        if (b.tuning.valid) {
+            mod["fifo-tuning"] = {{"buffer-words", b.tuning.buffer_words},
+                                  {"buffers", b.tuning.buffers},
+                                  {"max-dma-words", b.tuning.max_dma_words},
+                                  {"max-event-words", b.tuning.max_event_words},
+                                  {"max-queue-depth", b.tuning.max_queue_depth},
+                                  {"over-budget", b.tuning.over_budget}};
+        }
+        report["modules"].push_back(mod);
+        crate_bytes += bytes;
+        crate_secs = std::max(crate_secs, period);
+    }
+    report["crate"] = {
+        {"bytes", crate_bytes},
+        {"secs", crate_secs},
+        {"mb-per-sec", crate_secs > 0 ? double(crate_bytes) / crate_secs / 1e6 : 0}};
+    if (output_opt.empty()) {
+        args.opts.out << report.dump(2) << std::endl;
+    } else {
+        std::ofstream out(output_opt);
+        if (!out) {
+            throw std::runtime_error(
+                "bench: report open: " + output_opt + ": " + std::strerror(errno));
+        }
+        out << report.dump(2) << std::endl;
+        performance_stats(args, benches, true);
+    }
+}
+
 static void bl_acq(command_args& args) {
     if (!valid_option(args, 1)) {
         throw std::runtime_error("bl-acq: not enough options");
@@ -1450,6 +1829,36 @@ static void bl_save(command_args& args) {
     }
 }
 
+static void bl_stats(command_args& args) {
+    if (!valid_option(args, 1)) {
+        throw std::runtime_error("bl-stats: not enough options");
+    }
+    auto& crate = args.crate;
+    auto& opts = args.opts;
+    auto mod_nums_opt = get_and_next(args);
+    args_command chans_opt;
+    if (valid_option(args, 1)) {
+        chans_opt = get_and_next(args);
+    }
+    module_range mod_nums;
+    modules_option(mod_nums, mod_nums_opt, crate.num_modules);
+    xia::util::ostream_guard flags(opts.out);
+    opts.out << "module,channel,baselines,mean,median,stddev,noise,min,max" << std::endl;
+    for (auto mod_num : mod_nums) {
+        xia::pixie::channel::range channels;
+        channels_option(channels, chans_opt, crate[mod_num].num_channels);
+        xia::pixie::stats::baseline_noises noises;
+        crate[mod_num].bl_noise(channels, noises, false);
+        for (size_t idx = 0; idx < channels.size(); ++idx) {
+            auto& noise = noises[idx];
+            opts.out << mod_num << ',' << channels[idx] << ',' << noise.values.count << ','
+                     << noise.values.mean << ',' << noise.median.value() << ','
+                     << noise.values.stddev() << ',' << noise.noise() << ','
+                     << noise.values.min << ',' << noise.values.max << std::endl;
+        }
+    }
+}
+
 static void boot(command_args& args) {
     auto& crate = args.crate;
     xia::pixie::crate::crate::boot_params boot_params;
@@ -1577,14 +1986,23 @@ static void db(command_args& args) {
 }
 
 static void export_(command_args& args) {
+    auto snapshot_opt = switch_option("-s", args, false);
+    auto also_opt = switch_option("-a", args);
     if (!valid_option(args, 1)) {
         throw std::runtime_error("export: not enough options");
     }
+    if (!snapshot_opt.empty() && !also_opt.empty()) {
+        throw std::runtime_error("export: -s and -a are exclusive");
+    }
     auto& crate = args.crate;
     auto file_opt = get_and_next(args);
     xia::util::timepoint tp;
     tp.start();
-    crate.export_config(file_opt);
+    if (also_opt.empty()) {
+        crate.export_config(file_opt, !snapshot_opt.empty());
+    } else {
+        crate.export_config_and_snapshot(file_opt, also_opt);
+    }
     tp.end();
     args.opts.out << "Modules export time=" << tp << std::endl;
 }
@@ -1629,6 +2047,27 @@ static void help(command_args& args) {
     }
 }
 
+static void hist_export(command_args& args) {
+    auto described_opt = switch_option("-d", args, false);
+    auto bins_opt = switch_option("-b", args);
+    if (!valid_option(args, 2)) {
+        throw std::runtime_error("hist-export: not enough options");
+    }
+    auto& crate = args.crate;
+    auto file_opt = get_and_next(args);
+    auto mod_nums_opt = get_and_next(args);
+    module_range mod_nums;
+    modules_option(mod_nums, mod_nums_opt, crate.num_modules);
+    size_t length = 0;
+    if (!bins_opt.empty()) {
+        length = get_value<size_t>(bins_opt);
+    }
+    auto format = !described_opt.empty() ?
+        xia::pixie::crate::crate::histogram_format::described :
+        xia::pixie::crate::crate::histogram_format::binary;
+    crate.save_histograms(file_opt, mod_nums, format, length);
+}
+
 static void hist_resume(command_args& args) {
     if (!valid_option(args, 1)) {
         throw std::runtime_error("hist-resume: not enough options");
@@ -1707,6 +2146,7 @@ static void hist_start(command_args& args) {
 }
 
 static void import(command_args& args) {
+    auto changes_opt = switch_option("-c", args, false);
     if (!valid_option(args, 1)) {
         throw std::runtime_error("import: not enough options");
     }
@@ -1715,8 +2155,12 @@ static void import(command_args& args) {
     xia::util::timepoint tp;
     xia::pixie::module::number_slots modules;
     tp.start();
-    crate.import_config(path_opt, modules);
-    crate.initialize_afe();
+    if (changes_opt.empty()) {
+        crate.import_config(path_opt, modules);
+        crate.initialize_afe();
+    } else {
+        crate.import_config(path_opt, modules, true);
+    }
     tp.end();
     args.opts.out << "Modules imported: " << modules.size()
                   << " time=" << tp << std::endl;
@@ -1731,65 +2175,163 @@ struct list_save_worker : public module_thread_worker {
     void worker(
         process_command_options& process_opts,
         xia::pixie::module::module& module);
+    void publish(
+        process_command_options& process_opts,
+        xia::pixie::module::module& module, const std::string& ring);
+    void run_end(
+        process_command_options& process_opts,
+        xia::pixie::module::module& module);
 };
 
 list_save_worker::list_save_worker() : seconds(0) {}
 
 void list_save_worker::worker(
     process_command_options& process_opts, xia::pixie::module::module& module) {
-    name += '-' + std::to_string(module.number) + ".lmd";
+    const std::string shm_prefix = "shm:";
+    if (name.compare(0, shm_prefix.size(), shm_prefix) == 0) {
+        publish(process_opts, module, name.substr(shm_prefix.size()));
+        return;
+    }
+    const std::string lmc_ext = ".lmc";
+    const bool compressed = name.size() > lmc_ext.size() &&
+        name.compare(name.size() - lmc_ext.size(), lmc_ext.size(), lmc_ext) == 0;
+    if (compressed) {
+        name.erase(name.size() - lmc_ext.size());
+    }
+    name += '-' + std::to_string(module.number) + (compressed ? lmc_ext : ".lmd");
     std::ofstream out(name, std::ios::binary);
     if (!out) {
         throw std::runtime_error(
             std::string("list mode file open: ") + name + ": " +
             std::strerror(errno));
     }
+    std::unique_ptr<xia::pixie::lmc::writer> container;
+    if (compressed) {
+        int adc_msps = 0;
+        if (!module.channels.empty() && module.channels[0].fixture) {
+            adc_msps = module.channels[0].fixture->config.adc_msps;
+        }
+        nlohmann::json head;
+        head["format"] = "pixie-list-mode";
+        head["modules"] = {{{"number", module.number},
+                            {"slot", module.slot},
+                            {"serial-num", module.serial_num},
+                            {"revision", module.revision},
+                            {"adc-msps", adc_msps}}};
+        container.reset(new xia::pixie::lmc::writer(
+            [&out](const void* data, size_t size) {
+                out.write(static_cast<const char*>(data), std::streamsize(size));
+            },
+            {{module.number, module.revision, adc_msps}}, head.dump()));
+    }
+    auto save = [&out, &container, &module](const xia::pixie::hw::words& lm) {
+        if (container) {
+            container->add(module.number, lm.data(), lm.size());
+        } else {
+            out.write(
+                reinterpret_cast<const char*>(lm.data()),
+                lm.size() * sizeof(xia::pixie::hw::word));
+        }
+    };
     using namespace xia::pixie::hw::run;
     if (run_task) {
         module.start_listmode(run_mode::new_run);
     }
     xia::pixie::hw::words lm;
     const size_t poll_period_usecs = 100 * 1000;
+    /*
+     * The subscription wakes the loop when the worker queues data.
+     */
+    module.subscribe_list_mode(xia::pixie::module::list_mode_subscription());
     total = 0;
     period.start();
     while (period.secs() < seconds) {
         lm.clear();
         if (module.read_list_mode(lm) > 0) {
             total += lm.size();
-            out.write(
-                reinterpret_cast<char*>(lm.data()),
-                lm.size() * sizeof(xia::pixie::hw::word));
+            save(lm);
         } else {
-            xia::pixie::hw::wait(poll_period_usecs);
+            module.wait_list_mode(poll_period_usecs);
         }
     }
+    module.unsubscribe_list_mode();
     if (run_task) {
         module.run_end();
         lm.clear();
         if (module.read_list_mode(lm) > 0) {
             total += lm.size();
-            out.write(
-                reinterpret_cast<char*>(lm.data()),
-                lm.size() * sizeof(xia::pixie::hw::word));
+            save(lm);
         }
-        process_opts.out << "list-mode: " << module.number
-                         << ": " << module.run_stats.output() << std::endl;
-        if (module.run_stats.hw_overflows != 0) {
-            throw std::runtime_error(
-                "list mode: EXT FIFO overflow (check workflow config)");
+        if (container) {
+            container->finish();
+            container.reset();
         }
-        if (module.run_stats.overflows != 0) {
-            throw std::runtime_error(
-                "list mode: data FIFO overflow (check buffer sizes)");
+        run_end(process_opts, module);
+    }
+    if (container) {
+        container->finish();
+    }
+    period.end();
+}
+
+/*
+ * Publish the data to a shared memory ring named `<ring>-<module>`. The
+ * ring is lossy so a slow consumer cannot stop the module's readout.
+ */
+void list_save_worker::publish(
+    process_command_options& process_opts, xia::pixie::module::module& module,
+    const std::string& ring) {
+    namespace shm = xia::buffer::shm;
+    shm::publisher pub(ring + '-' + std::to_string(module.number));
+    using namespace xia::pixie::hw::run;
+    if (run_task) {
+        module.start_listmode(run_mode::new_run);
+    }
+    const auto source = static_cast<uint32_t>(module.number);
+    xia::buffer::queue::handles buffers;
+    const size_t poll_period_usecs = 100 * 1000;
+    module.subscribe_list_mode(xia::pixie::module::list_mode_subscription());
+    total = 0;
+    period.start();
+    while (period.secs() < seconds) {
+        if (module.read_list_mode(buffers) > 0) {
+            total += pub.publish(source, buffers);
+        } else {
+            module.wait_list_mode(poll_period_usecs);
         }
-        if (module.run_stats.in != module.run_stats.out) {
-            throw std::runtime_error(
-                "list mode: data left in data FIFO");
+    }
+    module.unsubscribe_list_mode();
+    if (run_task) {
+        module.run_end();
+        if (module.read_list_mode(buffers) > 0) {
+            total += pub.publish(source, buffers);
         }
+        run_end(process_opts, module);
     }
+    process_opts.out << "list-mode: " << module.number << ": published " << pub.name
+                     << " blocks=" << pub.sequence()
+                     << " subscribers=" << pub.subscribers() << std::endl;
     period.end();
 }
 
+void list_save_worker::run_end(
+    process_command_options& process_opts, xia::pixie::module::module& module) {
+    process_opts.out << "list-mode: " << module.number
+                     << ": " << module.run_stats.output() << std::endl;
+    if (module.run_stats.hw_overflows != 0) {
+        throw std::runtime_error(
+            "list mode: EXT FIFO overflow (check workflow config)");
+    }
+    if (module.run_stats.overflows != 0) {
+        throw std::runtime_error(
+            "list mode: data FIFO overflow (check buffer sizes)");
+    }
+    if (module.run_stats.in != module.run_stats.out) {
+        throw std::runtime_error(
+            "list mode: data left in data FIFO");
+    }
+}
+
 static void list_mode_command(command_args& args, bool run_task) {
     if (!valid_option(args, 3)) {
         throw std::runtime_error("list-[save,mode]: not enough options");
@@ -1839,6 +2381,57 @@ static void list_save(command_args& args) {
     list_mode_command(args, false);
 }
 
+static void list_serve(command_args& args) {
+    if (!valid_option(args, 3)) {
+        throw std::runtime_error("list-serve: not enough options");
+    }
+    auto& crate = args.crate;
+    auto mod_nums_opt = get_and_next(args);
+    auto secs_opt = get_and_next(args);
+    auto port_opt = get_and_next(args);
+    module_range mod_nums;
+    modules_option(mod_nums, mod_nums_opt, crate.num_modules);
+    module_check(crate, mod_nums);
+    auto secs = get_value<size_t>(secs_opt);
+    namespace server = xia::pixie::server;
+    xia::pixie::recorder::sources srcs;
+    for (auto mod_num : mod_nums) {
+        srcs.push_back(xia::pixie::recorder::module_source(crate[mod_num]));
+    }
+    server::config cfg;
+    cfg.port = get_value<int>(port_opt);
+    server::server srv(srcs, cfg);
+    args.opts.out << "list-serve: port " << srv.port() << std::endl;
+    srv.start();
+    xia::pixie::hw::wait(secs * 1000 * 1000);
+    srv.stop();
+    args.opts.out << "list-serve: clients=" << srv.clients() << " dropped=" << srv.dropped()
+                  << " bytes=" << srv.bytes() << " errors=" << srv.errors() << std::endl;
+}
+
+static void crate_serve(command_args& args) {
+    if (!valid_option(args, 2)) {
+        throw std::runtime_error("crate-serve: not enough options");
+    }
+    auto secs_opt = get_and_next(args);
+    auto socket_opt = get_and_next(args);
+    namespace ipc = xia::pixie::ipc;
+    ipc::config cfg;
+    cfg.socket = socket_opt;
+    if (valid_option(args, 1)) {
+        cfg.ring_name = get_and_next(args);
+    }
+    auto secs = get_value<size_t>(secs_opt);
+    ipc::server srv(args.crate, cfg);
+    args.opts.out << "crate-serve: socket " << cfg.socket << " ring " << cfg.ring_name
+                  << std::endl;
+    srv.start();
+    xia::pixie::hw::wait(secs * 1000 * 1000);
+    srv.stop();
+    args.opts.out << "crate-serve: requests=" << srv.requests() << " errors=" << srv.errors()
+                  << " published=" << srv.published() << std::endl;
+}
+
 static void list_start(command_args& args) {
     if (!valid_option(args, 1)) {
         throw std::runtime_error("list-start: not enough options");
@@ -1859,6 +2452,75 @@ static void list_start(command_args& args) {
     }
 }
 
+static void list_timed(command_args& args) {
+    auto preset_opt = switch_option("-p", args, false);
+    if (!valid_option(args, 1)) {
+        throw std::runtime_error("list-timed: not enough options");
+    }
+    auto& crate = args.crate;
+    auto secs_opt = get_and_next(args);
+    xia::pixie::crate::crate::timed_run run;
+    run.seconds = get_value<double>(secs_opt);
+    run.preset = !preset_opt.empty();
+    /*
+     * Read the data while the run is active so the queues do not fill.
+     */
+    std::atomic_bool reading(true);
+    std::vector<size_t> words(crate.num_modules, 0);
+    std::vector<std::thread> readers;
+    for (size_t mod_num = 0; mod_num < crate.num_modules; ++mod_num) {
+        if (!crate[mod_num].online()) {
+            continue;
+        }
+        readers.emplace_back([&crate, &reading, &words, mod_num] {
+            auto& module = crate[mod_num];
+            xia::buffer::queue::handles buffers;
+            const size_t poll_period_usecs = 10 * 1000;
+            while (reading.load()) {
+                size_t read = 0;
+                if (module.read_list_mode(buffers, 0, read, std::nothrow) !=
+                    xia::pixie::error::code::success) {
+                    break;
+                }
+                buffers.clear();
+                if (read > 0) {
+                    words[mod_num] += read;
+                } else {
+                    xia::pixie::hw::wait(poll_period_usecs);
+                }
+            }
+        });
+    }
+    try {
+        crate.run_listmode_for(xia::pixie::hw::run::run_mode::new_run, run);
+    } catch (...) {
+        reading = false;
+        for (auto& reader : readers) {
+            reader.join();
+        }
+        throw;
+    }
+    reading = false;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    args.opts.out << "list-timed: preset-ended=" << std::boolalpha << run.preset_ended
+                  << " counter-timed=" << run.counter_timed << std::noboolalpha
+                  << " skew=" << run.start.skew_usecs << " usecs" << std::endl;
+    for (size_t mod_num = 0; mod_num < crate.num_modules; ++mod_num) {
+        auto& module = crate[mod_num];
+        if (!module.online()) {
+            continue;
+        }
+        xia::buffer::queue::handles buffers;
+        words[mod_num] += module.read_list_mode(buffers);
+        args.opts.out << "list-timed: " << mod_num << ": run=" << run.run_secs[mod_num]
+                      << " secs host=" << run.host_secs[mod_num]
+                      << " secs end=" << run.end_usecs[mod_num]
+                      << " usecs words=" << words[mod_num] << std::endl;
+    }
+}
+
 static void lset_import(command_args& args) {
     if (!valid_option(args, 2)) {
         throw std::runtime_error("lset-import: not enough options");
@@ -1997,6 +2659,57 @@ static xia::pixie::hw::address get_address(
     return address;
 }
 
+static void rates(command_args& args) {
+    auto period_opt = switch_option("-p", args);
+    auto reads_opt = switch_option("-n", args);
+    if (!valid_option(args, 1)) {
+        throw std::runtime_error("rates: not enough options");
+    }
+    auto& crate = args.crate;
+    auto mod_nums_opt = get_and_next(args);
+    args_command chans_opt;
+    if (valid_option(args, 1)) {
+        chans_opt = get_and_next(args);
+    }
+    size_t period_msecs = 1000;
+    if (!period_opt.empty()) {
+        period_msecs = get_value<size_t>(period_opt);
+    }
+    size_t reads = 2;
+    if (!reads_opt.empty()) {
+        reads = std::max(get_value<size_t>(reads_opt), size_t(2));
+    }
+    module_range mod_nums;
+    modules_option(mod_nums, mod_nums_opt, crate.num_modules);
+    xia::pixie::stats::snapshot snap;
+    xia::pixie::stats::snapshots ring(2);
+    xia::pixie::stats::intervals intervals;
+    for (size_t r = 0; r < reads; ++r) {
+        if (r > 0) {
+            xia::pixie::hw::wait(period_msecs * 1000);
+        }
+        crate.read_stats(mod_nums, snap);
+        ring.push(snap);
+        if (r == 0) {
+            continue;
+        }
+        ring.rates(intervals);
+        args.opts.out << "rates: read " << r << ": elapsed=" << snap.elapsed(ring.at(1))
+                      << " skew=" << snap.skew.count() << "us" << std::endl;
+        for (size_t m = 0; m < mod_nums.size(); ++m) {
+            xia::pixie::channel::range channels;
+            channels_option(channels, chans_opt, crate[mod_nums[m]].num_channels);
+            for (auto channel : channels) {
+                auto& rate = intervals[m].chans[channel];
+                args.opts.out << "module " << mod_nums[m] << " chan " << channel
+                              << ": icr=" << rate.input_count_rate()
+                              << " ocr=" << rate.output_count_rate()
+                              << " live=" << rate.live_fraction() << std::endl;
+            }
+        }
+    }
+}
+
 static void reg_read(command_args& args) {
     const std::string label = "reg-read";
     auto slot_opt = switch_option("-s", args, false);
@@ -2188,6 +2901,24 @@ static void par_write(command_args& args) {
     }
 }
 
+static void profile(command_args& args) {
+    std::string action = "dump";
+    if (valid_option(args, 1)) {
+        action = get_and_next(args);
+    }
+    if (action == "on") {
+        xia::pixie::profile::enable(true);
+    } else if (action == "off") {
+        xia::pixie::profile::enable(false);
+    } else if (action == "reset") {
+        xia::pixie::profile::reset();
+    } else if (action == "dump") {
+        xia::pixie::profile::output(args.opts.out);
+    } else {
+        throw std::runtime_error("profile: invalid action: " + action);
+    }
+}
+
 static void report(command_args& args) {
     std::ostream* out= &std::cout;
     std::ofstream output_file;
@@ -2231,6 +2962,45 @@ static void run_end(command_args& args) {
     }
 }
 
+static void scope(command_args& args) {
+    auto period_opt = switch_option("-p", args);
+    if (!valid_option(args, 2)) {
+        throw std::runtime_error("scope: not enough options");
+    }
+    auto& crate = args.crate;
+    auto secs_opt = get_and_next(args);
+    auto mod_nums_opt = get_and_next(args);
+    args_command chans_opt;
+    if (valid_option(args, 1)) {
+        chans_opt = get_and_next(args);
+    }
+    auto secs = get_value<size_t>(secs_opt);
+    module_range mod_nums;
+    modules_option(mod_nums, mod_nums_opt, crate.num_modules);
+    std::vector<std::unique_ptr<xia::pixie::scope::scope>> scopes;
+    for (auto mod_num : mod_nums) {
+        xia::pixie::scope::config cfg;
+        channels_option(cfg.channels, chans_opt, crate[mod_num].num_channels);
+        if (!period_opt.empty()) {
+            cfg.period_msecs = get_value<size_t>(period_opt);
+        }
+        scopes.push_back(std::make_unique<xia::pixie::scope::scope>(crate[mod_num], cfg));
+    }
+    for (auto& scp : scopes) {
+        scp->start();
+    }
+    xia::pixie::hw::wait(secs * 1000 * 1000);
+    for (auto& scp : scopes) {
+        scp->stop();
+    }
+    for (size_t m = 0; m < mod_nums.size(); ++m) {
+        auto& scp = *scopes[m];
+        args.opts.out << "scope: module " << mod_nums[m] << ": acquisitions=" << scp.sequence()
+                      << " rate=" << double(scp.sequence()) / double(std::max(secs, size_t(1)))
+                      << "/s errors=" << scp.errors() << std::endl;
+    }
+}
+
 static void set_dacs(command_args& args) {
     if (!valid_option(args, 1)) {
         throw std::runtime_error("set-dacs: not enough options");
@@ -2311,6 +3081,237 @@ static void stats(command_args& args) {
     }
 }
 
+struct sweep_param {
+    std::string name;
+    std::vector<double> values;
+    bool module_param;
+
+    sweep_param(const std::string& opt);
+};
+
+sweep_param::sweep_param(const std::string& opt) {
+    xia::util::strings name_range;
+    xia::util::split(name_range, opt, '=');
+    if (name_range.size() != 2) {
+        throw std::runtime_error("sweep: invalid parameter: " + opt);
+    }
+    name = name_range[0];
+    auto& module_params = xia::pixie::param::get_module_param_map();
+    module_param = module_params.find(name) != module_params.end();
+    xia::util::strings range;
+    xia::util::split(range, name_range[1], ':');
+    if (range.size() == 1) {
+        xia::util::strings list;
+        xia::util::split(list, range[0], ',');
+        for (auto& value : list) {
+            values.push_back(get_value<double>(value));
+        }
+    } else if (range.size() == 2 || range.size() == 3) {
+        auto start = get_value<double>(range[0]);
+        auto end = get_value<double>(range[1]);
+        auto step = range.size() == 3 ? get_value<double>(range[2]) : 1.0;
+        if (step <= 0 || start > end) {
+            throw std::runtime_error("sweep: invalid range: " + opt);
+        }
+        /*
+         * Count the steps so rounding does not lose the end value.
+         */
+        auto steps = size_t(((end - start) / step) + 1e-9);
+        for (size_t s = 0; s <= steps; ++s) {
+            values.push_back(start + s * step);
+        }
+    } else {
+        throw std::runtime_error("sweep: invalid range: " + opt);
+    }
+    if (values.empty()) {
+        throw std::runtime_error("sweep: no values: " + opt);
+    }
+}
+
+struct sweep_row {
+    size_t channel;
+    double real_time;
+    double live_time;
+    double input_count_rate;
+    double output_count_rate;
+    size_t processed_events;
+};
+
+struct sweep_worker : public module_thread_worker {
+    std::string action;
+    size_t secs;
+    std::string chans_opt;
+    const std::vector<sweep_param>* params;
+    std::vector<double> values;
+    std::vector<sweep_row> rows;
+
+    sweep_worker();
+    void worker(
+        process_command_options& process_opts,
+        xia::pixie::module::module& module);
+};
+
+sweep_worker::sweep_worker() : secs(0), params(nullptr) {}
+
+void sweep_worker::worker(
+    process_command_options& , xia::pixie::module::module& module) {
+    using namespace xia::pixie::hw::run;
+    xia::pixie::channel::range channels;
+    channels_option(channels, chans_opt, module.num_channels);
+    rows.clear();
+    for (size_t p = 0; p < params->size(); ++p) {
+        auto& param = (*params)[p];
+        if (param.module_param) {
+            module.write(param.name, values[p]);
+        } else {
+            for (auto channel : channels) {
+                module.write(param.name, channel, values[p]);
+            }
+        }
+    }
+    period.start();
+    if (action == "hist") {
+        try {
+            module.start_histograms(run_mode::new_run);
+            xia::pixie::hw::wait(secs * 1000 * 1000);
+            module.run_end();
+        } catch (...) {
+            period.end();
+            has_error = true;
+            module.run_end();
+            throw;
+        }
+    }
+    period.end();
+    xia::pixie::stats::stats stats(module);
+    module.read_stats(stats);
+    for (auto channel : channels) {
+        sweep_row row;
+        row.channel = channel;
+        row.real_time = stats.mod.real_time();
+        row.live_time = stats.chans[channel].live_time();
+        row.input_count_rate = stats.chans[channel].input_count_rate();
+        row.output_count_rate = stats.chans[channel].output_count_rate();
+        row.processed_events = stats.mod.processed_events();
+        rows.push_back(row);
+    }
+}
+
+static void sweep(command_args& args) {
+    args_command output_opt;
+    args_command chans_opt;
+    while (true) {
+        auto opt = switch_option("-o", args);
+        if (!opt.empty()) {
+            output_opt = opt;
+            continue;
+        }
+        opt = switch_option("-c", args);
+        if (!opt.empty()) {
+            chans_opt = opt;
+            continue;
+        }
+        break;
+    }
+    if (!valid_option(args, 3)) {
+        throw std::runtime_error("sweep: not enough options");
+    }
+    auto& crate = args.crate;
+    auto mod_nums_opt = get_and_next(args);
+    std::vector<sweep_param> params;
+    while (valid_option(args, 1) && args.ci->find('=') != std::string::npos) {
+        params.emplace_back(get_and_next(args));
+    }
+    if (params.empty()) {
+        throw std::runtime_error("sweep: no parameters");
+    }
+    if (!valid_option(args, 1)) {
+        throw std::runtime_error("sweep: no action");
+    }
+    auto action = get_and_next(args);
+    size_t secs = 0;
+    if (action == "hist") {
+        if (!valid_option(args, 1)) {
+            throw std::runtime_error("sweep: hist: no period");
+        }
+        secs = get_value<size_t>(get_and_next(args));
+    } else if (action != "read") {
+        throw std::runtime_error("sweep: invalid action: " + action);
+    }
+    module_range mod_nums;
+    modules_option(mod_nums, mod_nums_opt, crate.num_modules);
+    module_check(crate, mod_nums);
+    std::ostream* out = &args.opts.out;
+    std::ofstream output_file;
+    if (!output_opt.empty()) {
+        output_file.open(output_opt);
+        if (!output_file) {
+            throw std::runtime_error(
+                std::string("sweep: output: " + output_opt + ": " + std::strerror(errno)));
+        }
+        out = &output_file;
+    }
+    /*
+     * One row per point, module and channel in columns.
+     */
+    *out << "point,module,slot,channel";
+    for (auto& param : params) {
+        *out << ',' << param.name;
+    }
+    *out << ",real-time,live-time,input-count-rate,output-count-rate,processed-events"
+         << std::endl;
+    auto sweeps = std::vector<sweep_worker>(mod_nums.size());
+    set_num_slot(crate, mod_nums, sweeps);
+    for (auto& sw : sweeps) {
+        sw.action = action;
+        sw.secs = secs;
+        sw.chans_opt = chans_opt;
+        sw.params = &params;
+    }
+    size_t points = 1;
+    for (auto& param : params) {
+        points *= param.values.size();
+    }
+    std::vector<size_t> index(params.size(), 0);
+    for (size_t point = 0; point < points; ++point) {
+        std::vector<double> values;
+        for (size_t p = 0; p < params.size(); ++p) {
+            values.push_back(params[p].values[index[p]]);
+        }
+        if (args.opts.verbose) {
+            args.opts.out << "sweep: point " << point + 1 << " of " << points << ':';
+            for (size_t p = 0; p < params.size(); ++p) {
+                args.opts.out << ' ' << params[p].name << '=' << values[p];
+            }
+            args.opts.out << std::endl;
+        }
+        for (auto& sw : sweeps) {
+            sw.values = values;
+        }
+        module_threads(args, mod_nums, sweeps, "sweep command error; see log", false);
+        for (auto& sw : sweeps) {
+            for (auto& row : sw.rows) {
+                *out << point << ',' << sw.number << ',' << sw.slot << ',' << row.channel;
+                for (auto value : values) {
+                    *out << ',' << value;
+                }
+                *out << ',' << row.real_time << ',' << row.live_time << ','
+                     << row.input_count_rate << ',' << row.output_count_rate << ','
+                     << row.processed_events << std::endl;
+            }
+        }
+        /*
+         * Step the innermost loop, the last parameter, first.
+         */
+        for (size_t p = params.size(); p > 0; --p) {
+            if (++index[p - 1] < params[p - 1].values.size()) {
+                break;
+            }
+            index[p - 1] = 0;
+        }
+    }
+}
+
 struct test_fifo_worker : public module_thread_worker {
     size_t length;
 
@@ -2352,6 +3353,40 @@ void test_fifo_worker::worker(
     }
 }
 
+static void tau_fit(command_args& args) {
+    auto write_opt = switch_option("-w", args, false);
+    auto captures_opt = switch_option("-n", args);
+    if (!valid_option(args, 1)) {
+        throw std::runtime_error("tau-fit: not enough options");
+    }
+    auto& crate = args.crate;
+    auto mod_nums_opt = get_and_next(args);
+    args_command chans_opt;
+    if (valid_option(args, 1)) {
+        chans_opt = get_and_next(args);
+    }
+    size_t captures = 1;
+    if (!captures_opt.empty()) {
+        captures = get_value<size_t>(captures_opt);
+    }
+    module_range mod_nums;
+    modules_option(mod_nums, mod_nums_opt, crate.num_modules);
+    xia::pixie::data::tau::config cfg;
+    for (auto mod_num : mod_nums) {
+        xia::pixie::channel::range channels;
+        channels_option(channels, chans_opt, crate[mod_num].num_channels);
+        xia::pixie::data::tau::estimates taus;
+        crate[mod_num].fit_tau(channels, cfg, taus, captures, !write_opt.empty());
+        for (size_t c = 0; c < channels.size(); ++c) {
+            auto& est = taus[c];
+            args.opts.out << "module " << mod_num << " channel " << channels[c]
+                          << ": tau=" << est.tau_usecs << " spread=" << est.spread_usecs
+                          << " pulses=" << est.pulses << " rejected=" << est.rejected
+                          << std::endl;
+        }
+    }
+}
+
 static void test(command_args& args) {
     auto mode_opt = switch_option("-m", args);
     if (!valid_option(args, 1)) {
@@ -2628,6 +3663,9 @@ int main(int argc, char* argv[]) {
     args_strings_flag cmd_file_flag(
         option_group, "cmd_file_flag",
         "File of commands to execute.", {'c', "cmd"});
+    args_string_flag eeprom_cache_flag(
+        option_group, "eeprom_cache_flag",
+        "Host cache file of the modules' EEPROM contents.", {'E', "eeprom-cache"});
 
     args_group command_group(parser, "Commands");
     args_positional_list args_cmds(
@@ -2680,6 +3718,10 @@ int main(int argc, char* argv[]) {
         xia::logging::start("log", log, false);
         xia::logging::set_level(log_level);
 
+        if (eeprom_cache_flag) {
+            xia::pixie::eeprom::cache_open(args::get(eeprom_cache_flag));
+        }
+
         std::ostream* out = &std::cout;
         std::ofstream output;
         if (out_file_flag) {
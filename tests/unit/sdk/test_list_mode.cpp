@@ -20,9 +20,22 @@
  * @brief Tests related to the list_mode namespace
  */
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <thread>
+
 #include <doctest/doctest.h>
 
+#include <pixie/data/energy.hpp>
+#include <pixie/data/histogrammer.hpp>
 #include <pixie/data/list_mode.hpp>
+#include <pixie/data/merge.hpp>
+#include <pixie/data/tau.hpp>
+#include <pixie/data/trace.hpp>
 #include <pixie/error.hpp>
 
 using namespace xia::pixie::data::list_mode;
@@ -82,6 +95,43 @@ TEST_SUITE("xia::pixie::list_mode") {
             CHECK(rec == evt);
         }
 
+        SUBCASE("Verify binary output and input") {
+            binary bin;
+            CHECK_THROWS_AS(record_to_binary(evt, bin), xia::pixie::error::error);
+            CHECK(bin.empty());
+
+            record rec = evt;
+            rec.trace = {1, 2, 3, 65535, 5};
+            rec.energy_sums = {123, 456, 789};
+            rec.qdc = {1, 2, 3, 4, 5, 6, 7, 8};
+            rec.filter_baseline = 12.5;
+            rec.trace_out_of_range = true;
+            record_to_binary(rec, bin);
+            CHECK(bin.size() == binary_record_size(rec));
+            CHECK(bin.size() % 4 == 0);
+            record from_bin;
+            CHECK(binary_to_record(bin.data(), bin.size(), from_bin) == bin.size());
+            CHECK(from_bin == rec);
+            CHECK(from_bin.trace == rec.trace);
+            CHECK(from_bin.energy_sums == rec.energy_sums);
+            CHECK(from_bin.qdc == rec.qdc);
+            CHECK(from_bin.external_time == rec.external_time);
+            CHECK(from_bin.filter_baseline == rec.filter_baseline);
+            CHECK(from_bin.trace_out_of_range == rec.trace_out_of_range);
+
+            records recs = {rec, rec, rec};
+            bin.clear();
+            records_to_binary(recs, bin);
+            records from_bins;
+            CHECK(binary_to_records(bin.data(), bin.size() - 2, from_bins) ==
+                  2 * binary_record_size(rec));
+            CHECK(from_bins.size() == 2);
+
+            bin[4] = 99;
+            CHECK_THROWS_WITH_AS(binary_to_record(bin.data(), bin.size(), from_bin),
+                                 "binary record: unsupported version: 99",
+                                 xia::pixie::error::error);
+        }
         SUBCASE("Verify streamed output") {
             std::ostringstream buf;
             buf << evt;
@@ -486,4 +536,1737 @@ TEST_SUITE("xia::pixie::list_mode") {
         decode_data_block(data, 34688, 500, recs, leftover);
         check_decoded_data(recs[0], evt);
     }
-}
\ No newline at end of file
+    TEST_CASE("fixed point time") {
+        const record::fixed_time_type timestamp = 17514317598928;
+        records recs;
+        buffer leftover;
+        SUBCASE("100 MHz") {
+            auto data = generate_data(2151882794, 3735933136, 202182637, 2149450208, true, true,
+                                      true, true);
+            decode_data_block(data, 34688, 100, recs, leftover);
+            REQUIRE(recs.size() == 1);
+            CHECK(recs[0].timestamp == uint64_t(timestamp));
+            CHECK(recs[0].cfd_fixed_time == 964);
+            CHECK(recs[0].fixed_time == timestamp * 10240 + 964);
+        }
+        SUBCASE("250 MHz") {
+            auto data = generate_data(2148024362, 3735933136, 1275924461, 2147484128, false, false,
+                                      false, false);
+            decode_data_block(data, 34688, 250, recs, leftover);
+            REQUIRE(recs.size() == 1);
+            CHECK(recs[0].timestamp == uint64_t(timestamp));
+            CHECK(recs[0].cfd_fixed_time == 771 - 4096);
+            CHECK(recs[0].fixed_time == timestamp * 8192 + 771 - 4096);
+        }
+        SUBCASE("500 MHz") {
+            auto data = generate_data(2151882794, 3735933136, 3423408109, 2149450208, true, true,
+                                      true, true);
+            decode_data_block(data, 34688, 500, recs, leftover);
+            REQUIRE(recs.size() == 1);
+            CHECK(recs[0].cfd_fixed_time == 771 + 5 * 2048);
+            CHECK(recs[0].fixed_time == timestamp * 10240 + 771 + 5 * 2048);
+        }
+        SUBCASE("Batch") {
+            auto data = generate_data(2151882794, 3735933136, 202182637, 2149450208, true, true,
+                                      true, true);
+            decode_data_block(data, 34688, 100, recs, leftover);
+            event_batch batch;
+            decode_data_block(data.data(), data.size(), 34688, 100, batch, leftover);
+            REQUIRE(batch.size() == 1);
+            CHECK(batch.timestamp[0] == recs[0].timestamp);
+            CHECK(batch.fixed_time[0] == recs[0].fixed_time);
+            record rec;
+            batch.get(0, rec);
+            CHECK(rec.fixed_time == recs[0].fixed_time);
+        }
+        for (auto& rec : recs) {
+            CHECK(record::from_fixed_time(rec.fixed_time).count() ==
+                  doctest::Approx(rec.time.count()).epsilon(1e-12));
+        }
+
+        record rec;
+        rec.set_time(record::time_type(1.5e-6));
+        CHECK(rec.fixed_time == 1500 * record::fixed_time_per_ns);
+        CHECK(rec.cfd_fixed_time == 0);
+        rec.shift_time(record::time_type(-0.5e-6));
+        CHECK(rec.fixed_time == 1000 * record::fixed_time_per_ns);
+        CHECK(rec.time.count() == doctest::Approx(1e-6));
+        CHECK(record::to_fixed_time(record::from_fixed_time(123456789)) == 123456789);
+    }
+    TEST_CASE("compact events") {
+        auto full =
+            generate_data(2151882794, 3735933136, 202182637, 2149450208, true, true, true, true);
+        auto header = generate_data(2148024362, 3735933136, 1275924461, 2147484128, false, false,
+                                    false, false);
+        buffer data = full;
+        data.insert(data.end(), header.begin(), header.end());
+        records recs;
+        buffer leftover;
+        decode_data_block(data, 34688, 100, recs, leftover);
+        REQUIRE(recs.size() == 2);
+
+        CHECK(sizeof(compact_event) == 48);
+
+        auto check_record = [](const record& rec, const record& expected, bool blocks) {
+            CHECK(rec.crate_id == expected.crate_id);
+            CHECK(rec.slot_id == expected.slot_id);
+            CHECK(rec.channel_number == expected.channel_number);
+            CHECK(rec.cfd_trigger_source == expected.cfd_trigger_source);
+            CHECK(rec.cfd_forced_trigger == expected.cfd_forced_trigger);
+            CHECK(rec.finish_code == expected.finish_code);
+            CHECK(rec.trace_out_of_range == expected.trace_out_of_range);
+            CHECK(rec.energy == expected.energy);
+            CHECK(rec.event_length == expected.event_length);
+            CHECK(rec.header_length == expected.header_length);
+            CHECK(rec.fixed_time == expected.fixed_time);
+            CHECK(rec.cfd_fixed_time == expected.cfd_fixed_time);
+            CHECK(rec.timestamp == expected.timestamp);
+            CHECK(rec.time.count() == doctest::Approx(expected.time.count()).epsilon(1e-12));
+            CHECK(rec.filter_time.count() ==
+                  doctest::Approx(expected.filter_time.count()).epsilon(1e-12));
+            if (blocks) {
+                CHECK(rec.external_time == expected.external_time);
+                CHECK(rec.energy_sums == expected.energy_sums);
+                CHECK(rec.filter_baseline == doctest::Approx(expected.filter_baseline));
+                CHECK(rec.qdc == expected.qdc);
+                CHECK(rec.trace == expected.trace);
+                CHECK(rec.trace_length == expected.trace_length);
+            }
+        };
+
+        SUBCASE("From records") {
+            compact_events events;
+            for (auto& rec : recs) {
+                events.add(rec);
+            }
+            REQUIRE(events.size() == 2);
+            CHECK(events.trace(0).length == recs[0].trace.size());
+            CHECK(events.trace(1).length == 0);
+            for (size_t e = 0; e < recs.size(); ++e) {
+                record rec;
+                events.get(e, rec);
+                check_record(rec, recs[e], true);
+            }
+            CHECK(events.bytes() == 2 * sizeof(compact_event) + 14 * sizeof(uint32_t) +
+                                        recs[0].trace.size() * sizeof(uint16_t));
+            CHECK_THROWS_AS(events.get(2, recs[0]), xia::pixie::error::error);
+        }
+        SUBCASE("Decoded") {
+            compact_events events;
+            decode_data_block(data.data(), data.size(), 34688, 100, events, leftover);
+            REQUIRE(events.size() == 2);
+            for (size_t e = 0; e < recs.size(); ++e) {
+                record rec;
+                events.get(e, rec);
+                check_record(rec, recs[e], true);
+            }
+        }
+        SUBCASE("Selected blocks") {
+            compact_events events(scan_external_time);
+            decode_data_block(data.data(), data.size(), 34688, 100, events, leftover);
+            REQUIRE(events.size() == 2);
+            CHECK(events.traces.empty());
+            CHECK(events.block_words.size() == 2);
+            record rec;
+            events.get(0, rec);
+            check_record(rec, recs[0], false);
+            CHECK(rec.external_time == recs[0].external_time);
+            CHECK(rec.energy_sums.empty());
+            CHECK(rec.qdc.empty());
+            CHECK(rec.trace.empty());
+            CHECK(rec.trace_length == recs[0].trace_length);
+            events.clear();
+            CHECK(events.empty());
+        }
+        SUBCASE("Values that do not fit") {
+            compact_events events;
+            record rec = recs[0];
+            rec.slot_id = 300;
+            CHECK_THROWS_AS(events.add(rec), xia::pixie::error::error);
+            rec = recs[0];
+            rec.qdc.resize(3);
+            CHECK_THROWS_AS(events.add(rec), xia::pixie::error::error);
+            CHECK(events.empty());
+        }
+    }
+    TEST_CASE("decoder") {
+        auto full =
+            generate_data(2151882794, 3735933136, 202182637, 2149450208, true, true, true, true);
+        auto header = generate_data(2148024362, 3735933136, 1275924461, 2147484128, false, false,
+                                    false, false);
+        buffer data = full;
+        data.insert(data.end(), header.begin(), header.end());
+        records expected;
+        buffer leftover;
+        decode_data_block(data, 34688, 100, expected, leftover);
+        REQUIRE(expected.size() == 2);
+
+        decoder dec(34688, 100);
+        CHECK(dec.revision == 34688);
+        CHECK(dec.frequency == 100);
+
+        SUBCASE("Records") {
+            records recs(3);
+            dec.decode(data.data(), data.size(), recs, leftover);
+            REQUIRE(recs.size() == expected.size());
+            for (size_t r = 0; r < recs.size(); ++r) {
+                CHECK(recs[r] == expected[r]);
+                check_decoded_data(recs[r], expected[r]);
+            }
+            CHECK(leftover.empty());
+        }
+        SUBCASE("Arena") {
+            record_arena arena;
+            dec.decode(data.data(), data.size(), arena, leftover);
+            REQUIRE(arena.size() == expected.size());
+            for (size_t r = 0; r < arena.size(); ++r) {
+                check_decoded_data(arena[r], expected[r]);
+            }
+        }
+        SUBCASE("Batch") {
+            event_batch batch;
+            dec.decode(data.data(), data.size(), batch, leftover);
+            dec.decode(data.data(), data.size(), batch, leftover);
+            REQUIRE(batch.size() == 2 * expected.size());
+            CHECK(batch.timestamp[0] == expected[0].timestamp);
+            CHECK(batch.timestamp[3] == expected[1].timestamp);
+        }
+        SUBCASE("Compact") {
+            compact_events events;
+            dec.decode(data.data(), data.size(), events, leftover);
+            CHECK(events.size() == expected.size());
+        }
+        SUBCASE("Leftovers") {
+            records recs;
+            dec.decode(data.data(), full.size() - 2, recs, leftover);
+            CHECK(recs.empty());
+            CHECK(leftover.size() == full.size() - 2);
+        }
+        SUBCASE("Invalid") {
+            CHECK_THROWS_WITH_AS(decoder(29000, 189), "invalid frequency: 189",
+                                 xia::pixie::error::error);
+            CHECK_THROWS_WITH_AS(decoder(1, 250), "minimum supported firmware rev is 17562",
+                                 xia::pixie::error::error);
+            CHECK_THROWS_WITH_AS(decoder(29000, 500), "minimum supported firmware rev is 29432",
+                                 xia::pixie::error::error);
+            records recs;
+            CHECK_THROWS_WITH_AS(dec.decode(nullptr, 0, recs, leftover),
+                                 "buffer pointed to an invalid location",
+                                 xia::pixie::error::error);
+        }
+    }
+    TEST_CASE("calibration") {
+        auto data =
+            generate_data(2151882794, 3735933136, 202182637, 2149450208, true, true, true, true);
+        records plain;
+        buffer leftover;
+        decode_data_block(data, 34688, 100, plain, leftover);
+        REQUIRE(plain.size() == 1);
+
+        calibration calib;
+        CHECK_THROWS_AS(calib.set(16, 2, 10, {0, 1}), xia::pixie::error::error);
+        CHECK_THROWS_AS(calib.set(0, 2, 16, {0, 1}), xia::pixie::error::error);
+        calib.set(0, 2, 10, {1, 2}, calibration::time_type(100e-9));
+        calib.set(0, 2, 11, {5});
+        CHECK_FALSE(calib.compiled());
+        CHECK(calib.find(0, 2, 10) == nullptr);
+
+        records recs;
+        CHECK_THROWS_AS(decode_data_block(data.data(), data.size(), 34688, 100, recs, leftover,
+                                          &calib),
+                        xia::pixie::error::error);
+        calib.compile();
+        REQUIRE(calib.find(0, 2, 10) != nullptr);
+        CHECK(calib.find(0, 2, 12) == nullptr);
+        CHECK(calib.find(0, 2, 10)->energy[480] == 961);
+
+        SUBCASE("Records") {
+            decode_data_block(data.data(), data.size(), 34688, 100, recs, leftover, &calib);
+            REQUIRE(recs.size() == 1);
+            CHECK(recs[0].energy == 961);
+            CHECK(recs[0].time.count() == doctest::Approx(plain[0].time.count() + 100e-9));
+            CHECK(recs[0].filter_time.count() ==
+                  doctest::Approx(plain[0].filter_time.count() + 100e-9));
+            CHECK(recs[0].cfd_fractional_time == plain[0].cfd_fractional_time);
+            CHECK(recs[0].fixed_time == plain[0].fixed_time + 100 * record::fixed_time_per_ns);
+            CHECK(recs[0].timestamp == plain[0].timestamp);
+        }
+        SUBCASE("Batch") {
+            event_batch batch;
+            decode_data_block(data.data(), data.size(), 34688, 100, batch, leftover, &calib);
+            REQUIRE(batch.size() == 1);
+            CHECK(batch.energy[0] == 961);
+            CHECK(batch.fixed_time[0] == plain[0].fixed_time + 100 * record::fixed_time_per_ns);
+        }
+        SUBCASE("Uncalibrated channel") {
+            calib.clear();
+            calib.set(0, 3, 10, {0, 4}, calibration::time_type(1e-6));
+            calib.compile();
+            decode_data_block(data.data(), data.size(), 34688, 100, recs, leftover, &calib);
+            REQUIRE(recs.size() == 1);
+            CHECK(recs[0].energy == plain[0].energy);
+            CHECK(recs[0].fixed_time == plain[0].fixed_time);
+        }
+        SUBCASE("Time offset only") {
+            calib.set(0, 2, 10, {}, calibration::time_type(-10e-9));
+            calib.compile();
+            decode_data_block(data.data(), data.size(), 34688, 100, recs, leftover, &calib);
+            REQUIRE(recs.size() == 1);
+            CHECK(recs[0].energy == plain[0].energy);
+            CHECK(recs[0].fixed_time == plain[0].fixed_time - 10 * record::fixed_time_per_ns);
+        }
+    }
+    TEST_CASE("event batch") {
+        buffer leftover;
+        auto data =
+            generate_data(2151882794, 3735933136, 1275924461, 2149450208, true, true, true, true);
+        auto header = generate_data(2148024362, 3735933136, 1275924461, 2147484128, false, false,
+                                    false, false);
+        data.insert(data.end(), header.begin(), header.end());
+        records recs;
+        decode_data_block(data, 34688, 250, recs, leftover);
+        REQUIRE(recs.size() == 2);
+
+        event_batch batch;
+        decode_data_block(data.data(), data.size(), 34688, 250, batch, leftover);
+        SUBCASE("Matches records") {
+            REQUIRE(batch.size() == recs.size());
+            for (size_t e = 0; e < batch.size(); ++e) {
+                record rec;
+                batch.get(e, rec);
+                CHECK(rec == recs[e]);
+                CHECK(rec.time == recs[e].time);
+                CHECK(rec.external_time == recs[e].external_time);
+                CHECK(rec.filter_baseline == recs[e].filter_baseline);
+                CHECK(rec.energy_sums == recs[e].energy_sums);
+                CHECK(rec.qdc == recs[e].qdc);
+                CHECK(rec.trace == recs[e].trace);
+                CHECK(rec.trace_length == recs[e].trace_length);
+                CHECK(rec.cfd_forced_trigger == recs[e].cfd_forced_trigger);
+                CHECK(rec.finish_code == recs[e].finish_code);
+                CHECK(rec.header_length == recs[e].header_length);
+                CHECK(rec.event_length == recs[e].event_length);
+            }
+            CHECK(batch.energy_sums_offset[1] == event_batch::no_data);
+            CHECK(batch.qdc_offset[1] == event_batch::no_data);
+            CHECK(batch.trace(1).length == 0);
+        }
+        SUBCASE("Appends and clears") {
+            decode_data_block(data.data(), data.size(), 34688, 250, batch, leftover);
+            CHECK(batch.size() == 4);
+            auto capacity = batch.time.capacity();
+            batch.clear();
+            CHECK(batch.empty());
+            CHECK(batch.traces.empty());
+            CHECK(batch.time.capacity() == capacity);
+        }
+        SUBCASE("Out of range") {
+            record rec;
+            CHECK_THROWS_AS(batch.get(batch.size(), rec), xia::pixie::error::error);
+        }
+        SUBCASE("Same errors") {
+            CHECK_THROWS_WITH_AS(decode_data_block(nullptr, 0, 30474, 250, batch, leftover),
+                                 "buffer pointed to an invalid location", xia::pixie::error::error);
+        }
+    }
+    TEST_CASE("scan") {
+        auto full =
+            generate_data(2151882794, 3735933136, 1275924461, 2149450208, true, true, true, true);
+        auto header = generate_data(2148024362, 3735933136, 1275924461, 2147484128, false, false,
+                                    false, false);
+        buffer data;
+        for (size_t e = 0; e < 50; ++e) {
+            auto& evt = (e % 2) == 0 ? full : header;
+            data.insert(data.end(), evt.begin(), evt.end());
+        }
+        data.insert(data.end(), full.begin(), full.begin() + 6);
+        event_batch batch;
+        buffer leftover;
+        decode_data_block(data.data(), data.size(), 34688, 250, batch, leftover);
+        REQUIRE(batch.size() == 50);
+        CHECK(batch.holds(scan_all));
+
+        event_batch scanned;
+        buffer scan_leftover;
+        SUBCASE("Header fields") {
+            scan_data_block(data.data(), data.size(), 34688, 250, scan_times | scan_energy,
+                            scanned, scan_leftover);
+            REQUIRE(scanned.size() == batch.size());
+            CHECK(scan_leftover == leftover);
+            CHECK(scanned.holds(scan_times | scan_energy));
+            CHECK_FALSE(scanned.holds(scan_ids));
+            CHECK(scanned.time == batch.time);
+            CHECK(scanned.energy == batch.energy);
+            CHECK(scanned.event_length == batch.event_length);
+            CHECK(scanned.header_length == batch.header_length);
+            CHECK(scanned.trace_length == batch.trace_length);
+            CHECK(scanned.channel.empty());
+            CHECK(scanned.external_time.empty());
+            CHECK(scanned.energy_sums.empty());
+            CHECK(scanned.qdc.empty());
+            CHECK(scanned.traces.empty());
+            CHECK(scanned.trace(0).length == 0);
+            record rec;
+            scanned.get(0, rec);
+            CHECK(rec.energy == 480);
+            CHECK(rec.time.count() == batch.time[0]);
+            CHECK(rec.trace.empty());
+            CHECK(rec.trace_length == batch.trace_length[0]);
+            CHECK(rec.slot_id == 0);
+        }
+        SUBCASE("All fields") {
+            scan_data_block(data.data(), data.size(), 34688, 250, scan_all, scanned,
+                            scan_leftover);
+            REQUIRE(scanned.size() == batch.size());
+            for (size_t e = 0; e < batch.size(); ++e) {
+                record expected;
+                record rec;
+                batch.get(e, expected);
+                scanned.get(e, rec);
+                CHECK(rec == expected);
+                CHECK(rec.trace == expected.trace);
+                CHECK(rec.qdc == expected.qdc);
+            }
+        }
+        SUBCASE("Parallel") {
+            std::atomic_size_t events(0);
+            std::atomic_size_t traces(0);
+            decode_data_block_parallel(
+                data.data(), data.size(), 34688, 250, 2,
+                [&events, &traces](size_t, event_batch& b) {
+                    CHECK(b.holds(scan_ids));
+                    CHECK_FALSE(b.holds(scan_traces));
+                    events += b.size();
+                    traces += b.traces.size();
+                },
+                scan_leftover, scan_ids);
+            CHECK(events.load() == batch.size());
+            CHECK(traces.load() == 0);
+        }
+        SUBCASE("Same errors") {
+            CHECK_THROWS_WITH_AS(
+                scan_data_block(nullptr, 0, 30474, 250, scan_header, scanned, scan_leftover),
+                "buffer pointed to an invalid location", xia::pixie::error::error);
+        }
+    }
+    TEST_CASE("unpack trace") {
+        buffer words;
+        for (uint32_t w = 0; w < 13; ++w) {
+            words.push_back(((2 * w + 1) << 16) | (2 * w));
+        }
+        std::vector<uint16_t> samples(words.size() * 2);
+        unpack_trace(words.data(), words.size(), samples.data());
+        for (size_t s = 0; s < samples.size(); ++s) {
+            CHECK(samples[s] == s);
+        }
+    }
+    TEST_CASE("parallel decode") {
+        auto full =
+            generate_data(2151882794, 3735933136, 1275924461, 2149450208, true, true, true, true);
+        auto header = generate_data(2148024362, 3735933136, 1275924461, 2147484128, false, false,
+                                    false, false);
+        buffer data;
+        for (size_t e = 0; e < 500; ++e) {
+            auto& evt = (e % 3) == 0 ? header : full;
+            data.insert(data.end(), evt.begin(), evt.end());
+        }
+        const size_t complete = data.size();
+        data.insert(data.end(), full.begin(), full.begin() + 6);
+
+        records recs;
+        buffer leftover;
+        decode_data_block(data, 34688, 250, recs, leftover);
+
+        SUBCASE("Event boundaries") {
+            std::vector<size_t> boundaries;
+            CHECK(find_event_boundaries(data.data(), data.size(), 34688, 250, 1000, boundaries) ==
+                  complete);
+            REQUIRE(boundaries.size() > 2);
+            CHECK(boundaries.front() == 0);
+            CHECK(boundaries.back() == complete);
+            for (size_t b = 1; b < boundaries.size() - 1; ++b) {
+                CHECK(boundaries[b] - boundaries[b - 1] >= 1000);
+            }
+        }
+        SUBCASE("Matches serial decode") {
+            const size_t threads = 4;
+            std::vector<size_t> counts(threads, 0);
+            std::vector<double> energy(threads, 0);
+            std::vector<size_t> trace_samples(threads, 0);
+            buffer parallel_leftover;
+            decode_data_block_parallel(
+                data.data(), data.size(), 34688, 250, threads,
+                [&](size_t worker, event_batch& batch) {
+                    counts[worker] += batch.size();
+                    trace_samples[worker] += batch.traces.size();
+                    for (auto e : batch.energy) {
+                        energy[worker] += e;
+                    }
+                },
+                parallel_leftover);
+            size_t total = 0;
+            size_t total_samples = 0;
+            double total_energy = 0;
+            for (size_t t = 0; t < threads; ++t) {
+                total += counts[t];
+                total_samples += trace_samples[t];
+                total_energy += energy[t];
+            }
+            size_t expected_samples = 0;
+            double expected_energy = 0;
+            for (const auto& rec : recs) {
+                expected_samples += rec.trace.size();
+                expected_energy += rec.energy;
+            }
+            CHECK(total == recs.size());
+            CHECK(total_samples == expected_samples);
+            CHECK(total_energy == expected_energy);
+            CHECK(parallel_leftover == leftover);
+        }
+        SUBCASE("Errors") {
+            size_t offset = 0;
+            for (size_t e = 0; e < recs.size() / 2; ++e) {
+                offset += recs[e].event_length;
+            }
+            data[offset + 3] = 0;
+            buffer parallel_leftover;
+            CHECK_THROWS_AS(decode_data_block_parallel(
+                                data.data(), data.size(), 34688, 250, 4,
+                                [](size_t, event_batch&) {}, parallel_leftover),
+                            xia::pixie::error::error);
+        }
+    }
+    TEST_CASE("event filter") {
+        auto full =
+            generate_data(2151882794, 3735933136, 1275924461, 2149450208, true, true, true, true);
+        auto header = generate_data(2148024362, 3735933136, 1275924461, 2147484128, false, false,
+                                    false, false);
+        buffer data;
+        for (uint32_t e = 0; e < 300; ++e) {
+            auto evt = (e % 3) == 1 ? header : full;
+            evt[0] = (evt[0] & ~0x8000000FU) | (e % 4) | ((e % 5) == 0 ? 0x80000000U : 0);
+            evt[3] = (evt[3] & ~0xFFFFU) | (100 * (e % 7));
+            data.insert(data.end(), evt.begin(), evt.end());
+        }
+        records recs;
+        buffer leftover;
+        decode_data_block(data, 34688, 250, recs, leftover);
+        REQUIRE(recs.size() == 300);
+
+        reduction policy;
+        SUBCASE("Pass through") {
+            CHECK(policy.pass_through());
+            event_filter filter;
+            CHECK_FALSE(filter.enabled());
+            filter.configure(policy, 34688, 250);
+            CHECK_FALSE(filter.enabled());
+            auto block = data;
+            filter.reduce(block);
+            CHECK(block == data);
+        }
+        SUBCASE("Reduces split blocks") {
+            policy.channel_mask = 0x7;
+            policy.energy_min = 100;
+            policy.energy_max = 500;
+            policy.finish_code = reduction::finish_codes::drop;
+            policy.trace_policy = {reduction::traces::keep, reduction::traces::strip,
+                                   reduction::traces::pileup};
+            CHECK_FALSE(policy.pass_through());
+            records expected;
+            for (auto rec : recs) {
+                if (rec.channel_number < 3 && rec.energy >= 100 && rec.energy <= 500 &&
+                    !rec.finish_code) {
+                    if (rec.channel_number != 0) {
+                        rec.trace.clear();
+                    }
+                    expected.push_back(rec);
+                }
+            }
+            REQUIRE(!expected.empty());
+            for (size_t block_size : {size_t(1), size_t(3), size_t(7), size_t(37), data.size()}) {
+                CAPTURE(block_size);
+                event_filter filter;
+                filter.configure(policy, 34688, 250);
+                CHECK(filter.enabled());
+                buffer reduced;
+                for (size_t b = 0; b < data.size(); b += block_size) {
+                    buffer block(data.begin() + b,
+                                 data.begin() + std::min(b + block_size, data.size()));
+                    filter.reduce(block);
+                    reduced.insert(reduced.end(), block.begin(), block.end());
+                }
+                records out;
+                decode_data_block(reduced, 34688, 250, out, leftover);
+                CHECK(leftover.empty());
+                REQUIRE(out.size() == expected.size());
+                for (size_t e = 0; e < out.size(); ++e) {
+                    CHECK(out[e] == expected[e]);
+                    CHECK(out[e].trace == expected[e].trace);
+                    CHECK(out[e].trace_length == expected[e].trace.size());
+                    CHECK(out[e].event_length == out[e].header_length + out[e].trace.size() / 2);
+                }
+                CHECK(filter.counts().events_in == recs.size());
+                CHECK(filter.counts().events_out == expected.size());
+                CHECK(filter.counts().words_out == reduced.size());
+            }
+        }
+        SUBCASE("Reduces traces to a region of interest") {
+            reduction::trace_roi roi;
+            roi.start = 10;
+            roi.length = 8;
+            roi.decimation = 4;
+            reduction::trace_roi roi_only;
+            roi_only.start = 25;
+            roi_only.length = 10;
+            policy.trace_policy = {reduction::traces::roi, reduction::traces::roi};
+            policy.trace_rois = {roi, roi_only};
+            CHECK_FALSE(policy.pass_through());
+            /*
+             * The mean of each 4 samples before and after the region.
+             */
+            auto reference = [](const reduction::trace_roi& r, const record::trace_type& in) {
+                record::trace_type out;
+                auto decimate = [&](size_t from, size_t to) {
+                    for (size_t s = from; r.decimation != 0 && s < to; s += r.decimation) {
+                        const size_t end = std::min(s + r.decimation, to);
+                        size_t sum = 0;
+                        for (size_t d = s; d < end; ++d) {
+                            sum += in[d];
+                        }
+                        out.push_back(sum / (end - s));
+                    }
+                };
+                const size_t roi_end = std::min(r.start + r.length, in.size());
+                decimate(0, r.start);
+                out.insert(out.end(), in.begin() + r.start, in.begin() + roi_end);
+                decimate(roi_end, in.size());
+                if ((out.size() & 1) != 0) {
+                    out.push_back(0);
+                }
+                return out;
+            };
+            records expected;
+            for (auto rec : recs) {
+                if (!rec.trace.empty() && rec.channel_number < 2) {
+                    auto& r = policy.trace_rois[rec.channel_number];
+                    rec.trace = reference(r, rec.trace);
+                    CHECK(rec.trace.size() == r.reduced_length(rec.trace_length));
+                    rec.trace_length = rec.trace.size();
+                    rec.event_length = rec.header_length + rec.trace.size() / 2;
+                }
+                expected.push_back(rec);
+            }
+            for (size_t block_size : {size_t(1), size_t(3), size_t(7), size_t(37), data.size()}) {
+                CAPTURE(block_size);
+                event_filter filter;
+                filter.configure(policy, 34688, 250);
+                buffer reduced;
+                for (size_t b = 0; b < data.size(); b += block_size) {
+                    buffer block(data.begin() + b,
+                                 data.begin() + std::min(b + block_size, data.size()));
+                    filter.reduce(block);
+                    reduced.insert(reduced.end(), block.begin(), block.end());
+                }
+                records out;
+                decode_data_block(reduced, 34688, 250, out, leftover);
+                CHECK(leftover.empty());
+                REQUIRE(out.size() == expected.size());
+                for (size_t e = 0; e < out.size(); ++e) {
+                    CHECK(out[e].trace == expected[e].trace);
+                    CHECK(out[e].trace_length == expected[e].trace_length);
+                    CHECK(out[e].event_length == expected[e].event_length);
+                }
+                CHECK(filter.counts().events_in == recs.size());
+                CHECK(filter.counts().events_out == recs.size());
+                CHECK(filter.counts().traces_reduced > 0);
+                CHECK(filter.counts().words_out == reduced.size());
+            }
+            record::trace_type trace;
+            roi.expand(reference(roi, recs[0].trace), recs[0].trace.size(), trace);
+            REQUIRE(trace.size() == recs[0].trace.size());
+            for (size_t s = 10; s < 18; ++s) {
+                CHECK(trace[s] == recs[0].trace[s]);
+            }
+            CHECK(trace[0] == trace[3]);
+            CHECK(trace[18] == trace[21]);
+            CHECK_THROWS_AS(roi.expand(record::trace_type(4), 30, trace),
+                            xia::pixie::error::error);
+        }
+        SUBCASE("Errors") {
+            event_filter filter;
+            CHECK_THROWS_AS(filter.configure(policy, 20000, 250), xia::pixie::error::error);
+            CHECK_THROWS_AS(filter.configure(policy, 34688, 189), xia::pixie::error::error);
+            policy.energy_min = 10;
+            policy.energy_max = 9;
+            CHECK_THROWS_AS(filter.configure(policy, 34688, 250), xia::pixie::error::error);
+            policy.energy_min = 0;
+            policy.trace_policy = {reduction::traces::roi};
+            CHECK_THROWS_AS(filter.configure(policy, 34688, 250), xia::pixie::error::error);
+            policy.trace_policy.clear();
+            policy.energy_min = 10;
+            policy.energy_max = 10;
+            filter.configure(policy, 34688, 250);
+            buffer block = data;
+            block[0] &= ~0x0001F000U;
+            CHECK_THROWS_AS(filter.reduce(block), xia::pixie::error::error);
+        }
+    }
+    TEST_CASE("event validator") {
+        auto full =
+            generate_data(2151882794, 3735933136, 1275924461, 2149450208, true, true, true, true);
+        auto header = generate_data(2148024362, 3735933136, 1275924461, 2147484128, false, false,
+                                    false, false);
+        buffer data;
+        std::vector<size_t> starts;
+        for (uint32_t e = 0; e < 100; ++e) {
+            auto& evt = (e % 3) == 1 ? header : full;
+            starts.push_back(data.size());
+            data.insert(data.end(), evt.begin(), evt.end());
+        }
+        using fault_kind = event_validator::fault_kind;
+        SUBCASE("Valid split blocks") {
+            for (size_t block_size : {size_t(1), size_t(3), size_t(7), size_t(37), data.size()}) {
+                CAPTURE(block_size);
+                event_validator validator;
+                CHECK_FALSE(validator.enabled());
+                validator.configure(34688, 250, 2);
+                CHECK(validator.enabled());
+                size_t faults = 0;
+                for (size_t b = 0; b < data.size(); b += block_size) {
+                    faults += validator.validate(data.data() + b,
+                                                 std::min(block_size, data.size() - b));
+                }
+                CHECK(faults == 0);
+                CHECK(validator.counts().events == 100);
+                CHECK(validator.counts().words == data.size());
+                CHECK(validator.found().empty());
+            }
+        }
+        SUBCASE("Faults and resync") {
+            buffer block = data;
+            block[starts[10]] &= ~0x0001F000U;
+            const size_t zeros_at = starts[50];
+            block.insert(block.begin() + zeros_at, 40, 0);
+            for (size_t block_size : {size_t(5), block.size()}) {
+                CAPTURE(block_size);
+                event_validator validator;
+                validator.configure(34688, 250, 2);
+                size_t faults = 0;
+                for (size_t b = 0; b < block.size(); b += block_size) {
+                    faults += validator.validate(block.data() + b,
+                                                 std::min(block_size, block.size() - b));
+                }
+                CHECK(faults == 3);
+                CHECK(validator.counts().resyncs == 2);
+                CHECK(validator.counts().zero_runs == 1);
+                CHECK(validator.counts().events == 99);
+                auto found = validator.found();
+                std::stable_sort(found.begin(), found.end(),
+                                 [](const event_validator::fault& a,
+                                    const event_validator::fault& b) {
+                                     return a.offset < b.offset;
+                                 });
+                REQUIRE(found.size() == 5);
+                CHECK(found[0].kind == fault_kind::header_length);
+                CHECK(found[0].offset == starts[10]);
+                CHECK(found[1].kind == fault_kind::resync);
+                CHECK(found[1].offset == starts[11]);
+                CHECK(found[1].word == starts[11] - starts[10]);
+                CHECK(found[2].kind == fault_kind::header_length);
+                CHECK(found[2].offset == zeros_at);
+                CHECK(found[3].kind == fault_kind::zero_run);
+                CHECK(found[3].offset == zeros_at);
+                CHECK(found[4].kind == fault_kind::resync);
+                CHECK(found[4].offset == zeros_at + 40);
+                CHECK(found[4].word == 40);
+                validator.reset();
+                CHECK(validator.found().empty());
+                CHECK(validator.counts().faults == 0);
+            }
+        }
+        SUBCASE("Wrong slot") {
+            event_validator validator;
+            validator.configure(34688, 250, 3);
+            CHECK(validator.validate(data) == 1);
+            REQUIRE(validator.found().size() == 1);
+            CHECK(validator.found()[0].kind == fault_kind::slot);
+            /*
+             * The last words are held to be tried with the next block.
+             */
+            CHECK(validator.counts().skipped_words == data.size() - 3);
+            CHECK(validator.counts().resyncs == 0);
+        }
+        SUBCASE("Errors") {
+            event_validator validator;
+            CHECK_THROWS_AS(validator.validate(data), xia::pixie::error::error);
+            CHECK_THROWS_AS(validator.configure(20000, 250, 2), xia::pixie::error::error);
+            CHECK_THROWS_AS(validator.configure(34688, 189, 2), xia::pixie::error::error);
+        }
+    }
+    TEST_CASE("decode recovery") {
+        auto full =
+            generate_data(2151882794, 3735933136, 1275924461, 2149450208, true, true, true, true);
+        auto header = generate_data(2148024362, 3735933136, 1275924461, 2147484128, false, false,
+                                    false, false);
+        buffer data;
+        std::vector<size_t> starts;
+        for (uint32_t e = 0; e < 100; ++e) {
+            auto& evt = (e % 3) == 1 ? header : full;
+            starts.push_back(data.size());
+            data.insert(data.end(), evt.begin(), evt.end());
+        }
+        buffer block = data;
+        block[starts[10]] &= ~0xF0U;
+        block.insert(block.begin() + starts[50], 7, 0xFFFFFFFF);
+        SUBCASE("Skips corrupt words") {
+            buffer leftovers;
+            records recs;
+            CHECK_THROWS_AS(decode_data_block(block.data(), block.size(), 34688, 250, recs,
+                                              leftovers),
+                            xia::pixie::error::error);
+            for (size_t block_size : {size_t(5), size_t(37), block.size()}) {
+                CAPTURE(block_size);
+                recovery recover(2);
+                leftovers.clear();
+                size_t decoded = 0;
+                for (size_t b = 0; b < block.size(); b += block_size) {
+                    buffer words = leftovers;
+                    words.insert(words.end(), block.begin() + b,
+                                 block.begin() + std::min(b + block_size, block.size()));
+                    decode_data_block(words.data(), words.size(), 34688, 250, recs, leftovers,
+                                      nullptr, &recover);
+                    decoded += recs.size();
+                }
+                CHECK(leftovers.empty());
+                CHECK(decoded == 99);
+                CHECK(recover.errors == 2);
+                CHECK(recover.resyncs == 2);
+                CHECK(recover.skipped_words == starts[11] - starts[10] + 7);
+                CHECK_FALSE(recover.resyncing);
+            }
+        }
+        SUBCASE("Batch") {
+            recovery recover;
+            buffer leftovers;
+            event_batch batch;
+            decode_data_block(block.data(), block.size(), 34688, 250, batch, leftovers, nullptr,
+                              &recover);
+            CHECK(batch.size() == 99);
+            CHECK(recover.errors == 2);
+            recover.reset();
+            CHECK(recover.errors == 0);
+            CHECK(recover.skipped_words == 0);
+        }
+        SUBCASE("Wrong slot") {
+            recovery recover(3);
+            buffer leftovers;
+            records recs;
+            decode_data_block(data.data(), data.size(), 34688, 250, recs, leftovers, nullptr,
+                              &recover);
+            CHECK(recs.empty());
+            CHECK(recover.errors == 1);
+            CHECK(recover.resyncs == 0);
+            CHECK(recover.skipped_words == data.size() - 3);
+            CHECK(leftovers.size() == 3);
+            CHECK(recover.resyncing);
+        }
+    }
+    TEST_CASE("file reader") {
+        auto full =
+            generate_data(2151882794, 3735933136, 1275924461, 2149450208, true, true, true, true);
+        auto header = generate_data(2148024362, 3735933136, 1275924461, 2147484128, false, false,
+                                    false, false);
+        buffer data;
+        for (size_t e = 0; e < 20000; ++e) {
+            auto& evt = (e % 3) == 0 ? header : full;
+            data.insert(data.end(), evt.begin(), evt.end());
+        }
+        data.insert(data.end(), full.begin(), full.begin() + 6);
+
+        records recs;
+        buffer leftover;
+        decode_data_block(data, 34688, 250, recs, leftover);
+
+        const std::string name = "test_list_mode_file_reader.bin";
+        {
+            std::ofstream out(name, std::ios::binary);
+            out.write(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(uint32_t));
+        }
+
+        auto check_reader = [&](bool use_mmap) {
+            file_reader reader(name, 34688, 250, file_reader::min_window_words, use_mmap);
+            CHECK(reader.mapped() == use_mmap);
+            CHECK(reader.size() == data.size());
+
+            size_t count = 0;
+            size_t batches = 0;
+            size_t mismatches = 0;
+            for (const auto& batch : reader) {
+                for (size_t e = 0; e < batch.size(); ++e, ++count) {
+                    if (count >= recs.size() || batch.time[e] != recs[count].time.count() ||
+                        batch.trace_length[e] != recs[count].trace.size()) {
+                        ++mismatches;
+                    }
+                }
+                ++batches;
+            }
+            CHECK(batches > 1);
+            CHECK(mismatches == 0);
+            CHECK(count == recs.size());
+            CHECK(reader.leftovers() == leftover.size());
+            CHECK(reader.position() + reader.leftovers() == data.size());
+
+            reader.rewind();
+            records file_recs;
+            count = 0;
+            mismatches = 0;
+            while (reader.next(file_recs)) {
+                for (const auto& rec : file_recs) {
+                    if (count >= recs.size() || rec != recs[count]) {
+                        ++mismatches;
+                    }
+                    ++count;
+                }
+            }
+            CHECK(mismatches == 0);
+            CHECK(count == recs.size());
+
+            reader.rewind();
+            std::vector<size_t> counts(2, 0);
+            while (reader.next(2, [&counts](size_t worker, event_batch& batch) {
+                counts[worker] += batch.size();
+            })) {
+            }
+            CHECK(counts[0] + counts[1] == recs.size());
+
+            reader.rewind();
+            reader.set_fields(scan_times);
+            CHECK(reader.fields() == scan_times);
+            count = 0;
+            size_t samples = 0;
+            for (const auto& batch : reader) {
+                count += batch.size();
+                samples += batch.traces.size();
+            }
+            CHECK(count == recs.size());
+            CHECK(samples == 0);
+        };
+
+        SUBCASE("Memory mapped") {
+            check_reader(true);
+        }
+        SUBCASE("Streamed") {
+            check_reader(false);
+        }
+        SUBCASE("Missing file") {
+            CHECK_THROWS_AS(file_reader("missing_list_mode_file.bin", 34688, 250),
+                            xia::pixie::error::error);
+        }
+
+        std::remove(name.c_str());
+    }
+    TEST_CASE("time index") {
+        auto full =
+            generate_data(2151882794, 3735933136, 1275924461, 2149450208, true, true, true, true);
+        auto header = generate_data(2148024362, 3735933136, 1275924461, 2147484128, false, false,
+                                    false, false);
+        /*
+         * The times increase with a few events out of order.
+         */
+        buffer data;
+        for (uint32_t e = 0; e < 20000; ++e) {
+            auto evt = (e % 3) == 0 ? header : full;
+            evt[1] = (e % 11) == 0 && e > 50 ? (e - 50) * 100 : e * 100;
+            data.insert(data.end(), evt.begin(), evt.end());
+        }
+
+        const std::string name = "test_list_mode_time_index.bin";
+        {
+            std::ofstream out(name, std::ios::binary);
+            out.write(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(uint32_t));
+        }
+
+        event_batch all;
+        buffer leftover;
+        decode_data_block(data.data(), data.size(), 34688, 250, all, leftover);
+        REQUIRE(all.size() == 20000);
+
+        auto check_range = [&](file_reader& reader, const time_index& index, double start,
+                               double end) {
+            size_t expected = 0;
+            for (size_t e = 0; e < all.size(); ++e) {
+                if (all.filter_time[e] >= start && all.filter_time[e] <= end) {
+                    ++expected;
+                }
+            }
+            reader.seek(index, start, end);
+            size_t found = 0;
+            size_t read = 0;
+            for (const auto& batch : reader) {
+                for (size_t e = 0; e < batch.size(); ++e, ++read) {
+                    if (batch.filter_time[e] >= start && batch.filter_time[e] <= end) {
+                        ++found;
+                    }
+                }
+            }
+            CHECK(found == expected);
+            CHECK(read < all.size());
+        };
+
+        auto check_index = [&](bool use_mmap) {
+            file_reader reader(name, 34688, 250, file_reader::min_window_words, use_mmap);
+            time_index index;
+            reader.build_index(index, 1000);
+            CHECK(index.checkpoints().size() == 20);
+            CHECK(index.checkpoints()[0].offset == 0);
+            CHECK(index.checkpoints()[0].events == 1000);
+            CHECK(index.checkpoints()[0].slot == all.slot[0]);
+            CHECK(index.checkpoints()[1].first_time == all.filter_time[1000]);
+            CHECK(index.checkpoints()[1].min_time < all.filter_time[1000]);
+            CHECK(reader.position() == 0);
+
+            const double base = all.filter_time[0];
+            const double tick = all.filter_time[1] - base;
+            check_range(reader, index, base + tick * 5000, base + tick * 7500);
+            check_range(reader, index, base + tick * 19990, base + tick * 30000);
+            check_range(reader, index, 0, base + tick * 10);
+
+            reader.seek(index, base + tick * 100000);
+            CHECK(reader.begin() == reader.end());
+
+            reader.rewind();
+            size_t count = 0;
+            for (const auto& batch : reader) {
+                count += batch.size();
+            }
+            CHECK(count == all.size());
+
+            reader.seek(index.checkpoints()[3].offset, index.checkpoints()[4].offset);
+            count = 0;
+            for (const auto& batch : reader) {
+                count += batch.size();
+            }
+            CHECK(count == 1000);
+            CHECK_THROWS_AS(reader.seek(10, 5), xia::pixie::error::error);
+        };
+
+        SUBCASE("Memory mapped") {
+            check_index(true);
+        }
+        SUBCASE("Streamed") {
+            check_index(false);
+        }
+        SUBCASE("Sidecar") {
+            const auto sidecar = time_index::sidecar(name);
+            file_reader reader(name, 34688, 250);
+            time_index index;
+            reader.build_index(index);
+            CHECK(index.checkpoints().size() == 2);
+            index.save(sidecar);
+
+            time_index loaded;
+            CHECK(loaded.load(sidecar, reader));
+            CHECK(loaded.stride == time_index::default_stride);
+            REQUIRE(loaded.checkpoints().size() == index.checkpoints().size());
+            CHECK(loaded.checkpoints()[1].offset == index.checkpoints()[1].offset);
+            CHECK(loaded.checkpoints()[1].max_time == index.checkpoints()[1].max_time);
+            CHECK(loaded.start(all.filter_time[15000]) == index.start(all.filter_time[15000]));
+
+            file_reader other_rev(name, 46540, 250);
+            CHECK_FALSE(loaded.load(sidecar, other_rev));
+            CHECK_FALSE(loaded.load("missing_list_mode_file.bin.lmi", reader));
+            CHECK_THROWS_AS(reader.seek(time_index(), 0), xia::pixie::error::error);
+            std::remove(sidecar.c_str());
+        }
+
+        std::remove(name.c_str());
+    }
+
+    TEST_CASE("merger") {
+        auto make_rec = [](size_t slot, double time) {
+            record rec;
+            rec.slot_id = slot;
+            rec.set_time(record::time_type(time));
+            return rec;
+        };
+        merger merge(3, merger::time_type(1.5), merger::time_type(2));
+        records group;
+
+        SUBCASE("Time ordered groups") {
+            records s0 = {make_rec(2, 1), make_rec(2, 10), make_rec(2, 20)};
+            records s1 = {make_rec(3, 1.5), make_rec(3, 12)};
+            records s2 = {make_rec(4, 2), make_rec(4, 11), make_rec(4, 30)};
+            merge.push(0, s0);
+            CHECK(s0.empty());
+            merge.push(1, s1);
+            CHECK_FALSE(merge.next(group));
+            merge.push(2, s2);
+            REQUIRE(merge.next(group));
+            REQUIRE(group.size() == 3);
+            CHECK(group[0].slot_id == 2);
+            CHECK(group[1].slot_id == 3);
+            CHECK(group[2].slot_id == 4);
+            /*
+             * Stream 1 can still have events within the lookahead of 12.
+             */
+            CHECK_FALSE(merge.next(group));
+            merge.finish();
+            REQUIRE(merge.next(group));
+            CHECK(group.size() == 2);
+            CHECK(group[0].time.count() == 10);
+            CHECK(group[1].time.count() == 11);
+            size_t groups = 0;
+            double last = 0;
+            while (merge.next(group)) {
+                for (auto& rec : group) {
+                    CHECK(rec.time.count() >= last);
+                    last = rec.time.count();
+                }
+                ++groups;
+            }
+            CHECK(groups == 3);
+            CHECK(merge.pending() == 0);
+        }
+        SUBCASE("Lookahead") {
+            records s0 = {make_rec(2, 5), make_rec(2, 3)};
+            merge.push(0, s0);
+            records s0b = {make_rec(2, 4), make_rec(2, 9)};
+            merge.push(0, s0b);
+            merge.advance(1, merger::time_type(100));
+            merge.finish(2);
+            std::vector<double> times;
+            while (merge.next(group)) {
+                for (auto& rec : group) {
+                    times.push_back(rec.time.count());
+                }
+            }
+            CHECK(times == std::vector<double>({3, 4, 5}));
+            merge.finish(0);
+            REQUIRE(merge.next(group));
+            CHECK(group[0].time.count() == 9);
+        }
+        SUBCASE("Errors") {
+            records s;
+            CHECK_THROWS_AS(merge.push(3, s), xia::pixie::error::error);
+            merge.finish(0);
+            s.push_back(make_rec(2, 1));
+            CHECK_THROWS_AS(merge.push(0, s), xia::pixie::error::error);
+        }
+    }
+    TEST_CASE("reorder") {
+        auto make_rec = [](size_t chan, double time) {
+            record rec;
+            rec.channel_number = chan;
+            rec.set_time(record::time_type(time));
+            return rec;
+        };
+        auto times = [](const records& recs) {
+            std::vector<double> values;
+            for (auto& rec : recs) {
+                values.push_back(rec.time.count());
+            }
+            return values;
+        };
+        records out;
+
+        SUBCASE("Window") {
+            reorder ro(reorder::time_type(2));
+            records in = {make_rec(0, 1), make_rec(1, 3), make_rec(0, 2), make_rec(1, 4)};
+            ro.push(in);
+            CHECK(in.empty());
+            CHECK(ro.held() == 4);
+            CHECK(ro.pop(out) == 1);
+            CHECK(times(out) == std::vector<double>({1}));
+            in = {make_rec(0, 5), make_rec(1, 3.5), make_rec(0, 7)};
+            ro.push(in);
+            CHECK(ro.pop(out) == 4);
+            CHECK(times(out) == std::vector<double>({1, 2, 3, 3.5, 4}));
+            CHECK(ro.flush(out) == 2);
+            CHECK(times(out) == std::vector<double>({1, 2, 3, 3.5, 4, 5, 7}));
+            CHECK(ro.held() == 0);
+            CHECK(ro.late() == 0);
+        }
+        SUBCASE("Equal times keep the push order") {
+            reorder ro(reorder::time_type(1));
+            records in = {make_rec(3, 1), make_rec(1, 1), make_rec(2, 1), make_rec(0, 5)};
+            ro.push(in);
+            CHECK(ro.pop(out) == 3);
+            CHECK(out[0].channel_number == 3);
+            CHECK(out[1].channel_number == 1);
+            CHECK(out[2].channel_number == 2);
+        }
+        SUBCASE("Late events") {
+            reorder ro(reorder::time_type(1));
+            records in = {make_rec(0, 1), make_rec(0, 5)};
+            ro.push(in);
+            CHECK(ro.pop(out) == 1);
+            in = {make_rec(1, 0.5)};
+            ro.push(in);
+            CHECK(ro.late() == 1);
+            CHECK(ro.dropped() == 0);
+            CHECK(ro.pop(out) == 1);
+            CHECK(times(out) == std::vector<double>({1, 0.5}));
+
+            reorder dropping(reorder::time_type(1), 0, true);
+            in = {make_rec(0, 1), make_rec(0, 5)};
+            dropping.push(in);
+            out.clear();
+            dropping.pop(out);
+            in = {make_rec(1, 0.5)};
+            dropping.push(in);
+            CHECK(dropping.late() == 1);
+            CHECK(dropping.dropped() == 1);
+            CHECK(dropping.held() == 1);
+        }
+        SUBCASE("Maximum held") {
+            reorder ro(reorder::time_type(100), 2);
+            records in = {make_rec(0, 3), make_rec(0, 1), make_rec(0, 2), make_rec(0, 4)};
+            ro.push(in);
+            CHECK(ro.pop(out) == 2);
+            CHECK(times(out) == std::vector<double>({1, 2}));
+            CHECK(ro.held() == 2);
+        }
+        SUBCASE("Sorted stream into a merger") {
+            std::mt19937 random(1234);
+            std::uniform_real_distribution<double> jitter(0, 1);
+            records in;
+            for (size_t e = 0; e < 1000; ++e) {
+                in.push_back(make_rec(e % 16, double(e) + jitter(random) * 4));
+            }
+            reorder ro(reorder::time_type(5));
+            records sorted;
+            for (size_t b = 0; b < in.size(); b += 100) {
+                records block(in.begin() + b, in.begin() + b + 100);
+                ro.push(block);
+                ro.pop(sorted);
+            }
+            ro.flush(sorted);
+            CHECK(ro.late() == 0);
+            REQUIRE(sorted.size() == in.size());
+            CHECK(std::is_sorted(sorted.begin(), sorted.end(),
+                                 [](const record& lhs, const record& rhs) {
+                                     return lhs.fixed_time < rhs.fixed_time;
+                                 }));
+        }
+        SUBCASE("Errors") {
+            CHECK_THROWS_AS(reorder(reorder::time_type(-1)), xia::pixie::error::error);
+        }
+    }
+    TEST_CASE("record arena") {
+        auto full =
+            generate_data(2151882794, 3735933136, 1275924461, 2149450208, true, true, true, true);
+        auto header = generate_data(2148024362, 3735933136, 1275924461, 2147484128, false, false,
+                                    false, false);
+        buffer data = full;
+        data.insert(data.end(), header.begin(), header.end());
+        buffer swapped = header;
+        swapped.insert(swapped.end(), full.begin(), full.end());
+        records recs;
+        records swapped_recs;
+        buffer leftover;
+        decode_data_block(data, 34688, 250, recs, leftover);
+        decode_data_block(swapped, 34688, 250, swapped_recs, leftover);
+
+        record_arena arena;
+        decode_data_block(data.data(), data.size(), 34688, 250, arena, leftover);
+        REQUIRE(arena.size() == 2);
+        CHECK(arena[0] == recs[0]);
+        CHECK(arena[0].trace == recs[0].trace);
+        const auto* trace = arena[0].trace.data();
+
+        SUBCASE("Reuse keeps capacity") {
+            decode_data_block(data.data(), data.size(), 34688, 250, arena, leftover);
+            CHECK(arena.size() == 2);
+            CHECK(arena.capacity() == 2);
+            CHECK(arena[0].trace.data() == trace);
+            CHECK(arena[0].qdc == recs[0].qdc);
+        }
+        SUBCASE("Reuse resets values") {
+            decode_data_block(swapped.data(), swapped.size(), 34688, 250, arena, leftover);
+            REQUIRE(arena.size() == 2);
+            size_t index = 0;
+            for (const auto& rec : arena) {
+                CHECK(rec == swapped_recs[index]);
+                CHECK(rec.trace == swapped_recs[index].trace);
+                CHECK(rec.energy_sums == swapped_recs[index].energy_sums);
+                CHECK(rec.qdc == swapped_recs[index].qdc);
+                CHECK(rec.external_time == swapped_recs[index].external_time);
+                CHECK(rec.filter_baseline == swapped_recs[index].filter_baseline);
+                ++index;
+            }
+        }
+    }
+    TEST_CASE("histogrammer") {
+        using axis = histogrammer::axis;
+        using channel_id = histogrammer::channel_id;
+        auto add_event = [](event_batch& batch, uint16_t slot, uint16_t channel, double time,
+                            double energy) {
+            batch.time.push_back(time);
+            batch.energy.push_back(energy);
+            batch.crate.push_back(0);
+            batch.slot.push_back(slot);
+            batch.channel.push_back(channel);
+            batch.qdc_offset.push_back(event_batch::no_data);
+        };
+        histogrammer hists(4);
+
+        SUBCASE("Definitions") {
+            CHECK_THROWS_AS(histogrammer(0), xia::pixie::error::error);
+            CHECK_THROWS_AS(axis(1, 1, 10), xia::pixie::error::error);
+            CHECK_THROWS_AS(axis(0, 1, 0), xia::pixie::error::error);
+            hists.add_energy("e", channel_id(0, 2, 0), axis(0, 100, 10));
+            CHECK_THROWS_AS(hists.add_energy("e", channel_id(0, 2, 1), axis(0, 100, 10)),
+                            xia::pixie::error::error);
+            CHECK_THROWS_AS(hists.add_energy_psd("psd", channel_id(0, 2, 1), axis(0, 100, 10),
+                                                 axis(0, 1, 10), 8, 0),
+                            xia::pixie::error::error);
+            CHECK(hists.find("e") == 0);
+            CHECK_THROWS_AS(hists.find("f"), xia::pixie::error::error);
+            event_batch batch;
+            hists.fill(0, batch);
+            CHECK_THROWS_AS(hists.fill(4, batch), xia::pixie::error::error);
+            CHECK_THROWS_AS(hists.add_energy("f", channel_id(0, 2, 1), axis(0, 100, 10)),
+                            xia::pixie::error::error);
+        }
+        SUBCASE("Energy and time differences") {
+            const auto e2 = hists.add_energy("e 2.0", channel_id(0, 2, 0), axis(0, 100, 10));
+            const auto all = hists.add_energy("e all", channel_id(), axis(0, 100, 10));
+            const auto dt =
+                hists.add_time_difference("dt", channel_id(0, 2, 0), channel_id(0, 2, 1),
+                                          axis(-10, 10, 20));
+            event_batch batch;
+            add_event(batch, 2, 0, 100, 5);
+            add_event(batch, 2, 1, 102.5, 15);
+            add_event(batch, 2, 1, 104.5, 150);
+            add_event(batch, 2, 0, 105, 95);
+            add_event(batch, 3, 0, 106, 55);
+            hists.fill(0, batch);
+            hists.fill(1, batch);
+            histogrammer::snapshot snap;
+            hists.get(e2, snap);
+            CHECK_FALSE(snap.two_d());
+            CHECK(snap.entries() == 4);
+            CHECK(snap.at(0) == 2);
+            CHECK(snap.at(9) == 2);
+            hists.get(all, snap);
+            CHECK(snap.entries() == 10);
+            CHECK(snap.outside == 2);
+            CHECK(snap.at(5) == 2);
+            hists.get(dt, snap);
+            /*
+             * Each shard has stops 2.5 and 4.5 after the start and a start
+             * 0.5 after the stop. A shard only pairs its own events.
+             */
+            CHECK(snap.entries() == 6);
+            CHECK(snap.at(12) == 2);
+            CHECK(snap.at(14) == 2);
+            CHECK(snap.at(9) == 2);
+            hists.clear();
+            hists.get(dt, snap);
+            CHECK(snap.entries() == 0);
+        }
+        SUBCASE("Energy against PSD") {
+            const auto psd = hists.add_energy_psd("psd", channel_id(0, 2, 0), axis(0, 100, 10),
+                                                  axis(0, 1, 4), 1, 0);
+            const auto user = hists.add(
+                "user", axis(0, 100, 10), axis(0, 20, 2),
+                [](const event_batch& batch, size_t event, double& x, double& y) {
+                    x = batch.energy[event];
+                    y = batch.channel[event];
+                    return batch.slot[event] == 2;
+                });
+            event_batch batch;
+            add_event(batch, 2, 0, 1, 25);
+            batch.qdc_offset.back() = batch.qdc.size();
+            batch.qdc.insert(batch.qdc.end(), {1000, 300, 0, 0, 0, 0, 0, 0});
+            add_event(batch, 2, 0, 2, 25);
+            add_event(batch, 2, 0, 3, 75);
+            batch.qdc_offset.back() = batch.qdc.size();
+            batch.qdc.insert(batch.qdc.end(), {1000, 900, 0, 0, 0, 0, 0, 0});
+            add_event(batch, 3, 0, 4, 75);
+            hists.fill(2, batch);
+            histogrammer::snapshot snap;
+            hists.get(psd, snap);
+            CHECK(snap.two_d());
+            CHECK(snap.entries() == 2);
+            CHECK(snap.at(2, 1) == 1);
+            CHECK(snap.at(7, 3) == 1);
+            hists.get(user, snap);
+            CHECK(snap.entries() == 3);
+            CHECK(snap.at(2, 0) == 2);
+        }
+        SUBCASE("Decode") {
+            auto full = generate_data(2151882794, 3735933136, 1275924461, 2149450208, true, true,
+                                      true, true);
+            buffer data;
+            for (size_t e = 0; e < 100; ++e) {
+                data.insert(data.end(), full.begin(), full.end());
+            }
+            hists.add_energy("e", channel_id(), axis(0, 65536, 64));
+            buffer leftovers;
+            hists.decode(3, data.data(), data.size(), 34688, 250, leftovers);
+            buffer parallel_leftovers;
+            decode_data_block_parallel(data.data(), data.size(), 34688, 250, hists.shards(),
+                                       hists.handler(), parallel_leftovers);
+            histogrammer::snapshots snaps;
+            hists.get(snaps);
+            REQUIRE(snaps.size() == 1);
+            CHECK(snaps[0].entries() == 200);
+        }
+        SUBCASE("Snapshots while filling") {
+            const auto e = hists.add_energy("e", channel_id(), axis(0, 100, 100));
+            event_batch batch;
+            for (size_t event = 0; event < 1000; ++event) {
+                add_event(batch, 2, event % 16, double(event), double(event % 100));
+            }
+            const size_t fills = 200;
+            std::vector<std::thread> threads;
+            for (size_t shard = 0; shard < hists.shards(); ++shard) {
+                threads.emplace_back([&hists, &batch, shard] {
+                    for (size_t f = 0; f < fills; ++f) {
+                        hists.fill(shard, batch);
+                    }
+                });
+            }
+            histogrammer::snapshot snap;
+            uint64_t last = 0;
+            for (size_t s = 0; s < 20; ++s) {
+                hists.get(e, snap);
+                CHECK(snap.entries() >= last);
+                last = snap.entries();
+            }
+            for (auto& thread : threads) {
+                thread.join();
+            }
+            hists.get(e, snap);
+            CHECK(snap.entries() == hists.shards() * fills * 1000);
+            CHECK(snap.at(42) == hists.shards() * fills * 10);
+        }
+    }
+    TEST_CASE("trace processing") {
+        namespace trace = xia::pixie::data::trace;
+        /*
+         * A baseline of 100 with a pulse rising 100 a sample from sample 50
+         * to 1000 at sample 60 and falling back at sample 80.
+         */
+        std::vector<event_batch::trace_value> pulse(128, 100);
+        for (size_t s = 50; s < 80; ++s) {
+            pulse[s] = event_batch::trace_value(100 + std::min<size_t>(s - 50, 10) * 100);
+        }
+        trace::samples subtracted(pulse.size());
+        trace::samples work(pulse.size());
+
+        SUBCASE("Kernels") {
+            CHECK(trace::mean(pulse.data(), pulse.size(), 0, 32) == 100);
+            CHECK(trace::mean(pulse.data(), pulse.size(), 120, 32) == 100);
+            CHECK(std::isnan(trace::mean(pulse.data(), pulse.size(), 128, 32)));
+            trace::subtract(pulse.data(), pulse.size(), 100, subtracted.data());
+            CHECK(subtracted[0] == 0);
+            CHECK(subtracted[55] == 500);
+            trace::moving_average(subtracted.data(), subtracted.size(), 4, work.data());
+            CHECK(work[52] == 75);
+            CHECK(work[70] == 1000);
+            CHECK(trace::cfd(subtracted.data(), subtracted.size(), 4, 0.5f, 20, work.data()) ==
+                  doctest::Approx(58));
+            CHECK(trace::cfd(subtracted.data(), subtracted.size(), 4, 0.4f, 20, work.data()) ==
+                  doctest::Approx(56.6667).epsilon(1e-4));
+            CHECK(std::isnan(trace::cfd(subtracted.data(), 40, 4, 0.5f, 20, work.data())));
+            CHECK(trace::integral(subtracted.data(), subtracted.size(), 50, 80) == 24500);
+            CHECK(trace::integral(subtracted.data(), subtracted.size(), 100, 200) == 0);
+            CHECK(trace::tail_total(subtracted.data(), subtracted.size(), 50, 60, 80) ==
+                  doctest::Approx(20000.0 / 24500));
+            CHECK(std::isnan(trace::tail_total(subtracted.data(), subtracted.size(), 0, 0, 40)));
+        }
+        SUBCASE("Batch") {
+            event_batch batch;
+            for (size_t event = 0; event < 3; ++event) {
+                batch.time.push_back(double(event));
+                batch.trace_offset.push_back(batch.traces.size());
+                if (event == 1) {
+                    batch.trace_length.push_back(0);
+                } else {
+                    batch.trace_length.push_back(uint32_t(pulse.size()));
+                    batch.traces.insert(batch.traces.end(), pulse.begin(), pulse.end());
+                }
+            }
+            trace::config cfg;
+            cfg.cfd_fraction = 0.4;
+            cfg.total_start = -6;
+            cfg.tail_start = 4;
+            cfg.end = 24;
+            trace::results results;
+            trace::process(batch, cfg, results);
+            REQUIRE(results.size() == 3);
+            CHECK(results.traces.size() == batch.traces.size());
+            CHECK(results.traces[pulse.size() + 55] == 500);
+            CHECK(results.baseline[0] == 100);
+            CHECK(std::isnan(results.baseline[1]));
+            CHECK(std::isnan(results.psd[1]));
+            CHECK(results.cfd[2] == doctest::Approx(56.6667).epsilon(1e-4));
+            CHECK(results.total[2] == 24500);
+            CHECK(results.psd[2] == doctest::Approx(20000.0 / 24500));
+            cfg.smoothing = 3;
+            trace::process(batch, cfg, results);
+            CHECK(results.cfd[0] == doctest::Approx(56.6667).epsilon(0.02));
+            cfg.cfd_fraction = 0;
+            CHECK_THROWS_AS(trace::process(batch, cfg, results), xia::pixie::error::error);
+        }
+        SUBCASE("Offload") {
+            event_batch batch;
+            for (size_t event = 0; event < 3; ++event) {
+                batch.time.push_back(double(event));
+                batch.trace_offset.push_back(batch.traces.size());
+                if (event == 1) {
+                    batch.trace_length.push_back(0);
+                } else {
+                    batch.trace_length.push_back(uint32_t(pulse.size()));
+                    batch.traces.insert(batch.traces.end(), pulse.begin(), pulse.end());
+                }
+            }
+            event_batch single;
+            single.time.push_back(0);
+            single.trace_offset.push_back(0);
+            single.trace_length.push_back(uint32_t(pulse.size()));
+            single.traces = pulse;
+            trace::config cfg;
+            cfg.smoothing = 3;
+            trace::results expected;
+            trace::process(batch, cfg, expected);
+            CHECK(trace::available(trace::backend::host));
+            trace::offload offload(cfg);
+            CHECK(offload.device() == "host");
+            trace::results results;
+            CHECK_FALSE(offload.collect(results));
+            CHECK(offload.submit(batch));
+            CHECK(offload.submit(single));
+            CHECK_FALSE(offload.submit(batch));
+            CHECK(offload.in_flight() == 2);
+            REQUIRE(offload.collect(results));
+            REQUIRE(results.size() == 3);
+            CHECK(results.traces == expected.traces);
+            CHECK(results.baseline[0] == expected.baseline[0]);
+            CHECK(std::isnan(results.cfd[1]));
+            CHECK(results.cfd[2] == expected.cfd[2]);
+            CHECK(results.total[2] == expected.total[2]);
+            CHECK(results.psd[2] == expected.psd[2]);
+            CHECK(offload.submit(batch));
+            REQUIRE(offload.collect(results));
+            CHECK(results.size() == 1);
+            CHECK(results.cfd[0] == expected.cfd[0]);
+            REQUIRE(offload.collect(results));
+            CHECK(results.size() == 3);
+            CHECK_FALSE(offload.collect(results));
+            CHECK(offload.in_flight() == 0);
+            CHECK_THROWS_AS(trace::offload(cfg, trace::backend::host, 0),
+                            xia::pixie::error::error);
+            cfg.cfd_fraction = 0;
+            CHECK_THROWS_AS(trace::offload bad(cfg), xia::pixie::error::error);
+#if !defined(PIXIE_OPENCL)
+            cfg.cfd_fraction = 0.5;
+            CHECK_FALSE(trace::available(trace::backend::opencl));
+            CHECK_THROWS_AS(trace::offload(cfg, trace::backend::opencl),
+                            xia::pixie::error::error);
+#endif
+        }
+    }
+    TEST_CASE("tau fitting") {
+        namespace tau = xia::pixie::data::tau;
+        /*
+         * A trace of pulses decaying with a tau of 5 usecs sampled every
+         * 10 nsecs on a noisy baseline.
+         */
+        const double tau_usecs = 5;
+        const double sample_usecs = 0.01;
+        auto make_trace = [&](unsigned seed, const std::vector<size_t>& starts) {
+            std::mt19937 random(seed);
+            std::normal_distribution<double> noise(0, 4);
+            tau::trace trace(8192);
+            for (size_t s = 0; s < trace.size(); ++s) {
+                double value = 1000 + noise(random);
+                for (auto start : starts) {
+                    if (s >= start) {
+                        value += 6000 * std::exp(-double(s - start) * sample_usecs / tau_usecs);
+                    }
+                }
+                trace[s] = tau::value(std::lround(value));
+            }
+            return trace;
+        };
+        tau::config cfg;
+        cfg.sample_usecs = sample_usecs;
+
+        SUBCASE("Kernel") {
+            std::vector<tau::sample> decay(200);
+            for (size_t s = 0; s < decay.size(); ++s) {
+                decay[s] = tau::sample(1000 * std::exp(-double(s) / 50));
+            }
+            std::vector<tau::sample> work(decay.size() * 2);
+            CHECK(tau::log_linear(decay.data(), decay.size(), work.data()) ==
+                  doctest::Approx(50).epsilon(1e-4));
+            std::vector<tau::sample> flat(100, 10);
+            CHECK(std::isnan(tau::log_linear(flat.data(), flat.size(), work.data())));
+            CHECK(std::isnan(tau::log_linear(decay.data(), 1, work.data())));
+        }
+        SUBCASE("Config") {
+            CHECK_NOTHROW(cfg.validate());
+            tau::config bad(cfg);
+            bad.sample_usecs = 0;
+            CHECK_THROWS_AS(tau::fitter{bad}, xia::pixie::error::error);
+            bad = cfg;
+            bad.tail_fraction = 1;
+            CHECK_THROWS_AS(bad.validate(), xia::pixie::error::error);
+            bad = cfg;
+            bad.max_fit_samples = 1;
+            CHECK_THROWS_AS(bad.validate(), xia::pixie::error::error);
+        }
+        SUBCASE("ADC traces") {
+            tau::fitter fit(cfg);
+            fit.add(make_trace(1, {500, 3500, 6500}));
+            fit.add(make_trace(2, {1000, 4000}));
+            auto est = fit.result();
+            CHECK(est.valid());
+            CHECK(est.pulses == 5);
+            CHECK(est.tau_usecs == doctest::Approx(tau_usecs).epsilon(0.02));
+            CHECK(est.spread_usecs < 0.1);
+            /*
+             * A pulse on the tail of another is cut short and the next
+             * pulse's baseline is not flat.
+             */
+            fit.clear();
+            fit.add(make_trace(3, {500, 900, 4000}));
+            est = fit.result();
+            CHECK(est.pulses == 2);
+            CHECK(est.rejected == 1);
+            CHECK(est.tau_usecs == doctest::Approx(tau_usecs).epsilon(0.02));
+            fit.clear();
+            fit.add(make_trace(4, {}));
+            est = fit.result();
+            CHECK_FALSE(est.valid());
+            CHECK(est.pulses == 0);
+            CHECK(std::isnan(est.tau_usecs));
+        }
+        SUBCASE("Parallel") {
+            tau::config slow(cfg);
+            slow.sample_usecs = sample_usecs * 2;
+            tau::fitters fits = {tau::fitter(cfg), tau::fitter(slow), tau::fitter(cfg)};
+            tau::traces traces = {make_trace(5, {500, 4000}), make_trace(6, {500, 4000}),
+                                  make_trace(7, {})};
+            tau::add(fits, traces, 3);
+            tau::estimates ests;
+            tau::results(fits, ests);
+            REQUIRE(ests.size() == 3);
+            CHECK(ests[0].tau_usecs == doctest::Approx(tau_usecs).epsilon(0.02));
+            CHECK(ests[1].tau_usecs == doctest::Approx(tau_usecs * 2).epsilon(0.02));
+            CHECK_FALSE(ests[2].valid());
+            traces.pop_back();
+            CHECK_THROWS_AS(tau::add(fits, traces), xia::pixie::error::error);
+        }
+        SUBCASE("List-mode traces") {
+            event_batch batch(xia::pixie::data::list_mode::scan_ids |
+                              xia::pixie::data::list_mode::scan_traces);
+            for (size_t event = 0; event < 6; ++event) {
+                auto trace = make_trace(unsigned(10 + event), {100});
+                trace.resize(1000);
+                batch.channel.push_back(event_batch::id_type(event % 3));
+                batch.event_length.push_back(4 + 500);
+                batch.trace_offset.push_back(batch.traces.size());
+                batch.trace_length.push_back(uint32_t(trace.size()));
+                batch.traces.insert(batch.traces.end(), trace.begin(), trace.end());
+            }
+            tau::fitters fits(2, tau::fitter(cfg));
+            tau::add(fits, batch);
+            tau::estimates ests;
+            tau::results(fits, ests);
+            REQUIRE(ests.size() == 2);
+            for (auto& est : ests) {
+                CHECK(est.pulses == 2);
+                CHECK(est.tau_usecs == doctest::Approx(tau_usecs).epsilon(0.05));
+            }
+            event_batch no_traces(xia::pixie::data::list_mode::scan_header);
+            CHECK_THROWS_AS(tau::add(fits, no_traces), xia::pixie::error::error);
+        }
+    }
+    TEST_CASE("energy recomputation") {
+        namespace energy = xia::pixie::data::energy;
+        energy::filter filt;
+        filt.rise_time_usecs = 0.8;
+        filt.flat_top_usecs = 0.4;
+        filt.tau_usecs = 5;
+        filt.sample_usecs = 0.08;
+        CHECK(filt.rise_samples() == 10);
+        CHECK(filt.flat_top_samples() == 5);
+        /*
+         * The sums of a DC level with a pulse decaying with the filter's
+         * tau from the start of the gap. The baseline is the filter of the
+         * DC level.
+         */
+        const double b1 = std::exp(-filt.sample_usecs / filt.tau_usecs);
+        const size_t rise = filt.rise_samples();
+        const size_t gap = filt.flat_top_samples();
+        const double dc = 100;
+        const double amplitude = 20000;
+        double sums[3] = {};
+        for (size_t s = 0; s < 2 * rise + gap; ++s) {
+            const double value = dc + (s >= rise ? amplitude * std::pow(b1, double(s - rise)) : 0);
+            sums[s < rise ? 0 : s < rise + gap ? 1 : 2] += value;
+        }
+        const uint32_t words[3] = {uint32_t(std::lround(sums[0])), uint32_t(std::lround(sums[1])),
+                                   uint32_t(std::lround(sums[2]))};
+        const double baseline = dc * (1 - b1) * double(rise + gap);
+
+        SUBCASE("Kernels") {
+            energy::coefficients coeffs(filt);
+            CHECK(coeffs.gap == doctest::Approx(1 - b1));
+            CHECK(energy::compute(coeffs, words, baseline) ==
+                  doctest::Approx(amplitude).epsilon(1e-4));
+            std::vector<uint32_t> column;
+            std::vector<double> baselines(4, baseline);
+            for (size_t e = 0; e < 4; ++e) {
+                column.insert(column.end(), words, words + 3);
+            }
+            std::vector<double> energies(4);
+            energy::compute(coeffs, column.data(), baselines.data(), 4, energies.data());
+            for (auto e : energies) {
+                CHECK(e == doctest::Approx(amplitude).epsilon(1e-4));
+            }
+            filt.scale = 4;
+            CHECK(energy::coefficients(filt).trailing == doctest::Approx(coeffs.trailing * 4));
+        }
+        SUBCASE("Batch") {
+            event_batch batch(xia::pixie::data::list_mode::scan_ids |
+                              xia::pixie::data::list_mode::scan_energy_sums);
+            for (size_t event = 0; event < 4; ++event) {
+                const size_t channel = event == 3 ? 5 : std::min<size_t>(event, 1);
+                batch.channel.push_back(event_batch::id_type(channel));
+                batch.event_length.push_back(8);
+                if (event == 1) {
+                    batch.energy_sums_offset.push_back(event_batch::no_data);
+                    batch.filter_baseline.push_back(0);
+                } else {
+                    batch.energy_sums_offset.push_back(batch.energy_sums.size());
+                    batch.energy_sums.insert(batch.energy_sums.end(), words, words + 3);
+                    batch.filter_baseline.push_back(baseline);
+                }
+            }
+            energy::filters filters = {filt, filt};
+            energy::results results;
+            energy::recompute(batch, filters, results);
+            REQUIRE(results.size() == 4);
+            CHECK(results.energy[0] == doctest::Approx(amplitude).epsilon(1e-4));
+            CHECK(std::isnan(results.energy[1]));
+            CHECK(results.energy[2] == doctest::Approx(amplitude).epsilon(1e-4));
+            CHECK(std::isnan(results.energy[3]));
+            /*
+             * A different tau under corrects the decay.
+             */
+            filters[0].tau_usecs = 50;
+            energy::recompute(batch, filters, results);
+            CHECK(results.energy[0] < amplitude * 0.99);
+            CHECK(results.energy[2] == doctest::Approx(amplitude).epsilon(1e-4));
+            filters[1].tau_usecs = 0;
+            CHECK_THROWS_AS(energy::recompute(batch, filters, results), xia::pixie::error::error);
+            event_batch no_sums(xia::pixie::data::list_mode::scan_header);
+            CHECK_THROWS_AS(energy::recompute(no_sums, {filt}, results), xia::pixie::error::error);
+        }
+    }
+}
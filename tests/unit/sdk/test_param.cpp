@@ -26,6 +26,7 @@
 #include <doctest/doctest.h>
 
 #include <pixie/error.hpp>
+#include <pixie/fw.hpp>
 #include <pixie/log.hpp>
 #include <pixie/param.hpp>
 
@@ -278,6 +279,153 @@ TEST_SUITE("xia::pixie::param") {
             }
         }
     }
+    TEST_CASE("lookup") {
+        namespace param = xia::pixie::param;
+        SUBCASE("Parameters") {
+            for (auto& par : param::get_module_param_map()) {
+                CHECK(param::is_module_param(par.first));
+                CHECK(param::lookup_module_param(par.first) == par.second);
+            }
+            for (auto& par : param::get_channel_param_map()) {
+                CHECK(param::is_channel_param(par.first));
+                CHECK(param::lookup_channel_param(par.first) == par.second);
+            }
+            CHECK(param::lookup_system_param("NUMBER_MODULES") ==
+                  param::system_param::number_modules);
+        }
+        SUBCASE("Variables") {
+            CHECK(param::lookup_module_var("RunTask") == param::module_var::RunTask);
+            CHECK(param::lookup_channel_var("LiveTimeA") == param::channel_var::LiveTimeA);
+            CHECK(param::lookup_channel_descriptor("LiveTimeA",
+                                                   param::get_channel_var_descriptors())
+                      .name == "LiveTimeA");
+        }
+        SUBCASE("Invalid") {
+            CHECK_FALSE(param::is_module_param("NOT_A_PARAM"));
+            CHECK_FALSE(param::is_channel_var("NotAVar"));
+            CHECK_THROWS_WITH_AS(param::lookup_channel_param("NOT_A_PARAM"),
+                                 "invalid channel param: NOT_A_PARAM", xia::pixie::error::error);
+            CHECK_THROWS_WITH_AS(param::lookup_module_var("NotAVar"),
+                                 "invalid module variable: NotAVar", xia::pixie::error::error);
+        }
+    }
+    TEST_CASE("variable image") {
+        namespace param = xia::pixie::param;
+        const size_t max_channels = 4;
+        param::module_var_descs module_descs = {
+            {param::module_var::ModNum, param::enable, param::rw, 1, "ModNum"},
+            {param::module_var::ModCSRA, param::enable, param::rw, 1, "ModCSRA"},
+            {param::module_var::RealTimeA, param::enable, param::ro, 1, "RealTimeA"}};
+        module_descs[0].address = 0x100;
+        module_descs[1].address = 0x101;
+        module_descs[2].address = 0x110;
+        param::channel_var_descs channel_descs = {
+            {param::channel_var::ChanCSRa, param::enable, param::rw, 1, "ChanCSRa"},
+            {param::channel_var::LiveTimeA, param::enable, param::ro, 1, "LiveTimeA"}};
+        channel_descs[0].address = 0x120;
+        channel_descs[1].address = 0x130;
+        param::address_map map;
+        map.set(max_channels, module_descs, channel_descs);
+        CHECK(map.extent.start == 0x100);
+        CHECK(map.extent.end == 0x130 + max_channels);
+        param::image image;
+        CHECK_FALSE(image.valid());
+        image.create(map);
+        REQUIRE(image.valid());
+        CHECK(image.base() == 0x100);
+        CHECK(image.size() == map.extent.size);
+        CHECK(image.contains(0x133));
+        CHECK_FALSE(image.contains(0x134));
+        CHECK_THROWS_AS(image.get(0x134), xia::pixie::error::error);
+        image.store(0x100, 1);
+        CHECK(image.get(0x100) == 1);
+        CHECK(image.dirty_words() == 0);
+        image.set(0x101, 2);
+        image.set(0x120, 3);
+        image.set(0x121, 4);
+        CHECK(image.dirty(0x101));
+        CHECK_FALSE(image.dirty(0x100));
+        CHECK(image.dirty_words() == 3);
+        param::image::runs runs;
+        image.dirty_runs(runs);
+        REQUIRE(runs.size() == 2);
+        CHECK(runs[0].address == 0x101);
+        CHECK(runs[0].offset == 1);
+        CHECK(runs[0].length == 1);
+        CHECK(runs[1].address == 0x120);
+        CHECK(runs[1].length == 2);
+        image.clean();
+        CHECK(image.dirty_words() == 0);
+        param::image copy = image;
+        CHECK(copy.same(image));
+        copy.store(0x121, 5);
+        copy.store(0x130, 6);
+        param::image::addresses differ;
+        image.diff(copy, differ);
+        REQUIRE(differ.size() == 2);
+        CHECK(differ[0] == 0x121);
+        CHECK(differ[1] == 0x130);
+        CHECK(image.copy(copy) == 2);
+        CHECK(image.same(copy));
+        CHECK(image.dirty(0x121));
+        CHECK(image.dirty(0x130));
+        CHECK(image.dirty_words() == 2);
+        param::image other;
+        other.create(map);
+        other.clear();
+        CHECK_THROWS_AS(image.same(other), xia::pixie::error::error);
+    }
+    TEST_CASE("variable table cache") {
+        namespace param = xia::pixie::param;
+        namespace firmware = xia::pixie::firmware;
+        const size_t max_channels = 16;
+        /*
+         * A var file of the default descriptors. The channel variables of
+         * each mode are contiguous, each is an array of the channels.
+         */
+        std::ostringstream vars;
+        vars << std::hex;
+        uint32_t address = 0x4a000;
+        for (auto& desc : param::get_module_var_descriptors()) {
+            vars << address << ' ' << desc.name << std::endl;
+            address += uint32_t(desc.size);
+        }
+        for (auto mode : {param::rw, param::ro, param::wr}) {
+            for (auto& desc : param::get_channel_var_descriptors()) {
+                if (desc.mode == mode) {
+                    vars << address << ' ' << desc.name << std::endl;
+                    address += uint32_t(max_channels * desc.size);
+                }
+            }
+        }
+        auto text = vars.str();
+        auto fw = std::make_shared<firmware::firmware>("test", 15, 250, 14, "var");
+        fw->data = std::make_shared<firmware::image>(text.begin(), text.end());
+        auto table = param::load_table(fw, max_channels);
+        REQUIRE(table);
+        CHECK(table->module_descs[0].address == 0x4a000);
+        CHECK(table->addresses.extent.start == 0x4a000);
+        CHECK(table->addresses.extent.end == address);
+        CHECK(param::load_table(fw, max_channels) == table);
+        /*
+         * The address map is of the number of channels, the file only
+         * fits 16 channels.
+         */
+        CHECK_THROWS_AS(param::load_table(fw, 32), xia::pixie::error::error);
+        param::shared_module_var_descs first(
+            param::shared_module_var_descs::descs_ptr(table, &table->module_descs));
+        param::shared_module_var_descs second(
+            param::shared_module_var_descs::descs_ptr(table, &table->module_descs));
+        CHECK(first.shares(second));
+        CHECK(first.size() == param::get_module_var_descriptors().size());
+        param::shared_module_var_descs copy(param::get_module_var_descriptors());
+        CHECK_FALSE(copy.shares(first));
+        /*
+         * A reloaded image is parsed again.
+         */
+        fw->data = std::make_shared<firmware::image>(text.begin(), text.end());
+        CHECK(param::load_table(fw, max_channels) != table);
+    }
     TEST_CASE("TEARDOWN") {
         xia::logging::stop("log");
     }
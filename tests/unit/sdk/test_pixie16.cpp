@@ -65,3 +65,24 @@ TEST_SUITE("Pixie16Api: Bit manipulation functions.") {
         CHECK(APP32_TstBit(19, 1 << 19));
     }
 }
+
+TEST_SUITE("Pixie16Api: Crate FIFO functions.") {
+    using namespace xia::pixie::error;
+    TEST_CASE("PixieCheckCrateFIFOStatus") {
+        unsigned int words[2];
+        CHECK(PixieCheckCrateFIFOStatus(nullptr, 2) ==
+              return_code(api_result(code::invalid_value)));
+        CHECK(PixieCheckCrateFIFOStatus(words, 2) ==
+              return_code(api_result(code::crate_not_ready)));
+    }
+    TEST_CASE("PixieReadCrateFIFO") {
+        unsigned int data[16];
+        unsigned int* buffers[1] = {data};
+        unsigned int max_words[1] = {16};
+        unsigned int num_words[1];
+        CHECK(PixieReadCrateFIFO(nullptr, max_words, num_words, 1) ==
+              return_code(api_result(code::invalid_value)));
+        CHECK(PixieReadCrateFIFO(buffers, max_words, num_words, 1) ==
+              return_code(api_result(code::crate_not_ready)));
+    }
+}
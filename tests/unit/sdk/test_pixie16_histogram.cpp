@@ -0,0 +1,122 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2022 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file test_pixie16_histogram.cpp
+ * @brief Provides test coverage for the histogram snapshots.
+ */
+
+#include <chrono>
+#include <thread>
+
+#include <doctest/doctest.h>
+
+#include <pixie/error.hpp>
+
+#include <pixie/pixie16/histogram.hpp>
+
+namespace histogram = xia::pixie::histogram;
+namespace hw = xia::pixie::hw;
+
+TEST_SUITE("xia::pixie::histogram") {
+    TEST_CASE("make_delta") {
+        hw::words previous = {1, 2, 3, 4};
+        hw::words current = {1, 5, 3, 6};
+        histogram::delta change;
+        SUBCASE("Dense") {
+            histogram::make_delta(previous.data(), current.data(), 4, histogram::format::dense,
+                                  change);
+            CHECK(change.reset == false);
+            CHECK(change.counts == 5);
+            CHECK(change.dense == hw::words{0, 3, 0, 2});
+            CHECK(change.sparse.empty());
+        }
+        SUBCASE("Sparse") {
+            histogram::make_delta(previous.data(), current.data(), 4, histogram::format::sparse,
+                                  change);
+            CHECK(change.counts == 5);
+            CHECK(change.dense.empty());
+            CHECK(change.sparse == histogram::bin_counts{{1, 3}, {3, 2}});
+        }
+        SUBCASE("Reset") {
+            current[2] = 1;
+            histogram::make_delta(previous.data(), current.data(), 4, histogram::format::sparse,
+                                  change);
+            CHECK(change.reset == true);
+            CHECK(change.counts == 13);
+            CHECK(change.sparse.size() == 4);
+        }
+    }
+    TEST_CASE("snapshots") {
+        hw::words source = {0, 0, 0, 0, 0, 0};
+        size_t reads = 0;
+        histogram::snapshots snaps({2, 5}, 3, [&source, &reads](hw::words& values) {
+            ++reads;
+            values = source;
+        });
+        size_t dense_updates = 0;
+        size_t sparse_updates = 0;
+        histogram::deltas dense;
+        histogram::deltas sparse;
+        auto dense_id = snaps.subscribe(
+            [&](const histogram::update& changes) {
+                ++dense_updates;
+                dense = changes.changes;
+            },
+            histogram::format::dense);
+        snaps.subscribe([&](const histogram::update& changes) {
+            ++sparse_updates;
+            sparse = changes.changes;
+            CHECK(changes.snapshot->size() == 6);
+            CHECK(changes.sequence == snaps.sequence());
+        });
+        source = {1, 0, 0, 0, 4, 0};
+        CHECK_NOTHROW(snaps.poll());
+        CHECK(reads == 1);
+        CHECK(dense_updates == 1);
+        CHECK(sparse_updates == 1);
+        REQUIRE(dense.size() == 2);
+        CHECK(dense[0].channel == 2);
+        CHECK(dense[1].channel == 5);
+        CHECK(dense[0].dense == hw::words{1, 0, 0});
+        CHECK(sparse[1].sparse == histogram::bin_counts{{1, 4}});
+        source = {1, 0, 2, 0, 4, 0};
+        snaps.unsubscribe(dense_id);
+        CHECK_NOTHROW(snaps.poll());
+        CHECK(reads == 2);
+        CHECK(dense_updates == 1);
+        CHECK(sparse_updates == 2);
+        CHECK(sparse[0].sparse == histogram::bin_counts{{2, 2}});
+        CHECK(sparse[1].sparse.empty());
+        hw::words copy;
+        snaps.snapshot(copy);
+        CHECK(copy == source);
+        source.resize(2);
+        CHECK_THROWS_AS(snaps.poll(), xia::pixie::error::error);
+        CHECK_THROWS_AS(snaps.start(0), xia::pixie::error::error);
+        source.resize(6);
+        CHECK_NOTHROW(snaps.start(1));
+        CHECK(snaps.running());
+        CHECK_THROWS_AS(snaps.start(1), xia::pixie::error::error);
+        for (int wait = 0; wait < 1000 && snaps.sequence() < 4; ++wait) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        snaps.stop();
+        CHECK(snaps.running() == false);
+        CHECK(snaps.sequence() >= 4);
+    }
+}
@@ -20,15 +20,48 @@
  * @brief
  */
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <future>
+#include <limits>
+#include <sstream>
+#include <thread>
+
 #include <doctest/doctest.h>
+#include <nolhmann/json.hpp>
 
+#include <pixie/config.hpp>
 #include <pixie/error.hpp>
+#include <pixie/fw.hpp>
 #include <pixie/log.hpp>
 
+#include <pixie/data/list_mode.hpp>
+#include <pixie/data/merge.hpp>
+
+#include <pixie/pixie16/await.hpp>
+#include <pixie/pixie16/baseline.hpp>
+#include <pixie/pixie16/capture.hpp>
+#include <pixie/pixie16/cluster.hpp>
 #include <pixie/pixie16/defs.hpp>
+#include <pixie/pixie16/ipc.hpp>
+#include <pixie/pixie16/metrics.hpp>
 #include <pixie/pixie16/module.hpp>
+#include <pixie/pixie16/recorder.hpp>
+#include <pixie/pixie16/reglist.hpp>
+#include <pixie/pixie16/scope.hpp>
 #include <pixie/pixie16/sim.hpp>
 
+#if !defined(_WIN64) && !defined(_WIN32)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
 using crate_error = xia::pixie::crate::error;
 
 static const std::vector<std::string> module_def = {
@@ -93,6 +126,63 @@ TEST_SUITE("Crate: modules") {
             CHECK(crate.backplane.sync_waiters.size() == (crate.num_modules + crate.offline.size()));
         }
         using namespace xia::pixie;
+        SUBCASE("Module tasks") {
+            std::atomic<size_t> count(0);
+            CHECK_NOTHROW(crate.run_modules("count", [&count](module::module&) { ++count; }));
+            CHECK(count == test_modules);
+            count = 0;
+            CHECK_NOTHROW(
+                crate.run_modules("count", {0, 2}, [&count](module::module&) { ++count; }));
+            CHECK(count == 2);
+            CHECK_THROWS_WITH_AS(
+                crate.run_modules("count", {0, 5}, [&count](module::module&) { ++count; }),
+                "crate count: module number invalid", crate_error);
+            CHECK(count == 2);
+            CHECK_THROWS_WITH_AS(crate.run_modules("fail",
+                                                   [](module::module& module) {
+                                                       if (module.number == 1) {
+                                                           throw crate_error(
+                                                               crate_error::code::invalid_value,
+                                                               "task failed");
+                                                       }
+                                                   }),
+                                 "crate fail error; see log", crate_error);
+        }
+        SUBCASE("Async module tasks") {
+            std::atomic<size_t> count(0);
+            auto op = crate.run_modules_async("count", {},
+                                              [&count](module::module&) { ++count; });
+            CHECK(op.valid());
+            CHECK(op.wait_for(10000));
+            CHECK(op.ready());
+            CHECK_NOTHROW(op.get());
+            CHECK_FALSE(op.valid());
+            CHECK(count == test_modules);
+            CHECK_THROWS_AS(op.get(), crate_error);
+            CHECK_THROWS_WITH_AS(crate.run_modules_async("count", {0, 5}, {}),
+                                 "crate count: module number invalid", crate_error);
+            std::promise<void> gate;
+            std::shared_future<void> gated = gate.get_future().share();
+            auto blocked =
+                crate.run_modules_async("gate", {0}, [gated](module::module&) { gated.wait(); });
+            auto queued =
+                crate.run_modules_async("queued", {0}, [&count](module::module&) { ++count; });
+            CHECK_FALSE(blocked.ready());
+            CHECK_FALSE(queued.wait_for(1));
+            queued.cancel();
+            CHECK(queued.cancelled());
+            gate.set_value();
+            CHECK_NOTHROW(blocked.get());
+            try {
+                queued.get();
+                CHECK(false);
+            } catch (crate_error& e) {
+                CHECK(e.type == crate_error::code::module_task_cancelled);
+            }
+            CHECK(count == test_modules);
+            auto dacs = crate.set_dacs_async({0, 1});
+            CHECK_NOTHROW(dacs.get());
+        }
         SUBCASE("FIFO defaults") {
             CHECK(crate[0].fifo_buffers == module::module::default_fifo_buffers);
             CHECK(crate[0].fifo_run_wait_usecs == module::module::default_fifo_run_wait_usec);
@@ -165,6 +255,36 @@ TEST_SUITE("Crate: modules") {
                                  "module: num=0,slot=2: fifo: bandwidth value out of range",
                                  crate_error);
         }
+        SUBCASE("FIFO placement") {
+            module::worker_placement placement;
+            placement.cpus = {0};
+            placement.numa_local = true;
+            CHECK_NOTHROW(crate[0].set_fifo_placement(placement));
+            CHECK(crate[0].fifo_placement.cpus == xia::util::cpus({0}));
+            CHECK(crate[0].fifo_placement.numa_local);
+            placement.policy = xia::util::sched_policy::fifo;
+            CHECK_THROWS_WITH_AS(crate[0].set_fifo_placement(placement),
+                                 "module: num=0,slot=2: fifo: worker priority value out of range",
+                                 crate_error);
+            CHECK_NOTHROW(crate[0].set_fifo_placement(module::worker_placement()));
+        }
+        SUBCASE("FIFO auto-tune") {
+            CHECK(crate[0].fifo_buffer_words == module::module::default_fifo_buffer_words);
+            CHECK_NOTHROW(crate[0].set_fifo_buffer_words(module::module::min_fifo_buffer_words));
+            CHECK(crate[0].fifo_buffer_words == module::module::min_fifo_buffer_words);
+            CHECK_THROWS_WITH_AS(
+                crate[0].set_fifo_buffer_words(module::module::max_fifo_buffer_words + 1),
+                "module: num=0,slot=2: fifo: buffer words value out of range", crate_error);
+            CHECK_THROWS_WITH_AS(crate[0].set_fifo_auto_tune(true, 0, 0),
+                                 "module: num=0,slot=2: fifo: auto-tune period value out of range",
+                                 crate_error);
+            CHECK_NOTHROW(crate[0].set_fifo_auto_tune(true, 1024 * 1024));
+            CHECK(crate[0].fifo_auto_tune);
+            CHECK(crate[0].fifo_tune_budget == 1024 * 1024);
+            CHECK(!crate[0].get_fifo_tuning().valid);
+            CHECK(!crate[0].apply_fifo_tuning());
+            CHECK_NOTHROW(crate[0].set_fifo_auto_tune(false));
+        }
     }
     TEST_CASE("assign slots") {
         using namespace xia::pixie;
@@ -204,7 +324,1745 @@ TEST_SUITE("Crate: modules") {
         CHECK_NOTHROW(crate[0].run_end());
         CHECK_NOTHROW(crate[2].run_end());
         CHECK_NOTHROW(crate[1].run_end());
+        CHECK_NOTHROW(hw::run::control(crate[0], hw::run::control_task::program_fippi));
+        auto latency = crate[0].task_latencies.get(hw::run::control_task::program_fippi);
+        CHECK(latency.count == 1);
+        CHECK(latency.expected_usecs == latency.last_usecs);
+        CHECK(latency.last_polls >= 1);
+    }
+    TEST_CASE("parameter batch") {
+        using namespace xia::pixie;
+        using namespace xia::pixie::param;
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        SUBCASE("Module") {
+            module::param_writes writes = {
+                {module_param::trigconfig0, 0x12},
+                {module_param::trigconfig1, 0x34},
+                {channel_param::channel_csra, 0, 0x44},
+                {channel_param::channel_csra, 1, 0x4},
+            };
+            CHECK(crate[0].write_batch(writes) == false);
+            CHECK(crate[0].read(module_param::trigconfig0) == 0x12);
+            CHECK(crate[0].read(module_param::trigconfig1) == 0x34);
+            CHECK(crate[0].read(channel_param::channel_csra, 0) == 0x44);
+            CHECK(crate[0].read(channel_param::channel_csra, 1) == 0x4);
+            CHECK(crate[0].write_batch({{module_param::host_rt_preset, 10}}) == true);
+            CHECK(crate[0].defer_control(hw::run::control_task::program_fippi) == false);
+        }
+        SUBCASE("Controls") {
+            auto& latencies = crate[0].task_latencies;
+            auto fippi = latencies.get(hw::run::control_task::program_fippi).count;
+            crate[0].control_task = hw::run::control_task::nop;
+            CHECK_NOTHROW(crate[0].write_batch({{channel_param::channel_csra, 0, 0x44},
+                                                {channel_param::channel_csra, 1, 0x44}}));
+            CHECK(latencies.get(hw::run::control_task::program_fippi).count == fippi + 1);
+            CHECK(crate[0].control_task.load() == hw::run::control_task::set_dacs);
+        }
+        SUBCASE("Invalid") {
+            auto& latencies = crate[0].task_latencies;
+            auto fippi = latencies.get(hw::run::control_task::program_fippi).count;
+            crate[0].control_task = hw::run::control_task::nop;
+            CHECK_THROWS_AS(crate[0].write_batch({{channel_param::channel_csra, 0, 0x4},
+                                                  {channel_param::channel_csra, 99, 0x4}}),
+                            crate_error);
+            CHECK(crate[0].read(channel_param::channel_csra, 0) == 0x4);
+            CHECK(crate[0].defer_control(hw::run::control_task::program_fippi) == false);
+            CHECK(latencies.get(hw::run::control_task::program_fippi).count == fippi + 1);
+            CHECK(crate[0].control_task.load() == hw::run::control_task::set_dacs);
+        }
+        SUBCASE("Crate") {
+            crate::crate::module_param_writes writes;
+            writes[0] = {{module_param::trigconfig2, 0x56}};
+            writes[2] = {{module_param::trigconfig2, 0x78}};
+            CHECK_NOTHROW(crate.write_batch(writes));
+            CHECK(crate[0].read(module_param::trigconfig2) == 0x56);
+            CHECK(crate[2].read(module_param::trigconfig2) == 0x78);
+            writes[5] = {{module_param::trigconfig2, 0}};
+            CHECK_THROWS_WITH_AS(crate.write_batch(writes),
+                                 "crate write batch: module number invalid", crate_error);
+        }
+        SUBCASE("Staged") {
+            CHECK_FALSE(crate[0].staged());
+            CHECK_NOTHROW(crate[0].commit_staged());
+            CHECK_NOTHROW(crate[0].start_listmode(hw::run::run_mode::new_run));
+            CHECK(crate[0].stage_writes({{module_param::trigconfig0, 0x21},
+                                         {channel_param::channel_csra, 0, 0x24}}) == false);
+            CHECK(crate[0].staged());
+            CHECK(crate[0].read(module_param::trigconfig0) == 0x21);
+            CHECK(crate[0].read(channel_param::channel_csra, 0) == 0x24);
+            CHECK(crate[0].defer_control(hw::run::control_task::program_fippi) == true);
+            CHECK(crate[0].defer_control(hw::run::control_task::set_dacs) == true);
+            CHECK(crate[0].defer_control(hw::run::control_task::get_traces) == false);
+            CHECK_NOTHROW(crate[0].run_end());
+            CHECK_NOTHROW(crate[0].commit_staged());
+            CHECK_FALSE(crate[0].staged());
+            CHECK(crate[0].defer_control(hw::run::control_task::program_fippi) == false);
+            CHECK(crate[0].read(module_param::trigconfig0) == 0x21);
+            crate::crate::module_param_writes writes;
+            writes[1] = {{module_param::trigconfig3, 0x9a}};
+            writes[2] = {{module_param::trigconfig3, 0xbc}};
+            CHECK_NOTHROW(crate.stage_writes(writes));
+            CHECK(crate[1].staged());
+            CHECK(crate[2].staged());
+            CHECK_NOTHROW(crate.commit_staged());
+            CHECK_FALSE(crate[1].staged());
+            CHECK_FALSE(crate[2].staged());
+            CHECK(crate[2].read(module_param::trigconfig3) == 0xbc);
+            CHECK(crate[1].stage_writes({{channel_param::channel_csra, 1, 0x4}}) == false);
+            CHECK_NOTHROW(crate[1].discard_staged());
+            CHECK_FALSE(crate[1].staged());
+        }
+    }
+    TEST_CASE("config import") {
+        using namespace xia::pixie;
+        using param::channel_var;
+        using param::module_var;
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        module::number_slots loaded;
+        const std::string json_file = "test_config.json";
+        const std::string snapshot_file = "test_config.snap";
+        auto write_file = [](const std::string& name, const std::string& text) {
+            std::ofstream(name, std::ios::binary | std::ios::trunc) << text;
+        };
+        SUBCASE("JSON") {
+            config::parse_cache_clear();
+            write_file(json_file,
+                       R"([{"channel": {"input": {"FastThresh": [100, 101], "Bad": [1]}},)"
+                       R"( "metadata": {"config": [{"adc_bits": 14}], "fifo": {"hold": 1},)"
+                       R"( "hardware_revision": "F", "slot": 2},)"
+                       R"( "module": {"input": {"SlotID": 9, "SlowFilterRange": 2,)"
+                       R"( "TrigConfig": [1, 2, 3, 4]}}}])");
+            for (size_t pass = 0; pass < 2; ++pass) {
+                loaded.clear();
+                CHECK_NOTHROW(crate.import_config(json_file, loaded));
+                CHECK(loaded.size() == test_modules);
+                CHECK(config::parse_cache_files() == 1);
+                CHECK(crate[0].read_var(module_var::SlowFilterRange, 0, false) == 2);
+                CHECK(crate[0].read_var(module_var::TrigConfig, 3, false) == 4);
+                CHECK(crate[0].read_var(module_var::SlotID, 0, false) == 2);
+                CHECK(crate[0].read_var(channel_var::FastThresh, 1, 0, false) == 101);
+                CHECK(crate[0].read_var(channel_var::FastThresh, 15, 0, false) == 100);
+                CHECK(crate[2].read_var(module_var::SlowFilterRange, 0, false) == 3);
+                CHECK(crate[2].read_var(channel_var::FastThresh, 31, 0, false) == 1000);
+            }
+            /*
+             * A rewrite with the same size in the same second is not stale.
+             */
+            write_file(json_file,
+                       R"([{"channel": {"input": {"FastThresh": [100, 101], "Bad": [1]}},)"
+                       R"( "metadata": {"config": [{"adc_bits": 14}], "fifo": {"hold": 1},)"
+                       R"( "hardware_revision": "F", "slot": 2},)"
+                       R"( "module": {"input": {"SlotID": 9, "SlowFilterRange": 3,)"
+                       R"( "TrigConfig": [1, 2, 3, 4]}}}])");
+            loaded.clear();
+            CHECK_NOTHROW(crate.import_config(json_file, loaded));
+            CHECK(crate[0].read_var(module_var::SlowFilterRange, 0, false) == 3);
+            write_file(json_file, "{}");
+            CHECK_THROWS_WITH_AS(crate.import_config(json_file, loaded),
+                                 "parse config: not an array of modules", crate_error);
+            write_file(json_file, "[{}]");
+            CHECK_THROWS_WITH_AS(crate.import_config(json_file, loaded), "'metadata' not found",
+                                 crate_error);
+            write_file(json_file, "[{");
+            CHECK_THROWS_AS(crate.import_config(json_file, loaded), crate_error);
+            config::parse_cache_clear();
+            CHECK(config::parse_cache_files() == 0);
+            std::remove(json_file.c_str());
+        }
+        SUBCASE("Changes only") {
+            crate[0].write_var(channel_var::FastThresh, 200, 3, 0, false);
+            CHECK(crate[0].update_var(channel_var::FastThresh, 200, 3) == false);
+            CHECK(crate[0].update_var(channel_var::FastThresh, 201, 3) == true);
+            CHECK(crate[0].read_var(channel_var::FastThresh, 3, 0, false) == 201);
+            CHECK(crate[0].update_var(module_var::SlowFilterRange, 4) == true);
+            CHECK(crate[0].update_var(module_var::SlowFilterRange, 4) == false);
+            write_file(json_file,
+                       R"([{"channel": {"input": {"FastThresh": [300]}},)"
+                       R"( "metadata": {"hardware_revision": "F", "slot": 2},)"
+                       R"( "module": {"input": {"SlowFilterRange": 4}}}])");
+            loaded.clear();
+            CHECK_NOTHROW(crate.import_config(json_file, loaded, true));
+            CHECK(loaded.size() == test_modules);
+            CHECK(crate[0].read_var(channel_var::FastThresh, 3, 0, false) == 300);
+            CHECK(crate[0].read_var(module_var::SlowFilterRange, 0, false) == 4);
+            std::remove(json_file.c_str());
+        }
+        SUBCASE("Snapshot") {
+            crate[1].write_var(channel_var::FastThresh, 1234, 7, 0, false);
+            crate[1].write_var(module_var::SlowFilterRange, 1, 0, false);
+            CHECK_NOTHROW(crate.export_config(snapshot_file, true));
+            CHECK(config::is_snapshot(snapshot_file));
+            crate[1].write_var(channel_var::FastThresh, 10, 7, 0, false);
+            crate[1].write_var(module_var::SlowFilterRange, 3, 0, false);
+            loaded.clear();
+            CHECK_NOTHROW(crate.import_config(snapshot_file, loaded));
+            CHECK(loaded.size() == test_modules);
+            CHECK(crate[1].read_var(channel_var::FastThresh, 7, 0, false) == 1234);
+            CHECK(crate[1].read_var(module_var::SlowFilterRange, 0, false) == 1);
+            {
+                std::fstream file(snapshot_file, std::ios::in | std::ios::out | std::ios::binary);
+                file.seekp(-1, std::ios::end);
+                file.put(0x55);
+            }
+            CHECK_THROWS_WITH_AS(crate.import_config(snapshot_file, loaded),
+                                 "config snapshot: CRC mismatch: test_config.snap", crate_error);
+            CHECK_NOTHROW(crate.export_config(snapshot_file, true));
+            {
+                std::fstream file(snapshot_file, std::ios::in | std::ios::out | std::ios::binary);
+                const uint32_t modules = 0xffffffff;
+                file.seekp(2 * sizeof(uint32_t));
+                file.write(reinterpret_cast<const char*>(&modules), sizeof(modules));
+            }
+            CHECK_THROWS_WITH_AS(crate.import_config(snapshot_file, loaded),
+                                 "config snapshot: invalid module count: test_config.snap",
+                                 crate_error);
+            std::remove(snapshot_file.c_str());
+        }
+    }
+    TEST_CASE("config export") {
+        using namespace xia::pixie;
+        using param::channel_var;
+        using param::module_var;
+        /*
+         * The JSON's metadata has the modules' firmware.
+         */
+        firmware::module fws;
+        for (auto device : {"sys", "fippi", "dsp", "var"}) {
+            const std::string name = std::string("test_export_") + device + ".bin";
+            std::ofstream(name, std::ios::binary | std::ios::trunc) << device << "-image";
+            fws.push_back(std::make_shared<firmware::firmware>(firmware::parse(
+                std::string("version=1, revision=15, adc-msps=500, adc-bits=14, device=") +
+                    device + ", file=" + name,
+                ',')));
+        }
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        for (size_t m = 0; m < test_modules; ++m) {
+            crate[m].add(fws);
+        }
+        CHECK_NOTHROW(crate.probe());
+        module::number_slots loaded;
+        const std::string json_file = "test_export.json";
+        const std::string snapshot_file = "test_export.snap";
+        crate[2].write_var(channel_var::FastThresh, 777, 5, 0, false);
+        crate[2].write_var(module_var::SlowFilterRange, 2, 0, false);
+        CHECK_NOTHROW(crate.export_config_and_snapshot(json_file, snapshot_file));
+        /*
+         * The streamed JSON is formatted as a DOM's dump.
+         */
+        std::string text;
+        {
+            std::ifstream file(json_file);
+            std::stringstream contents;
+            contents << file.rdbuf();
+            text = contents.str();
+        }
+        auto doc = nlohmann::json::parse(text);
+        CHECK(doc.size() == test_modules);
+        CHECK(text == doc.dump(4) + "\n");
+        CHECK(doc[2]["metadata"]["slot"] == crate[2].slot);
+        CHECK(doc[2]["metadata"]["dsp"]["file"] == "test_export_dsp.bin");
+        CHECK(doc[2]["module"]["input"]["SlowFilterRange"] == 2);
+        CHECK(doc[2]["channel"]["input"]["FastThresh"][5] == 777);
+        CHECK(config::is_snapshot(snapshot_file));
+        crate[2].write_var(channel_var::FastThresh, 10, 5, 0, false);
+        CHECK_NOTHROW(crate.import_config(snapshot_file, loaded));
+        CHECK(crate[2].read_var(channel_var::FastThresh, 5, 0, false) == 777);
+        crate[2].write_var(channel_var::FastThresh, 10, 5, 0, false);
+        CHECK_NOTHROW(crate.import_config(json_file, loaded));
+        CHECK(crate[2].read_var(channel_var::FastThresh, 5, 0, false) == 777);
+        std::remove(json_file.c_str());
+        std::remove(snapshot_file.c_str());
+        for (auto device : {"sys", "fippi", "dsp", "var"}) {
+            std::remove((std::string("test_export_") + device + ".bin").c_str());
+        }
+    }
+    TEST_CASE("histogram bulk read") {
+        using namespace xia::pixie;
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        hw::words values(4);
+        SUBCASE("Empty") {
+            CHECK_NOTHROW(crate[0].read_histograms({}, values));
+            CHECK(values.empty());
+        }
+        SUBCASE("Invalid") {
+            CHECK_THROWS_AS(crate[0].read_histograms({0, 99}, values), crate_error);
+            const size_t max = crate[0].channels[0].fixture->config.max_histogram_length;
+            CHECK_THROWS_AS(crate[0].read_histograms({0, 1}, values, max + 1), crate_error);
+            crate::crate::module_histograms histograms;
+            CHECK_THROWS_WITH_AS(crate.read_histograms({0, 5}, histograms),
+                                 "crate read histograms: module number invalid", crate_error);
+            CHECK_THROWS_AS(crate.save_histograms("/no-such-dir/test.mca", {0}), crate_error);
+        }
+        SUBCASE("Save") {
+            const std::string file_name = "test_histograms.mca";
+            const size_t length = 16;
+            auto file_words = [&file_name]() {
+                std::ifstream in(file_name, std::ios::binary);
+                hw::words words;
+                hw::word word;
+                while (in.read(reinterpret_cast<char*>(&word), sizeof(word))) {
+                    words.push_back(word);
+                }
+                return words;
+            };
+            crate::crate::module_histograms histograms;
+            CHECK_NOTHROW(crate.read_histograms({0, 1}, histograms, length));
+            CHECK_NOTHROW(crate.save_histograms(file_name, {0, 1},
+                                                crate::crate::histogram_format::binary, length));
+            auto words = file_words();
+            CHECK(words.size() == (crate[0].num_channels + crate[1].num_channels) * length);
+            CHECK(std::equal(histograms[0].begin(), histograms[0].end(), words.begin()));
+            CHECK_NOTHROW(crate.save_histograms(file_name, {1},
+                                                crate::crate::histogram_format::described,
+                                                length));
+            words = file_words();
+            REQUIRE(words.size() == 3 + 8 + crate[1].num_channels * length);
+            CHECK(words[0] == crate::crate::histogram_file_magic);
+            CHECK(words[1] == crate::crate::histogram_file_version);
+            CHECK(words[2] == 1);
+            CHECK(words[3] == 1);
+            CHECK(words[4] == hw::word(crate[1].slot));
+            CHECK(words[5] == hw::word(crate[1].serial_num));
+            CHECK(words[9] == hw::word(crate[1].num_channels));
+            CHECK(words[10] == length);
+            CHECK(std::equal(histograms[1].begin(), histograms[1].end(), words.begin() + 11));
+            CHECK_NOTHROW(crate.save_histograms(file_name, {}));
+            words = file_words();
+            size_t total = 0;
+            for (auto& mod : crate.modules) {
+                total += mod->num_channels * mod->channels[0].fixture->config.max_histogram_length;
+            }
+            CHECK(words.size() == total);
+            std::remove(file_name.c_str());
+        }
+    }
+    TEST_CASE("MCA clear") {
+        using namespace xia::pixie;
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        auto& module = crate[0];
+        CHECK(module.mca_clear_policy.load() == module::module::mca_clear::run_start);
+        CHECK(module.mca_memory() == module::module::mca_state::dirty);
+        SUBCASE("Run start") {
+            CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+            CHECK(module.run_mca_cleared.load());
+            CHECK_NOTHROW(module.run_end());
+            CHECK(module.mca_memory() == module::module::mca_state::dirty);
+        }
+        SUBCASE("Skip list-mode") {
+            CHECK_NOTHROW(module.set_mca_clear(module::module::mca_clear::skip_list_mode));
+            CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+            CHECK(!module.run_mca_cleared.load());
+            CHECK_THROWS_AS(module.start_mca_clear(), error::error);
+            CHECK_NOTHROW(module.run_end());
+            CHECK_NOTHROW(module.start_mca_clear());
+            CHECK(module.wait_mca_clear());
+            CHECK(module.mca_memory() == module::module::mca_state::clear);
+            CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+            CHECK(module.run_mca_cleared.load());
+            CHECK_NOTHROW(module.run_end());
+        }
+        SUBCASE("Run end") {
+            CHECK_NOTHROW(module.set_mca_clear(module::module::mca_clear::run_end));
+            CHECK_NOTHROW(module.start_histograms(hw::run::run_mode::new_run));
+            CHECK_NOTHROW(module.run_end());
+            CHECK(module.wait_mca_clear());
+            hw::words values(16);
+            CHECK_NOTHROW(module.read_histogram(0, values));
+            CHECK(std::all_of(values.begin(), values.end(), [](hw::word w) { return w == 0; }));
+            CHECK_NOTHROW(module.start_histograms(hw::run::run_mode::new_run));
+            CHECK(module.run_mca_cleared.load());
+            CHECK_NOTHROW(module.run_end());
+        }
+    }
+    TEST_CASE("ADC bulk read") {
+        using namespace xia::pixie;
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        hw::adc_traces traces;
+        CHECK_THROWS_AS(crate[0].read_adcs({0, 99}, traces, false), crate_error);
+        CHECK_THROWS_WITH_AS(crate[0].read_adcs({0, 1}, traces, false),
+                             "module: num=0,slot=2: control task not `get_traces`", crate_error);
+        CHECK_THROWS_WITH_AS(crate.read_adcs({0, 5},
+                                             [](module::module&, hw::adc_traces&) {}, false),
+                             "crate read adcs: module number invalid", crate_error);
+    }
+    TEST_CASE("tau fit") {
+        using namespace xia::pixie;
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        data::tau::config cfg;
+        data::tau::estimates taus;
+        CHECK_THROWS_AS(crate[0].fit_tau({0, 99}, cfg, taus), crate_error);
+        CHECK_THROWS_WITH_AS(crate[0].fit_tau({0, 1}, cfg, taus, 0),
+                             "module: num=0,slot=2: fit tau: no captures", crate_error);
+        crate::crate::module_taus module_taus;
+        CHECK_THROWS_WITH_AS(crate.fit_taus({0, 5}, cfg, module_taus),
+                             "crate fit taus: module number invalid", crate_error);
+        /*
+         * The sim's ADC traces decay with the channel's tau.
+         */
+        crate[0].write_var(param::channel_var::Xwait, 2, 2);
+        crate[0].write_var(param::channel_var::PreampTau, xia::util::ieee_float(12.5), 2);
+        CHECK_NOTHROW(crate[0].fit_tau({2}, cfg, taus, 2));
+        REQUIRE(taus.size() == 1);
+        CHECK(taus[0].pulses == 2);
+        CHECK(taus[0].tau_usecs == doctest::Approx(12.5).epsilon(0.02));
+    }
+    TEST_CASE("scope") {
+        using namespace xia::pixie;
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        auto& module = crate[0];
+        scope::config cfg;
+        cfg.channels = {0, 3};
+        cfg.depth = 3;
+        cfg.length = 256;
+        SUBCASE("Config") {
+            scope::config bad(cfg);
+            bad.depth = 0;
+            CHECK_THROWS_AS(scope::scope(module, bad), crate_error);
+            bad = cfg;
+            bad.channels = {99};
+            CHECK_THROWS_AS(scope::scope(module, bad), crate_error);
+            bad = cfg;
+            bad.length = hw::max_adc_trace_length + 1;
+            CHECK_THROWS_AS(scope::scope(module, bad), crate_error);
+        }
+        SUBCASE("Acquire") {
+            scope::scope scope(module, cfg);
+            scope::frame frame;
+            CHECK_FALSE(scope.latest(0, frame));
+            CHECK_THROWS_AS(scope.latest(1, frame), crate_error);
+            for (size_t a = 0; a < 5; ++a) {
+                CHECK(scope.acquire());
+            }
+            CHECK(scope.sequence() == 5);
+            REQUIRE(scope.latest(3, frame));
+            CHECK(frame.sequence == 5);
+            CHECK(frame.samples.size() == 256);
+            CHECK(frame.samples[0] == doctest::Approx(1000).epsilon(0.01));
+            scope::frames frames;
+            CHECK(scope.history(0, frames) == 3);
+            CHECK(frames[0].sequence == 5);
+            CHECK(frames[2].sequence == 3);
+            CHECK(frames[0].time >= frames[2].time);
+            module.run_task = hw::run::run_task::list_mode;
+            CHECK_FALSE(scope.acquire());
+            module.run_task = hw::run::run_task::nop;
+        }
+        SUBCASE("Stream") {
+            scope::scope scope(module, cfg);
+            CHECK_NOTHROW(scope.start());
+            CHECK(scope.running());
+            CHECK_THROWS_AS(scope.start(), crate_error);
+            /*
+             * Readers take the latest trace while the thread acquires.
+             */
+            size_t reads = 0;
+            size_t last = 0;
+            auto until = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+            while (scope.sequence() < 10 && std::chrono::steady_clock::now() < until) {
+                scope::frame frame;
+                if (scope.latest(0, frame)) {
+                    CHECK(frame.sequence >= last);
+                    last = frame.sequence;
+                    ++reads;
+                }
+            }
+            CHECK_NOTHROW(scope.stop());
+            CHECK_FALSE(scope.running());
+            CHECK(scope.sequence() >= 10);
+            CHECK(scope.errors() == 0);
+            CHECK(reads > 0);
+        }
+    }
+    TEST_CASE("fingerprint boot") {
+        using namespace xia::pixie;
+        const std::vector<std::string> devices = {"sys", "fippi", "dsp"};
+        firmware::module fws;
+        for (auto& device : devices) {
+            const std::string name = "test_fingerprint_" + device + ".bin";
+            std::ofstream(name, std::ios::binary | std::ios::trunc) << device << "-image";
+            fws.push_back(std::make_shared<firmware::firmware>(firmware::parse(
+                "version=1, revision=15, adc-msps=500, adc-bits=14, device=" + device +
+                    ", file=" + name,
+                ',')));
+        }
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        crate[0].add(fws);
+        CHECK_NOTHROW(crate.probe());
+        SUBCASE("Module") {
+            auto expected = crate[0].firmware_fingerprint();
+            CHECK(expected.comms == fws[0]->crc);
+            CHECK(expected.dsp == fws[2]->crc);
+            module::fingerprint loaded;
+            CHECK(crate[0].boot_changed(loaded) == true);
+            CHECK(loaded.comms == expected.comms);
+            CHECK(loaded.fippi == expected.fippi);
+            CHECK(loaded.dsp == expected.dsp);
+            CHECK(crate[0].boot_changed(loaded) == false);
+            loaded.fippi = 0;
+            CHECK(crate[0].boot_changed(loaded) == true);
+            CHECK(loaded.fippi == expected.fippi);
+            CHECK(crate[0].online());
+        }
+        SUBCASE("Crate") {
+            const std::string fp_file = "test_fingerprints.json";
+            std::remove(fp_file.c_str());
+            crate::crate::boot_params params;
+            params.modules = {0};
+            params.force = false;
+            params.fingerprints = fp_file;
+            CHECK_NOTHROW(crate.boot(params));
+            std::ifstream input(fp_file);
+            std::stringstream contents;
+            contents << input.rdbuf();
+            CHECK(contents.str().find("\"serial-num\": 1034") != std::string::npos);
+            CHECK(contents.str().find(std::to_string(fws[1]->crc)) != std::string::npos);
+            CHECK_NOTHROW(crate.boot(params));
+            std::remove(fp_file.c_str());
+        }
+        for (auto& device : devices) {
+            std::remove(("test_fingerprint_" + device + ".bin").c_str());
+        }
+    }
+    TEST_CASE("bus lock") {
+        using namespace xia::pixie;
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        auto& module = crate[0];
+        module.bus_hold_stats_reset();
+        {
+            module::module::bus_guard guard(module);
+        }
+        {
+            module::module::bus_guard guard(module, module::module::bus_priority::fifo);
+            guard.unlock();
+            guard.lock();
+        }
+        auto stats = module.bus_hold_stats();
+        CHECK(stats.holds == 3);
+        CHECK(stats.fifo_holds == 2);
+        CHECK(stats.fifo_waits == 0);
+        CHECK(stats.waits == 0);
+        SUBCASE("FIFO priority") {
+            std::atomic_bool normal_locked(false);
+            std::atomic_bool fifo_locked(false);
+            std::atomic_bool fifo_first(false);
+            std::unique_ptr<module::module::bus_guard> held(
+                new module::module::bus_guard(module));
+            std::thread fifo_worker([&] {
+                module::module::bus_guard guard(module, module::module::bus_priority::fifo);
+                fifo_locked = true;
+                fifo_first = !normal_locked.load();
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            });
+            while (module.bus_hold_stats().fifo_waits == 0) {
+                std::this_thread::yield();
+            }
+            std::thread user([&] {
+                module::module::bus_guard guard(module);
+                normal_locked = true;
+            });
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            held.reset();
+            fifo_worker.join();
+            user.join();
+            CHECK(fifo_locked.load());
+            CHECK(normal_locked.load());
+            CHECK(fifo_first.load());
+            auto waited = module.bus_hold_stats();
+            CHECK(waited.waits == 2);
+            CHECK(waited.max_wait_usecs >= 5000);
+            CHECK(waited.total_wait_usecs >= waited.max_wait_usecs);
+        }
+    }
+    TEST_CASE("module lock") {
+        using namespace xia::pixie;
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        auto& module = crate[0];
+        module.lock_wait_stats_reset();
+        {
+            module::module::guard guard(module);
+            guard.unlock();
+            guard.lock();
+        }
+        auto stats = module.lock_wait_stats();
+        CHECK(stats.locks == 2);
+        CHECK(stats.waits == 0);
+        SUBCASE("Wait") {
+            std::atomic_bool waiting(false);
+            std::unique_ptr<module::module::guard> held(new module::module::guard(module));
+            std::thread user([&] {
+                waiting = true;
+                module::module::guard guard(module);
+            });
+            while (!waiting.load()) {
+                std::this_thread::yield();
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            held.reset();
+            user.join();
+            auto waited = module.lock_wait_stats();
+            CHECK(waited.locks == 4);
+            CHECK(waited.waits == 1);
+            CHECK(waited.max_wait_usecs > 0);
+            CHECK(waited.total_wait_usecs == waited.max_wait_usecs);
+        }
+    }
+    TEST_CASE("fifo histogram") {
+        using histogram = xia::pixie::module::module::fifo_histogram;
+        CHECK(histogram::bin(0) == 0);
+        CHECK(histogram::bin(1) == 1);
+        CHECK(histogram::bin(2) == 2);
+        CHECK(histogram::bin(3) == 2);
+        CHECK(histogram::bin(1024) == 11);
+        CHECK(histogram::bin(std::numeric_limits<size_t>::max()) == histogram::bins - 1);
+        CHECK(histogram::bin_lower(0) == 0);
+        CHECK(histogram::bin_lower(11) == 1024);
+        histogram hist;
+        hist.record(0);
+        hist.record(5);
+        hist.record(7);
+        hist.record(1024);
+        CHECK(hist.total() == 4);
+        CHECK(hist.output() == "0:1 4:2 1024:1");
+        xia::pixie::module::module::fifo_stats stats;
+        stats.dma_words = hist;
+        CHECK(stats.dma_words.counts[3].load() == 2);
+        auto copy = stats;
+        CHECK(copy.dma_words.total() == 4);
+        stats.clear();
+        CHECK(stats.dma_words.total() == 0);
+        CHECK(copy.dma_words.total() == 4);
+    }
+    TEST_CASE("register command lists") {
+        using namespace xia::pixie;
+        namespace reglist = hw::reglist;
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        auto& module = crate[0];
+        const hw::word pci_active = 1 << hw::bit::PCIACTIVE;
+        const hw::word run_active = 1 << hw::bit::RUNACTIVE;
+        SUBCASE("Invalid") {
+            CHECK_THROWS_AS(reglist::list("empty", {}), crate_error);
+            CHECK_THROWS_AS(reglist::list("negative", {reglist::write(-4, 0)}), crate_error);
+            CHECK_THROWS_AS(reglist::list("unaligned", {reglist::write(0x49, 0)}), crate_error);
+            CHECK_THROWS_AS(reglist::list("no bits", {reglist::set_bits(hw::device::CSR, 0)}),
+                            crate_error);
+            CHECK_THROWS_AS(reglist::list("expect", {reglist::expect(hw::device::CSR, 1, 2,
+                                                                     error::code::success,
+                                                                     "expect")}),
+                            crate_error);
+        }
+        SUBCASE("Run") {
+            reglist::list list("test", {
+                reglist::write_param(hw::device::WRT_EXT_MEM, 1),
+                reglist::set_bits(hw::device::CSR, pci_active),
+                reglist::read(hw::device::CFG_RDCS),
+                reglist::expect(hw::device::CSR, run_active, 0, error::code::device_dma_busy,
+                                "run active"),
+                reglist::clear_bits(hw::device::CSR, pci_active),
+                reglist::read(hw::device::RD_WRT_FIFO_WML)
+            });
+            CHECK(list.size() == 6);
+            CHECK(list.params() == 2);
+            CHECK(list.reads() == 2);
+            hw::word results[2] = {1, 1};
+            CHECK_THROWS_WITH_AS(list.run(module, {0x100}, results),
+                                 "reglist: test: not enough parameters", crate_error);
+            CHECK_THROWS_WITH_AS(list.run(module, {0x100, 0x200}),
+                                 "reglist: test: no results", crate_error);
+            CHECK_NOTHROW(list.run(module, {0x100, 0x200}, results));
+            CHECK(results[0] == 0);
+            CHECK(results[1] == 0);
+            {
+                module::module::reg_trace_guard trace(module);
+                trace.enable();
+                CHECK_NOTHROW(list.run(module, {0x100, 0x200}, results));
+                CHECK(module.reg_trace);
+            }
+            auto times = list.times();
+            CHECK(times.runs == 2);
+            CHECK(times.max_nsecs <= times.total_nsecs);
+            CHECK(times.mean_nsecs() <= double(times.max_nsecs));
+            list.times_reset();
+            CHECK(list.times().runs == 0);
+            reglist::list busy("busy", {
+                reglist::expect(hw::device::CSR, run_active, run_active,
+                                error::code::device_dma_busy, "run not active")
+            });
+            CHECK_THROWS_WITH_AS(busy.run(module), "run not active", crate_error);
+        }
+    }
+    TEST_CASE("hardware access paths") {
+        using namespace xia::pixie;
+        namespace access = hw::access;
+        CHECK(std::string(access::select(hw::rev_B).name) == "rev-b-g");
+        CHECK(std::string(access::select(hw::rev_F).name) == "rev-b-g");
+        CHECK(std::string(access::select(hw::rev_H).name) == "rev-h");
+        CHECK(&access::select(hw::rev_G) == &access::select(hw::rev_D));
+        CHECK(access::select(hw::rev_H).mca_read == access::mca_read<access::rev_h>);
+        CHECK(access::select(hw::rev_F).mca_read == access::mca_read<access::rev_b_g>);
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        for (auto& module : crate.modules) {
+            REQUIRE(module->hw_access != nullptr);
+            CHECK(module->hw_access == &access::select(module->revision));
+        }
+        auto& module = crate[0];
+        hw::words values(16, 1);
+        SUBCASE("MCA read") {
+            CHECK_NOTHROW(access::mca_read<access::rev_b_g>(module, 0, values.data(),
+                                                            values.size()));
+            CHECK_NOTHROW(access::mca_read<access::rev_h>(module, 0, values.data(),
+                                                          values.size()));
+            CHECK_NOTHROW(module.hw_access->mca_read(module, 0, values.data(), values.size()));
+        }
+        SUBCASE("FIFO read") {
+            CHECK_NOTHROW(access::fifo_read<access::rev_b_g>(module, values.data(),
+                                                             values.size()));
+            CHECK_NOTHROW(module.hw_access->fifo_read(module, values.data(), values.size()));
+        }
+    }
+    TEST_CASE("fifo stats layout") {
+        using fifo_stats = xia::pixie::module::module::fifo_stats;
+        constexpr size_t line = xia::util::cache_line;
+        auto stats = std::make_unique<fifo_stats>();
+        auto addr = [](const void* p) { return reinterpret_cast<uintptr_t>(p); };
+        CHECK(addr(&stats->out) - addr(&stats->min_bandwidth) >= line + sizeof(double));
+        CHECK(addr(&stats->level_words) - addr(&stats->out) >= line + sizeof(size_t));
+        stats->in = 10;
+        stats->out = 4;
+        fifo_stats copy(*stats);
+        CHECK(copy.in.load() == 10);
+        CHECK(copy.out.load() == 4);
+    }
+    TEST_CASE("fifo rate") {
+        xia::pixie::module::fifo_rate rate;
+        CHECK(rate.wait_usecs(0, 1000, 500, 150000) == 150000);
+        rate.sample(2000, 0, 1000);
+        CHECK(rate.valid);
+        CHECK(rate.rate == doctest::Approx(2.0));
+        CHECK(rate.wait_usecs(0, 4000, 500, 150000) == 2000);
+        CHECK(rate.wait_usecs(3500, 4000, 500, 150000) == 500);
+        CHECK(rate.trigger_level(2000, 512, 4000) == 4000);
+        CHECK(rate.trigger_level(100, 512, 4000) == 512);
+        rate.sample(1000, 1000, 1000);
+        CHECK(rate.rate == doctest::Approx(1.5));
+        rate.sample(0, 1000, 1000);
+        CHECK(rate.rate < 1.5);
+        rate.reset();
+        CHECK(!rate.valid);
+    }
+    TEST_CASE("fifo tuner") {
+        using xia::pixie::module::fifo_tuner;
+        using xia::pixie::hw::word;
+        /*
+         * Events of 100 words with the length in the header's first word.
+         */
+        std::vector<word> data(3000, 0);
+        for (size_t w = 0; w < data.size(); w += 100) {
+            data[w] = word(100) << 17;
+        }
+        fifo_tuner tuner;
+        CHECK(!tuner.tune(0, 10, 1000).valid);
+        tuner.sample(data.data(), 250, 64 * 1024, 3);
+        CHECK(tuner.carry == 50);
+        tuner.sample(data.data() + 250, 2750, 64 * 1024, 12);
+        CHECK(tuner.carry == 0);
+        CHECK(tuner.dmas == 2);
+        CHECK(tuner.max_dma_words == 2750);
+        CHECK(tuner.max_event_words == 100);
+        CHECK(tuner.max_queue_depth == 12);
+        CHECK(!tuner.capped);
+        auto tuning = tuner.tune(0, 10, 1000);
+        CHECK(tuning.valid);
+        CHECK(tuning.buffer_words == fifo_tuner::min_buffer_words);
+        CHECK(tuning.buffers == 2 * 12 + fifo_tuner::headroom_buffers);
+        CHECK(!tuning.over_budget);
+        /*
+         * Transfers that fill the buffers double the buffer size.
+         */
+        tuner.sample(data.data(), 2048, 2048, 1);
+        CHECK(tuner.capped);
+        tuning = tuner.tune(0, 10, 1000);
+        CHECK(tuning.buffer_words == fifo_tuner::min_buffer_words);
+        tuner.sample(data.data(), 3000, 3000, 1);
+        tuner.capacity = 32 * 1024;
+        tuning = tuner.tune(0, 10, 1000);
+        CHECK(tuning.buffer_words == 64 * 1024);
+        /*
+         * The budget reduces the buffers to the deepest queue and then
+         * the buffer size.
+         */
+        const size_t word_bytes = sizeof(word);
+        tuning = tuner.tune(20 * 64 * 1024 * word_bytes, 10, 1000);
+        CHECK(tuning.buffers == 20);
+        CHECK(tuning.buffer_words == 64 * 1024);
+        CHECK(!tuning.over_budget);
+        tuning = tuner.tune(18 * 16 * 1024 * word_bytes, 10, 1000);
+        CHECK(tuning.buffers == 12 + fifo_tuner::headroom_buffers);
+        CHECK(tuning.buffer_words == 16 * 1024);
+        tuning = tuner.tune(1024, 10, 1000);
+        CHECK(tuning.over_budget);
+        CHECK(tuning.buffer_words == fifo_tuner::min_buffer_words);
+        tuner.reset();
+        CHECK(tuner.dmas == 0);
+    }
+    TEST_CASE("list-mode generator") {
+        using namespace xia::pixie;
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        auto& module = dynamic_cast<sim::module&>(crate[0]);
+        sim::generator_config config;
+        config.channels.resize(1);
+        SUBCASE("Invalid") {
+            config.header_length = 5;
+            CHECK_THROWS_WITH_AS(module.set_generator(config),
+                                 "sim: generator: invalid header length: 5", error::error);
+            config.header_length = data::list_mode::header_length::header;
+            config.channels.resize(3);
+            CHECK_THROWS_WITH_AS(module.set_generator(config),
+                                 "sim: generator: channel count does not match the module",
+                                 error::error);
+        }
+        SUBCASE("Run") {
+            config.header_length = data::list_mode::header_length::header_esum_qdc_ets;
+            config.channels[0].rate = 1000;
+            config.channels[0].trace_length = 64;
+            config.pileup_ns = 100000;
+            CHECK_NOTHROW(module.set_generator(config));
+            CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            CHECK_NOTHROW(module.run_end());
+            CHECK(module.gen.events.load() > 0);
+            hw::words values;
+            {
+                xia::buffer::queue::handles buffers;
+                CHECK(module.read_list_mode(buffers) > 0);
+                for (auto& buf : buffers) {
+                    values.insert(values.end(), buf->begin(), buf->end());
+                }
+            }
+            data::list_mode::records recs;
+            data::list_mode::buffer leftovers;
+            CHECK_NOTHROW(data::list_mode::decode_data_block(values.data(), values.size(), 34688,
+                                                             500, recs, leftovers));
+            CHECK(leftovers.empty());
+            CHECK(recs.size() == module.gen.events.load() - module.gen.lost.load());
+            size_t pileups = 0;
+            bool valid = true;
+            bool ordered = true;
+            for (size_t r = 0; r < recs.size(); ++r) {
+                auto& rec = recs[r];
+                valid = valid && rec.slot_id == 2 && rec.channel_number < 16 &&
+                    rec.header_length == 18 && rec.trace_length == 64 && rec.trace.size() == 64;
+                if (r > 0 && rec.filter_time < recs[r - 1].filter_time) {
+                    ordered = false;
+                }
+                if (rec.finish_code) {
+                    ++pileups;
+                }
+            }
+            CHECK(valid);
+            CHECK(ordered);
+            CHECK(pileups == module.gen.pileups.load());
+        }
+        SUBCASE("Auto-tune") {
+            config.header_length = data::list_mode::header_length::header_esum_qdc_ets;
+            config.channels[0].rate = 1000;
+            config.channels[0].trace_length = 64;
+            CHECK_NOTHROW(module.set_generator(config));
+            CHECK_NOTHROW(module.set_fifo_auto_tune(true, 0, 1));
+            CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            CHECK_NOTHROW(module.run_end());
+            xia::buffer::queue::handles buffers;
+            CHECK(module.read_list_mode(buffers) > 0);
+            buffers.clear();
+            auto tuning = module.get_fifo_tuning();
+            CHECK(tuning.valid);
+            CHECK(tuning.dmas > 0);
+            CHECK(tuning.max_event_words == 18 + 64 / 2);
+            CHECK(tuning.buffer_words == module::fifo_tuner::min_buffer_words);
+            CHECK(module.apply_fifo_tuning());
+            CHECK(module.fifo_buffer_words == tuning.buffer_words);
+            CHECK(module.fifo_buffers == tuning.buffers);
+            CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            CHECK_NOTHROW(module.run_end());
+            CHECK(module.read_list_mode(buffers) > 0);
+        }
     }
+    TEST_CASE("list-mode subscription") {
+        using namespace xia::pixie;
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        auto& module = dynamic_cast<sim::module&>(crate[0]);
+        sim::generator_config config;
+        config.header_length = data::list_mode::header_length::header;
+        config.channels.resize(1);
+        config.channels[0].rate = 10000;
+        CHECK_NOTHROW(module.set_generator(config));
+        SUBCASE("Handler") {
+            std::atomic_size_t words(0);
+            std::atomic_size_t calls(0);
+            module::list_mode_subscription sub;
+            sub.threshold_words = 64;
+            sub.timeout_usecs = 20000;
+            sub.callback = [&words, &calls](module::module&, xia::buffer::queue::handles& bufs) {
+                for (auto& buf : bufs) {
+                    words += buf->size();
+                }
+                ++calls;
+            };
+            CHECK_NOTHROW(module.subscribe_list_mode(sub));
+            CHECK(module.list_mode_subscribed());
+            CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            CHECK_NOTHROW(module.run_end());
+            for (int w = 0; w < 100 && words.load() < module.run_stats.in.load(); ++w) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            CHECK(calls.load() > 0);
+            CHECK(words.load() > 0);
+            CHECK(words.load() == module.run_stats.in.load());
+            CHECK_NOTHROW(module.unsubscribe_list_mode());
+            CHECK(!module.list_mode_subscribed());
+        }
+        SUBCASE("Wait") {
+            CHECK(!module.wait_list_mode(1000));
+            module::list_mode_subscription sub;
+            CHECK_NOTHROW(module.subscribe_list_mode(sub));
+#if defined(__linux__)
+            CHECK(module.list_mode_event_fd() >= 0);
+#endif
+            CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+            CHECK(module.wait_list_mode(1000 * 1000));
+            CHECK(module.wait_list_mode(1000));
+            xia::buffer::queue::handles buffers;
+            CHECK(module.read_list_mode(buffers) > 0);
+            CHECK_NOTHROW(module.run_end());
+            buffers.clear();
+            module.read_list_mode(buffers);
+            CHECK(!module.wait_list_mode(1000));
+            CHECK_NOTHROW(module.unsubscribe_list_mode());
+            CHECK(module.list_mode_event_fd() == -1);
+        }
+    }
+    TEST_CASE("list-mode polling") {
+        using namespace xia::pixie;
+        sim::crate crate;
+        {
+            crate::module_poll_handle handle(crate, 0);
+            CHECK(handle.result == error::code::crate_not_ready);
+        }
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        {
+            crate::module_poll_handle handle(crate, 10);
+            CHECK(handle.result == error::code::module_number_invalid);
+        }
+        crate::module_poll_handle handle(crate, 0);
+        REQUIRE(handle);
+        auto& module = dynamic_cast<sim::module&>(*handle);
+        sim::generator_config config;
+        config.header_length = data::list_mode::header_length::header;
+        config.channels.resize(1);
+        config.channels[0].rate = 10000;
+        CHECK_NOTHROW(module.set_generator(config));
+        size_t level = 1;
+        CHECK(module.read_list_mode_level(level, std::nothrow) == error::code::success);
+        CHECK(level == 0);
+        CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        CHECK_NOTHROW(module.run_end());
+        CHECK(module.read_list_mode_level(level, std::nothrow) == error::code::success);
+        CHECK(level > 0);
+        hw::words words(level / 2);
+        size_t copied = 0;
+        CHECK(module.read_list_mode(words.data(), words.size(), copied, std::nothrow) ==
+              error::code::success);
+        CHECK(copied == words.size());
+        xia::buffer::queue::handles buffers;
+        CHECK(module.read_list_mode(buffers, 0, copied, std::nothrow) == error::code::success);
+        CHECK(copied >= level - words.size());
+        stats::stats stats(module);
+        CHECK(module.read_stats(stats, std::nothrow) == error::code::success);
+        buffers.clear();
+        module.force_offline();
+        CHECK(module.read_list_mode_level(level, std::nothrow) == error::code::module_offline);
+        CHECK(level == 0);
+        CHECK(module.read_list_mode(words.data(), words.size(), copied, std::nothrow) ==
+              error::code::module_offline);
+        CHECK(module.read_list_mode(buffers, 0, copied, std::nothrow) ==
+              error::code::module_offline);
+        CHECK(module.read_stats(stats, std::nothrow) == error::code::module_offline);
+        crate::module_poll_handle offline(crate, 0);
+        CHECK(offline.result == error::code::module_offline);
+    }
+    TEST_CASE("list-mode resume") {
+        using namespace xia::pixie;
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        auto& module = dynamic_cast<sim::module&>(*crate.modules[0]);
+        CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+        CHECK(module.run_task.load() == hw::run::run_task::list_mode);
+        CHECK_NOTHROW(module.run_end());
+        CHECK(module.run_task.load() == hw::run::run_task::nop);
+        CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::resume));
+        CHECK(module.run_task.load() == hw::run::run_task::list_mode);
+        CHECK(module.read_var(param::module_var::Resume) ==
+              param::value_type(hw::run::run_mode::resume));
+        CHECK_NOTHROW(module.run_end());
+        CHECK(module.run_task.load() == hw::run::run_task::nop);
+    }
+    TEST_CASE("list-mode save") {
+        using namespace xia::pixie;
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        auto& module = dynamic_cast<sim::module&>(*crate.modules[0]);
+        sim::generator_config config;
+        config.header_length = data::list_mode::header_length::header;
+        config.channels.resize(1);
+        config.channels[0].rate = 10000;
+        CHECK_NOTHROW(module.set_generator(config));
+        const std::string file_name = "test_save_list_mode.bin";
+        std::remove(file_name.c_str());
+        CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        CHECK_NOTHROW(module.run_end());
+        const size_t level = module.read_list_mode_level();
+        REQUIRE(level > 0);
+        CHECK(module.save_list_mode(file_name, level) == 0);
+        CHECK(!std::ifstream(file_name).good());
+        CHECK(module.save_list_mode(file_name) == level);
+        CHECK(module.save_list_mode(file_name) == 0);
+        CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        CHECK_NOTHROW(module.run_end());
+        const size_t more = module.read_list_mode_level();
+        CHECK(module.save_list_mode(file_name) == more);
+        {
+            std::ifstream file(file_name, std::ios::binary | std::ios::ate);
+            CHECK(size_t(file.tellg()) == (level + more) * sizeof(hw::word));
+        }
+        CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        CHECK_NOTHROW(module.run_end());
+        const size_t kept = module.read_list_mode_level();
+        REQUIRE(kept > 0);
+        CHECK_THROWS_AS(module.save_list_mode("no-such-dir/list-mode.bin"), error::error);
+        CHECK(module.read_list_mode_level() == kept);
+#if defined(__linux__)
+        CHECK_THROWS_AS(module.save_list_mode("/dev/full"), error::error);
+        CHECK(module.read_list_mode_level() == kept);
+#endif
+        CHECK(module.save_list_mode(file_name) == kept);
+        std::remove(file_name.c_str());
+    }
+    TEST_CASE("list-mode readout with the module locked") {
+        using namespace xia::pixie;
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        auto& module = dynamic_cast<sim::module&>(crate[0]);
+        sim::generator_config config;
+        config.header_length = data::list_mode::header_length::header;
+        config.channels.resize(1);
+        config.channels[0].rate = 10000;
+        CHECK_NOTHROW(module.set_generator(config));
+        CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        CHECK_NOTHROW(module.run_end());
+        /*
+         * A control thread holds the module lock until the reads finish or
+         * it times out. Reads that wait for the lock see it timed out.
+         */
+        std::atomic_bool held(false);
+        std::atomic_bool done(false);
+        std::atomic_bool timedout(false);
+        std::thread control([&module, &held, &done, &timedout] {
+            module::module::guard guard(module);
+            held = true;
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+            while (!done.load()) {
+                if (std::chrono::steady_clock::now() > deadline) {
+                    timedout = true;
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+        while (!held.load()) {
+            std::this_thread::yield();
+        }
+        size_t level = 0;
+        CHECK_NOTHROW(level = module.read_list_mode_level());
+        CHECK(level > 0);
+        xia::buffer::queue::handles buffers;
+        size_t words = 0;
+        CHECK_NOTHROW(words = module.read_list_mode(buffers));
+        done = true;
+        control.join();
+        CHECK_FALSE(timedout.load());
+        CHECK(words == level);
+        buffers.clear();
+    }
+    TEST_CASE("list-mode filter") {
+        using namespace xia::pixie;
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        auto& module = dynamic_cast<sim::module&>(crate[0]);
+        sim::generator_config config;
+        config.header_length = data::list_mode::header_length::header;
+        config.channels.resize(1);
+        config.channels[0].rate = 2000;
+        config.channels[0].trace_length = 20;
+        CHECK_NOTHROW(module.set_generator(config));
+        data::list_mode::reduction policy;
+        policy.channel_mask = 0x3;
+        policy.trace_policy = {data::list_mode::reduction::traces::keep,
+                               data::list_mode::reduction::traces::strip};
+        CHECK_THROWS_AS(module.set_fifo_filter(policy, 1), error::error);
+        CHECK_NOTHROW(module.set_fifo_filter(policy, 34688));
+        CHECK(module.fifo_filtering.load());
+        CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+        CHECK_THROWS_AS(module.set_fifo_filter(policy, 34688), error::error);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        CHECK_NOTHROW(module.run_end());
+        data::list_mode::buffer words;
+        xia::buffer::queue::handles buffers;
+        CHECK_NOTHROW(module.read_list_mode(buffers));
+        for (auto& buf : buffers) {
+            words.insert(words.end(), buf->begin(), buf->end());
+        }
+        buffers.clear();
+        REQUIRE(!words.empty());
+        data::list_mode::records recs;
+        data::list_mode::buffer leftover;
+        CHECK_NOTHROW(data::list_mode::decode_data_block(
+            words, 34688, size_t(module.channels[0].fixture->config.adc_msps), recs, leftover));
+        CHECK(leftover.empty());
+        CHECK(!recs.empty());
+        for (auto& rec : recs) {
+            CHECK(rec.channel_number < 2);
+            CHECK(rec.trace.size() == (rec.channel_number == 0 ? 20 : 0));
+        }
+        CHECK(module.run_stats.filtered.load() > 0);
+        CHECK(module.run_stats.in.load() == words.size());
+        CHECK_NOTHROW(module.set_fifo_filter(data::list_mode::reduction(), 34688));
+        CHECK_FALSE(module.fifo_filtering.load());
+    }
+    TEST_CASE("list-mode validation") {
+        using namespace xia::pixie;
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        auto& module = dynamic_cast<sim::module&>(crate[0]);
+        sim::generator_config config;
+        config.header_length = data::list_mode::header_length::header;
+        config.channels.resize(1);
+        config.channels[0].rate = 2000;
+        config.channels[0].trace_length = 20;
+        CHECK_NOTHROW(module.set_generator(config));
+        CHECK_THROWS_AS(module.set_fifo_validation(true, 1), error::error);
+        CHECK_NOTHROW(module.set_fifo_validation(true, 34688));
+        CHECK(module.fifo_validating.load());
+        CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+        CHECK_THROWS_AS(module.set_fifo_validation(false, 34688), error::error);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        CHECK_NOTHROW(module.run_end());
+        xia::buffer::queue::handles buffers;
+        CHECK_NOTHROW(module.read_list_mode(buffers));
+        buffers.clear();
+        CHECK(module.fifo_validator.counts().events > 0);
+        CHECK(module.fifo_validator.counts().words == module.run_stats.in.load());
+        CHECK(module.run_stats.faults.load() == 0);
+        CHECK_NOTHROW(module.set_fifo_validation(false, 34688));
+        CHECK_FALSE(module.fifo_validating.load());
+    }
+    TEST_CASE("list-mode direct reads") {
+        using namespace xia::pixie;
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        auto& module = dynamic_cast<sim::module&>(crate[0]);
+        sim::generator_config config;
+        config.header_length = data::list_mode::header_length::header;
+        config.channels.resize(1);
+        config.channels[0].rate = 2000;
+        CHECK_NOTHROW(module.set_generator(config));
+        CHECK_NOTHROW(module.set_fifo_direct(true));
+        CHECK(module.fifo_direct.load());
+        CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+        CHECK_THROWS_AS(module.set_fifo_direct(false), error::error);
+        size_t words = 0;
+        xia::buffer::queue::handles buffers;
+        for (int poll = 0; poll < 10; ++poll) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            words += module.read_list_mode(buffers);
+        }
+        CHECK(words > 0);
+        CHECK_NOTHROW(module.run_end());
+        words += module.read_list_mode(buffers);
+        buffers.clear();
+        CHECK(words == module.run_stats.in.load());
+        CHECK(module.run_stats.dropped.load() == 0);
+        CHECK_NOTHROW(module.set_fifo_direct(false));
+    }
+    TEST_CASE("list-mode fan-out") {
+        using namespace xia::pixie;
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        auto& module = dynamic_cast<sim::module&>(crate[0]);
+        sim::generator_config config;
+        config.header_length = data::list_mode::header_length::header;
+        config.channels.resize(1);
+        config.channels[0].rate = 2000;
+        CHECK_NOTHROW(module.set_generator(config));
+        auto tee = module.tee_list_mode();
+        CHECK(tee->max_held == module.fifo_buffers / 2);
+        auto recorder = tee->subscribe();
+        auto monitor = tee->subscribe();
+        auto src = recorder::module_source(module, *tee);
+        CHECK(tee->consumers() == 3);
+        CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        CHECK_NOTHROW(module.run_end());
+        xia::buffer::queue::handles recorded;
+        xia::buffer::queue::handles monitored;
+        xia::buffer::queue::handles sourced;
+        size_t words = recorder->read(recorded);
+        CHECK(words > 0);
+        CHECK(words == module.run_stats.in.load());
+        CHECK(monitor->read(monitored) == words);
+        CHECK(src.read(sourced) == words);
+        CHECK(recorded == monitored);
+        CHECK(recorded == sourced);
+        CHECK(recorder->dropped() == 0);
+        CHECK(tee->held() == 0);
+        recorded.clear();
+        monitored.clear();
+        sourced.clear();
+        src = recorder::source();
+        recorder.reset();
+        monitor.reset();
+        CHECK(tee->consumers() == 0);
+    }
+    TEST_CASE("list-mode capture and replay") {
+        using namespace xia::pixie;
+        const std::string path = "test_fifo_capture.cap";
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        auto& module = dynamic_cast<sim::module&>(crate[0]);
+        sim::generator_config config;
+        config.header_length = data::list_mode::header_length::header;
+        config.channels.resize(1);
+        config.channels[0].rate = 2000;
+        CHECK_NOTHROW(module.set_generator(config));
+        CHECK_THROWS_AS(module.start_fifo_capture("no-such-dir/capture.cap"), error::error);
+        CHECK_FALSE(module.fifo_capturing.load());
+        CHECK_NOTHROW(module.start_fifo_capture(path));
+        CHECK(module.fifo_capturing.load());
+        CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        CHECK_NOTHROW(module.run_end());
+        CHECK_NOTHROW(module.stop_fifo_capture());
+        CHECK_FALSE(module.fifo_capturing.load());
+
+        auto read_words = [&module]() {
+            data::list_mode::buffer words;
+            xia::buffer::queue::handles buffers;
+            module.read_list_mode(buffers);
+            for (auto& buf : buffers) {
+                words.insert(words.end(), buf->begin(), buf->end());
+            }
+            return words;
+        };
+        auto captured = read_words();
+        REQUIRE(!captured.empty());
+
+        capture::reader reader;
+        CHECK_THROWS_AS(reader.open("no-such-capture.cap"), error::error);
+        CHECK_NOTHROW(reader.open(path));
+        CHECK(reader.hdr.slot == uint32_t(module.slot));
+        CHECK(reader.hdr.adc_msps ==
+              uint32_t(module.channels[0].fixture->config.adc_msps));
+        data::list_mode::buffer words;
+        size_t chunks = 0;
+        uint64_t last_usecs = 0;
+        bool ordered = true;
+        capture::chunk chk;
+        while (reader.next(chk)) {
+            ordered = ordered && chk.usecs >= last_usecs;
+            last_usecs = chk.usecs;
+            words.insert(words.end(), chk.words.begin(), chk.words.end());
+            ++chunks;
+        }
+        CHECK(ordered);
+        CHECK(chunks == module.fifo_capture.chunks);
+        CHECK(words == captured);
+
+        CHECK_NOTHROW(module.set_generator(sim::generator_config()));
+        CHECK_THROWS_AS(module.set_replay("no-such-capture.cap", false), error::error);
+        CHECK_NOTHROW(module.set_replay(path, false));
+        CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+        for (int wait = 0; wait < 100 && module.replayer.running(); ++wait) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        CHECK_NOTHROW(module.run_end());
+        CHECK(module.replayer.chunks.load() == chunks);
+        CHECK(read_words() == captured);
+        CHECK_NOTHROW(module.clear_replay());
+        CHECK_FALSE(module.replayer.enabled());
+        std::remove(path.c_str());
+    }
+    TEST_CASE("awaitable readout") {
+        using namespace xia::pixie;
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        auto& module = dynamic_cast<sim::module&>(crate[0]);
+        sim::generator_config config;
+        config.header_length = data::list_mode::header_length::header;
+        config.channels.resize(1);
+        config.channels[0].rate = 2000;
+        CHECK_NOTHROW(module.set_generator(config));
+
+        await::inline_executor exec;
+        await::reactor reactor(exec, 500);
+        std::promise<std::pair<error::code, size_t>> buffers_done;
+        reactor.next_buffers(module, [&buffers_done](error::code code,
+                                                     xia::buffer::queue::handles& buffers) {
+            buffers_done.set_value(std::make_pair(code, buffers.size()));
+        });
+        CHECK(reactor.pending() == 0);
+        auto cancelled = buffers_done.get_future();
+        REQUIRE(cancelled.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+        CHECK(cancelled.get().first == error::code::module_task_cancelled);
+
+        reactor.start();
+        CHECK(reactor.running());
+        CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+        std::promise<std::pair<error::code, size_t>> read;
+        reactor.next_buffers(module, [&read](error::code code,
+                                             xia::buffer::queue::handles& buffers) {
+            read.set_value(std::make_pair(code, buffers.size()));
+        });
+        auto readout = read.get_future();
+        REQUIRE(readout.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+        auto result = readout.get();
+        CHECK(result.first == error::code::success);
+        CHECK(result.second > 0);
+
+        std::promise<error::code> timeout;
+        reactor.next_buffers(
+            module,
+            [&timeout](error::code code, xia::buffer::queue::handles&) {
+                timeout.set_value(code);
+            },
+            0, 1);
+        std::promise<error::code> ended;
+        reactor.run_done(module, [&ended](error::code code) { ended.set_value(code); });
+        auto run = ended.get_future();
+        CHECK(run.wait_for(std::chrono::milliseconds(20)) == std::future_status::timeout);
+        CHECK_NOTHROW(module.run_end());
+        REQUIRE(run.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+        CHECK(run.get() == error::code::success);
+        auto timed_out = timeout.get_future();
+        REQUIRE(timed_out.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+
+        std::promise<error::code> op_done;
+        reactor.operation_done(
+            crate.run_modules_async("fail", {1},
+                                    [](module::module&) {
+                                        throw error::error(error::code::invalid_value, "failed");
+                                    }),
+            [&op_done](error::code code) { op_done.set_value(code); });
+        auto op = op_done.get_future();
+        REQUIRE(op.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+        CHECK(op.get() == error::code::invalid_value);
+
+        std::promise<error::code> stopped;
+        reactor.run_done(module, [](error::code) {});
+        reactor.next_buffers(module, [&stopped](error::code code, xia::buffer::queue::handles&) {
+            stopped.set_value(code);
+        });
+        reactor.stop();
+        CHECK_FALSE(reactor.running());
+        CHECK(reactor.pending() == 0);
+        CHECK(stopped.get_future().wait_for(std::chrono::seconds(0)) ==
+              std::future_status::ready);
+    }
+    TEST_CASE("crate list-mode run") {
+        using namespace xia::pixie;
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        for (auto& mod : crate.modules) {
+            auto& module = dynamic_cast<sim::module&>(*mod);
+            sim::generator_config config;
+            config.header_length = data::list_mode::header_length::header;
+            config.channels.resize(1);
+            config.channels[0].rate = 1000;
+            CHECK_NOTHROW(module.set_generator(config));
+        }
+        SUBCASE("Start and end") {
+            crate::crate::run_start start;
+            CHECK_NOTHROW(crate.start_listmode(hw::run::run_mode::new_run, start));
+            CHECK(start.enable_usecs.size() == crate.num_modules);
+            bool running = true;
+            for (auto& mod : crate.modules) {
+                running = running && mod->run_task.load() == hw::run::run_task::list_mode;
+                CHECK(start.enable_usecs[size_t(mod->number)] <= start.skew_usecs);
+            }
+            CHECK(running);
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            CHECK_NOTHROW(crate.end_run());
+            for (auto& mod : crate.modules) {
+                auto& module = dynamic_cast<sim::module&>(*mod);
+                CHECK(module.run_task.load() == hw::run::run_task::nop);
+                CHECK(module.gen.events.load() > 0);
+                xia::buffer::queue::handles buffers;
+                CHECK(module.read_list_mode(buffers) > 0);
+            }
+        }
+        SUBCASE("Timed") {
+            crate::crate::timed_run run;
+            CHECK_THROWS_WITH_AS(crate.run_listmode_for(hw::run::run_mode::new_run, run),
+                                 "crate: timed list-mode: invalid run time", error::error);
+            run.seconds = 0.2;
+            auto start = std::chrono::steady_clock::now();
+            CHECK_NOTHROW(crate.run_listmode_for(hw::run::run_mode::new_run, run));
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            CHECK(elapsed >= std::chrono::milliseconds(200));
+            CHECK_FALSE(run.preset_ended);
+            CHECK_FALSE(run.counter_timed);
+            CHECK(run.host_secs.size() == crate.num_modules);
+            CHECK(run.end_usecs.size() == crate.num_modules);
+            CHECK(run.run_secs.size() == crate.num_modules);
+            for (auto& mod : crate.modules) {
+                auto& module = dynamic_cast<sim::module&>(*mod);
+                CHECK(run.host_secs[size_t(module.number)] >= 0.2);
+                CHECK(run.host_secs[size_t(module.number)] < 5);
+                CHECK(module.run_task.load() == hw::run::run_task::nop);
+                xia::buffer::queue::handles buffers;
+                CHECK(module.read_list_mode(buffers) > 0);
+            }
+        }
+        SUBCASE("Timed preset") {
+            crate::crate::timed_run run;
+            run.seconds = 0.1;
+            run.preset = true;
+            run.preset_grace_msecs = 50;
+            CHECK_NOTHROW(crate.run_listmode_for(hw::run::run_mode::new_run, run));
+            /*
+             * The simulation does not end the run at the preset.
+             */
+            CHECK_FALSE(run.preset_ended);
+            for (auto& mod : crate.modules) {
+                CHECK(xia::util::ieee_float(mod->read(param::module_param::host_rt_preset)) ==
+                      0.1);
+                CHECK(mod->run_task.load() == hw::run::run_task::nop);
+                CHECK(run.host_secs[size_t(mod->number)] >= 0.15);
+            }
+        }
+        SUBCASE("Prepare error") {
+            CHECK_NOTHROW(crate[1].start_listmode(hw::run::run_mode::new_run));
+            CHECK_THROWS_AS(crate.start_listmode(hw::run::run_mode::new_run), error::error);
+            CHECK(crate[0].run_task.load() == hw::run::run_task::nop);
+            CHECK(crate[1].run_task.load() == hw::run::run_task::list_mode);
+            CHECK(crate[2].run_task.load() == hw::run::run_task::nop);
+            CHECK_NOTHROW(crate[1].run_end());
+        }
+        SUBCASE("Enable without a prepare") {
+            CHECK_THROWS_WITH_AS(crate[0].enable_run(), "module: num=0,slot=2: no run task prepared",
+                                 error::error);
+        }
+    }
+#if !defined(_WIN64) && !defined(_WIN32)
+    TEST_CASE("cluster run") {
+        using namespace xia::pixie;
+        sim::crate crates[2];
+        std::unique_ptr<cluster::node> nodes[2];
+        cluster::crate_addresses addresses;
+        for (size_t c = 0; c < 2; ++c) {
+            CHECK_NOTHROW(crates[c].initialize());
+            CHECK_NOTHROW(crates[c].probe());
+            for (auto& mod : crates[c].modules) {
+                auto& module = dynamic_cast<sim::module&>(*mod);
+                sim::generator_config config;
+                config.header_length = data::list_mode::header_length::header;
+                config.channels.resize(1);
+                config.channels[0].rate = 1000;
+                CHECK_NOTHROW(module.set_generator(config));
+            }
+            cluster::node_config cfg;
+            cfg.crate_id = c + 1;
+            cfg.director = c == 0;
+            cfg.fw_revision = 34688;
+            cfg.address = "127.0.0.1";
+            cfg.data.address = "127.0.0.1";
+            cfg.data.poll_msecs = 5;
+            REQUIRE_NOTHROW(nodes[c].reset(new cluster::node(crates[c], cfg)));
+            CHECK_NOTHROW(nodes[c]->start());
+            addresses.emplace_back("127.0.0.1", nodes[c]->control_port(),
+                                   data::list_mode::record::time_type(c * 1.0));
+        }
+        cluster::controller controller(addresses);
+        REQUIRE_NOTHROW(controller.connect());
+        REQUIRE(controller.crates().size() == 2);
+        CHECK(controller.crates()[0].director);
+        CHECK(controller.crates()[1].first_stream == test_modules);
+        CHECK(controller.streams() == 2 * test_modules);
+        CHECK_THROWS_AS(controller.set_reorder(data::list_mode::record::time_type(-1)),
+                        error::error);
+        CHECK_NOTHROW(controller.set_reorder(data::list_mode::record::time_type(1e-3)));
+        CHECK_NOTHROW(controller.start_run(hw::run::run_mode::new_run));
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        CHECK_NOTHROW(controller.end_run());
+        data::list_mode::merger merger(controller.streams(),
+                                       data::list_mode::record::time_type(0));
+        size_t events = 0;
+        for (int r = 0; r < 500 && !controller.complete(); ++r) {
+            events += controller.read(merger);
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        CHECK(controller.complete());
+        CHECK(controller.late_events() == 0);
+        size_t generated = 0;
+        for (size_t c = 0; c < 2; ++c) {
+            for (auto& mod : crates[c].modules) {
+                auto& module = dynamic_cast<sim::module&>(*mod);
+                generated += module.gen.events.load() - module.gen.lost.load();
+            }
+        }
+        CHECK(events == generated);
+        data::list_mode::records group;
+        size_t merged = 0;
+        bool ordered = true;
+        bool crate_ids = true;
+        data::list_mode::record::time_type last(0);
+        while (merger.next(group)) {
+            for (auto& rec : group) {
+                ordered = ordered && rec.time >= last;
+                last = rec.time;
+                crate_ids = crate_ids && (rec.crate_id == 1 || rec.crate_id == 2);
+                /*
+                 * The second crate's events are offset by a second.
+                 */
+                crate_ids = crate_ids && (rec.crate_id == 1 || rec.time.count() >= 1.0);
+                ++merged;
+            }
+        }
+        CHECK(merged == events);
+        CHECK(ordered);
+        CHECK(crate_ids);
+        CHECK_NOTHROW(controller.disconnect());
+        for (auto& node : nodes) {
+            CHECK_NOTHROW(node->stop());
+        }
+    }
+#endif
+    TEST_CASE("crate stats snapshots") {
+        using namespace xia::pixie;
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        stats::snapshot snap;
+        stats::snapshots ring(4);
+        CHECK_THROWS_AS(crate.read_stats({crate.num_modules}, snap), error::error);
+        for (size_t s = 0; s < 6; ++s) {
+            CHECK_NOTHROW(crate.read_stats({}, snap));
+            ring.push(snap);
+        }
+        CHECK(snap.sequence == 6);
+        CHECK(snap.numbers.size() == crate.num_modules);
+        CHECK(snap.modules.size() == crate.num_modules);
+        CHECK(snap.skew < std::chrono::milliseconds(100));
+        CHECK(ring.size() == 4);
+        CHECK(ring.at(0).sequence == 6);
+        CHECK(ring.at(3).sequence == 3);
+        CHECK(ring.at(0).elapsed(ring.at(3)) >= 0);
+        stats::intervals rates;
+        CHECK_NOTHROW(ring.rates(rates, 3));
+        CHECK(rates.size() == crate.num_modules);
+        CHECK(rates[0].chans.size() == crate[0].num_channels);
+        CHECK_THROWS_AS(ring.rates(rates, 4), error::error);
+        CHECK_NOTHROW(crate.read_stats({0}, snap));
+        ring.push(snap);
+        CHECK_THROWS_AS(ring.rates(rates), error::error);
+    }
+    TEST_CASE("metrics") {
+        using namespace xia::pixie;
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        metrics::config cfg;
+        CHECK(cfg.port == -1);
+        SUBCASE("Text") {
+            metrics::exporter exporter(crate, cfg);
+            CHECK(exporter.port() == -1);
+            CHECK(exporter.serve() == 0);
+            CHECK(exporter.poll_stats() == test_modules);
+            auto text = exporter.text();
+            CHECK(text.find("# TYPE pixie_fifo_in_words counter\n") != std::string::npos);
+            CHECK(text.find("pixie_module_online{module=\"0\",slot=\"2\"} 1\n") !=
+                  std::string::npos);
+            CHECK(text.find("pixie_fifo_in_words_total{module=\"2\",slot=\"10\"} 0\n") !=
+                  std::string::npos);
+            CHECK(text.find("pixie_module_stats_reads_total{module=\"1\",slot=\"6\"} 1\n") !=
+                  std::string::npos);
+            CHECK(text.find("pixie_channel_live_time_seconds{module=\"2\",slot=\"10\","
+                            "channel=\"31\"}") != std::string::npos);
+            CHECK(text.size() > 6);
+            CHECK(text.compare(text.size() - 6, 6, "# EOF\n") == 0);
+        }
+#if !defined(_WIN64) && !defined(_WIN32)
+        SUBCASE("Endpoint") {
+            cfg.port = 0;
+            cfg.address = "127.0.0.1";
+            cfg.stats_period_msecs = 10;
+            metrics::exporter exporter(crate, cfg);
+            REQUIRE(exporter.port() > 0);
+            CHECK_NOTHROW(exporter.start());
+            auto get = [&exporter](const std::string& path) {
+                const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+                sockaddr_in addr = {};
+                addr.sin_family = AF_INET;
+                addr.sin_port = htons(static_cast<uint16_t>(exporter.port()));
+                addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+                std::string response;
+                if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+                    const std::string request = "GET " + path + " HTTP/1.1\r\n\r\n";
+                    ::send(fd, request.data(), request.size(), 0);
+                    char buf[4096];
+                    ssize_t got;
+                    while ((got = ::recv(fd, buf, sizeof(buf), 0)) > 0) {
+                        response.append(buf, size_t(got));
+                    }
+                }
+                ::close(fd);
+                return response;
+            };
+            auto response = get("/metrics");
+            CHECK(response.compare(0, 15, "HTTP/1.1 200 OK") == 0);
+            CHECK(response.find("application/openmetrics-text") != std::string::npos);
+            CHECK(response.find("pixie_channel_input_count_rate{") != std::string::npos);
+            response = get("/other");
+            CHECK(response.compare(0, 22, "HTTP/1.1 404 Not Found") == 0);
+            CHECK_NOTHROW(exporter.stop());
+        }
+#endif
+    }
+#if !defined(_WIN64) && !defined(_WIN32)
+    TEST_CASE("crate server") {
+        using namespace xia::pixie;
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        ipc::config cfg;
+        cfg.socket = "/tmp/pixie-sdk-test-ipc.sock";
+        cfg.ring_name = "/pixie-sdk-test-ipc";
+        cfg.poll_msecs = 1;
+        ipc::server srv(crate, cfg);
+        CHECK_THROWS_AS(ipc::server(crate, cfg), error::error);
+        CHECK_NOTHROW(srv.start());
+        SUBCASE("Control") {
+            ipc::client cl(cfg.socket);
+            CHECK(cl.ring_name == cfg.ring_name);
+            REQUIRE(cl.modules.size() == test_modules);
+            CHECK(cl.modules[1].number == 1);
+            CHECK(cl.modules[1].slot == crate[1].slot);
+            CHECK(cl.modules[1].num_channels == int(crate[1].num_channels));
+            CHECK(cl.modules[1].online == 1);
+            CHECK_NOTHROW(cl.write(0, "TrigConfig0", 0x12));
+            CHECK(cl.read(0, "TrigConfig0") == 0x12);
+            CHECK_NOTHROW(cl.write(0, "CHANNEL_CSRA", 0x44, 1));
+            CHECK(cl.read(0, "CHANNEL_CSRA", 1) == 0x44);
+            CHECK_THROWS_AS(cl.read(0, "NOT_A_PARAM"), error::error);
+            CHECK_THROWS_AS(cl.read(99, "TrigConfig0"), error::error);
+            CHECK_THROWS_AS(cl.run_active(-1), error::error);
+            CHECK(!cl.run_active(0));
+            CHECK_NOTHROW(cl.start_histograms(0));
+            CHECK(crate[0].run_task.load() == hw::run::run_task::histogram);
+            CHECK_NOTHROW(cl.end_run(0));
+            CHECK(crate[0].run_task.load() == hw::run::run_task::nop);
+            hw::words values(16);
+            CHECK_NOTHROW(cl.read_histogram(0, 3, values));
+            CHECK(values.size() == 16);
+            CHECK_THROWS_AS(cl.read_histogram(0, -1, values), error::error);
+            hw::words oversized(crate[0].channels[3].fixture->config.max_histogram_length + 1);
+            CHECK_THROWS_AS(cl.read_histogram(0, 3, oversized), error::error);
+            CHECK(srv.requests() == 14);
+            CHECK(srv.errors() == 5);
+        }
+        SUBCASE("List-mode data") {
+            auto& module = dynamic_cast<sim::module&>(crate[0]);
+            sim::generator_config gen;
+            gen.header_length = data::list_mode::header_length::header;
+            gen.channels.resize(1);
+            gen.channels[0].rate = 2000;
+            CHECK_NOTHROW(module.set_generator(gen));
+            {
+                ipc::client cl(cfg.socket);
+                auto sub = cl.subscribe();
+                REQUIRE(sub);
+                CHECK_NOTHROW(cl.start_listmode(0));
+                CHECK(module.run_task.load() == hw::run::run_task::list_mode);
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                CHECK_NOTHROW(cl.end_run(0));
+                size_t words = 0;
+                xia::buffer::shm::block_view view;
+                while (sub->read(view, 100 * 1000)) {
+                    CHECK(view.source == 0);
+                    words += view.words;
+                    CHECK(sub->release(view));
+                    if (words == module.run_stats.in.load()) {
+                        break;
+                    }
+                }
+                CHECK(words > 0);
+                CHECK(words == module.run_stats.in.load());
+                CHECK(srv.published() == words);
+            }
+            /*
+             * A new client of the resident crate.
+             */
+            ipc::client cl(cfg.socket);
+            CHECK(cl.modules.size() == test_modules);
+            CHECK(!cl.run_active(0));
+        }
+        CHECK_NOTHROW(srv.stop());
+    }
+#endif
     TEST_CASE("backplane") {
         using namespace xia::pixie;
         using namespace xia::pixie::param;
@@ -305,3 +2163,86 @@ TEST_SUITE("Crate: modules") {
         xia::logging::stop("log");
     }
 }
+
+TEST_SUITE("xia::pixie::baseline") {
+    TEST_CASE("channel") {
+        using namespace xia::pixie;
+        baseline::channel bl(5, 1);
+        bl.start(3, 10);
+        CHECK(bl.bins.size() == 1024);
+        hw::adc_trace trace;
+        for (size_t s = 0; s < 1003; ++s) {
+            trace.push_back(hw::adc_word(500 + (s % 3)));
+        }
+        trace.push_back(hw::adc_word(5000));
+        bl.update(trace);
+        bl.update(trace);
+        CHECK(bl.runs == 2);
+        CHECK(bl.bins[500] == 2 * 335);
+        CHECK(bl.bins[501] == 2 * 334);
+        CHECK(bl.bins[502] == 2 * 334);
+        CHECK(bl.bins[1023] == 2);
+        bl.end();
+        CHECK(bl.baseline == 500);
+        CHECK(bl == 501);
+        CHECK(bl != 600);
+    }
+}
+
+TEST_SUITE("xia::pixie::channel") {
+    TEST_CASE("baseline cut") {
+        using baseline = xia::pixie::channel::baseline;
+        baseline::values vals;
+        for (auto& val : vals) {
+            val = baseline::value(0, 1000);
+        }
+        CHECK(baseline::compute_cut(vals, baseline::max_num) == 0);
+        /*
+         * Alternate the baselines by 2 with a few pulses. The median
+         * difference is 2 and the pulses do not move the cut.
+         */
+        for (size_t bl = 0; bl < vals.size(); ++bl) {
+            vals[bl].second = 1000 + ((bl % 2) * 2);
+        }
+        const auto cut = baseline::compute_cut(vals, baseline::max_num);
+        CHECK(cut == xia::pixie::param::value_type(std::floor(8 * 2 / 0.6745)));
+        for (size_t bl = 100; bl < vals.size(); bl += 200) {
+            vals[bl].second = 5000;
+        }
+        CHECK(baseline::compute_cut(vals, baseline::max_num) == cut);
+        CHECK(baseline::compute_cut(vals, 1) == 0);
+    }
+}
+
+TEST_SUITE("xia::pixie::hw") {
+    TEST_CASE("task latency") {
+        using namespace xia::pixie::hw::run;
+        latencies tasks;
+        CHECK(tasks.expected_usecs(control_task::program_fippi) == 500);
+        CHECK(tasks.expected_usecs(control_task::nop) == 0);
+        tasks.record(control_task::program_fippi, 200, 3);
+        tasks.record(control_task::program_fippi, 600, 5);
+        auto latency = tasks.get(control_task::program_fippi);
+        CHECK(latency.count == 2);
+        CHECK(latency.min_usecs == 200);
+        CHECK(latency.max_usecs == 600);
+        CHECK(latency.total_usecs == 800);
+        CHECK(latency.last_polls == 5);
+        CHECK(latency.expected_usecs == 300);
+        latencies copy(tasks);
+        CHECK(copy.get(control_task::program_fippi).count == 2);
+        tasks.clear();
+        CHECK(tasks.get(control_task::program_fippi).count == 0);
+        CHECK(tasks.expected_usecs(control_task::program_fippi) == 500);
+    }
+    TEST_CASE("wait") {
+        using clock = std::chrono::steady_clock;
+        for (size_t period : {0, 10, 150, 2000}) {
+            auto start = clock::now();
+            xia::pixie::hw::wait(period);
+            auto waited =
+                std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - start);
+            CHECK(size_t(waited.count()) >= period);
+        }
+    }
+}
@@ -0,0 +1,177 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2022 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file test_pixie16_pipeline.cpp
+ * @brief Provides test coverage for the list-mode decode pipeline.
+ */
+
+#include <algorithm>
+#include <mutex>
+#include <random>
+#include <vector>
+
+#include <doctest/doctest.h>
+
+#include <pixie/error.hpp>
+
+#include <pixie/pixie16/pipeline.hpp>
+
+namespace list_mode = xia::pixie::data::list_mode;
+namespace pipeline = xia::pixie::pipeline;
+namespace recorder = xia::pixie::recorder;
+namespace hw = xia::pixie::hw;
+
+/*
+ * Events with a 4 word header and a trace. The time advances by 100 ticks
+ * each event and the energy is the event's number.
+ */
+static hw::words make_events(size_t events, size_t trace_words) {
+    hw::words data;
+    uint64_t time = 1000;
+    for (size_t e = 0; e < events; ++e) {
+        const size_t length = 4 + trace_words;
+        data.push_back(hw::word(e % 16) | (2 << 4) | (4 << 12) | (hw::word(length) << 17));
+        data.push_back(hw::word(time));
+        data.push_back(hw::word(time >> 32));
+        data.push_back(hw::word(e % 30000) | (hw::word(trace_words * 2) << 16));
+        for (size_t w = 0; w < trace_words; ++w) {
+            data.push_back(400 | (401 << 16));
+        }
+        time += 100;
+    }
+    return data;
+}
+
+/*
+ * A source that returns the data in reads of random sizes that split
+ * events.
+ */
+struct split_source {
+    xia::buffer::pool& pool;
+    const hw::words& data;
+    size_t pos;
+    std::mt19937 random;
+
+    split_source(xia::buffer::pool& pool_, const hw::words& data_, unsigned int seed)
+        : pool(pool_), data(data_), pos(0), random(seed) {}
+
+    recorder::source make(int number) {
+        recorder::source src;
+        src.number = number;
+        src.revision = 34688;
+        src.adc_msps = 250;
+        src.read = [this](xia::buffer::queue::handles& buffers) -> size_t {
+            std::uniform_int_distribution<size_t> size(1, 3000);
+            const size_t words = std::min(size(random), data.size() - pos);
+            if (words == 0) {
+                return 0;
+            }
+            auto buf = pool.request();
+            buf->assign(data.begin() + pos, data.begin() + pos + words);
+            buffers.push_back(buf);
+            pos += words;
+            return words;
+        };
+        return src;
+    }
+};
+
+TEST_SUITE("xia::pixie::pipeline") {
+    TEST_CASE("config") {
+        xia::buffer::pool pool;
+        pool.create(10, 4096);
+        hw::words data = make_events(10, 8);
+        split_source source(pool, data, 1);
+        recorder::sources sources;
+        CHECK_THROWS_AS(pipeline::pipeline(sources, pipeline::config(), [](pipeline::batch&) {}),
+                        xia::pixie::error::error);
+        sources.push_back(source.make(0));
+        CHECK_THROWS_AS(pipeline::pipeline(sources, pipeline::config(), nullptr),
+                        xia::pixie::error::error);
+        pipeline::config cfg;
+        cfg.chunk_words = 0;
+        CHECK_THROWS_AS(pipeline::pipeline(sources, cfg, [](pipeline::batch&) {}),
+                        xia::pixie::error::error);
+    }
+    TEST_CASE("decode in order") {
+        xia::buffer::pool pool;
+        pool.create(200, 4096);
+        const size_t events = 20000;
+        hw::words data = make_events(events, 8);
+        std::vector<std::unique_ptr<split_source>> tests;
+        recorder::sources sources;
+        for (int m = 0; m < 3; ++m) {
+            tests.emplace_back(new split_source(pool, data, unsigned(m + 1)));
+            sources.push_back(tests.back()->make(m));
+        }
+        std::mutex lock;
+        std::vector<std::vector<uint64_t>> times(sources.size());
+        std::vector<size_t> sequences(sources.size(), 0);
+        bool in_order = true;
+        pipeline::config cfg;
+        cfg.workers = 4;
+        cfg.chunk_words = 2000;
+        cfg.max_chunks = 8;
+        cfg.poll_msecs = 1;
+        cfg.fields = list_mode::scan_header;
+        pipeline::pipeline pipe(sources, cfg, [&](pipeline::batch& b) {
+            std::lock_guard<std::mutex> guard(lock);
+            auto& module_times = times[size_t(b.number)];
+            in_order = in_order && b.sequence >= sequences[size_t(b.number)];
+            sequences[size_t(b.number)] = b.sequence;
+            for (size_t e = 0; e < b.events.size(); ++e) {
+                module_times.push_back(b.events.timestamp[e]);
+            }
+        });
+        pipe.start();
+        CHECK(pipe.running());
+        CHECK_THROWS_AS(pipe.start(), xia::pixie::error::error);
+        pipe.stop();
+        CHECK_FALSE(pipe.running());
+        CHECK(in_order);
+        CHECK(pipe.errors() == 0);
+        CHECK(pipe.leftovers() == 0);
+        CHECK(pipe.words() == data.size() * sources.size());
+        CHECK(pipe.decoded_words() == pipe.words());
+        CHECK(pipe.events() == events * sources.size());
+        for (auto& module_times : times) {
+            REQUIRE(module_times.size() == events);
+            bool ordered = true;
+            for (size_t e = 0; e < events; ++e) {
+                ordered = ordered && module_times[e] == 1000 + 100 * e;
+            }
+            CHECK(ordered);
+        }
+    }
+    TEST_CASE("partial event") {
+        xia::buffer::pool pool;
+        pool.create(20, 4096);
+        hw::words data = make_events(100, 8);
+        data.resize(data.size() - 5);
+        split_source source(pool, data, 7);
+        size_t consumed = 0;
+        pipeline::pipeline pipe({source.make(0)}, pipeline::config(),
+                                [&consumed](pipeline::batch& b) { consumed += b.events.size(); });
+        while (pipe.poll() != 0) {
+        }
+        pipe.flush();
+        CHECK(consumed == 99);
+        CHECK(pipe.leftovers() == 12 - 5);
+        CHECK(pipe.batches() >= 1);
+    }
+}
@@ -0,0 +1,547 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2022 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file test_pixie16_recorder.cpp
+ * @brief Provides test coverage for the list-mode recorder.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <thread>
+
+#include <doctest/doctest.h>
+
+#include <nolhmann/json.hpp>
+
+#include <pixie/error.hpp>
+
+#include <pixie/pixie16/lmc.hpp>
+#include <pixie/pixie16/recorder.hpp>
+#include <pixie/pixie16/server.hpp>
+
+#if !defined(_WIN64) && !defined(_WIN32)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace lmc = xia::pixie::lmc;
+namespace recorder = xia::pixie::recorder;
+namespace server = xia::pixie::server;
+namespace hw = xia::pixie::hw;
+
+/*
+ * A source that queues a buffer of words each read. Buffers returned are
+ * read first.
+ */
+struct test_source {
+    xia::buffer::pool& pool;
+    hw::word value;
+    size_t words;
+    size_t reads;
+    xia::buffer::queue returned;
+
+    test_source(xia::buffer::pool& pool_, hw::word value_, size_t words_, size_t reads_)
+        : pool(pool_), value(value_), words(words_), reads(reads_) {}
+
+    recorder::source make(int number) {
+        recorder::source src;
+        src.number = number;
+        src.serial_num = 1000 + number;
+        src.read = [this](xia::buffer::queue::handles& buffers) -> size_t {
+            if (!returned.empty()) {
+                return returned.pop(buffers);
+            }
+            if (reads == 0) {
+                return 0;
+            }
+            --reads;
+            auto buf = pool.request();
+            buf->resize(words, value);
+            buffers.push_back(buf);
+            return words;
+        };
+        src.requeue = [this](xia::buffer::queue::handles& buffers) { returned.requeue(buffers); };
+        return src;
+    }
+};
+
+/*
+ * Events with a 4 word header and a noisy trace of samples around a
+ * baseline. The time advances by 100 ticks each event.
+ */
+static hw::words make_events(size_t events, size_t trace_words, uint64_t time = 1000) {
+    std::mt19937 random(4321);
+    std::uniform_int_distribution<hw::word> noise(0, 15);
+    hw::words data;
+    for (size_t e = 0; e < events; ++e) {
+        const size_t length = 4 + trace_words;
+        data.push_back(hw::word(e % 16) | (2 << 4) | (4 << 12) | (hw::word(length) << 17));
+        data.push_back(hw::word(time));
+        data.push_back(hw::word(time >> 32) | (hw::word(e) << 16));
+        data.push_back(hw::word(1000 + e) | (hw::word(trace_words * 2) << 16));
+        for (size_t w = 0; w < trace_words; ++w) {
+            data.push_back((400 + noise(random)) | ((400 + noise(random)) << 16));
+        }
+        time += 100;
+    }
+    return data;
+}
+
+static void write_container(const std::string& name, const hw::words& data, size_t block_words,
+                            bool finish, int revision = 34688) {
+    std::ofstream out(name, std::ios::binary);
+    lmc::writer writer(
+        [&out](const void* d, size_t size) {
+            out.write(static_cast<const char*>(d), std::streamsize(size));
+        },
+        {{2, revision, 250}}, "{\"modules\": [{\"number\": 2, \"adc-msps\": 250}]}",
+        block_words);
+    /*
+     * Add the data in pieces that split events.
+     */
+    for (size_t pos = 0; pos < data.size(); pos += 777) {
+        writer.add(2, data.data() + pos, std::min(size_t(777), data.size() - pos));
+    }
+    if (finish) {
+        writer.finish();
+    } else {
+        writer.flush();
+    }
+}
+
+static hw::words read_container(lmc::reader& reader, size_t first = 0) {
+    hw::words data;
+    hw::words block;
+    for (size_t b = first; b < reader.index().size(); ++b) {
+        reader.read(b, block);
+        data.insert(data.end(), block.begin(), block.end());
+    }
+    return data;
+}
+
+static std::string read_file(const std::string& name) {
+    std::ifstream in(name, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static nlohmann::json header(const std::string& contents) {
+    return nlohmann::json::parse(std::string(contents.c_str()));
+}
+
+static const hw::word* data(const std::string& contents) {
+    return reinterpret_cast<const hw::word*>(contents.data() + recorder::header_size);
+}
+
+TEST_SUITE("xia::pixie::lmc") {
+    TEST_CASE("Container") {
+        const std::string name = "test_container.lmc";
+        auto data = make_events(1000, 100);
+        SUBCASE("Round trip") {
+            write_container(name, data, 10000, true);
+            lmc::reader reader(name);
+            CHECK(reader.indexed());
+            REQUIRE(reader.modules().size() == 1);
+            CHECK(reader.modules()[0].tick_period() == 8e-9);
+            REQUIRE(reader.index().size() > 5);
+            CHECK(read_container(reader) == data);
+            size_t events = 0;
+            for (auto& blk : reader.index()) {
+                CHECK((blk.flags & lmc::block::raw) == 0);
+                CHECK(blk.channels == 0xffff);
+                events += blk.events;
+            }
+            CHECK(events == 1000);
+            /*
+             * The 4 bit noise packs in 5 bits a sample.
+             */
+            CHECK(read_file(name).size() < data.size() * sizeof(hw::word) / 2);
+            for (size_t e : {size_t(0), size_t(333), size_t(999)}) {
+                const uint64_t ticks = 1000 + e * 100;
+                auto b = reader.find_ticks(ticks);
+                REQUIRE(b < reader.index().size());
+                auto& blk = reader.index()[b];
+                CHECK(blk.first_time <= ticks);
+                CHECK(blk.last_time >= ticks);
+                CHECK(reader.find(double(ticks) * 8e-9) == b);
+            }
+            CHECK(reader.find_ticks(1000 + 1000 * 100) == reader.index().size());
+            CHECK(reader.find_ticks(0, 3) == reader.index().size());
+        }
+        SUBCASE("Narrow event length") {
+            write_container(name, data, 5000, true, 17562);
+            lmc::reader reader(name);
+            CHECK((reader.index()[0].flags & lmc::block::narrow_length) != 0);
+            CHECK(read_container(reader) == data);
+        }
+        SUBCASE("Partial event") {
+            data.resize(data.size() - 10);
+            write_container(name, data, 10000, true);
+            lmc::reader reader(name);
+            CHECK((reader.index().back().flags & lmc::block::raw) != 0);
+            CHECK(reader.index().back().words == 94);
+            CHECK(read_container(reader) == data);
+        }
+        SUBCASE("Corrupt data") {
+            data[104 * 10] = 0;
+            write_container(name, data, 1000000, true);
+            lmc::reader reader(name);
+            REQUIRE(reader.index().size() == 2);
+            CHECK(reader.index()[0].events == 10);
+            CHECK((reader.index()[1].flags & lmc::block::raw) != 0);
+            CHECK(read_container(reader) == data);
+        }
+        SUBCASE("No index") {
+            write_container(name, data, 10000, false);
+            lmc::reader reader(name);
+            CHECK_FALSE(reader.indexed());
+            CHECK(read_container(reader) == data);
+        }
+        SUBCASE("CRC") {
+            write_container(name, data, 10000, true);
+            {
+                std::fstream file(name, std::ios::binary | std::ios::in | std::ios::out);
+                file.seekp(200);
+                file.put('\xff');
+            }
+            lmc::reader reader(name);
+            hw::words block;
+            CHECK_THROWS_AS(reader.read(0, block), xia::pixie::error::error);
+        }
+        std::remove(name.c_str());
+        CHECK_THROWS_AS(lmc::reader("test_container_missing.lmc"), xia::pixie::error::error);
+    }
+}
+
+TEST_SUITE("xia::pixie::recorder") {
+    TEST_CASE("Config") {
+        recorder::config cfg;
+        CHECK_THROWS_WITH_AS(recorder::recorder({}, cfg), "recorder: no path",
+                             xia::pixie::error::error);
+        cfg.path = "test_recorder";
+        CHECK_THROWS_WITH_AS(recorder::recorder({}, cfg), "recorder: no sources",
+                             xia::pixie::error::error);
+    }
+    TEST_CASE("Record") {
+        xia::buffer::pool pool;
+        pool.create(10, 4096);
+        recorder::config cfg;
+        cfg.path = "test_recorder";
+        cfg.metadata = "run 1";
+        SUBCASE("Module files") {
+            for (bool direct : {true, false}) {
+                cfg.direct = direct;
+                test_source src0(pool, 0x11, 1000, 3);
+                test_source src1(pool, 0x22, 2000, 2);
+                auto reduced = src1.make(3);
+                reduced.reduction.trace_policy = {
+                    xia::pixie::data::list_mode::reduction::traces::keep,
+                    xia::pixie::data::list_mode::reduction::traces::roi};
+                reduced.reduction.trace_rois.resize(2);
+                reduced.reduction.trace_rois[1].start = 20;
+                reduced.reduction.trace_rois[1].length = 100;
+                reduced.reduction.trace_rois[1].decimation = 8;
+                recorder::recorder rec({src0.make(0), reduced}, cfg);
+                rec.start();
+                const size_t total = (3 * 1000 + 2 * 2000) * sizeof(hw::word);
+                for (size_t wait = 0; rec.bytes() < total && wait < 1000; ++wait) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                }
+                rec.stop();
+                CHECK(rec.errors() == 0);
+                CHECK(rec.files() == 2);
+                CHECK(rec.bytes() == (3 * 1000 + 2 * 2000) * sizeof(hw::word));
+                auto names = rec.names();
+                REQUIRE(names.size() == 2);
+                CHECK(names[0] == "test_recorder-0-0000.lmd");
+                CHECK(names[1] == "test_recorder-3-0000.lmd");
+                auto contents = read_file(names[1]);
+                REQUIRE(contents.size() == recorder::header_size + 4000 * sizeof(hw::word));
+                auto head = header(contents);
+                CHECK(head["metadata"] == "run 1");
+                CHECK(head["modules"].size() == 1);
+                CHECK(head["modules"][0]["number"] == 3);
+                CHECK(head["modules"][0]["serial-num"] == 1003);
+                REQUIRE(head["modules"][0]["trace-rois"].size() == 1);
+                CHECK(head["modules"][0]["trace-rois"][0]["channel"] == 1);
+                CHECK(head["modules"][0]["trace-rois"][0]["start"] == 20);
+                CHECK(head["modules"][0]["trace-rois"][0]["decimation"] == 8);
+                CHECK(data(contents)[0] == 0x22);
+                CHECK(data(contents)[3999] == 0x22);
+                for (auto& name : names) {
+                    std::remove(name.c_str());
+                }
+            }
+        }
+        SUBCASE("Merged") {
+            cfg.merged = true;
+            test_source src0(pool, 0x11, 100, 1);
+            test_source src1(pool, 0x22, 200, 1);
+            recorder::recorder rec({src0.make(0), src1.make(1)}, cfg);
+            CHECK(rec.poll() == 300);
+            CHECK(rec.poll() == 0);
+            rec.stop();
+            auto names = rec.names();
+            REQUIRE(names.size() == 1);
+            CHECK(names[0] == "test_recorder-0000.lmd");
+            auto contents = read_file(names[0]);
+            REQUIRE(contents.size() == recorder::header_size +
+                                           (2 * recorder::block_header_words + 300) *
+                                               sizeof(hw::word));
+            CHECK(header(contents)["modules"].size() == 2);
+            auto words = data(contents);
+            CHECK(words[0] == recorder::block_magic);
+            CHECK(words[1] == 0);
+            CHECK(words[2] == 100);
+            CHECK(words[4] == 0x11);
+            words += recorder::block_header_words + 100;
+            CHECK(words[0] == recorder::block_magic);
+            CHECK(words[1] == 1);
+            CHECK(words[2] == 200);
+            CHECK(words[4] == 0x22);
+            std::remove(names[0].c_str());
+        }
+        SUBCASE("Stop") {
+            test_source src0(pool, 0x11, 1000, 3);
+            recorder::recorder rec({src0.make(0)}, cfg);
+            rec.stop();
+            CHECK(rec.bytes() == 1000 * sizeof(hw::word));
+            CHECK(src0.reads == 2);
+            std::remove(rec.names()[0].c_str());
+        }
+#if defined(__linux__)
+        SUBCASE("Write failure") {
+            cfg.direct = false;
+            cfg.path = "test_recorder_full";
+            const std::string full = "test_recorder_full-0-0000.lmd";
+            std::remove(full.c_str());
+            REQUIRE(::symlink("/dev/full", full.c_str()) == 0);
+            test_source src0(pool, 0x11, 1000, 1);
+            {
+                recorder::recorder rec({src0.make(0)}, cfg);
+                CHECK_THROWS_AS(rec.poll(), xia::pixie::error::error);
+                CHECK(src0.returned.size() == 1000);
+                CHECK(rec.poll() == 1000);
+                CHECK(src0.returned.empty());
+                rec.stop();
+                auto names = rec.names();
+                REQUIRE(names.size() == 1);
+                CHECK(names[0] == "test_recorder_full-0-0001.lmd");
+                auto contents = read_file(names[0]);
+                CHECK(contents.size() == recorder::header_size + 1000 * sizeof(hw::word));
+                std::remove(names[0].c_str());
+            }
+            test_source src1(pool, 0x22, 1000, 1);
+            {
+                auto src = src1.make(0);
+                src.requeue = nullptr;
+                recorder::recorder rec({src}, cfg);
+                rec.start();
+                for (size_t wait = 0; rec.errors() == 0 && wait < 1000; ++wait) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                }
+                CHECK(rec.errors() == 1);
+                CHECK_FALSE(rec.running());
+                CHECK_NOTHROW(rec.stop());
+            }
+            std::remove(full.c_str());
+        }
+#endif
+        SUBCASE("Rotate") {
+            cfg.rotate_bytes = 1500 * sizeof(hw::word);
+            test_source src0(pool, 0x11, 1000, 4);
+            recorder::recorder rec({src0.make(0)}, cfg);
+            while (rec.poll() != 0) {
+            }
+            rec.stop();
+            auto names = rec.names();
+            REQUIRE(names.size() == 2);
+            CHECK(names[1] == "test_recorder-0-0001.lmd");
+            for (auto& name : names) {
+                auto contents = read_file(name);
+                CHECK(contents.size() == recorder::header_size + 2000 * sizeof(hw::word));
+            }
+            CHECK(header(read_file(names[1]))["sequence"] == 1);
+            for (auto& name : names) {
+                std::remove(name.c_str());
+            }
+        }
+        SUBCASE("Compressed") {
+            cfg.merged = true;
+            cfg.compressed = true;
+            auto events = make_events(100, 50);
+            recorder::source src;
+            src.number = 2;
+            src.revision = 34688;
+            src.adc_msps = 500;
+            bool read = false;
+            src.read = [&pool, &events, &read](xia::buffer::queue::handles& buffers) -> size_t {
+                if (read) {
+                    return 0;
+                }
+                read = true;
+                auto buf = pool.request();
+                buf->assign(events.begin(), events.begin() + 4000);
+                buffers.push_back(buf);
+                buf = pool.request();
+                buf->assign(events.begin() + 4000, events.end());
+                buffers.push_back(buf);
+                return events.size();
+            };
+            recorder::recorder rec({src}, cfg);
+            CHECK(rec.poll() == events.size());
+            rec.stop();
+            auto names = rec.names();
+            REQUIRE(names.size() == 1);
+            CHECK(names[0] == "test_recorder-0000.lmc");
+            lmc::reader reader(names[0]);
+            CHECK(nlohmann::json::parse(reader.header())["compressed"] == true);
+            REQUIRE(reader.modules().size() == 1);
+            CHECK(reader.modules()[0].adc_msps == 500);
+            CHECK(read_container(reader) == events);
+            std::remove(names[0].c_str());
+        }
+        pool.destroy();
+    }
+}
+
+#if !defined(_WIN64) && !defined(_WIN32)
+TEST_SUITE("xia::pixie::server") {
+    TEST_CASE("Config") {
+        xia::buffer::pool pool;
+        test_source src(pool, 1, 10, 1);
+        server::config cfg;
+        CHECK_THROWS_AS(server::server({}, cfg), xia::pixie::error::error);
+        CHECK_THROWS_AS(server::server({src.make(0)}, cfg), xia::pixie::error::error);
+        cfg.group = "not-an-address";
+        CHECK_THROWS_AS(server::server({src.make(0)}, cfg), xia::pixie::error::error);
+    }
+    TEST_CASE("Stream") {
+        xia::buffer::pool pool;
+        pool.create(32, 10000);
+        test_source src0(pool, 0x1234, 5000, 3);
+        test_source src1(pool, 0x5678, 100, 2);
+        server::config cfg;
+        cfg.port = 0;
+        cfg.address = "127.0.0.1";
+
+        auto check_tcp = [&]() {
+            server::server srv({src0.make(0), src1.make(1)}, cfg);
+            REQUIRE(srv.port() > 0);
+            server::client cl1("127.0.0.1", srv.port());
+            server::client cl2("127.0.0.1", srv.port());
+            CHECK(srv.poll() == 5100);
+            CHECK(srv.clients() == 2);
+            CHECK(srv.poll() == 5100);
+            CHECK(srv.poll() == 5000);
+            CHECK(srv.poll() == 0);
+            for (auto cl : {&cl1, &cl2}) {
+                server::frame_header header;
+                hw::words words;
+                std::vector<uint64_t> sequences(2, 0);
+                for (size_t frame = 0; frame < 5; ++frame) {
+                    REQUIRE(cl->receive(header, words));
+                    REQUIRE(header.module < 2);
+                    CHECK(header.sequence == sequences[header.module]++);
+                    CHECK(header.crc != 0);
+                    CHECK(words.size() == (header.module == 0 ? 5000 : 100));
+                    CHECK(words.back() == (header.module == 0 ? 0x1234 : 0x5678));
+                }
+            }
+            CHECK(srv.bytes() == 2 * (5 * sizeof(server::frame_header) + 15200 * 4));
+            CHECK(srv.errors() == 0);
+        };
+
+        SUBCASE("TCP") {
+            check_tcp();
+        }
+        SUBCASE("TCP zero copy") {
+            cfg.zerocopy = true;
+            check_tcp();
+            CHECK(pool.full());
+        }
+        SUBCASE("Client disconnects") {
+            server::server srv({src0.make(0)}, cfg);
+            {
+                server::client cl("127.0.0.1", srv.port());
+                srv.poll();
+                CHECK(srv.clients() == 1);
+            }
+            /*
+             * The first send after the close can succeed, the next fails.
+             */
+            srv.poll();
+            srv.poll();
+            CHECK(srv.clients() == 0);
+            CHECK(srv.dropped() == 1);
+        }
+        SUBCASE("Datagrams") {
+            const int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+            REQUIRE(fd >= 0);
+            sockaddr_in addr = {};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            REQUIRE(::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+            socklen_t len = sizeof(addr);
+            ::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len);
+            timeval timeout = {1, 0};
+            ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+            cfg.port = -1;
+            cfg.group = "127.0.0.1";
+            cfg.group_port = ntohs(addr.sin_port);
+            cfg.datagram_bytes = 1032;
+            cfg.batch_frames = 3;
+            test_source src(pool, 0x4321, 1000, 1);
+            server::server srv({src.make(7)}, cfg);
+            CHECK(srv.poll() == 1000);
+
+            std::vector<char> datagram(2000);
+            hw::words words(1000, 0);
+            size_t fragments = 0;
+            size_t received = 0;
+            while (received < 1000) {
+                const ssize_t got = ::recv(fd, datagram.data(), datagram.size(), 0);
+                if (got <= 0) {
+                    break;
+                }
+                server::frame_header header;
+                std::memcpy(&header, datagram.data(), sizeof(header));
+                CHECK(header.magic == server::frame_magic);
+                CHECK(header.module == 7);
+                CHECK(header.words == 1000);
+                CHECK(size_t(got) == sizeof(header) + header.count * sizeof(hw::word));
+                std::memcpy(words.data() + header.offset, datagram.data() + sizeof(header),
+                            header.count * sizeof(hw::word));
+                received += header.count;
+                ++fragments;
+            }
+            ::close(fd);
+            CHECK(fragments == 4);
+            CHECK(received == 1000);
+            CHECK(words == hw::words(1000, 0x4321));
+        }
+        pool.destroy();
+    }
+}
+#endif
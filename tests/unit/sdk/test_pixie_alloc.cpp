@@ -0,0 +1,84 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2022 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file test_pixie_alloc.cpp
+ * @brief Provides test coverage for the heap allocation accounting.
+ */
+
+#include <thread>
+
+#include <doctest/doctest.h>
+
+#include <pixie/alloc.hpp>
+
+namespace alloc = xia::pixie::alloc;
+
+TEST_SUITE("xia::pixie::alloc") {
+    TEST_CASE("counter") {
+        alloc::counter c;
+        CHECK(c.allocations() == 0);
+        c.note(16);
+        c.note(32);
+        CHECK(c.allocations() == 2);
+        CHECK(c.bytes() == 48);
+        alloc::counter copy(c);
+        CHECK(copy.allocations() == 2);
+        c.reset();
+        CHECK(c.allocations() == 0);
+        CHECK(c.bytes() == 0);
+    }
+    TEST_CASE("watch") {
+        alloc::counter outer;
+        alloc::counter inner;
+        CHECK(alloc::watching() == nullptr);
+        alloc::note(8);
+        {
+            alloc::watch watching(&outer);
+            CHECK(alloc::watching() == &outer);
+            alloc::note(8);
+            {
+                alloc::watch nested(&inner);
+                alloc::note(4);
+                alloc::watch none(nullptr);
+                alloc::note(4);
+            }
+            CHECK(alloc::watching() == &outer);
+            alloc::note(8);
+        }
+        CHECK(alloc::watching() == nullptr);
+        CHECK(inner.allocations() == 1);
+        CHECK(inner.bytes() == 4);
+        CHECK(outer.allocations() == 2);
+        CHECK(outer.bytes() == 16);
+        alloc::counter* other_watching = &inner;
+        {
+            alloc::watch watching(&outer);
+            std::thread other([&other_watching] { other_watching = alloc::watching(); });
+            other.join();
+        }
+        CHECK(other_watching == nullptr);
+    }
+    TEST_CASE("fallback") {
+        alloc::counter c;
+        {
+            alloc::watch watching(&c);
+            alloc::note_fallback(64);
+        }
+        CHECK(c.allocations() == (alloc::hooked() ? 0 : 1));
+    }
+}
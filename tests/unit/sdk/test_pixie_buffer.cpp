@@ -20,10 +20,21 @@
  * @brief Defines tests for the threaded FIFO buffer readout.
  */
 
+#include <algorithm>
 #include <cstring>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include <doctest/doctest.h>
+#include <pixie/alloc.hpp>
 #include <pixie/buffer.hpp>
+#include <pixie/shm.hpp>
+
+#if !defined(_WIN64) && !defined(_WIN32)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 TEST_SUITE("xia::buffer") {
     TEST_CASE("pool create/destroy") {
@@ -59,6 +70,80 @@ TEST_SUITE("xia::buffer") {
             pool.destroy();
         }
     }
+    TEST_CASE("pool locked pages") {
+        xia::buffer::pool pool;
+        pool.create(10, 8 * 1024, true);
+        CHECK(pool.full());
+        CHECK(pool.locked <= pool.number);
+        {
+            xia::buffer::handle buf = pool.request();
+            CHECK(buf->capacity() == pool.size);
+            buf->resize(pool.size);
+        }
+        pool.destroy();
+        CHECK(pool.locked == 0);
+    }
+    TEST_CASE("pool huge pages") {
+        xia::buffer::pool pool;
+        pool.create(8, 64 * 1024, true, true);
+        CHECK(pool.full());
+        CHECK(pool.arena_pages() != xia::buffer::arena::pages::none);
+        {
+            std::vector<xia::buffer::handle> bufs;
+            for (size_t b = 0; b < pool.number; ++b) {
+                bufs.push_back(pool.request());
+                CHECK(bufs.back()->capacity() == pool.size);
+                bufs.back()->resize(pool.size, xia::buffer::buffer_value(b));
+            }
+            /*
+             * The buffers are carved from one block of memory and do not
+             * overlap.
+             */
+            std::vector<const xia::buffer::buffer_value*> data;
+            for (auto& buf : bufs) {
+                data.push_back(buf->data());
+            }
+            std::sort(data.begin(), data.end());
+            for (size_t d = 1; d < data.size(); ++d) {
+                CHECK(static_cast<size_t>(data[d] - data[d - 1]) >= pool.size);
+            }
+            CHECK(static_cast<size_t>(data.back() - data.front()) < 2 * pool.number * pool.size);
+            /*
+             * A copy is not in the arena.
+             */
+            xia::buffer::buffer copy(*bufs[0]);
+            CHECK(copy == *bufs[0]);
+            CHECK(copy.get_allocator().arena_ == nullptr);
+        }
+        pool.destroy();
+        CHECK(pool.arena_pages() == xia::buffer::arena::pages::none);
+        CHECK(pool.locked == 0);
+    }
+    TEST_CASE("arena") {
+        xia::buffer::arena arena;
+        CHECK_FALSE(arena.valid());
+        CHECK_FALSE(arena.create(0, 1024, false));
+        REQUIRE(arena.create(2, 1000, false));
+        CHECK_THROWS_AS(arena.create(2, 1000, false), xia::buffer::error);
+        CHECK(arena.slots() >= 2);
+        CHECK(arena.allocate(1024 * 1024 * 4) == nullptr);
+        std::vector<void*> slots;
+        for (size_t s = 0; s < arena.slots(); ++s) {
+            auto slot = arena.allocate(1000);
+            REQUIRE(slot != nullptr);
+            CHECK(arena.contains(slot));
+            slots.push_back(slot);
+        }
+        CHECK(arena.allocate(1000) == nullptr);
+        int on_heap = 0;
+        CHECK_FALSE(arena.deallocate(&on_heap));
+        for (auto slot : slots) {
+            CHECK(arena.deallocate(slot));
+        }
+        CHECK(arena.allocate(1000) != nullptr);
+        arena.destroy();
+        CHECK_FALSE(arena.valid());
+    }
     TEST_CASE("pool create/destroy reuse") {
         xia::buffer::pool pool;
         SUBCASE("one") {
@@ -125,6 +210,89 @@ TEST_SUITE("xia::buffer") {
         }
         pool.destroy();
     }
+    TEST_CASE("pool elastic") {
+        xia::buffer::pool pool;
+        pool.set_elastic(20, 5);
+        pool.create(10, 1024);
+        CHECK(!pool.grown());
+        std::vector<xia::buffer::handle> handles;
+        for (size_t b = 0; b < 10; ++b) {
+            handles.push_back(pool.request());
+        }
+        CHECK(pool.empty());
+        CHECK(pool.grow());
+        CHECK(pool.number == 15);
+        CHECK(pool.count() == 5);
+        for (size_t b = 0; b < 10; ++b) {
+            handles.push_back(pool.request());
+        }
+        CHECK(pool.number == 20);
+        CHECK(!pool.grow());
+        CHECK_THROWS_WITH_AS(pool.request(), "no buffers available", xia::buffer::error);
+        handles.resize(12);
+        CHECK(pool.shrink() == 8);
+        CHECK(pool.number == 12);
+        CHECK(pool.empty());
+        handles.clear();
+        CHECK(pool.shrink() == 2);
+        CHECK(pool.number == 10);
+        CHECK(pool.full());
+        pool.destroy();
+    }
+    TEST_CASE("pool watermarks") {
+        xia::buffer::pool pool;
+        pool.create(10, 1024);
+        CHECK_THROWS_AS(pool.set_watermarks(5, 5), xia::buffer::error);
+        std::vector<std::pair<xia::buffer::pool::watermark, size_t>> events;
+        pool.set_watermarks(8, 2, [&events](xia::buffer::pool::watermark level, size_t in_use) {
+            events.emplace_back(level, in_use);
+        });
+        std::vector<xia::buffer::handle> handles;
+        for (size_t b = 0; b < 9; ++b) {
+            handles.push_back(pool.request());
+        }
+        CHECK(pool.high_water());
+        CHECK(pool.high_water_events() == 1);
+        REQUIRE(events.size() == 1);
+        CHECK(events[0].first == xia::buffer::pool::watermark::high);
+        CHECK(events[0].second == 8);
+        handles.resize(3);
+        CHECK(pool.high_water());
+        handles.resize(2);
+        CHECK(!pool.high_water());
+        REQUIRE(events.size() == 2);
+        CHECK(events[1].first == xia::buffer::pool::watermark::low);
+        CHECK(events[1].second == 2);
+        handles.clear();
+        CHECK(events.size() == 2);
+        pool.destroy();
+    }
+    TEST_CASE("steady state") {
+        xia::buffer::pool pool;
+        pool.create(16, 1024);
+        xia::buffer::queue queue;
+        queue.reserve(pool.number);
+        std::vector<xia::buffer::buffer_value> out(16 * 100);
+        xia::pixie::alloc::counter allocations;
+        {
+            xia::pixie::alloc::watch watching(&allocations);
+            for (size_t round = 0; round < 10; ++round) {
+                for (size_t b = 0; b < 16; ++b) {
+                    auto buf = pool.request();
+                    buf->resize(100, xia::buffer::buffer_value(b));
+                    queue.push(buf);
+                }
+                CHECK(pool.empty());
+                CHECK(queue.copy(out.data(), 50) == 50);
+                CHECK(queue.copy(out.data() + 50, out.size() - 50) == out.size() - 50);
+                CHECK(out.back() == 15);
+                CHECK(pool.full());
+            }
+        }
+        CHECK(allocations.allocations() == 0);
+        CHECK(allocations.bytes() == 0);
+        pool.destroy();
+    }
     TEST_CASE("queue") {
         xia::buffer::pool pool;
         pool.create(100, 8 * 1024);
@@ -193,6 +361,32 @@ TEST_SUITE("xia::buffer") {
             CHECK(queue.size() == total);
             CHECK(queue.count() == 5);
         }
+        SUBCASE("pop handles") {
+            xia::buffer::queue queue;
+            size_t total = 0;
+            for (size_t b = 0; b < 10; ++b) {
+                xia::buffer::handle buf = pool.request();
+                size_t size = b * 100 + 10;
+                buf->resize(size, static_cast<xia::buffer::buffer_value>(b));
+                total += size;
+                queue.push(buf);
+            }
+            xia::buffer::queue::handles handles;
+            CHECK(queue.pop(handles, 3) == 10 + 110 + 210);
+            CHECK(handles.size() == 3);
+            CHECK(queue.count() == 7);
+            CHECK(queue.size() == total - (10 + 110 + 210));
+            CHECK(handles[2]->size() == 210);
+            CHECK((*handles[2])[0] == 2);
+            CHECK(queue.pop(handles) == total - (10 + 110 + 210));
+            CHECK(handles.size() == 10);
+            CHECK(queue.count() == 0);
+            CHECK(queue.size() == 0);
+            CHECK(queue.pop(handles) == 0);
+            CHECK(pool.count() == pool.number - 10);
+            handles.clear();
+            CHECK(pool.full());
+        }
         SUBCASE("compact to one") {
             xia::buffer::queue queue;
             size_t total = 0;
@@ -245,6 +439,66 @@ TEST_SUITE("xia::buffer") {
             CHECK(queue.count() == 9);
             CHECK(queue.size() == total);
         }
+        SUBCASE("compact keeps the order") {
+            xia::buffer::queue queue;
+            xia::buffer::buffer_value value = 0;
+            size_t total = 0;
+            for (size_t b = 0; b < 40; ++b) {
+                xia::buffer::handle buf = pool.request();
+                size_t size = (b * 37) % (pool.size / 2) + 1;
+                for (size_t w = 0; w < size; ++w) {
+                    buf->push_back(value++);
+                }
+                total += size;
+                queue.push(buf);
+            }
+            queue.compact();
+            CHECK(queue.size() == total);
+            CHECK(queue.count() == (total + pool.size - 1) / pool.size);
+            CHECK(pool.count() == pool.number - queue.count());
+            xia::buffer::buffer data;
+            queue.copy(data);
+            bool ordered = data.size() == total;
+            for (size_t w = 0; ordered && w < data.size(); ++w) {
+                ordered = data[w] == xia::buffer::buffer_value(w);
+            }
+            CHECK(ordered);
+            CHECK(queue.empty());
+        }
+        SUBCASE("partial copies") {
+            xia::buffer::queue queue;
+            xia::buffer::buffer_value value = 0;
+            for (size_t b = 0; b < 4; ++b) {
+                xia::buffer::handle buf = pool.request();
+                for (size_t w = 0; w < 1000; ++w) {
+                    buf->push_back(value++);
+                }
+                queue.push(buf);
+            }
+            xia::buffer::buffer chunk(300);
+            bool ordered = true;
+            xia::buffer::buffer_value next = 0;
+            for (size_t c = 0; c < 5; ++c) {
+                CHECK(queue.copy(chunk) == chunk.size());
+                for (auto v : chunk) {
+                    ordered = ordered && v == next++;
+                }
+            }
+            CHECK(ordered);
+            CHECK(queue.size() == 2500);
+            CHECK(queue.count() == 3);
+            queue.compact();
+            CHECK(queue.size() == 2500);
+            xia::buffer::queue::handles handles;
+            CHECK(queue.pop(handles) == 2500);
+            for (auto& buf : handles) {
+                for (auto v : *buf) {
+                    ordered = ordered && v == next++;
+                }
+            }
+            CHECK(ordered);
+            CHECK(next == value);
+        }
         SUBCASE("copy") {
             xia::buffer::queue queue;
             size_t total = 0;
@@ -392,4 +646,328 @@ TEST_SUITE("xia::buffer") {
         }
         pool.destroy();
     }
+    TEST_CASE("ring") {
+        xia::buffer::pool pool;
+        pool.create(100, 8 * 1024);
+        SUBCASE("create/destroy") {
+            xia::buffer::ring ring;
+            CHECK(!ring.valid());
+            ring.create(10);
+            CHECK(ring.valid());
+            CHECK(ring.capacity() == 10);
+            CHECK(ring.empty());
+            CHECK_THROWS_WITH_AS(ring.create(10), "ring is already created", xia::buffer::error);
+            ring.destroy();
+            CHECK(!ring.valid());
+        }
+        SUBCASE("push and pop") {
+            xia::buffer::ring ring;
+            ring.create(4);
+            /*
+             * Empty buffers are not queued but released.
+             */
+            CHECK(ring.push(pool.request()));
+            CHECK(ring.empty());
+            CHECK(pool.full());
+            for (size_t b = 0; b < 4; ++b) {
+                xia::buffer::handle buf = pool.request();
+                buf->resize(10 * (b + 1), static_cast<xia::buffer::buffer_value>(b));
+                CHECK(ring.push(buf));
+            }
+            CHECK(ring.full());
+            CHECK(ring.count() == 4);
+            CHECK(ring.size() == 10 + 20 + 30 + 40);
+            xia::buffer::handle buf = pool.request();
+            buf->resize(10);
+            CHECK(!ring.push(buf));
+            buf.reset();
+            for (size_t b = 0; b < 4; ++b) {
+                buf = ring.pop();
+                CHECK(buf->size() == 10 * (b + 1));
+                CHECK((*buf)[0] == b);
+            }
+            CHECK(!ring.pop());
+            CHECK(ring.empty());
+            CHECK(ring.size() == 0);
+            buf.reset();
+            CHECK(pool.full());
+        }
+        SUBCASE("drain") {
+            xia::buffer::ring ring;
+            xia::buffer::queue queue;
+            ring.create(10);
+            for (size_t b = 0; b < 5; ++b) {
+                xia::buffer::handle buf = pool.request();
+                buf->resize(100);
+                ring.push(buf);
+            }
+            CHECK(ring.drain(queue) == 500);
+            CHECK(ring.empty());
+            CHECK(queue.count() == 5);
+            CHECK(queue.size() == 500);
+            queue.flush();
+            CHECK(pool.full());
+        }
+        SUBCASE("threaded") {
+            xia::buffer::ring ring;
+            ring.create(8);
+            const size_t buffers = 10000;
+            std::thread producer([&pool, &ring, buffers]() {
+                for (size_t b = 0; b < buffers;) {
+                    if (pool.empty()) {
+                        std::this_thread::yield();
+                        continue;
+                    }
+                    xia::buffer::handle buf = pool.request();
+                    buf->resize(10, static_cast<xia::buffer::buffer_value>(b));
+                    while (!ring.push(buf)) {
+                        std::this_thread::yield();
+                    }
+                    ++b;
+                }
+            });
+            bool ordered = true;
+            for (size_t b = 0; b < buffers;) {
+                xia::buffer::handle buf = ring.pop();
+                if (!buf) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                if ((*buf)[0] != b || buf->size() != 10) {
+                    ordered = false;
+                }
+                ++b;
+            }
+            producer.join();
+            CHECK(ordered);
+            CHECK(ring.empty());
+            CHECK(pool.full());
+        }
+        pool.destroy();
+    }
+    TEST_CASE("fanout") {
+        xia::buffer::pool pool;
+        pool.create(20, 1024);
+        xia::buffer::queue queue;
+        auto push = [&pool, &queue](size_t count) {
+            for (size_t b = 0; b < count; ++b) {
+                xia::buffer::handle buf = pool.request();
+                buf->resize(10, static_cast<xia::buffer::buffer_value>(b));
+                queue.push(buf);
+            }
+        };
+        auto source = [&queue](xia::buffer::queue::handles& buffers) {
+            return queue.pop(buffers);
+        };
+        SUBCASE("Invalid") {
+            CHECK_THROWS_AS(xia::buffer::fanout(nullptr), xia::buffer::error);
+        }
+        SUBCASE("Consumers") {
+            xia::buffer::fanout fan(source);
+            auto c1 = fan.subscribe();
+            auto c2 = fan.subscribe();
+            CHECK(fan.consumers() == 2);
+            push(5);
+            xia::buffer::queue::handles b1;
+            xia::buffer::queue::handles b2;
+            CHECK(c1->read(b1, 2) == 20);
+            CHECK(fan.held() == 5);
+            CHECK(c1->available() == 3);
+            CHECK(c2->available() == 5);
+            CHECK(c2->read(b2) == 50);
+            CHECK(fan.held() == 3);
+            CHECK(c1->read(b1) == 30);
+            CHECK(fan.held() == 0);
+            REQUIRE(b1.size() == 5);
+            REQUIRE(b2.size() == 5);
+            for (size_t b = 0; b < 5; ++b) {
+                CHECK(b1[b] == b2[b]);
+                CHECK((*b1[b])[0] == b);
+            }
+            CHECK(pool.count() == 15);
+            b1.clear();
+            CHECK(pool.count() == 15);
+            b2.clear();
+            CHECK(pool.full());
+            c2.reset();
+            CHECK(fan.consumers() == 1);
+            push(3);
+            CHECK(fan.pull() == 30);
+            CHECK(fan.held() == 3);
+            c1.reset();
+            CHECK(fan.held() == 0);
+            CHECK(pool.full());
+        }
+        SUBCASE("Slow consumer") {
+            xia::buffer::fanout fan(source, 4);
+            auto fast = fan.subscribe();
+            auto slow = fan.subscribe();
+            xia::buffer::queue::handles buffers;
+            push(10);
+            CHECK(fast->read(buffers) == 100);
+            CHECK(fan.held() == 4);
+            CHECK(slow->dropped() == 6);
+            buffers.clear();
+            CHECK(slow->read(buffers) == 40);
+            CHECK(slow->dropped() == 6);
+            CHECK((*buffers.front())[0] == 6);
+            CHECK(fast->dropped() == 0);
+            buffers.clear();
+            CHECK(pool.full());
+        }
+        queue.flush();
+        pool.destroy();
+    }
+#if !defined(_WIN64) && !defined(_WIN32)
+    TEST_CASE("shm ring") {
+        namespace shm = xia::buffer::shm;
+        const std::string name = "/pixie-sdk-test-" + std::to_string(::getpid());
+        xia::buffer::buffer data(1000);
+        for (size_t w = 0; w < data.size(); ++w) {
+            data[w] = static_cast<xia::buffer::buffer_value>(w);
+        }
+        shm::config cfg;
+        cfg.blocks = 4;
+        cfg.block_words = 400;
+        cfg.subscribers = 2;
+        SUBCASE("publish and read") {
+            shm::publisher pub(name, cfg);
+            CHECK_THROWS_AS(shm::subscriber("/pixie-sdk-test-missing"), xia::buffer::error);
+            shm::subscriber sub1(name);
+            shm::subscriber sub2(name);
+            CHECK_THROWS_AS(shm::subscriber sub3(name), xia::buffer::error);
+            CHECK(pub.subscribers() == 2);
+            CHECK(sub1.cfg.blocks == 4);
+            shm::block_view view;
+            CHECK(!sub1.read(view));
+            CHECK(pub.publish(3, data.data(), data.size()));
+            CHECK(pub.sequence() == 3);
+            for (auto sub : {&sub1, &sub2}) {
+                CHECK(sub->available() == 3);
+                xia::buffer::buffer got;
+                while (sub->read(view)) {
+                    CHECK(view.source == 3);
+                    CHECK(((view.flags & shm::block_view::continued) != 0) == (view.words == 400));
+                    got.insert(got.end(), view.data, view.data + view.words);
+                    CHECK(sub->release(view));
+                }
+                CHECK(got == data);
+                CHECK(sub->dropped() == 0);
+            }
+        }
+        SUBCASE("lossy") {
+            shm::publisher pub(name, cfg);
+            shm::subscriber sub(name);
+            for (size_t b = 0; b < 6; ++b) {
+                CHECK(pub.publish(static_cast<uint32_t>(b), data.data(), 10));
+            }
+            shm::block_view view;
+            REQUIRE(sub.read(view));
+            CHECK(view.source == 2);
+            CHECK(sub.dropped() == 2);
+            CHECK(pub.publish(6, data.data(), 10));
+            CHECK(pub.publish(7, data.data(), 10));
+            CHECK(pub.publish(8, data.data(), 10));
+            CHECK(pub.publish(9, data.data(), 10));
+            CHECK(!sub.release(view));
+            CHECK(sub.dropped() == 3);
+            REQUIRE(sub.read(view));
+            CHECK(view.source == 6);
+            CHECK(sub.release(view));
+        }
+        SUBCASE("lossless") {
+            cfg.mode = shm::policy::lossless;
+            shm::publisher pub(name, cfg);
+            shm::subscriber sub(name);
+            CHECK(pub.publish(0, data.data(), data.size()));
+            CHECK(pub.space() == 1);
+            CHECK(!pub.publish(1, data.data(), data.size()));
+            CHECK(pub.full() == 1);
+            CHECK_THROWS_AS(pub.publish(1, data.data(), 2000), xia::buffer::error);
+
+            xia::buffer::pool pool;
+            pool.create(4, 100);
+            xia::buffer::queue::handles bufs;
+            for (size_t b = 0; b < 3; ++b) {
+                bufs.push_back(pool.request());
+                bufs.back()->assign(100, static_cast<xia::buffer::buffer_value>(b));
+            }
+            CHECK(pub.publish(1, bufs) == 100);
+            CHECK(bufs.size() == 2);
+            shm::block_view view;
+            for (size_t b = 0; b < 3; ++b) {
+                REQUIRE(sub.read(view));
+                CHECK(sub.release(view));
+            }
+            CHECK(pub.publish(1, bufs) == 200);
+            CHECK(bufs.empty());
+            CHECK(pool.full());
+            size_t read = 0;
+            while (sub.read(view)) {
+                CHECK(view.data[0] == read);
+                CHECK(sub.release(view));
+                ++read;
+            }
+            CHECK(read == 3);
+            CHECK(sub.dropped() == 0);
+            pool.destroy();
+        }
+        SUBCASE("other process") {
+            cfg.mode = shm::policy::lossless;
+            const size_t blocks = 200;
+            shm::publisher pub(name, cfg);
+            auto child = ::fork();
+            REQUIRE(child >= 0);
+            if (child == 0) {
+                try {
+                    shm::subscriber sub(name);
+                    shm::block_view view;
+                    size_t next = 0;
+                    while (next < blocks && sub.read(view, 5000000)) {
+                        if (view.source != next || view.words != 10 || view.data[9] != next) {
+                            break;
+                        }
+                        sub.release(view);
+                        ++next;
+                    }
+                    /*
+                     * Exit without detaching for the publisher to reap.
+                     */
+                    ::_exit(next == blocks ? 0 : 2);
+                } catch (...) {
+                }
+                ::_exit(1);
+            }
+            for (size_t wait = 0; pub.subscribers() == 0 && wait < 5000; ++wait) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            CHECK(pub.subscribers() == 1);
+            xia::buffer::buffer block(10);
+            for (size_t b = 0; b < blocks;) {
+                std::fill(block.begin(), block.end(), static_cast<xia::buffer::buffer_value>(b));
+                if (pub.publish(static_cast<uint32_t>(b), block.data(), block.size())) {
+                    ++b;
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+            int status = -1;
+            ::waitpid(child, &status, 0);
+            CHECK(WIFEXITED(status));
+            CHECK(WEXITSTATUS(status) == 0);
+            CHECK(pub.reap() == 1);
+            CHECK(pub.subscribers() == 0);
+        }
+        SUBCASE("closed") {
+            std::unique_ptr<shm::publisher> pub(new shm::publisher(name, cfg));
+            shm::subscriber sub(name);
+            CHECK(!sub.closed());
+            pub.reset();
+            CHECK(sub.closed());
+            shm::block_view view;
+            CHECK(!sub.read(view, 1000000));
+            CHECK_THROWS_AS(shm::subscriber reopened(name), xia::buffer::error);
+        }
+    }
+#endif
 }
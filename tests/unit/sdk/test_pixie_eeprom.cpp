@@ -21,6 +21,7 @@
  */
 
 #include <algorithm>
+#include <cstdio>
 #include <map>
 
 #include <doctest/doctest.h>
@@ -285,4 +286,39 @@ TEST_SUITE("xia::pixie::eeprom") {
                 eeprom.process(), "invalid ADC MSPS: 65535", eeprom_error);
         }
     }
+    TEST_CASE("Cache") {
+        namespace ee = xia::pixie::eeprom;
+        const std::string path = "test_eeprom_cache.bin";
+        std::remove(path.c_str());
+        xia::pixie::eeprom::eeprom rev_h;
+        eetest::load("H", rev_h);
+        xia::pixie::eeprom::eeprom rev_f;
+        eetest::load("F", rev_f);
+        ee::contents hdr(rev_h.data.begin(), rev_h.data.begin() + ee::header::size);
+        ee::contents data;
+        CHECK(ee::cache_enabled() == false);
+        ee::cache_add(rev_h.data);
+        CHECK(ee::cache_entries() == 0);
+        ee::cache_open(path);
+        CHECK(ee::cache_enabled());
+        CHECK(ee::cache_entries() == 0);
+        CHECK(ee::cache_find(hdr, data) == false);
+        ee::cache_add(rev_h.data);
+        ee::cache_add(rev_f.data);
+        CHECK(ee::cache_entries() == 1);
+        CHECK(ee::cache_find(hdr, data));
+        CHECK(data == rev_h.data);
+        auto changed = hdr;
+        changed[ee::header::size - 1] ^= 1;
+        CHECK(ee::cache_find(changed, data) == false);
+        ee::cache_close();
+        CHECK(ee::cache_find(hdr, data) == false);
+        ee::cache_open(path);
+        CHECK(ee::cache_entries() == 1);
+        data.clear();
+        CHECK(ee::cache_find(hdr, data));
+        CHECK(data == rev_h.data);
+        ee::cache_close();
+        std::remove(path.c_str());
+    }
 }
@@ -0,0 +1,159 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2022 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file test_pixie_fft.cpp
+ * @brief Provides test coverage for the fast Fourier transforms.
+ */
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <doctest/doctest.h>
+
+#include <pixie/error.hpp>
+#include <pixie/fft.hpp>
+
+#include <pixie16/pixie16.h>
+
+namespace fft = xia::pixie::fft;
+
+static fft::values dft(const fft::values& in, double sign) {
+    const double two_pi = 2.0 * std::acos(-1.0);
+    const size_t n = in.size();
+    fft::values out(n);
+    for (size_t k = 0; k < n; ++k) {
+        fft::value sum(0, 0);
+        for (size_t j = 0; j < n; ++j) {
+            sum += in[j] * std::polar(1.0, sign * two_pi * double((j * k) % n) / double(n));
+        }
+        out[k] = sum;
+    }
+    return out;
+}
+
+static double max_error(const fft::values& a, const fft::values& b) {
+    double err = 0;
+    for (size_t i = 0; i < a.size() && i < b.size(); ++i) {
+        err = std::max(err, std::abs(a[i] - b[i]));
+    }
+    return err;
+}
+
+static fft::values random_values(size_t length, unsigned int seed) {
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+    fft::values values(length);
+    for (auto& v : values) {
+        v = fft::value(dist(gen), dist(gen));
+    }
+    return values;
+}
+
+TEST_SUITE("xia::pixie::fft") {
+    TEST_CASE("power of 2") {
+        CHECK(fft::power_of_2(1));
+        CHECK(fft::power_of_2(4096));
+        CHECK_FALSE(fft::power_of_2(0));
+        CHECK_FALSE(fft::power_of_2(12));
+    }
+    TEST_CASE("plan") {
+        CHECK_THROWS_AS(fft::plan(0), xia::pixie::error::error);
+        CHECK_THROWS_AS(fft::plan(24), xia::pixie::error::error);
+        CHECK_THROWS_AS(fft::real_plan(1), xia::pixie::error::error);
+        CHECK_THROWS_AS(fft::real_plan(6), xia::pixie::error::error);
+        fft::plan plan(8);
+        fft::values short_data(4);
+        CHECK_THROWS_AS(plan.forward(short_data), xia::pixie::error::error);
+    }
+    TEST_CASE("complex") {
+        for (size_t length = 1; length <= 1024; length *= 2) {
+            CAPTURE(length);
+            auto input = random_values(length, unsigned(length));
+            fft::plan plan(length);
+            auto data = input;
+            plan.forward(data);
+            CHECK(max_error(data, dft(input, -1)) < 1e-9);
+            plan.inverse(data);
+            for (auto& v : data) {
+                v /= double(length);
+            }
+            CHECK(max_error(data, input) < 1e-12);
+            data = input;
+            plan.inverse(data);
+            CHECK(max_error(data, dft(input, 1)) < 1e-9);
+        }
+    }
+    TEST_CASE("real") {
+        for (size_t length = 2; length <= 2048; length *= 2) {
+            CAPTURE(length);
+            std::mt19937 gen{unsigned(length)};
+            std::uniform_int_distribution<int> dist(0, 16383);
+            std::vector<uint16_t> trace(length);
+            fft::values input(length);
+            for (size_t i = 0; i < length; ++i) {
+                trace[i] = uint16_t(dist(gen));
+                input[i] = fft::value(trace[i], 0);
+            }
+            fft::real_plan plan(length);
+            CHECK(plan.bins() == length / 2 + 1);
+            fft::values bins;
+            plan.forward(trace, bins);
+            auto expected = dft(input, -1);
+            expected.resize(plan.bins());
+            CHECK(max_error(bins, expected) / double(length) < 1e-9);
+        }
+    }
+    TEST_CASE("power spectra") {
+        const size_t length = 256;
+        const double two_pi = 2.0 * std::acos(-1.0);
+        fft::real_plan plan(length);
+        std::vector<std::vector<uint16_t>> traces(4, std::vector<uint16_t>(length));
+        for (size_t t = 0; t < traces.size(); ++t) {
+            for (size_t i = 0; i < length; ++i) {
+                traces[t][i] = uint16_t(1000 + 100 * std::cos(two_pi * double((t + 1) * 8 * i) /
+                                                              double(length)));
+            }
+        }
+        std::vector<std::vector<double>> spectra;
+        fft::power_spectra(plan, traces, spectra);
+        REQUIRE(spectra.size() == traces.size());
+        for (size_t t = 0; t < spectra.size(); ++t) {
+            CAPTURE(t);
+            REQUIRE(spectra[t].size() == plan.bins());
+            size_t peak = 1;
+            for (size_t k = 1; k < plan.bins(); ++k) {
+                if (spectra[t][k] > spectra[t][peak]) {
+                    peak = k;
+                }
+            }
+            CHECK(peak == (t + 1) * 8);
+        }
+        traces[1].resize(length / 2);
+        CHECK_THROWS_AS(fft::power_spectra(plan, traces, spectra), xia::pixie::error::error);
+    }
+    TEST_CASE("Pixie16complexFFT") {
+        const size_t length = 128;
+        auto input = random_values(length, 1);
+        auto data = input;
+        CHECK(Pixie16complexFFT(reinterpret_cast<double*>(data.data()), length) == 0);
+        CHECK(max_error(data, dft(input, 1)) < 1e-9);
+        CHECK(Pixie16complexFFT(reinterpret_cast<double*>(data.data()), 100) < 0);
+        CHECK(Pixie16complexFFT(nullptr, length) < 0);
+    }
+}
@@ -0,0 +1,108 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2022 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file test_pixie_fw.cpp
+ * @brief Provides test coverage for the firmware namespace.
+ */
+
+#include <cstdio>
+#include <fstream>
+
+#include <doctest/doctest.h>
+#include <pixie/error.hpp>
+#include <pixie/fw.hpp>
+#include <pixie/util.hpp>
+
+namespace fw = xia::pixie::firmware;
+
+static void write_image(const std::string& name, const std::string& contents) {
+    std::ofstream out(name, std::ios::binary | std::ios::trunc);
+    out << contents;
+}
+
+TEST_SUITE("xia::pixie::firmware") {
+    TEST_CASE("image cache") {
+        const std::string name_a = "test_pixie_fw_a.bin";
+        const std::string name_b = "test_pixie_fw_b.bin";
+        const std::string contents = "0123456789abcdef";
+        const std::string desc =
+            "version=1, revision=15, adc-msps=250, adc-bits=16, device=sys, file=";
+
+        write_image(name_a, contents);
+        write_image(name_b, contents);
+
+        fw::image_cache_enable(true);
+        fw::image_cache_clear();
+
+        fw::firmware fw_a = fw::parse(desc + name_a, ',');
+        fw::firmware fw_b = fw::parse(desc + name_a, ',');
+        fw::firmware fw_c = fw::parse(desc + name_b, ',');
+
+        SUBCASE("Not loaded") {
+            CHECK(!fw_a.data);
+            CHECK_THROWS_AS(fw_a.get_image(), xia::pixie::error::error);
+        }
+        SUBCASE("Shared") {
+            fw_a.load();
+            fw_b.load();
+            fw_c.load();
+            CHECK(fw::image_cache_files() == 2);
+            CHECK(fw_a.get_image() == fw_b.get_image());
+            CHECK(fw_a.get_image() == fw_c.get_image());
+            CHECK(fw_a.data->size() == contents.size());
+            CHECK(fw_a.words() == contents.size() / sizeof(fw::image_value_type));
+            xia::util::crc32 crc;
+            crc.update(*fw_a.data);
+            CHECK(fw_a.crc == crc.value);
+        }
+        SUBCASE("Kept after clear") {
+            fw_a.load();
+            auto image = fw_a.get_image();
+            fw_a.clear();
+            CHECK(!fw_a.data);
+            fw_a.load();
+            CHECK(fw_a.get_image() == image);
+        }
+        SUBCASE("Modified file") {
+            fw_a.load();
+            auto image = fw_a.get_image();
+            fw_a.clear();
+            write_image(name_a, contents + contents);
+            fw_a.load();
+            /*
+             * The modification time may not change within the file system's
+             * time resolution so only the size change can be relied on.
+             */
+            CHECK(fw_a.get_image() != image);
+            CHECK(fw_a.data->size() == contents.size() * 2);
+        }
+        SUBCASE("Disabled") {
+            fw::image_cache_enable(false);
+            fw_a.load();
+            fw_b.load();
+            CHECK(fw::image_cache_files() == 0);
+            CHECK(fw_a.get_image() != fw_b.get_image());
+            CHECK(*fw_a.get_image() == *fw_b.get_image());
+            fw::image_cache_enable(true);
+        }
+
+        fw::image_cache_clear();
+        std::remove(name_a.c_str());
+        std::remove(name_b.c_str());
+    }
+}
@@ -21,7 +21,11 @@
  */
 
 
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <thread>
+#include <vector>
 
 #include <doctest/doctest.h>
 #include <pixie/error.hpp>
@@ -250,6 +254,133 @@ TEST_SUITE("xia::logging") {
         }
         xia::logging::stop("level_logging");
     }
+    TEST_CASE("asynchronous") {
+        const std::string name = "asynchronous";
+        const std::string file = "test_pixie_log_async.log";
+        const size_t producers = 4;
+        auto count_entries = [&file](size_t& entries, size_t& reported_drops) {
+            std::ifstream in(file);
+            std::string line;
+            const std::string drop_label = "dropped ";
+            entries = 0;
+            reported_drops = 0;
+            while (std::getline(in, line)) {
+                if (line.find(test_message) != std::string::npos) {
+                    ++entries;
+                }
+                auto drop = line.find(drop_label);
+                if (drop != std::string::npos) {
+                    reported_drops += std::stoul(line.substr(drop + drop_label.size()));
+                }
+            }
+        };
+        auto produce = [producers](size_t count) {
+            std::vector<std::thread> threads;
+            for (size_t p = 0; p < producers; ++p) {
+                threads.emplace_back([count] {
+                    for (size_t e = 0; e < count; ++e) {
+                        xia_log(xia::log::info) << test_message;
+                    }
+                });
+            }
+            for (auto& thread : threads) {
+                thread.join();
+            }
+        };
+        SUBCASE("All entries written") {
+            const size_t count = 1000;
+            xia::logging::start(name, file, false, producers * count);
+            xia::logging::set_level(xia::log::level::info);
+            produce(count);
+            CHECK(xia::logging::dropped(name) == 0);
+            xia::logging::stop(name);
+            size_t entries;
+            size_t reported_drops;
+            count_entries(entries, reported_drops);
+            CHECK(entries == producers * count);
+            CHECK(reported_drops == 0);
+        }
+        SUBCASE("Dropped entries counted") {
+            const size_t count = 10000;
+            xia::logging::start(name, file, false, 2);
+            xia::logging::set_level(xia::log::level::info);
+            produce(count);
+            xia::logging::stop(name);
+            size_t entries;
+            size_t reported_drops;
+            count_entries(entries, reported_drops);
+            CHECK(entries + reported_drops == producers * count);
+        }
+        CHECK_THROWS_WITH_AS(xia::logging::dropped("unit_test"),
+                             "invalid log output name in dropped", xia::pixie::error::error);
+        std::remove(file.c_str());
+    }
+    TEST_CASE("categories") {
+        std::stringstream test_stream;
+        std::streambuf* old = std::cout.rdbuf();
+        std::cout.rdbuf(test_stream.rdbuf());
+        xia::logging::start("categories", "", false);
+        xia::logging::set_level(xia::log::level::warning);
+        xia::logging::set_datetime_stamp("categories", false);
+        std::cout.rdbuf(old);
+
+        SUBCASE("Logging level") {
+            CHECK_FALSE(xia::logging::level_logging(xia::log::debug, xia::log::bus));
+            xia_logc(xia::log::bus, xia::log::debug) << test_message;
+            CHECK(test_stream.str() == "");
+            xia_logc(xia::log::bus, xia::log::warning) << test_message;
+            CHECK(test_stream.str() == "[WARN ] " + test_message + "\n");
+        }
+        SUBCASE("Category level") {
+            xia::logging::set_level(xia::log::bus, xia::log::debug);
+            CHECK(xia::logging::level_logging(xia::log::debug, xia::log::bus));
+            CHECK_FALSE(xia::logging::level_logging(xia::log::debug, xia::log::fifo));
+            CHECK_FALSE(xia::logging::level_logging(xia::log::debug));
+            xia_logc(xia::log::fifo, xia::log::debug) << test_message;
+            xia_log(xia::log::debug) << test_message;
+            CHECK(test_stream.str() == "");
+            xia_logc(xia::log::bus, xia::log::debug) << std::hex << 255;
+            CHECK(test_stream.str() == "[DEBUG] ff\n");
+            test_stream.str("");
+            xia_logc(xia::log::bus, xia::log::debug) << 255;
+            CHECK(test_stream.str() == "[DEBUG] 255\n");
+            test_stream.str("");
+            xia::logging::set_level(xia::log::fifo, xia::log::off);
+            xia_logc(xia::log::fifo, xia::log::error) << test_message;
+            CHECK(test_stream.str() == "");
+            xia::logging::clear_level(xia::log::fifo);
+            xia_logc(xia::log::fifo, xia::log::error) << test_message;
+            CHECK(test_stream.str() == "[ERROR] " + test_message + "\n");
+            xia::logging::clear_level(xia::log::bus);
+            CHECK_FALSE(xia::logging::level_logging(xia::log::debug, xia::log::bus));
+        }
+        SUBCASE("Category levels") {
+            xia::logging::set_levels("bus=debug,dma=info");
+            CHECK(xia::logging::level_logging(xia::log::debug, xia::log::bus));
+            CHECK(xia::logging::level_logging(xia::log::info, xia::log::dma));
+            CHECK_FALSE(xia::logging::level_logging(xia::log::debug, xia::log::dma));
+            CHECK_THROWS_WITH_AS(xia::logging::set_levels("fifo=debug,bus"),
+                                 "invalid log category level: bus", xia::pixie::error::error);
+            CHECK_THROWS_WITH_AS(xia::logging::set_levels("disk=debug"),
+                                 "invalid log category level: disk=debug",
+                                 xia::pixie::error::error);
+            CHECK_FALSE(xia::logging::level_logging(xia::log::debug, xia::log::fifo));
+            xia::logging::clear_level(xia::log::bus);
+            xia::logging::clear_level(xia::log::dma);
+        }
+        SUBCASE("Nested entries") {
+            xia::logging::set_level(xia::log::level::info);
+            auto value = [] {
+                xia_log(xia::log::info) << "inner";
+                return 1;
+            };
+            xia_log(xia::log::info) << "outer " << value();
+            CHECK(test_stream.str() == "[INFO ] inner\n[INFO ] outer 1\n");
+        }
+        CHECK_THROWS_WITH_AS(xia::logging::set_level(xia::log::general, xia::log::debug),
+                             "invalid log category in set level", xia::pixie::error::error);
+        xia::logging::stop("categories");
+    }
     TEST_CASE("set_datetime_stamp") {
         xia::logging::start("set_datetime_stamp", "", false);
         xia::logging::set_level(xia::log::level::off);
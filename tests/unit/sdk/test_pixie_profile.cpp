@@ -0,0 +1,145 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2022 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file test_pixie_profile.cpp
+ * @brief Provides test coverage for the profiler of named code sites.
+ */
+
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <doctest/doctest.h>
+
+#include <pixie/profile.hpp>
+
+namespace profile = xia::pixie::profile;
+
+static bool find(const std::string& name, profile::stats& st) {
+    profile::stats_list sites;
+    profile::dump(sites);
+    for (auto& s : sites) {
+        if (s.name == name) {
+            st = s;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void scoped() {
+    PIXIE_PROFILE_SCOPE("test::scoped");
+}
+
+TEST_SUITE("xia::pixie::profile") {
+    TEST_CASE("disabled") {
+        profile::enable(false);
+        profile::reset();
+        scoped();
+        profile::stats st;
+        CHECK_FALSE(find("test::scoped", st));
+    }
+    TEST_CASE("scoped timer") {
+        profile::enable();
+        profile::reset();
+        for (int i = 0; i < 5; ++i) {
+            scoped();
+        }
+        static profile::site stopped("test::stopped");
+        profile::timer t(stopped);
+        t.stop();
+        t.stop();
+        profile::enable(false);
+        profile::stats st;
+        REQUIRE(find("test::scoped", st));
+        CHECK(st.count == 5);
+        CHECK(st.min_nsecs <= st.max_nsecs);
+        REQUIRE(find("test::stopped", st));
+        CHECK(st.count == 1);
+    }
+    TEST_CASE("aggregate") {
+        profile::reset();
+        profile::site site("test::aggregate");
+        profile::site same("test::aggregate");
+        for (uint64_t nsecs = 1; nsecs <= 100; ++nsecs) {
+            site.record(nsecs * 1000);
+        }
+        same.record(1000000);
+        profile::stats st;
+        REQUIRE(find("test::aggregate", st));
+        CHECK(st.count == 101);
+        CHECK(st.total_nsecs == 5050 * 1000 + 1000000);
+        CHECK(st.min_nsecs == 1000);
+        CHECK(st.max_nsecs == 1000000);
+        CHECK(st.mean_usecs() == doctest::Approx(double(st.total_nsecs) / 101 / 1000));
+        /*
+         * The 51st timing is 51 usecs and in the bin of 32768 to 65535
+         * nsecs.
+         */
+        CHECK(st.percentile_nsecs(0.5) == 65535);
+        CHECK(st.percentile_nsecs(1.0) == 1000000);
+    }
+    TEST_CASE("threads") {
+        profile::reset();
+        profile::site site("test::threads");
+        const size_t num_threads = 4;
+        const size_t records = 1000;
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < num_threads; ++t) {
+            threads.emplace_back([&site, t] {
+                for (size_t r = 0; r < records; ++r) {
+                    site.record(t + 1);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        site.record(100);
+        profile::stats st;
+        REQUIRE(find("test::threads", st));
+        CHECK(st.count == num_threads * records + 1);
+        CHECK(st.total_nsecs == (1 + 2 + 3 + 4) * records + 100);
+        CHECK(st.min_nsecs == 1);
+        CHECK(st.max_nsecs == 100);
+    }
+    TEST_CASE("reset") {
+        profile::site site("test::reset");
+        site.record(10);
+        std::thread thread([&site] { site.record(20); });
+        thread.join();
+        profile::stats st;
+        REQUIRE(find("test::reset", st));
+        profile::reset();
+        CHECK_FALSE(find("test::reset", st));
+        site.record(30);
+        REQUIRE(find("test::reset", st));
+        CHECK(st.count == 1);
+        CHECK(st.total_nsecs == 30);
+    }
+    TEST_CASE("output") {
+        profile::reset();
+        profile::site site("test::output");
+        site.record(2000);
+        std::ostringstream out;
+        profile::output(out);
+        CHECK(out.str().find("p99-us") != std::string::npos);
+        CHECK(out.str().find("test::output") != std::string::npos);
+        profile::reset();
+    }
+}
@@ -0,0 +1,185 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2022 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file test_pixie_stats.cpp
+ * @brief Provides test coverage for the streaming statistics accumulators.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <doctest/doctest.h>
+
+#include <pixie/error.hpp>
+#include <pixie/stats.hpp>
+
+namespace stats = xia::pixie::stats;
+
+TEST_SUITE("xia::pixie::stats") {
+    TEST_CASE("moments") {
+        stats::moments m;
+        CHECK(m.count == 0);
+        CHECK(m.variance() == 0);
+        for (double v : {2, 4, 4, 4, 5, 5, 7, 9}) {
+            m.update(v);
+        }
+        CHECK(m.count == 8);
+        CHECK(m.mean == doctest::Approx(5));
+        CHECK(m.variance() == doctest::Approx(32.0 / 7));
+        CHECK(m.min == 2);
+        CHECK(m.max == 9);
+        SUBCASE("merge") {
+            stats::moments a;
+            stats::moments b;
+            for (double v : {2, 4, 4}) {
+                a.update(v);
+            }
+            for (double v : {4, 5, 5, 7, 9}) {
+                b.update(v);
+            }
+            a.merge(b);
+            CHECK(a.count == m.count);
+            CHECK(a.mean == doctest::Approx(m.mean));
+            CHECK(a.variance() == doctest::Approx(m.variance()));
+            CHECK(a.min == m.min);
+            CHECK(a.max == m.max);
+        }
+    }
+    TEST_CASE("quantile") {
+        stats::quantile median;
+        CHECK(median.value() == 0);
+        for (double v : {5, 1, 3}) {
+            median.update(v);
+        }
+        CHECK(median.value() == 3);
+        std::mt19937 gen(1);
+        std::normal_distribution<double> normal(100, 10);
+        stats::quantile q50(0.5);
+        stats::quantile q90(0.9);
+        std::vector<double> values;
+        for (int v = 0; v < 20000; ++v) {
+            auto value = normal(gen);
+            values.push_back(value);
+            q50.update(value);
+            q90.update(value);
+        }
+        std::sort(values.begin(), values.end());
+        CHECK(q50.count() == values.size());
+        CHECK(q50.value() == doctest::Approx(values[values.size() / 2]).epsilon(0.01));
+        CHECK(q90.value() == doctest::Approx(values[values.size() * 9 / 10]).epsilon(0.01));
+    }
+    TEST_CASE("histogram") {
+        CHECK_THROWS_AS(stats::histogram(1, 1, 10), xia::pixie::error::error);
+        CHECK_THROWS_AS(stats::histogram(0, 1, 0), xia::pixie::error::error);
+        stats::histogram hist(0, 10, 10);
+        CHECK(hist.width == 1);
+        for (int v = 0; v < 10; ++v) {
+            hist.update(v + 0.5, 10);
+        }
+        hist.update(-1);
+        hist.update(10);
+        CHECK(hist.total == 102);
+        CHECK(hist.underflow == 1);
+        CHECK(hist.overflow == 1);
+        CHECK(hist.counts[3] == 10);
+        CHECK(hist.bin_low(3) == 3);
+        CHECK(hist.quantile(0.5) == doctest::Approx(5));
+        CHECK(hist.quantile(0) == 0);
+        CHECK(hist.quantile(1) == 10);
+        hist.clear();
+        CHECK(hist.total == 0);
+        CHECK(hist.quantile(0.5) == 0);
+    }
+    TEST_CASE("interval rates") {
+        xia::pixie::hw::config config;
+        config.adc_msps = 100;
+        config.adc_clk_div = 1;
+        stats::channel from(config);
+        stats::channel to(config);
+        /*
+         * 0.5 secs of real time, 0.25 secs of live time and 1000 input and
+         * 400 output counts in the interval.
+         */
+        const uint64_t real_ticks = uint64_t(0.5 * xia::pixie::hw::system_clock_mhz * 1e6);
+        from.runtime_b = 1000;
+        from.fast_peaks_b = 500;
+        from.chan_events_b = 100;
+        from.live_time_b = 7;
+        to.runtime_a = uint32_t((1000 + real_ticks) >> 32);
+        to.runtime_b = uint32_t(1000 + real_ticks);
+        to.fast_peaks_b = 1500;
+        to.chan_events_b = 500;
+        to.live_time_b = 7 + 25000000;
+        stats::channel_interval rate(from, to);
+        CHECK(rate.input_counts == 1000);
+        CHECK(rate.output_counts == 400);
+        CHECK(rate.real_time == doctest::Approx(0.5));
+        CHECK(rate.live_time == doctest::Approx(0.25));
+        CHECK(rate.input_count_rate() == doctest::Approx(4000));
+        CHECK(rate.output_count_rate() == doctest::Approx(800));
+        CHECK(rate.live_fraction() == doctest::Approx(0.5));
+        /*
+         * A new run restarts the counters.
+         */
+        stats::channel_interval restart(to, from);
+        CHECK(restart.input_counts == 500);
+        CHECK(restart.output_counts == 100);
+        CHECK(stats::channel_interval().input_count_rate() == 0);
+        CHECK(stats::channel_interval().live_fraction() == 0);
+    }
+    TEST_CASE("snapshot ring") {
+        stats::snapshots ring(3);
+        CHECK(ring.empty());
+        CHECK(ring.depth() == 3);
+        CHECK_THROWS_AS(ring.at(), xia::pixie::error::error);
+        stats::snapshot snap;
+        for (size_t s = 0; s < 5; ++s) {
+            snap.time = stats::snapshot::clock::now();
+            ring.push(snap);
+        }
+        CHECK(ring.size() == 3);
+        CHECK(ring.at(0).sequence == 5);
+        CHECK(ring.at(2).sequence == 3);
+        CHECK_THROWS_AS(ring.at(3), xia::pixie::error::error);
+        stats::intervals rates;
+        CHECK_NOTHROW(ring.rates(rates, 2));
+        CHECK(rates.empty());
+        ring.clear();
+        CHECK(ring.empty());
+    }
+    TEST_CASE("baseline noise") {
+        stats::baseline_noise noise;
+        std::mt19937 gen(2);
+        std::normal_distribution<double> normal(0, 2);
+        for (int bl = 0; bl < 10000; ++bl) {
+            /*
+             * A slow drift is not noise.
+             */
+            noise.update(1000 + bl * 0.01 + normal(gen));
+        }
+        CHECK(noise.values.count == 10000);
+        CHECK(noise.diffs.count == 9999);
+        CHECK(noise.noise() == doctest::Approx(2).epsilon(0.05));
+        CHECK(noise.values.stddev() > noise.noise());
+        CHECK(noise.median.value() == doctest::Approx(1050).epsilon(0.01));
+        noise.clear();
+        CHECK(noise.values.count == 0);
+    }
+}
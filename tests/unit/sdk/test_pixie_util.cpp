@@ -21,6 +21,12 @@
  */
 
 
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
 #include <doctest/doctest.h>
 #include <pixie/util.hpp>
 
@@ -72,6 +78,31 @@ TEST_SUITE("xia::util") {
             CHECK(xia::util::ieee_float(0xbf800000u) == -1.0);
             CHECK(xia::util::ieee_float(-1.0) == xia::util::ieee_float(0xbf800000u));
         }
+        SUBCASE("Truncation") {
+            CHECK(xia::util::ieee_float(0.1) == 0x3dccccccu);
+            CHECK(xia::util::ieee_float(-0.1) == 0xbdccccccu);
+            CHECK(xia::util::ieee_float(16777215.0) == 0x4b7fffffu);
+            CHECK(xia::util::ieee_float(std::ldexp(1.0, -9)) == 0x3b000000u);
+        }
+        SUBCASE("Arrays") {
+            const std::vector<xia::util::ieee_float::value_type> words = {
+                0x3f000000u, 0x40490fdbu, 0xc958a450u, 0x3e22d0e5u, 0x00000000u,
+                0x7f800000u, 0xbf800000u, 0x3f800000u, 0x4b7fffffu};
+            std::vector<double> doubles(words.size());
+            xia::util::ieee_float::to_doubles(words.data(), doubles.data(), words.size());
+            bool same = true;
+            for (size_t w = 0; w < words.size(); ++w) {
+                same = same && doubles[w] == double(xia::util::ieee_float(words[w]));
+            }
+            CHECK(same);
+            std::vector<xia::util::ieee_float::value_type> back(words.size());
+            xia::util::ieee_float::to_values(doubles.data(), back.data(), back.size());
+            CHECK(back[0] == words[0]);
+            CHECK(back[1] == words[1]);
+            CHECK(back[2] == words[2]);
+            CHECK(back[7] == words[7]);
+            CHECK(back[8] == words[8]);
+        }
     }
 
     TEST_CASE("dequote") {
@@ -84,6 +115,12 @@ TEST_SUITE("xia::util") {
                              std::runtime_error);
     }
 
+    TEST_CASE("host_little_endian") {
+        const uint32_t word = 0x22221111;
+        uint16_t samples[2];
+        std::memcpy(samples, &word, sizeof(word));
+        CHECK(xia::util::host_little_endian() == (samples[0] == 0x1111));
+    }
     TEST_CASE("ltrim") {
         std::string test = "    trim";
         xia::util::ltrim(test);
@@ -153,6 +190,28 @@ TEST_SUITE("xia::util") {
                 chksum2 << val;
             CHECK(chksum2.value == expected);
         }
+        SUBCASE("Large and incremental updates") {
+            std::vector<unsigned char> data(4099);
+            uint32_t reference = 0xffffffff;
+            for (size_t i = 0; i < data.size(); ++i) {
+                data[i] = static_cast<unsigned char>((i * 131) ^ (i >> 3));
+                reference ^= data[i];
+                for (int b = 0; b < 8; ++b) {
+                    reference = (reference >> 1) ^ (0xedb88320 & (0 - (reference & 1)));
+                }
+            }
+            reference = ~reference;
+            auto whole = xia::util::crc32();
+            whole.update(data);
+            CHECK(whole.value == reference);
+            for (size_t start : {1, 7, 8, 13, 4000}) {
+                auto parts = xia::util::crc32();
+                std::vector<unsigned char> first(data.begin(), data.begin() + start);
+                parts.update(first);
+                parts.update(data, start);
+                CHECK(parts.value == reference);
+            }
+        }
         SUBCASE("Clear") {
             auto chksum3 = xia::util::crc32();
             chksum3.value = expected;
@@ -160,4 +219,69 @@ TEST_SUITE("xia::util") {
             CHECK(chksum3.value == 0);
         }
     }
+    TEST_CASE("parse_cpu_list") {
+        xia::util::cpus cpus;
+        xia::util::parse_cpu_list(cpus, "0-3,8,10-11");
+        CHECK(cpus == xia::util::cpus({0, 1, 2, 3, 8, 10, 11}));
+        xia::util::parse_cpu_list(cpus, "");
+        CHECK(cpus.empty());
+        CHECK_THROWS_WITH_AS(xia::util::parse_cpu_list(cpus, "0-x"), "invalid CPU list: 0-x",
+                             std::runtime_error);
+        CHECK_THROWS_WITH_AS(xia::util::parse_cpu_list(cpus, "4-2"), "invalid CPU list: 4-2",
+                             std::runtime_error);
+    }
+    TEST_CASE("cpu_list") {
+        CHECK(xia::util::cpu_list({}) == "");
+        CHECK(xia::util::cpu_list({0, 1, 2, 3, 8, 10, 11}) == "0-3,8,10-11");
+        xia::util::cpus cpus;
+        xia::util::parse_cpu_list(cpus, xia::util::cpu_list({2, 4, 5}));
+        CHECK(cpus == xia::util::cpus({2, 4, 5}));
+    }
+    TEST_CASE("thread placement") {
+        std::thread thread([] {});
+        CHECK_FALSE(xia::util::set_thread_affinity(thread, {}));
+        thread.join();
+        CHECK_FALSE(xia::util::set_thread_affinity(thread, {0}));
+        CHECK_FALSE(xia::util::set_thread_scheduling(thread, xia::util::sched_policy::fifo, 1));
+    }
+    TEST_CASE("thread_pool") {
+        xia::util::thread_pool pool;
+        CHECK_FALSE(pool.running());
+        CHECK_THROWS_WITH_AS(pool.submit(0, [] {}), "thread pool not running",
+                             std::runtime_error);
+        pool.start(3);
+        CHECK(pool.running());
+        CHECK(pool.size() == 3);
+        SUBCASE("Tasks run on their worker") {
+            std::vector<std::thread::id> ids(6);
+            std::vector<std::future<void>> futures;
+            for (size_t t = 0; t < ids.size(); ++t) {
+                futures.push_back(
+                    pool.submit(t, [t, &ids] { ids[t] = std::this_thread::get_id(); }));
+            }
+            for (auto& future : futures) {
+                future.get();
+            }
+            for (size_t t = 0; t < 3; ++t) {
+                CHECK(ids[t] == ids[t + 3]);
+                CHECK(ids[t] != std::this_thread::get_id());
+            }
+            CHECK(ids[0] != ids[1]);
+            CHECK(ids[1] != ids[2]);
+        }
+        SUBCASE("Errors") {
+            auto future = pool.submit(1, [] { throw std::runtime_error("task failed"); });
+            CHECK_THROWS_WITH_AS(future.get(), "task failed", std::runtime_error);
+            CHECK_NOTHROW(pool.submit(1, [] {}).get());
+        }
+        SUBCASE("Stop runs queued tasks") {
+            std::atomic<size_t> count(0);
+            for (size_t t = 0; t < 100; ++t) {
+                pool.submit(t, [&count] { ++count; });
+            }
+            pool.stop();
+            CHECK(count == 100);
+            CHECK_FALSE(pool.running());
+        }
+    }
 }